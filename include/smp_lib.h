@@ -42,8 +42,20 @@
  * Layer draft SPL-4 (revision 2).
  */
 
+/* Thread safety: the library may be called from several threads. Each
+ * thread should use its own smp_target_obj, with the exception that
+ * smp_send_req() (and smp_send_req_batch() ) may be called concurrently
+ * on the same open object. smp_initiator_open() and smp_initiator_close()
+ * may be called concurrently on different objects. Functions that return
+ * a pointer to a static string (e.g. safe_strerror() ) are not thread safe
+ * unless the string is constant; use the _r variant, or those taking a
+ * caller's buffer (e.g. smp_get_func_res_str() ), instead. The session
+ * functions (smp_session_begin() and friends) are for single threaded
+ * programs such as smp_shell. */
+
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 
 #ifdef __cplusplus
@@ -140,6 +152,12 @@ extern "C" {
 #define SMP_SUBVALUE_SEPARATOR ','
 #endif
 
+struct smp_rg_cache;            /* opaque, see smp_get_report_general() */
+struct smp_stats_blk;           /* opaque, see smp_get_stats() */
+struct smp_buf_arena;           /* opaque, see smp_buf_get() */
+struct smp_xport_ops;           /* see smp_xport_register() */
+struct smp_admit_ent;           /* opaque, see smp_admit_get() */
+
 struct smp_target_obj {
     char device_name[SMP_MAX_DEVICE_NAME];
     int subvalue;               /* adapter number (opt) */
@@ -148,6 +166,14 @@ struct smp_target_obj {
     int opened;
     int fd;
     void * vp;                  /* opaque for pass-through (e.g. CAM) */
+    struct smp_rg_cache * rgcp; /* REPORT GENERAL cache, NULL till needed */
+    struct smp_stats_blk * statsp;      /* request statistics */
+    int timeout_ms;             /* 0 -> pass-through's default */
+    int max_retries;            /* see smp_set_req_policy() */
+    int backoff_ms;
+    struct smp_buf_arena * arenap;      /* NULL till smp_buf_get() */
+    struct smp_admit_ent * admitp;      /* NULL -> not admission limited */
+    const struct smp_xport_ops * xops;  /* transport opened with */
 };
 
 /* SAS standards include a 4 byte CRC at the end of each SMP request
@@ -178,6 +204,15 @@ int smp_initiator_open(const char * device_name, int subvalue,
                        const char * i_params, uint64_t sa,
                        struct smp_target_obj * tobj, int verbose);
 
+/* Opens the expander whose SAS address is sa without the caller needing
+ * to know its device name. In Linux an index of SAS address to bsg device,
+ * built from sysfs, is kept in /run/smp_utils/sas_index so that most
+ * lookups need neither a sysfs scan nor more than a hash probe. Also used
+ * by smp_initiator_open() when device_name is "" and sa is non-zero.
+ * Returns 0 on success, else -1 (e.g. no such expander). */
+int smp_initiator_open_by_sa(uint64_t sa, const char * i_params,
+                             struct smp_target_obj * tobj, int verbose);
+
 /* Send a SMP request to the SMP target referred to by tobj. The request
  * and space for the response (including the CRC even if it is not sent
  * or returned) are in the object pointed to by rresp. Returns 0 on
@@ -189,6 +224,580 @@ int smp_send_req(const struct smp_target_obj * tobj,
  * on success, else -1 . */
 int smp_initiator_close(struct smp_target_obj * tobj);
 
+/* Returns the name of the pass-through interface tobj was opened with
+ * (e.g. "sgv4", "mpt", "aac", "cam", "usmp", "sim" or "snapshot") */
+const char * smp_get_interface_str(const struct smp_target_obj * tobj);
+
+#define SMP_BATCH_DEF_INFLIGHT 8
+#define SMP_BATCH_MAX_INFLIGHT 64
+
+/* Called by smp_send_req_batch() as each request completes. 'index' is the
+ * position of rresp in the array given to smp_send_req_batch() and 'res' is
+ * what smp_send_req() returned for it. Calls are serialized. */
+typedef void (*smp_batch_cb_t)(int index, struct smp_req_resp * rresp,
+                               int res, void * cb_arg);
+
+/* Transports (pass-throughs). Each is described by a table of operations
+ * and registered with smp_xport_register(); smp_initiator_open() picks one
+ * by matching the start of i_params against each transport's prefixes or,
+ * if none match, by probing device_name with each transport flagged
+ * SMP_XPORT_AUTO in the order they were registered. The library registers
+ * "sim" and "smpd" then the native pass-throughs of the OS (in Linux
+ * "sgv4" (bsg), "mpt" and "aac"). Further transports can be loaded at the
+ * first open from shared objects listed (colon separated) in the
+ * SMP_UTILS_XPORT environment variable; each object must define
+ *     int smp_xport_module_init(void);
+ * that calls smp_xport_register() and returns 0. */
+#define SMP_XPORT_AUTO 0x1      /* probed when i_params names no transport */
+#define SMP_XPORT_NEEDS_SA 0x2  /* needs the expander's SAS address */
+#define SMP_XPORT_TIMEOUT 0x4   /* honours timeout_ms (smp_set_req_policy) */
+#define SMP_XPORT_NO_DEVICE 0x8 /* no device node, open is complete */
+
+#define SMP_XPORT_MAX 16        /* registered transports, at most */
+
+struct smp_xport_ops {
+    const char * name;          /* from smp_get_interface_str() */
+    const char * prefix[4];     /* i_params prefixes, NULL terminated */
+    int selector;               /* interface_selector, 0 -> assigned */
+    int flags;                  /* SMP_XPORT_* values OR-ed together */
+    int max_inflight;           /* concurrent requests, 0 -> no limit */
+    /* Returns > 0 if device_name looks like one of this transport's, else
+     * 0. NULL -> always tried. */
+    int (*probe)(const char * device_name, int verbose);
+    /* Sets up the transport's part of tobj (e.g. fd or vp); the library
+     * sets the rest. With SMP_XPORT_NO_DEVICE open does it all, like
+     * smp_sim_open(). Returns 0 on success, else -1 . */
+    int (*open)(const char * device_name, int subvalue,
+                const char * i_params, uint64_t sa,
+                struct smp_target_obj * tobj, int verbose);
+    /* One attempt at rresp, sets *timed_outp if the transport timed out.
+     * Returns 0 on success. smp_send_req() does retries and statistics. */
+    int (*send)(const struct smp_target_obj * tobj,
+                struct smp_req_resp * rresp, bool * timed_outp, int verbose);
+    /* Optional: as smp_send_req_batch(), else that uses threads */
+    int (*send_batch)(const struct smp_target_obj * tobj,
+                      struct smp_req_resp * rresp, int num, int max_inflight,
+                      smp_batch_cb_t cb, void * cb_arg, int verbose);
+    /* Releases what open set up; the library frees the rest of tobj.
+     * Returns what smp_initiator_close() should. */
+    int (*close)(struct smp_target_obj * tobj);
+    /* Optional: places the device name of the expander whose SAS address
+     * is sa in b, for smp_initiator_open_by_sa(). Returns 0 if found. */
+    int (*name_by_sa)(uint64_t sa, char * b, int blen, int verbose);
+};
+
+/* Adds xp to the transports that smp_initiator_open() may use; xp must
+ * stay valid. Returns 0 on success, else -1 (e.g. SMP_XPORT_MAX already
+ * registered). */
+int smp_xport_register(const struct smp_xport_ops * xp);
+
+/* Returns the transport tobj was opened with, NULL if none (e.g. a
+ * snapshot replay), so callers can check its flags and max_inflight. */
+const struct smp_xport_ops * smp_xport_get(const struct smp_target_obj *
+                                           tobj);
+
+/* Registers the OS's native transports, called by the library once
+ * before the first open. Defined in smp_lin_sel.c, smp_fre_cam.c or
+ * smp_sol_usmp.c . */
+void smp_xport_native_init(void);
+
+
+/* Sends the num requests in the rresp array to the SMP target referred to
+ * by tobj keeping up to max_inflight of them outstanding (0 -> default of
+ * SMP_BATCH_DEF_INFLIGHT). Requests are started in array order but may
+ * complete in any order. If cb is non-NULL it is called once per request
+ * as it completes. Returns once all have completed: the number of requests
+ * for which smp_send_req() failed (so 0 is success), or -1 if the arguments
+ * are bad. Function results and transport errors are left in each element
+ * of rresp for the caller to check. */
+int smp_send_req_batch(const struct smp_target_obj * tobj,
+                       struct smp_req_resp * rresp, int num,
+                       int max_inflight, smp_batch_cb_t cb, void * cb_arg,
+                       int verbose);
+
+/* Checks one element of rresp after smp_send_req_batch() has returned.
+ * Returns the function result (0 for accepted) of its response, else
+ * SMP_LIB_CAT_MALFORMED if that is not a response to func, or -1 if the
+ * request failed (transport error or no response). */
+int smp_batch_resp_res(const struct smp_req_resp * rresp, int func);
+
+/* One SMP target's share of smp_send_req_lockstep(). sent_us and lat_us,
+ * if non-NULL, point to num elements that are given the
+ * smp_stats_clock_us() time each request was sent and its latency in
+ * microseconds (retries included). failed is set to the number of
+ * smp_send_req() failures. */
+struct smp_lockstep_tgt {
+    const struct smp_target_obj * tobj;
+    struct smp_req_resp * rresp;
+    int num;
+    uint64_t * sent_us;
+    uint32_t * lat_us;
+    int failed;
+};
+
+/* Sends the requests of num_tgts SMP targets (all opened by the caller),
+ * up to max_inflight outstanding per target as with smp_send_req_batch().
+ * Every sending thread of every target is started first and they gather
+ * at a barrier, then are released together so the first request to each
+ * target is sent as close to the same moment as possible; that moment is
+ * placed in *release_usp if that is non-NULL. The transports' own batch
+ * paths are not used so that each request can be timed. Returns the total
+ * number of smp_send_req() failures (so 0 is success), or -1 if the
+ * arguments are bad or a thread could not be started (then nothing is
+ * sent). */
+int smp_send_req_lockstep(struct smp_lockstep_tgt * ltp, int num_tgts,
+                          int max_inflight, uint64_t * release_usp,
+                          int verbose);
+
+/* Registers tobj (already opened with smp_initiator_open()) as the target
+ * of a session. Until smp_session_end() is called, smp_initiator_open() of
+ * the same device name and subvalue (and SAS address, if non-zero) yields
+ * a copy of tobj without re-opening and smp_initiator_close() of a copy
+ * leaves the device open. Used by smp_shell. Returns 0 on success, else
+ * -1 (e.g. a session is already active). */
+int smp_session_begin(struct smp_target_obj * tobj);
+
+/* Ends the session, the caller should then close its tobj */
+void smp_session_end(void);
+
+/* These two are used by the smp_initiator_open() and smp_initiator_close()
+ * implementations. smp_session_lookup() returns true (and fills tobj) if
+ * the given device is the session target. smp_session_member() returns
+ * true if tobj is a copy of the session target. */
+bool smp_session_lookup(const char * device_name, int subvalue, uint64_t sa,
+                        struct smp_target_obj * tobj);
+bool smp_session_member(const struct smp_target_obj * tobj);
+
+#define SMP_REPORT_GENERAL_RESP_LEN 76  /* max, includes CRC */
+
+/* Decoded REPORT GENERAL response. Fields past the response's length are
+ * zero. resp_len is the response length in bytes, excluding the CRC. A
+ * zero 'sas2' indicates a SAS-1.1 (or earlier) response. */
+struct smp_report_general {
+    bool sas2;
+    bool long_response;
+    bool table_to_table_sup;
+    bool zone_configuring;
+    bool self_configuring;
+    bool configures_others;
+    bool configuring;
+    bool ext_config_route_table;
+    bool zoning_supported;
+    bool zoning_enabled;
+    bool zone_locked;
+    bool phys_presence_sup;
+    bool phys_presence_asserted;
+    uint8_t num_phys;
+    uint16_t exp_change_count;
+    uint16_t exp_route_indexes;
+    uint16_t max_routed_sas_addrs;
+    int num_zone_groups;        /* 128 or 256 */
+    uint64_t enclosure_logical_id;
+    uint64_t active_zm_sas_addr;
+    int resp_len;
+    uint8_t resp[SMP_REPORT_GENERAL_RESP_LEN];
+};
+
+/* Fetches the REPORT GENERAL response of tobj, decoded, into rgp. The
+ * response is cached on tobj and a cached copy no older than max_age_ms
+ * milliseconds is returned without a SMP round-trip. A max_age_ms of 0
+ * always fetches afresh, a negative value accepts a cached copy of any
+ * age. The cache is invalidated when smp_send_req() sees a response with
+ * a different expander change count on that target, or a successful
+ * configure function. Returns 0 on success, the SMP function result if
+ * it is non-zero, SMP_LIB_CAT_MALFORMED for a response that makes no
+ * sense, else -1 (e.g. transport error). */
+int smp_get_report_general(struct smp_target_obj * tobj,
+                           struct smp_report_general * rgp, int max_age_ms,
+                           int verbose);
+
+/* Decodes a REPORT GENERAL response in rp, len bytes long (excluding CRC),
+ * into rgp. */
+void smp_decode_report_general(const uint8_t * rp, int len,
+                               struct smp_report_general * rgp);
+
+/* Discards any cached REPORT GENERAL response of tobj */
+void smp_rg_cache_invalidate(const struct smp_target_obj * tobj);
+
+/* Used by the smp_send_req() and smp_initiator_close() implementations to
+ * keep the REPORT GENERAL cache of tobj in step with its responses, and
+ * to release it. smp_rg_cache_get() allocates the cache if needed. */
+void smp_rg_cache_note(const struct smp_target_obj * tobj,
+                       const struct smp_req_resp * rresp);
+struct smp_rg_cache * smp_rg_cache_get(struct smp_target_obj * tobj);
+void smp_rg_cache_free(struct smp_target_obj * tobj);
+
+/* Sets the request policy of tobj, which smp_initiator_open() takes from
+ * the SMP_UTILS_TIMEOUT (milliseconds) and SMP_UTILS_RETRIES environment
+ * variables, else defaults. timeout_ms of 0 is the pass-through's default
+ * (not all pass-throughs allow it to be changed). A request answered with
+ * BUSY is sent again up to max_retries times, waiting backoff_ms (doubled
+ * for each later retry, with jitter) first. A request that times out is
+ * retried likewise, but only when timeout_ms is non-zero. A negative value
+ * leaves that setting unchanged. Returns 0 on success, else -1. */
+int smp_set_req_policy(struct smp_target_obj * tobj, int timeout_ms,
+                       int max_retries, int backoff_ms);
+
+/* Used by smp_initiator_open() and smp_send_req() implementations. The
+ * latter calls smp_req_retry() after each attempt (counting from 0); it
+ * returns true, after sleeping, if the request should be sent again. */
+void smp_req_policy_init(struct smp_target_obj * tobj);
+bool smp_req_retry(const struct smp_target_obj * tobj,
+                   const struct smp_req_resp * rresp, int res,
+                   bool timed_out, int attempt, int verbose);
+
+/* Admission control: smp_send_req() (and so smp_send_req_batch() ) is
+ * limited per expander, across all threads and target objects of the
+ * process, to a number of requests in flight that is halved when the
+ * expander answers BUSY and creeps back up to max_inflight (default
+ * SMP_BATCH_DEF_INFLIGHT) while it does not; optionally also to a rate.
+ * The SMP_UTILS_ADMIT environment variable sets limits, per expander
+ * model if wanted, and whether they hold across processes (see
+ * lib/smp_admit.c and smp_utils(8)). smp_admit_set() overrides them for
+ * the expander tobj is open on (max_inflight up to 64, a rate in requests
+ * per second with 0 for no limit, a value < 0 left unchanged, and
+ * max_inflight of 0 likewise) and smp_admit_get() reports the state.
+ * Both return 0 on success, else -1 (e.g. admission control is off). */
+struct smp_admit_info {
+    int max_inflight;
+    int limit;                  /* current concurrency limit */
+    int inflight;
+    int rate;                   /* requests per second, 0 -> none */
+    bool shared;                /* limit held across processes */
+    uint32_t num_busy;          /* BUSY answers seen */
+    uint32_t num_waits;         /* requests that waited for a slot */
+    char vendor[9];             /* "" until REPORT MANUFACTURER seen */
+    char product[17];
+};
+
+int smp_admit_set(const struct smp_target_obj * tobj, int max_inflight,
+                  int rate);
+int smp_admit_get(const struct smp_target_obj * tobj,
+                  struct smp_admit_info * aip);
+
+/* Sends REPORT MANUFACTURER INFORMATION, once per expander, when
+ * SMP_UTILS_ADMIT has per model rules and the model is not yet known.
+ * Returns 0 (also when nothing was sent), else what smp_send_req()
+ * returned. smp_send_req_batch() calls it. */
+int smp_admit_identify(const struct smp_target_obj * tobj, int verbose);
+
+/* Used by the smp_initiator_open() (through smp_req_policy_init() ) and
+ * smp_send_req() implementations. smp_admit_enter() waits for a slot
+ * before each attempt and returns a value to give to smp_admit_exit()
+ * with the outcome. */
+void smp_admit_attach(struct smp_target_obj * tobj);
+int smp_admit_enter(const struct smp_target_obj * tobj);
+void smp_admit_exit(const struct smp_target_obj * tobj, int slot,
+                    const struct smp_req_resp * rresp, int res, int verbose);
+
+/* Request statistics, kept per target object from smp_initiator_open()
+ * until smp_initiator_close(). Latencies (in microseconds) are counted in
+ * log2 buckets: hist[0] holds those under 2 us, hist[k] those from 2**k up
+ * to 2**(k+1) us and the last bucket the rest (over 8 seconds). */
+#define SMP_STATS_HIST_LEN 24
+#define SMP_STATS_NUM_FUNCS 256         /* indexed by SMP function code */
+
+struct smp_func_stats {
+    uint32_t count;             /* requests sent */
+    uint32_t send_fail;         /* smp_send_req() returned non-zero */
+    uint32_t transport_err;     /* response with transport_err set */
+    uint32_t busy;              /* SMP_FRES_BUSY function result */
+    uint32_t fres_err;          /* other non-zero function results */
+    uint32_t timeout;           /* pass-through reported a timeout */
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t hist[SMP_STATS_HIST_LEN];
+};
+
+struct smp_stats {
+    uint64_t start_us;          /* CLOCK_MONOTONIC at open (or reset) */
+    struct smp_func_stats fn[SMP_STATS_NUM_FUNCS];
+};
+
+/* Copies the statistics of tobj into sp. Returns 0 on success, else -1
+ * (e.g. tobj not open). */
+int smp_get_stats(const struct smp_target_obj * tobj, struct smp_stats * sp);
+
+/* Zeroes the statistics of tobj */
+void smp_reset_stats(const struct smp_target_obj * tobj);
+
+/* Outputs the statistics of tobj to fp, one line per SMP function used.
+ * smp_initiator_close() does this when the SMP_UTILS_STATS environment
+ * variable names a file (appended to) or is "-" (stderr). Returns 0 on
+ * success, else -1. */
+int smp_dump_stats(const struct smp_target_obj * tobj, FILE * fp);
+
+/* Used by the smp_initiator_open(), smp_send_req() and
+ * smp_initiator_close() implementations. smp_send_req() takes
+ * smp_stats_clock_us() before sending and passes it as start_us along
+ * with its result (res) and whether the pass-through timed out. */
+uint64_t smp_stats_clock_us(void);
+void smp_stats_attach(struct smp_target_obj * tobj);
+void smp_stats_note(const struct smp_target_obj * tobj,
+                    const struct smp_req_resp * rresp, int res,
+                    bool timed_out, uint64_t start_us);
+void smp_stats_free(struct smp_target_obj * tobj);
+
+/* Response buffers cut from an arena kept on tobj, so that polling
+ * programs get buffers without heap traffic. smp_buf_get() returns len
+ * bytes (zeroed, aligned to at least 64 bytes) or NULL if the arena of
+ * SMP_BUF_ARENA_LEN bytes is exhausted. smp_buf_reset() releases all
+ * buffers got from tobj; smp_initiator_close() frees the arena with
+ * smp_buf_free(). Like smp_memalign() buffers but never free()-ed. */
+#define SMP_BUF_ARENA_LEN (32 * 1024)
+
+uint8_t * smp_buf_get(struct smp_target_obj * tobj, int len);
+void smp_buf_reset(struct smp_target_obj * tobj);
+void smp_buf_free(struct smp_target_obj * tobj);
+
+/* Request frame templates, for programs that send the same function
+ * (with the same options) many times, varying only the phy identifier or
+ * starting index. smp_tmpl_init() builds the frame once: req_len is the
+ * request length in bytes including the CRC (0 for the function's SAS-1
+ * default), and the Allocated Response Length and Request Length fields
+ * are set from max_resp_len and req_len unless zero_lens (SAS-1.1). The
+ * caller may then set option bytes in tp->req directly. resp (of
+ * max_resp_len bytes) is reused by each send. smp_tmpl_set_idx() patches
+ * the phy identifier (DISCOVER LIST: starting phy identifier; REPORT PHY
+ * EVENT LIST: starting descriptor index) and is ignored by functions that
+ * have none. smp_tmpl_send() clears the response header, not the whole
+ * response, then calls smp_send_req() on tp->rr and returns its result;
+ * response bytes beyond the length the response gives (or not received,
+ * if the pass-through can't tell) are left over from earlier sends.
+ * smp_tmpl_init() returns 0, or -1 for bad arguments. */
+#define SMP_TMPL_MAX_REQ_LEN 64
+
+struct smp_req_tmpl {
+    struct smp_req_resp rr;     /* request is req, response is resp */
+    int idx_off;                /* offset of the index in req, -1: none */
+    int idx_width;              /* 1 or 2 (big endian) bytes */
+    uint8_t req[SMP_TMPL_MAX_REQ_LEN];
+};
+
+int smp_tmpl_init(struct smp_req_tmpl * tp, int func_code, int req_len,
+                  uint8_t * resp, int max_resp_len, bool zero_lens,
+                  int verbose);
+void smp_tmpl_set_idx(struct smp_req_tmpl * tp, unsigned int idx);
+int smp_tmpl_send(const struct smp_target_obj * tobj,
+                  struct smp_req_tmpl * tp, int verbose);
+
+/* Fabric snapshots: every SMP request and its response recorded to a file
+ * that can later be replayed in place of the hardware. After
+ * smp_snap_save_begin() each successful smp_send_req() is recorded along
+ * with the target (device name, subvalue and SAS address) it was sent to;
+ * smp_snap_save_end() writes them to fn, indexed by expander SAS address,
+ * function and phy id. After smp_snap_load() (which mmap()s fn and checks
+ * only its header) smp_initiator_open() opens targets in the snapshot,
+ * chosen by device name, else SAS address, else the first, and
+ * smp_send_req() answers from the snapshot. Begin, end, load and unload
+ * should be called from a single thread. Each returns 0 on success, else
+ * SMP_LIB_FILE_ERROR or -1. */
+#define SMP_SNAP_INTERFACE 0x100        /* interface_selector of replay */
+
+int smp_snap_save_begin(const char * fn, int verbose);
+int smp_snap_save_end(int verbose);
+int smp_snap_load(const char * fn, int verbose);
+void smp_snap_unload(void);
+
+/* Used by the smp_initiator_open(), smp_send_req() and
+ * smp_initiator_close() implementations. When smp_snap_replaying() is
+ * true they defer to smp_snap_open(), smp_snap_send_req() and
+ * smp_snap_close() respectively, the latter two for a tobj that is a
+ * smp_snap_member(). smp_send_req() passes each response with its result
+ * to smp_snap_note(). */
+bool smp_snap_replaying(void);
+bool smp_snap_member(const struct smp_target_obj * tobj);
+int smp_snap_open(const char * device_name, int subvalue, uint64_t sa,
+                  struct smp_target_obj * tobj, int verbose);
+int smp_snap_send_req(const struct smp_target_obj * tobj,
+                      struct smp_req_resp * rresp, int verbose);
+int smp_snap_close(struct smp_target_obj * tobj);
+void smp_snap_note(const struct smp_target_obj * tobj,
+                   const struct smp_req_resp * rresp, int res);
+
+/* Tracing of each request and response frame sent by smp_send_req() (each
+ * attempt when retried) with a time stamp and the pass-through duration,
+ * to fn in pcap format (link type USER0). Records go through a lock free
+ * ring buffer drained by a background thread, full means dropped. Started
+ * by smp_trace_begin() or, at the first request, when the SMP_UTILS_TRACE
+ * environment variable names a file (then stopped at exit). smp_trace_end()
+ * flushes the file. Both return 0 on success, else SMP_LIB_FILE_ERROR or
+ * -1. smp_trace_note() is used by the smp_send_req() implementations. */
+int smp_trace_begin(const char * fn, int verbose);
+int smp_trace_end(int verbose);
+void smp_trace_note(const struct smp_target_obj * tobj,
+                    const struct smp_req_resp * rresp, int res,
+                    bool timed_out, int attempt, uint64_t start_us);
+
+/* Simulated expanders, selected by an i_params string (the --interface=
+ * option of the utilities) starting with "sim", optionally followed by
+ * comma separated parameters: phys=N (per expander, default 12), exp=K
+ * (child expanders per expander), depth=D (levels of child expanders,
+ * default 1 when exp given), lat=US (added to each request), busy=PCT
+ * (percentage of requests answered BUSY), routes=R (route table entries
+ * per phy) and zoning (enabled at start). A domain is built in memory
+ * for each SMP_DEVICE name (which need not exist) the first time it is
+ * opened and is kept, with any changes configure functions make to it,
+ * until the process exits; sa, when non-zero, chooses an expander in it.
+ * The smp_initiator_open(), smp_send_req() and smp_initiator_close()
+ * implementations call these for such targets. */
+#define SMP_SIM_INTERFACE 0x101         /* interface_selector of sim */
+
+int smp_sim_open(const char * device_name, int subvalue,
+                 const char * i_params, uint64_t sa,
+                 struct smp_target_obj * tobj, int verbose);
+int smp_sim_send_req(const struct smp_target_obj * tobj,
+                     struct smp_req_resp * rresp, int verbose);
+int smp_sim_close(struct smp_target_obj * tobj);
+
+/* The smpd daemon owns the SMP targets of a fabric. Clients reach it
+ * through a Unix socket by giving an i_params string starting with
+ * "smpd", optionally followed by ",sock=PATH" (default SMP_SMPD_SOCKET).
+ * smp_initiator_open() then asks smpd for the target it holds with that
+ * SAS address (else that device name, else its first) and smp_send_req()
+ * has smpd send each request; identical report requests from different
+ * clients that are in flight at the same time share one SMP round-trip.
+ * Each message on the socket is a struct smp_smpd_msg and 'len' bytes
+ * (device name, request or response), in host byte order. The
+ * smp_initiator_open(), smp_send_req() and smp_initiator_close()
+ * implementations call these for such targets. */
+#define SMP_SMPD_INTERFACE 0x102        /* interface_selector of smpd */
+#define SMP_SMPD_SOCKET "/run/smpd.sock"
+#define SMP_SMPD_SHM "/dev/shm/smpd"
+#define SMP_SMPD_MAGIC 0x534d5044       /* "SMPD" */
+#define SMP_SMPD_OP_OPEN 1
+#define SMP_SMPD_OP_REQ 2
+#define SMP_SMPD_MAX_FRAME 1032         /* request or response, with CRC */
+
+struct smp_smpd_msg {
+    uint32_t magic;
+    uint16_t op;
+    uint16_t target;            /* [o] of OP_OPEN, [i] of OP_REQ */
+    uint32_t tag;               /* echoed in the reply */
+    int32_t res;                /* [o] smp_send_req() result */
+    int32_t act_resp_len;       /* [o] */
+    int32_t transport_err;      /* [o] */
+    uint32_t max_resp_len;      /* [i] OP_REQ; subvalue of OP_OPEN */
+    uint32_t len;               /* bytes that follow */
+    uint64_t sas_addr;          /* [i] OP_OPEN, [o] too */
+};
+
+int smp_smpd_open(const char * device_name, int subvalue,
+                  const char * i_params, uint64_t sa,
+                  struct smp_target_obj * tobj, int verbose);
+int smp_smpd_send_req(const struct smp_target_obj * tobj,
+                      struct smp_req_resp * rresp, int verbose);
+int smp_smpd_close(struct smp_target_obj * tobj);
+
+/* smpd also publishes its model of the fabric, kept current using change
+ * counts, in a file (default SMP_SMPD_SHM) that readers map. It holds a
+ * header then num_exps expander records, exp_len bytes apart, each with
+ * the last REPORT GENERAL response and the last DISCOVER response of
+ * every phy (len 0 if not yet known). An expander record is rewritten
+ * between two increments of its 'seq' (odd while being written) and 'gen'
+ * is incremented after each rewrite, so a reader can poll 'gen' and copy
+ * with the smp_smpd_read_*() functions below without any system call. */
+#define SMP_SMPD_SHM_MAGIC 0x534d504d   /* "SMPM" */
+#define SMP_SMPD_SHM_VERSION 1
+#define SMP_SMPD_MAX_PHYS 256
+#define SMP_SMPD_DISC_LEN 124           /* DISCOVER response, with CRC */
+
+struct smp_smpd_shm_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_exps;
+    uint32_t exp_len;
+    uint64_t gen;               /* incremented after each update */
+    uint32_t pid;               /* of smpd */
+    uint32_t active;            /* 0 after smpd exits */
+    uint32_t interval_ms;       /* REPORT GENERAL poll interval */
+    uint32_t reserved[7];
+};
+
+struct smp_smpd_shm_phy {
+    uint32_t len;               /* of resp, 0 -> not known */
+    uint8_t resp[SMP_SMPD_DISC_LEN];
+};
+
+struct smp_smpd_shm_exp {
+    uint32_t seq;               /* odd while being rewritten */
+    int32_t status;             /* 0, else result of last failed poll */
+    uint64_t sas_addr;
+    uint64_t update_us;         /* smp_stats_clock_us() of last rewrite */
+    uint64_t poll_us;           /* of last poll, outside seq */
+    uint32_t num_phys;
+    uint32_t rg_len;
+    uint8_t rg_resp[SMP_REPORT_GENERAL_RESP_LEN];
+    char device_name[SMP_MAX_DEVICE_NAME];
+    struct smp_smpd_shm_phy phys[SMP_SMPD_MAX_PHYS];
+};
+
+/* Maps the model published by smpd at path (NULL for SMP_SMPD_SHM)
+ * read-only. Returns its header, else NULL. */
+const struct smp_smpd_shm_hdr * smp_smpd_map(const char * path,
+                                             int verbose);
+void smp_smpd_unmap(const struct smp_smpd_shm_hdr * hp);
+
+/* Returns the index of the expander record with SAS address sa, else
+ * -1. */
+int smp_smpd_find_exp(const struct smp_smpd_shm_hdr * hp, uint64_t sa);
+
+/* Copy a consistent version of expander record exp_idx (less its phys),
+ * or of the DISCOVER response of one of its phys, to the caller. The
+ * latter returns the response length (0 if not known) while the former
+ * returns 0; both return -1 for a bad index or a record smpd never
+ * published. */
+int smp_smpd_read_exp(const struct smp_smpd_shm_hdr * hp, int exp_idx,
+                      struct smp_smpd_shm_exp * ep);
+int smp_smpd_read_phy(const struct smp_smpd_shm_hdr * hp, int exp_idx,
+                      int phy_id, uint8_t * resp, int max_resp_len);
+
+/* Returns 1 if the SMP target (an expander) supports the DISCOVER LIST
+ * function, 0 if it does not (e.g. a SAS-1.1 expander answering UNKNOWN
+ * SMP FUNCTION), else -1 (e.g. transport error). The first call for an
+ * expander sends a small DISCOVER LIST probe, unless the capability cache
+ * (see smp_caps_get() ) already knows; the answer is cached for the life
+ * of the process keyed by SAS address (or device name if tobj was opened
+ * without one), and in the capability cache. */
+int smp_discover_list_supported(struct smp_target_obj * tobj, int verbose);
+
+/* Records in that cache what a DISCOVER LIST request to tobj found, for
+ * callers that learn it without smp_discover_list_supported(). */
+void smp_discover_list_cap_set(const struct smp_target_obj * tobj,
+                               bool supported);
+
+/* Expander capability cache, kept across runs (in /run/smp_utils/caps
+ * unless the SMP_UTILS_CAPS environment variable names another file, or
+ * is "off" to keep it in memory only). Traits are kept per expander model
+ * (vendor, product and firmware revision from REPORT MANUFACTURER
+ * INFORMATION, which smp_send_req() passes to smp_caps_resp_note()), so a
+ * trait learnt from one expander holds for others of the same model; the
+ * model of each SMP target is remembered by SAS address (else device
+ * name). smp_caps_get() fills cp for tobj and returns 0, or returns -1 if
+ * nothing is known; cp->known says which traits are. smp_caps_note()
+ * records the traits in which (taken from cp) for tobj's model, or for
+ * tobj until its model is known (they are then copied to the model). Both
+ * send one REPORT MANUFACTURER INFORMATION request to a target whose model
+ * is not yet known, once per target per process. */
+#define SMP_CAP_DLIST 0x1       /* dlist is valid */
+#define SMP_CAP_ZERO_LENS 0x2   /* zero_lens is valid */
+
+struct smp_caps {
+    uint32_t known;             /* SMP_CAP_* bits */
+    bool dlist;                 /* DISCOVER LIST supported */
+    bool zero_lens;             /* needs zeroed length fields (SAS-1.1) */
+    char vendor[9];             /* "" until REPORT MANUFACTURER seen */
+    char product[17];
+    char revision[5];
+};
+
+int smp_caps_get(const struct smp_target_obj * tobj, struct smp_caps * cp,
+                 int verbose);
+void smp_caps_note(const struct smp_target_obj * tobj, uint32_t which,
+                   const struct smp_caps * cp, int verbose);
+void smp_caps_resp_note(const struct smp_target_obj * tobj,
+                        const struct smp_req_resp * rresp);
+
 /* Given an SMP function response code in func_res, places the associated
  * string (most likely an error if func_res > 0) in the area pointed to
  * by buffer. That string will not exceed buff_len bytes. Returns buff
@@ -208,6 +817,28 @@ int smp_get_func_def_req_len(int func_code);
  * REGISTER). */
 int smp_get_func_def_resp_len(int func_code);
 
+/* Static description of an SMP function, one per function code known to
+ * this library. def_req_len and def_resp_len are as returned by the two
+ * functions above. */
+struct smp_func_desc {
+    int func;                   /* SMP_FN_* function code */
+    int def_req_len;            /* SAS-1 request length in dwords, or -2/-3 */
+    int def_resp_len;           /* SAS-1 response length in dwords, or -2/-3 */
+    int flags;                  /* SMP_FDESC_* values OR-ed together */
+    const char * name;          /* lower case, e.g. "report general" */
+};
+
+#define SMP_FDESC_WRITE 0x1     /* configure function: changes expander */
+#define SMP_FDESC_PHY 0x2       /* request has phy identifier in byte 9 */
+
+/* Returns the description of func_code from a table indexed by function
+ * code, or NULL if func_code is unknown (or outside 0 to 255). */
+const struct smp_func_desc * smp_get_func_desc(int func_code);
+
+/* Returns the lower case name of func_code (e.g. "discover"), or
+ * "unknown". The returned string is constant. */
+const char * smp_get_func_name(int func_code);
+
 /* spl5r04.pdf says a valid SAS address can be NAA-5 or NAA-3 (locally
  * assigned). It prefers NAA-5 . Returns true if is, else false. */
 bool smp_is_sas_naa(uint64_t addr);
@@ -242,6 +873,325 @@ char * smp_get_phy_pwr_cond_str(int phy_pwr_cond, int buff_len, char * buff);
 char * smp_get_pwr_dis_signal_str(int pwr_dis_signal,
                                   int buff_len, char * buff);
 
+/* Bits in the att_init and att_targ fields of smp_discover_view */
+#define SMP_DV_SATA 0x1         /* SATA host (att_init), device (att_targ) */
+#define SMP_DV_SMP 0x2
+#define SMP_DV_STP 0x4
+#define SMP_DV_SSP 0x8
+#define SMP_DV_STP_BUFF_TSMALL 0x10     /* att_targ only */
+#define SMP_DV_PORT_SEL 0x80            /* att_targ only */
+
+/* Bits in the zone_flags (and def_, saved_ and shadow_ variants) */
+#define SMP_DV_ZONING_EN 0x1    /* per phy in DISCOVER, not short DL desc */
+#define SMP_DV_IZ 0x2           /* inside ZPSDS */
+#define SMP_DV_ZG_PERS 0x4      /* zone group persistent */
+#define SMP_DV_REQ_IZ 0x10      /* requested inside ZPSDS */
+#define SMP_DV_IZ_PERS 0x20     /* inside ZPSDS persistent */
+#define SMP_DV_REQ_IZ_CBE 0x40  /* requested inside ZPSDS changed by exp */
+
+/* A DISCOVER response, or a long or short DISCOVER LIST descriptor,
+ * decoded once by smp_decode_discover() into fixed positions so that
+ * output paths need not know which of the formats it came from. Multi bit
+ * fields are split out; groups of flag bits keep their wire layout (see the
+ * SMP_DV_* masks above and the raw byte noted beside them). Fields not
+ * present in the source (e.g. sas_addr in a short descriptor, or those
+ * past a short response) are zero. */
+struct smp_discover_view {
+    uint64_t sas_addr;          /* of the expander itself */
+    uint64_t att_sas_addr;
+    uint64_t att_dev_name;
+    uint64_t self_config_sas_addr;
+    uint32_t prog_phy_cap;
+    uint32_t cur_phy_cap;
+    uint32_t att_phy_cap;
+    uint16_t exp_change_count;
+    uint16_t stp_buff_size;
+    uint16_t resp_len;          /* bytes decoded, excluding CRC */
+    uint8_t desc_type;          /* 0: DISCOVER (or long desc), 1: short */
+    bool sas2;                  /* response length other than zero */
+    uint8_t func_res;
+    uint8_t phy_id;
+    uint8_t att_dev_type;       /* 0: none, 1: end, 2: exp, 3: fanout */
+    uint8_t att_reason;
+    uint8_t neg_log_lrate;
+    uint8_t att_init;           /* [14] SMP_DV_SSP ... */
+    uint8_t att_targ;           /* [15] SMP_DV_SSP ... SMP_DV_PORT_SEL */
+    uint8_t att_phy_id;
+    uint8_t att_caps[2];        /* [33] and [34], persistent capable ... */
+    uint8_t prog_min_lrate;
+    uint8_t hw_min_lrate;
+    uint8_t prog_max_lrate;
+    uint8_t hw_max_lrate;
+    uint8_t phy_change_count;
+    bool virt_phy;
+    uint8_t pp_timeout;         /* partial pathway timeout value */
+    uint8_t routing_attr;
+    uint8_t conn_type;
+    uint8_t conn_elem_ind;
+    uint8_t conn_phy_link;
+    uint8_t pwr_caps;           /* [48] phy power cond, sas/sata caps */
+    uint8_t pwr_ctl;            /* [49] pwr_dis, sas/sata enables */
+    uint8_t zone_flags;         /* [60] SMP_DV_ZONING_EN ... */
+    uint8_t zone_group;
+    uint8_t self_config_status;
+    uint8_t self_config_levels;
+    uint8_t reason;
+    uint8_t neg_phy_lrate;
+    uint8_t phy_flags;          /* [95] optical mode, SSC, muxing */
+    uint8_t def_zone_flags;
+    uint8_t def_zone_group;
+    uint8_t saved_zone_flags;
+    uint8_t saved_zone_group;
+    uint8_t shadow_zone_flags;
+    uint8_t shadow_zone_group;
+    uint8_t dev_slot_num;       /* 0xff when not available */
+    uint8_t dev_slot_grp_num;   /* 0xff when not available */
+    uint8_t buff_phy_burst_sz;  /* in KiB */
+    char dev_slot_grp_oc[7];    /* output connector, null terminated */
+    uint8_t src;                /* 0: SMP, else SMP_DV_SRC_SYSFS */
+};
+
+/* Decodes rp, which holds len bytes (excluding CRC), into vp. If desc_type
+ * is 0 then rp is a DISCOVER response, or a long DISCOVER LIST descriptor
+ * which has the same layout. If desc_type is 1 then rp is a 24 byte short
+ * DISCOVER LIST descriptor. Returns 0 on success, else -1 (e.g. len too
+ * short for the descriptor type). */
+int smp_decode_discover(const uint8_t * rp, int len, int desc_type,
+                        struct smp_discover_view * vp);
+
+/* Kernel copy of DISCOVER fields. On Linux the SAS transport class keeps,
+ * in sysfs, each expander phy's link rates and what it is attached to, as
+ * found by the kernel's own discovery. smp_sysfs_discover() fills vp from
+ * there, without an SMP round trip, for phy_id of the expander tobj was
+ * opened on (found by its device name or SAS address). It returns the
+ * groups of fields filled, as SMP_DVF_* bits; other fields are zero (so
+ * routing attribute and zoning are not known) and vp->src is
+ * SMP_DV_SRC_SYSFS. If a group that is needed is missing the caller
+ * should send DISCOVER for that phy; 0 is returned when the expander or
+ * phy is not in sysfs (e.g. not Linux). */
+#define SMP_DV_SRC_SYSFS 1
+#define SMP_DVF_PHY 0x1         /* phy_id, sas_addr */
+#define SMP_DVF_LRATE 0x2       /* neg_log_lrate, hw_ and prog_ min, max */
+#define SMP_DVF_ATT 0x4         /* att_dev_type, att_sas_addr, att_phy_id,
+                                 * att_init, att_targ */
+#define SMP_DVF_ALL (SMP_DVF_PHY | SMP_DVF_LRATE | SMP_DVF_ATT)
+
+int smp_sysfs_discover(const struct smp_target_obj * tobj, int phy_id,
+                       struct smp_discover_view * vp, int verbose);
+
+/* Returns the number of phys sysfs has for the expander tobj was opened
+ * on, or -1 if it is not there. */
+int smp_sysfs_num_phys(const struct smp_target_obj * tobj, int verbose);
+
+/* Returns the NUMA node of the HBA (PCI device) that the SMP device
+ * dev_name (e.g. "/dev/bsg/expander-6:0", or "/dev/mptctl" with subvalue
+ * picking the mptsas HBA) is reached through, as found in sysfs. Returns
+ * -1 if not known, which is also what sysfs says on single node machines. */
+int smp_sysfs_numa_node(const char * dev_name, int subvalue, int verbose);
+
+/* Runs the calling thread only on the CPUs of NUMA node, and makes that
+ * node's memory preferred for what it allocates and first touches (so its
+ * stack and buffers, e.g. those from smp_buf_get(), end up local). Meant
+ * for a worker dedicated to the SMP targets behind one HBA, given the
+ * node from smp_sysfs_numa_node(). Returns 0 when bound, 1 when nothing
+ * was done (node is -1, the machine has a single node, not Linux, or the
+ * SMP_UTILS_NUMA environment variable is "0"), else -1 . */
+int smp_numa_bind(int node, int verbose);
+
+/* Reverse index from attached SAS address, or attached device name (as
+ * shown by 'smp_discover --adn'), to the expander phy it is attached to.
+ * Built from the DISCOVER responses of a topology walk (live or from a
+ * snapshot) and saved in a file (default SMP_LOCATE_FN) that is mapped
+ * read-only by readers; a query is one hash probe sequence, so costs the
+ * same for thousands of drives as for one. A device on a wide port (or
+ * dual attached) has an entry per phy. */
+#define SMP_LOCATE_FN "/run/smp_utils/locate"
+#define SMP_LOCATE_DEV_LEN 40
+
+struct smp_locate_ent {
+    uint64_t att_sas_addr;
+    uint64_t att_dev_name;      /* 0 if the expander does not report it */
+    uint64_t exp_sas_addr;      /* expander the device is attached to */
+    uint8_t phy_id;             /* expander's phy */
+    uint8_t zone_group;
+    uint8_t neg_log_lrate;      /* negotiated logical link rate */
+    uint8_t att_dev_type;       /* 1: end, 2: exp, 3: fanout */
+    uint8_t att_init;           /* SMP_DV_SSP ... */
+    uint8_t att_targ;
+    uint8_t att_phy_id;
+    uint8_t reserved;
+    char exp_dev[SMP_LOCATE_DEV_LEN];   /* where the expander was opened */
+};
+
+struct smp_locate_idx;          /* opaque */
+
+/* Returns an empty index with room for max_ents entries (e.g. the sum of
+ * the expanders' phys), or NULL. */
+struct smp_locate_idx * smp_locate_new(int max_ents);
+
+/* Adds an entry for the DISCOVER response in rp (len bytes, excluding
+ * CRC) of the expander opened as exp_dev. Returns 0 if added, 1 if
+ * nothing is attached to that phy, -1 if the response is bad or the index
+ * is full. */
+int smp_locate_add(struct smp_locate_idx * lip, const char * exp_dev,
+                   const uint8_t * rp, int len);
+
+/* Writes the index to fn (NULL -> SMP_LOCATE_FN) through a temporary
+ * file that is renamed, so readers see the old or the new index. Returns
+ * 0 on success, else -1 . */
+int smp_locate_save(const struct smp_locate_idx * lip, const char * fn,
+                    int verbose);
+
+/* Maps the index saved in fn (NULL -> SMP_LOCATE_FN). Returns NULL if
+ * it is missing or not a valid index. */
+struct smp_locate_idx * smp_locate_map(const char * fn, int verbose);
+
+/* Places up to max_num entries for key (an attached SAS address, or if
+ * by_name an attached device name) in arr. Returns the number of entries
+ * found, which may exceed max_num. */
+int smp_locate_find(const struct smp_locate_idx * lip, uint64_t key,
+                    bool by_name, struct smp_locate_ent * arr, int max_num);
+
+/* Frees an index from smp_locate_new() or smp_locate_map() */
+void smp_locate_free(struct smp_locate_idx * lip);
+
+/* Buffered machine readable output: one record (e.g. per phy) at a time,
+ * either as a JSON object per line or as CSV with a header line taken from
+ * the field names of the first record. Output is held in a buffer of
+ * 64 KiB which is written when almost full and by smp_emit_fini(). */
+#define SMP_EMIT_JSON 1
+#define SMP_EMIT_CSV 2
+
+struct smp_emit {
+    bool hdr_done;              /* CSV header line written */
+    bool err;                   /* a write to fp failed */
+    int fmt;                    /* SMP_EMIT_JSON or SMP_EMIT_CSV */
+    int nfields;                /* in current record */
+    int nrecs;
+    int off;
+    int blen;
+    int hdr_off;
+    char * buff;
+    char * hdr;
+    FILE * fp;
+};
+
+/* smp_emit_init() allocates the buffer, fp of NULL implies stdout; returns
+ * 0 on success else -1. Each record is framed by smp_emit_rec_begin() and
+ * smp_emit_rec_end() with one smp_emit_int(), smp_emit_hex64() or
+ * smp_emit_str() call per field between them. smp_emit_fini() writes what
+ * remains, frees the buffer and returns -1 if any write failed. */
+int smp_emit_init(struct smp_emit * ep, int fmt, FILE * fp);
+void smp_emit_rec_begin(struct smp_emit * ep);
+void smp_emit_int(struct smp_emit * ep, const char * name, int64_t val);
+void smp_emit_hex64(struct smp_emit * ep, const char * name, uint64_t val);
+void smp_emit_str(struct smp_emit * ep, const char * name, const char * s);
+void smp_emit_rec_end(struct smp_emit * ep);
+int smp_emit_flush(struct smp_emit * ep);
+int smp_emit_fini(struct smp_emit * ep);
+
+/* Emits the fields of vp (not a whole record) so that the caller may add
+ * fields of its own before smp_emit_rec_end() */
+void smp_emit_discover(struct smp_emit * ep,
+                       const struct smp_discover_view * vp);
+
+/* Zone permission table held as a bit matrix: bit (d % 64) of
+ * w[s][d / 64] is ZP[s,d] (i.e. source zone group s may access zone group
+ * d). A row is in the same order as a zone permission descriptor read
+ * backwards, so descriptors convert a 64 bit word at a time. Rows and
+ * columns at and beyond num_zg are kept zero. */
+#define SMP_ZP_MAX_ZG 256
+#define SMP_ZP_WORDS (SMP_ZP_MAX_ZG / 64)
+
+struct smp_zone_perm {
+    int num_zg;                 /* 128 or 256 */
+    uint64_t w[SMP_ZP_MAX_ZG][SMP_ZP_WORDS];
+};
+
+/* num_zg other than 256 is taken as 128. All permissions are cleared. */
+void smp_zp_init(struct smp_zone_perm * zpp, int num_zg);
+/* descp is a zone permission descriptor (16 bytes for 128 zone groups, 32
+ * for 256) as found in REPORT and CONFIGURE ZONE PERMISSION TABLE */
+void smp_zp_set_row(struct smp_zone_perm * zpp, int s, const uint8_t * descp);
+void smp_zp_get_row(const struct smp_zone_perm * zpp, int s, uint8_t * descp);
+bool smp_zp_test(const struct smp_zone_perm * zpp, int s, int d);
+void smp_zp_set(struct smp_zone_perm * zpp, int s, int d, bool permit);
+/* dst may not be src */
+void smp_zp_transpose(const struct smp_zone_perm * src,
+                      struct smp_zone_perm * dst);
+/* Returns the number of rows in which a and b differ (or num_zg if they
+ * hold a different number of zone groups). If rows is not NULL, bit
+ * (s % 64) of rows[s / 64] is set when row s differs; it should have
+ * SMP_ZP_WORDS elements. */
+int smp_zp_diff(const struct smp_zone_perm * a, const struct smp_zone_perm * b,
+                uint64_t * rows);
+/* Returns the number of pairs (s < d) for which ZP[s,d] != ZP[d,s], so 0
+ * when symmetric. The first such pair is placed in *sp and *dp if they are
+ * not NULL. */
+int smp_zp_asymmetric(const struct smp_zone_perm * zpp, int * sp, int * dp);
+/* Source zone groups that may access zone group g (i.e. column g); sets
+ * bit (s % 64) of srcs[s / 64] for each, srcs should have SMP_ZP_WORDS
+ * elements. Returns the number of them. */
+int smp_zp_reach(const struct smp_zone_perm * zpp, int g, uint64_t * srcs);
+
+/* Zoning transaction on one open target: ZONE LOCK, CONFIGURE ZONE
+ * PERMISSION TABLE and CONFIGURE ZONE PHY INFORMATION (each as many times
+ * as needed), ZONE ACTIVATE and ZONE UNLOCK sent back to back so the zone
+ * lock is held for as short a time as possible. */
+struct smp_zone_txn {
+    /* set by caller */
+    const struct smp_zone_perm * zpp;   /* NULL: permission table unchanged */
+    int sszg;                   /* first source zone group to configure */
+    int num_rows;               /* from sszg, 0 (or too many): to the end */
+    const uint8_t * phy_info;   /* zone phy config descriptors, 4 bytes each */
+    int num_phy_info;
+    const uint8_t * password;   /* 32 bytes; NULL: all zeros */
+    int save;                   /* SAVE field of CONFIGURE functions: 0 to 3 */
+    int inact_tl;               /* ZONE LOCK inactivity time limit (100 ms) */
+    /* set by smp_zone_txn_*() */
+    bool locked;
+    int fail_func;              /* function code of first failure, else -1 */
+    int num_reqs;               /* SMP requests sent */
+    uint64_t active_zm_sa;      /* from ZONE LOCK response */
+    uint64_t lock_start_us;     /* smp_stats_clock_us() when ZONE LOCK sent */
+    uint64_t lock_us;           /* ZONE LOCK sent to ZONE UNLOCK completed */
+    uint64_t activate_us;       /* smp_stats_clock_us() when ZONE ACTIVATE
+                                 * sent */
+};
+
+/* smp_zone_txn_stage() locks then configures; if a configure function
+ * fails the zone is unlocked before returning. smp_zone_txn_commit()
+ * activates and unlocks (unlocking even if ZONE ACTIVATE fails) while
+ * smp_zone_txn_abort() just unlocks. smp_zone_txn_run() is stage then
+ * commit. Each returns 0 on success, else the SMP function result of the
+ * first failure (see ztp->fail_func), SMP_LIB_CAT_MALFORMED,
+ * SMP_LIB_SYNTAX_ERROR (e.g. sszg out of range) or -1 (send or transport
+ * failure). */
+int smp_zone_txn_stage(struct smp_target_obj * tobj,
+                       struct smp_zone_txn * ztp, int verbose);
+int smp_zone_txn_commit(struct smp_target_obj * tobj,
+                        struct smp_zone_txn * ztp, int verbose);
+int smp_zone_txn_abort(struct smp_target_obj * tobj,
+                       struct smp_zone_txn * ztp, int verbose);
+int smp_zone_txn_run(struct smp_target_obj * tobj, struct smp_zone_txn * ztp,
+                     int verbose);
+
+/* Reads back the current zone permission table after the transaction and
+ * compares the rows (and columns) that ztp configured, placing the number
+ * of rows that differ in *num_diffp. Returns 0 if the table was read,
+ * else as smp_zone_txn_stage(). */
+int smp_zone_txn_verify(struct smp_target_obj * tobj,
+                        const struct smp_zone_txn * ztp, int * num_diffp,
+                        int verbose);
+
+/* Reads num_rows rows of a zone permission table starting at source zone
+ * group sszg with REPORT ZONE PERMISSION TABLE, report_type 0 (current) to
+ * 3 (default), into zpp which is first initialized to the number of zone
+ * groups the expander reports. Returns 0 on success, else the function
+ * result, SMP_LIB_CAT_MALFORMED, SMP_LIB_SYNTAX_ERROR or -1. */
+int smp_zp_read(struct smp_target_obj * tobj, int report_type, int sszg,
+                int num_rows, struct smp_zone_perm * zpp, int verbose);
+
 const char * smp_lib_version();
 
 struct smp_val_name {
@@ -255,6 +1205,25 @@ struct smp_val_name {
    If errnum is negative, flip its sign. */
 char * safe_strerror(int errnum);
 
+/* As safe_strerror() but thread safe, the string is placed in b (which is
+ * returned) truncated to blen bytes including the trailing null. */
+char * safe_strerror_r(int errnum, char * b, int blen);
+
+/* As perror() but output via pr2ws() (so to the log callback if set) and
+ * thread safe. errno is preserved. */
+void smp_perror(const char * s);
+
+/* Library diagnostics (from pr2ws(), which the library uses rather than
+ * fprintf(stderr, ...) ) go to stderr unless a log callback is set, in
+ * which case each message is passed to cb, with arg, instead. A message
+ * is no longer than 1023 bytes and may be part of a line (e.g. when hex
+ * is output a byte at a time). cb is called without any library lock
+ * held, so it may call into libsmputils, but may be called from several
+ * threads at once. Setting a NULL cb restores stderr. */
+typedef void (*smp_log_cb_t)(const char * msg, void * arg);
+
+void smp_set_log_cb(smp_log_cb_t cb, void * arg);
+
 
 /* Print (to stdout) 'str' of bytes in hex, 16 bytes per line optionally
    followed at the right hand side of the line with an ASCII interpretation.
@@ -354,6 +1323,28 @@ int64_t smp_get_llnum_nomult(const char * buf);
  * or "0X" prefix, or by a 'h' or 'H' suffix. */
 int smp_get_dhnum(const char * buf);
 
+/* Reads the bytes of a permission table (e.g. --permf=FN) or of zone phy
+ * information descriptors (--pconf=PC) from fname, '-' being stdin, into
+ * mp_arr, writing their number to *mp_arr_len. If as_binary is true the
+ * file holds the bytes themselves. Otherwise it is ASCII hex: on each line
+ * either bytes separated by spaces, commas or tabs (1 or 2 digits each) or,
+ * if the first such string has 3 or more digits, strings of 2 digits per
+ * byte. Everything from a '#' on a line is ignored. If startp is non-NULL
+ * a line like "--start=8" writes 8 to *startp (else -1 is written) and '-'
+ * also ends a line; otherwise a '-' is a syntax error. If line_maxp is
+ * non-NULL the most bytes found on one line is written there (more than
+ * 16 suggests 256 zone groups). Errors are reported with the line number
+ * and position. Returns 0 if ok, or 1 if error. */
+int smp_f2hex_arr(const char * fname, bool as_binary, uint8_t * mp_arr,
+                  int * mp_arr_len, int max_arr_len, int * startp,
+                  int * line_maxp, int verbose);
+
+/* Decodes a list of phy identifiers such as "0,3,8-11" into phy_arr in
+ * ascending order without duplicates. Returns the number placed in phy_arr
+ * (at most max_num), or -1 if 'buf' can't be decoded or an identifier is
+ * greater than 254. */
+int smp_get_phy_list(const char * buf, uint8_t * phy_arr, int max_num);
+
 
 #ifdef __cplusplus
 }
@@ -25,6 +25,7 @@
 #include "mpi_sas.h"
 
 #include "smp_aac_io.h"
+#include "sg_pr2serr.h"
 
 #include "aacraid.h"
 
@@ -55,7 +56,7 @@ chk_aac_device(const char * dev_name,int verbose)
     //Open /proc/devices to find if aac interface it present
     fp = fopen("/proc/devices","r");
     if(NULL == fp && verbose) {
-        fprintf(stderr,"chk_aac_device : /proc/devices Not Found : %s\n",safe_strerror(errno));
+        smp_perror("chk_aac_device : /proc/devices Not Found");
         return ret;
     }
 
@@ -74,7 +75,7 @@ chk_aac_device(const char * dev_name,int verbose)
   // aac in /proc/devices is not found
     if ( aacDevMjr < 0 ){
         if (verbose)
-            fprintf(stderr,"chk_aac_device : aac entry not found in /proc/devices \n");
+            pr2ws("chk_aac_device : aac entry not found in /proc/devices \n");
         return 0;
     }
 
@@ -84,7 +85,7 @@ chk_aac_device(const char * dev_name,int verbose)
         if(strncmp(dev_name,"/dev/aac",8) == 0) {
             aacDevMnr = 0;
         } else {
-            fprintf(stderr,"chk_aac_device : Invalid device name\n");
+            pr2ws("chk_aac_device : Invalid device name\n");
             return 0;
         }
     }
@@ -92,14 +93,14 @@ chk_aac_device(const char * dev_name,int verbose)
     //checks if file already exists
     if(open(dev_name,O_RDWR) < 0) {
         if(mknod(dev_name,S_IFCHR,makedev(aacDevMjr,aacDevMnr))) {
-            fprintf (stderr,"chk_aac_device : Mknod failed : %s\n",safe_strerror(errno));
+            smp_perror("chk_aac_device : Mknod failed");
             return 0;
         }
     }
 
     //Checks for /dev/aacX created with different major and minor numbers
     if (stat(dev_name, &st) < 0) {
-        fprintf (stderr,"chk_aac_device : Stat failed : %s \n",safe_strerror(errno));
+        smp_perror("chk_aac_device : Stat failed");
     }
 
     if ((S_ISCHR(st.st_mode)) && (aacDevMjr ==(int) major(st.st_rdev))) {
@@ -110,13 +111,13 @@ chk_aac_device(const char * dev_name,int verbose)
 
     if (verbose) {
         if (S_ISCHR(st.st_mode))
-            fprintf(stderr, "chk_aac_device: wanted char device "
-              "major,minor=%d,%d\n got=%d,%d\n", aacDevMjr,
-               aacDevMnr, major(st.st_rdev),minor(st.st_rdev));
+            pr2ws("chk_aac_device: wanted char device "
+            "major,minor=%d,%d\n got=%d,%d\n", aacDevMjr,
+             aacDevMnr, major(st.st_rdev),minor(st.st_rdev));
         else
-            fprintf(stderr, "chk_aac_device: wanted char device "
-              "major,minor=%d,%d\n but didn't get char device\n",
-               aacDevMjr,aacDevMnr);
+            pr2ws("chk_aac_device: wanted char device "
+            "major,minor=%d,%d\n but didn't get char device\n",
+             aacDevMjr,aacDevMnr);
     }
     return 0;
 }
@@ -132,13 +133,13 @@ open_aac_device(const char * dev_name ,int verbose)
 
     if(res<0){
         if (verbose)
-            fprintf(stderr,"Open_aac_device failed");
+            pr2ws("Open_aac_device failed");
     }else if (fstat(res, &st) >= 0){
         if (!((S_ISCHR(st.st_mode)) && (aacDevMjr ==(int) major(st.st_rdev)) &&
             (aacDevMnr ==(int) minor(st.st_rdev))))
-            fprintf(stderr,"Major and Minor  do not match\n");
+            pr2ws("Major and Minor  do not match\n");
     }else if (verbose)
-        fprintf(stderr,"open_aac_device:stat failed");
+        pr2ws("open_aac_device:stat failed");
     return res;
 }
 
@@ -184,7 +185,7 @@ send_req_aac(int fd, int subvalue, const unsigned char * target_sa,
 
         aSmpPassThruReq = (HostSmpPassThruRequest *)malloc(SIZE_SMP_PASS_THRU_REQ);
         if( NULL == aSmpPassThruReq){
-         fprintf(stderr,"send_req_aac: Could not allocate memory for SMP Pass Thru Request \n");
+         pr2ws("send_req_aac: Could not allocate memory for SMP Pass Thru Request \n");
          goto err_out;
         }
         memset(aSmpPassThruReq,0,SIZE_SMP_PASS_THRU_REQ);
@@ -200,7 +201,7 @@ send_req_aac(int fd, int subvalue, const unsigned char * target_sa,
 
         aFib = (Fib *)malloc(SIZE_FIB);
         if( NULL == aFib){
-            fprintf(stderr,"send_req_aac: Could not allocate memory for FIB \n");
+            pr2ws("send_req_aac: Could not allocate memory for FIB \n");
             goto err_out;
         }
         memset(aFib,0,SIZE_FIB);
@@ -215,7 +216,7 @@ send_req_aac(int fd, int subvalue, const unsigned char * target_sa,
         memcpy(aFib->data,aSmpPassThruReq,SIZE_SMP_PASS_THRU_REQ);
 
         if( ioctl (fd,FSACTL_SENDFIB,aFib) !=0) {
-            fprintf(stderr,"send_req_aac: Request FSACTL_SENDFIB ioctl failed - %s",safe_strerror(errno));
+            smp_perror("send_req_aac: Request FSACTL_SENDFIB ioctl failed");
             goto err_out;
         }
 
@@ -231,7 +232,7 @@ send_req_aac(int fd, int subvalue, const unsigned char * target_sa,
     aSmpReqHdrStat = aSmpResult->header.status;
   }
   if (aSmpCmdReqLen != 0) {
-    fprintf(stderr,"send_req_aac:Firmware did not aacept the request\n ");
+    pr2ws("send_req_aac:Firmware did not aacept the request\n ");
     goto err_out;
   }
 
@@ -241,19 +242,19 @@ if((aSmpResult->header.status != SMP_PASS_THRU_SUCCESS)
     switch(aSmpResult->header.status)
     {
     case SMP_PASS_THRU_BUSY:
-      fprintf(stderr,"send_req_aac: Request Firmware Busy\n ");
+      pr2ws("send_req_aac: Request Firmware Busy\n ");
       break;
     case SMP_PASS_THRU_TIMEOUT:
-      fprintf(stderr,"send_req_aac: Request Firmware Timeout\n ");
+      pr2ws("send_req_aac: Request Firmware Timeout\n ");
       break;
     case SMP_PASS_THRU_PARM_INVALID:
-      fprintf(stderr,"send_req_aac: Request Firmware Parmeters Invalid\n ");
+      pr2ws("send_req_aac: Request Firmware Parmeters Invalid\n ");
       break;
     default:
-      fprintf(stderr,"send_req_aac: Request Firmware command error\n ");
+      pr2ws("send_req_aac: Request Firmware command error\n ");
       break;
     }
-    fprintf(stderr,"send_req_aac: Request SMP Header Status - %x \n ",aSmpResult->header.status);
+    pr2ws("send_req_aac: Request SMP Header Status - %x \n ",aSmpResult->header.status);
   goto err_out;
   }
 
@@ -287,7 +288,7 @@ if((aSmpResult->header.status != SMP_PASS_THRU_SUCCESS)
 
     aSmpPassThruRes = (HostSmpPassThruResult *)malloc(SIZE_SMP_PASS_THRU_RES);
     if( NULL == aSmpPassThruRes) {
-        fprintf(stderr,"send_req_aac: Could not allocate memory for SMP PASS THRU RESULT \n");
+        pr2ws("send_req_aac: Could not allocate memory for SMP PASS THRU RESULT \n");
         goto err_out;
     }
     memset(aSmpPassThruRes,0,SIZE_SMP_PASS_THRU_RES);
@@ -310,7 +311,7 @@ if((aSmpResult->header.status != SMP_PASS_THRU_SUCCESS)
     memcpy(aFib->data,aSmpPassThruRes,SIZE_SMP_PASS_THRU_RES);
 
     if( ioctl (fd,FSACTL_SENDFIB,aFib) !=0){
-        fprintf(stderr,"send_req_aac: Result FSACTL_SENDFIB ioctl failed  - %s",safe_strerror(errno));
+        smp_perror("send_req_aac: Result FSACTL_SENDFIB ioctl failed");
         goto err_out;
     }
 
@@ -323,19 +324,19 @@ if((aSmpResult->header.status != SMP_PASS_THRU_SUCCESS)) {
  switch(aSmpResult->header.status)
     {
      case SMP_PASS_THRU_BUSY:
-      fprintf(stderr,"send_req_aac: Result Firmware Busy\n ");
+      pr2ws("send_req_aac: Result Firmware Busy\n ");
        break;
      case SMP_PASS_THRU_TIMEOUT:
-       fprintf(stderr,"send_req_aac: Result Firmware Timeout\n ");
+       pr2ws("send_req_aac: Result Firmware Timeout\n ");
        break;
      case SMP_PASS_THRU_PARM_INVALID:
-       fprintf(stderr,"send_req_aac: Result Firmware Parmeters Invalid\n ");
+       pr2ws("send_req_aac: Result Firmware Parmeters Invalid\n ");
        break;
      default:
-       fprintf(stderr,"send_req_aac: Result Firmware command error\n ");
+       pr2ws("send_req_aac: Result Firmware command error\n ");
        break;
      }
-     fprintf(stderr,"send_req_aac: Result SMP Header Status - %x \n ",aSmpResult->header.status);
+     pr2ws("send_req_aac: Result SMP Header Status - %x \n ",aSmpResult->header.status);
 
   } else {
    ret = 0;
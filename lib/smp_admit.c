@@ -0,0 +1,504 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* Admission control. Each expander (keyed by SAS address, else device
+ * name, as in the DISCOVER LIST capability cache) gets one entry, shared
+ * by every target object opened on it in this process, and smp_send_req()
+ * holds one of its slots while each attempt is with the pass-through. The
+ * number of slots (the concurrency limit) starts at max_inflight; a BUSY
+ * answer halves it and a run of 'limit' answers that are not BUSY adds one
+ * back, up to max_inflight. So a batch settles on what the expander's SMP
+ * processor can take instead of meeting BUSY with more retries, which is
+ * what makes some firmware spiral. An optional rate (requests per second)
+ * spaces out the sends, with a burst of up to 'limit'.
+ *
+ * The SMP_UTILS_ADMIT environment variable holds rules separated by ';'.
+ * Each is an optional VENDOR[/PRODUCT]: prefix (as in REPORT MANUFACTURER
+ * INFORMATION, matched as leading text) then comma separated max=N and
+ * rate=R. A rule without a prefix is the default. The word "shared" makes
+ * the limit hold across processes: slot k is a lock on byte k of a file in
+ * /run/smp_utils named after the SAS address, which the kernel releases if
+ * the holder dies. "off" disables admission control. Model rules apply
+ * once an expander's REPORT MANUFACTURER INFORMATION response has been
+ * seen; smp_send_req_batch() asks for it (smp_admit_identify()) when there
+ * are model rules. Entries last for the life of the process. */
+
+#define ADMIT_SLOTS 256
+#define ADMIT_MAX_RULES 16
+#define ADMIT_MAX_LIMIT 64      /* slots are bits in a uint64_t */
+#define ADMIT_LOCK_DIR "/run/smp_utils"
+#define SMP_FN_REPORT_MANUFACTURER_RESP_LEN 64
+
+struct admit_rule {
+    char vendor[9];             /* "" for the default rule */
+    char product[17];
+    int max_inflight;           /* -1 -> not given */
+    int rate;
+};
+
+struct smp_admit_ent {
+    bool used;
+    bool pinned;                /* smp_admit_set() wins over rules */
+    bool model_known;
+    bool identify_tried;
+    uint64_t sa;
+    char dev_name[SMP_MAX_DEVICE_NAME];
+    char vendor[9];
+    char product[17];
+    pthread_mutex_t mtx;
+    pthread_cond_t cv;
+    int max_inflight;
+    int limit;
+    int inflight;
+    int ok_run;                 /* answers since last change of limit */
+    int hold;                   /* answers to pass before halving again */
+    int rate;                   /* requests per second, 0 -> no limit */
+    uint64_t next_us;           /* earliest start of the next request */
+    uint64_t held;              /* lock file bytes held in this process */
+    int lock_fd;                /* -1 unless "shared" */
+    uint32_t num_busy;
+    uint32_t num_waits;
+};
+
+static struct smp_admit_ent admit_arr[ADMIT_SLOTS];
+static pthread_mutex_t admit_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t admit_once = PTHREAD_ONCE_INIT;
+static struct admit_rule admit_rules[ADMIT_MAX_RULES];
+static int admit_num_rules;     /* [0] is the default rule */
+static bool admit_off;
+static bool admit_shared;
+
+
+/* copies the text of a SCSI style fixed length field, less trailing
+ * spaces */
+static void
+trim_copy(char * d, int dlen, const uint8_t * s, int slen)
+{
+    if (slen > dlen - 1)
+        slen = dlen - 1;
+    memcpy(d, s, slen);
+    while ((slen > 0) && (' ' == d[slen - 1]))
+        --slen;
+    d[slen] = '\0';
+}
+
+static int
+parse_rule(const char * cp, int len, struct admit_rule * rp)
+{
+    int n, k;
+    const char * colon = (const char *)memchr(cp, ':', len);
+    const char * slash;
+    const char * ep;
+    char b[32];
+
+    memset(rp, 0, sizeof(*rp));
+    rp->max_inflight = -1;
+    rp->rate = -1;
+    if (colon) {
+        n = colon - cp;
+        slash = (const char *)memchr(cp, '/', n);
+        k = slash ? (slash - cp) : n;
+        trim_copy(rp->vendor, sizeof(rp->vendor), (const uint8_t *)cp, k);
+        if (slash)
+            trim_copy(rp->product, sizeof(rp->product),
+                      (const uint8_t *)slash + 1, n - k - 1);
+        len -= n + 1;
+        cp = colon + 1;
+    }
+    for ( ; len > 0; len -= n + 1, cp = ep + 1) {
+        ep = (const char *)memchr(cp, ',', len);
+        n = ep ? (ep - cp) : len;
+        if (n >= (int)sizeof(b))
+            return -1;
+        memcpy(b, cp, n);
+        b[n] = '\0';
+        if (0 == strncmp("max=", b, 4)) {
+            rp->max_inflight = smp_get_num(b + 4);
+            if ((rp->max_inflight < 1) ||
+                (rp->max_inflight > ADMIT_MAX_LIMIT))
+                return -1;
+        } else if (0 == strncmp("rate=", b, 5)) {
+            if ((rp->rate = smp_get_num(b + 5)) < 0)
+                return -1;
+        } else if (n > 0)
+            return -1;
+        if (NULL == ep)
+            break;
+    }
+    return 0;
+}
+
+/* Reads the SMP_UTILS_ADMIT environment variable, once */
+static void
+admit_config(void)
+{
+    int n;
+    const char * cp = getenv("SMP_UTILS_ADMIT");
+    const char * ep;
+    struct admit_rule r;
+
+    admit_rules[0].max_inflight = SMP_BATCH_DEF_INFLIGHT;
+    admit_num_rules = 1;
+    for ( ; cp && *cp; cp = ep ? ep + 1 : cp + n) {
+        ep = strchr(cp, ';');
+        n = ep ? (ep - cp) : (int)strlen(cp);
+        if (0 == n)
+            continue;
+        if ((3 == n) && (0 == strncmp("off", cp, 3)))
+            admit_off = true;
+        else if ((6 == n) && (0 == strncmp("shared", cp, 6)))
+            admit_shared = true;
+        else if (parse_rule(cp, n, &r))
+            pr2ws("SMP_UTILS_ADMIT: bad rule '%.*s', ignored\n", n, cp);
+        else if ('\0' == r.vendor[0]) {
+            if (r.max_inflight > 0)
+                admit_rules[0].max_inflight = r.max_inflight;
+            if (r.rate >= 0)
+                admit_rules[0].rate = r.rate;
+        } else if (admit_num_rules < ADMIT_MAX_RULES)
+            admit_rules[admit_num_rules++] = r;
+        if (NULL == ep)
+            break;
+    }
+}
+
+/* Applies the first model rule matching the entry, else the default.
+ * Caller holds ep->mtx. */
+static void
+apply_rules(struct smp_admit_ent * ep)
+{
+    int k;
+    const struct admit_rule * rp = admit_rules;
+
+    for (k = 1; ep->model_known && (k < admit_num_rules); ++k) {
+        if ((0 == strncmp(admit_rules[k].vendor, ep->vendor,
+                          strlen(admit_rules[k].vendor))) &&
+            (0 == strncmp(admit_rules[k].product, ep->product,
+                          strlen(admit_rules[k].product)))) {
+            rp = admit_rules + k;
+            break;
+        }
+    }
+    ep->max_inflight = (rp->max_inflight > 0) ? rp->max_inflight :
+                                                admit_rules[0].max_inflight;
+    ep->rate = (rp->rate >= 0) ? rp->rate : admit_rules[0].rate;
+    if (ep->limit > ep->max_inflight)
+        ep->limit = ep->max_inflight;
+    pthread_cond_broadcast(&ep->cv);
+}
+
+static void
+open_lock_file(struct smp_admit_ent * ep)
+{
+    char b[64];
+
+    if (mkdir(ADMIT_LOCK_DIR, 0755) && (EEXIST != errno))
+        return;
+    snprintf(b, sizeof(b), "%s/admit-%016" PRIx64, ADMIT_LOCK_DIR, ep->sa);
+    /* never closed: that would drop all of this process's locks on it */
+    ep->lock_fd = open(b, O_RDWR | O_CREAT, 0666);
+}
+
+void
+smp_admit_attach(struct smp_target_obj * tobj)
+{
+    int k;
+    uint64_t sa;
+    struct smp_admit_ent * ep;
+    struct smp_admit_ent * fp = NULL;
+
+    if (NULL == tobj)
+        return;
+    tobj->admitp = NULL;
+    pthread_once(&admit_once, admit_config);
+    if (admit_off || (SMP_SNAP_INTERFACE == tobj->interface_selector))
+        return;
+    sa = sg_get_unaligned_be64(tobj->sas_addr);
+    pthread_mutex_lock(&admit_mtx);
+    for (k = 0, ep = admit_arr; k < ADMIT_SLOTS; ++k, ++ep) {
+        if (! ep->used) {
+            if (NULL == fp)
+                fp = ep;
+        } else if (sa ? (sa == ep->sa) :
+                   ((0 == ep->sa) &&
+                    (0 == strcmp(ep->dev_name, tobj->device_name))))
+            break;
+    }
+    if (k >= ADMIT_SLOTS) {
+        ep = fp;        /* NULL when full: that expander is not limited */
+        if (ep) {
+            memset(ep, 0, sizeof(*ep));
+            ep->used = true;
+            ep->sa = sa;
+            if (0 == sa)
+                snprintf(ep->dev_name, sizeof(ep->dev_name), "%s",
+                         tobj->device_name);
+            pthread_mutex_init(&ep->mtx, NULL);
+            pthread_cond_init(&ep->cv, NULL);
+            ep->lock_fd = -1;
+            apply_rules(ep);
+            ep->limit = ep->max_inflight;
+            if (admit_shared && sa)
+                open_lock_file(ep);
+        }
+    }
+    pthread_mutex_unlock(&admit_mtx);
+    tobj->admitp = ep;
+}
+
+static int
+lock_byte(int fd, int b, int type)
+{
+    struct flock fl;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = b;
+    fl.l_len = 1;
+    return fcntl(fd, (F_UNLCK == type) ? F_SETLK : F_SETLKW, &fl);
+}
+
+int
+smp_admit_enter(const struct smp_target_obj * tobj)
+{
+    int slot = -1;
+    int64_t wait_us = 0;
+    uint64_t now, interval;
+    struct smp_admit_ent * ep;
+    struct timespec ts;
+
+    if ((NULL == tobj) || (NULL == (ep = tobj->admitp)))
+        return -1;
+    pthread_mutex_lock(&ep->mtx);
+    while (ep->inflight >= ep->limit) {
+        ++ep->num_waits;
+        pthread_cond_wait(&ep->cv, &ep->mtx);
+    }
+    ++ep->inflight;
+    if (ep->rate > 0) {
+        now = smp_stats_clock_us();
+        interval = 1000000 / ep->rate;
+        if ((ep->next_us + (interval * ep->limit)) < now)
+            ep->next_us = now - (interval * ep->limit);     /* burst */
+        wait_us = (int64_t)(ep->next_us - now);
+        ep->next_us += interval;
+    }
+    if (ep->lock_fd >= 0) {
+        for (slot = 0; ep->held & ((uint64_t)1 << slot); ++slot)
+            ;
+        ep->held |= (uint64_t)1 << slot;
+    }
+    pthread_mutex_unlock(&ep->mtx);
+    if (wait_us > 0) {
+        ts.tv_sec = wait_us / 1000000;
+        ts.tv_nsec = (wait_us % 1000000) * 1000;
+        while ((nanosleep(&ts, &ts) < 0) && (EINTR == errno))
+            ;
+    }
+    if (slot >= 0) {
+        while (lock_byte(ep->lock_fd, slot, F_WRLCK) < 0) {
+            if (EINTR == errno)
+                continue;
+            if (EDEADLK != errno)
+                break;          /* go on without the other processes */
+            ts.tv_sec = 0;
+            ts.tv_nsec = 1000000;
+            nanosleep(&ts, NULL);
+        }
+    }
+    return slot;
+}
+
+/* Notes the model of ep's expander then applies its rules. Caller holds
+ * ep->mtx. */
+static void
+set_model(struct smp_admit_ent * ep, const uint8_t * vendor, int vlen,
+          const uint8_t * product, int plen, int verbose)
+{
+    trim_copy(ep->vendor, sizeof(ep->vendor), vendor, vlen);
+    trim_copy(ep->product, sizeof(ep->product), product, plen);
+    ep->model_known = true;
+    if (! ep->pinned) {
+        apply_rules(ep);
+        if (verbose > 1)
+            pr2ws("admission: 0x%" PRIx64 " is %s %s, max inflight "
+                  "%d, rate %d\n", ep->sa, ep->vendor, ep->product,
+                  ep->max_inflight, ep->rate);
+    }
+}
+
+void
+smp_admit_exit(const struct smp_target_obj * tobj, int slot,
+               const struct smp_req_resp * rresp, int res, int verbose)
+{
+    bool busy, good;
+    int len;
+    struct smp_admit_ent * ep;
+    const uint8_t * rp = rresp ? rresp->response : NULL;
+
+    if ((NULL == tobj) || (NULL == (ep = tobj->admitp)))
+        return;
+    if (slot >= 0)
+        lock_byte(ep->lock_fd, slot, F_UNLCK);
+    len = rresp ? rresp->act_response_len : 0;
+    good = (0 == res) && rp && (0 == rresp->transport_err) &&
+           ((len < 0) || (len > 2)) && (SMP_FRAME_TYPE_RESP == rp[0]);
+    busy = good && (SMP_FRES_BUSY == rp[2]);
+    pthread_mutex_lock(&ep->mtx);
+    if (slot >= 0)
+        ep->held &= ~((uint64_t)1 << slot);
+    --ep->inflight;
+    if (ep->hold > 0)
+        --ep->hold;
+    if (busy) {
+        ++ep->num_busy;
+        ep->ok_run = 0;
+        /* those already sent when the limit was halved don't count */
+        if ((ep->limit > 1) && (0 == ep->hold)) {
+            if (verbose > 1)
+                pr2ws("admission: 0x%" PRIx64 " BUSY, concurrency limit "
+                      "%d -> %d\n", ep->sa, ep->limit, ep->limit / 2);
+            ep->limit /= 2;
+            ep->hold = ep->inflight;
+        }
+    } else if (good && (++ep->ok_run >= ep->limit) &&
+               (ep->limit < ep->max_inflight)) {
+        ++ep->limit;
+        ep->ok_run = 0;
+        pthread_cond_broadcast(&ep->cv);
+    }
+    if (good && (0 == rp[2]) && (SMP_FN_REPORT_MANUFACTURER == rp[1]) &&
+        ((len < 0) || (len >= 36)) && (! ep->model_known))
+        set_model(ep, rp + 12, 8, rp + 20, 16, verbose);
+    pthread_cond_signal(&ep->cv);
+    pthread_mutex_unlock(&ep->mtx);
+}
+
+int
+smp_admit_identify(const struct smp_target_obj * tobj, int verbose)
+{
+    bool ask;
+    struct smp_admit_ent * ep;
+    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_REPORT_MANUFACTURER,
+                         0, 0, 0, 0, 0, 0};
+    uint8_t smp_resp[SMP_FN_REPORT_MANUFACTURER_RESP_LEN];
+    struct smp_req_resp smp_rr;
+    struct smp_caps caps;
+
+    if ((NULL == tobj) || (NULL == (ep = tobj->admitp)) ||
+        (admit_num_rules < 2))
+        return 0;
+    pthread_mutex_lock(&ep->mtx);
+    ask = ! (ep->model_known || ep->identify_tried || ep->pinned);
+    ep->identify_tried = true;
+    pthread_mutex_unlock(&ep->mtx);
+    if (! ask)
+        return 0;
+    /* the capability cache may know the model from an earlier run */
+    if ((0 == smp_caps_get(tobj, &caps, verbose)) && caps.vendor[0]) {
+        pthread_mutex_lock(&ep->mtx);
+        if (! ep->model_known)
+            set_model(ep, (const uint8_t *)caps.vendor, strlen(caps.vendor),
+                      (const uint8_t *)caps.product, strlen(caps.product),
+                      verbose);
+        pthread_mutex_unlock(&ep->mtx);
+        return 0;
+    }
+    memset(smp_resp, 0, sizeof(smp_resp));
+    memset(&smp_rr, 0, sizeof(smp_rr));
+    smp_rr.request_len = sizeof(smp_req);
+    smp_rr.request = smp_req;
+    smp_rr.max_response_len = sizeof(smp_resp);
+    smp_rr.response = smp_resp;
+    return smp_send_req(tobj, &smp_rr, verbose);  /* exit learns model */
+}
+
+int
+smp_admit_set(const struct smp_target_obj * tobj, int max_inflight,
+              int rate)
+{
+    struct smp_admit_ent * ep;
+
+    if ((NULL == tobj) || (NULL == (ep = tobj->admitp)) ||
+        (max_inflight > ADMIT_MAX_LIMIT))
+        return -1;
+    pthread_mutex_lock(&ep->mtx);
+    ep->pinned = true;
+    if (max_inflight > 0) {
+        ep->max_inflight = max_inflight;
+        ep->limit = max_inflight;
+        ep->ok_run = 0;
+    }
+    if (rate >= 0)
+        ep->rate = rate;
+    pthread_cond_broadcast(&ep->cv);
+    pthread_mutex_unlock(&ep->mtx);
+    return 0;
+}
+
+int
+smp_admit_get(const struct smp_target_obj * tobj,
+              struct smp_admit_info * aip)
+{
+    struct smp_admit_ent * ep;
+
+    if ((NULL == tobj) || (NULL == (ep = tobj->admitp)) || (NULL == aip))
+        return -1;
+    memset(aip, 0, sizeof(*aip));
+    pthread_mutex_lock(&ep->mtx);
+    aip->max_inflight = ep->max_inflight;
+    aip->limit = ep->limit;
+    aip->inflight = ep->inflight;
+    aip->rate = ep->rate;
+    aip->shared = (ep->lock_fd >= 0);
+    aip->num_busy = ep->num_busy;
+    aip->num_waits = ep->num_waits;
+    memcpy(aip->vendor, ep->vendor, sizeof(aip->vendor));
+    memcpy(aip->product, ep->product, sizeof(aip->product));
+    pthread_mutex_unlock(&ep->mtx);
+    return 0;
+}
@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_pr2serr.h"
+
+/* Batched SMP request submission. None of the pass-throughs (bsg, mptctl,
+ * aacraid, CAM or usmp) offer a portable asynchronous interface, however
+ * all of them accept concurrent synchronous requests on the same file
+ * descriptor. So up to 'max_inflight' requests are kept outstanding by
+ * issuing smp_send_req() from that many threads (the calling thread being
+ * one of them). As each request completes the caller's callback is invoked,
+ * serialized under a mutex, so the callback need not be re-entrant. */
+
+struct smp_batch_t {
+    const struct smp_target_obj * tobj;
+    struct smp_req_resp * rresp;
+    int num;
+    int next;                   /* index of next request to start */
+    int failed;                 /* number of smp_send_req() failures */
+    int verbose;
+    smp_batch_cb_t cb;
+    void * cb_arg;
+    uint64_t * sent_us;         /* when each request was sent, or NULL */
+    uint32_t * lat_us;          /* latency of each request, or NULL */
+    pthread_mutex_t mtx;
+};
+
+/* One SMP target of smp_send_req_lockstep(): its batch and the threads
+ * sending it, which all wait at the barrier before the first request */
+struct smp_lstep_run_t {
+    struct smp_batch_t batch;
+    int n_thr;
+    int * readyp;               /* threads at the barrier */
+    int * gop;                  /* set to release them */
+    pthread_t thr[SMP_BATCH_MAX_INFLIGHT];
+};
+
+static void *
+batch_worker(void * arg)
+{
+    struct smp_batch_t * bp = (struct smp_batch_t *)arg;
+    int k, res;
+    uint64_t begin_us = 0;
+
+    while (1) {
+        pthread_mutex_lock(&bp->mtx);
+        k = bp->next;
+        if (k < bp->num)
+            ++bp->next;
+        pthread_mutex_unlock(&bp->mtx);
+        if (k >= bp->num)
+            break;
+        if (bp->sent_us)
+            begin_us = smp_stats_clock_us();
+        res = smp_send_req(bp->tobj, bp->rresp + k, bp->verbose);
+        if (bp->sent_us) {
+            bp->sent_us[k] = begin_us;
+            if (bp->lat_us)
+                bp->lat_us[k] = (uint32_t)(smp_stats_clock_us() - begin_us);
+        }
+        pthread_mutex_lock(&bp->mtx);
+        if (res)
+            ++bp->failed;
+        if (bp->cb)
+            bp->cb(k, bp->rresp + k, res, bp->cb_arg);
+        pthread_mutex_unlock(&bp->mtx);
+    }
+    return NULL;
+}
+
+int
+smp_send_req_batch(const struct smp_target_obj * tobj,
+                   struct smp_req_resp * rresp, int num, int max_inflight,
+                   smp_batch_cb_t cb, void * cb_arg, int verbose)
+{
+    int k, n_thr, res;
+    pthread_t * thr = NULL;
+    const struct smp_xport_ops * xp;
+    struct smp_batch_t batch;
+    char b[64];
+
+    if ((NULL == tobj) || (0 == tobj->opened) || (NULL == rresp) ||
+        (num < 0)) {
+        if (verbose > 2)
+            pr2ws("%s: bad arguments or nothing open??\n", __func__);
+        return -1;
+    }
+    if (0 == num)
+        return 0;
+    smp_admit_identify(tobj, verbose);  /* so model rules can apply */
+    if (max_inflight <= 0)
+        max_inflight = SMP_BATCH_DEF_INFLIGHT;
+    else if (max_inflight > SMP_BATCH_MAX_INFLIGHT)
+        max_inflight = SMP_BATCH_MAX_INFLIGHT;
+    xp = tobj->xops;
+    if (xp && (xp->max_inflight > 0) && (max_inflight > xp->max_inflight))
+        max_inflight = xp->max_inflight;
+    if (xp && xp->send_batch)   /* transport has its own asynchronous path */
+        return xp->send_batch(tobj, rresp, num, max_inflight, cb, cb_arg,
+                              verbose);
+    if (max_inflight > num)
+        max_inflight = num;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.tobj = tobj;
+    batch.rresp = rresp;
+    batch.num = num;
+    batch.verbose = verbose;
+    batch.cb = cb;
+    batch.cb_arg = cb_arg;
+    pthread_mutex_init(&batch.mtx, NULL);
+
+    n_thr = 0;
+    if (max_inflight > 1) {
+        thr = (pthread_t *)calloc(max_inflight - 1, sizeof(pthread_t));
+        if (NULL == thr) {
+            if (verbose)
+                pr2ws("%s: unable to allocate threads, serializing\n",
+                      __func__);
+        } else {
+            for ( ; n_thr < (max_inflight - 1); ++n_thr) {
+                res = pthread_create(thr + n_thr, NULL, batch_worker, &batch);
+                if (res) {
+                    if (verbose)
+                        pr2ws("%s: pthread_create: %s, continuing with %d "
+                              "in flight\n", __func__,
+                              safe_strerror_r(res, b, sizeof(b)),
+                              n_thr + 1);
+                    break;
+                }
+            }
+        }
+    }
+    if (verbose > 3)
+        pr2ws("%s: num=%d, in flight=%d\n", __func__, num, n_thr + 1);
+    batch_worker(&batch);       /* calling thread does its share */
+    for (k = 0; k < n_thr; ++k)
+        pthread_join(thr[k], NULL);
+    if (thr)
+        free(thr);
+    pthread_mutex_destroy(&batch.mtx);
+    return batch.failed;
+}
+
+int
+smp_batch_resp_res(const struct smp_req_resp * rresp, int func)
+{
+    const uint8_t * rp = rresp->response;
+
+    if (rresp->transport_err)
+        return -1;
+    if ((rresp->act_response_len >= 0) && (rresp->act_response_len < 4))
+        return (0 == rresp->act_response_len) ? -1 : SMP_LIB_CAT_MALFORMED;
+    if ((SMP_FRAME_TYPE_RESP != rp[0]) || (func != rp[1]))
+        return (0 == rp[0]) ? -1 : SMP_LIB_CAT_MALFORMED;
+    return rp[2];
+}
+
+static void *
+lstep_worker(void * arg)
+{
+    int go;
+    struct smp_lstep_run_t * rp = (struct smp_lstep_run_t *)arg;
+
+    __atomic_add_fetch(rp->readyp, 1, __ATOMIC_ACQ_REL);
+    /* spin rather than sleep so that all leave within microseconds */
+    while (0 == (go = __atomic_load_n(rp->gop, __ATOMIC_ACQUIRE)))
+        sched_yield();
+    if (go < 0)         /* another thread failed to start, send nothing */
+        return NULL;
+    return batch_worker(&rp->batch);
+}
+
+int
+smp_send_req_lockstep(struct smp_lockstep_tgt * ltp, int num_tgts,
+                      int max_inflight, uint64_t * release_usp, int verbose)
+{
+    int k, j, res, n;
+    int total = 0;
+    int ready = 0;
+    int go = 0;
+    int ret = 0;
+    struct smp_lstep_run_t * runs;
+    struct smp_lstep_run_t * rp;
+    const struct smp_xport_ops * xp;
+    char b[64];
+
+    if ((NULL == ltp) || (num_tgts < 1)) {
+        if (verbose > 2)
+            pr2ws("%s: bad arguments\n", __func__);
+        return -1;
+    }
+    for (k = 0; k < num_tgts; ++k) {
+        if ((NULL == ltp[k].tobj) || (0 == ltp[k].tobj->opened) ||
+            (ltp[k].num < 0) || ((ltp[k].num > 0) && (NULL == ltp[k].rresp))) {
+            if (verbose > 2)
+                pr2ws("%s: target %d not open or bad arguments\n", __func__,
+                      k);
+            return -1;
+        }
+    }
+    if (max_inflight <= 0)
+        max_inflight = SMP_BATCH_DEF_INFLIGHT;
+    else if (max_inflight > SMP_BATCH_MAX_INFLIGHT)
+        max_inflight = SMP_BATCH_MAX_INFLIGHT;
+    runs = (struct smp_lstep_run_t *)calloc(num_tgts, sizeof(*runs));
+    if (NULL == runs)
+        return -1;
+    for (k = 0; k < num_tgts; ++k) {
+        smp_admit_identify(ltp[k].tobj, verbose);
+        rp = runs + k;
+        rp->batch.tobj = ltp[k].tobj;
+        rp->batch.rresp = ltp[k].rresp;
+        rp->batch.num = ltp[k].num;
+        rp->batch.verbose = verbose;
+        rp->batch.sent_us = ltp[k].sent_us;
+        rp->batch.lat_us = ltp[k].lat_us;
+        pthread_mutex_init(&rp->batch.mtx, NULL);
+        rp->readyp = &ready;
+        rp->gop = &go;
+    }
+    /* start every sending thread of every target before releasing any */
+    for (k = 0; (0 == ret) && (k < num_tgts); ++k) {
+        rp = runs + k;
+        xp = ltp[k].tobj->xops;
+        n = (xp && (xp->max_inflight > 0) &&
+             (max_inflight > xp->max_inflight)) ? xp->max_inflight :
+                                                  max_inflight;
+        if (n > ltp[k].num)
+            n = ltp[k].num;
+        for ( ; rp->n_thr < n; ++rp->n_thr) {
+            res = pthread_create(rp->thr + rp->n_thr, NULL, lstep_worker,
+                                 rp);
+            if (res) {
+                if (verbose)
+                    pr2ws("%s: pthread_create: %s\n", __func__,
+                          safe_strerror_r(res, b, sizeof(b)));
+                ret = -1;
+                break;
+            }
+        }
+        total += rp->n_thr;
+    }
+    if (ret)            /* started threads leave without sending */
+        __atomic_store_n(&go, -1, __ATOMIC_RELEASE);
+    else {
+        /* the barrier */
+        while (__atomic_load_n(&ready, __ATOMIC_ACQUIRE) < total)
+            sched_yield();
+        if (release_usp)
+            *release_usp = smp_stats_clock_us();
+        __atomic_store_n(&go, 1, __ATOMIC_RELEASE);
+    }
+    for (k = 0; k < num_tgts; ++k) {
+        rp = runs + k;
+        for (j = 0; j < rp->n_thr; ++j)
+            pthread_join(rp->thr[j], NULL);
+        pthread_mutex_destroy(&rp->batch.mtx);
+        ltp[k].failed = rp->batch.failed;
+        if (ret >= 0)
+            ret += rp->batch.failed;
+    }
+    free(runs);
+    return ret;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_pr2serr.h"
+
+/* Response buffer arena. Utilities (and programs linked with this library
+ * that poll for days) want a buffer or two per operation, each no larger
+ * than the largest SMP frame. Rather than smp_memalign() and free() each
+ * time, buffers are cut from one page aligned block kept on the target
+ * object, allocated on first use. smp_buf_reset() makes the whole block
+ * available again and smp_initiator_close() frees it. Each buffer starts
+ * on a SMP_BUF_ALIGN byte boundary; the first after a reset is page
+ * aligned. */
+
+#define SMP_BUF_ALIGN 64
+
+struct smp_buf_arena {
+    pthread_mutex_t mtx;
+    int used;
+    int len;
+    uint8_t * base;
+    uint8_t * free_base;
+};
+
+/* serializes making the arena of a target object */
+static pthread_mutex_t arena_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+
+uint8_t *
+smp_buf_get(struct smp_target_obj * tobj, int len)
+{
+    int n;
+    uint8_t * res = NULL;
+    struct smp_buf_arena * ap;
+
+    if ((NULL == tobj) || (len < 0) || (len > SMP_BUF_ARENA_LEN))
+        return NULL;
+    pthread_mutex_lock(&arena_mtx);    /* threads may share tobj */
+    if (NULL == (ap = tobj->arenap)) {
+        ap = (struct smp_buf_arena *)calloc(1, sizeof(*ap));
+        if (ap) {
+            ap->base = smp_memalign(SMP_BUF_ARENA_LEN, 0, &ap->free_base,
+                                    false);
+            if (NULL == ap->base) {
+                free(ap);
+                ap = NULL;
+            }
+        }
+        if (ap) {
+            ap->len = SMP_BUF_ARENA_LEN;
+            pthread_mutex_init(&ap->mtx, NULL);
+            tobj->arenap = ap;
+        }
+    }
+    pthread_mutex_unlock(&arena_mtx);
+    if (NULL == ap)
+        return NULL;
+    if (0 == len)
+        len = 1;
+    n = (len + SMP_BUF_ALIGN - 1) & ~(SMP_BUF_ALIGN - 1);
+    pthread_mutex_lock(&ap->mtx);
+    if (n <= (ap->len - ap->used)) {
+        res = ap->base + ap->used;
+        ap->used += n;
+    }
+    pthread_mutex_unlock(&ap->mtx);
+    if (res)
+        memset(res, 0, len);
+    else
+        pr2ws("%s: arena exhausted, %d bytes wanted\n", __func__, len);
+    return res;
+}
+
+void
+smp_buf_reset(struct smp_target_obj * tobj)
+{
+    struct smp_buf_arena * ap;
+
+    if ((NULL == tobj) || (NULL == (ap = tobj->arenap)))
+        return;
+    pthread_mutex_lock(&ap->mtx);
+    ap->used = 0;
+    pthread_mutex_unlock(&ap->mtx);
+}
+
+void
+smp_buf_free(struct smp_target_obj * tobj)
+{
+    struct smp_buf_arena * ap;
+
+    if (tobj && (ap = tobj->arenap)) {
+        pthread_mutex_destroy(&ap->mtx);
+        if (ap->free_base)
+            free(ap->free_base);
+        free(ap);
+        tobj->arenap = NULL;
+    }
+}
@@ -0,0 +1,511 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* Expander capability cache. Traits that cost a round trip (or a failed
+ * request) to learn are kept per expander model, the vendor, product and
+ * firmware revision from REPORT MANUFACTURER INFORMATION, so one model
+ * learns them for a whole fleet and a firmware upgrade starts afresh. The
+ * model of each SMP target (keyed by SAS address, else device name, as in
+ * lib/smp_dlist.c) is noted whenever smp_send_req() sees a REPORT
+ * MANUFACTURER response; smp_caps_get() and smp_caps_note() send one
+ * themselves (once per target) when the model is not yet known. Until it
+ * is, traits are kept against the target and are then copied to the model.
+ *
+ * The file is a log of lines, later lines overriding earlier ones:
+ *     tgt <key> <vendor|product|revision>         target's model
+ *     cap <key or model> [dlist=0|1] [zero=0|1]   traits
+ * where spaces within the model's fields are replaced by '_'. Each change
+ * is appended with one short write() (O_APPEND) so that concurrent
+ * processes don't mix lines; a long log is rewritten (via a temporary
+ * file, renamed) when loaded. Appends hold a shared flock() on the file
+ * and the rewrite an exclusive one, so no line is lost to it. It is in
+ * /run so is dropped at reboot, when the device names may change. What is
+ * learnt from the simulated expander or a snapshot replay is kept in
+ * memory only. */
+
+#define CAPS_DEF_FN "/run/smp_utils/caps"
+#define CAPS_DIR "/run/smp_utils"
+#define CAPS_SLOTS 256
+#define CAPS_MODEL_LEN 32       /* 8 + 1 + 16 + 1 + 4 + NUL */
+#define CAPS_KEY_LEN SMP_MAX_DEVICE_NAME
+
+#define SMP_FN_REPORT_MANUFACTURER_RESP_LEN 64
+
+struct caps_ent {
+    bool used;
+    bool dlist;
+    bool zero_lens;
+    bool asked;                 /* REPORT MANUFACTURER sent, this process */
+    bool transient;             /* from sim or snapshot, not written */
+    uint32_t known;             /* SMP_CAP_* bits */
+    char key[CAPS_KEY_LEN];     /* "0x<sa>", device name or a model */
+    char model[CAPS_MODEL_LEN]; /* model of a target key, "" if unknown */
+};
+
+static struct caps_ent caps_arr[CAPS_SLOTS];
+static int caps_next;
+static int caps_lines;          /* in the file, when loaded */
+static bool caps_loaded;
+static pthread_mutex_t caps_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* Returns the file name, or NULL if the SMP_UTILS_CAPS environment
+ * variable is "off" */
+static const char *
+caps_fn(void)
+{
+    const char * cp = getenv("SMP_UTILS_CAPS");
+
+    if (cp && (0 == strcmp(cp, "off")))
+        return NULL;
+    return (cp && *cp) ? cp : CAPS_DEF_FN;
+}
+
+static void
+caps_key(const struct smp_target_obj * tobj, char * b, int blen)
+{
+    uint64_t sa = sg_get_unaligned_be64(tobj->sas_addr);
+
+    if (sa)
+        snprintf(b, blen, "0x%" PRIx64, sa);
+    else
+        snprintf(b, blen, "%s", tobj->device_name);
+}
+
+/* Returns true for the simulated expander and snapshot replays, whose
+ * traits are not those of any hardware */
+static bool
+caps_transient(const struct smp_target_obj * tobj)
+{
+    return (SMP_SIM_INTERFACE == tobj->interface_selector) ||
+           (SMP_SNAP_INTERFACE == tobj->interface_selector);
+}
+
+/* Marks ep as learnt from tobj: a new entry takes its transience, a real
+ * target makes any entry persistent. Caller holds caps_mtx. */
+static void
+caps_mark(struct caps_ent * ep, const struct smp_target_obj * tobj)
+{
+    if ((0 == ep->known) && ('\0' == ep->model[0]))
+        ep->transient = caps_transient(tobj);
+    else if (! caps_transient(tobj))
+        ep->transient = false;
+}
+
+/* Caller holds caps_mtx. Returns the entry for key, made if add. */
+static struct caps_ent *
+caps_find(const char * key, bool add)
+{
+    int k;
+    struct caps_ent * ep;
+
+    for (k = 0; k < CAPS_SLOTS; ++k) {
+        ep = caps_arr + k;
+        if (ep->used && (0 == strcmp(ep->key, key)))
+            return ep;
+    }
+    if (! add)
+        return NULL;
+    ep = caps_arr + caps_next;
+    caps_next = (caps_next + 1) % CAPS_SLOTS;
+    memset(ep, 0, sizeof(*ep));
+    ep->used = true;
+    snprintf(ep->key, sizeof(ep->key), "%s", key);
+    return ep;
+}
+
+/* Applies one line of the file. Caller holds caps_mtx. */
+static void
+caps_line(char * line)
+{
+    int v;
+    char * cp;
+    char * key;
+    struct caps_ent * ep;
+
+    if ((cp = strchr(line, '\n')))
+        *cp = '\0';
+    if (0 == strncmp(line, "tgt ", 4)) {
+        key = line + 4;
+        if (NULL == (cp = strchr(key, ' ')))
+            return;
+        *cp++ = '\0';
+        if (*key && *cp && (NULL == strchr(cp, ' ')))
+            snprintf(caps_find(key, true)->model, CAPS_MODEL_LEN, "%s", cp);
+    } else if (0 == strncmp(line, "cap ", 4)) {
+        key = line + 4;
+        cp = strchr(key, ' ');
+        if (cp)
+            *cp++ = '\0';
+        if ('\0' == *key)
+            return;
+        ep = caps_find(key, true);
+        while (cp && *cp) {
+            if (1 == sscanf(cp, "dlist=%d", &v)) {
+                ep->dlist = !! v;
+                ep->known |= SMP_CAP_DLIST;
+            } else if (1 == sscanf(cp, "zero=%d", &v)) {
+                ep->zero_lens = !! v;
+                ep->known |= SMP_CAP_ZERO_LENS;
+            }
+            if ((cp = strchr(cp, ' ')))
+                ++cp;
+        }
+    }
+}
+
+/* Formats ep as the line(s) that recreate it into b. Returns the length. */
+static int
+caps_fmt(const struct caps_ent * ep, char * b, int blen)
+{
+    int n = 0;
+
+    if (ep->model[0])
+        n += snprintf(b + n, blen - n, "tgt %s %s\n", ep->key, ep->model);
+    if (ep->known && (n < blen)) {
+        n += snprintf(b + n, blen - n, "cap %s", ep->key);
+        if ((ep->known & SMP_CAP_DLIST) && (n < blen))
+            n += snprintf(b + n, blen - n, " dlist=%d", (int)ep->dlist);
+        if ((ep->known & SMP_CAP_ZERO_LENS) && (n < blen))
+            n += snprintf(b + n, blen - n, " zero=%d", (int)ep->zero_lens);
+        if (n < blen)
+            n += snprintf(b + n, blen - n, "\n");
+    }
+    return (n < blen) ? n : (blen - 1);
+}
+
+/* Rewrites the file from the table, under an exclusive flock() on it.
+ * The file is read again first, so lines other processes appended since
+ * it was loaded are kept (applying the older lines again is harmless as
+ * every change was appended in order). Caller holds caps_mtx. */
+static void
+caps_compact(const char * fn)
+{
+    int k, fd, lfd, n;
+    FILE * fp;
+    char tmp_fn[300];
+    char b[2 * (CAPS_KEY_LEN + CAPS_MODEL_LEN) + 64];
+
+    if ((lfd = open(fn, O_RDONLY)) < 0)
+        return;
+    if (flock(lfd, LOCK_EX) < 0) {
+        close(lfd);
+        return;
+    }
+    if ((fp = fdopen(dup(lfd), "r"))) {
+        while (fgets(b, sizeof(b), fp))
+            caps_line(b);
+        fclose(fp);
+    }
+    snprintf(tmp_fn, sizeof(tmp_fn), "%s.%d", fn, (int)getpid());
+    fd = open(tmp_fn, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if ((fd < 0) || (NULL == (fp = fdopen(fd, "w")))) {
+        if (fd >= 0)
+            close(fd);
+        close(lfd);
+        return;
+    }
+    caps_lines = 0;
+    for (k = 0, n = 0; (k < CAPS_SLOTS) && (n >= 0); ++k) {
+        if (caps_arr[k].used && (! caps_arr[k].transient) &&
+            (caps_fmt(caps_arr + k, b, sizeof(b)) > 0)) {
+            n = fputs(b, fp);
+            caps_lines += 2;
+        }
+    }
+    if (fclose(fp) || (n < 0) || rename(tmp_fn, fn))
+        unlink(tmp_fn);
+    close(lfd);         /* drops the lock */
+}
+
+/* Loads the file once per process. Caller holds caps_mtx. */
+static void
+caps_load(int verbose)
+{
+    const char * fn;
+    FILE * fp;
+    char line[CAPS_KEY_LEN + CAPS_MODEL_LEN + 32];
+
+    if (caps_loaded)
+        return;
+    caps_loaded = true;
+    if ((NULL == (fn = caps_fn())) || (NULL == (fp = fopen(fn, "r"))))
+        return;
+    while (fgets(line, sizeof(line), fp)) {
+        caps_line(line);
+        ++caps_lines;
+    }
+    fclose(fp);
+    if (verbose > 2)
+        pr2ws("%s: %d lines from %s\n", __func__, caps_lines, fn);
+    if (caps_lines > CAPS_SLOTS)
+        caps_compact(fn);
+}
+
+/* Appends ep to the file, under a shared flock() on it. If the file was
+ * rewritten (renamed over) while waiting for the lock, the new one is
+ * opened. Caller holds caps_mtx. */
+static void
+caps_append(const struct caps_ent * ep)
+{
+    int k, fd, n;
+    const char * fn = caps_fn();
+    struct stat fst, st;
+    char b[2 * (CAPS_KEY_LEN + CAPS_MODEL_LEN) + 64];
+
+    if ((NULL == fn) || ep->transient)
+        return;
+    if (0 == strcmp(fn, CAPS_DEF_FN))
+        mkdir(CAPS_DIR, 0755);  /* may well exist */
+    for (k = 0; k < 3; ++k) {
+        fd = open(fn, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0)
+            return;
+        if ((flock(fd, LOCK_SH) < 0) || (fstat(fd, &fst) < 0) ||
+            (stat(fn, &st) < 0) || (fst.st_ino == st.st_ino))
+            break;
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0)
+        return;
+    n = caps_fmt(ep, b, sizeof(b));
+    if (write(fd, b, n) == n)
+        caps_lines += 2;
+    close(fd);
+}
+
+/* Fills cp from the target entry tp and the entry of its model, if any.
+ * Returns 0 if anything is known. Caller holds caps_mtx. */
+static int
+caps_fill(const struct caps_ent * tp, struct smp_caps * cp)
+{
+    const struct caps_ent * mp;
+    char * p;
+    char b[CAPS_MODEL_LEN];
+
+    memset(cp, 0, sizeof(*cp));
+    if (NULL == tp)
+        return -1;
+    mp = tp->model[0] ? caps_find(tp->model, false) : NULL;
+    cp->known = tp->known | (mp ? mp->known : 0);
+    /* traits of the model, which more targets teach, take precedence */
+    cp->dlist = (mp && (mp->known & SMP_CAP_DLIST)) ? mp->dlist : tp->dlist;
+    cp->zero_lens = (mp && (mp->known & SMP_CAP_ZERO_LENS)) ?
+                    mp->zero_lens : tp->zero_lens;
+    if (tp->model[0]) {
+        snprintf(b, sizeof(b), "%s", tp->model);
+        for (p = b; *p; ++p) {
+            if ('_' == *p)
+                *p = ' ';
+        }
+        p = strchr(b, '|');
+        sscanf(b, "%8[^|]", cp->vendor);
+        if (p) {
+            sscanf(p + 1, "%16[^|]", cp->product);
+            if ((p = strchr(p + 1, '|')))
+                snprintf(cp->revision, sizeof(cp->revision), "%s", p + 1);
+        }
+    }
+    return (cp->known || tp->model[0]) ? 0 : -1;
+}
+
+/* Sends REPORT MANUFACTURER INFORMATION to tobj, the target of key, if
+ * its model is not known and that has not been tried by this process.
+ * smp_send_req() passes the response to smp_caps_resp_note(), so caps_mtx
+ * must not be held. */
+static void
+caps_identify(const struct smp_target_obj * tobj, const char * key,
+              int verbose)
+{
+    bool ask;
+    struct caps_ent * tp;
+    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_REPORT_MANUFACTURER,
+                         0, 0, 0, 0, 0, 0};
+    uint8_t smp_resp[SMP_FN_REPORT_MANUFACTURER_RESP_LEN];
+    struct smp_req_resp smp_rr;
+
+    if (SMP_SNAP_INTERFACE == tobj->interface_selector)
+        return;         /* replay has what was recorded, no more */
+    pthread_mutex_lock(&caps_mtx);
+    caps_load(verbose);
+    tp = caps_find(key, true);
+    ask = ! (tp->model[0] || tp->asked);
+    tp->asked = true;
+    pthread_mutex_unlock(&caps_mtx);
+    if (! ask)
+        return;
+    memset(smp_resp, 0, sizeof(smp_resp));
+    memset(&smp_rr, 0, sizeof(smp_rr));
+    smp_rr.request_len = sizeof(smp_req);
+    smp_rr.request = smp_req;
+    smp_rr.max_response_len = sizeof(smp_resp);
+    smp_rr.response = smp_resp;
+    if (smp_send_req(tobj, &smp_rr, verbose) && (verbose > 2))
+        pr2ws("%s: %s: REPORT MANUFACTURER failed\n", __func__, key);
+}
+
+int
+smp_caps_get(const struct smp_target_obj * tobj, struct smp_caps * cp,
+             int verbose)
+{
+    int res;
+    char key[CAPS_KEY_LEN];
+
+    if ((NULL == tobj) || (NULL == cp))
+        return -1;
+    caps_key(tobj, key, sizeof(key));
+    caps_identify(tobj, key, verbose);
+    pthread_mutex_lock(&caps_mtx);
+    caps_load(verbose);
+    res = caps_fill(caps_find(key, false), cp);
+    pthread_mutex_unlock(&caps_mtx);
+    if ((0 == res) && (verbose > 2))
+        pr2ws("%s: %s is '%s' '%s' '%s', known 0x%x\n", __func__, key,
+              cp->vendor, cp->product, cp->revision, cp->known);
+    return res;
+}
+
+void
+smp_caps_note(const struct smp_target_obj * tobj, uint32_t which,
+              const struct smp_caps * cp, int verbose)
+{
+    struct caps_ent * tp;
+    struct caps_ent * ep;
+    char key[CAPS_KEY_LEN];
+
+    if ((NULL == tobj) || (NULL == cp) || (0 == which))
+        return;
+    caps_key(tobj, key, sizeof(key));
+    caps_identify(tobj, key, verbose);
+    pthread_mutex_lock(&caps_mtx);
+    caps_load(verbose);
+    tp = caps_find(key, true);
+    ep = tp->model[0] ? caps_find(tp->model, true) : tp;
+    caps_mark(ep, tobj);
+    if (((which & SMP_CAP_DLIST) && (! (ep->known & SMP_CAP_DLIST) ||
+                                     (ep->dlist != cp->dlist))) ||
+        ((which & SMP_CAP_ZERO_LENS) &&
+         (! (ep->known & SMP_CAP_ZERO_LENS) ||
+          (ep->zero_lens != cp->zero_lens)))) {
+        if (which & SMP_CAP_DLIST)
+            ep->dlist = cp->dlist;
+        if (which & SMP_CAP_ZERO_LENS)
+            ep->zero_lens = cp->zero_lens;
+        ep->known |= (which & (SMP_CAP_DLIST | SMP_CAP_ZERO_LENS));
+        caps_append(ep);
+        if (verbose > 1)
+            pr2ws("%s: %s: known 0x%x\n", __func__, ep->key, ep->known);
+    }
+    pthread_mutex_unlock(&caps_mtx);
+}
+
+/* Copies slen bytes of s to d, trailing spaces dropped and other spaces
+ * (and any '|') made '_'. */
+static void
+caps_field(char * d, int dlen, const uint8_t * s, int slen)
+{
+    int k;
+
+    while ((slen > 0) && ((' ' == s[slen - 1]) || (0 == s[slen - 1])))
+        --slen;
+    for (k = 0; (k < slen) && (k < (dlen - 1)); ++k)
+        d[k] = ((s[k] <= ' ') || ('|' == s[k]) || (s[k] >= 0x7f)) ? '_' :
+                                                                  s[k];
+    d[k] = '\0';
+}
+
+void
+smp_caps_resp_note(const struct smp_target_obj * tobj,
+                   const struct smp_req_resp * rresp)
+{
+    int len;
+    uint32_t add;
+    struct caps_ent * tp;
+    struct caps_ent * mp;
+    const uint8_t * rp;
+    char v[9], p[17], r[5];
+    char key[CAPS_KEY_LEN];
+    char model[CAPS_MODEL_LEN];
+
+    if ((NULL == rresp) || (NULL == (rp = rresp->response)) ||
+        (rresp->request_len < 2) ||
+        (SMP_FN_REPORT_MANUFACTURER != rresp->request[1]))
+        return;
+    len = rresp->act_response_len;
+    if (rresp->transport_err || ((len >= 0) && (len < 40)) ||
+        (SMP_FRAME_TYPE_RESP != rp[0]) ||
+        (SMP_FN_REPORT_MANUFACTURER != rp[1]) || rp[2])
+        return;
+    caps_field(v, sizeof(v), rp + 12, 8);
+    caps_field(p, sizeof(p), rp + 20, 16);
+    caps_field(r, sizeof(r), rp + 36, 4);
+    if ('\0' == v[0])
+        return;
+    snprintf(model, sizeof(model), "%s|%s|%s", v, p, r);
+    caps_key(tobj, key, sizeof(key));
+    pthread_mutex_lock(&caps_mtx);
+    caps_load(0);
+    tp = caps_find(key, true);
+    if (strcmp(tp->model, model)) {
+        caps_mark(tp, tobj);
+        snprintf(tp->model, sizeof(tp->model), "%s", model);
+        caps_append(tp);
+        /* what was learnt before the model was known now goes with it */
+        mp = caps_find(model, true);
+        caps_mark(mp, tobj);
+        add = tp->known & ~mp->known;
+        if (add) {
+            if (add & SMP_CAP_DLIST)
+                mp->dlist = tp->dlist;
+            if (add & SMP_CAP_ZERO_LENS)
+                mp->zero_lens = tp->zero_lens;
+            mp->known |= add;
+            caps_append(mp);
+        }
+    }
+    pthread_mutex_unlock(&caps_mtx);
+}
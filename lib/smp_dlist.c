@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* DISCOVER LIST capability cache. DISCOVER LIST (SAS-2 and later) returns
+ * up to 8 long (or 40 short) descriptors per response where DISCOVER
+ * returns one phy, but SAS-1.1 expanders answer it with UNKNOWN SMP
+ * FUNCTION. Whether an expander supports it is found once, by a probe or
+ * from a real request, and remembered for the life of the process keyed by
+ * the expander's SAS address. When the SMP target was opened without a SAS
+ * address (e.g. a bsg device) the device name is the key instead. So
+ * smp_topology and smp_shell, which open the same expanders many times,
+ * pay for the probe once. The table is small and entries are reused round
+ * robin. What is found is also given to the capability cache (see
+ * lib/smp_caps.c) which keeps it across runs. */
+
+#define DLIST_CAP_SLOTS 64
+
+struct dlist_cap {
+    bool used;
+    bool supported;
+    uint64_t sa;
+    char dev_name[SMP_MAX_DEVICE_NAME];
+};
+
+static struct dlist_cap cap_arr[DLIST_CAP_SLOTS];
+static int cap_next;
+static pthread_mutex_t cap_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+
+static bool
+cap_key_match(const struct dlist_cap * cp,
+              const struct smp_target_obj * tobj, uint64_t sa)
+{
+    if (! cp->used)
+        return false;
+    if (sa)
+        return (sa == cp->sa);
+    return ((0 == cp->sa) && (0 == strcmp(cp->dev_name, tobj->device_name)));
+}
+
+/* Returns 1 if cached as supported, 0 if cached as not supported, else -1.
+ * Caller holds cap_mtx. */
+static int
+cap_lookup(const struct smp_target_obj * tobj)
+{
+    int k;
+    uint64_t sa = sg_get_unaligned_be64(tobj->sas_addr);
+
+    for (k = 0; k < DLIST_CAP_SLOTS; ++k) {
+        if (cap_key_match(cap_arr + k, tobj, sa))
+            return cap_arr[k].supported ? 1 : 0;
+    }
+    return -1;
+}
+
+/* Caller holds cap_mtx */
+static void
+cap_store(const struct smp_target_obj * tobj, bool supported)
+{
+    int k;
+    uint64_t sa = sg_get_unaligned_be64(tobj->sas_addr);
+    struct dlist_cap * cp = NULL;
+
+    for (k = 0; k < DLIST_CAP_SLOTS; ++k) {
+        if (cap_key_match(cap_arr + k, tobj, sa)) {
+            cp = cap_arr + k;
+            break;
+        }
+    }
+    if (NULL == cp) {
+        cp = cap_arr + cap_next;
+        cap_next = (cap_next + 1) % DLIST_CAP_SLOTS;
+        memset(cp, 0, sizeof(*cp));
+        cp->used = true;
+        cp->sa = sa;
+        if (0 == sa)
+            snprintf(cp->dev_name, sizeof(cp->dev_name), "%s",
+                     tobj->device_name);
+    }
+    cp->supported = supported;
+}
+
+void
+smp_discover_list_cap_set(const struct smp_target_obj * tobj, bool supported)
+{
+    struct smp_caps caps;
+
+    if (NULL == tobj)
+        return;
+    pthread_mutex_lock(&cap_mtx);
+    cap_store(tobj, supported);
+    pthread_mutex_unlock(&cap_mtx);
+    memset(&caps, 0, sizeof(caps));
+    caps.dlist = supported;
+    smp_caps_note(tobj, SMP_CAP_DLIST, &caps, 0);
+}
+
+int
+smp_discover_list_supported(struct smp_target_obj * tobj, int verbose)
+{
+    int res, k;
+    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_DISCOVER_LIST, 0, 6,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                         0, 0, 0, 0, };
+    uint8_t rp[48 + 24 + 4];    /* header, one short descriptor, CRC */
+    struct smp_req_resp smp_rr;
+    struct smp_caps caps;
+    char b[128];
+
+    if ((NULL == tobj) || (0 == tobj->opened))
+        return -1;
+    pthread_mutex_lock(&cap_mtx);
+    res = cap_lookup(tobj);
+    pthread_mutex_unlock(&cap_mtx);
+    if (res >= 0) {
+        if (verbose > 2)
+            pr2ws("%s: from cache, %ssupported\n", __func__,
+                  (res ? "" : "not "));
+        return res;
+    }
+    /* an earlier run may have learnt it for this expander or its model */
+    if ((0 == smp_caps_get(tobj, &caps, verbose)) &&
+        (caps.known & SMP_CAP_DLIST)) {
+        res = caps.dlist ? 1 : 0;
+        pthread_mutex_lock(&cap_mtx);
+        cap_store(tobj, !! res);
+        pthread_mutex_unlock(&cap_mtx);
+        if (verbose > 2)
+            pr2ws("%s: from capability cache, %ssupported\n", __func__,
+                  (res ? "" : "not "));
+        return res;
+    }
+    /* probe: ask for one short descriptor starting at phy 0 */
+    smp_req[2] = (sizeof(rp) - 8) / 4;
+    smp_req[9] = 1;
+    smp_req[11] = 1;
+    if (verbose) {
+        pr2ws("    Discover list probe request: ");
+        for (k = 0; k < (int)sizeof(smp_req); ++k) {
+            if (0 == (k % 16))
+                pr2ws("\n      ");
+            else if (0 == (k % 8))
+                pr2ws(" ");
+            pr2ws("%02x ", smp_req[k]);
+        }
+        pr2ws("\n");
+    }
+    memset(rp, 0, sizeof(rp));
+    memset(&smp_rr, 0, sizeof(smp_rr));
+    smp_rr.request_len = sizeof(smp_req);
+    smp_rr.request = smp_req;
+    smp_rr.max_response_len = sizeof(rp);
+    smp_rr.response = rp;
+    res = smp_send_req(tobj, &smp_rr, verbose);
+    if (res || smp_rr.transport_err ||
+        ((smp_rr.act_response_len >= 0) && (smp_rr.act_response_len < 4)) ||
+        (SMP_FRAME_TYPE_RESP != rp[0]) || (rp[1] != smp_req[1])) {
+        if (verbose)
+            pr2ws("%s: probe failed, res=%d\n", __func__, res);
+        return -1;
+    }
+    switch (rp[2]) {
+    case SMP_FRES_FUNCTION_ACCEPTED:
+    case SMP_FRES_NO_PHY:       /* understood, expander without phy 0 */
+    case SMP_FRES_PHY_VACANT:
+        res = 1;
+        break;
+    case SMP_FRES_UNKNOWN_FUNCTION:
+        res = 0;
+        break;
+    default:
+        if (verbose)
+            pr2ws("%s: probe result: %s\n", __func__,
+                  smp_get_func_res_str(rp[2], sizeof(b), b));
+        return -1;              /* don't know, so don't cache */
+    }
+    smp_discover_list_cap_set(tobj, !! res);
+    if (verbose > 1)
+        pr2ws("%s: DISCOVER LIST %ssupported\n", __func__,
+              (res ? "" : "not "));
+    return res;
+}
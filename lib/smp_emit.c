@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+
+/* Machine readable output. Each record (e.g. one per phy) is appended
+ * field by field to a large buffer allocated once by smp_emit_init() and
+ * the buffer is written out with a single fwrite() when it is nearly full,
+ * rather than calling stdio for every field. JSON output is one object per
+ * line (often called "JSON lines") so a collector can start decoding
+ * before the utility finishes. CSV output has a header line made from the
+ * field names of the first record; later records are expected to have the
+ * same fields in the same order. */
+
+#define SMP_EMIT_BUFF_LEN (64 * 1024)
+#define SMP_EMIT_HDR_LEN 2048
+#define SMP_EMIT_REC_MAX 4096   /* flush when less than this remains */
+
+static const char * att_dev_type_arr[] = {
+    "none", "end", "expander", "fanout", "reserved", "reserved", "reserved",
+    "reserved",
+};
+
+
+/* Appends len bytes from s to b (at *offp), truncating if there is no
+ * room. Only smp_emit_rec_end() flushes the buffer so a
+ * record (and the CSV header) is never split. */
+static void
+add(char * b, int blen, int * offp, const char * s, int len)
+{
+    if (len > (blen - 1 - *offp))
+        len = blen - 1 - *offp;
+    if (len <= 0)
+        return;
+    memcpy(b + *offp, s, len);
+    *offp += len;
+    b[*offp] = '\0';
+}
+
+static void
+add_name(struct smp_emit * ep, const char * name)
+{
+    if (SMP_EMIT_JSON == ep->fmt) {
+        add(ep->buff, ep->blen, &ep->off, ep->nfields ? ",\"" : "\"",
+            ep->nfields ? 2 : 1);
+        add(ep->buff, ep->blen, &ep->off, name, strlen(name));
+        add(ep->buff, ep->blen, &ep->off, "\":", 2);
+    } else {
+        if (ep->nfields)
+            add(ep->buff, ep->blen, &ep->off, ",", 1);
+        if (! ep->hdr_done) {
+            if (ep->nfields)
+                add(ep->hdr, SMP_EMIT_HDR_LEN, &ep->hdr_off, ",", 1);
+            add(ep->hdr, SMP_EMIT_HDR_LEN, &ep->hdr_off, name,
+                strlen(name));
+        }
+    }
+    ++ep->nfields;
+}
+
+/* Returns 0 on success, else -1 (out of memory or bad fmt). */
+int
+smp_emit_init(struct smp_emit * ep, int fmt, FILE * fp)
+{
+    memset(ep, 0, sizeof(*ep));
+    if ((SMP_EMIT_JSON != fmt) && (SMP_EMIT_CSV != fmt))
+        return -1;
+    ep->fmt = fmt;
+    ep->fp = fp ? fp : stdout;
+    ep->blen = SMP_EMIT_BUFF_LEN;
+    ep->buff = (char *)malloc(SMP_EMIT_BUFF_LEN + SMP_EMIT_HDR_LEN);
+    if (NULL == ep->buff)
+        return -1;
+    ep->hdr = ep->buff + SMP_EMIT_BUFF_LEN;
+    ep->buff[0] = '\0';
+    ep->hdr[0] = '\0';
+    return 0;
+}
+
+void
+smp_emit_rec_begin(struct smp_emit * ep)
+{
+    ep->nfields = 0;
+    if (SMP_EMIT_JSON == ep->fmt)
+        add(ep->buff, ep->blen, &ep->off, "{", 1);
+}
+
+void
+smp_emit_int(struct smp_emit * ep, const char * name, int64_t val)
+{
+    int n;
+    char b[32];
+
+    add_name(ep, name);
+    n = snprintf(b, sizeof(b), "%" PRId64, val);
+    add(ep->buff, ep->blen, &ep->off, b, n);
+}
+
+/* SAS addresses and the like are output in hex, quoted in JSON since
+ * many JSON decoders hold numbers as doubles (53 bit mantissa). */
+void
+smp_emit_hex64(struct smp_emit * ep, const char * name, uint64_t val)
+{
+    int n;
+    char b[32];
+
+    add_name(ep, name);
+    if (SMP_EMIT_JSON == ep->fmt)
+        n = snprintf(b, sizeof(b), "\"0x%016" PRIx64 "\"", val);
+    else
+        n = snprintf(b, sizeof(b), "0x%016" PRIx64, val);
+    add(ep->buff, ep->blen, &ep->off, b, n);
+}
+
+void
+smp_emit_str(struct smp_emit * ep, const char * name, const char * s)
+{
+    bool json = (SMP_EMIT_JSON == ep->fmt);
+    bool quote;
+    const char * cp;
+    char b[8];
+
+    add_name(ep, name);
+    if (NULL == s)
+        s = "";
+    quote = json || (NULL != strpbrk(s, ",\"\r\n"));
+    if (quote)
+        add(ep->buff, ep->blen, &ep->off, "\"", 1);
+    for (cp = s; *cp; ++cp) {
+        if ('"' == *cp)
+            add(ep->buff, ep->blen, &ep->off, json ? "\\\"" : "\"\"", 2);
+        else if (json && ('\\' == *cp))
+            add(ep->buff, ep->blen, &ep->off, "\\\\", 2);
+        else if (json && ((unsigned char)*cp < 0x20))
+            add(ep->buff, ep->blen, &ep->off, b,
+                snprintf(b, sizeof(b), "\\u%04x", (unsigned char)*cp));
+        else
+            add(ep->buff, ep->blen, &ep->off, cp, 1);
+    }
+    if (quote)
+        add(ep->buff, ep->blen, &ep->off, "\"", 1);
+}
+
+void
+smp_emit_rec_end(struct smp_emit * ep)
+{
+    if (SMP_EMIT_JSON == ep->fmt)
+        add(ep->buff, ep->blen, &ep->off, "}\n", 2);
+    else {
+        add(ep->buff, ep->blen, &ep->off, "\n", 1);
+        if (! ep->hdr_done) {
+            add(ep->hdr, SMP_EMIT_HDR_LEN, &ep->hdr_off, "\n", 1);
+            if (ep->hdr_off !=
+                (int)fwrite(ep->hdr, 1, ep->hdr_off, ep->fp))
+                ep->err = true;
+            ep->hdr_done = true;
+        }
+    }
+    ++ep->nrecs;
+    if (ep->off > (ep->blen - SMP_EMIT_REC_MAX))
+        smp_emit_flush(ep);
+}
+
+int
+smp_emit_flush(struct smp_emit * ep)
+{
+    if (ep->off > 0) {
+        if (ep->off != (int)fwrite(ep->buff, 1, ep->off, ep->fp))
+            ep->err = true;
+        ep->off = 0;
+        ep->buff[0] = '\0';
+    }
+    if (fflush(ep->fp))
+        ep->err = true;
+    return ep->err ? -1 : 0;
+}
+
+/* Flushes and frees the buffer. Returns 0 if all output was written,
+ * else -1. */
+int
+smp_emit_fini(struct smp_emit * ep)
+{
+    int res = 0;
+
+    if (ep->buff) {
+        res = smp_emit_flush(ep);
+        free(ep->buff);
+        ep->buff = NULL;
+        ep->hdr = NULL;
+    }
+    return res;
+}
+
+/* Field names follow the SPL names of the DISCOVER response, lower case
+ * with underscores. The same fields are emitted whatever the source (a
+ * DISCOVER response or a long or short DISCOVER LIST descriptor) so CSV
+ * columns line up; those absent from the source are zero. */
+void
+smp_emit_discover(struct smp_emit * ep, const struct smp_discover_view * vp)
+{
+    smp_emit_int(ep, "phy_identifier", vp->phy_id);
+    smp_emit_int(ep, "function_result", vp->func_res);
+    smp_emit_hex64(ep, "sas_address", vp->sas_addr);
+    smp_emit_int(ep, "expander_change_count", vp->exp_change_count);
+    smp_emit_int(ep, "attached_device_type", vp->att_dev_type);
+    smp_emit_str(ep, "attached_device",
+                 att_dev_type_arr[vp->att_dev_type & 0x7]);
+    smp_emit_hex64(ep, "attached_sas_address", vp->att_sas_addr);
+    smp_emit_int(ep, "attached_phy_identifier", vp->att_phy_id);
+    smp_emit_hex64(ep, "attached_device_name", vp->att_dev_name);
+    smp_emit_int(ep, "attached_initiator", vp->att_init);
+    smp_emit_int(ep, "attached_target", vp->att_targ);
+    smp_emit_int(ep, "negotiated_logical_link_rate", vp->neg_log_lrate);
+    smp_emit_int(ep, "negotiated_physical_link_rate", vp->neg_phy_lrate);
+    smp_emit_int(ep, "programmed_minimum_link_rate", vp->prog_min_lrate);
+    smp_emit_int(ep, "hardware_minimum_link_rate", vp->hw_min_lrate);
+    smp_emit_int(ep, "programmed_maximum_link_rate", vp->prog_max_lrate);
+    smp_emit_int(ep, "hardware_maximum_link_rate", vp->hw_max_lrate);
+    smp_emit_int(ep, "routing_attribute", vp->routing_attr);
+    smp_emit_int(ep, "virtual_phy", vp->virt_phy);
+    smp_emit_int(ep, "phy_change_count", vp->phy_change_count);
+    smp_emit_int(ep, "zoning_enabled",
+                 !! (vp->zone_flags & SMP_DV_ZONING_EN));
+    smp_emit_int(ep, "zone_group", vp->zone_group);
+    smp_emit_int(ep, "connector_type", vp->conn_type);
+    smp_emit_int(ep, "device_slot_number", vp->dev_slot_num);
+}
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_pr2serr.h"
+
+/* Reader of the ASCII hex (or binary) files given to the zone utilities
+ * as --permf=FN and --pconf=PC. A regular file is mapped and decoded in
+ * place, other files (e.g. stdin as '-') are first read into memory, so
+ * the cost is one pass over the bytes with a table lookup per character,
+ * rather than fgets(), strspn() and a sscanf() per byte. Unlike the copies
+ * of f2hex_arr() it replaces, there is no limit on the number of lines or
+ * their length and a '\r' before each '\n' is accepted. */
+
+#define F2HEX_STDIN_CHUNK 65536
+
+/* value of each hex digit, -1 for other characters */
+static const signed char hex_val[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+static inline bool
+is_sep(int c)
+{
+    return (' ' == c) || ('\t' == c) || (',' == c);
+}
+
+/* Returns malloc-ed copy of all of fd (up to EOF) with its length in
+ * *lenp, or NULL */
+static uint8_t *
+slurp(int fd, int64_t * lenp)
+{
+    int64_t len = 0;
+    int64_t sz = F2HEX_STDIN_CHUNK;
+    ssize_t n;
+    uint8_t * bp = (uint8_t *)malloc(sz);
+    uint8_t * nbp;
+
+    while (bp) {
+        if (len == sz) {
+            sz *= 2;
+            if (NULL == (nbp = (uint8_t *)realloc(bp, sz))) {
+                free(bp);
+                return NULL;
+            }
+            bp = nbp;
+        }
+        n = read(fd, bp + len, sz - len);
+        if (n < 0) {
+            if (EINTR == errno)
+                continue;
+            free(bp);
+            return NULL;
+        }
+        if (0 == n)
+            break;
+        len += n;
+    }
+    *lenp = len;
+    return bp;
+}
+
+/* Decodes the text in [bp, bp + len). Returns 0 if ok, else 1. */
+static int
+decode_text(const char * fname, const uint8_t * bp, int64_t len,
+            uint8_t * mp_arr, int * mp_arr_len, int max_arr_len,
+            int * startp, int * line_maxp, int verbose)
+{
+    bool checked_hexlen = false;
+    bool no_space = false;
+    int n, v, lnum, nib;
+    int off = 0;
+    int line_max = 0;
+    long k;
+    const uint8_t * lp;         /* start of line */
+    const uint8_t * ep;         /* end of line, less any '\r' */
+    const uint8_t * p;
+    const uint8_t * q;
+    const uint8_t * fin = bp + len;
+    char b[32];
+
+    for (lnum = 1, lp = bp; lp < fin; ++lnum, lp = ep + 1) {
+        ep = (const uint8_t *)memchr(lp, '\n', fin - lp);
+        if (NULL == ep)
+            ep = fin;
+        q = ep;
+        if ((q > lp) && ('\r' == *(q - 1)))
+            --q;
+        for (p = lp; (p < q) && ((' ' == *p) || ('\t' == *p)); ++p)
+            ;
+        if ((p == q) || ('#' == *p))
+            continue;
+        if ('-' == *p) {
+            if (NULL == startp)
+                goto syntax;
+            n = q - p;
+            if (n >= (int)sizeof(b))
+                n = sizeof(b) - 1;
+            memcpy(b, p, n);
+            b[n] = '\0';
+            if ((0 == strncmp("--start=", b, 8)) &&
+                ((k = strtol(b + 8, NULL, 10)) >= 0) && (k < 256))
+                *startp = (int)k;
+            else if (verbose)
+                pr2ws("%s: line %d: could not decode --start=<num>, "
+                      "ignored\n", fname, lnum);
+            continue;
+        }
+        if (! checked_hexlen) {
+            checked_hexlen = true;
+            for (n = 0; ((p + n) < q) && (hex_val[p[n]] >= 0); ++n)
+                ;
+            if (n > 2)
+                no_space = true;
+        }
+        n = 0;          /* bytes on this line */
+        while (p < q) {
+            if (is_sep(*p)) {
+                ++p;
+                continue;
+            }
+            if (('#' == *p) || (startp && ('-' == *p)))
+                break;
+            if (hex_val[*p] < 0)
+                goto syntax;
+            if (no_space) {     /* run of digit pairs */
+                for ( ; (p < q) && (hex_val[*p] >= 0); p += 2, ++n) {
+                    if (((p + 1) >= q) || (hex_val[p[1]] < 0)) {
+                        pr2ws("%s: odd number of hex digits at line %d, "
+                              "pos %d\n", fname, lnum, (int)(p - lp + 1));
+                        return 1;
+                    }
+                    if (off >= max_arr_len)
+                        goto too_long;
+                    mp_arr[off++] = (hex_val[p[0]] << 4) | hex_val[p[1]];
+                }
+            } else {            /* one number, perhaps with leading zeros */
+                for (v = 0, nib = 0; (p < q) && (hex_val[*p] >= 0);
+                     ++p, ++nib) {
+                    v = (v << 4) | hex_val[*p];
+                    if (v > 0xff) {
+                        pr2ws("%s: hex number larger than 0xff in line %d, "
+                              "pos %d\n", fname, lnum, (int)(p - lp - nib + 1));
+                        return 1;
+                    }
+                }
+                if (off >= max_arr_len)
+                    goto too_long;
+                mp_arr[off++] = v;
+                ++n;
+            }
+            if ((p < q) && ! (is_sep(*p) || ('#' == *p) ||
+                              (startp && ('-' == *p))))
+                goto syntax;
+        }
+        if (n > line_max)
+            line_max = n;
+    }
+    *mp_arr_len = off;
+    if (line_maxp)
+        *line_maxp = line_max;
+    return 0;
+syntax:
+    pr2ws("%s: syntax error at line %d, pos %d\n", fname, lnum,
+          (int)(p - lp + 1));
+    return 1;
+too_long:
+    pr2ws("%s: array length (%d) exceeded at line %d\n", fname,
+          max_arr_len, lnum);
+    return 1;
+}
+
+int
+smp_f2hex_arr(const char * fname, bool as_binary, uint8_t * mp_arr,
+              int * mp_arr_len, int max_arr_len, int * startp,
+              int * line_maxp, int verbose)
+{
+    bool mapped = false;
+    int fd, res;
+    int64_t len = 0;
+    uint8_t * bp = NULL;
+    struct stat st;
+
+    if ((NULL == fname) || ('\0' == fname[0]) || (NULL == mp_arr) ||
+        (NULL == mp_arr_len))
+        return 1;
+    if (startp)
+        *startp = -1;
+    if (line_maxp)
+        *line_maxp = 0;
+    if (0 == strcmp("-", fname))
+        fd = STDIN_FILENO;
+    else if ((fd = open(fname, O_RDONLY)) < 0) {
+        pr2ws("Unable to open %s for reading: %s\n", fname, strerror(errno));
+        return 1;
+    }
+    if ((0 == fstat(fd, &st)) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+        len = st.st_size;
+        bp = (uint8_t *)mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == bp)
+            bp = NULL;
+        else {
+            mapped = true;
+            madvise(bp, len, MADV_SEQUENTIAL);
+        }
+    }
+    if (NULL == bp)
+        bp = slurp(fd, &len);
+    if (STDIN_FILENO != fd)
+        close(fd);
+    if (NULL == bp) {
+        pr2ws("Unable to read %s: %s\n", fname, strerror(errno));
+        return 1;
+    }
+    if (as_binary) {
+        if (len > max_arr_len) {
+            pr2ws("%s: %" PRId64 " bytes, more than the %d expected\n",
+                  fname, len, max_arr_len);
+            res = 1;
+        } else {
+            memcpy(mp_arr, bp, len);
+            *mp_arr_len = (int)len;
+            res = 0;
+        }
+    } else
+        res = decode_text(fname, bp, len, mp_arr, mp_arr_len, max_arr_len,
+                          startp, line_maxp, verbose);
+    if (mapped)
+        munmap(bp, len);
+    else
+        free(bp);
+    if ((0 == res) && (verbose > 2))
+        pr2ws("%s: %d bytes decoded from %" PRId64 " byte %s file\n",
+              fname, *mp_arr_len, len, as_binary ? "binary" : "text");
+    return res;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* Request frames are otherwise built from scratch for every request. A
+ * template is built once per function and options: the frame header and
+ * its two length fields, option bytes the caller sets, and the place of
+ * the phy identifier (or starting index) that changes per request. The
+ * response buffer is not cleared before each send, only its 4 byte header,
+ * which holds the response length. When the pass-through says how much
+ * arrived any shortfall up to that length is cleared after the send;
+ * beyond it (or with pass-throughs that don't say) bytes are stale. */
+
+struct tmpl_idx_t {
+    uint8_t func;
+    uint8_t off;                /* byte offset within the request */
+    uint8_t width;              /* 1, or 2 for big endian 16 bit */
+};
+
+static const struct tmpl_idx_t tmpl_idx_arr[] = {
+    {SMP_FN_DISCOVER, 9, 1},
+    {SMP_FN_REPORT_PHY_ERR_LOG, 9, 1},
+    {SMP_FN_REPORT_PHY_SATA, 9, 1},
+    {SMP_FN_REPORT_ROUTE_INFO, 9, 1},
+    {SMP_FN_REPORT_PHY_EVENT, 9, 1},
+    {SMP_FN_DISCOVER_LIST, 8, 1},               /* starting phy id */
+    {SMP_FN_REPORT_PHY_EVENT_LIST, 6, 2},       /* starting descriptor */
+    {SMP_FN_CONFIG_ROUTE_INFO, 9, 1},
+    {SMP_FN_PHY_CONTROL, 9, 1},
+    {SMP_FN_PHY_TEST_FUNCTION, 9, 1},
+    {SMP_FN_CONFIG_PHY_EVENT, 9, 1},
+};
+
+int
+smp_tmpl_init(struct smp_req_tmpl * tp, int func_code, int req_len,
+              uint8_t * resp, int max_resp_len, bool zero_lens, int verbose)
+{
+    int k, n;
+    const struct tmpl_idx_t * ip;
+
+    if ((NULL == tp) || (NULL == resp) || (max_resp_len < 8)) {
+        if (verbose > 2)
+            pr2ws("%s: bad arguments\n", __func__);
+        return -1;
+    }
+    if (0 == req_len) {
+        n = smp_get_func_def_req_len(func_code);
+        if (n < 0) {
+            if (verbose)
+                pr2ws("%s: no default request length for function 0x%x\n",
+                      __func__, func_code);
+            return -1;
+        }
+        req_len = 8 + (4 * n);
+    }
+    if ((req_len < 8) || (req_len > SMP_TMPL_MAX_REQ_LEN) || (req_len % 4)) {
+        if (verbose)
+            pr2ws("%s: bad request length %d\n", __func__, req_len);
+        return -1;
+    }
+    memset(tp, 0, sizeof(*tp));
+    tp->req[0] = SMP_FRAME_TYPE_REQ;
+    tp->req[1] = func_code;
+    if (! zero_lens) {          /* SAS-2 or later */
+        n = (max_resp_len - 8) / 4;
+        tp->req[2] = (n < 0x100) ? n : 0xff;   /* Allocated Response Len */
+        tp->req[3] = (req_len - 8) / 4;        /* Request Length: dwords */
+    }
+    tp->idx_off = -1;
+    for (k = 0; k < (int)(sizeof(tmpl_idx_arr) / sizeof(tmpl_idx_arr[0]));
+         ++k) {
+        ip = tmpl_idx_arr + k;
+        if (ip->func == func_code) {
+            tp->idx_off = ip->off;
+            tp->idx_width = ip->width;
+            break;
+        }
+    }
+    tp->rr.request_len = req_len;
+    tp->rr.request = tp->req;
+    tp->rr.max_response_len = max_resp_len;
+    tp->rr.response = resp;
+    return 0;
+}
+
+void
+smp_tmpl_set_idx(struct smp_req_tmpl * tp, unsigned int idx)
+{
+    if (tp->idx_off < 0)
+        return;
+    if (2 == tp->idx_width)
+        sg_put_unaligned_be16((uint16_t)idx, tp->req + tp->idx_off);
+    else
+        tp->req[tp->idx_off] = (uint8_t)idx;
+}
+
+int
+smp_tmpl_send(const struct smp_target_obj * tobj, struct smp_req_tmpl * tp,
+              int verbose)
+{
+    int res, len, act;
+    uint8_t * rp = tp->rr.response;
+
+    tp->rr.act_response_len = 0;
+    tp->rr.transport_err = 0;
+    memset(rp, 0, 4);
+    res = smp_send_req(tobj, &tp->rr, verbose);
+    /* a short response reads as zeros up to the length it claims, as it
+     * would from a cleared buffer */
+    act = tp->rr.act_response_len;
+    if ((0 == res) && (act >= 4) && (act < tp->rr.max_response_len)) {
+        len = 4 + (rp[3] * 4);
+        if (len > tp->rr.max_response_len)
+            len = tp->rr.max_response_len;
+        if (len > act)
+            memset(rp + act, 0, len - act);
+    }
+    return res;
+}
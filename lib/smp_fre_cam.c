@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2011-2018, Douglas Gilbert
+ * Copyright (c) 2011-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <fcntl.h>
@@ -41,43 +42,92 @@
 #include <glob.h>
 #include <fcntl.h>
 #include <stddef.h>
+#include <pthread.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 #include "smp_lib.h"
 #include "sg_unaligned.h"
+#include "sg_pr2serr.h"
 
 #define I_CAM 1
+#define DEF_CAM_TIMEOUT_MS 5000
 
+/* CCBs are allocated with cam_getccb() as needed and kept on the target
+ * object for reuse, so a sequence of requests costs one allocation. There
+ * are as many as there can be requests in flight from
+ * smp_send_req_batch(); each request takes a free one under the mutex. */
 struct tobj_cam_t {
     struct cam_device * cam_dev;
     char devname[DEV_IDLEN + 1];        /* for cam */
     int unitnum;                        /* for cam */
+    int num_ccbs;                       /* allocated so far */
+    pthread_mutex_t mtx;
+    bool in_use[SMP_BATCH_MAX_INFLIGHT];
+    union ccb * ccbs[SMP_BATCH_MAX_INFLIGHT];
 };
 
 
+/* Returns a CCB from the target's pool (allocating one if all are busy),
+ * or NULL. *slotp is the pool index or -1 if the CCB is not pooled. */
+static union ccb *
+get_ccb(struct tobj_cam_t * tcp, int * slotp)
+{
+    int k;
+    union ccb * ccb = NULL;
+
+    *slotp = -1;
+    pthread_mutex_lock(&tcp->mtx);
+    for (k = 0; k < tcp->num_ccbs; ++k) {
+        if (! tcp->in_use[k])
+            break;
+    }
+    if (k >= tcp->num_ccbs) {
+        if ((k < SMP_BATCH_MAX_INFLIGHT) &&
+            (tcp->ccbs[k] = cam_getccb(tcp->cam_dev)))
+            ++tcp->num_ccbs;
+        else
+            k = -1;
+    }
+    if (k >= 0) {
+        tcp->in_use[k] = true;
+        ccb = tcp->ccbs[k];
+        *slotp = k;
+    }
+    pthread_mutex_unlock(&tcp->mtx);
+    if (NULL == ccb)
+        ccb = cam_getccb(tcp->cam_dev);
+    return ccb;
+}
+
+static void
+put_ccb(struct tobj_cam_t * tcp, union ccb * ccb, int slot)
+{
+    if (slot < 0) {
+        cam_freeccb(ccb);
+        return;
+    }
+    pthread_mutex_lock(&tcp->mtx);
+    tcp->in_use[slot] = false;
+    pthread_mutex_unlock(&tcp->mtx);
+}
+
+
 /* Note that CAM (circa FreeBSD 9) cannot directly communicate with a SAS
  * expander because it isn't a SCSI device. FreeBSD assumes each SAS
  * expander is paired with a SES (enclosure) device. This seems to be true
  * for SAS-2 expanders but not the older SAS-1 expanders. Hence device_name
- * will be something like /dev/ses0 . */
-int
-smp_initiator_open(const char * device_name, int subvalue,
-                   const char * i_params, uint64_t sa,
-                   struct smp_target_obj * tobj, int verbose)
+ * will be something like /dev/ses0 . There is no index of SAS address to
+ * device here, so no name_by_sa(). */
+static int
+cam_open(const char * device_name, int subvalue, const char * i_params,
+         uint64_t sa, struct smp_target_obj * tobj, int verbose)
 {
     struct cam_device* cam_dev;
     struct tobj_cam_t * tcp;
 
-    if (i_params) { ; }     /* unused, suppress warning */
-    if ((NULL == tobj) || (NULL == device_name))
-        return -1;
-    memset(tobj, 0, sizeof(struct smp_target_obj));
-    strncpy(tobj->device_name, device_name, SMP_MAX_DEVICE_NAME);
-    if (sa)
-        sg_put_unaligned_be64(sa, tobj->sas_addr + 0);
-    tobj->interface_selector = I_CAM;
+    if (subvalue || i_params || sa) { ; }   /* unused, suppress warning */
     tcp = (struct tobj_cam_t *)
                 calloc(1, sizeof(struct tobj_cam_t));
     if (tcp == NULL) {
@@ -87,51 +137,53 @@ smp_initiator_open(const char * device_name, int subvalue,
     if (cam_get_device(device_name, tcp->devname, DEV_IDLEN,
                        &(tcp->unitnum)) == -1) {
         if (verbose)
-            fprintf(stderr, "bad device name structure\n");
+            pr2ws("bad device name structure\n");
         free(tcp);
         return -1;
     }
     if (! (cam_dev = cam_open_spec_device(tcp->devname, tcp->unitnum,
                                           O_RDWR, NULL))) {
-        fprintf(stderr, "cam_open_spec_device: %s\n", cam_errbuf);
+        pr2ws("cam_open_spec_device: %s\n", cam_errbuf);
         free(tcp);
         return -1;
     }
     tcp->cam_dev = cam_dev;
+    pthread_mutex_init(&tcp->mtx, NULL);
+    if (NULL == (tcp->ccbs[0] = cam_getccb(cam_dev))) {
+        pr2ws("cam_getccb: failed\n");
+        pthread_mutex_destroy(&tcp->mtx);
+        cam_close_device(cam_dev);
+        free(tcp);
+        return -1;
+    }
+    tcp->num_ccbs = 1;
     tobj->vp = tcp;
-    tobj->opened = 1;
-    tobj->subvalue = subvalue;  /* unused */
     return 0;
 }
 
-int
-smp_send_req(const struct smp_target_obj * tobj, struct smp_req_resp * rresp,
-             int verbose)
+/* One attempt at sending rresp. Returns 0 if ok, else -1 or the CAM
+ * status. Sets *timed_outp when CAM reports a timeout. smp_send_req()
+ * notes every attempt in the target's statistics, so each non-zero return
+ * here (no CCB included) counts as a pass-through failure. */
+static int
+send_req_cam(const struct smp_target_obj * tobj, struct smp_req_resp * rresp,
+             bool * timed_outp, int verbose)
 {
     union ccb *ccb;
     struct tobj_cam_t * tcp;
-    int retval, emsk;
+    int retval, emsk, slot;
     int flags = 0;
 
-    if ((NULL == tobj) || (0 == tobj->opened) || (NULL == tobj->vp)) {
-        if (verbose)
-            fprintf(stderr, "smp_send_req: nothing open??\n");
-        return -1;
-    }
-    if (I_CAM != tobj->interface_selector) {
-        fprintf(stderr, "smp_send_req: unknown transport [%d]\n",
-                tobj->interface_selector);
-        return -1;
-    }
     tcp = (struct tobj_cam_t *)tobj->vp;
-    if (! (ccb = cam_getccb(tcp->cam_dev))) {
-        fprintf(stderr, "cam_getccb: failed\n");
-        return -1;
+    if (! (ccb = get_ccb(tcp, &slot))) {
+        pr2ws("cam_getccb: failed\n");
+        return -1;      /* a send_fail in the statistics, as below */
     }
 
-    // clear out structure, except for header that was filled in for us
+    /* clear the smpio part, the header (path, target and lun) was filled
+     * in by cam_getccb() and is kept */
     bzero(&(&ccb->ccb_h)[1],
-            sizeof(union ccb) - sizeof(struct ccb_hdr));
+            sizeof(struct ccb_smpio) - sizeof(struct ccb_hdr));
 
     flags |= CAM_DEV_QFRZDIS;
     /* CAM does not want request_len including CRC */
@@ -143,7 +195,8 @@ smp_send_req(const struct smp_target_obj * tobj, struct smp_req_resp * rresp,
                    /*smp_request_len*/ rresp->request_len - 4,
                    /*smp_response*/ rresp->response,
                    /*smp_response_len*/ rresp->max_response_len,
-                   /*timeout*/ 5000);   /* milliseconds ? */
+                   /*timeout*/ ((tobj->timeout_ms > 0) ? tobj->timeout_ms :
+                                DEF_CAM_TIMEOUT_MS));
 
     ccb->smpio.flags = SMP_FLAG_NONE;
 
@@ -152,7 +205,9 @@ smp_send_req(const struct smp_target_obj * tobj, struct smp_req_resp * rresp,
         ((((emsk = (ccb->ccb_h.status & CAM_STATUS_MASK))) != CAM_REQ_CMP) &&
          (emsk != CAM_SMP_STATUS_ERROR))) {
         cam_error_print(tcp->cam_dev, ccb, CAM_ESF_ALL, CAM_EPF_ALL, stderr);
-        cam_freeccb(ccb);
+        put_ccb(tcp, ccb, slot);
+        if (CAM_CMD_TIMEOUT == emsk)
+            *timed_outp = true;
         return -1;
     }
     if (((emsk == CAM_REQ_CMP) || (emsk == CAM_SMP_STATUS_ERROR)) &&
@@ -161,30 +216,46 @@ smp_send_req(const struct smp_target_obj * tobj, struct smp_req_resp * rresp,
             cam_error_print(tcp->cam_dev, ccb, CAM_ESF_ALL, CAM_EPF_ALL,
                             stderr);
         rresp->act_response_len = -1;
-        cam_freeccb(ccb);
+        put_ccb(tcp, ccb, slot);
         return 0;
     } else {
-        fprintf(stderr, "smp_send_req(cam): not sure how it got here\n");
-        cam_freeccb(ccb);
+        pr2ws("smp_send_req(cam): not sure how it got here\n");
+        put_ccb(tcp, ccb, slot);
         return emsk ? emsk : -1;
     }
 }
 
-int
-smp_initiator_close(struct smp_target_obj * tobj)
+static int
+cam_close(struct smp_target_obj * tobj)
 {
+    int k;
     struct tobj_cam_t * tcp;
 
-    if ((NULL == tobj) || (0 == tobj->opened)) {
-        fprintf(stderr, "smp_initiator_close: nothing open??\n");
-        return -1;
-    }
     if (tobj->vp) {
         tcp = (struct tobj_cam_t *)tobj->vp;
+        for (k = 0; k < tcp->num_ccbs; ++k)
+            cam_freeccb(tcp->ccbs[k]);
+        pthread_mutex_destroy(&tcp->mtx);
         cam_close_device(tcp->cam_dev);
         free(tobj->vp);
         tobj->vp = NULL;
     }
-    tobj->opened = 0;
     return 0;
 }
+
+static const struct smp_xport_ops cam_xport = {
+    .name = "cam",
+    .prefix = {"cam", NULL},
+    .selector = I_CAM,
+    .flags = SMP_XPORT_AUTO | SMP_XPORT_TIMEOUT,
+    .max_inflight = SMP_BATCH_MAX_INFLIGHT,     /* size of the CCB pool */
+    .open = cam_open,
+    .send = send_req_cam,
+    .close = cam_close,
+};
+
+void
+smp_xport_native_init(void)
+{
+    smp_xport_register(&cam_xport);
+}
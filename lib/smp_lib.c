@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2019, Douglas Gilbert
+ * Copyright (c) 2006-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -29,6 +29,8 @@
 #include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 
@@ -51,52 +53,77 @@ static const char * version_str = "1.30 20190710";    /* spl-5 rev 8 */
  * the 4 byte CRC at the end of each frame. The 4 byte CRC field
  * does not need to be set (just space allocated (for some pass
  * throughs)). */
-struct smp_func_def_rrlen {
-    int func;           /* '-1' for last entry */
-    int def_req_len;    /* if 0==<request_length> use this value, unless */
-                        /*  -2 -> no default; -3 -> different format */
-    int def_resp_len;   /* if 0==<response_length> use this value, unless */
-                        /*  -2 -> no default; -3 -> different format */
-    /* N.B. Some SAS-2 functions have 8 byte request or response lengths.
-            This is noted by putting 0 in one of the two above fields. */
+#define RD 0                                /* report function */
+#define WR SMP_FDESC_WRITE
+#define PH SMP_FDESC_PHY
+
+/* Every SMP function known to this library: function code, default
+ * request and response lengths (as above, also: -2 -> no default; -3 ->
+ * different format; note some SAS-2 functions have 8 byte request or
+ * response lengths, shown as 0), flags and name. Positive request and
+ * response lengths match SAS-1.1 (sas1r10.pdf). smp_func_desc_arr[] is
+ * built from this list at compile time, indexed by function code. */
+#define SMP_FUNC_LIST(X) \
+    X(SMP_FN_REPORT_GENERAL, 0, 6, RD, "report general") \
+    X(SMP_FN_REPORT_MANUFACTURER, 0, 14, RD, "report manufacturer") \
+    /* obsolete, not applicable: SFF-8485 */ \
+    X(SMP_FN_READ_GPIO_REG, -3, -3, RD, "read gpio register") \
+    X(SMP_FN_REPORT_SELF_CONFIG, -2, -2, RD, \
+      "report self configuration status") \
+    /* variable length response */ \
+    X(SMP_FN_REPORT_ZONE_PERMISSION_TBL, -2, -2, RD, \
+      "report zone permission table") \
+    X(SMP_FN_REPORT_ZONE_MANAGER_PASS, -2, -2, RD, \
+      "report zone manager password") \
+    X(SMP_FN_REPORT_BROADCAST, -2, -2, RD, "report broadcast") \
+    /* SFF-8485 should explain */ \
+    X(SMP_FN_READ_GPIO_REG_ENH, -2, -2, RD, "read enhanced gpio register") \
+    X(SMP_FN_DISCOVER, 2, 0xc, RD | PH, "discover") \
+    X(SMP_FN_REPORT_PHY_ERR_LOG, 2, 6, RD | PH, "report phy error log") \
+    X(SMP_FN_REPORT_PHY_SATA, 2, 13, RD | PH, "report phy sata") \
+    X(SMP_FN_REPORT_ROUTE_INFO, 2, 9, RD | PH, "report route information") \
+    /* variable length response */ \
+    X(SMP_FN_REPORT_PHY_EVENT, -2, -2, RD | PH, "report phy event") \
+    X(SMP_FN_DISCOVER_LIST, -2, -2, RD, "discover list") \
+    X(SMP_FN_REPORT_PHY_EVENT_LIST, -2, -2, RD, "report phy event list") \
+    X(SMP_FN_REPORT_EXP_ROUTE_TBL_LIST, -2, -2, RD, \
+      "report expander route table list") \
+    X(SMP_FN_CONFIG_GENERAL, 3, 0, WR, "configure general") \
+    X(SMP_FN_ENABLE_DISABLE_ZONING, -2, 0, WR, "enable disable zoning") \
+    /* obsolete, not applicable: SFF-8485 */ \
+    X(SMP_FN_WRITE_GPIO_REG, -3, -3, WR, "write gpio register") \
+    /* SFF-8485 should explain */ \
+    X(SMP_FN_WRITE_GPIO_REG_ENH, -2, -2, WR, "write enhanced gpio register") \
+    /* variable length request */ \
+    X(SMP_FN_ZONED_BROADCAST, -2, 0, WR, "zoned broadcast") \
+    X(SMP_FN_ZONE_LOCK, -2, -2, WR, "zone lock") \
+    X(SMP_FN_ZONE_ACTIVATE, -2, 0, WR, "zone activate") \
+    X(SMP_FN_ZONE_UNLOCK, -2, 0, WR, "zone unlock") \
+    X(SMP_FN_CONFIG_ZONE_MANAGER_PASS, -2, 0, WR, \
+      "configure zone manager password") \
+    /* variable length request */ \
+    X(SMP_FN_CONFIG_ZONE_PHY_INFO, -2, 0, WR, \
+      "configure zone phy information") \
+    /* variable length request */ \
+    X(SMP_FN_CONFIG_ZONE_PERMISSION_TBL, -2, 0, WR, \
+      "configure zone permission table") \
+    X(SMP_FN_CONFIG_ROUTE_INFO, 9, 0, WR | PH, "configure route information") \
+    X(SMP_FN_PHY_CONTROL, 9, 0, WR | PH, "phy control") \
+    X(SMP_FN_PHY_TEST_FUNCTION, 9, 0, WR | PH, "phy test function") \
+    /* variable length request */ \
+    X(SMP_FN_CONFIG_PHY_EVENT, -2, 0, WR, "configure phy event")
+
+#define FUNC_DESC_ENTRY(fc, rq, rs, fl, nm) [fc] = {fc, rq, rs, fl, nm},
+
+/* entries for unknown function codes have a NULL name */
+static const struct smp_func_desc smp_func_desc_arr[256] = {
+    SMP_FUNC_LIST(FUNC_DESC_ENTRY)
 };
 
-/* Positive request and response lengths match SAS-1.1 (sas1r10.pdf) */
-struct smp_func_def_rrlen smp_def_rrlen_arr[] = {
-    /* in numerical order by 'func' */
-    {SMP_FN_REPORT_GENERAL, 0, 6},
-    {SMP_FN_REPORT_MANUFACTURER, 0, 14},
-    {SMP_FN_READ_GPIO_REG, -3, -3}, /* obsolete, not applicable: SFF-8485 */
-    {SMP_FN_REPORT_SELF_CONFIG, -2, -2},
-    {SMP_FN_REPORT_ZONE_PERMISSION_TBL, -2, -2},/* variable length response */
-    {SMP_FN_REPORT_ZONE_MANAGER_PASS, -2, -2},
-    {SMP_FN_REPORT_BROADCAST, -2, -2},
-    {SMP_FN_READ_GPIO_REG_ENH, -2, -2}, /* SFF-8485 should explain */
-    {SMP_FN_DISCOVER, 2, 0xc},
-    {SMP_FN_REPORT_PHY_ERR_LOG, 2, 6},
-    {SMP_FN_REPORT_PHY_SATA, 2, 13},
-    {SMP_FN_REPORT_ROUTE_INFO, 2, 9},
-    {SMP_FN_REPORT_PHY_EVENT, -2, -2},     /* variable length response */
-    {SMP_FN_DISCOVER_LIST, -2, -2},
-    {SMP_FN_REPORT_PHY_EVENT_LIST, -2, -2},
-    {SMP_FN_REPORT_EXP_ROUTE_TBL_LIST, -2, -2},
-    {SMP_FN_CONFIG_GENERAL, 3, 0},
-    {SMP_FN_ENABLE_DISABLE_ZONING, -2, 0},
-    {SMP_FN_WRITE_GPIO_REG, -3, -3}, /* obsolete, not applicable: SFF-8485 */
-    {SMP_FN_WRITE_GPIO_REG_ENH, -2, -2}, /* SFF-8485 should explain */
-    {SMP_FN_ZONED_BROADCAST, -2, 0},            /* variable length request */
-    {SMP_FN_ZONE_LOCK, -2, -2},
-    {SMP_FN_ZONE_ACTIVATE, -2, 0},
-    {SMP_FN_ZONE_UNLOCK, -2, 0},
-    {SMP_FN_CONFIG_ZONE_MANAGER_PASS, -2, 0},
-    {SMP_FN_CONFIG_ZONE_PHY_INFO, -2, 0},       /* variable length request */
-    {SMP_FN_CONFIG_ZONE_PERMISSION_TBL, -2, 0}, /* variable length request */
-    {SMP_FN_CONFIG_ROUTE_INFO, 9, 0},
-    {SMP_FN_PHY_CONTROL, 9, 0},
-    {SMP_FN_PHY_TEST_FUNCTION, 9, 0},
-    {SMP_FN_CONFIG_PHY_EVENT, -2, 0},      /* variable length request */
-    {-1, -1, -1},
-};
+#undef FUNC_DESC_ENTRY
+#undef RD
+#undef WR
+#undef PH
 
 #if defined(__GNUC__) || defined(__clang__)
 static int scnpr(char * cp, int cp_max_len, const char * fmt, ...)
@@ -133,93 +160,88 @@ static inline int my_isprint(int ch)
     return ((ch >= ' ') && (ch < 0x7f));
 }
 
-static void
-trimTrailingSpaces(char * b)
+
+const struct smp_func_desc *
+smp_get_func_desc(int func_code)
 {
-    int k;
+    const struct smp_func_desc * fdp;
 
-    for (k = ((int)strlen(b) - 1); k >= 0; --k) {
-        if (' ' != b[k])
-            break;
-    }
-    if ('\0' != b[k + 1])
-        b[k + 1] = '\0';
+    if ((func_code < 0) || (func_code > 255))
+        return NULL;
+    fdp = smp_func_desc_arr + func_code;
+    return fdp->name ? fdp : NULL;
 }
 
+const char *
+smp_get_func_name(int func_code)
+{
+    const struct smp_func_desc * fdp = smp_get_func_desc(func_code);
+
+    return fdp ? fdp->name : "unknown";
+}
 
 int
 smp_get_func_def_req_len(int func_code)
 {
-    struct smp_func_def_rrlen * drlp;
+    const struct smp_func_desc * fdp = smp_get_func_desc(func_code);
 
-    for (drlp = smp_def_rrlen_arr; drlp->func >= 0; ++drlp) {
-        if (func_code == drlp->func)
-            return drlp->def_req_len;
-    }
-    return -1;
+    return fdp ? fdp->def_req_len : -1;
 }
 
 int
 smp_get_func_def_resp_len(int func_code)
 {
-    struct smp_func_def_rrlen * drlp;
+    const struct smp_func_desc * fdp = smp_get_func_desc(func_code);
 
-    for (drlp = smp_def_rrlen_arr; drlp->func >= 0; ++drlp) {
-        if (func_code == drlp->func)
-            return drlp->def_resp_len;
-    }
-    return -1;
+    return fdp ? fdp->def_resp_len : -1;
 }
 
 
-static struct smp_val_name smp_func_results[] =
-{
-    {SMP_FRES_FUNCTION_ACCEPTED, "SMP function accepted"},
-    {SMP_FRES_UNKNOWN_FUNCTION, "Unknown SMP function"},
-    {SMP_FRES_FUNCTION_FAILED, "SMP function failed"},
-    {SMP_FRES_INVALID_REQUEST_LEN, "Invalid request frame length"},
-    {SMP_FRES_INVALID_EXP_CHANGE_COUNT, "Invalid expander change count"},
-    {SMP_FRES_BUSY, "Busy"},
-    {SMP_FRES_INCOMPLETE_DESCRIPTOR_LIST, "Incomplete descriptor list"},
-    {SMP_FRES_NO_PHY, "Phy does not exist"},
-    {SMP_FRES_NO_INDEX, "Index does not exist"},
-    {SMP_FRES_NO_SATA_SUPPORT, "Phy does not support SATA"},
-    {SMP_FRES_UNKNOWN_PHY_OP, "Unknown phy operation"},
-    {SMP_FRES_UNKNOWN_PHY_TEST_FN, "Unknown phy test function"},
-    {SMP_FRES_PHY_TEST_IN_PROGRESS, "Phy test function in progress"},
-    {SMP_FRES_PHY_VACANT, "Phy vacant"},
-    {SMP_FRES_UNKNOWN_PHY_EVENT_SRC,
-     "Unknown phy event source"},
-    {SMP_FRES_UNKNOWN_DESCRIPTOR_TYPE, "Unknown descriptor type"},
-    {SMP_FRES_UNKNOWN_PHY_FILTER, "Unknown phy filter"},
-    {SMP_FRES_AFFILIATION_VIOLATION, "Affiliation violation"},
-    {SMP_FRES_SMP_ZONE_VIOLATION, "SMP zone violation"},
-    {SMP_FRES_NO_MANAGEMENT_ACCESS, "No management access rights"},
-    {SMP_FRES_UNKNOWN_EN_DIS_ZONING_VAL,
-     "Unknown enable disable zoning value"},
-    {SMP_FRES_ZONE_LOCK_VIOLATION, "Zone lock violation"},
-    {SMP_FRES_NOT_ACTIVATED, "Not activated"},
-    {SMP_FRES_ZONE_GROUP_OUT_OF_RANGE, "Zone group out of range"},
-    {SMP_FRES_NO_PHYSICAL_PRESENCE, "No physical presence"},
-    {SMP_FRES_SAVING_NOT_SUPPORTED, "Saving not supported"},
-    {SMP_FRES_SOURCE_ZONE_GROUP, "Source zone group does not exist"},
-    {SMP_FRES_DIS_PASSWORD_NOT_SUPPORTED, "Disabled password not supported"},
-    {SMP_FRES_INVALID_FIELD_IN_REQUEST, "Invalid field in SMP request"},
-    {0x0, NULL},
+/* indexed by function result, NULL for reserved values */
+static const char * smp_func_res_arr[256] = {
+    [SMP_FRES_FUNCTION_ACCEPTED] = "SMP function accepted",
+    [SMP_FRES_UNKNOWN_FUNCTION] = "Unknown SMP function",
+    [SMP_FRES_FUNCTION_FAILED] = "SMP function failed",
+    [SMP_FRES_INVALID_REQUEST_LEN] = "Invalid request frame length",
+    [SMP_FRES_INVALID_EXP_CHANGE_COUNT] = "Invalid expander change count",
+    [SMP_FRES_BUSY] = "Busy",
+    [SMP_FRES_INCOMPLETE_DESCRIPTOR_LIST] = "Incomplete descriptor list",
+    [SMP_FRES_NO_PHY] = "Phy does not exist",
+    [SMP_FRES_NO_INDEX] = "Index does not exist",
+    [SMP_FRES_NO_SATA_SUPPORT] = "Phy does not support SATA",
+    [SMP_FRES_UNKNOWN_PHY_OP] = "Unknown phy operation",
+    [SMP_FRES_UNKNOWN_PHY_TEST_FN] = "Unknown phy test function",
+    [SMP_FRES_PHY_TEST_IN_PROGRESS] = "Phy test function in progress",
+    [SMP_FRES_PHY_VACANT] = "Phy vacant",
+    [SMP_FRES_UNKNOWN_PHY_EVENT_SRC] = "Unknown phy event source",
+    [SMP_FRES_UNKNOWN_DESCRIPTOR_TYPE] = "Unknown descriptor type",
+    [SMP_FRES_UNKNOWN_PHY_FILTER] = "Unknown phy filter",
+    [SMP_FRES_AFFILIATION_VIOLATION] = "Affiliation violation",
+    [SMP_FRES_SMP_ZONE_VIOLATION] = "SMP zone violation",
+    [SMP_FRES_NO_MANAGEMENT_ACCESS] = "No management access rights",
+    [SMP_FRES_UNKNOWN_EN_DIS_ZONING_VAL] =
+        "Unknown enable disable zoning value",
+    [SMP_FRES_ZONE_LOCK_VIOLATION] = "Zone lock violation",
+    [SMP_FRES_NOT_ACTIVATED] = "Not activated",
+    [SMP_FRES_ZONE_GROUP_OUT_OF_RANGE] = "Zone group out of range",
+    [SMP_FRES_NO_PHYSICAL_PRESENCE] = "No physical presence",
+    [SMP_FRES_SAVING_NOT_SUPPORTED] = "Saving not supported",
+    [SMP_FRES_SOURCE_ZONE_GROUP] = "Source zone group does not exist",
+    [SMP_FRES_DIS_PASSWORD_NOT_SUPPORTED] = "Disabled password not supported",
+    [SMP_FRES_INVALID_FIELD_IN_REQUEST] = "Invalid field in SMP request",
 };
 
 char *
 smp_get_func_res_str(int func_res, int buff_len, char * buff)
 {
-    struct smp_val_name * vnp;
+    const char * cp = ((func_res >= 0) && (func_res < 256)) ?
+                      smp_func_res_arr[func_res] : NULL;
 
-    for (vnp = smp_func_results; vnp->name; ++vnp) {
-        if (func_res == vnp->value) {
-            snprintf(buff, buff_len, "%s", vnp->name);
-            return buff;
-        }
-    }
-    snprintf(buff, buff_len, "Unknown function result code=0x%x\n", func_res);
+    if (cp)
+        snprintf(buff, buff_len, "%s", cp);
+    else
+        snprintf(buff, buff_len, "Unknown function result code=0x%x\n",
+                 func_res);
     return buff;
 }
 
@@ -246,193 +268,93 @@ smp_is_naa5(uint64_t addr)
  * found. <maximum > only prints "maximum " when <n> is greater than 1 .
  * Returns buff as its result and its length (including a trailing null
  * character) will not exceed buff_len. */
+struct smp_conn_type {
+    const char * name;
+    int pl_num;         /* maximum physical links, -1 for vendor specific */
+};
+
+/* Connector type is a 7 bit field; indexed by it, NULL name for unknown */
+static const struct smp_conn_type smp_conn_type_arr[128] = {
+/* External connectors */
+    [0x0] = {"No information", 0},
+    [0x1] = {"SAS 4x receptacle (SFF-8470)", 4},
+    [0x2] = {"Mini SAS 4x receptacle (SFF-8088)", 4},
+    [0x3] = {"QSFP+ receptacle (SFF-8436)", 4},
+    [0x4] = {"Mini SAS 4x active receptacle (SFF-8088)", 4},
+    [0x5] = {"Mini SAS HD 4x receptacle (SFF-8644)", 4},
+    [0x6] = {"Mini SAS HD 8x receptacle (SFF-8644)", 8},
+    [0x7] = {"Mini SAS HD 16x receptacle (SFF-8644)", 16},
+    [0xf] = {"Vendor specific external connector", -1},
+/* Internal wide connectors */
+    [0x10] = {"SAS 4i plug (SFF-8484)", 4},
+    [0x11] = {"Mini SAS 4i receptacle (SFF-8087)", 4},
+    [0x12] = {"Mini SAS HD 4i receptacle (SFF-8643)", 4},
+    [0x13] = {"Mini SAS HD 8i receptacle (SFF-8643)", 8},
+    [0x14] = {"Mini SAS HD 16i receptacle (SFF-8643)", 16},
+    /* 0x15 and 0x16 were 'SAS SlimLine', changed ses4r03 */
+    [0x15] = {"SlimSAS 4i (SFF-8654)", 4},
+    [0x16] = {"SlimSAS 8i (SFF-8654)", 8},
+    [0x17] = {"SAS MiniLink 4i (SFF-8612)", 4},
+    [0x18] = {"SAS MiniLink 8i (SFF-8612)", 8},
+/* Internal connectors to end devices */
+    [0x20] = {"SAS Drive backplane receptacle (SFF-8482)", 2},
+    [0x21] = {"SATA host plug", 1},
+    [0x22] = {"SAS Drive plug (SFF-8482)", 2},
+    [0x23] = {"SATA device plug", 1},
+    [0x24] = {"Micro SAS receptacle", 2},
+    [0x25] = {"Micro SATA device plug", 1},
+    [0x26] = {"Micro SAS plug (SFF-8486", 2},
+    [0x27] = {"Micro SAS/SATA plug (SFF-8486)", 2},
+    [0x28] = {"12 Gb/s SAS Drive backplane receptacle (SFF-8680)", 2},
+    [0x29] = {"12Gb/s SAS Drive Plug (SFF-8680) ", 2},
+    [0x2a] = {"Multifunction 12 Gb/s 6x Unshielded receptacle (SFF-8639)",
+              6},
+    [0x2b] = {"Multifunction 12 Gb/s 6x Unshielded plug (SFF-8639)", 6},
+    [0x2c] = {"SAS MultiLink drive backplane receptacle (SFF-8630)", 4},
+    [0x2d] = {"SAS MultiLink drive backplane plug (SFF-8630)", 4},
+    [0x2f] = {"SAS virtual connector", 1},
+    [0x3f] = {"Vendor specific internal connector", -1},
+    [0x40] = {"SAS high density drive backplane receptacle (SFF-8631)", 8},
+    [0x41] = {"SAS high density drive backplane plug (SFF-8631)", 8},
+};
+
 char *
 smp_get_connector_type_str(int conn_type, bool plink, int buff_len,
                            char * buff)
 {
+    const struct smp_conn_type * ctp = NULL;
     int pl_num = 0;
     int n;
 
     if ((NULL == buff) || (buff_len < 1))
         return buff;
-    switch (conn_type) {
-/* External connectors */
-    case 0x0:
-        snprintf(buff, buff_len, "No information");
-        break;
-    case 0x1:
-        snprintf(buff, buff_len, "SAS 4x receptacle (SFF-8470)");
-        pl_num = 4;
-        break;
-    case 0x2:
-        snprintf(buff, buff_len, "Mini SAS 4x receptacle (SFF-8088)");
-        pl_num = 4;
-        break;
-    case 0x3:
-        snprintf(buff, buff_len, "QSFP+ receptacle (SFF-8436)");
-        pl_num = 4;
-        break;
-    case 0x4:
-        snprintf(buff, buff_len, "Mini SAS 4x active receptacle (SFF-8088)");
-        pl_num = 4;
-        break;
-    case 0x5:
-        snprintf(buff, buff_len, "Mini SAS HD 4x receptacle (SFF-8644)");
-        pl_num = 4;
-        break;
-    case 0x6:
-        snprintf(buff, buff_len, "Mini SAS HD 8x receptacle (SFF-8644)");
-        pl_num = 8;
-        break;
-    case 0x7:
-        snprintf(buff, buff_len, "Mini SAS HD 16x receptacle (SFF-8644)");
-        pl_num = 16;
-        break;
-    case 0xf:
-        snprintf(buff, buff_len, "Vendor specific external connector");
-        pl_num = -1;
-        break;
-/* Internal wide connectors */
-    case 0x10:
-        snprintf(buff, buff_len, "SAS 4i plug (SFF-8484)");
-        pl_num = 4;
-        break;
-    case 0x11:
-        snprintf(buff, buff_len, "Mini SAS 4i receptacle (SFF-8087)");
-        pl_num = 4;
-        break;
-    case 0x12:
-        snprintf(buff, buff_len, "Mini SAS HD 4i receptacle (SFF-8643)");
-        pl_num = 4;
-        break;
-    case 0x13:
-        snprintf(buff, buff_len, "Mini SAS HD 8i receptacle (SFF-8643)");
-        pl_num = 8;
-        break;
-    case 0x14:
-        snprintf(buff, buff_len, "Mini SAS HD 16i receptacle (SFF-8643)");
-        pl_num = 16;
-        break;
-    case 0x15:	/* was 'SAS SlimLine', changed ses4r03 */
-        snprintf(buff, buff_len, "SlimSAS 4i (SFF-8654)");
-        pl_num = 4;
-        break;
-    case 0x16:	/* was 'SAS SlimLine', changed ses4r03 */
-        snprintf(buff, buff_len, "SlimSAS 8i (SFF-8654)");
-        pl_num = 8;
-        break;
-    case 0x17:
-        snprintf(buff, buff_len, "SAS MiniLink 4i (SFF-8612)");
-        pl_num = 4;
-        break;
-    case 0x18:
-        snprintf(buff, buff_len, "SAS MiniLink 8i (SFF-8612)");
-        pl_num = 8;
-        break;
-/* Internal connectors to end devices */
-    case 0x20:
-        snprintf(buff, buff_len, "SAS Drive backplane receptacle (SFF-8482)");
-        pl_num = 2;
-        break;
-    case 0x21:
-        snprintf(buff, buff_len, "SATA host plug");
-        pl_num = 1;
-        break;
-    case 0x22:
-        snprintf(buff, buff_len, "SAS Drive plug (SFF-8482)");
-        pl_num = 2;
-        break;
-    case 0x23:
-        snprintf(buff, buff_len, "SATA device plug");
-        pl_num = 1;
-        break;
-    case 0x24:
-        snprintf(buff, buff_len, "Micro SAS receptacle");
-        pl_num = 2;
-        break;
-    case 0x25:
-        snprintf(buff, buff_len, "Micro SATA device plug");
-        pl_num = 1;
-        break;
-    case 0x26:
-        snprintf(buff, buff_len, "Micro SAS plug (SFF-8486");
-        pl_num = 2;
-        break;
-    case 0x27:
-        snprintf(buff, buff_len, "Micro SAS/SATA plug (SFF-8486)");
-        pl_num = 2;
-        break;
-    case 0x28:
-        snprintf(buff, buff_len, "12 Gb/s SAS Drive backplane receptacle "
-                 "(SFF-8680)");
-        pl_num = 2;
-        break;
-    case 0x29:
-        snprintf(buff, buff_len, "12Gb/s SAS Drive Plug (SFF-8680) ");
-        pl_num = 2;
-        break;
-    case 0x2a:
-        snprintf(buff, buff_len, "Multifunction 12 Gb/s 6x Unshielded "
-                 "receptacle (SFF-8639)");
-        pl_num = 6;
-        break;
-    case 0x2b:
-        snprintf(buff, buff_len, "Multifunction 12 Gb/s 6x Unshielded plug "
-                "(SFF-8639)");
-        pl_num = 6;
-        break;
-    case 0x2c:
-        snprintf(buff, buff_len, "SAS MultiLink drive backplane receptacle "
-                 "(SFF-8630)");
-        pl_num = 4;
-        break;
-    case 0x2d:
-        snprintf(buff, buff_len, "SAS MultiLink drive backplane plug "
-                 "(SFF-8630)");
-        pl_num = 4;
-        break;
-    case 0x2f:
-        snprintf(buff, buff_len, "SAS virtual connector");
-        pl_num = 1;
-        break;
-    case 0x3f:
-        snprintf(buff, buff_len, "Vendor specific internal connector");
-        pl_num = -1;
-        break;
-    case 0x40:
-        snprintf(buff, buff_len, "SAS high density drive backplane "
-                 "receptacle (SFF-8631)");
-        pl_num = 8;
-        break;
-    case 0x41:
-        snprintf(buff, buff_len, "SAS high density drive backplane "
-                 "plug (SFF-8631)");
-        pl_num = 8;
-        break;
-    default:
-        if (conn_type < 0x10)
-            snprintf(buff, buff_len, "unknown external connector type: 0x%x",
-                     conn_type);
-        else if (conn_type < 0x20)
-            snprintf(buff, buff_len, "unknown internal wide connector type: "
-                     "0x%x", conn_type);
-        else if (conn_type < 0x30)
-            snprintf(buff, buff_len, "unknown internal connector to end "
-                     "device, type: 0x%x", conn_type);
-        else if (conn_type < 0x3f)
-            snprintf(buff, buff_len, "unknown internal connector"
-                     ", type: 0x%x", conn_type);
-        else if (conn_type < 0x70)
-            snprintf(buff, buff_len, "reserved connector type: 0x%x",
-                     conn_type);
-        else if (conn_type < 0x80)
-            snprintf(buff, buff_len, "vendor specific connector type: 0x%x",
-                     conn_type);
-        else    /* conn_type is a 7 bit field, so this is impossible */
-            snprintf(buff, buff_len, "unexpected connector type: 0x%x",
-                     conn_type);
-        break;
-    }
+    if ((conn_type >= 0) && (conn_type < 128) &&
+        smp_conn_type_arr[conn_type].name)
+        ctp = smp_conn_type_arr + conn_type;
+    if (ctp) {
+        snprintf(buff, buff_len, "%s", ctp->name);
+        pl_num = ctp->pl_num;
+    } else if (conn_type < 0x10)
+        snprintf(buff, buff_len, "unknown external connector type: 0x%x",
+                 conn_type);
+    else if (conn_type < 0x20)
+        snprintf(buff, buff_len, "unknown internal wide connector type: "
+                 "0x%x", conn_type);
+    else if (conn_type < 0x30)
+        snprintf(buff, buff_len, "unknown internal connector to end "
+                 "device, type: 0x%x", conn_type);
+    else if (conn_type < 0x3f)
+        snprintf(buff, buff_len, "unknown internal connector"
+                 ", type: 0x%x", conn_type);
+    else if (conn_type < 0x70)
+        snprintf(buff, buff_len, "reserved connector type: 0x%x",
+                 conn_type);
+    else if (conn_type < 0x80)
+        snprintf(buff, buff_len, "vendor specific connector type: 0x%x",
+                 conn_type);
+    else    /* conn_type is a 7 bit field, so this is impossible */
+        snprintf(buff, buff_len, "unexpected connector type: 0x%x",
+                 conn_type);
     if (! plink)
         return buff;
     n = strlen(buff);
@@ -498,14 +420,120 @@ smp_get_pwr_dis_signal_str(int pwr_dis_signal, int buff_len, char * buff)
     return buff;
 }
 
+int
+smp_decode_discover(const uint8_t * rp, int len, int desc_type,
+                    struct smp_discover_view * vp)
+{
+    uint8_t b[128];     /* longest DISCOVER response is 124 bytes */
+
+    if ((NULL == rp) || (NULL == vp))
+        return -1;
+    memset(vp, 0, sizeof(*vp));
+    if (1 == desc_type) {       /* short DISCOVER LIST descriptor */
+        if (len < 24)
+            return -1;
+        vp->desc_type = 1;
+        vp->resp_len = 24;
+        vp->sas2 = true;
+        vp->phy_id = rp[0];
+        vp->func_res = rp[1];
+        vp->att_dev_type = (rp[2] >> 4) & 0x7;
+        vp->att_reason = rp[2] & 0xf;
+        vp->neg_log_lrate = rp[3] & 0xf;
+        vp->att_init = rp[4];
+        vp->att_targ = rp[5] & ~SMP_DV_STP_BUFF_TSMALL;
+        vp->virt_phy = !! (rp[6] & 0x80);
+        vp->routing_attr = rp[6] & 0xf;
+        vp->reason = (rp[7] >> 4) & 0xf;
+        vp->neg_phy_lrate = rp[7] & 0xf;
+        vp->zone_group = rp[8];
+        vp->zone_flags = rp[9] & ~SMP_DV_ZONING_EN;
+        vp->att_phy_id = rp[10];
+        vp->phy_change_count = rp[11];
+        vp->att_sas_addr = sg_get_unaligned_be64(rp + 12);
+        vp->buff_phy_burst_sz = rp[20];
+        vp->dev_slot_num = 0xff;
+        vp->dev_slot_grp_num = 0xff;
+        return 0;
+    } else if (0 != desc_type)
+        return -1;
+    if (len < 16)
+        return -1;
+    /* fields past len (e.g. in a SAS-1.1 response) decode as zero */
+    memset(b, 0, sizeof(b));
+    memcpy(b, rp, (len < (int)sizeof(b)) ? len : (int)sizeof(b));
+    vp->resp_len = (len > 0xffff) ? 0xffff : len;
+    vp->sas2 = !! b[3];
+    vp->func_res = b[2];
+    vp->exp_change_count = sg_get_unaligned_be16(b + 4);
+    vp->phy_id = b[9];
+    vp->att_dev_type = (b[12] >> 4) & 0x7;
+    vp->att_reason = b[12] & 0xf;
+    vp->neg_log_lrate = b[13] & 0xf;
+    vp->att_init = b[14];
+    vp->att_targ = b[15];
+    vp->sas_addr = sg_get_unaligned_be64(b + 16);
+    vp->att_sas_addr = sg_get_unaligned_be64(b + 24);
+    vp->att_phy_id = b[32];
+    vp->att_caps[0] = b[33];
+    vp->att_caps[1] = b[34];
+    vp->prog_min_lrate = (b[40] >> 4) & 0xf;
+    vp->hw_min_lrate = b[40] & 0xf;
+    vp->prog_max_lrate = (b[41] >> 4) & 0xf;
+    vp->hw_max_lrate = b[41] & 0xf;
+    vp->phy_change_count = b[42];
+    vp->virt_phy = !! (b[43] & 0x80);
+    vp->pp_timeout = b[43] & 0xf;
+    vp->routing_attr = b[44] & 0xf;
+    vp->conn_type = b[45] & 0x7f;
+    vp->conn_elem_ind = b[46];
+    vp->conn_phy_link = b[47];
+    vp->pwr_caps = b[48];
+    vp->pwr_ctl = b[49];
+    vp->att_dev_name = sg_get_unaligned_be64(b + 52);
+    vp->zone_flags = b[60];
+    vp->zone_group = b[63];
+    vp->self_config_status = b[64];
+    vp->self_config_levels = b[65];
+    vp->self_config_sas_addr = sg_get_unaligned_be64(b + 68);
+    vp->prog_phy_cap = sg_get_unaligned_be32(b + 76);
+    vp->cur_phy_cap = sg_get_unaligned_be32(b + 80);
+    vp->att_phy_cap = sg_get_unaligned_be32(b + 84);
+    vp->reason = (b[94] >> 4) & 0xf;
+    vp->neg_phy_lrate = b[94] & 0xf;
+    vp->phy_flags = b[95];
+    vp->def_zone_flags = b[96];
+    vp->def_zone_group = b[99];
+    vp->saved_zone_flags = b[100];
+    vp->saved_zone_group = b[103];
+    vp->shadow_zone_flags = b[104];
+    vp->shadow_zone_group = b[107];
+    vp->dev_slot_num = (len > 108) ? b[108] : 0xff;
+    vp->dev_slot_grp_num = (len > 109) ? b[109] : 0xff;
+    memcpy(vp->dev_slot_grp_oc, b + 110, 6);
+    vp->stp_buff_size = sg_get_unaligned_be16(b + 116);
+    vp->buff_phy_burst_sz = b[118];
+    return 0;
+}
+
 /* safe_strerror() contributed by Clayton Weaver <cgweav at email dot com>
    Allows for situation in which strerror() is given a wild value (or the
-   C library is incomplete) and returns NULL. Still not thread safe.
+   C library is incomplete) and returns NULL. Still not thread safe, see
+   safe_strerror_r().
  */
 
 static char safe_errbuf[64] = {'u', 'n', 'k', 'n', 'o', 'w', 'n', ' ',
                                'e', 'r', 'r', 'n', 'o', ':', ' ', 0};
 
+/* strerror() may use a static buffer, and strerror_r() comes in two
+ * incompatible flavours (XSI and GNU), so calls are serialized instead. */
+static pthread_mutex_t strerror_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/* Log callback for pr2ws(), NULL for stderr. */
+static pthread_mutex_t log_mtx = PTHREAD_MUTEX_INITIALIZER;
+static smp_log_cb_t log_cb;
+static void * log_cb_arg;
+
 char *
 safe_strerror(int errnum)
 {
@@ -524,97 +552,99 @@ safe_strerror(int errnum)
     return errstr;
 }
 
+char *
+safe_strerror_r(int errnum, char * b, int blen)
+{
+    const char * errstr;
+
+    if ((NULL == b) || (blen < 1))
+        return b;
+    if (errnum < 0)
+        errnum = -errnum;
+    pthread_mutex_lock(&strerror_mtx);
+    errstr = strerror(errnum);
+    if (errstr)
+        snprintf(b, blen, "%s", errstr);
+    else
+        snprintf(b, blen, "unknown errno: %i", errnum);
+    pthread_mutex_unlock(&strerror_mtx);
+    return b;
+}
+
+void
+smp_perror(const char * s)
+{
+    int err = errno;
+    char b[96];
+
+    safe_strerror_r(err, b, sizeof(b));
+    if (s && s[0])
+        pr2ws("%s: %s\n", s, b);
+    else
+        pr2ws("%s\n", b);
+    errno = err;
+}
+
+/* Lower case hex digits; each byte is two lookups rather than a
+ * snprintf() call */
+static const char hex_lc[] = "0123456789abcdef";
+
+static inline void
+put_hex2(char * p, uint8_t c)
+{
+    p[0] = hex_lc[c >> 4];
+    p[1] = hex_lc[c & 0xf];
+}
+
+#define DSHF_OBUF_LEN 8192      /* holds the dump of a 1032 byte response */
+
 /* Note the ASCII-hex output goes to stream identified by 'fp'. This usually
  * be either stdout or stderr.
  * 'no_ascii' allows for 3 output types:
  *     > 0     each line has address then up to 16 ASCII-hex bytes
  *     = 0     in addition, the bytes are listed in ASCII to the right
- *     < 0     only the ASCII-hex bytes are listed (i.e. without address) */
+ *     < 0     only the ASCII-hex bytes are listed (i.e. without address)
+ * Lines are built in a local buffer and written together, so SMP sized
+ * responses take one fwrite(). */
 static void
 dStrHexFp(const char* str, int len, int no_ascii, FILE * fp)
 {
-    const char * p = str;
-    const char * formatstr;
-    unsigned char c;
-    char buff[82];
-    int a = 0;
-    int bpstart = 5;
+    const uint8_t * p = (const uint8_t *)str;
+    /* first hex byte of a line: after the address, if there is one */
+    const int bpstart = (no_ascii < 0) ? 0 : 8;
     const int cpstart = 60;
-    int cpos = cpstart;
-    int bpos = bpstart;
-    int i, k, blen;
+    int a, j, k, m;
+    int n = 0;
+    char * lp;
+    char obuf[DSHF_OBUF_LEN];
 
     if (len <= 0)
         return;
-    blen = (int)sizeof(buff);
-    if (0 == no_ascii)  /* address at left and ASCII at right */
-        formatstr = "%.76s\n";
-    else if (no_ascii > 0)
-        formatstr = "%s\n";     /* was: "%.58s\n" */
-    else /* negative: no address at left and no ASCII at right */
-        formatstr = "%s\n";     /* was: "%.48s\n"; */
-    memset(buff, ' ', 80);
-    buff[80] = '\0';
-    if (no_ascii < 0) {
-        bpstart = 0;
-        bpos = bpstart;
-        for (k = 0; k < len; k++) {
-            c = *p++;
-            if (bpos == (bpstart + (8 * 3)))
-                bpos++;
-            scnpr(&buff[bpos], blen - bpos, "%.2x", (int)(unsigned char)c);
-            buff[bpos + 2] = ' ';
-            if ((k > 0) && (0 == ((k + 1) % 16))) {
-                trimTrailingSpaces(buff);
-                fprintf(fp, formatstr, buff);
-                bpos = bpstart;
-                memset(buff, ' ', 80);
-            } else
-                bpos += 3;
-        }
-        if (bpos > bpstart) {
-            buff[bpos + 2] = '\0';
-            trimTrailingSpaces(buff);
-            fprintf(fp, "%s\n", buff);
-        }
-        return;
-    }
-    /* no_ascii>=0, start each line with address (offset) */
-    k = scnpr(buff + 1, blen - 1, "%.2x", a);
-    buff[k + 1] = ' ';
-
-    for (i = 0; i < len; i++) {
-        c = *p++;
-        bpos += 3;
-        if (bpos == (bpstart + (9 * 3)))
-            bpos++;
-        scnpr(&buff[bpos], blen - bpos, "%.2x", (int)(unsigned char)c);
-        buff[bpos + 2] = ' ';
-        if (no_ascii)
-            buff[cpos++] = ' ';
-        else {
-            if (! my_isprint(c))
-                c = '.';
-            buff[cpos++] = c;
+    for (a = 0; a < len; a += 16, p += 16) {
+        if (n > (DSHF_OBUF_LEN - 82)) {
+            fwrite(obuf, 1, n, fp);
+            n = 0;
         }
-        if (cpos > (cpstart + 15)) {
-            if (no_ascii)
-                trimTrailingSpaces(buff);
-            fprintf(fp, formatstr, buff);
-            bpos = bpstart;
-            cpos = cpstart;
-            a += 16;
-            memset(buff, ' ', 80);
-            k = scnpr(buff + 1, blen - 1, "%.2x", a);
-            buff[k + 1] = ' ';
+        lp = obuf + n;
+        m = ((len - a) < 16) ? (len - a) : 16;
+        memset(lp, ' ', 80);
+        if (no_ascii >= 0) {
+            k = scnpr(lp + 1, 80, "%.2x", a);
+            lp[k + 1] = ' ';
         }
+        /* extra space between the 8th and 9th bytes */
+        for (j = 0; j < m; ++j)
+            put_hex2(lp + bpstart + (3 * j) + ((j < 8) ? 0 : 1), p[j]);
+        if (0 == no_ascii) {
+            for (j = 0; j < m; ++j)
+                lp[cpstart + j] = my_isprint(p[j]) ? p[j] : '.';
+            k = cpstart + m;
+        } else  /* up to the last hex digit */
+            k = bpstart + (3 * (m - 1)) + ((m > 8) ? 1 : 0) + 2;
+        lp[k] = '\n';
+        n += k + 1;
     }
-    if (cpos > cpstart) {
-        buff[cpos] = '\0';
-        if (no_ascii)
-            trimTrailingSpaces(buff);
-        fprintf(fp, "%s\n", buff);
-    }
+    fwrite(obuf, 1, n, fp);
 }
 
 void
@@ -643,12 +673,11 @@ int
 dStrHexStr(const char * str, int len, const char * leadin, int format,
            int b_len, char * b)
 {
-    unsigned char c;
-    int bpstart, bpos, k, n, prior_ascii_len;
     bool want_ascii;
-    char buff[DSHS_LINE_BLEN + 2];
-    char a[DSHS_BPL + 1];
-    const char * p = str;
+    int bpstart, cpstart, j, k, m, off;
+    int n = 0;
+    const uint8_t * p = (const uint8_t *)str;
+    char line[DSHS_LINE_BLEN + 2];
 
     if (len <= 0) {
         if (b_len > 0)
@@ -658,57 +687,40 @@ dStrHexStr(const char * str, int len, const char * leadin, int format,
     if (b_len <= 0)
         return 0;
     want_ascii = !format;
-    if (want_ascii) {
-        memset(a, ' ', DSHS_BPL);
-        a[DSHS_BPL] = '\0';
-    }
     if (leadin) {
         bpstart = strlen(leadin);
         /* Cap leadin at (DSHS_LINE_BLEN - 70) characters */
         if (bpstart > (DSHS_LINE_BLEN - 70))
             bpstart = DSHS_LINE_BLEN - 70;
+        memcpy(line, leadin, bpstart);
     } else
         bpstart = 0;
-    bpos = bpstart;
-    prior_ascii_len = bpstart + (DSHS_BPL * 3) + 1;
-    n = 0;
-    memset(buff, ' ', DSHS_LINE_BLEN);
-    buff[DSHS_LINE_BLEN] = '\0';
-    if (bpstart > 0)
-        memcpy(buff, leadin, bpstart);
-    for (k = 0; k < len; k++) {
-        c = *p++;
-        if (bpos == (bpstart + ((DSHS_BPL / 2) * 3)))
-            bpos++;     /* for extra space in middle of each line's hex */
-        scnpr(buff + bpos, (int)sizeof(buff) - bpos, "%.2x",
-              (int)(unsigned char)c);
-        buff[bpos + 2] = ' ';
-        if (want_ascii)
-            a[k % DSHS_BPL] = my_isprint(c) ? c : '.';
-        if ((k > 0) && (0 == ((k + 1) % DSHS_BPL))) {
-            trimTrailingSpaces(buff);
-            if (want_ascii) {
-                n += scnpr(b + n, b_len - n, "%-*s   %s\n", prior_ascii_len,
-                           buff, a);
-                memset(a, ' ', DSHS_BPL);
-            } else
-                n += scnpr(b + n, b_len - n, "%s\n", buff);
-            if (n >= (b_len - 1))
-                return n;
-            memset(buff, ' ', DSHS_LINE_BLEN);
-            bpos = bpstart;
-            if (bpstart > 0)
-                memcpy(buff, leadin, bpstart);
+    /* ASCII starts 3 spaces after room for a full line of hex */
+    cpstart = bpstart + (DSHS_BPL * 3) + 1 + 3;
+    for (off = 0; off < len; off += DSHS_BPL, p += DSHS_BPL) {
+        m = ((len - off) < DSHS_BPL) ? (len - off) : DSHS_BPL;
+        memset(line + bpstart, ' ', cpstart - bpstart);
+        /* extra space in middle of each line's hex */
+        for (j = 0; j < m; ++j)
+            put_hex2(line + bpstart + (3 * j) +
+                     ((j < (DSHS_BPL / 2)) ? 0 : 1), p[j]);
+        if (want_ascii) {
+            for (j = 0; j < DSHS_BPL; ++j)
+                line[cpstart + j] = (j >= m) ? ' ' :
+                                    (my_isprint(p[j]) ? p[j] : '.');
+            k = cpstart + DSHS_BPL;
         } else
-            bpos += 3;
-    }
-    if (bpos > bpstart) {
-        trimTrailingSpaces(buff);
-        if (want_ascii)
-            n += scnpr(b + n, b_len - n, "%-*s   %s\n", prior_ascii_len,
-                       buff, a);
-        else
-            n += scnpr(b + n, b_len - n, "%s\n", buff);
+            k = bpstart + (3 * (m - 1)) + ((m > (DSHS_BPL / 2)) ? 1 : 0) + 2;
+        line[k++] = '\n';
+        if ((b_len - n) < 2)
+            return n;
+        if (k > (b_len - n - 1))
+            k = b_len - n - 1;
+        memcpy(b + n, line, k);
+        n += k;
+        b[n] = '\0';
+        if (n >= (b_len - 1))
+            return n;
     }
     return n;
 }
@@ -779,8 +791,8 @@ smp_memalign(uint32_t num_bytes, uint32_t align_to, uint8_t ** buff_to_free,
 
         err = posix_memalign(&wp, psz, num_bytes);
         if (err || (NULL == wp)) {
-            fprintf(stderr, "%s: posix_memalign: error [%d], out of "
-                    "memory?\n", __func__, err);
+            pr2ws("%s: posix_memalign: error [%d], out of "
+                  "memory?\n", __func__, err);
             return NULL;
         }
         memset(wp, 0, num_bytes);
@@ -788,11 +800,11 @@ smp_memalign(uint32_t num_bytes, uint32_t align_to, uint8_t ** buff_to_free,
             *buff_to_free = (uint8_t *)wp;
         res = (uint8_t *)wp;
         if (vb) {
-            fprintf(stderr, "%s: posix_ma, len=%d, ", __func__, num_bytes);
+            pr2ws("%s: posix_ma, len=%d, ", __func__, num_bytes);
             if (buff_to_free)
-                fprintf(stderr, "wrkBuffp=%p, ", (void *)res);
-            fprintf(stderr, "psz=%u, rp=%p\n", (unsigned int)psz,
-                    (void *)res);
+                pr2ws("wrkBuffp=%p, ", (void *)res);
+            pr2ws("psz=%u, rp=%p\n", (unsigned int)psz,
+                  (void *)res);
         }
         return res;
     }
@@ -811,11 +823,11 @@ smp_memalign(uint32_t num_bytes, uint32_t align_to, uint8_t ** buff_to_free,
         res = (uint8_t *)(void *)
             (((smp_uintptr_t)wrkBuff + align_1) & (~align_1));
         if (vb) {
-            fprintf(stderr, "%s: hack, len=%d, ", __func__, num_bytes);
+            pr2ws("%s: hack, len=%d, ", __func__, num_bytes);
             if (buff_to_free)
-                fprintf(stderr, "buff_to_free=%p, ", wrkBuff);
-            fprintf(stderr, "align_1=%lu, rp=%p\n", (unsigned long)align_1,
-                    (void *)res);
+                pr2ws("buff_to_free=%p, ", wrkBuff);
+            pr2ws("align_1=%lu, rp=%p\n", (unsigned long)align_1,
+                  (void *)res);
         }
         return res;
     }
@@ -946,7 +958,7 @@ smp_get_num(const char * buf)
             }
             return -1;
         default:
-            fprintf(stderr, "unrecognized multiplier\n");
+            pr2ws("unrecognized multiplier\n");
             return -1;
         }
     }
@@ -1077,7 +1089,7 @@ smp_get_llnum(const char * buf)
             }
             return -1LL;
         default:
-            fprintf(stderr, "unrecognized multiplier\n");
+            pr2ws("unrecognized multiplier\n");
             return -1LL;
         }
     }
@@ -1135,6 +1147,44 @@ smp_get_dhnum(const char * buf)
     return res ? n : -1;
 }
 
+/* Decodes a list of phy identifiers such as "0,3,8-11" in 'buf' into
+ * phy_arr in ascending order, dropping duplicates. Ranges are inclusive.
+ * Each number is decoded as for smp_get_num_nomult() and must be from 0
+ * to 254. Returns the number of phy identifiers placed in phy_arr (at most
+ * max_num), or -1 if 'buf' can not be decoded. */
+int
+smp_get_phy_list(const char * buf, uint8_t * phy_arr, int max_num)
+{
+    int k, n, lo, hi, len;
+    const char * cp;
+    uint8_t bm[32];
+    char b[32];
+
+    if ((NULL == buf) || ('\0' == buf[0]))
+        return -1;
+    memset(bm, 0, sizeof(bm));
+    for (cp = buf; *cp; cp += len + (',' == cp[len])) {
+        len = strcspn(cp, ",");
+        if ((len < 1) || (len >= (int)sizeof(b)))
+            return -1;
+        memcpy(b, cp, len);
+        b[len] = '\0';
+        lo = smp_get_num_nomult(b);
+        for (k = 1; (k < len) && ('-' != b[k]); ++k)
+            ;
+        hi = (k < len) ? smp_get_num_nomult(b + k + 1) : lo;
+        if ((lo < 0) || (lo > 254) || (hi < lo) || (hi > 254))
+            return -1;
+        for (k = lo; k <= hi; ++k)
+            bm[k / 8] |= (1 << (k % 8));
+    }
+    for (n = 0, k = 0; (k < 255) && (n < max_num); ++k) {
+        if (bm[k / 8] & (1 << (k % 8)))
+            phy_arr[n++] = k;
+    }
+    return n;
+}
+
 /* Want safe, 'n += snprintf(b + n, blen - n, ...)' style sequence of
  * functions. Returns number of chars placed in cp excluding the
  * trailing null char. So for cp_max_len > 0 the return value is always
@@ -1169,18 +1219,45 @@ pr2serr(const char * fmt, ...)
     return n;
 }
 
+/* Library diagnostics go through here. With a log callback the message is
+ * formatted into a local buffer (truncated if longer) and passed on. The
+ * callback and its argument are taken under the mutex but it is called
+ * without it, so it may itself call into the library. Without a callback
+ * the mutex keeps messages from different threads from interleaving. */
 int
 pr2ws(const char * fmt, ...)
 {
     va_list args;
     int n;
+    smp_log_cb_t cb;
+    void * cb_arg;
+    char b[1024];
 
     va_start(args, fmt);
-    n = vfprintf(stderr, fmt, args);
+    pthread_mutex_lock(&log_mtx);
+    cb = log_cb;
+    cb_arg = log_cb_arg;
+    if (cb) {
+        pthread_mutex_unlock(&log_mtx);
+        n = vsnprintf(b, sizeof(b), fmt, args);
+        cb(b, cb_arg);
+    } else {
+        n = vfprintf(stderr, fmt, args);
+        pthread_mutex_unlock(&log_mtx);
+    }
     va_end(args);
     return n;
 }
 
+void
+smp_set_log_cb(smp_log_cb_t cb, void * arg)
+{
+    pthread_mutex_lock(&log_mtx);
+    log_cb = cb;
+    log_cb_arg = arg;
+    pthread_mutex_unlock(&log_mtx);
+}
+
 const char *
 smp_lib_version()
 {
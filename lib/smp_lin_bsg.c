@@ -47,12 +47,14 @@
 #include <sys/types.h>
 #endif
 #include <scsi/sg.h>
+#include <pthread.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
 #include "smp_lin_bsg.h"
+#include "sg_pr2serr.h"
 
 #if defined(IGNORE_LINUX_BSG) || ! defined(HAVE_LINUX_BSG_H)
 
@@ -81,14 +83,26 @@ close_lin_bsg_device(int fd)
     return 0;
 }
 
+int
+lin_bsg_name_by_sa(uint64_t sa, char * b, int blen, int verbose)
+{
+    sa = sa;
+    b = b;
+    blen = blen;
+    verbose = verbose;
+    return -1;
+}
+
 /* Returns 0 on success else -1 . */
 int
 send_req_lin_bsg(int fd, int subvalue, struct smp_req_resp * rresp,
-                 int verbose)
+                 int timeout_ms, bool * timed_outp, int verbose)
 {
     fd = fd;
     subvalue = subvalue;
     rresp = rresp;
+    timeout_ms = timeout_ms;
+    timed_outp = timed_outp;
     verbose = verbose;
     return -1;
 }
@@ -97,9 +111,34 @@ send_req_lin_bsg(int fd, int subvalue, struct smp_req_resp * rresp,
 # else  /* have <linux/bsg.h> and want to use it */
 
 #include <linux/bsg.h>
+#include <dirent.h>
+#include <errno.h>
 
 #define DEF_TIMEOUT_MS 20000    /* 20 seconds */
 
+/* Maps bsg char device major:minor to its node in /dev . Kept in /run
+ * (a tmpfs cleared at each boot) so the mapping is per boot. Each entry is
+ * re-checked with stat() before use, so stale entries are harmless. */
+#define BSG_CACHE_DIR "/run/smp_utils"
+#define BSG_CACHE_FN BSG_CACHE_DIR "/bsg_nodes"
+
+/* Index of expander SAS address to sysfs name (e.g. "expander-6:0"), built
+ * from /sys/class/sas_expander and /sys/class/bsg then saved in /run so
+ * later processes need not rescan sysfs. Held in memory as an open
+ * addressing hash table. */
+#define SAS_INDEX_FN BSG_CACHE_DIR "/sas_index"
+#define SAS_INDEX_SZ 1024       /* power of 2, more than expanders */
+#define SAS_INDEX_NM_LEN 64
+
+struct sas_index_t {
+    uint64_t sa;                /* 0 --> empty slot */
+    char name[SAS_INDEX_NM_LEN];
+};
+
+static struct sas_index_t sas_index[SAS_INDEX_SZ];
+static int sas_index_count = -1;        /* -1 --> not loaded */
+static pthread_mutex_t sas_index_mtx = PTHREAD_MUTEX_INITIALIZER;
+
 
 /* Returns 1 if bsg dev_name else 0 . */
 int
@@ -112,8 +151,8 @@ chk_lin_bsg_device(const char * dev_name, int verbose)
     int len;
 
     if (strlen(dev_name) > sizeof(buff)) {
-        fprintf(stderr, "device name too long (greater than %d bytes)\n",
-                (int)sizeof(buff));
+        pr2ws("device name too long (greater than %d bytes)\n",
+              (int)sizeof(buff));
         return 0;
     }
     len = 0;
@@ -124,7 +163,7 @@ chk_lin_bsg_device(const char * dev_name, int verbose)
                 buff[len++] = '/';
         } else {
             if (verbose > 3)
-                perror("chk_lin_bsg_device: getcwd failed");
+                smp_perror("chk_lin_bsg_device: getcwd failed");
             return 0;
         }
         strncpy(buff + len, dev_name, sizeof(buff) - len);
@@ -137,9 +176,9 @@ chk_lin_bsg_device(const char * dev_name, int verbose)
         if (strstr(buff, "/bsg/")) {
             if (stat(buff, &st) < 0) {
                 if (verbose > 3) {
-                    fprintf(stderr, "chk_lin_bsg_device: stat() on %s "
-                            "failed: ", buff);
-                    perror("");
+                    pr2ws("chk_lin_bsg_device: stat() on %s "
+                          "failed: ", buff);
+                    smp_perror("");
                 }
                 return 0;
             }
@@ -152,9 +191,9 @@ chk_lin_bsg_device(const char * dev_name, int verbose)
         snprintf(sysfs_nm, sizeof(sysfs_nm), "/sys/class/bsg/%s/dev", cp + 1);
         if (stat(sysfs_nm, &st) < 0) {
             if (verbose > 3) {
-                fprintf(stderr, "chk_lin_bsg_device: stat() on redirected %s "
-                        "failed: ", sysfs_nm);
-                perror("");
+                pr2ws("chk_lin_bsg_device: stat() on redirected %s "
+                      "failed: ", sysfs_nm);
+                smp_perror("");
             }
             return 0;
         }
@@ -163,20 +202,291 @@ chk_lin_bsg_device(const char * dev_name, int verbose)
     return 0;
 }
 
+/* Returns 1 if node_name is a char device with the given major and minor
+ * device numbers, else 0 . */
+static int
+bsg_node_matches(const char * node_name, int maj, int min)
+{
+    struct stat st;
+
+    if (stat(node_name, &st) < 0)
+        return 0;
+    return (S_ISCHR(st.st_mode) && ((int)major(st.st_rdev) == maj) &&
+            ((int)minor(st.st_rdev) == min));
+}
+
+static void
+bsg_cache_add(int maj, int min, const char * node_name, int verbose)
+{
+    int fd, n;
+    char b[1100];
+
+    if ((mkdir(BSG_CACHE_DIR, 0755) < 0) && (EEXIST != errno))
+        goto fail;
+    fd = open(BSG_CACHE_FN, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+        goto fail;
+    /* one short write() with O_APPEND so concurrent adders don't mix */
+    n = snprintf(b, sizeof(b), "%d:%d %s\n", maj, min, node_name);
+    if (write(fd, b, n) != n)
+        n = -1;
+    close(fd);
+    if (n > 0)
+        return;
+fail:
+    if (verbose > 2)
+        pr2ws("bsg_cache_add: unable to update %s: %s\n",
+              BSG_CACHE_FN, safe_strerror_r(errno, b, sizeof(b)));
+}
+
+/* Finds an existing device node for bsg char device maj:min whose sysfs
+ * name is sys_name. Tries /dev/bsg/<sys_name>, then the per boot cache,
+ * then scans /dev/bsg (adding what it finds to the cache). Returns 1 and
+ * places the node name in b if found, else returns 0 . */
+static int
+find_bsg_node(const char * sys_name, int maj, int min, char * b, int blen,
+              int verbose)
+{
+    int c_maj, c_min, found;
+    FILE * fp;
+    DIR * dirp;
+    struct dirent * dep;
+    char line[1100];
+    char nm[1024];
+
+    snprintf(b, blen, "/dev/bsg/%s", sys_name);
+    if (bsg_node_matches(b, maj, min))
+        return 1;
+    if ((fp = fopen(BSG_CACHE_FN, "r"))) {
+        found = 0;
+        while (fgets(line, sizeof(line), fp)) {
+            if ((3 == sscanf(line, "%d:%d %1023s", &c_maj, &c_min, nm)) &&
+                (c_maj == maj) && (c_min == min) &&
+                bsg_node_matches(nm, maj, min)) {
+                snprintf(b, blen, "%s", nm);
+                found = 1;
+                break;
+            }
+        }
+        fclose(fp);
+        if (found) {
+            if (verbose > 2)
+                pr2ws("find_bsg_node: %d:%d is %s [cached]\n",
+                      maj, min, b);
+            return 1;
+        }
+    }
+    if (NULL == (dirp = opendir("/dev/bsg")))
+        return 0;
+    found = 0;
+    while ((dep = readdir(dirp))) {
+        if ('.' == dep->d_name[0])
+            continue;
+        snprintf(b, blen, "/dev/bsg/%s", dep->d_name);
+        if (bsg_node_matches(b, maj, min)) {
+            found = 1;
+            break;
+        }
+    }
+    closedir(dirp);
+    if (found) {
+        if (verbose > 2)
+            pr2ws("find_bsg_node: %d:%d is %s\n", maj, min, b);
+        bsg_cache_add(maj, min, b, verbose);
+    }
+    return found;
+}
+
+static int
+sas_index_slot(uint64_t sa)
+{
+    uint64_t h = sa * 0x9e3779b97f4a7c15ULL;    /* Fibonacci hashing */
+
+    return (int)(h >> 54) & (SAS_INDEX_SZ - 1);
+}
+
+/* Returns the slot holding sa, or the empty slot where it would go, or -1
+ * if the table is full. */
+static int
+sas_index_find(uint64_t sa)
+{
+    int k, j;
+
+    for (k = 0, j = sas_index_slot(sa); k < SAS_INDEX_SZ;
+         ++k, j = (j + 1) & (SAS_INDEX_SZ - 1)) {
+        if ((sas_index[j].sa == sa) || (0 == sas_index[j].sa))
+            return j;
+    }
+    return -1;
+}
+
+static void
+sas_index_add(uint64_t sa, const char * name)
+{
+    int j;
+
+    if ((0 == sa) || (strlen(name) >= SAS_INDEX_NM_LEN))
+        return;
+    j = sas_index_find(sa);
+    if (j < 0)
+        return;
+    if (0 == sas_index[j].sa)
+        ++sas_index_count;
+    sas_index[j].sa = sa;
+    snprintf(sas_index[j].name, SAS_INDEX_NM_LEN, "%s", name);
+}
+
+/* Reads the SAS address of the expander named 'name' from sysfs. Returns
+ * 0 if not available. */
+static uint64_t
+sysfs_expander_sa(const char * name)
+{
+    uint64_t ull = 0;
+    FILE * fp;
+    char b[128];
+
+    snprintf(b, sizeof(b), "/sys/class/sas_device/%.64s/sas_address",
+             name);
+    if ((fp = fopen(b, "r"))) {
+        if (fgets(b, sizeof(b), fp))
+            ull = strtoull(b, NULL, 16);
+        fclose(fp);
+    }
+    return ull;
+}
+
+/* Rebuilds the index from sysfs then tries to save it. */
+static void
+sas_index_build(int verbose)
+{
+    int fd, k, n;
+    uint64_t ull;
+    DIR * dirp;
+    FILE * fp;
+    struct dirent * dep;
+    struct stat st;
+    char b[128];
+    char tmp_fn[128];
+
+    memset(sas_index, 0, sizeof(sas_index));
+    sas_index_count = 0;
+    if (NULL == (dirp = opendir("/sys/class/sas_expander")))
+        return;
+    while ((dep = readdir(dirp))) {
+        if (strncmp(dep->d_name, "expander-", 9) ||
+            (strlen(dep->d_name) >= SAS_INDEX_NM_LEN))
+            continue;
+        /* only expanders reachable via bsg are of use */
+        snprintf(b, sizeof(b), "/sys/class/bsg/%s", dep->d_name);
+        if (stat(b, &st) < 0)
+            continue;
+        ull = sysfs_expander_sa(dep->d_name);
+        if (ull)
+            sas_index_add(ull, dep->d_name);
+    }
+    closedir(dirp);
+    if (verbose > 2)
+        pr2ws("sas_index_build: %d expanders\n", sas_index_count);
+
+    if ((mkdir(BSG_CACHE_DIR, 0755) < 0) && (EEXIST != errno))
+        return;
+    snprintf(tmp_fn, sizeof(tmp_fn), "%s.%d", SAS_INDEX_FN, (int)getpid());
+    fd = open(tmp_fn, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if ((fd < 0) || (NULL == (fp = fdopen(fd, "w")))) {
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    for (k = 0, n = 0; k < SAS_INDEX_SZ; ++k) {
+        if (sas_index[k].sa)
+            n = fprintf(fp, "0x%" PRIx64 " %s\n", sas_index[k].sa,
+                        sas_index[k].name);
+        if (n < 0)
+            break;
+    }
+    if (fclose(fp) || (n < 0) || rename(tmp_fn, SAS_INDEX_FN))
+        unlink(tmp_fn);
+}
+
+/* Loads the index saved by an earlier process. Returns 0 if loaded. */
+static int
+sas_index_load(void)
+{
+    uint64_t ull;
+    FILE * fp;
+    char line[160];
+    char nm[SAS_INDEX_NM_LEN];
+
+    if (NULL == (fp = fopen(SAS_INDEX_FN, "r")))
+        return -1;
+    memset(sas_index, 0, sizeof(sas_index));
+    sas_index_count = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        if (2 == sscanf(line, "0x%" SCNx64 " %63s", &ull, nm))
+            sas_index_add(ull, nm);
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* Places the bsg device name of the expander with SAS address sa in b.
+ * Prefers /dev/bsg/<name> but uses the /sys/class/bsg/<name> form when
+ * there is no node. The index entry is re-checked against sysfs before
+ * being used; a miss or a stale entry causes one rebuild. Returns 0 if
+ * found, else -1 . */
+int
+lin_bsg_name_by_sa(uint64_t sa, char * b, int blen, int verbose)
+{
+    int j, pass;
+    int ret = -1;
+    struct stat st;
+
+    if (0 == sa)
+        return -1;
+    pthread_mutex_lock(&sas_index_mtx);
+    if (sas_index_count < 0) {
+        if (sas_index_load())
+            sas_index_build(verbose);
+    }
+    for (pass = 0; pass < 2; ++pass) {
+        j = sas_index_find(sa);
+        if ((j >= 0) && sas_index[j].sa &&
+            (sysfs_expander_sa(sas_index[j].name) == sa)) {
+            snprintf(b, blen, "/dev/bsg/%s", sas_index[j].name);
+            if (stat(b, &st) < 0)
+                snprintf(b, blen, "/sys/class/bsg/%s", sas_index[j].name);
+            if (verbose > 2)
+                pr2ws("lin_bsg_name_by_sa: 0x%" PRIx64 " --> "
+                      "%s\n", sa, b);
+            ret = 0;
+            break;
+        }
+        if (0 == pass)
+            sas_index_build(verbose);
+    }
+    pthread_mutex_unlock(&sas_index_mtx);
+    if (ret && verbose)
+        pr2ws("no expander with SAS address 0x%" PRIx64 " found "
+              "in sysfs\n", sa);
+    return ret;
+}
+
 /* Returns open file descriptor to dev_name bsg device or -1 */
 int
 open_lin_bsg_device(const char * dev_name, int verbose)
 {
     char buff[1024];
     char sysfs_nm[1024 + 8];
+    char node_nm[1024];
+    char * cp;
     int len, res, maj, min;
     int ret = -1;
     FILE * fp = NULL;
     struct timeval t;
 
     if (strlen(dev_name) > sizeof(buff)) {
-        fprintf(stderr, "device name too long (greater than %d bytes)\n",
-                (int)sizeof(buff));
+        pr2ws("device name too long (greater than %d bytes)\n",
+              (int)sizeof(buff));
         return 0;
     }
     len = 0;
@@ -187,7 +497,7 @@ open_lin_bsg_device(const char * dev_name, int verbose)
                 buff[len++] = '/';
         } else {
             if (verbose)
-                perror("open_lin_bsg_device: getcwd failed");
+                smp_perror("open_lin_bsg_device: getcwd failed");
             return 0;
         }
         strncpy(buff + len, dev_name, sizeof(buff) - len);
@@ -202,43 +512,57 @@ open_lin_bsg_device(const char * dev_name, int verbose)
         fp = fopen(sysfs_nm, "r");
         if (! fp) {
             if (verbose)
-                perror("open_lin_bsg_device: fopen() in sysfs failed");
+                smp_perror("open_lin_bsg_device: fopen() in sysfs failed");
             return -1;
         }
         if (! fgets(buff, sizeof(buff), fp)) {
             if (verbose)
-                perror("open_lin_bsg_device: fgets() in sysfs failed");
+                smp_perror("open_lin_bsg_device: fgets() in sysfs failed");
             goto close_sysfs;
         }
         if (2 != sscanf(buff, "%d:%d", &maj, &min)) {
             if (verbose)
-                perror("open_lin_bsg_device: fclose() in sysfs failed");
+                smp_perror("open_lin_bsg_device: fclose() in sysfs failed");
             goto close_sysfs;
         }
+        cp = strrchr(sysfs_nm, '/');    /* strip trailing "/dev" */
+        *cp = '\0';
+        cp = strrchr(sysfs_nm, '/');
+        if (find_bsg_node(cp + 1, maj, min, node_nm, sizeof(node_nm),
+                          verbose)) {
+            ret = open(node_nm, O_RDWR);
+            if (ret >= 0)
+                goto close_sysfs;
+            if (verbose) {
+                smp_perror("open_lin_bsg_device: open() device node failed");
+                pr2ws("\t\ttried to open %s\n", node_nm);
+            }
+        }
+        /* no usable node in /dev, fall back to a temporary one */
         res = gettimeofday(&t, NULL);
         if (res) {
             if (verbose)
-                perror("open_lin_bsg_device: gettimeofday() failed");
+                smp_perror("open_lin_bsg_device: gettimeofday() failed");
             goto close_sysfs;
         }
         memset(buff, 0, sizeof(buff));
         snprintf(buff, sizeof(buff), "/tmp/bsg_%lx%lx", t.tv_sec, t.tv_usec);
         if (verbose > 2)
-            fprintf(stderr, "about to make temporary device node at %s\n"
-                    "\tfor char device maj:%d min:%d\n", buff, maj, min);
+            pr2ws("about to make temporary device node at %s\n"
+                  "\tfor char device maj:%d min:%d\n", buff, maj, min);
         res = mknod(buff, S_IFCHR | S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH,
                     makedev(maj, min));
         if (res) {
             if (verbose)
-                perror("open_lin_bsg_device: mknod() failed");
+                smp_perror("open_lin_bsg_device: mknod() failed");
             goto close_sysfs;
         }
         ret = open(buff, O_RDWR);
         if (ret < 0) {
             if (verbose) {
-                perror("open_lin_bsg_device: open() temporary device node "
+                smp_perror("open_lin_bsg_device: open() temporary device node "
                        "failed");
-                fprintf(stderr, "\t\ttried to open %s\n", buff);
+                pr2ws("\t\ttried to open %s\n", buff);
             }
             goto close_sysfs;
         }
@@ -248,8 +572,8 @@ open_lin_bsg_device(const char * dev_name, int verbose)
         ret = open(buff, O_RDWR);
         if (ret < 0) {
             if (verbose) {
-                perror("open_lin_bsg_device: open() device node failed");
-                fprintf(stderr, "\t\ttried to open %s\n", buff);
+                smp_perror("open_lin_bsg_device: open() device node failed");
+                pr2ws("\t\ttried to open %s\n", buff);
             }
             goto close_sysfs;
         }
@@ -271,7 +595,7 @@ close_lin_bsg_device(int fd)
 /* Returns 0 on success else -1 . */
 int
 send_req_lin_bsg(int fd, int subvalue, struct smp_req_resp * rresp,
-                 int verbose)
+                 int timeout_ms, bool * timed_outp, int verbose)
 {
     struct sg_io_v4 hdr;
     unsigned char cmd[16];      /* unused */
@@ -295,32 +619,37 @@ send_req_lin_bsg(int fd, int subvalue, struct smp_req_resp * rresp,
     hdr.din_xfer_len = rresp->max_response_len;
     hdr.din_xferp = (uintptr_t) rresp->response;
 
-    hdr.timeout = DEF_TIMEOUT_MS;
+    hdr.timeout = (timeout_ms > 0) ? timeout_ms : DEF_TIMEOUT_MS;
 
     if (verbose > 3)
-        fprintf(stderr, "send_req_lin_bsg: dout_xfer_len=%u, din_xfer_len="
-                "%u, timeout=%u ms\n", hdr.dout_xfer_len, hdr.din_xfer_len,
-                hdr.timeout);
+        pr2ws("send_req_lin_bsg: dout_xfer_len=%u, din_xfer_len="
+              "%u, timeout=%u ms\n", hdr.dout_xfer_len, hdr.din_xfer_len,
+              hdr.timeout);
 
     res = ioctl(fd, SG_IO, &hdr);
     if (res) {
-        perror("send_req_lin_bsg: SG_IO ioctl");
+        if (ETIMEDOUT == errno)
+            *timed_outp = true;
+        smp_perror("send_req_lin_bsg: SG_IO ioctl");
         return -1;
     }
+    /* host byte DID_TIME_OUT or driver byte DRIVER_TIMEOUT */
+    if ((0x3 == hdr.transport_status) || (0x6 == (hdr.driver_status & 0xf)))
+        *timed_outp = true;
     res = hdr.din_xfer_len - hdr.din_resid;
     rresp->act_response_len = res;
     /* was: rresp->act_response_len = -1; */
     if (verbose > 3) {
-        fprintf(stderr, "send_req_lin_bsg: driver_status=%u, transport_status="
-                "%u\n", hdr.driver_status, hdr.transport_status);
-        fprintf(stderr, "    device_status=%u, duration=%u, info=%u\n",
-                hdr.device_status, hdr.duration, hdr.info);
-        fprintf(stderr, "    din_resid=%d, dout_resid=%d\n",
-                hdr.din_resid, hdr.dout_resid);
-        fprintf(stderr, "  smp_req_resp::max_response_len=%d  "
-                "act_response_len=%d\n", rresp->max_response_len, res);
+        pr2ws("send_req_lin_bsg: driver_status=%u, transport_status="
+              "%u\n", hdr.driver_status, hdr.transport_status);
+        pr2ws("    device_status=%u, duration=%u, info=%u\n",
+              hdr.device_status, hdr.duration, hdr.info);
+        pr2ws("    din_resid=%d, dout_resid=%d\n",
+              hdr.din_resid, hdr.dout_resid);
+        pr2ws("  smp_req_resp::max_response_len=%d  "
+              "act_response_len=%d\n", rresp->max_response_len, res);
         if ((verbose > 4) && (hdr.din_xfer_len > 0)) {
-            fprintf(stderr, "  response (din_resid might exclude CRC):\n");
+            pr2ws("  response (din_resid might exclude CRC):\n");
             hex2stdout(rresp->response,
                        (res > 0) ? res : (int)hdr.din_xfer_len, 1);
         }
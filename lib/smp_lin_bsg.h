@@ -9,7 +9,12 @@ int open_lin_bsg_device(const char * dev_name, int verbose);
 
 int close_lin_bsg_device(int fd);
 
+int lin_bsg_name_by_sa(uint64_t sa, char * b, int blen, int verbose);
+
+/* timeout_ms of 0 selects the default. Sets *timed_outp when the request
+ * timed out. */
 int send_req_lin_bsg(int fd, int subvalue,
-		     struct smp_req_resp * rresp, int verbose);
+		     struct smp_req_resp * rresp, int timeout_ms,
+		     bool * timed_outp, int verbose);
 
 #endif
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2020, Douglas Gilbert
+ * Copyright (c) 2006-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -27,13 +27,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <inttypes.h>
+#include <pthread.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 #include "smp_lib.h"
 #include "sg_unaligned.h"
+#include "sg_pr2serr.h"
 
 #include "smp_aac_io.h"
 #include "smp_mptctl_io.h"
@@ -44,151 +46,163 @@
 #define I_SGV4 4
 #define I_AAC  6
 
-int
-smp_initiator_open(const char * device_name, int subvalue,
-                   const char * i_params, uint64_t sa,
-                   struct smp_target_obj * tobj, int verbose)
+/* Linux pass-throughs, registered with smp_xport_register() in the order
+ * an unnamed device is probed: bsg first, then mptctl, then aacraid. */
+
+static pthread_mutex_t aac_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+
+static int
+bsg_open(const char * device_name, int subvalue, const char * i_params,
+         uint64_t sa, struct smp_target_obj * tobj, int verbose)
 {
-    int force = 0;
     int res;
-    int len = device_name ? (strlen(device_name) + 1) : 0;
-    char * cp;
 
-    if ((NULL == tobj) || (NULL == device_name))
+    if (subvalue || i_params || sa) { ; }   /* unused, suppress warning */
+    res = open_lin_bsg_device(device_name, verbose);
+    if (res < 0)
         return -1;
-    memset(tobj, 0, sizeof(struct smp_target_obj));
-    memcpy(tobj->device_name, device_name,
-	   ((len > SMP_MAX_DEVICE_NAME) ? SMP_MAX_DEVICE_NAME : len));
-    if (sa)
-        sg_put_unaligned_be64(sa, tobj->sas_addr + 0);
-    if (i_params[0]) {
-        if (0 == strncmp("aac", i_params, 3))
-            tobj->interface_selector = I_AAC;
-        else if(0 == strncmp("mpt",i_params,3))
-            tobj->interface_selector = I_MPT;
-        else if ((0 == strncmp("sgv4", i_params, 2)) ||
-                 (0 == strncmp("bsg", i_params, 3)))
-            tobj->interface_selector = I_SGV4;
-        else if (0 == strncmp("for", i_params, 3))
-            force = 1;
-        else if (verbose > 3)
-            fprintf(stderr, "smp_initiator_open: interface not recognized\n");
-        cp = (char *)strchr(i_params, ','); /* cast to stop C++ error */
-        if (cp) {
-            if ((tobj->interface_selector > 0) &&
-                (0 == strncmp("for", cp + 1, 3)))
-                force = 1;
-        }
-    }
-    if ((I_SGV4 == tobj->interface_selector) ||
-        (0 == tobj->interface_selector)) {
-        res = chk_lin_bsg_device(device_name, verbose);
-        if (res || force) {
-            if (0 == tobj->interface_selector)
-                tobj->interface_selector = I_SGV4;
-            if ((0 == res) && force)
-                fprintf(stderr, "... overriding failed check due "
-                        "to 'force'\n");
-            res = open_lin_bsg_device(device_name, verbose);
-            if (res < 0)
-                goto err_out;
-            tobj->fd = res;
-            tobj->subvalue = subvalue;
-            tobj->opened = 1;
-            return 0;
-        } else if (verbose > 2)
-            fprintf(stderr, "chk_lin_bsg_device: failed\n");
-    }
-    if ((I_MPT == tobj->interface_selector) ||
-        (0 == tobj->interface_selector)) {
-        res = chk_mpt_device(device_name, verbose);
-        if (res || force) {
-            if (0 == tobj->interface_selector)
-                tobj->interface_selector = I_MPT;
-            if ((0 == res) && force)
-                fprintf(stderr, "... overriding failed check due "
-                        "to 'force'\n");
-            res = open_mpt_device(device_name, verbose);
-            if (res < 0)
-                goto err_out;
-            tobj->fd = res;
-            tobj->subvalue = subvalue;
-            tobj->opened = 1;
-
-            return 0;
-        } else if (verbose > 2)
-            fprintf(stderr, "smp_initiator_open: chk_mpt_device failed\n");
-    }
+    tobj->fd = res;
+    return 0;
+}
 
-    if((I_AAC == tobj->interface_selector) ||
-      (0 == tobj->interface_selector)) {
-       res = chk_aac_device(device_name,verbose);
-       if(res || force) {
-           if (0 == tobj->interface_selector)
-               tobj->interface_selector = I_AAC;
-           if ((0 == res) && force)
-               fprintf(stderr,"... overriding failed check due"
-                       "to 'force' \n");
-           res = open_aac_device(device_name,verbose);
-           if (res < 0)
-               goto err_out;
-           tobj->fd = res;
-           tobj->subvalue = subvalue;
-           tobj->opened  = 1;
-           return 0;
-        } else if (verbose > 2)
-            fprintf(stderr,"smp_initiator_open: chk_aac_device failed\n");
-    }
+static int
+bsg_send(const struct smp_target_obj * tobj, struct smp_req_resp * rresp,
+         bool * timed_outp, int verbose)
+{
+    return send_req_lin_bsg(tobj->fd, tobj->subvalue, rresp,
+                            tobj->timeout_ms, timed_outp, verbose);
+}
 
-err_out:
-    fprintf(stderr, "smp_initiator_open: failed to open %s\n", device_name);
-    return -1;
+static int
+bsg_close(struct smp_target_obj * tobj)
+{
+    if (close_lin_bsg_device(tobj->fd) < 0)
+        pr2ws("close_lin_bsg_device: failed\n");
+    return 0;
 }
 
-int
-smp_send_req(const struct smp_target_obj * tobj,
-             struct smp_req_resp * rresp, int verbose)
+static const struct smp_xport_ops bsg_xport = {
+    .name = "sgv4",
+    .prefix = {"sg", "bsg", NULL},
+    .selector = I_SGV4,
+    .flags = SMP_XPORT_AUTO | SMP_XPORT_TIMEOUT,
+    .probe = chk_lin_bsg_device,
+    .open = bsg_open,
+    .send = bsg_send,
+    .close = bsg_close,
+    .name_by_sa = lin_bsg_name_by_sa,
+};
+
+static int
+mpt_open(const char * device_name, int subvalue, const char * i_params,
+         uint64_t sa, struct smp_target_obj * tobj, int verbose)
 {
-    if ((NULL == tobj) || (0 == tobj->opened)) {
-        if (verbose > 2)
-            fprintf(stderr, "smp_send_req: nothing open??\n");
+    int res;
+
+    if (subvalue || i_params || sa) { ; }   /* unused, suppress warning */
+    res = open_mpt_device(device_name, verbose);
+    if (res < 0)
         return -1;
-    }
-    if (I_SGV4 == tobj->interface_selector)
-        return send_req_lin_bsg(tobj->fd, tobj->subvalue, rresp, verbose);
-    else if (I_MPT == tobj->interface_selector)
-        return send_req_mpt(tobj->fd, tobj->subvalue, tobj->sas_addr,
-                            rresp, verbose);
-    else if (I_AAC == tobj->interface_selector)
-        return send_req_aac(tobj->fd, tobj->subvalue, tobj->sas_addr,
-                            rresp, verbose);
-    else {
-        if (verbose)
-            fprintf(stderr, "smp_send_req: no transport??\n");
+    if (NULL == (tobj->vp = alloc_mpt_bufs(res, verbose))) {
+        close_mpt_device(res);
         return -1;
     }
+    tobj->fd = res;
+    return 0;
+}
+
+static int
+mpt_send(const struct smp_target_obj * tobj, struct smp_req_resp * rresp,
+         bool * timed_outp, int verbose)
+{
+    if (timed_outp) { ; }       /* unused, mptctl does not report it */
+    return send_req_mpt(tobj->fd, tobj->subvalue, tobj->sas_addr,
+                        tobj->vp, rresp, verbose);
 }
 
-int
-smp_initiator_close(struct smp_target_obj * tobj)
+static int
+mpt_close(struct smp_target_obj * tobj)
+{
+    if (close_mpt_device(tobj->fd) < 0)
+        pr2ws("close_mpt_device: failed\n");
+    free_mpt_bufs(tobj->vp);
+    tobj->vp = NULL;
+    return 0;
+}
+
+static const struct smp_xport_ops mpt_xport = {
+    .name = "mpt",
+    .prefix = {"mpt", NULL},
+    .selector = I_MPT,
+    .flags = SMP_XPORT_AUTO | SMP_XPORT_NEEDS_SA,
+    .probe = chk_mpt_device,
+    .open = mpt_open,
+    .send = mpt_send,
+    .close = mpt_close,
+};
+
+static int
+aac_probe(const char * device_name, int verbose)
 {
     int res;
 
-    if ((NULL == tobj) || (0 == tobj->opened)) {
-        fprintf(stderr, "smp_initiator_close: nothing open??\n");
+    pthread_mutex_lock(&aac_mtx);
+    res = chk_aac_device(device_name, verbose);
+    pthread_mutex_unlock(&aac_mtx);
+    return res;
+}
+
+static int
+aac_open(const char * device_name, int subvalue, const char * i_params,
+         uint64_t sa, struct smp_target_obj * tobj, int verbose)
+{
+    int res;
+
+    if (subvalue || i_params || sa) { ; }   /* unused, suppress warning */
+    /* chk_aac_device() leaves the device numbers for open_aac_device() */
+    pthread_mutex_lock(&aac_mtx);
+    chk_aac_device(device_name, 0);
+    res = open_aac_device(device_name, verbose);
+    pthread_mutex_unlock(&aac_mtx);
+    if (res < 0)
         return -1;
-    }
-    if (I_MPT == tobj->interface_selector) {
-        res = close_mpt_device(tobj->fd);
-        if (res < 0)
-            fprintf(stderr, "close_mpt_device: failed\n");
-    }else if(I_AAC == tobj->interface_selector){
-        res = close_aac_device(tobj->fd);
-        if (res < 0)
-            fprintf(stderr,"close_aac_device: failed\n");
-    }
+    tobj->fd = res;
+    return 0;
+}
 
+static int
+aac_send(const struct smp_target_obj * tobj, struct smp_req_resp * rresp,
+         bool * timed_outp, int verbose)
+{
+    if (timed_outp) { ; }       /* unused, aacraid does not report it */
+    return send_req_aac(tobj->fd, tobj->subvalue, tobj->sas_addr, rresp,
+                        verbose);
+}
 
-    tobj->opened = 0;
+static int
+aac_close(struct smp_target_obj * tobj)
+{
+    if (close_aac_device(tobj->fd) < 0)
+        pr2ws("close_aac_device: failed\n");
     return 0;
 }
+
+static const struct smp_xport_ops aac_xport = {
+    .name = "aac",
+    .prefix = {"aac", NULL},
+    .selector = I_AAC,
+    .flags = SMP_XPORT_AUTO | SMP_XPORT_NEEDS_SA,
+    .probe = aac_probe,
+    .open = aac_open,
+    .send = aac_send,
+    .close = aac_close,
+};
+
+void
+smp_xport_native_init(void)
+{
+    smp_xport_register(&bsg_xport);
+    smp_xport_register(&mpt_xport);
+    smp_xport_register(&aac_xport);
+}
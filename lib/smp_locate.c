@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_pr2serr.h"
+
+/* The index is laid out in memory exactly as in its file: a header, two
+ * open addressing hash tables of nslots slots (one keyed by attached SAS
+ * address, one by attached device name) each holding an entry number plus
+ * one (0 for an empty slot), then the entries. So smp_locate_save() is
+ * one write and smp_locate_map() one mmap(), and nothing is parsed. Keys
+ * that occur more than once (wide ports) simply occupy more slots of the
+ * same probe sequence. nslots is a power of 2 at least twice max_num so
+ * probe sequences stay short. */
+
+#define LOCATE_MAGIC 0x534d504c         /* "SMPL" */
+#define LOCATE_VERSION 1
+#define LOCATE_MAX_ENTS (1 << 24)
+
+struct locate_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nslots;
+    uint32_t max_num;
+    uint32_t num;
+    uint32_t ent_len;           /* sizeof(struct smp_locate_ent) */
+};
+
+struct smp_locate_idx {
+    bool mapped;
+    size_t len;
+    uint8_t * base;
+    struct locate_hdr * hp;
+    uint32_t * sa_slot;
+    uint32_t * dn_slot;
+    struct smp_locate_ent * ents;
+};
+
+
+static size_t
+locate_len(uint32_t nslots, uint32_t max_num)
+{
+    return sizeof(struct locate_hdr) + (2 * sizeof(uint32_t) * nslots) +
+           (sizeof(struct smp_locate_ent) * (size_t)max_num);
+}
+
+static void
+locate_layout(struct smp_locate_idx * lip)
+{
+    lip->hp = (struct locate_hdr *)lip->base;
+    lip->sa_slot = (uint32_t *)(lip->base + sizeof(struct locate_hdr));
+    lip->dn_slot = lip->sa_slot + lip->hp->nslots;
+    lip->ents = (struct smp_locate_ent *)(lip->dn_slot + lip->hp->nslots);
+}
+
+static uint32_t
+locate_slot(uint64_t key, uint32_t nslots)
+{
+    uint64_t h = key * 0x9e3779b97f4a7c15ULL;   /* Fibonacci hashing */
+
+    return (uint32_t)(h >> 32) & (nslots - 1);
+}
+
+static void
+locate_insert(uint32_t * slots, uint32_t nslots, uint64_t key, uint32_t e)
+{
+    uint32_t j = locate_slot(key, nslots);
+
+    while (slots[j])    /* never full, nslots > 2 * max_num */
+        j = (j + 1) & (nslots - 1);
+    slots[j] = e + 1;
+}
+
+struct smp_locate_idx *
+smp_locate_new(int max_ents)
+{
+    uint32_t nslots;
+    struct smp_locate_idx * lip;
+
+    if ((max_ents < 1) || (max_ents > LOCATE_MAX_ENTS))
+        return NULL;
+    for (nslots = 16; nslots < (2 * (uint32_t)max_ents); nslots <<= 1)
+        ;
+    lip = (struct smp_locate_idx *)calloc(1, sizeof(*lip));
+    if (NULL == lip)
+        return NULL;
+    lip->len = locate_len(nslots, max_ents);
+    if (NULL == (lip->base = (uint8_t *)calloc(1, lip->len))) {
+        free(lip);
+        return NULL;
+    }
+    lip->hp = (struct locate_hdr *)lip->base;
+    lip->hp->magic = LOCATE_MAGIC;
+    lip->hp->version = LOCATE_VERSION;
+    lip->hp->nslots = nslots;
+    lip->hp->max_num = max_ents;
+    lip->hp->ent_len = sizeof(struct smp_locate_ent);
+    locate_layout(lip);
+    return lip;
+}
+
+int
+smp_locate_add(struct smp_locate_idx * lip, const char * exp_dev,
+               const uint8_t * rp, int len)
+{
+    uint32_t e;
+    struct smp_locate_ent * ep;
+    struct smp_discover_view dv;
+
+    if ((NULL == lip) || lip->mapped || (NULL == rp) ||
+        smp_decode_discover(rp, len, 0, &dv))
+        return -1;
+    if ((0 == dv.att_dev_type) || (dv.att_dev_type > 3) ||
+        (0 == dv.att_sas_addr))
+        return 1;
+    e = lip->hp->num;
+    if (e >= lip->hp->max_num)
+        return -1;
+    ep = lip->ents + e;
+    ep->att_sas_addr = dv.att_sas_addr;
+    ep->att_dev_name = dv.att_dev_name;
+    ep->exp_sas_addr = dv.sas_addr;
+    ep->phy_id = dv.phy_id;
+    ep->zone_group = dv.zone_group;
+    ep->neg_log_lrate = dv.neg_log_lrate;
+    ep->att_dev_type = dv.att_dev_type;
+    ep->att_init = dv.att_init;
+    ep->att_targ = dv.att_targ;
+    ep->att_phy_id = dv.att_phy_id;
+    snprintf(ep->exp_dev, sizeof(ep->exp_dev), "%s", exp_dev ? exp_dev : "");
+    locate_insert(lip->sa_slot, lip->hp->nslots, ep->att_sas_addr, e);
+    if (ep->att_dev_name)
+        locate_insert(lip->dn_slot, lip->hp->nslots, ep->att_dev_name, e);
+    lip->hp->num = e + 1;
+    return 0;
+}
+
+int
+smp_locate_save(const struct smp_locate_idx * lip, const char * fn,
+                int verbose)
+{
+    int fd, n;
+    size_t k;
+    char tmp_fn[256];
+    char b[64];
+
+    if (NULL == lip)
+        return -1;
+    if (NULL == fn) {
+        fn = SMP_LOCATE_FN;
+        mkdir("/run/smp_utils", 0755);  /* may well exist */
+    }
+    snprintf(tmp_fn, sizeof(tmp_fn), "%s.%d", fn, (int)getpid());
+    fd = open(tmp_fn, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        pr2ws("%s: unable to create %s: %s\n", __func__, tmp_fn,
+              safe_strerror_r(errno, b, sizeof(b)));
+        return -1;
+    }
+    for (k = 0; k < lip->len; k += n) {
+        n = write(fd, lip->base + k, lip->len - k);
+        if ((n < 0) && (EINTR == errno)) {
+            n = 0;
+            continue;
+        }
+        if (n <= 0)
+            break;
+    }
+    if ((close(fd) < 0) || (k < lip->len) || (rename(tmp_fn, fn) < 0)) {
+        pr2ws("%s: unable to write %s: %s\n", __func__, fn,
+              safe_strerror_r(errno, b, sizeof(b)));
+        unlink(tmp_fn);
+        return -1;
+    }
+    if (verbose)
+        pr2ws("%s: %u entries written to %s\n", __func__, lip->hp->num, fn);
+    return 0;
+}
+
+struct smp_locate_idx *
+smp_locate_map(const char * fn, int verbose)
+{
+    int fd;
+    void * vp;
+    const struct locate_hdr * hp;
+    struct smp_locate_idx * lip;
+    struct stat st;
+    char b[64];
+
+    if (NULL == fn)
+        fn = SMP_LOCATE_FN;
+    if ((fd = open(fn, O_RDONLY)) < 0) {
+        if (verbose)
+            pr2ws("%s: %s: %s\n", __func__, fn,
+                  safe_strerror_r(errno, b, sizeof(b)));
+        return NULL;
+    }
+    if ((fstat(fd, &st) < 0) ||
+        (st.st_size < (off_t)sizeof(struct locate_hdr))) {
+        close(fd);
+        pr2ws("%s: %s: too short\n", __func__, fn);
+        return NULL;
+    }
+    vp = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == vp) {
+        pr2ws("%s: mmap(%s): %s\n", __func__, fn,
+              safe_strerror_r(errno, b, sizeof(b)));
+        return NULL;
+    }
+    hp = (const struct locate_hdr *)vp;
+    if ((LOCATE_MAGIC != hp->magic) || (LOCATE_VERSION != hp->version) ||
+        (sizeof(struct smp_locate_ent) != hp->ent_len) ||
+        (0 == hp->nslots) || (hp->nslots & (hp->nslots - 1)) ||
+        (hp->num > hp->max_num) ||
+        ((size_t)st.st_size != locate_len(hp->nslots, hp->max_num))) {
+        munmap(vp, st.st_size);
+        pr2ws("%s: %s: not a valid index\n", __func__, fn);
+        return NULL;
+    }
+    if (NULL == (lip = (struct smp_locate_idx *)calloc(1, sizeof(*lip)))) {
+        munmap(vp, st.st_size);
+        return NULL;
+    }
+    lip->mapped = true;
+    lip->len = st.st_size;
+    lip->base = (uint8_t *)vp;
+    locate_layout(lip);
+    if (verbose > 1)
+        pr2ws("%s: %s: %u entries\n", __func__, fn, hp->num);
+    return lip;
+}
+
+int
+smp_locate_find(const struct smp_locate_idx * lip, uint64_t key,
+                bool by_name, struct smp_locate_ent * arr, int max_num)
+{
+    int n = 0;
+    uint32_t e, j, k;
+    uint32_t nslots;
+    const uint32_t * slots;
+    const struct smp_locate_ent * ep;
+
+    if ((NULL == lip) || (0 == key))
+        return 0;
+    nslots = lip->hp->nslots;
+    slots = by_name ? lip->dn_slot : lip->sa_slot;
+    for (k = 0, j = locate_slot(key, nslots); k < nslots;
+         ++k, j = (j + 1) & (nslots - 1)) {
+        if (0 == (e = slots[j]))
+            break;
+        if (e > lip->hp->num)
+            break;              /* damaged, do not wander */
+        ep = lip->ents + (e - 1);
+        if (key != (by_name ? ep->att_dev_name : ep->att_sas_addr))
+            continue;
+        if (arr && (n < max_num))
+            arr[n] = *ep;
+        ++n;
+    }
+    return n;
+}
+
+void
+smp_locate_free(struct smp_locate_idx * lip)
+{
+    if (NULL == lip)
+        return;
+    if (lip->mapped)
+        munmap(lip->base, lip->len);
+    else
+        free(lip->base);
+    free(lip);
+}
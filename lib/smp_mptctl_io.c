@@ -26,6 +26,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <fcntl.h>
+#include <pthread.h>
 // #include <linux/major.h>
 
 
@@ -38,6 +39,7 @@
 
 #include "smp_mptctl_glue.h"
 #include "smp_mptctl_io.h"
+#include "sg_pr2serr.h"
 
 #include "mptctl.h"
 
@@ -51,8 +53,29 @@ typedef struct mpt_ioctl_command mpiIoctlBlk_t;
 #define MPT2_DEV_MINOR 221
 #define MPT3_DEV_MINOR 222
 
+#define MPT_REPLY_FRAME_LEN 1200
+#define MPT_DATA_IN_LEN (1028 + 4)      /* largest SMP response + 4 */
+
 static const char null_sas_addr[8] = {0, 0, 0, 0, 0, 0, 0, 0, };
-static int mptcommand = (int)MPTCOMMAND;
+
+/* Buffers for the mptctl ioctl, allocated once when the device is opened
+ * and kept on the target object (tobj->vp) rather than malloc()-ed for
+ * each request. The ioctl block (with its two SGLs) is built once; only
+ * the request length, data out pointer and SAS address change between
+ * requests. The data in buffer is a bounce buffer: mptctl wants room for
+ * 4 bytes more than the response (the CRC) which the caller's response
+ * buffer need not have. The mutex is needed since smp_send_req_batch()
+ * sends from several threads; mptctl serializes the ioctl anyway. The
+ * ioctl number depends on whether the device is mptctl or mpt2ctl (or
+ * mpt3ctl) so it is kept here too rather than in a global. */
+struct mpt_bufs {
+        pthread_mutex_t mtx;
+        int mptcommand;
+        int data_in_len;
+        char * data_in;
+        mpiIoctlBlk_t * blk;
+        char reply_m[MPT_REPLY_FRAME_LEN];
+};
 
 
 /* Part of interface to upper level. */
@@ -63,7 +86,7 @@ chk_mpt_device(const char * dev_name, int verbose)
 
     if (stat(dev_name, &st) < 0) {
         if (verbose)
-            perror("chk_mpt_device: stat failed");
+            smp_perror("chk_mpt_device: stat failed");
         return 0;
     }
     if ((S_ISCHR(st.st_mode)) && (MPT_DEV_MAJOR == major(st.st_rdev))) {
@@ -74,15 +97,15 @@ chk_mpt_device(const char * dev_name, int verbose)
     }
     if (verbose) {
         if (S_ISCHR(st.st_mode))
-            fprintf(stderr, "chk_mpt_device: wanted char device "
-                    "major,minor=%d,[%d,%d,%d]\n    got=%d,%d\n",
-                    MPT_DEV_MAJOR, MPT_DEV_MINOR, MPT2_DEV_MINOR,
-                    MPT3_DEV_MINOR, major(st.st_rdev), minor(st.st_rdev));
+            pr2ws("chk_mpt_device: wanted char device "
+                  "major,minor=%d,[%d,%d,%d]\n    got=%d,%d\n",
+                  MPT_DEV_MAJOR, MPT_DEV_MINOR, MPT2_DEV_MINOR,
+                  MPT3_DEV_MINOR, major(st.st_rdev), minor(st.st_rdev));
         else
-            fprintf(stderr, "chk_mpt_device: wanted char device major,minor"
-                    "=%d,[%d,%d,%d]\n    but didn't get char device\n",
-                    MPT_DEV_MAJOR, MPT_DEV_MINOR, MPT2_DEV_MINOR,
-                    MPT3_DEV_MINOR);
+            pr2ws("chk_mpt_device: wanted char device major,minor"
+                  "=%d,[%d,%d,%d]\n    but didn't get char device\n",
+                  MPT_DEV_MAJOR, MPT_DEV_MINOR, MPT2_DEV_MINOR,
+                  MPT3_DEV_MINOR);
     }
     return 0;
 }
@@ -92,21 +115,10 @@ int
 open_mpt_device(const char * dev_name, int verbose)
 {
     int res;
-    struct stat st;
 
     res = open(dev_name, O_RDWR);
-    if (res < 0) {
-        if (verbose)
-            perror("open_mpt_device failed");
-    } else if (fstat(res, &st) >= 0) {
-        if ((S_ISCHR(st.st_mode)) && (MPT_DEV_MAJOR == major(st.st_rdev)) &&
-            ((MPT2_DEV_MINOR == minor(st.st_rdev)) ||
-             (MPT3_DEV_MINOR == minor(st.st_rdev))))
-            mptcommand = (int)MPT2COMMAND;
-        else
-            mptcommand = (int)MPTCOMMAND;
-    } else if (verbose)
-        perror("open_mpt_device: stat failed");
+    if ((res < 0) && verbose)
+        smp_perror("open_mpt_device failed");
     return res;
 }
 
@@ -117,6 +129,63 @@ close_mpt_device(int fd)
     return close(fd);
 }
 
+/* Part of interface to upper level. fd is from open_mpt_device(). Returns
+ * NULL if out of memory. */
+void *
+alloc_mpt_bufs(int fd, int verbose)
+{
+    uint numBytes;
+    struct mpt_bufs * mbp;
+    struct stat st;
+
+    numBytes = offsetof(SmpPassthroughRequest_t, SGL) +
+               (2 * sizeof(SGESimple64_t));
+    mbp = (struct mpt_bufs *)calloc(1, sizeof(*mbp));
+    if (NULL == mbp)
+        goto err_out;
+    mbp->blk = (mpiIoctlBlk_t *)calloc(1, sizeof(mpiIoctlBlk_t) + numBytes);
+    mbp->data_in = (char *)malloc(MPT_DATA_IN_LEN);
+    if ((NULL == mbp->blk) || (NULL == mbp->data_in)) {
+        free(mbp->blk);
+        free(mbp->data_in);
+        free(mbp);
+        goto err_out;
+    }
+    mbp->data_in_len = MPT_DATA_IN_LEN;
+    mbp->blk->replyFrameBufPtr = mbp->reply_m;
+    mbp->blk->maxReplyBytes = sizeof(mbp->reply_m);
+    mbp->blk->dataSgeOffset = offsetof(SmpPassthroughRequest_t, SGL) / 4;
+    mbp->mptcommand = (int)MPTCOMMAND;
+    if (fstat(fd, &st) >= 0) {
+        if ((S_ISCHR(st.st_mode)) && (MPT_DEV_MAJOR == major(st.st_rdev)) &&
+            ((MPT2_DEV_MINOR == minor(st.st_rdev)) ||
+             (MPT3_DEV_MINOR == minor(st.st_rdev))))
+            mbp->mptcommand = (int)MPT2COMMAND;
+    } else if (verbose)
+        smp_perror("alloc_mpt_bufs: stat failed");
+    pthread_mutex_init(&mbp->mtx, NULL);
+    return mbp;
+
+err_out:
+    if (verbose)
+        pr2ws("alloc_mpt_bufs: out of memory\n");
+    return NULL;
+}
+
+/* Part of interface to upper level. */
+void
+free_mpt_bufs(void * bufs)
+{
+    struct mpt_bufs * mbp = (struct mpt_bufs *)bufs;
+
+    if (mbp) {
+        pthread_mutex_destroy(&mbp->mtx);
+        free(mbp->data_in);
+        free(mbp->blk);
+        free(mbp);
+    }
+}
+
 
 /*****************************************************************
  *                                                               *
@@ -138,7 +207,8 @@ void SmpImmediateIoctl(int fd, int ioc_num);
  * SDI_IOC | 0x01 Ioctl Function.
  *****************************************************************/
 int
-issueMptCommand(int fd, int ioc_num, mpiIoctlBlk_t *mpiBlkPtr)
+issueMptCommand(int fd, int ioc_num, int mptcommand,
+                mpiIoctlBlk_t *mpiBlkPtr)
 {
         int status = -1;
 #if 0
@@ -155,7 +225,7 @@ issueMptCommand(int fd, int ioc_num, mpiIoctlBlk_t *mpiBlkPtr)
         mpiBlkPtr->hdr.port = 0;
 
         if (ioctl(fd, mptcommand, (char *) mpiBlkPtr) != 0)
-                perror("MPTCOMMAND or MPT2COMMAND ioctl failed");
+                smp_perror("MPTCOMMAND or MPT2COMMAND ioctl failed");
         else {
 #if 0
                 MPIDefaultReply_t *pReply = NULL;
@@ -184,58 +254,60 @@ issueMptCommand(int fd, int ioc_num, mpiIoctlBlk_t *mpiBlkPtr)
         return status;
 }
 
-/* Part of interface to upper level. */
+/* Part of interface to upper level. bufs is from alloc_mpt_bufs(). */
 int
 send_req_mpt(int fd, int subvalue, const unsigned char * target_sa,
-             struct smp_req_resp * rresp, int verbose)
+             void * bufs, struct smp_req_resp * rresp, int verbose)
 {
-        mpiIoctlBlk_t * mpiBlkPtr = NULL;
+        struct mpt_bufs * mbp = (struct mpt_bufs *)bufs;
+        mpiIoctlBlk_t * mpiBlkPtr;
         pSmpPassthroughRequest_t smpReq;
         pSmpPassthroughReply_t smpReply;
-        uint numBytes;
-        int  k, status;
-        char reply_m[1200];
+        int  k, status, in_len;
         u16     ioc_stat;
         unsigned char * ucp;
         int ret = -1;
 
+        if (NULL == mbp)
+                return -1;
         if (verbose && (0 == memcmp(target_sa, null_sas_addr, 8))) {
-                fprintf(stderr, "The MPT interface typically needs SAS "
-                        "address of target (e.g. expander).\n");
-                fprintf(stderr, "A '--sa=SAS_ADDR' command line option "
-                        "may be required. See man page.\n");
+                pr2ws("The MPT interface typically needs SAS "
+                      "address of target (e.g. expander).\n");
+                pr2ws("A '--sa=SAS_ADDR' command line option "
+                      "may be required. See man page.\n");
         }
         if (verbose > 2) {
-                fprintf(stderr, "send_req_mpt: subvalue=%d  ", subvalue);
-                fprintf(stderr, "SAS address=0x");
+                pr2ws("send_req_mpt: subvalue=%d  ", subvalue);
+                pr2ws("SAS address=0x");
                 for (k = 0; k < 8; ++k)
-                        fprintf(stderr, "%02x", target_sa[7 - k]);
-                fprintf(stderr, "\n");
+                        pr2ws("%02x", target_sa[7 - k]);
+                pr2ws("\n");
                 if (verbose > 3)
-                        fprintf(stderr, "    mptctl two scatter gather list "
-                                "interface\n");
+                        pr2ws("    mptctl two scatter gather list "
+                              "interface\n");
         }
-        numBytes = offsetof(SmpPassthroughRequest_t, SGL) +
-                   (2 * sizeof(SGESimple64_t));
-        mpiBlkPtr = (mpiIoctlBlk_t *)malloc(sizeof(mpiIoctlBlk_t) + numBytes);
-        if (mpiBlkPtr == NULL)
-                goto err_out;
-        memset(mpiBlkPtr, 0, sizeof(mpiIoctlBlk_t) + numBytes);
-        mpiBlkPtr->replyFrameBufPtr = reply_m;
-        memset(mpiBlkPtr->replyFrameBufPtr, 0, sizeof(reply_m));
-        mpiBlkPtr->maxReplyBytes = sizeof(reply_m);
+        in_len = rresp->max_response_len + 4;
+        pthread_mutex_lock(&mbp->mtx);
+        if (in_len > mbp->data_in_len) {        /* larger than any SMP frame */
+                char * p = (char *)realloc(mbp->data_in, in_len);
+
+                if (NULL == p)
+                        goto err_out;
+                mbp->data_in = p;
+                mbp->data_in_len = in_len;
+        }
+        mpiBlkPtr = mbp->blk;
         smpReq = (pSmpPassthroughRequest_t)mpiBlkPtr->MF;
-        mpiBlkPtr->dataSgeOffset = offsetof(SmpPassthroughRequest_t, SGL) / 4;
         smpReply = (pSmpPassthroughReply_t)mpiBlkPtr->replyFrameBufPtr;
+        /* only the reply header is looked at, no need to clear all 1200 */
+        memset(smpReply, 0, sizeof(*smpReply));
 
         /* send smp request */
         mpiBlkPtr->dataOutSize = rresp->request_len - 4;
         mpiBlkPtr->dataOutBufPtr = (char *)rresp->request;
-        mpiBlkPtr->dataInSize = rresp->max_response_len + 4;
-        mpiBlkPtr->dataInBufPtr = (char *)malloc(mpiBlkPtr->dataInSize);
-        if(mpiBlkPtr->dataInBufPtr == NULL)
-                goto err_out;
-        memset(mpiBlkPtr->dataInBufPtr, 0, mpiBlkPtr->dataInSize);
+        mpiBlkPtr->dataInSize = in_len;
+        mpiBlkPtr->dataInBufPtr = mbp->data_in;
+        memset(mpiBlkPtr->dataInBufPtr, 0, in_len);
 
         /* Populate the SMP Request
          */
@@ -252,10 +324,10 @@ send_req_mpt(int fd, int subvalue, const unsigned char * target_sa,
         ucp = (unsigned char *)&smpReq->SASAddress;
         memcpy(ucp, target_sa, 8);
 
-        status = issueMptCommand(fd, subvalue, mpiBlkPtr);
+        status = issueMptCommand(fd, subvalue, mbp->mptcommand, mpiBlkPtr);
 
         if (status != 0) {
-                fprintf(stderr, "ioctl failed\n");
+                pr2ws("ioctl failed\n");
                 goto err_out;
         }
 
@@ -265,76 +337,76 @@ send_req_mpt(int fd, int subvalue, const unsigned char * target_sa,
                 if (verbose) {
                         switch(smpReply->SASStatus) {
                         case MPI_SASSTATUS_UNKNOWN_ERROR:
-                                fprintf(stderr, "Unknown SAS (SMP) error\n");
+                                pr2ws("Unknown SAS (SMP) error\n");
                                 break;
                         case MPI_SASSTATUS_INVALID_FRAME:
-                                fprintf(stderr, "Invalid frame\n");
+                                pr2ws("Invalid frame\n");
                                 break;
                         case MPI_SASSTATUS_UTC_BAD_DEST:
-                                fprintf(stderr, "Unable to connect (bad "
-                                        "destination)\n");
+                                pr2ws("Unable to connect (bad "
+                                      "destination)\n");
                                 break;
                         case MPI_SASSTATUS_UTC_BREAK_RECEIVED:
-                                fprintf(stderr, "Unable to connect (break "
-                                        "received)\n");
+                                pr2ws("Unable to connect (break "
+                                      "received)\n");
                                 break;
                         case MPI_SASSTATUS_UTC_CONNECT_RATE_NOT_SUPPORTED:
-                                fprintf(stderr, "Unable to connect (connect "
-                                        "rate not supported)\n");
+                                pr2ws("Unable to connect (connect "
+                                      "rate not supported)\n");
                                 break;
                         case MPI_SASSTATUS_UTC_PORT_LAYER_REQUEST:
-                                fprintf(stderr, "Unable to connect (port "
-                                        "layer request)\n");
+                                pr2ws("Unable to connect (port "
+                                      "layer request)\n");
                                 break;
                         case MPI_SASSTATUS_UTC_PROTOCOL_NOT_SUPPORTED:
-                                fprintf(stderr, "Unable to connect (protocol "
-                                        "(SMP target) not supported)\n");
+                                pr2ws("Unable to connect (protocol "
+                                      "(SMP target) not supported)\n");
                                 break;
                         case MPI_SASSTATUS_UTC_WRONG_DESTINATION:
-                                fprintf(stderr, "Unable to connect (wrong "
-                                        "destination)\n");
+                                pr2ws("Unable to connect (wrong "
+                                      "destination)\n");
                                 break;
                         case MPI_SASSTATUS_SHORT_INFORMATION_UNIT:
-                                fprintf(stderr, "Short information unit\n");
+                                pr2ws("Short information unit\n");
                                 break;
                         case MPI_SASSTATUS_DATA_INCORRECT_DATA_LENGTH:
-                                fprintf(stderr, "Incorrect data length\n");
+                                pr2ws("Incorrect data length\n");
                                 break;
                         case MPI_SASSTATUS_INITIATOR_RESPONSE_TIMEOUT:
-                                fprintf(stderr, "Initiator response "
-                                        "timeout\n");
+                                pr2ws("Initiator response "
+                                      "timeout\n");
                                 break;
                         default:
                                 if (smpReply->SASStatus !=
                                     MPI_SASSTATUS_SUCCESS) {
-                                        fprintf(stderr, "Unrecognized SAS "
-                                                "(SMP) error 0x%x\n",
-                                                smpReply->SASStatus);
+                                        pr2ws("Unrecognized SAS "
+                                              "(SMP) error 0x%x\n",
+                                              smpReply->SASStatus);
                                         break;
                                 }
                                 if (smpReply->IOCStatus ==
                                     MPI_IOCSTATUS_SAS_SMP_REQUEST_FAILED)
-                                        fprintf(stderr, "SMP request failed "
-                                                "(IOCStatus)\n");
+                                        pr2ws("SMP request failed "
+                                              "(IOCStatus)\n");
                                 else if (smpReply->IOCStatus ==
                                          MPI_IOCSTATUS_SAS_SMP_DATA_OVERRUN)
-                                        fprintf(stderr, "SMP data overrun "
-                                                "(IOCStatus)\n");
+                                        pr2ws("SMP data overrun "
+                                              "(IOCStatus)\n");
                                 else if (smpReply->IOCStatus ==
                                          MPI_IOCSTATUS_SCSI_DEVICE_NOT_THERE)
-                                        fprintf(stderr, "Device not there "
-                                                "(IOCStatus)\n");
+                                        pr2ws("Device not there "
+                                              "(IOCStatus)\n");
                                 else
-                                        fprintf(stderr, "IOCStatus=0x%x\n",
-                                                smpReply->IOCStatus);
+                                        pr2ws("IOCStatus=0x%x\n",
+                                              smpReply->IOCStatus);
                         }
                 }
                 if (verbose > 1)
-                        fprintf(stderr, "IOCStatus=0x%X IOCLogInfo=0x%X "
-                                "SASStatus=0x%X\n",
-                                smpReply->IOCStatus,
-                                smpReply->IOCLogInfo,
-                                smpReply->SASStatus);
+                        pr2ws("IOCStatus=0x%X IOCLogInfo=0x%X "
+                              "SASStatus=0x%X\n",
+                              smpReply->IOCStatus,
+                              smpReply->IOCLogInfo,
+                              smpReply->SASStatus);
         } else
                 ret = 0;
 
@@ -343,11 +415,7 @@ send_req_mpt(int fd, int subvalue, const unsigned char * target_sa,
         rresp->act_response_len = -1;
 
 err_out:
-        if (mpiBlkPtr) {
-                if (mpiBlkPtr->dataInBufPtr)
-                        free(mpiBlkPtr->dataInBufPtr);
-                free(mpiBlkPtr);
-        }
+        pthread_mutex_unlock(&mbp->mtx);
         return ret;
 }
 
@@ -408,7 +476,7 @@ SmpTwoSGLsIoctl(int fd, int ioc_num)
         smpReq->Function = MPI_FUNCTION_SMP_PASSTHROUGH;
         memcpy(&smpReq->SASAddress, expanderSasAddr, 8);
 
-        status = issueMptCommand(fd, ioc_num, mpiBlkPtr);
+        status = issueMptCommand(fd, ioc_num, (int)MPTCOMMAND, mpiBlkPtr);
 
         if (status != 0) {
                 printf("ioctl failed\n");
@@ -485,7 +553,7 @@ SmpImmediateIoctl(int fd, int ioc_num)
         memcpy(&smpReq->SASAddress,expanderSasAddr,8);
         memcpy(&smpReq->SGL,smp_request,sizeof(smp_request));
 
-        status = issueMptCommand(fd, ioc_num, mpiBlkPtr);
+        status = issueMptCommand(fd, ioc_num, (int)MPTCOMMAND, mpiBlkPtr);
 
         if (status != 0) {
                 printf("ioctl failed\n");
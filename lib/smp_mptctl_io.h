@@ -11,7 +11,13 @@ extern int open_mpt_device(const char * dev_name, int verbose);
 
 extern int close_mpt_device(int fd);
 
+/* Per target buffers for send_req_mpt(), NULL if out of memory */
+extern void * alloc_mpt_bufs(int fd, int verbose);
+
+extern void free_mpt_bufs(void * bufs);
+
 extern int send_req_mpt(int fd, int subvalue, const unsigned char * target_sa,
-                        struct smp_req_resp * rresp, int verbose);
+                        void * bufs, struct smp_req_resp * rresp,
+                        int verbose);
 
 #endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_pr2serr.h"
+
+/* Request timeout and retry policy, held in each target object. An
+ * expander answers BUSY when its SMP processor can not take another
+ * request (e.g. while busy with I/O or other initiators); smp_send_req()
+ * waits and sends again, backing off exponentially with random jitter so
+ * that several initiators backing off together spread out. A timeout is
+ * retried only when the caller set a timeout, since the pass-throughs'
+ * defaults are long (20 seconds for bsg) and a hung expander should not
+ * stall a scan for several times that. */
+
+#define DEF_RETRIES 2
+#define DEF_BACKOFF_MS 10
+#define MAX_BACKOFF_MS 2000
+
+
+void
+smp_req_policy_init(struct smp_target_obj * tobj)
+{
+    int n;
+    const char * cp;
+
+    if (NULL == tobj)
+        return;
+    tobj->timeout_ms = 0;
+    tobj->max_retries = DEF_RETRIES;
+    tobj->backoff_ms = DEF_BACKOFF_MS;
+    if ((cp = getenv("SMP_UTILS_TIMEOUT")) && ((n = smp_get_num(cp)) >= 0))
+        tobj->timeout_ms = n;
+    else if (cp)
+        pr2ws("SMP_UTILS_TIMEOUT: '%s' not a number of milliseconds, "
+              "ignored\n", cp);
+    if ((cp = getenv("SMP_UTILS_RETRIES")) && ((n = smp_get_num(cp)) >= 0))
+        tobj->max_retries = n;
+    else if (cp)
+        pr2ws("SMP_UTILS_RETRIES: '%s' not a number, ignored\n", cp);
+    smp_admit_attach(tobj);
+}
+
+int
+smp_set_req_policy(struct smp_target_obj * tobj, int timeout_ms,
+                   int max_retries, int backoff_ms)
+{
+    if (NULL == tobj)
+        return -1;
+    if (timeout_ms >= 0)
+        tobj->timeout_ms = timeout_ms;
+    if (max_retries >= 0)
+        tobj->max_retries = max_retries;
+    if (backoff_ms >= 0)
+        tobj->backoff_ms = backoff_ms;
+    return 0;
+}
+
+bool
+smp_req_retry(const struct smp_target_obj * tobj,
+              const struct smp_req_resp * rresp, int res, bool timed_out,
+              int attempt, int verbose)
+{
+    bool busy;
+    int ms;
+    unsigned int seed;
+    const uint8_t * rp;
+    struct timespec ts;
+
+    if ((NULL == tobj) || (NULL == rresp) || (attempt >= tobj->max_retries))
+        return false;
+    rp = rresp->response;
+    busy = (0 == res) && (0 == rresp->transport_err) && rp &&
+           ((rresp->act_response_len < 0) || (rresp->act_response_len > 2)) &&
+           (SMP_FRAME_TYPE_RESP == rp[0]) && (SMP_FRES_BUSY == rp[2]);
+    if (! (busy || (timed_out && (tobj->timeout_ms > 0))))
+        return false;
+    ms = tobj->backoff_ms;
+    for ( ; (attempt > 0) && (ms < MAX_BACKOFF_MS); --attempt)
+        ms *= 2;
+    if (ms > MAX_BACKOFF_MS)
+        ms = MAX_BACKOFF_MS;
+    if (ms > 1) {               /* jitter: somewhere from ms/2 to ms */
+        seed = (unsigned int)smp_stats_clock_us();
+        ms = (ms / 2) + (rand_r(&seed) % ((ms / 2) + 1));
+    }
+    if (verbose)
+        pr2ws("smp_send_req: %s, retry in %d ms\n",
+              (busy ? "expander BUSY" : "timed out"), ms);
+    if (ms > 0) {
+        ts.tv_sec = ms / 1000;
+        ts.tv_nsec = (ms % 1000) * 1000000;
+        while ((nanosleep(&ts, &ts) < 0) && (EINTR == errno))
+            ;
+    }
+    return true;
+}
@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* REPORT GENERAL cache. Nearly every utility starts with a REPORT GENERAL
+ * (if only to find the number of phys) and a topology scan sends one to
+ * each expander, often more than once. The decoded response is kept on the
+ * target object. Most SAS-2 (and later) responses carry the expander change
+ * count in bytes 4 and 5, so smp_send_req() passes every response it sees
+ * to smp_rg_cache_note() which discards the cached copy when that count
+ * moves. Any REPORT GENERAL response seen is also cached, so a utility
+ * that issues its own still saves the next caller a round-trip. The mutex
+ * is needed since smp_send_req_batch() sends from several threads. */
+
+struct smp_rg_cache {
+    bool valid;
+    uint64_t when_ms;           /* CLOCK_MONOTONIC when response arrived */
+    pthread_mutex_t mtx;
+    struct smp_report_general rg;
+};
+
+
+static uint64_t
+mono_ms(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        return 0;
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/* Returns response length in bytes excluding the CRC, or -1 if rrp does
+ * not hold a plausible SMP response. */
+static int
+resp_len(const struct smp_req_resp * rrp)
+{
+    int len;
+    const uint8_t * rp = rrp->response;
+
+    if ((NULL == rp) || rrp->transport_err ||
+        ((rrp->act_response_len >= 0) && (rrp->act_response_len < 4)))
+        return -1;
+    if (SMP_FRAME_TYPE_RESP != rp[0])
+        return -1;
+    len = rp[3];
+    if ((0 == len) && (0 == rp[2])) {
+        len = smp_get_func_def_resp_len(rp[1]);
+        if (len < 0)
+            len = 0;
+    }
+    len = 4 + (len * 4);        /* length in bytes, excluding 4 byte CRC */
+    if ((rrp->act_response_len >= 0) && (len > rrp->act_response_len))
+        len = rrp->act_response_len;
+    if (len > (rrp->max_response_len - 4))
+        len = rrp->max_response_len - 4;
+    return (len < 4) ? -1 : len;
+}
+
+void
+smp_decode_report_general(const uint8_t * rp, int len,
+                          struct smp_report_general * rgp)
+{
+    uint8_t b[SMP_REPORT_GENERAL_RESP_LEN];
+
+    memset(rgp, 0, sizeof(*rgp));
+    if (len > (SMP_REPORT_GENERAL_RESP_LEN - 4))
+        len = SMP_REPORT_GENERAL_RESP_LEN - 4;
+    memset(b, 0, sizeof(b));
+    memcpy(b, rp, len);         /* so fields past len decode as zero */
+    memcpy(rgp->resp, rp, len);
+    rgp->resp_len = len;
+    rgp->sas2 = !! b[3];
+    rgp->exp_change_count = sg_get_unaligned_be16(b + 4);
+    rgp->exp_route_indexes = sg_get_unaligned_be16(b + 6);
+    rgp->long_response = !! (b[8] & 0x80);
+    rgp->num_phys = b[9];
+    rgp->table_to_table_sup = !! (b[10] & 0x80);
+    rgp->zone_configuring = !! (b[10] & 0x40);
+    rgp->self_configuring = !! (b[10] & 0x20);
+    rgp->configures_others = !! (b[10] & 0x4);
+    rgp->configuring = !! (b[10] & 0x2);
+    rgp->ext_config_route_table = !! (b[10] & 0x1);
+    rgp->enclosure_logical_id = sg_get_unaligned_be64(b + 12);
+    rgp->num_zone_groups = (b[36] & 0x40) ? 256 : 128;
+    rgp->zone_locked = !! (b[36] & 0x10);
+    rgp->phys_presence_sup = !! (b[36] & 0x8);
+    rgp->phys_presence_asserted = !! (b[36] & 0x4);
+    rgp->zoning_supported = !! (b[36] & 0x2);
+    rgp->zoning_enabled = !! (b[36] & 0x1);
+    rgp->max_routed_sas_addrs = sg_get_unaligned_be16(b + 38);
+    rgp->active_zm_sas_addr = sg_get_unaligned_be64(b + 40);
+}
+
+struct smp_rg_cache *
+smp_rg_cache_get(struct smp_target_obj * tobj)
+{
+    struct smp_rg_cache * cp;
+
+    if (NULL == tobj)
+        return NULL;
+    if (tobj->rgcp)
+        return tobj->rgcp;
+    cp = (struct smp_rg_cache *)calloc(1, sizeof(*cp));
+    if (NULL == cp)
+        return NULL;
+    pthread_mutex_init(&cp->mtx, NULL);
+    tobj->rgcp = cp;
+    return cp;
+}
+
+void
+smp_rg_cache_free(struct smp_target_obj * tobj)
+{
+    if (tobj && tobj->rgcp) {
+        pthread_mutex_destroy(&tobj->rgcp->mtx);
+        free(tobj->rgcp);
+        tobj->rgcp = NULL;
+    }
+}
+
+void
+smp_rg_cache_invalidate(const struct smp_target_obj * tobj)
+{
+    struct smp_rg_cache * cp;
+
+    if ((NULL == tobj) || (NULL == (cp = tobj->rgcp)))
+        return;
+    pthread_mutex_lock(&cp->mtx);
+    cp->valid = false;
+    pthread_mutex_unlock(&cp->mtx);
+}
+
+void
+smp_rg_cache_note(const struct smp_target_obj * tobj,
+                  const struct smp_req_resp * rresp)
+{
+    int len, func;
+    const uint8_t * rp;
+    struct smp_rg_cache * cp;
+
+    if ((NULL == tobj) || (NULL == (cp = tobj->rgcp)) || (NULL == rresp))
+        return;
+    if ((len = resp_len(rresp)) < 0)
+        return;
+    rp = rresp->response;
+    func = rp[1];
+    pthread_mutex_lock(&cp->mtx);
+    if (func >= SMP_FN_CONFIG_GENERAL) {
+        /* configure functions may change what REPORT GENERAL reports */
+        if ((SMP_FN_WRITE_GPIO_REG != func) &&
+            (SMP_FN_WRITE_GPIO_REG_ENH != func) &&
+            ((SMP_FRES_FUNCTION_ACCEPTED == rp[2]) ||
+             (SMP_FRES_INVALID_EXP_CHANGE_COUNT == rp[2])))
+            cp->valid = false;
+    } else if (rp[2] || (0 == rp[3]) || (len < 6))
+        ;       /* failed, or SAS-1.1 format without expander change count */
+    else if (SMP_FN_REPORT_GENERAL == func) {
+        smp_decode_report_general(rp, len, &cp->rg);
+        cp->when_ms = mono_ms();
+        cp->valid = true;
+    } else if ((SMP_FN_READ_GPIO_REG != func) &&
+               (SMP_FN_READ_GPIO_REG_ENH != func) && cp->valid &&
+               (sg_get_unaligned_be16(rp + 4) != cp->rg.exp_change_count))
+        cp->valid = false;
+    pthread_mutex_unlock(&cp->mtx);
+}
+
+int
+smp_get_report_general(struct smp_target_obj * tobj,
+                       struct smp_report_general * rgp, int max_age_ms,
+                       int verbose)
+{
+    bool hit = false;
+    int len, res, k;
+    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_REPORT_GENERAL, 0, 0,
+                         0, 0, 0, 0};
+    struct smp_rg_cache * cp;
+    struct smp_req_resp smp_rr;
+    uint8_t rp[SMP_REPORT_GENERAL_RESP_LEN];
+    char b[128];
+
+    if ((NULL == tobj) || (0 == tobj->opened) || (NULL == rgp))
+        return -1;
+    cp = smp_rg_cache_get(tobj);
+    if (cp && (0 != max_age_ms)) {
+        pthread_mutex_lock(&cp->mtx);
+        if (cp->valid &&
+            ((max_age_ms < 0) ||
+             ((mono_ms() - cp->when_ms) <= (uint64_t)max_age_ms))) {
+            memcpy(rgp, &cp->rg, sizeof(*rgp));
+            hit = true;
+        }
+        pthread_mutex_unlock(&cp->mtx);
+        if (hit) {
+            if (verbose > 2)
+                pr2ws("%s: from cache, expander change count=%u\n",
+                      __func__, rgp->exp_change_count);
+            return 0;
+        }
+    }
+    len = (SMP_REPORT_GENERAL_RESP_LEN - 8) / 4;
+    smp_req[2] = (len < 0x100) ? len : 0xff;
+    if (verbose) {
+        pr2ws("    Report general request: ");
+        for (k = 0; k < (int)sizeof(smp_req); ++k)
+            pr2ws("%02x ", smp_req[k]);
+        pr2ws("\n");
+    }
+    memset(rp, 0, sizeof(rp));
+    memset(&smp_rr, 0, sizeof(smp_rr));
+    smp_rr.request_len = sizeof(smp_req);
+    smp_rr.request = smp_req;
+    smp_rr.max_response_len = sizeof(rp);
+    smp_rr.response = rp;
+    /* a successful response is decoded into the cache by smp_send_req() */
+    res = smp_send_req(tobj, &smp_rr, verbose);
+    if (res) {
+        if (verbose)
+            pr2ws("RG smp_send_req failed, res=%d\n", res);
+        return -1;
+    }
+    if (smp_rr.transport_err) {
+        if (verbose)
+            pr2ws("RG smp_send_req transport_error=%d\n",
+                  smp_rr.transport_err);
+        return -1;
+    }
+    if ((len = resp_len(&smp_rr)) < 0) {
+        if (verbose)
+            pr2ws("RG response malformed\n");
+        return SMP_LIB_CAT_MALFORMED;
+    }
+    if (rp[1] != smp_req[1]) {
+        if (verbose)
+            pr2ws("RG Expected function code=0x%x, got=0x%x\n",
+                  smp_req[1], rp[1]);
+        return SMP_LIB_CAT_MALFORMED;
+    }
+    if (rp[2]) {
+        if (verbose > 1)
+            pr2ws("Report General result: %s\n",
+                  smp_get_func_res_str(rp[2], sizeof(b), b));
+        return rp[2];
+    }
+    smp_decode_report_general(rp, len, rgp);
+    if (verbose > 2)
+        pr2ws("%s: len=%d, number of phys: %u, expander change count=%u\n",
+              __func__, len, rgp->num_phys, rgp->exp_change_count);
+    return 0;
+}
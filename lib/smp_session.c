@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+
+/* A session lets a program that runs several utilities in the one process
+ * (e.g. smp_shell) open the SMP target once. While a session target is
+ * registered, smp_initiator_open() of the same device returns a copy of
+ * the session's target object rather than probing and opening the device
+ * again, and smp_initiator_close() of such a copy leaves the device open.
+ * The copies share the session target's REPORT GENERAL cache but not its
+ * buffer arena (see smp_buf_get() ).
+ * Only one session can be active at a time. */
+
+static struct smp_target_obj * session_tobj;
+
+
+int
+smp_session_begin(struct smp_target_obj * tobj)
+{
+    if ((NULL == tobj) || (0 == tobj->opened) || session_tobj)
+        return -1;
+    /* so that each copy shares the one REPORT GENERAL cache */
+    smp_rg_cache_get(tobj);
+    session_tobj = tobj;
+    return 0;
+}
+
+void
+smp_session_end(void)
+{
+    session_tobj = NULL;
+}
+
+bool
+smp_session_lookup(const char * device_name, int subvalue, uint64_t sa,
+                   struct smp_target_obj * tobj)
+{
+    const struct smp_target_obj * stp = session_tobj;
+
+    if ((NULL == stp) || (NULL == device_name) || (NULL == tobj))
+        return false;
+    if (sa && (sa != sg_get_unaligned_be64(stp->sas_addr)))
+        return false;
+    /* an empty device_name with a SAS address is an open by SAS address */
+    if (('\0' == device_name[0]) ? (0 == sa) :
+        (strcmp(device_name, stp->device_name) ||
+         (subvalue != stp->subvalue)))
+        return false;
+    memcpy(tobj, stp, sizeof(*tobj));
+    /* each copy cuts its buffers from its own arena, freed when it is
+     * closed, so the owner's is never freed under it */
+    tobj->arenap = NULL;
+    return true;
+}
+
+bool
+smp_session_member(const struct smp_target_obj * tobj)
+{
+    const struct smp_target_obj * stp = session_tobj;
+
+    if ((NULL == stp) || (NULL == tobj) || (tobj == stp))
+        return false;
+    return (tobj->fd == stp->fd) && (tobj->vp == stp->vp) &&
+           (0 == strcmp(tobj->device_name, stp->device_name));
+}
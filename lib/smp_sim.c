@@ -0,0 +1,1032 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* Simulated expanders, selected with the "sim" interface. smp_sim_open()
+ * builds (on first use of a SMP_DEVICE name) a domain of expanders held in
+ * memory: a root expander with 'exp' child expanders attached to its last
+ * phys, each of those with their own children down to 'depth' levels, and
+ * a SAS end device (SSP target) on every other phy. Requests sent to it
+ * are answered by smp_sim_send_req() from that model. Route tables, zoning
+ * state, the zone permission table, phy zone groups and phy state
+ * (disabled or not, under test or not, phy event sources) are kept, so
+ * configure functions change later responses, and persist for the life of
+ * the process. As in an expander, the zone configure functions need a ZONE
+ * LOCK first. A latency can be added to each request and a percentage of
+ * requests answered with BUSY, to exercise the library's batching and
+ * retry logic. The parameters follow "sim" in the --interface= option,
+ * separated by commas (e.g. "sim,phys=36,exp=4"). */
+
+#define SIM_DEF_PHYS 12
+#define SIM_MAX_PHYS 254
+#define SIM_MAX_EXP 256
+#define SIM_MAX_DOMAINS 16
+#define SIM_MAX_ROUTES 1024
+#define SIM_NUM_ZG 128
+#define SIM_RESP_MAX 1032       /* largest SMP response, including CRC */
+#define SIM_DEF_LRATE 0xb       /* 12 Gbps */
+#define SIM_GPIO_TX_REGS ((SIM_MAX_PHYS + 3) / 4)
+#define SIM_SCS_MAX 256         /* self-configuration status descriptors */
+#define SIM_PES_MAX 8           /* phy event sources per phy */
+
+struct sim_route {
+    bool disabled;
+    uint64_t sa;
+};
+
+struct sim_phy {
+    bool disabled;
+    bool sata;                  /* attached end device is a SATA device */
+    bool testing;               /* phy test function in progress */
+    uint8_t att_dev_type;       /* 0: none, 1: end device, 2: expander */
+    uint8_t att_phy_id;
+    uint8_t routing_attr;       /* 0: direct, 1: subtractive, 2: table */
+    uint8_t change_count;
+    uint8_t zone_group;
+    uint16_t bcast_cnt;         /* Broadcast (Change) originated */
+    uint32_t err_cnt[4];        /* REPORT PHY ERROR LOG counters */
+    uint8_t num_pes;            /* set by CONFIGURE PHY EVENT */
+    uint8_t pes[SIM_PES_MAX];
+    uint32_t pes_thres[SIM_PES_MAX];
+    uint64_t att_sa;
+    uint64_t pulled_sa;         /* end device removed by pull=N */
+};
+
+struct sim_scs {                /* self-configuration status descriptor */
+    uint8_t status;
+    uint8_t phy_id;
+    uint16_t index;             /* 1 to 65535 then back to 1 */
+    uint64_t sa;
+};
+
+struct sim_domain;
+
+struct sim_exp {
+    bool zoning_enabled;
+    bool zone_locked;
+    uint16_t exp_cc;
+    int depth;
+    uint64_t sa;
+    struct sim_domain * dp;
+    struct sim_phy phys[SIM_MAX_PHYS];
+    struct sim_route * routes;  /* num_routes per phy, NULL if none */
+    uint8_t zperm[SIM_NUM_ZG][SIM_NUM_ZG / 8];
+    uint8_t gpio_tx[SIM_GPIO_TX_REGS * 4];  /* SFF-8485 GPIO_TX registers */
+    int inflight;               /* requests being answered, see cap=N */
+    uint32_t scs_seq;           /* number of descriptors ever recorded */
+    struct sim_scs scs[SIM_SCS_MAX];        /* ring, oldest overwritten */
+};
+
+struct sim_domain {
+    char name[SMP_MAX_DEVICE_NAME];
+    int subvalue;
+    int num_phys;
+    int num_exps;
+    int lat_us;
+    int busy_pct;
+    int cap;                    /* BUSY when more in flight, 0 -> no cap */
+    int pull_every;
+    int num_reqs;
+    int num_routes;
+    bool sata;                  /* SATA devices on odd numbered phys */
+    unsigned int seed;
+    pthread_mutex_t mtx;
+    struct sim_exp * exps[SIM_MAX_EXP];
+};
+
+static pthread_mutex_t sim_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct sim_domain * sim_domains[SIM_MAX_DOMAINS];
+static int sim_num_domains;
+
+
+/* Parses "sim[,KEY=VAL]..." into dp. Returns 0 if ok, else -1. */
+static int
+parse_params(const char * i_params, struct sim_domain * dp, int * num_exp,
+             int * depth, bool * zoning)
+{
+    int n;
+    const char * cp;
+    const char * ep;
+    char b[64];
+
+    dp->num_phys = SIM_DEF_PHYS;
+    *num_exp = 0;
+    *depth = 0;
+    *zoning = false;
+    for (cp = strchr(i_params, ','); cp; cp = ep) {
+        ++cp;
+        ep = strchr(cp, ',');
+        n = ep ? (ep - cp) : (int)strlen(cp);
+        if ((n < 1) || (n >= (int)sizeof(b)))
+            goto bad;
+        memcpy(b, cp, n);
+        b[n] = '\0';
+        if (0 == strcmp("zoning", b))
+            *zoning = true;
+        else if (0 == strcmp("sata", b))
+            dp->sata = true;
+        else if (0 == strncmp("for", b, 3))
+            ;   /* 'force' means nothing here */
+        else if (0 == strncmp("phys=", b, 5)) {
+            dp->num_phys = smp_get_num(b + 5);
+            if ((dp->num_phys < 1) || (dp->num_phys > SIM_MAX_PHYS))
+                goto bad;
+        } else if (0 == strncmp("exp=", b, 4)) {
+            if ((*num_exp = smp_get_num(b + 4)) < 0)
+                goto bad;
+        } else if (0 == strncmp("depth=", b, 6)) {
+            if ((*depth = smp_get_num(b + 6)) < 0)
+                goto bad;
+        } else if (0 == strncmp("lat=", b, 4)) {
+            if ((dp->lat_us = smp_get_num(b + 4)) < 0)
+                goto bad;
+        } else if (0 == strncmp("busy=", b, 5)) {
+            dp->busy_pct = smp_get_num(b + 5);
+            if ((dp->busy_pct < 0) || (dp->busy_pct > 100))
+                goto bad;
+        } else if (0 == strncmp("cap=", b, 4)) {
+            if ((dp->cap = smp_get_num(b + 4)) < 0)
+                goto bad;
+        } else if (0 == strncmp("pull=", b, 5)) {
+            if ((dp->pull_every = smp_get_num(b + 5)) < 1)
+                goto bad;
+        } else if (0 == strncmp("routes=", b, 7)) {
+            dp->num_routes = smp_get_num(b + 7);
+            if ((dp->num_routes < 0) || (dp->num_routes > SIM_MAX_ROUTES))
+                goto bad;
+        } else
+            goto bad;
+    }
+    if (*num_exp && (0 == *depth))
+        *depth = 1;
+    /* a child needs its upstream phy and at least one other */
+    if (*num_exp > (dp->num_phys - 2))
+        goto bad;
+    return 0;
+bad:
+    pr2ws("sim: bad interface parameters: %s\n", i_params);
+    pr2ws("    expect sim[,phys=N][,exp=K][,depth=D][,lat=US][,busy=PCT]"
+          "[,cap=N]\n        [,pull=N][,routes=R][,sata][,zoning]\n");
+    return -1;
+}
+
+/* Joins phy pp of expander ep to phy cp of expander cep */
+static void
+link_exps(struct sim_exp * ep, int pp, struct sim_exp * cep, int cp)
+{
+    ep->phys[pp].att_dev_type = 2;
+    ep->phys[pp].att_sa = cep->sa;
+    ep->phys[pp].att_phy_id = cp;
+    ep->phys[pp].routing_attr = 2;
+    cep->phys[cp].att_dev_type = 2;
+    cep->phys[cp].att_sa = ep->sa;
+    cep->phys[cp].att_phy_id = pp;
+    cep->phys[cp].routing_attr = 1;
+}
+
+/* Fills the route table of each phy attached to a child expander with
+ * the SAS addresses attached to that child's other phys, as a self
+ * configuring expander would */
+static void
+prime_routes(struct sim_domain * dp)
+{
+    int k, p, q, n;
+    const struct sim_exp * cep;
+    struct sim_exp * ep;
+    struct sim_route * rtp;
+
+    for (k = 0; k < dp->num_exps; ++k) {
+        ep = dp->exps[k];
+        for (p = 0; p < dp->num_phys; ++p) {
+            if ((2 != ep->phys[p].att_dev_type) ||
+                (2 != ep->phys[p].routing_attr))
+                continue;
+            cep = dp->exps[(ep->phys[p].att_sa >> 8) & 0xff];
+            rtp = ep->routes + (p * dp->num_routes);
+            for (n = 0, q = 1; (q < dp->num_phys) && (n < dp->num_routes);
+                 ++q) {
+                if (cep->phys[q].att_dev_type) {
+                    rtp[n].disabled = false;
+                    rtp[n++].sa = cep->phys[q].att_sa;
+                }
+            }
+        }
+    }
+}
+
+/* Builds the domain for device_name. Returns NULL on failure. Called with
+ * sim_mtx held. */
+static struct sim_domain *
+build_domain(const char * device_name, int subvalue, const char * i_params)
+{
+    bool zoning;
+    int k, j, p, num_exp, depth, first_child;
+    uint32_t h;
+    uint64_t base;
+    const char * cp;
+    struct sim_domain * dp;
+    struct sim_exp * ep;
+    struct sim_exp * cep;
+
+    if (sim_num_domains >= SIM_MAX_DOMAINS) {
+        pr2ws("sim: too many simulated domains\n");
+        return NULL;
+    }
+    if (NULL == (dp = (struct sim_domain *)calloc(1, sizeof(*dp))))
+        return NULL;
+    snprintf(dp->name, sizeof(dp->name), "%s", device_name);
+    dp->subvalue = subvalue;
+    if (parse_params(i_params, dp, &num_exp, &depth, &zoning)) {
+        free(dp);
+        return NULL;
+    }
+    /* SAS addresses (NAA 5) from a hash of the name, so are repeatable */
+    for (h = 5381 + subvalue, cp = device_name; *cp; ++cp)
+        h = (h * 33) + (unsigned char)*cp;
+    base = 0x5000d15e00000000ULL | ((uint64_t)(h & 0xfff) << 20);
+    dp->seed = h;
+    pthread_mutex_init(&dp->mtx, NULL);
+    /* breadth first, so expander k's children follow those of k - 1 */
+    for (k = 0; (k == 0) || (k < dp->num_exps); ++k) {
+        if (0 == k) {
+            if (NULL == (ep = (struct sim_exp *)calloc(1, sizeof(*ep))))
+                goto nomem;
+            ep->sa = base;
+            dp->exps[dp->num_exps++] = ep;
+        }
+        ep = dp->exps[k];
+        ep->dp = dp;
+        ep->exp_cc = 1;
+        ep->zoning_enabled = zoning;
+        if (dp->num_routes) {
+            ep->routes = (struct sim_route *)calloc(dp->num_phys *
+                                    dp->num_routes, sizeof(struct sim_route));
+            if (NULL == ep->routes)
+                goto nomem;
+            for (j = 0; j < (dp->num_phys * dp->num_routes); ++j)
+                ep->routes[j].disabled = true;
+        }
+        for (j = 0; j < SIM_NUM_ZG; ++j)        /* all groups see all */
+            memset(ep->zperm[j], 0xff, sizeof(ep->zperm[j]));
+        first_child = dp->num_phys;
+        if (ep->depth < depth) {
+            for (j = 0; (j < num_exp) && (dp->num_exps < SIM_MAX_EXP);
+                 ++j) {
+                cep = (struct sim_exp *)calloc(1, sizeof(*cep));
+                if (NULL == cep)
+                    goto nomem;
+                cep->depth = ep->depth + 1;
+                cep->sa = base | ((uint64_t)dp->num_exps << 8);
+                p = dp->num_phys - num_exp + j;
+                if (j == 0)
+                    first_child = p;
+                link_exps(ep, p, cep, 0);
+                dp->exps[dp->num_exps++] = cep;
+            }
+        }
+        for (p = ((k > 0) ? 1 : 0); p < first_child; ++p) {
+            ep->phys[p].att_dev_type = 1;
+            ep->phys[p].att_sa = base | 0x80000 | ((uint64_t)k << 8) | p;
+            ep->phys[p].zone_group = zoning ? 8 : 0;
+            ep->phys[p].sata = dp->sata && (p & 1);
+        }
+    }
+    if (dp->num_routes)
+        prime_routes(dp);
+    sim_domains[sim_num_domains++] = dp;
+    return dp;
+nomem:
+    pr2ws("sim: out of memory\n");
+    for (k = 0; k < dp->num_exps; ++k) {
+        free(dp->exps[k]->routes);
+        free(dp->exps[k]);
+    }
+    pthread_mutex_destroy(&dp->mtx);
+    free(dp);
+    return NULL;
+}
+
+int
+smp_sim_open(const char * device_name, int subvalue, const char * i_params,
+             uint64_t sa, struct smp_target_obj * tobj, int verbose)
+{
+    int k, j;
+    struct sim_domain * dp = NULL;
+    struct sim_exp * ep = NULL;
+
+    if ((NULL == device_name) || (NULL == i_params) || (NULL == tobj))
+        return -1;
+    pthread_mutex_lock(&sim_mtx);
+    if ('\0' == device_name[0]) {       /* by SAS address, any domain */
+        for (k = 0; (NULL == ep) && (k < sim_num_domains); ++k) {
+            for (j = 0; j < sim_domains[k]->num_exps; ++j) {
+                if (sa == sim_domains[k]->exps[j]->sa) {
+                    dp = sim_domains[k];
+                    ep = dp->exps[j];
+                    break;
+                }
+            }
+        }
+    } else {
+        for (k = 0; k < sim_num_domains; ++k) {
+            if ((subvalue == sim_domains[k]->subvalue) &&
+                (0 == strcmp(device_name, sim_domains[k]->name))) {
+                dp = sim_domains[k];
+                break;
+            }
+        }
+        if ((NULL == dp) &&
+            (NULL == (dp = build_domain(device_name, subvalue, i_params))))
+            goto fini;
+        if (0 == sa)
+            ep = dp->exps[0];
+        for (j = 0; (NULL == ep) && (j < dp->num_exps); ++j) {
+            if (sa == dp->exps[j]->sa)
+                ep = dp->exps[j];
+        }
+    }
+fini:
+    pthread_mutex_unlock(&sim_mtx);
+    if (NULL == ep) {
+        if (dp || ('\0' == device_name[0]))
+            pr2ws("sim: no simulated expander with SAS address 0x%" PRIx64
+                  "\n", sa);
+        return -1;
+    }
+    memset(tobj, 0, sizeof(struct smp_target_obj));
+    snprintf(tobj->device_name, sizeof(tobj->device_name), "%s", dp->name);
+    tobj->subvalue = dp->subvalue;
+    sg_put_unaligned_be64(ep->sa, tobj->sas_addr);
+    tobj->interface_selector = SMP_SIM_INTERFACE;
+    tobj->vp = ep;
+    tobj->opened = 1;
+    smp_stats_attach(tobj);
+    smp_req_policy_init(tobj);
+    if (verbose > 1)
+        pr2ws("sim: %s, expander at depth %d of %d, SAS address 0x%" PRIx64
+              ", %d phys\n", dp->name, ep->depth, dp->num_exps, ep->sa,
+              dp->num_phys);
+    return 0;
+}
+
+int
+smp_sim_close(struct smp_target_obj * tobj)
+{
+    if ((NULL == tobj) || (SMP_SIM_INTERFACE != tobj->interface_selector))
+        return -1;
+    /* the model is kept, later opens see its (configured) state */
+    smp_stats_free(tobj);
+    smp_rg_cache_free(tobj);
+    smp_buf_free(tobj);
+    tobj->vp = NULL;
+    tobj->opened = 0;
+    return 0;
+}
+
+/* Fills the DISCOVER response (less its 4 byte header and CRC) for phy
+ * into b, as used in DISCOVER LIST long descriptors too. */
+static void
+fill_discover(const struct sim_exp * ep, int phy, uint8_t * b)
+{
+    const struct sim_phy * pp = ep->phys + phy;
+    int lrate = pp->disabled ? 1 : (pp->att_dev_type ? SIM_DEF_LRATE : 0);
+
+    sg_put_unaligned_be16(ep->exp_cc, b + 4);
+    b[9] = phy;
+    b[12] = (pp->att_dev_type & 0x7) << 4;
+    b[13] = lrate;
+    if (2 == pp->att_dev_type) {
+        b[14] = SMP_DV_SMP;
+        b[15] = SMP_DV_SMP;
+    } else if (1 == pp->att_dev_type)
+        b[15] = pp->sata ? SMP_DV_SATA : SMP_DV_SSP;
+    sg_put_unaligned_be64(ep->sa, b + 16);
+    sg_put_unaligned_be64(pp->att_sa, b + 24);
+    b[32] = pp->att_phy_id;
+    b[40] = 0x88;               /* programmed and hardware min: 1.5 Gbps */
+    b[41] = (SIM_DEF_LRATE << 4) | SIM_DEF_LRATE;
+    b[42] = pp->change_count;
+    b[44] = pp->routing_attr;
+    if (pp->att_dev_type)
+        sg_put_unaligned_be64(pp->att_sa, b + 52);      /* device name */
+    b[60] = ep->zoning_enabled ? SMP_DV_ZONING_EN : 0;
+    b[63] = pp->zone_group;
+    b[94] = lrate;
+    b[108] = 0xff;              /* device slot number: not available */
+    b[109] = 0xff;
+}
+
+static void
+fill_short_desc(const struct sim_exp * ep, int phy, uint8_t * d)
+{
+    uint8_t b[128];
+
+    memset(b, 0, sizeof(b));
+    fill_discover(ep, phy, b);
+    d[0] = phy;
+    d[2] = b[12];
+    d[3] = b[13];
+    d[4] = b[14];
+    d[5] = b[15];
+    d[6] = b[44];
+    d[7] = b[94];
+    d[8] = b[63];
+    d[9] = b[60] & ~SMP_DV_ZONING_EN;
+    d[10] = b[32];
+    d[11] = b[42];
+    memcpy(d + 12, b + 24, 8);
+}
+
+static bool
+filter_match(const struct sim_phy * pp, int filter)
+{
+    switch (filter) {
+    case 1:
+        return (2 == pp->att_dev_type);
+    case 2:
+        return (pp->att_dev_type > 0);
+    case 3:
+        return (1 == pp->att_dev_type);
+    default:
+        return true;
+    }
+}
+
+/* Records a self-configuration status descriptor, as a self-configuring
+ * expander does for problems it meets while (re)configuring. */
+static void
+scs_record(struct sim_exp * ep, int status, int phy, uint64_t sa)
+{
+    struct sim_scs * sp = ep->scs + (ep->scs_seq % SIM_SCS_MAX);
+
+    sp->status = status;
+    sp->phy_id = phy;
+    sp->sa = sa;
+    sp->index = (ep->scs_seq % 65535) + 1;
+    ++ep->scs_seq;
+}
+
+/* Builds the response to req in b. Returns its length in bytes, excluding
+ * the CRC. Called with the domain's mutex held. */
+static int
+sim_respond(struct sim_exp * ep, const uint8_t * req, int req_len,
+            uint8_t * b)
+{
+    int n, k, phy, idx, dl, maxd, filter, ecc;
+    const struct sim_domain * dp = ep->dp;
+    struct sim_phy * pp;
+    struct sim_route * rtp;
+
+    b[0] = SMP_FRAME_TYPE_RESP;
+    b[1] = req[1];
+    phy = (req_len > 9) ? req[9] : 0;
+    pp = (phy < dp->num_phys) ? (ep->phys + phy) : NULL;
+    ecc = (req_len > 5) ? sg_get_unaligned_be16(req + 4) : 0;
+    if ((req[1] >= SMP_FN_CONFIG_GENERAL) && ecc && (ecc != ep->exp_cc) &&
+        (SMP_FN_WRITE_GPIO_REG != req[1]) &&
+        (SMP_FN_WRITE_GPIO_REG_ENH != req[1])) {  /* no ecc in SFF-8485 */
+        b[2] = SMP_FRES_INVALID_EXP_CHANGE_COUNT;
+        return 4;
+    }
+    switch (req[1]) {
+    case SMP_FN_REPORT_GENERAL:
+        sg_put_unaligned_be16(ep->exp_cc, b + 4);
+        sg_put_unaligned_be16(dp->num_routes, b + 6);
+        b[8] = 0x80;            /* long response */
+        b[9] = dp->num_phys;
+        b[10] = dp->num_routes ? 0x1 : 0;       /* ext config route table */
+        sg_put_unaligned_be64(dp->exps[0]->sa, b + 12); /* enclosure id */
+        b[36] = 0x2 | (ep->zone_locked ? 0x10 : 0) |
+                (ep->zoning_enabled ? 0x1 : 0);
+        sg_put_unaligned_be16(dp->num_routes, b + 38);
+        n = 72;
+        break;
+    case SMP_FN_REPORT_MANUFACTURER:
+        b[8] = 0x1;             /* SAS-1.1 format */
+        memcpy(b + 12, "SMPUTILS", 8);
+        memcpy(b + 20, "SIM EXPANDER    ", 16);
+        memcpy(b + 36, "1.00", 4);
+        n = 60;
+        break;
+    case SMP_FN_REPORT_ZONE_PERMISSION_TBL:
+        idx = (req_len > 6) ? req[6] : 0;
+        maxd = (req_len > 7) ? req[7] : 0;
+        if ((0 == maxd) || (maxd > 63))
+            maxd = 63;
+        for (k = 0; (k < maxd) && ((idx + k) < SIM_NUM_ZG); ++k)
+            memcpy(b + 16 + (k * 16), ep->zperm[idx + k], 16);
+        sg_put_unaligned_be16(ep->exp_cc, b + 4);
+        b[6] = (ep->zone_locked ? 0x80 : 0) | (req[4] & 0x3);
+        b[13] = 16 / 4;         /* descriptor length, 128 zone groups */
+        b[14] = idx;
+        b[15] = k;
+        n = 16 + (k * 16);
+        break;
+    case SMP_FN_DISCOVER:
+        if (NULL == pp)
+            goto no_phy;
+        fill_discover(ep, phy, b);
+        n = 120;
+        break;
+    case SMP_FN_REPORT_PHY_ERR_LOG:
+        if (NULL == pp)
+            goto no_phy;
+        sg_put_unaligned_be16(ep->exp_cc, b + 4);
+        b[9] = phy;
+        for (k = 0; k < 4; ++k)
+            sg_put_unaligned_be32(pp->err_cnt[k], b + 12 + (4 * k));
+        n = 28;
+        break;
+    case SMP_FN_REPORT_PHY_SATA:
+        if (NULL == pp)
+            goto no_phy;
+        if ((! pp->sata) || (1 != pp->att_dev_type) || pp->disabled) {
+            b[2] = SMP_FRES_NO_SATA_SUPPORT;
+            return 4;
+        }
+        sg_put_unaligned_be16(ep->exp_cc, b + 4);
+        b[9] = phy;
+        b[11] = 0x2;            /* affiliations supported, none valid */
+        sg_put_unaligned_be64(pp->att_sa, b + 16);
+        b[24] = 0x34;           /* register D2H FIS with ATA signature */
+        b[26] = 0x50;           /* status: DRDY, DSC */
+        b[27] = 0x1;            /* error */
+        b[28] = 0x1;            /* LBA low */
+        b[36] = 0x1;            /* sector count */
+        b[65] = (req_len > 10) ? req[10] : 0;
+        b[67] = 1;              /* maximum affiliation contexts */
+        n = 68;
+        break;
+    case SMP_FN_REPORT_ROUTE_INFO:
+    case SMP_FN_CONFIG_ROUTE_INFO:
+        if (NULL == pp)
+            goto no_phy;
+        idx = (req_len > 7) ? sg_get_unaligned_be16(req + 6) : 0;
+        if (idx >= dp->num_routes) {
+            b[2] = SMP_FRES_NO_INDEX;
+            return 4;
+        }
+        rtp = ep->routes + (phy * dp->num_routes) + idx;
+        if (SMP_FN_CONFIG_ROUTE_INFO == req[1]) {
+            if (req_len < 28) {
+                b[2] = SMP_FRES_INVALID_REQUEST_LEN;
+                return 4;
+            }
+            rtp->disabled = !! (req[12] & 0x80);
+            rtp->sa = sg_get_unaligned_be64(req + 16);
+            return 4;
+        }
+        sg_put_unaligned_be16(ep->exp_cc, b + 4);
+        sg_put_unaligned_be16(idx, b + 6);
+        b[9] = phy;
+        b[12] = rtp->disabled ? 0x80 : 0;
+        sg_put_unaligned_be64(rtp->sa, b + 16);
+        n = 40;
+        break;
+    case SMP_FN_DISCOVER_LIST:
+        phy = (req_len > 8) ? req[8] : 0;
+        maxd = (req_len > 9) ? req[9] : 0;
+        filter = (req_len > 10) ? (req[10] & 0xf) : 0;
+        k = (req_len > 11) ? (req[11] & 0xf) : 0;
+        if (k > 1) {
+            b[2] = SMP_FRES_UNKNOWN_DESCRIPTOR_TYPE;
+            return 4;
+        }
+        if (filter > 3) {
+            b[2] = SMP_FRES_UNKNOWN_PHY_FILTER;
+            return 4;
+        }
+        dl = k ? 24 : 120;
+        if ((0 == maxd) || (maxd > ((1028 - 48) / dl)))
+            maxd = (1028 - 48) / dl;
+        b[8] = phy;
+        b[10] = filter;
+        b[11] = k;
+        b[12] = dl / 4;
+        sg_put_unaligned_be16(ep->exp_cc, b + 4);
+        b[16] = 0x80 | (ep->zoning_enabled ? 0x40 : 0);
+        for (n = 0; (phy < dp->num_phys) && (n < maxd); ++phy) {
+            if (! filter_match(ep->phys + phy, filter))
+                continue;
+            if (k)
+                fill_short_desc(ep, phy, b + 48 + (n * dl));
+            else {
+                uint8_t t[128];
+
+                memset(t, 0, sizeof(t));
+                fill_discover(ep, phy, t);
+                t[3] = (dl - 4) / 4;    /* as the DISCOVER response */
+                memcpy(b + 48 + (n * dl), t, dl);
+            }
+            ++n;
+        }
+        b[9] = n;
+        n = 48 + (n * dl);
+        break;
+    case SMP_FN_ENABLE_DISABLE_ZONING:
+        k = (req_len > 8) ? (req[8] & 0x3) : 0;
+        if (3 == k) {
+            b[2] = SMP_FRES_UNKNOWN_EN_DIS_ZONING_VAL;
+            return 4;
+        }
+        if (k && (ep->zoning_enabled != (1 == k))) {
+            ep->zoning_enabled = (1 == k);
+            ++ep->exp_cc;
+        }
+        return 4;
+    case SMP_FN_ZONE_LOCK:
+        ep->zone_locked = true;
+        n = 16;                 /* active zone manager SAS address: 0 */
+        break;
+    case SMP_FN_ZONE_UNLOCK:
+        ep->zone_locked = false;
+        return 4;
+    case SMP_FN_CONFIG_ZONE_PERMISSION_TBL:
+        if (! ep->zone_locked) {
+            b[2] = SMP_FRES_ZONE_LOCK_VIOLATION;
+            return 4;
+        }
+        idx = (req_len > 6) ? req[6] : 0;
+        n = (req_len > 7) ? req[7] : 0;
+        if ((req_len > 8) && (req[8] & 0x40)) {         /* 256 zone groups */
+            b[2] = SMP_FRES_INVALID_FIELD_IN_REQUEST;
+            return 4;
+        }
+        if ((idx + n) > SIM_NUM_ZG) {
+            b[2] = SMP_FRES_ZONE_GROUP_OUT_OF_RANGE;
+            return 4;
+        }
+        if (req_len < (16 + (n * 16) + 4)) {
+            b[2] = SMP_FRES_INVALID_REQUEST_LEN;
+            return 4;
+        }
+        for (k = 0; k < n; ++k)
+            memcpy(ep->zperm[idx + k], req + 16 + (k * 16), 16);
+        return 4;
+    case SMP_FN_PHY_CONTROL:
+        if (NULL == pp)
+            goto no_phy;
+        switch ((req_len > 10) ? req[10] : 0) {
+        case 5:                 /* clear error log */
+            memset(pp->err_cnt, 0, sizeof(pp->err_cnt));
+            break;
+        case 0:                 /* nop */
+        case 6:                 /* clear affiliation */
+        case 7:                 /* transmit SATA port selection signal */
+        case 8:                 /* clear STP I_T nexus loss */
+        case 9:                 /* set attached device name */
+            break;
+        case 1:                 /* link reset */
+        case 2:                 /* hard reset */
+        case 3:                 /* disable */
+            pp->disabled = (3 == req[10]);
+            ++pp->change_count;
+            ++pp->bcast_cnt;
+            scs_record(ep, 0x20, phy, pp->att_sa);  /* phy layer */
+            if (pp->att_dev_type) {
+                pp->err_cnt[0] += 4;    /* invalid dwords while resetting */
+                ++pp->err_cnt[2];       /* loss of dword sync */
+            }
+            ++ep->exp_cc;
+            break;
+        default:
+            b[2] = SMP_FRES_UNKNOWN_PHY_OP;
+            return 4;
+        }
+        return 4;
+    case SMP_FN_PHY_TEST_FUNCTION:
+        if (NULL == pp)
+            goto no_phy;
+        switch ((req_len > 10) ? req[10] : 0) {
+        case 0:                 /* stop */
+            if (pp->testing) {
+                pp->testing = false;
+                if (pp->att_dev_type)
+                    ++pp->err_cnt[2];   /* link comes back up */
+            }
+            break;
+        case 1:                 /* transmit pattern */
+            if (pp->testing) {
+                b[2] = SMP_FRES_PHY_TEST_IN_PROGRESS;
+                return 4;
+            }
+            pp->testing = true;
+            if (pp->att_dev_type) {
+                ++pp->err_cnt[2];       /* link drops to test */
+                pp->err_cnt[0] += 2 + (pp->att_phy_id % 3);
+            }
+            break;
+        default:
+            b[2] = SMP_FRES_UNKNOWN_PHY_TEST_FN;
+            return 4;
+        }
+        return 4;
+    case SMP_FN_CONFIG_PHY_EVENT:
+        if (NULL == pp)
+            goto no_phy;
+        if (0 == pp->att_dev_type) {
+            b[2] = SMP_FRES_PHY_VACANT;
+            return 4;
+        }
+        n = (req_len > 11) ? req[11] : 0;
+        dl = (req_len > 10) ? (req[10] * 4) : 0;
+        if (n && ((dl < 8) || ((16 + (n * dl)) > req_len)))
+            goto bad_len;
+        if (n > SIM_PES_MAX) {
+            b[2] = SMP_FRES_INVALID_FIELD_IN_REQUEST;
+            return 4;
+        }
+        for (k = 0; k < n; ++k) {
+            if ((req[12 + (k * dl) + 3] >= 0x70) &&
+                (req[12 + (k * dl) + 3] < 0xd0)) {
+                b[2] = SMP_FRES_UNKNOWN_PHY_EVENT_SRC;
+                return 4;
+            }
+        }
+        for (k = 0; k < n; ++k) {
+            pp->pes[k] = req[12 + (k * dl) + 3];
+            pp->pes_thres[k] = sg_get_unaligned_be32(req + 12 + (k * dl) + 4);
+        }
+        pp->num_pes = n;
+        return 4;
+    case SMP_FN_CONFIG_ZONE_PHY_INFO:
+        if (! ep->zone_locked) {
+            b[2] = SMP_FRES_ZONE_LOCK_VIOLATION;
+            return 4;
+        }
+        n = (req_len > 7) ? req[7] : 0;
+        if (req_len < (8 + (n * 4) + 4)) {
+            b[2] = SMP_FRES_INVALID_REQUEST_LEN;
+            return 4;
+        }
+        for (k = 0; k < n; ++k) {       /* check all before changing any */
+            if (req[8 + (k * 4)] >= dp->num_phys) {
+                b[2] = SMP_FRES_NO_PHY;
+                return 4;
+            }
+        }
+        for (k = 0; k < n; ++k)
+            ep->phys[req[8 + (k * 4)]].zone_group = req[8 + (k * 4) + 3];
+        return 4;
+    case SMP_FN_ZONE_ACTIVATE:
+        if (! ep->zone_locked) {
+            b[2] = SMP_FRES_ZONE_LOCK_VIOLATION;
+            return 4;
+        }
+        ++ep->exp_cc;
+        return 4;
+    case SMP_FN_REPORT_SELF_CONFIG:
+        sg_put_unaligned_be16(ep->exp_cc, b + 4);
+        k = (ep->scs_seq < SIM_SCS_MAX) ? (int)ep->scs_seq : SIM_SCS_MAX;
+        sg_put_unaligned_be16(k, b + 8);        /* total recorded */
+        b[12] = 16 / 4;
+        n = 20;
+        if (0 == k)
+            break;
+        sg_put_unaligned_be16(ep->scs[(ep->scs_seq - 1) % SIM_SCS_MAX].index,
+                              b + 10);          /* last (newest) index */
+        /* start at the requested index if still held, else the oldest.
+         * Index 0 only reports the last index, as SAS-2 has it */
+        idx = (req_len > 7) ? sg_get_unaligned_be16(req + 6) : 0;
+        if (0 == idx) {
+            sg_put_unaligned_be16(0, b + 8);
+            break;
+        }
+        for (dl = 0; dl < k; ++dl) {
+            if (ep->scs[(ep->scs_seq - k + dl) % SIM_SCS_MAX].index == idx)
+                break;
+        }
+        if (dl >= k)
+            dl = 0;
+        for (maxd = 0; (dl < k) && (maxd < ((1024 - 20) / 16));
+             ++dl, ++maxd) {
+            const struct sim_scs * sp =
+                        ep->scs + ((ep->scs_seq - k + dl) % SIM_SCS_MAX);
+
+            if (0 == maxd)
+                sg_put_unaligned_be16(sp->index, b + 6);
+            b[n] = sp->status;
+            b[n + 3] = sp->phy_id;
+            sg_put_unaligned_be64(sp->sa, b + n + 8);
+            n += 16;
+        }
+        b[19] = maxd;
+        break;
+    case SMP_FN_REPORT_PHY_EVENT_LIST:
+        /* descriptor indexes are 1 based, phy by phy */
+        sg_put_unaligned_be16(ep->exp_cc, b + 4);
+        idx = (req_len > 7) ? sg_get_unaligned_be16(req + 6) : 0;
+        if (0 == idx)
+            idx = 1;
+        b[10] = 12 / 4;
+        n = 16;
+        for (dl = 0, phy = 0; phy < dp->num_phys; ++phy) {
+            pp = ep->phys + phy;
+            for (k = 0; k < pp->num_pes; ++k) {
+                if ((++dl < idx) || (n > (1024 - 12)))
+                    continue;
+                if (0 == b[15])
+                    sg_put_unaligned_be16(dl, b + 6);
+                b[n + 2] = phy;
+                b[n + 3] = pp->pes[k];
+                if ((pp->pes[k] >= 1) && (pp->pes[k] <= 4))
+                    sg_put_unaligned_be32(pp->err_cnt[pp->pes[k] - 1],
+                                          b + n + 4);
+                sg_put_unaligned_be32(pp->pes_thres[k], b + n + 8);
+                ++b[15];
+                n += 12;
+            }
+        }
+        sg_put_unaligned_be16(dl, b + 8);       /* last descriptor index */
+        break;
+    case SMP_FN_REPORT_BROADCAST:
+        sg_put_unaligned_be16(ep->exp_cc, b + 4);
+        b[6] = (req_len > 4) ? (req[4] & 0xf) : 0;
+        b[10] = 8 / 4;          /* descriptor length */
+        n = 12;
+        if (0 == b[6]) {        /* only Broadcast (Change) is counted */
+            for (k = 0; (k < dp->num_phys) && (n < (1024 - 8)); ++k) {
+                if (0 == ep->phys[k].bcast_cnt)
+                    continue;
+                b[n + 1] = k;
+                sg_put_unaligned_be16(ep->phys[k].bcast_cnt, b + n + 4);
+                ++b[11];
+                n += 8;
+            }
+        }
+        break;
+    case SMP_FN_READ_GPIO_REG:
+    case SMP_FN_READ_GPIO_REG_ENH:
+    case SMP_FN_WRITE_GPIO_REG:
+    case SMP_FN_WRITE_GPIO_REG_ENH:
+        /* enhanced variants have the SAS-2 header, fields 2 bytes later */
+        k = ((SMP_FN_READ_GPIO_REG_ENH == req[1]) ||
+             (SMP_FN_WRITE_GPIO_REG_ENH == req[1])) ? 2 : 0;
+        if (req_len < (8 + k))
+            goto bad_len;
+        idx = req[3 + k];
+        n = req[4 + k];         /* register count */
+        if (0 == req[2 + k]) {          /* GPIO_CFG */
+            if ((idx + n) > 2)
+                goto no_index;
+        } else if (3 == req[2 + k]) {   /* GPIO_TX */
+            if ((idx + n) > ((dp->num_phys + 3) / 4))
+                goto no_index;
+        } else
+            goto no_index;
+        if (req[1] & 0x80) {            /* write */
+            if (req_len < (12 + (n * 4)))
+                goto bad_len;
+            if (3 == req[2 + k])
+                memcpy(ep->gpio_tx + (idx * 4), req + 8, n * 4);
+            return 4;
+        }
+        if (0 == req[2 + k]) {
+            memset(b + 4, 0, n * 4);
+            if (0 == idx) {
+                b[6] = 0x80 | (2 << 4); /* GPIO enable, 2 cfg registers */
+                b[7] = dp->num_phys;    /* supported drive count */
+            }
+        } else
+            memcpy(b + 4, ep->gpio_tx + (idx * 4), n * 4);
+        n = 4 + (n * 4);
+        break;
+    case SMP_FN_CONFIG_GENERAL:
+        return 4;
+    default:
+        b[2] = SMP_FRES_UNKNOWN_FUNCTION;
+        return 4;
+    }
+    b[3] = (n - 4) / 4;
+    return n;
+no_phy:
+    b[2] = SMP_FRES_NO_PHY;
+    return 4;
+no_index:
+    b[2] = SMP_FRES_NO_INDEX;
+    return 4;
+bad_len:
+    b[2] = SMP_FRES_INVALID_REQUEST_LEN;
+    return 4;
+}
+
+/* For pull=N: pulls the end device from, or puts it back into, a phy of a
+ * pseudo randomly chosen expander as a drive swap would. Called with the
+ * domain's mutex held. */
+static void
+sim_pull(struct sim_domain * dp)
+{
+    int k, phy;
+    struct sim_exp * ep = dp->exps[rand_r(&dp->seed) % dp->num_exps];
+    struct sim_phy * pp;
+
+    for (k = 0; k < dp->num_phys; ++k) {
+        phy = rand_r(&dp->seed) % dp->num_phys;
+        pp = ep->phys + phy;
+        if (1 == pp->att_dev_type) {
+            pp->pulled_sa = pp->att_sa;
+            pp->att_sa = 0;
+            pp->att_dev_type = 0;
+        } else if (pp->pulled_sa) {
+            pp->att_sa = pp->pulled_sa;
+            pp->pulled_sa = 0;
+            pp->att_dev_type = 1;
+        } else
+            continue;
+        scs_record(ep, pp->att_dev_type ? 0x20 : 0x44, phy,
+                   pp->att_dev_type ? pp->att_sa : pp->pulled_sa);
+        ++pp->change_count;
+        ++pp->bcast_cnt;
+        ++ep->exp_cc;
+        return;
+    }
+}
+
+int
+smp_sim_send_req(const struct smp_target_obj * tobj,
+                 struct smp_req_resp * rresp, int verbose)
+{
+    bool busy, over;
+    int n;
+    struct sim_exp * ep;
+    struct sim_domain * dp;
+    struct timespec ts;
+    uint8_t b[SIM_RESP_MAX];
+
+    if ((NULL == tobj) || (NULL == (ep = (struct sim_exp *)tobj->vp)) ||
+        (NULL == rresp) || (NULL == rresp->request) ||
+        (rresp->request_len < 4) || (NULL == rresp->response))
+        return -1;
+    dp = ep->dp;
+    /* like an SMP processor with cap=N request buffers */
+    n = __atomic_add_fetch(&ep->inflight, 1, __ATOMIC_RELAXED);
+    over = (dp->cap > 0) && (n > dp->cap);
+    if (dp->lat_us > 0) {
+        ts.tv_sec = dp->lat_us / 1000000;
+        ts.tv_nsec = (dp->lat_us % 1000000) * 1000;
+        nanosleep(&ts, NULL);
+    }
+    memset(b, 0, sizeof(b));
+    pthread_mutex_lock(&dp->mtx);
+    busy = over || ((dp->busy_pct > 0) &&
+                    ((int)(rand_r(&dp->seed) % 100) < dp->busy_pct));
+    if (busy) {
+        b[0] = SMP_FRAME_TYPE_RESP;
+        b[1] = rresp->request[1];
+        b[2] = SMP_FRES_BUSY;
+        n = 4;
+    } else
+        n = sim_respond(ep, rresp->request, rresp->request_len, b);
+    if (dp->pull_every && (0 == (++dp->num_reqs % dp->pull_every)))
+        sim_pull(dp);
+    pthread_mutex_unlock(&dp->mtx);
+    __atomic_sub_fetch(&ep->inflight, 1, __ATOMIC_RELAXED);
+    n += 4;                     /* CRC, left as zero */
+    if (n > rresp->max_response_len)
+        n = rresp->max_response_len;
+    memcpy(rresp->response, b, n);
+    rresp->act_response_len = n;
+    rresp->transport_err = 0;
+    if (verbose > 3)
+        pr2ws("sim: function 0x%x, result 0x%x, %d bytes\n",
+              rresp->request[1], b[2], n);
+    return 0;
+}
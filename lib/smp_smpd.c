@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* Client side of the smpd daemon: the "smpd" interface, which sends each
+ * request over a Unix socket for smpd to pass to the target it owns, and
+ * the readers of the fabric model smpd publishes. One connection is made
+ * per smp_initiator_open() and requests on it are sent one at a time
+ * (smp_send_req_batch() threads take turns); smpd coalesces identical
+ * requests from different connections. */
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define SMPD_SPIN_MAX (1 << 20) /* reader gives up on a record held odd */
+
+struct smpd_conn {
+    int fd;
+    uint16_t target;
+    uint32_t tag;
+    pthread_mutex_t mtx;
+};
+
+
+static int
+full_send(int fd, const void * bp, int len)
+{
+    int n;
+    const uint8_t * p = (const uint8_t *)bp;
+
+    while (len > 0) {
+        n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (EINTR == errno)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int
+full_recv(int fd, void * bp, int len)
+{
+    int n;
+    uint8_t * p = (uint8_t *)bp;
+
+    while (len > 0) {
+        n = read(fd, p, len);
+        if (n < 0) {
+            if (EINTR == errno)
+                continue;
+            return -1;
+        }
+        if (0 == n)
+            return -1;          /* smpd went away */
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Sends hdr then len bytes from bp (usually as one send()) */
+static int
+send_msg(int fd, const struct smp_smpd_msg * hdr, const uint8_t * bp,
+         int len)
+{
+    uint8_t b[sizeof(struct smp_smpd_msg) + SMP_SMPD_MAX_FRAME];
+
+    if (len > SMP_SMPD_MAX_FRAME)
+        return -1;
+    memcpy(b, hdr, sizeof(*hdr));
+    if (len > 0)
+        memcpy(b + sizeof(*hdr), bp, len);
+    return full_send(fd, b, sizeof(*hdr) + len);
+}
+
+int
+smp_smpd_open(const char * device_name, int subvalue, const char * i_params,
+              uint64_t sa, struct smp_target_obj * tobj, int verbose)
+{
+    int fd, n;
+    const char * cp;
+    const char * path = SMP_SMPD_SOCKET;
+    struct smpd_conn * scp;
+    struct sockaddr_un s_un;
+    struct smp_smpd_msg m;
+    char b[sizeof(s_un.sun_path)];
+
+    if ((NULL == device_name) || (NULL == tobj))
+        return -1;
+    if (i_params && (cp = strstr(i_params, ",sock="))) {
+        n = strcspn(cp + 6, ",");
+        if (n >= (int)sizeof(b)) {
+            pr2ws("smpd: socket path too long\n");
+            return -1;
+        }
+        memcpy(b, cp + 6, n);
+        b[n] = '\0';
+        path = b;
+    }
+    memset(&s_un, 0, sizeof(s_un));
+    s_un.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(s_un.sun_path))
+        return -1;
+    memcpy(s_un.sun_path, path, strlen(path));
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        pr2ws("smpd: socket: %s\n", safe_strerror(errno));
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&s_un, sizeof(s_un)) < 0) {
+        pr2ws("smpd: unable to connect to %s: %s\n", path,
+              safe_strerror(errno));
+        goto err_out;
+    }
+    memset(&m, 0, sizeof(m));
+    m.magic = SMP_SMPD_MAGIC;
+    m.op = SMP_SMPD_OP_OPEN;
+    m.max_resp_len = subvalue;
+    m.sas_addr = sa;
+    m.len = strlen(device_name) + 1;
+    if ((m.len > SMP_MAX_DEVICE_NAME) ||
+        send_msg(fd, &m, (const uint8_t *)device_name, m.len) ||
+        full_recv(fd, &m, sizeof(m)) || (SMP_SMPD_MAGIC != m.magic) ||
+        (m.len > 0)) {
+        pr2ws("smpd: open request to %s failed\n", path);
+        goto err_out;
+    }
+    if (m.res) {
+        if (sa)
+            pr2ws("smpd: no target with SAS address 0x%" PRIx64 "\n", sa);
+        else
+            pr2ws("smpd: no target named %s\n", device_name);
+        goto err_out;
+    }
+    scp = (struct smpd_conn *)calloc(1, sizeof(*scp));
+    if (NULL == scp)
+        goto err_out;
+    scp->fd = fd;
+    scp->target = m.target;
+    pthread_mutex_init(&scp->mtx, NULL);
+    memset(tobj, 0, sizeof(struct smp_target_obj));
+    snprintf(tobj->device_name, sizeof(tobj->device_name), "%s",
+             device_name);
+    tobj->subvalue = subvalue;
+    sg_put_unaligned_be64(m.sas_addr, tobj->sas_addr);
+    tobj->interface_selector = SMP_SMPD_INTERFACE;
+    tobj->fd = fd;
+    tobj->vp = scp;
+    tobj->opened = 1;
+    smp_stats_attach(tobj);
+    smp_req_policy_init(tobj);
+    if (verbose > 1)
+        pr2ws("smpd: %s target %d, SAS address 0x%" PRIx64 "\n", path,
+              m.target, m.sas_addr);
+    return 0;
+err_out:
+    close(fd);
+    return -1;
+}
+
+int
+smp_smpd_send_req(const struct smp_target_obj * tobj,
+                  struct smp_req_resp * rresp, int verbose)
+{
+    int res = -1;
+    struct smpd_conn * scp;
+    struct smp_smpd_msg m;
+
+    if ((NULL == tobj) || (NULL == (scp = (struct smpd_conn *)tobj->vp)))
+        return -1;
+    if ((rresp->request_len > SMP_SMPD_MAX_FRAME) ||
+        (rresp->max_response_len < 0)) {
+        if (verbose)
+            pr2ws("smpd: request too long\n");
+        return -1;
+    }
+    pthread_mutex_lock(&scp->mtx);
+    memset(&m, 0, sizeof(m));
+    m.magic = SMP_SMPD_MAGIC;
+    m.op = SMP_SMPD_OP_REQ;
+    m.target = scp->target;
+    m.tag = ++scp->tag;
+    m.max_resp_len = rresp->max_response_len;
+    m.len = rresp->request_len;
+    if (send_msg(scp->fd, &m, rresp->request, m.len) ||
+        full_recv(scp->fd, &m, sizeof(m)) || (SMP_SMPD_MAGIC != m.magic) ||
+        (m.tag != scp->tag) || (m.len > (uint32_t)rresp->max_response_len) ||
+        ((m.len > 0) && full_recv(scp->fd, rresp->response, m.len))) {
+        if (verbose)
+            pr2ws("smpd: lost connection\n");
+        goto fini;
+    }
+    rresp->act_response_len = m.act_resp_len;
+    rresp->transport_err = m.transport_err;
+    res = m.res;
+fini:
+    pthread_mutex_unlock(&scp->mtx);
+    return res;
+}
+
+int
+smp_smpd_close(struct smp_target_obj * tobj)
+{
+    struct smpd_conn * scp;
+
+    if ((NULL == tobj) || (SMP_SMPD_INTERFACE != tobj->interface_selector))
+        return -1;
+    if ((scp = (struct smpd_conn *)tobj->vp)) {
+        close(scp->fd);
+        pthread_mutex_destroy(&scp->mtx);
+        free(scp);
+    }
+    smp_stats_free(tobj);
+    smp_rg_cache_free(tobj);
+    smp_buf_free(tobj);
+    tobj->vp = NULL;
+    tobj->opened = 0;
+    return 0;
+}
+
+static size_t
+map_len(const struct smp_smpd_shm_hdr * hp)
+{
+    return sizeof(*hp) + ((size_t)hp->num_exps * hp->exp_len);
+}
+
+const struct smp_smpd_shm_hdr *
+smp_smpd_map(const char * path, int verbose)
+{
+    int fd;
+    void * vp;
+    const struct smp_smpd_shm_hdr * hp;
+    struct stat st;
+
+    if (NULL == path)
+        path = SMP_SMPD_SHM;
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        if (verbose)
+            pr2ws("smpd: unable to open %s: %s\n", path,
+                  safe_strerror(errno));
+        return NULL;
+    }
+    if (fstat(fd, &st) || (st.st_size < (off_t)sizeof(*hp))) {
+        close(fd);
+        goto bad;
+    }
+    vp = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == vp) {
+        if (verbose)
+            pr2ws("smpd: mmap of %s: %s\n", path, safe_strerror(errno));
+        return NULL;
+    }
+    hp = (const struct smp_smpd_shm_hdr *)vp;
+    if ((SMP_SMPD_SHM_MAGIC != hp->magic) ||
+        (SMP_SMPD_SHM_VERSION != hp->version) ||
+        (hp->exp_len < sizeof(struct smp_smpd_shm_exp)) ||
+        (map_len(hp) > (size_t)st.st_size)) {
+        munmap(vp, st.st_size);
+        goto bad;
+    }
+    return hp;
+bad:
+    if (verbose)
+        pr2ws("smpd: %s is not a smpd fabric model\n", path);
+    return NULL;
+}
+
+void
+smp_smpd_unmap(const struct smp_smpd_shm_hdr * hp)
+{
+    if (hp)
+        munmap((void *)hp, map_len(hp));
+}
+
+static const struct smp_smpd_shm_exp *
+exp_at(const struct smp_smpd_shm_hdr * hp, int exp_idx)
+{
+    if ((NULL == hp) || (exp_idx < 0) || (exp_idx >= (int)hp->num_exps))
+        return NULL;
+    return (const struct smp_smpd_shm_exp *)
+           ((const uint8_t *)(hp + 1) + ((size_t)exp_idx * hp->exp_len));
+}
+
+int
+smp_smpd_find_exp(const struct smp_smpd_shm_hdr * hp, uint64_t sa)
+{
+    int k;
+    const struct smp_smpd_shm_exp * ep;
+
+    for (k = 0; (ep = exp_at(hp, k)); ++k) {
+        if (sa == ep->sas_addr)
+            return k;
+    }
+    return -1;
+}
+
+/* Copies len bytes at off within expander record ep to bp, retrying while
+ * smpd rewrites the record. Returns -1 if it was never published or is
+ * held (e.g. smpd died while rewriting it). */
+static int
+seq_copy(const struct smp_smpd_shm_exp * ep, size_t off, void * bp,
+         size_t len)
+{
+    int k;
+    uint32_t s1, s2;
+
+    for (k = 0; k < SMPD_SPIN_MAX; ++k) {
+        s1 = __atomic_load_n(&ep->seq, __ATOMIC_ACQUIRE);
+        if (0 == s1)
+            return -1;
+        if (s1 & 1)
+            continue;
+        memcpy(bp, (const uint8_t *)ep + off, len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s2 = __atomic_load_n(&ep->seq, __ATOMIC_RELAXED);
+        if (s1 == s2)
+            return 0;
+    }
+    return -1;
+}
+
+int
+smp_smpd_read_exp(const struct smp_smpd_shm_hdr * hp, int exp_idx,
+                  struct smp_smpd_shm_exp * ep)
+{
+    const struct smp_smpd_shm_exp * sep = exp_at(hp, exp_idx);
+
+    if ((NULL == sep) || (NULL == ep))
+        return -1;
+    return seq_copy(sep, 0, ep, offsetof(struct smp_smpd_shm_exp, phys));
+}
+
+int
+smp_smpd_read_phy(const struct smp_smpd_shm_hdr * hp, int exp_idx,
+                  int phy_id, uint8_t * resp, int max_resp_len)
+{
+    int len;
+    const struct smp_smpd_shm_exp * sep = exp_at(hp, exp_idx);
+    struct smp_smpd_shm_phy ph;
+
+    if ((NULL == sep) || (phy_id < 0) || (phy_id >= SMP_SMPD_MAX_PHYS) ||
+        seq_copy(sep, offsetof(struct smp_smpd_shm_exp, phys) +
+                 (phy_id * sizeof(ph)), &ph, sizeof(ph)))
+        return -1;
+    len = (ph.len > SMP_SMPD_DISC_LEN) ? SMP_SMPD_DISC_LEN : (int)ph.len;
+    if (len > max_resp_len)
+        len = max_resp_len;
+    if (len > 0)
+        memcpy(resp, ph.resp, len);
+    return len;
+}
@@ -0,0 +1,702 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* Fabric snapshots. While recording, smp_send_req() passes each request
+ * that got a response to smp_snap_note() which keeps a copy of both, with
+ * the target it was sent to. smp_snap_save_end() sorts them and writes the
+ * file, which is laid out so that it can be used from mmap() as is:
+ *
+ *    header        SNAP_HDR_LEN bytes, see below
+ *    targets       num_tgts entries of SNAP_TGT_LEN bytes
+ *    index         num_recs entries of SNAP_IDX_LEN bytes, sorted by
+ *                  (SAS address, function, phy id, target, sequence)
+ *    data          each record's request then response, 4 byte aligned
+ *
+ * Integers are big endian, as in SMP frames. Loading checks the header and
+ * nothing else; a record's offsets are checked when it is touched. While
+ * replaying, smp_initiator_open() yields a target object bound to a
+ * target in the snapshot and smp_send_req() answers from the index with a
+ * binary search, so the utilities decode exactly what they decoded when
+ * the snapshot was taken without touching the hardware. */
+
+#define SNAP_MAGIC "SMPSNAP1"
+#define SNAP_VERSION 1
+#define SNAP_HDR_LEN 64
+#define SNAP_TGT_LEN (SMP_MAX_DEVICE_NAME + 16)
+#define SNAP_IDX_LEN 32
+#define SNAP_MAX_TGTS 1024
+#define SNAP_NO_PHY 0xffff
+
+/* Header: 0: magic; 8: version; 12: header length; 16: number of targets;
+ * 20: number of records; 24: offset of targets; 28: offset of index;
+ * 32: offset of data; 36: data length; 40: creation time (seconds since
+ * the epoch, 8 bytes). Target: 0: device name (null terminated);
+ * SMP_MAX_DEVICE_NAME: SAS address (8 bytes, 0 if never learnt);
+ * SMP_MAX_DEVICE_NAME + 8: subvalue. Index entry: 0: SAS address (8
+ * bytes); 8: target (2 bytes); 10: function; 12: phy id (2 bytes); 14:
+ * request length; 16: response length (both 2 bytes, including CRC); 20:
+ * data offset; 24: sequence number, the order the request was sent. */
+
+struct snap_tgt {
+    char name[SMP_MAX_DEVICE_NAME];
+    int subvalue;
+    uint64_t sa;
+};
+
+struct snap_rec {
+    int tgt;
+    int func;
+    int phy_id;
+    int seq;
+    int req_len;
+    int resp_len;
+    uint8_t * data;     /* request then response */
+};
+
+static pthread_mutex_t snap_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/* recording */
+static char * save_fn;
+static struct snap_tgt * save_tgts;
+static int save_num_tgts;
+static struct snap_rec * save_recs;
+static int save_num_recs;
+static int save_max_recs;
+
+/* replaying */
+static const uint8_t * map_base;
+static size_t map_len;
+static int map_num_tgts;
+static int map_num_recs;
+static const uint8_t * map_tgts;
+static const uint8_t * map_idx;
+static uint32_t map_data_off;
+
+
+/* Returns the phy identifier field of a request, if it has one, else
+ * SNAP_NO_PHY. */
+static int
+req_phy_id(const uint8_t * req, int len)
+{
+    switch (req[1]) {
+    case SMP_FN_DISCOVER:
+    case SMP_FN_REPORT_PHY_ERR_LOG:
+    case SMP_FN_REPORT_PHY_SATA:
+    case SMP_FN_REPORT_ROUTE_INFO:
+    case SMP_FN_REPORT_PHY_EVENT:
+    case SMP_FN_CONFIG_ROUTE_INFO:
+    case SMP_FN_PHY_CONTROL:
+    case SMP_FN_PHY_TEST_FUNCTION:
+        return (len > 9) ? req[9] : SNAP_NO_PHY;
+    case SMP_FN_DISCOVER_LIST:
+        return (len > 8) ? req[8] : SNAP_NO_PHY;      /* starting phy id */
+    default:
+        return SNAP_NO_PHY;
+    }
+}
+
+/* Returns the length of the response in rresp including its CRC, or -1
+ * if there is no plausible response. */
+static int
+resp_len(const struct smp_req_resp * rrp)
+{
+    int len;
+    const uint8_t * rp = rrp->response;
+
+    if ((NULL == rp) || rrp->transport_err || (rrp->max_response_len < 8))
+        return -1;
+    if (rrp->act_response_len >= 0)
+        len = rrp->act_response_len;
+    else {
+        if (SMP_FRAME_TYPE_RESP != rp[0])
+            return -1;
+        len = rp[3];
+        if ((0 == len) && (0 == rp[2])) {
+            len = smp_get_func_def_resp_len(rp[1]);
+            if (len < 0)
+                len = 0;
+        }
+        len = 4 + (len * 4) + 4;
+    }
+    if (len > rrp->max_response_len)
+        len = rrp->max_response_len;
+    return (len < 4) ? -1 : len;
+}
+
+int
+smp_snap_save_begin(const char * fn, int verbose)
+{
+    if ((NULL == fn) || ('\0' == fn[0]) || save_fn)
+        return -1;
+    if (NULL == (save_fn = strdup(fn))) {
+        pr2ws("%s: out of memory\n", __func__);
+        return -1;
+    }
+    if (verbose > 1)
+        pr2ws("%s: recording SMP requests for %s\n", __func__, fn);
+    return 0;
+}
+
+/* Returns the index in save_tgts of tobj, adding it if need be, or -1 if
+ * there are too many. Called with snap_mtx held. */
+static int
+save_tgt(const struct smp_target_obj * tobj)
+{
+    int k;
+    uint64_t sa = sg_get_unaligned_be64(tobj->sas_addr);
+    struct snap_tgt * tp;
+
+    for (k = 0; k < save_num_tgts; ++k) {
+        tp = save_tgts + k;
+        if ((tp->subvalue == tobj->subvalue) &&
+            (0 == strcmp(tp->name, tobj->device_name)) &&
+            ((0 == sa) || (0 == tp->sa) || (sa == tp->sa))) {
+            if (0 == tp->sa)
+                tp->sa = sa;
+            return k;
+        }
+    }
+    if (0 == (k % 16)) {
+        if (k >= SNAP_MAX_TGTS)
+            return -1;
+        tp = (struct snap_tgt *)realloc(save_tgts, (k + 16) * sizeof(*tp));
+        if (NULL == tp)
+            return -1;
+        save_tgts = tp;
+    }
+    tp = save_tgts + save_num_tgts++;
+    memset(tp, 0, sizeof(*tp));
+    snprintf(tp->name, sizeof(tp->name), "%s", tobj->device_name);
+    tp->subvalue = tobj->subvalue;
+    tp->sa = sa;
+    return k;
+}
+
+void
+smp_snap_note(const struct smp_target_obj * tobj,
+              const struct smp_req_resp * rresp, int res)
+{
+    int k, req_len, len;
+    const uint8_t * rp;
+    struct snap_rec * srp;
+    struct snap_tgt * tp;
+
+    if ((NULL == save_fn) || res || (NULL == tobj) || (NULL == rresp) ||
+        (NULL == rresp->request) || (rresp->request_len < 8) ||
+        (rresp->request_len > 0xffff) || ((len = resp_len(rresp)) < 0))
+        return;
+    req_len = rresp->request_len;
+    rp = rresp->response;
+    pthread_mutex_lock(&snap_mtx);
+    if ((k = save_tgt(tobj)) < 0)
+        goto fini;
+    tp = save_tgts + k;
+    /* a bsg target is opened by name, learn its SAS address from DISCOVER
+     * or a long descriptor DISCOVER LIST response */
+    if ((0 == tp->sa) && (0 == rp[2])) {
+        if ((SMP_FN_DISCOVER == rp[1]) && (len >= 28))
+            tp->sa = sg_get_unaligned_be64(rp + 16);
+        else if ((SMP_FN_DISCOVER_LIST == rp[1]) && (len >= (48 + 24)) &&
+                 (rp[9] > 0) && (0 == (rp[11] & 0xf)))
+            tp->sa = sg_get_unaligned_be64(rp + 48 + 16);
+    }
+    if (save_num_recs >= save_max_recs) {
+        srp = (struct snap_rec *)realloc(save_recs, (save_max_recs + 256) *
+                                                    sizeof(*srp));
+        if (NULL == srp)
+            goto fini;
+        save_recs = srp;
+        save_max_recs += 256;
+    }
+    srp = save_recs + save_num_recs;
+    if (NULL == (srp->data = (uint8_t *)malloc(req_len + len)))
+        goto fini;
+    memcpy(srp->data, rresp->request, req_len);
+    memcpy(srp->data + req_len, rp, len);
+    srp->tgt = k;
+    srp->func = rresp->request[1];
+    srp->phy_id = req_phy_id(rresp->request, req_len);
+    srp->seq = save_num_recs++;
+    srp->req_len = req_len;
+    srp->resp_len = len;
+fini:
+    pthread_mutex_unlock(&snap_mtx);
+}
+
+static int
+rec_cmp(const void * ap, const void * bp)
+{
+    const struct snap_rec * a = (const struct snap_rec *)ap;
+    const struct snap_rec * b = (const struct snap_rec *)bp;
+    uint64_t a_sa = save_tgts[a->tgt].sa;
+    uint64_t b_sa = save_tgts[b->tgt].sa;
+
+    if (a_sa != b_sa)
+        return (a_sa < b_sa) ? -1 : 1;
+    if (a->func != b->func)
+        return a->func - b->func;
+    if (a->phy_id != b->phy_id)
+        return a->phy_id - b->phy_id;
+    if (a->tgt != b->tgt)
+        return a->tgt - b->tgt;
+    return a->seq - b->seq;
+}
+
+static void
+save_free(void)
+{
+    int k;
+
+    for (k = 0; k < save_num_recs; ++k)
+        free(save_recs[k].data);
+    free(save_recs);
+    free(save_tgts);
+    free(save_fn);
+    save_recs = NULL;
+    save_tgts = NULL;
+    save_fn = NULL;
+    save_num_recs = 0;
+    save_max_recs = 0;
+    save_num_tgts = 0;
+}
+
+int
+smp_snap_save_end(int verbose)
+{
+    bool ok = true;
+    int k, res;
+    uint32_t tgt_off, idx_off, data_off, off;
+    const struct snap_rec * srp;
+    FILE * fp;
+    uint8_t hdr[SNAP_HDR_LEN];
+    uint8_t b[SNAP_TGT_LEN];
+    char fn[SMP_MAX_DEVICE_NAME + 8];
+    char e[128];
+
+    if (NULL == save_fn)
+        return -1;
+    pthread_mutex_lock(&snap_mtx);
+    if (save_num_recs > 1)
+        qsort(save_recs, save_num_recs, sizeof(struct snap_rec), rec_cmp);
+    tgt_off = SNAP_HDR_LEN;
+    idx_off = tgt_off + (save_num_tgts * SNAP_TGT_LEN);
+    data_off = idx_off + (save_num_recs * SNAP_IDX_LEN);
+    for (off = 0, k = 0; k < save_num_recs; ++k)
+        off += (save_recs[k].req_len + save_recs[k].resp_len + 3) & ~3;
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(hdr, SNAP_MAGIC, 8);
+    sg_put_unaligned_be32(SNAP_VERSION, hdr + 8);
+    sg_put_unaligned_be32(SNAP_HDR_LEN, hdr + 12);
+    sg_put_unaligned_be32(save_num_tgts, hdr + 16);
+    sg_put_unaligned_be32(save_num_recs, hdr + 20);
+    sg_put_unaligned_be32(tgt_off, hdr + 24);
+    sg_put_unaligned_be32(idx_off, hdr + 28);
+    sg_put_unaligned_be32(data_off, hdr + 32);
+    sg_put_unaligned_be32(off, hdr + 36);
+    sg_put_unaligned_be64((uint64_t)time(NULL), hdr + 40);
+
+    /* write to a temporary file then rename, as smp_discover --since */
+    snprintf(fn, sizeof(fn), "%s.tmp", save_fn);
+    if (NULL == (fp = fopen(fn, "w"))) {
+        pr2ws("%s: unable to create %s: %s\n", __func__, fn,
+              safe_strerror_r(errno, e, sizeof(e)));
+        res = SMP_LIB_FILE_ERROR;
+        goto fini;
+    }
+    ok = (1 == fwrite(hdr, sizeof(hdr), 1, fp));
+    for (k = 0; ok && (k < save_num_tgts); ++k) {
+        memset(b, 0, sizeof(b));
+        snprintf((char *)b, SMP_MAX_DEVICE_NAME, "%s", save_tgts[k].name);
+        sg_put_unaligned_be64(save_tgts[k].sa, b + SMP_MAX_DEVICE_NAME);
+        sg_put_unaligned_be32(save_tgts[k].subvalue,
+                              b + SMP_MAX_DEVICE_NAME + 8);
+        ok = (1 == fwrite(b, SNAP_TGT_LEN, 1, fp));
+    }
+    for (off = 0, k = 0; ok && (k < save_num_recs); ++k) {
+        srp = save_recs + k;
+        memset(b, 0, SNAP_IDX_LEN);
+        sg_put_unaligned_be64(save_tgts[srp->tgt].sa, b + 0);
+        sg_put_unaligned_be16(srp->tgt, b + 8);
+        b[10] = srp->func;
+        sg_put_unaligned_be16(srp->phy_id, b + 12);
+        sg_put_unaligned_be16(srp->req_len, b + 14);
+        sg_put_unaligned_be16(srp->resp_len, b + 16);
+        sg_put_unaligned_be32(off, b + 20);
+        sg_put_unaligned_be32(srp->seq, b + 24);
+        ok = (1 == fwrite(b, SNAP_IDX_LEN, 1, fp));
+        off += (srp->req_len + srp->resp_len + 3) & ~3;
+    }
+    memset(b, 0, 4);
+    for (k = 0; ok && (k < save_num_recs); ++k) {
+        srp = save_recs + k;
+        ok = (1 == fwrite(srp->data, srp->req_len + srp->resp_len, 1, fp));
+        res = (srp->req_len + srp->resp_len) & 3;
+        if (ok && res)
+            ok = (1 == fwrite(b, 4 - res, 1, fp));
+    }
+    if (fclose(fp) || (! ok) || rename(fn, save_fn)) {
+        pr2ws("%s: unable to write %s: %s\n", __func__, save_fn,
+              safe_strerror_r(errno, e, sizeof(e)));
+        remove(fn);
+        res = SMP_LIB_FILE_ERROR;
+        goto fini;
+    }
+    if (verbose)
+        pr2ws("%s: %d responses from %d target%s written to %s\n", __func__,
+              save_num_recs, save_num_tgts, ((1 == save_num_tgts) ? "" : "s"),
+              save_fn);
+    res = 0;
+fini:
+    save_free();
+    pthread_mutex_unlock(&snap_mtx);
+    return res;
+}
+
+int
+smp_snap_load(const char * fn, int verbose)
+{
+    int fd;
+    uint32_t tgt_off, idx_off;
+    uint64_t n;
+    void * p;
+    const uint8_t * bp;
+    struct stat st;
+    char e[128];
+
+    if ((NULL == fn) || map_base)
+        return -1;
+    if ((fd = open(fn, O_RDONLY)) < 0) {
+        pr2ws("%s: unable to open %s: %s\n", __func__, fn,
+              safe_strerror_r(errno, e, sizeof(e)));
+        return SMP_LIB_FILE_ERROR;
+    }
+    if (fstat(fd, &st) < 0) {
+        pr2ws("%s: fstat of %s: %s\n", __func__, fn,
+              safe_strerror_r(errno, e, sizeof(e)));
+        close(fd);
+        return SMP_LIB_FILE_ERROR;
+    }
+    if (st.st_size < SNAP_HDR_LEN) {
+        close(fd);
+        goto bad;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == p) {
+        pr2ws("%s: mmap of %s: %s\n", __func__, fn,
+              safe_strerror_r(errno, e, sizeof(e)));
+        return SMP_LIB_FILE_ERROR;
+    }
+    bp = (const uint8_t *)p;
+    map_len = st.st_size;
+    map_num_tgts = sg_get_unaligned_be32(bp + 16);
+    map_num_recs = sg_get_unaligned_be32(bp + 20);
+    tgt_off = sg_get_unaligned_be32(bp + 24);
+    idx_off = sg_get_unaligned_be32(bp + 28);
+    map_data_off = sg_get_unaligned_be32(bp + 32);
+    if (memcmp(bp, SNAP_MAGIC, 8) ||
+        (SNAP_VERSION != sg_get_unaligned_be32(bp + 8)) ||
+        (map_num_tgts < 1) || (map_num_tgts > SNAP_MAX_TGTS) ||
+        (map_num_recs < 0))
+        goto bad_unmap;
+    n = (uint64_t)tgt_off + ((uint64_t)map_num_tgts * SNAP_TGT_LEN);
+    if ((tgt_off < SNAP_HDR_LEN) || (n > idx_off))
+        goto bad_unmap;
+    n = (uint64_t)idx_off + ((uint64_t)map_num_recs * SNAP_IDX_LEN);
+    if ((n > map_data_off) || (map_data_off > map_len))
+        goto bad_unmap;
+    map_base = bp;
+    map_tgts = bp + tgt_off;
+    map_idx = bp + idx_off;
+    if (verbose)
+        pr2ws("%s: %d responses from %d target%s in %s\n", __func__,
+              map_num_recs, map_num_tgts, ((1 == map_num_tgts) ? "" : "s"),
+              fn);
+    return 0;
+
+bad_unmap:
+    munmap(p, map_len);
+bad:
+    pr2ws("%s: %s is not a SMP snapshot\n", __func__, fn);
+    return SMP_LIB_FILE_ERROR;
+}
+
+void
+smp_snap_unload(void)
+{
+    if (map_base) {
+        munmap((void *)map_base, map_len);
+        map_base = NULL;
+    }
+}
+
+bool
+smp_snap_replaying(void)
+{
+    return (NULL != map_base);
+}
+
+bool
+smp_snap_member(const struct smp_target_obj * tobj)
+{
+    return tobj && tobj->opened &&
+           (SMP_SNAP_INTERFACE == tobj->interface_selector);
+}
+
+int
+smp_snap_open(const char * device_name, int subvalue, uint64_t sa,
+              struct smp_target_obj * tobj, int verbose)
+{
+    int k;
+    uint64_t t_sa;
+    const uint8_t * tp = NULL;
+
+    if ((NULL == map_base) || (NULL == tobj))
+        return -1;
+    for (k = 0; k < map_num_tgts; ++k) {
+        tp = map_tgts + (k * SNAP_TGT_LEN);
+        t_sa = sg_get_unaligned_be64(tp + SMP_MAX_DEVICE_NAME);
+        if (device_name && device_name[0]) {
+            if ((0 == strncmp((const char *)tp, device_name,
+                              SMP_MAX_DEVICE_NAME)) &&
+                ((int)sg_get_unaligned_be32(tp + SMP_MAX_DEVICE_NAME + 8) ==
+                 subvalue) &&
+                ((0 == sa) || (0 == t_sa) || (sa == t_sa)))
+                break;
+        } else if ((0 == sa) || (sa == t_sa))
+            break;      /* with neither, the first target */
+    }
+    if (k >= map_num_tgts) {
+        if (device_name && device_name[0])
+            pr2ws("%s: %s not in snapshot\n", __func__, device_name);
+        else
+            pr2ws("%s: SAS address 0x%" PRIx64 " not in snapshot\n",
+                  __func__, sa);
+        return -1;
+    }
+    memset(tobj, 0, sizeof(struct smp_target_obj));
+    snprintf(tobj->device_name, sizeof(tobj->device_name), "%.*s",
+             SMP_MAX_DEVICE_NAME - 1, (const char *)tp);
+    tobj->subvalue = sg_get_unaligned_be32(tp + SMP_MAX_DEVICE_NAME + 8);
+    memcpy(tobj->sas_addr, tp + SMP_MAX_DEVICE_NAME, 8);
+    if ((0 == t_sa) && sa)
+        sg_put_unaligned_be64(sa, tobj->sas_addr);
+    tobj->interface_selector = SMP_SNAP_INTERFACE;
+    tobj->fd = k;       /* index of target in snapshot */
+    tobj->opened = 1;
+    smp_stats_attach(tobj);
+    smp_req_policy_init(tobj);
+    if (verbose > 1)
+        pr2ws("%s: %s from snapshot\n", __func__, tobj->device_name);
+    return 0;
+}
+
+/* Compares (sa, func, phy_id) with index entry ip */
+static int
+idx_cmp(uint64_t sa, int func, int phy_id, const uint8_t * ip)
+{
+    uint64_t i_sa = sg_get_unaligned_be64(ip + 0);
+    int i_phy_id = sg_get_unaligned_be16(ip + 12);
+
+    if (sa != i_sa)
+        return (sa < i_sa) ? -1 : 1;
+    if (func != ip[10])
+        return func - ip[10];
+    return phy_id - i_phy_id;
+}
+
+/* Builds the DISCOVER response of phy_id in rresp from a long (type 0)
+ * descriptor of a recorded DISCOVER LIST response, as 'smp_discover -m
+ * --save' records those rather than DISCOVER. tgt is the target index,
+ * only used when sa is 0. Returns the record's sequence number, or -1 if
+ * no recorded DISCOVER LIST has that phy. */
+static int
+dlist_discover(uint64_t sa, int tgt, int phy_id, struct smp_req_resp * rresp)
+{
+    int k, j, num, desc_len, len;
+    uint32_t off;
+    const uint8_t * ip;
+    const uint8_t * rp;
+    const uint8_t * dp;
+
+    for (k = 0; k < map_num_recs; ++k) {
+        ip = map_idx + (k * SNAP_IDX_LEN);
+        if ((sa != sg_get_unaligned_be64(ip + 0)) ||
+            (SMP_FN_DISCOVER_LIST != ip[10]) ||
+            ((0 == sa) && ((int)sg_get_unaligned_be16(ip + 8) != tgt)))
+            continue;
+        off = map_data_off + sg_get_unaligned_be32(ip + 20) +
+              sg_get_unaligned_be16(ip + 14);
+        len = sg_get_unaligned_be16(ip + 16);
+        if (((uint64_t)off + len > map_len) || (len < 48))
+            continue;
+        rp = map_base + off;
+        num = rp[9];
+        desc_len = rp[12] * 4;
+        if ((SMP_FRAME_TYPE_RESP != rp[0]) || rp[2] || (rp[11] & 0xf) ||
+            (desc_len < 12) || (len < (48 + (num * desc_len))))
+            continue;
+        /* a descriptor per phy unless filtered, so search them all */
+        for (j = 0, dp = rp + 48; j < num; ++j, dp += desc_len) {
+            if (dp[9] != phy_id)
+                continue;
+            len = desc_len;
+            if (len > (rresp->max_response_len - 4))
+                len = rresp->max_response_len - 4;
+            if (len < 4)
+                return -1;
+            memset(rresp->response, 0, len + 4);
+            memcpy(rresp->response, dp, len);
+            /* the descriptor's byte 2 is the phy's function result; the
+             * frame type and function may be zero and byte 3 short */
+            rresp->response[0] = SMP_FRAME_TYPE_RESP;
+            rresp->response[1] = SMP_FN_DISCOVER;
+            rresp->response[3] = (len - 4) / 4;
+            rresp->act_response_len = len + 4;  /* zero CRC */
+            return (int)sg_get_unaligned_be32(ip + 24);
+        }
+    }
+    return -1;
+}
+
+int
+smp_snap_send_req(const struct smp_target_obj * tobj,
+                  struct smp_req_resp * rresp, int verbose)
+{
+    int lo, hi, mid, func, phy_id, req_len, len, seq;
+    uint32_t off;
+    uint64_t sa, start_us;
+    const uint8_t * ip;
+    const uint8_t * best = NULL;
+    const uint8_t * dp;
+    const uint8_t * req;
+
+    if ((NULL == map_base) || (! smp_snap_member(tobj)) || (NULL == rresp) ||
+        (NULL == rresp->request) || (rresp->request_len < 8) ||
+        (tobj->fd < 0) || (tobj->fd >= map_num_tgts))
+        return -1;
+    start_us = smp_stats_clock_us();
+    req = rresp->request;
+    req_len = rresp->request_len;
+    func = req[1];
+    phy_id = req_phy_id(req, req_len);
+    sa = sg_get_unaligned_be64(map_tgts + (tobj->fd * SNAP_TGT_LEN) +
+                               SMP_MAX_DEVICE_NAME);
+    /* lower bound of (sa, func, phy_id) */
+    for (lo = 0, hi = map_num_recs; lo < hi; ) {
+        mid = lo + ((hi - lo) / 2);
+        if (idx_cmp(sa, func, phy_id, map_idx + (mid * SNAP_IDX_LEN)) > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    /* prefer the same request bytes after the header, ignoring the
+     * allocated response length (byte 2) and CRC */
+    for ( ; lo < map_num_recs; ++lo) {
+        ip = map_idx + (lo * SNAP_IDX_LEN);
+        if (idx_cmp(sa, func, phy_id, ip))
+            break;
+        if ((0 == sa) && ((int)sg_get_unaligned_be16(ip + 8) != tobj->fd))
+            continue;   /* SAS address never learnt, same target only */
+        off = map_data_off + sg_get_unaligned_be32(ip + 20);
+        len = sg_get_unaligned_be16(ip + 14);
+        if (((uint64_t)off + len + sg_get_unaligned_be16(ip + 16)) >
+            map_len)
+            continue;
+        dp = map_base + off;
+        if ((len == req_len) && (0 == memcmp(dp + 4, req + 4, len - 8))) {
+            best = ip;
+            break;
+        }
+        if ((NULL == best) && (SMP_FN_DISCOVER_LIST != func))
+            best = ip;
+    }
+    if (best) {
+        off = map_data_off + sg_get_unaligned_be32(best + 20);
+        dp = map_base + off + sg_get_unaligned_be16(best + 14);
+        len = sg_get_unaligned_be16(best + 16);
+        if (len > rresp->max_response_len)
+            len = rresp->max_response_len;
+        memcpy(rresp->response, dp, len);
+        rresp->act_response_len = len;
+        seq = (int)sg_get_unaligned_be32(best + 24);
+    } else if ((SMP_FN_DISCOVER == func) && (SNAP_NO_PHY != phy_id) &&
+               ((seq = dlist_discover(sa, tobj->fd, phy_id, rresp)) >= 0))
+        len = rresp->act_response_len;
+    else {
+        /* not verbose dependent: the utilities only say the request
+         * failed */
+        if (SNAP_NO_PHY == phy_id)
+            pr2ws("%s (function 0x%x) not in snapshot\n",
+                  smp_get_func_name(func), func);
+        else
+            pr2ws("%s (function 0x%x) for phy %d not in snapshot\n",
+                  smp_get_func_name(func), func, phy_id);
+        return -1;
+    }
+    rresp->transport_err = 0;
+    if (verbose > 3)
+        pr2ws("%s: function 0x%x, record %d, %d bytes%s\n", __func__, func,
+              seq, len, best ? "" : " (from DISCOVER LIST)");
+    smp_stats_note(tobj, rresp, 0, false, start_us);
+    smp_rg_cache_note(tobj, rresp);
+    smp_snap_note(tobj, rresp, 0);      /* recording a replay (subset) */
+    return 0;
+}
+
+int
+smp_snap_close(struct smp_target_obj * tobj)
+{
+    if (! smp_snap_member(tobj))
+        return -1;
+    smp_stats_free(tobj);
+    smp_rg_cache_free(tobj);
+    smp_buf_free(tobj);
+    tobj->opened = 0;
+    return 0;
+}
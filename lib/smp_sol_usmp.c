@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2018, Douglas Gilbert
+ * Copyright (c) 2006-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -27,7 +27,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <ctype.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -41,6 +43,7 @@
 #endif
 #include "smp_lib.h"
 #include "sg_unaligned.h"
+#include "sg_pr2serr.h"
 
 #define I_USMP 1
 #define DEF_USMP_TIMEOUT 60 /* seconds  */
@@ -53,63 +56,46 @@
 #define USMP_IO USMPFUNC
 #endif
 
-int
-smp_initiator_open(const char * device_name, int subvalue,
-                   const char * i_params, uint64_t sa,
-                   struct smp_target_obj * tobj, int verbose)
+static int
+usmp_open(const char * device_name, int subvalue, const char * i_params,
+          uint64_t sa, struct smp_target_obj * tobj, int verbose)
 {
     int res;
 
-    if (i_params) { ; }       /* unused, suppress warning */
-    if ((NULL == tobj) || (NULL == device_name))
+    if (subvalue || i_params || sa) { ; }   /* unused, suppress warning */
+    res = open(device_name, O_RDWR);
+    if (res < 0) {
+        smp_perror("smp_initiator_open(usmp): open() failed");
+        if (verbose)
+            pr2ws("tried to open %s\n", device_name);
         return -1;
-    memset(tobj, 0, sizeof(struct smp_target_obj));
-    strncpy(tobj->device_name, device_name, SMP_MAX_DEVICE_NAME);
-    if (sa)
-        sg_put_unaligned_be64(sa, tobj->sas_addr + 0);
-    tobj->interface_selector = I_USMP;
-    if (I_USMP == tobj->interface_selector) {
-        res = open(tobj->device_name, O_RDWR);
-        if (res < 0) {
-            perror("smp_initiator_open(usmp): open() failed");
-            if (verbose)
-                fprintf(stderr, "tried to open %s\n", tobj->device_name);
-            return -1;
-        }
-        tobj->fd = res;
-        tobj->subvalue = subvalue;
-        tobj->opened = 1;
-        return 0;
-    } else
-        fprintf(stderr, "bad interface selector: %d\n",
-                tobj->interface_selector);
-    return -1;
+    }
+    tobj->fd = res;
+    return 0;
 }
 
-int
-smp_send_req(const struct smp_target_obj * tobj,
-             struct smp_req_resp * rresp, int verbose)
+/* One attempt at sending rresp, there is no index of SAS address to device
+ * here so no name_by_sa(). */
+static int
+usmp_send(const struct smp_target_obj * tobj, struct smp_req_resp * rresp,
+          bool * timed_outp, int verbose)
 {
     struct usmp_cmd urr;
 
-    if ((NULL == tobj) || (0 == tobj->opened)) {
-        if (verbose > 2)
-            fprintf(stderr, "smp_send_req: nothing open??\n");
-        return -1;
-    }
-    if (I_USMP != tobj->interface_selector) {
-        fprintf(stderr, "bad interface selector: %d\n",
-                tobj->interface_selector);
-        return -1;
-    }
+    if (verbose) { ; }          /* unused, suppress warning */
     memset(&urr, 0, sizeof(urr));
     urr.usmp_req = rresp->request;
-    urr.usmp_reqsize = rresp->request_len; /* header+payload+CRC in bytes */
+    /* header+payload+CRC in bytes */
+    urr.usmp_reqsize = rresp->request_len;
     urr.usmp_rsp = rresp->response;
     urr.usmp_rspsize = rresp->max_response_len;
-    urr.usmp_timeout = DEF_USMP_TIMEOUT;
+    /* usmp timeout is in seconds, round up */
+    urr.usmp_timeout = (tobj->timeout_ms > 0) ?
+                       ((tobj->timeout_ms + 999) / 1000) :
+                       DEF_USMP_TIMEOUT;
     if (ioctl(tobj->fd, USMP_IO, &urr) < 0) {
-        perror("smp_send_req: ioctl(USMPCMD)");
+        *timed_outp = (ETIMEDOUT == errno);
+        smp_perror("smp_send_req: ioctl(USMPCMD)");
         return -1;
     }
     rresp->act_response_len = -1;
@@ -117,23 +103,26 @@ smp_send_req(const struct smp_target_obj * tobj,
     return 0;
 }
 
-int
-smp_initiator_close(struct smp_target_obj * tobj)
+static int
+usmp_close(struct smp_target_obj * tobj)
 {
-    int res;
-
-    if ((NULL == tobj) || (0 == tobj->opened)) {
-        fprintf(stderr, "smp_initiator_close(usmp): nothing open??\n");
-        return -1;
-    }
-    if (I_USMP != tobj->interface_selector) {
-        fprintf(stderr, "bad interface selector: %d\n",
-                tobj->interface_selector);
-        return -1;
-    }
-    res = close(tobj->fd);
-    if (res < 0)
-        perror("smp_initiator_close(usmp): failed\n");
-    tobj->opened = 0;
+    if (close(tobj->fd) < 0)
+        smp_perror("smp_initiator_close(usmp): failed\n");
     return 0;
 }
+
+static const struct smp_xport_ops usmp_xport = {
+    .name = "usmp",
+    .prefix = {"usmp", NULL},
+    .selector = I_USMP,
+    .flags = SMP_XPORT_AUTO | SMP_XPORT_TIMEOUT,
+    .open = usmp_open,
+    .send = usmp_send,
+    .close = usmp_close,
+};
+
+void
+smp_xport_native_init(void)
+{
+    smp_xport_register(&usmp_xport);
+}
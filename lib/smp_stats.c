@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* Request statistics. Each smp_send_req() implementation times the pass
+ * through call and passes the outcome to smp_stats_note() which keeps, per
+ * SMP function code, counts of requests, failures, transport errors, BUSY
+ * and other function results, timeouts and a histogram of latencies in
+ * log2 microsecond buckets. They are kept per target object (copies made
+ * by a session share the session's) and the mutex is needed since
+ * smp_send_req_batch() sends from several threads. When the SMP_UTILS_STATS
+ * environment variable is set smp_initiator_close() appends them to the
+ * file it names ("-" for stderr). */
+
+struct smp_stats_blk {
+    pthread_mutex_t mtx;
+    struct smp_stats st;
+};
+
+uint64_t
+smp_stats_clock_us(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        return 0;
+    return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+void
+smp_stats_attach(struct smp_target_obj * tobj)
+{
+    struct smp_stats_blk * bp;
+
+    if ((NULL == tobj) || tobj->statsp)
+        return;
+    bp = (struct smp_stats_blk *)calloc(1, sizeof(*bp));
+    if (NULL == bp)
+        return;         /* statistics are not worth failing an open for */
+    pthread_mutex_init(&bp->mtx, NULL);
+    bp->st.start_us = smp_stats_clock_us();
+    tobj->statsp = bp;
+}
+
+void
+smp_stats_note(const struct smp_target_obj * tobj,
+               const struct smp_req_resp * rresp, int res, bool timed_out,
+               uint64_t start_us)
+{
+    int func, k;
+    uint64_t us, now;
+    uint32_t n;
+    const uint8_t * rp;
+    struct smp_stats_blk * bp;
+    struct smp_func_stats * fsp;
+
+    if ((NULL == tobj) || (NULL == (bp = tobj->statsp)) || (NULL == rresp) ||
+        (NULL == rresp->request) || (rresp->request_len < 2))
+        return;
+    now = smp_stats_clock_us();
+    us = (now > start_us) ? (now - start_us) : 0;
+    func = rresp->request[1];
+    rp = rresp->response;
+    for (k = 0, n = us; (n > 1) && (k < (SMP_STATS_HIST_LEN - 1)); n >>= 1)
+        ++k;
+    pthread_mutex_lock(&bp->mtx);
+    fsp = bp->st.fn + func;
+    ++fsp->count;
+    fsp->total_us += us;
+    if (us > fsp->max_us)
+        fsp->max_us = (us > UINT32_MAX) ? UINT32_MAX : us;
+    ++fsp->hist[k];
+    if (timed_out)
+        ++fsp->timeout;
+    if (res)
+        ++fsp->send_fail;
+    else if (rresp->transport_err)
+        ++fsp->transport_err;
+    else if (rp && ((rresp->act_response_len < 0) ||
+                    (rresp->act_response_len > 2)) &&
+             (SMP_FRAME_TYPE_RESP == rp[0]) && rp[2]) {
+        if (SMP_FRES_BUSY == rp[2])
+            ++fsp->busy;
+        else
+            ++fsp->fres_err;
+    }
+    pthread_mutex_unlock(&bp->mtx);
+}
+
+int
+smp_get_stats(const struct smp_target_obj * tobj, struct smp_stats * sp)
+{
+    struct smp_stats_blk * bp;
+
+    if ((NULL == tobj) || (NULL == (bp = tobj->statsp)) || (NULL == sp))
+        return -1;
+    pthread_mutex_lock(&bp->mtx);
+    memcpy(sp, &bp->st, sizeof(*sp));
+    pthread_mutex_unlock(&bp->mtx);
+    return 0;
+}
+
+void
+smp_reset_stats(const struct smp_target_obj * tobj)
+{
+    struct smp_stats_blk * bp;
+
+    if ((NULL == tobj) || (NULL == (bp = tobj->statsp)))
+        return;
+    pthread_mutex_lock(&bp->mtx);
+    memset(&bp->st, 0, sizeof(bp->st));
+    bp->st.start_us = smp_stats_clock_us();
+    pthread_mutex_unlock(&bp->mtx);
+}
+
+/* One line per SMP function used, in "name=value" form so it is easy to
+ * grep and to split. The histogram lists non-empty buckets as
+ * LOWER_US:COUNT, the bucket holding latencies from LOWER_US up to twice
+ * that. */
+int
+smp_dump_stats(const struct smp_target_obj * tobj, FILE * fp)
+{
+    int f, k, n;
+    uint64_t elapsed;
+    const struct smp_func_stats * fsp;
+    struct smp_stats st;
+
+    if (smp_get_stats(tobj, &st) || (NULL == fp))
+        return -1;
+    elapsed = smp_stats_clock_us() - st.start_us;
+    fprintf(fp, "# smp_utils stats: device=%s sas_addr=0x%" PRIx64
+            " elapsed_ms=%" PRIu64 "\n", tobj->device_name,
+            sg_get_unaligned_be64(tobj->sas_addr), elapsed / 1000);
+    for (f = 0; f < SMP_STATS_NUM_FUNCS; ++f) {
+        fsp = st.fn + f;
+        if (0 == fsp->count)
+            continue;
+        fprintf(fp, "func=0x%02x name=\"%s\" count=%u fail=%u "
+                "transport_err=%u busy=%u fres_err=%u timeout=%u avg_us=%"
+                PRIu64 " max_us=%u hist=", f, smp_get_func_name(f), fsp->count,
+                fsp->send_fail, fsp->transport_err, fsp->busy, fsp->fres_err,
+                fsp->timeout, fsp->total_us / fsp->count, fsp->max_us);
+        for (k = 0, n = 0; k < SMP_STATS_HIST_LEN; ++k) {
+            if (fsp->hist[k])
+                fprintf(fp, "%s%u:%u", (n++ ? "," : ""),
+                        (k ? (1U << k) : 0), fsp->hist[k]);
+        }
+        fprintf(fp, "\n");
+    }
+    return ferror(fp) ? -1 : 0;
+}
+
+void
+smp_stats_free(struct smp_target_obj * tobj)
+{
+    const char * cp;
+    FILE * fp;
+    struct smp_stats_blk * bp;
+
+    if ((NULL == tobj) || (NULL == (bp = tobj->statsp)))
+        return;
+    cp = getenv("SMP_UTILS_STATS");
+    if (cp && *cp) {
+        if (0 == strcmp(cp, "-"))
+            smp_dump_stats(tobj, stderr);
+        else if ((fp = fopen(cp, "a"))) {
+            smp_dump_stats(tobj, fp);
+            fclose(fp);
+        } else
+            pr2ws("SMP_UTILS_STATS: unable to open %s\n", cp);
+    }
+    pthread_mutex_destroy(&bp->mtx);
+    free(bp);
+    tobj->statsp = NULL;
+}
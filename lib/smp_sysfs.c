@@ -0,0 +1,490 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1   /* for cpu_set_t and sched_setaffinity() */
+#endif
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <sched.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#ifdef SMP_LIB_LINUX
+#include <sys/syscall.h>
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* The Linux SAS transport class names an expander "expander-H:T" (H is
+ * the SCSI host number) and each of its phys "phy-H:T:N" in
+ * /sys/class/sas_phy . A phy's 'port' link leads to the port it belongs
+ * to; that holds the attached end device or expander, whose SAS address,
+ * phy identifier, type and protocols are under /sys/class/sas_device .
+ * Phys of a wide port, and those attached to the expander's parent (which
+ * have no port of their own), don't say which attached phy they are
+ * linked to, so their attached fields are left to DISCOVER. The
+ * SMP_UTILS_SYSFS environment variable replaces "/sys" (e.g. to test on a
+ * copy of another machine's tree). On other OSes nothing is found. */
+
+#define SYSFS_DEF_ROOT "/sys"
+
+static const char *
+sysfs_root(void)
+{
+    const char * cp = getenv("SMP_UTILS_SYSFS");
+
+    return (cp && *cp) ? cp : SYSFS_DEF_ROOT;
+}
+
+/* Reads the first line of dir/name into b, without its newline. Returns
+ * 0 if ok, else -1 . */
+static int
+sysfs_read(const char * dir, const char * name, char * b, int blen)
+{
+    int len;
+    FILE * fp;
+    char fn[320];
+
+    snprintf(fn, sizeof(fn), "%s/%s", dir, name);
+    if (NULL == (fp = fopen(fn, "r")))
+        return -1;
+    if (NULL == fgets(b, blen, fp)) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    len = strlen(b);
+    if ((len > 0) && ('\n' == b[len - 1]))
+        b[len - 1] = '\0';
+    return 0;
+}
+
+static const struct smp_val_name sysfs_lrate_arr[] = {
+    {0x0, "Unknown"},
+    {0x1, "Phy disabled"},
+    {0x2, "Link Rate failed"},
+    {0x3, "Spin-up hold"},
+    {0x8, "1.5 Gbit"},
+    {0x9, "3.0 Gbit"},
+    {0xa, "6.0 Gbit"},
+    {0xb, "12.0 Gbit"},
+    {0xc, "22.5 Gbit"},
+    {-1, NULL},
+};
+
+/* Returns the SAS link rate code of the sysfs link rate string in b, or
+ * -1 if none matches. */
+static int
+sysfs_lrate(const char * b)
+{
+    const struct smp_val_name * vnp;
+
+    for (vnp = sysfs_lrate_arr; vnp->name; ++vnp) {
+        if (0 == strcmp(b, vnp->name))
+            return vnp->value;
+    }
+    return -1;
+}
+
+/* Returns the SMP_DV_* bits of a protocols string such as "ssp, smp" */
+static uint8_t
+sysfs_protos(const char * b)
+{
+    uint8_t v = 0;
+
+    if (strstr(b, "sata"))
+        v |= SMP_DV_SATA;
+    if (strstr(b, "smp"))
+        v |= SMP_DV_SMP;
+    if (strstr(b, "stp"))
+        v |= SMP_DV_STP;
+    if (strstr(b, "ssp"))
+        v |= SMP_DV_SSP;
+    return v;
+}
+
+/* Finds the host and target numbers of the expander tobj was opened on,
+ * from its device name (e.g. "/dev/bsg/expander-6:0") or else, when the
+ * transport can map a SAS address to a name, from its SAS address.
+ * Returns 0 if found, else -1 . */
+static int
+sysfs_expander(const struct smp_target_obj * tobj, int * hostp, int * tgtp,
+               int verbose)
+{
+    uint64_t sa;
+    const char * cp;
+    char b[SMP_MAX_DEVICE_NAME];
+
+    cp = strrchr(tobj->device_name, '/');
+    cp = cp ? (cp + 1) : tobj->device_name;
+    if (2 == sscanf(cp, "expander-%d:%d", hostp, tgtp))
+        return 0;
+    sa = sg_get_unaligned_be64(tobj->sas_addr);
+    if (sa && tobj->xops && tobj->xops->name_by_sa &&
+        (0 == tobj->xops->name_by_sa(sa, b, sizeof(b), verbose))) {
+        cp = strrchr(b, '/');
+        cp = cp ? (cp + 1) : b;
+        if (2 == sscanf(cp, "expander-%d:%d", hostp, tgtp))
+            return 0;
+    }
+    if (verbose > 2)
+        pr2ws("%s: %s not found in sysfs\n", __func__, tobj->device_name);
+    return -1;
+}
+
+int
+smp_sysfs_num_phys(const struct smp_target_obj * tobj, int verbose)
+{
+    int host, tgt, h, t, n;
+    int num = -1;
+    DIR * dirp;
+    struct dirent * dep;
+    char b[256];
+
+    if (sysfs_expander(tobj, &host, &tgt, verbose))
+        return -1;
+    snprintf(b, sizeof(b), "%s/class/sas_phy", sysfs_root());
+    if (NULL == (dirp = opendir(b)))
+        return -1;
+    while ((dep = readdir(dirp))) {
+        if ((3 == sscanf(dep->d_name, "phy-%d:%d:%d", &h, &t, &n)) &&
+            (h == host) && (t == tgt) && (n >= num))
+            num = n + 1;
+    }
+    closedir(dirp);
+    return num;
+}
+
+/* Fills the attached fields of vp from the port that the phy in phy_dir
+ * belongs to. Returns true if there is one attached phy to describe. */
+static bool
+sysfs_attached(const char * phy_dir, struct smp_discover_view * vp)
+{
+    int nphys = 0;
+    DIR * dirp;
+    struct dirent * dep;
+    char dev[320];
+    char b[320];
+    char child[64];
+
+    snprintf(b, sizeof(b), "%s/device/port", phy_dir);
+    if (NULL == (dirp = opendir(b)))
+        return false;
+    child[0] = '\0';
+    while ((dep = readdir(dirp))) {
+        if (0 == strncmp(dep->d_name, "phy-", 4))
+            ++nphys;
+        else if ((0 == strncmp(dep->d_name, "end_device-", 11)) ||
+                 (0 == strncmp(dep->d_name, "expander-", 9)))
+            snprintf(child, sizeof(child), "%.63s", dep->d_name);
+    }
+    closedir(dirp);
+    if ((nphys > 1) || ('\0' == child[0]))
+        return false;
+    snprintf(dev, sizeof(dev), "%s/class/sas_device/%s", sysfs_root(),
+             child);
+    if (sysfs_read(dev, "sas_address", b, sizeof(b)))
+        return false;
+    vp->att_sas_addr = strtoull(b, NULL, 16);
+    if (sysfs_read(dev, "phy_identifier", b, sizeof(b)))
+        return false;
+    vp->att_phy_id = atoi(b);
+    if (sysfs_read(dev, "device_type", b, sizeof(b)))
+        return false;
+    if (0 == strcmp(b, "end device"))
+        vp->att_dev_type = 1;
+    else if (0 == strcmp(b, "edge expander"))
+        vp->att_dev_type = 2;
+    else if (0 == strcmp(b, "fanout expander"))
+        vp->att_dev_type = 3;
+    else
+        return false;
+    if (0 == sysfs_read(dev, "initiator_port_protocols", b, sizeof(b)))
+        vp->att_init = sysfs_protos(b);
+    if (0 == sysfs_read(dev, "target_port_protocols", b, sizeof(b)))
+        vp->att_targ = sysfs_protos(b);
+    return true;
+}
+
+int
+smp_sysfs_discover(const struct smp_target_obj * tobj, int phy_id,
+                   struct smp_discover_view * vp, int verbose)
+{
+    int host, tgt, k;
+    int ret = 0;
+    char dir[256];
+    char b[128];
+    int lr[5];
+    static const char * lr_names[5] = {"negotiated_linkrate",
+        "minimum_linkrate_hw", "maximum_linkrate_hw", "minimum_linkrate",
+        "maximum_linkrate"};
+
+    memset(vp, 0, sizeof(*vp));
+    vp->src = SMP_DV_SRC_SYSFS;
+    vp->dev_slot_num = 0xff;
+    vp->dev_slot_grp_num = 0xff;
+    if (sysfs_expander(tobj, &host, &tgt, verbose))
+        return 0;
+    snprintf(dir, sizeof(dir), "%s/class/sas_phy/phy-%d:%d:%d", sysfs_root(),
+             host, tgt, phy_id);
+    if (sysfs_read(dir, "phy_identifier", b, sizeof(b))) {
+        if (verbose > 2)
+            pr2ws("%s: no %s\n", __func__, dir);
+        return 0;
+    }
+    vp->phy_id = phy_id;
+    if (0 == sysfs_read(dir, "sas_address", b, sizeof(b))) {
+        vp->sas_addr = strtoull(b, NULL, 16);
+        ret |= SMP_DVF_PHY;
+    }
+    for (k = 0; k < 5; ++k) {
+        if (sysfs_read(dir, lr_names[k], b, sizeof(b)) ||
+            ((lr[k] = sysfs_lrate(b)) < 0))
+            break;
+    }
+    if (5 == k) {
+        vp->neg_log_lrate = lr[0];
+        vp->neg_phy_lrate = lr[0];
+        vp->hw_min_lrate = lr[1];
+        vp->hw_max_lrate = lr[2];
+        vp->prog_min_lrate = lr[3];
+        vp->prog_max_lrate = lr[4];
+        ret |= SMP_DVF_LRATE;
+        /* with the link down nothing is attached */
+        if ((lr[0] < 8) || sysfs_attached(dir, vp))
+            ret |= SMP_DVF_ATT;
+    }
+    if (verbose > 2)
+        pr2ws("%s: %s fields 0x%x\n", __func__, dir, ret);
+    return ret;
+}
+
+/* NUMA placement. An HBA is a PCI device, so it sits on one NUMA node and
+ * its interrupts (and so ioctl and bsg completions) are usually taken by
+ * CPUs on that node. A worker sending to an SMP target behind it does
+ * best running there with its buffers in that node's memory. The SCSI
+ * host of the SMP device is found from its name, then the parents of
+ * /sys/class/scsi_host/host<H> are walked up to the first with a
+ * 'numa_node' attribute (the PCI function). */
+
+/* Returns the SCSI host number of dev_name or -1. The bsg nodes of the
+ * SAS transport class ("expander-H:T", "sas_host<H>", "end_device-H:..")
+ * and of SCSI devices ("H:C:T:L") carry it. The mptctl device stands for
+ * all mptsas HBAs, subvalue picking one: taken here as the subvalue-th
+ * mptsas SCSI host in host number order. */
+static int
+sysfs_host_of(const char * dev_name, int subvalue)
+{
+    int h, k, n;
+    int num = 0;
+    int hosts[64];
+    const char * cp;
+    DIR * dirp;
+    struct dirent * dep;
+    char dir[256];
+    char b[32];
+
+    cp = strrchr(dev_name, '/');
+    cp = cp ? (cp + 1) : dev_name;
+    if ((1 == sscanf(cp, "expander-%d:", &h)) ||
+        (1 == sscanf(cp, "end_device-%d:", &h)) ||
+        (1 == sscanf(cp, "sas_host%d", &h)) ||
+        (2 == sscanf(cp, "%d:%*d:%*d:%d", &h, &n)))
+        return h;
+    if (NULL == strstr(cp, "mptctl"))
+        return -1;
+    snprintf(dir, sizeof(dir), "%s/class/scsi_host", sysfs_root());
+    if (NULL == (dirp = opendir(dir)))
+        return -1;
+    while ((dep = readdir(dirp)) && (num < (int)(sizeof(hosts) /
+                                                 sizeof(hosts[0])))) {
+        if (1 != sscanf(dep->d_name, "host%d", &h))
+            continue;
+        snprintf(dir, sizeof(dir), "%s/class/scsi_host/%.40s", sysfs_root(),
+                 dep->d_name);
+        if (sysfs_read(dir, "proc_name", b, sizeof(b)) ||
+            strcmp(b, "mptsas"))
+            continue;
+        for (k = num++; (k > 0) && (hosts[k - 1] > h); --k)
+            hosts[k] = hosts[k - 1];
+        hosts[k] = h;
+    }
+    closedir(dirp);
+    if (subvalue < 0)
+        subvalue = 0;
+    return (subvalue < num) ? hosts[subvalue] : -1;
+}
+
+int
+smp_sysfs_numa_node(const char * dev_name, int subvalue, int verbose)
+{
+    int host, len;
+    int node = -1;
+    char * cp;
+    char b[32];
+    char dir[PATH_MAX];
+    char path[PATH_MAX];
+
+    if ((NULL == dev_name) || ((host = sysfs_host_of(dev_name, subvalue)) <
+                               0)) {
+        if (verbose > 2)
+            pr2ws("%s: no SCSI host for %s\n", __func__,
+                  dev_name ? dev_name : "<null>");
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/class/scsi_host/host%d", sysfs_root(),
+             host);
+    if (NULL == realpath(path, dir))
+        return -1;
+    len = strlen(sysfs_root());
+    while ((int)strlen(dir) > len) {
+        if (0 == sysfs_read(dir, "numa_node", b, sizeof(b))) {
+            node = atoi(b);
+            break;
+        }
+        if (NULL == (cp = strrchr(dir, '/')))
+            break;
+        *cp = '\0';
+    }
+    if (verbose > 1)
+        pr2ws("%s: %s is on SCSI host %d, NUMA node %d\n", __func__,
+              dev_name, host, node);
+    return (node < 0) ? -1 : node;
+}
+
+#ifdef SMP_LIB_LINUX
+
+/* Parses a sysfs cpulist such as "0-7,16-23" into *csp. Returns the
+ * number of CPUs set. */
+static int
+sysfs_cpulist(const char * b, cpu_set_t * csp)
+{
+    int lo, hi, k;
+    int num = 0;
+    char * ep;
+
+    CPU_ZERO(csp);
+    while (*b) {
+        lo = strtol(b, &ep, 10);
+        if (ep == b)
+            break;
+        hi = lo;
+        if ('-' == *ep)
+            hi = strtol(ep + 1, &ep, 10);
+        for (k = lo; (k <= hi) && (k < CPU_SETSIZE); ++k, ++num)
+            CPU_SET(k, csp);
+        if (',' != *ep)
+            break;
+        b = ep + 1;
+    }
+    return num;
+}
+
+#define SMP_MPOL_PREFERRED 1    /* from <linux/mempolicy.h> */
+
+int
+smp_numa_bind(int node, int verbose)
+{
+    int k;
+    int num_nodes = 0;
+    const char * cp;
+    DIR * dirp;
+    struct dirent * dep;
+    unsigned long mask[4];
+    cpu_set_t cs;
+    char dir[256];
+    char b[1024];
+    char eb[64];
+
+    cp = getenv("SMP_UTILS_NUMA");
+    if ((node < 0) || (cp && ('0' == *cp)))
+        return 1;
+    snprintf(dir, sizeof(dir), "%s/devices/system/node", sysfs_root());
+    if (NULL == (dirp = opendir(dir)))
+        return 1;
+    while ((dep = readdir(dirp))) {
+        if (1 == sscanf(dep->d_name, "node%d", &k))
+            ++num_nodes;
+    }
+    closedir(dirp);
+    if (num_nodes < 2)
+        return 1;       /* nothing to gain from narrowing the choice */
+    snprintf(dir, sizeof(dir), "%s/devices/system/node/node%d", sysfs_root(),
+             node);
+    if (sysfs_read(dir, "cpulist", b, sizeof(b)) ||
+        (sysfs_cpulist(b, &cs) < 1)) {
+        if (verbose)
+            pr2ws("%s: no CPUs on NUMA node %d\n", __func__, node);
+        return -1;
+    }
+    /* pid 0 is the calling thread, not the whole process */
+    if (sched_setaffinity(0, sizeof(cs), &cs) < 0) {
+        if (verbose)
+            pr2ws("%s: sched_setaffinity: %s\n", __func__,
+                  safe_strerror_r(errno, eb, sizeof(eb)));
+        return -1;
+    }
+#ifdef SYS_set_mempolicy
+    /* preferred, not bound: memory comes from elsewhere if node is full */
+    if (node < (int)(8 * sizeof(mask))) {
+        memset(mask, 0, sizeof(mask));
+        mask[node / (8 * sizeof(mask[0]))] |=
+                1UL << (node % (8 * sizeof(mask[0])));
+        if ((syscall(SYS_set_mempolicy, SMP_MPOL_PREFERRED, mask,
+                     8 * sizeof(mask) + 1) < 0) && verbose)
+            pr2ws("%s: set_mempolicy: %s\n", __func__,
+                  safe_strerror_r(errno, eb, sizeof(eb)));
+    }
+#else
+    if (mask) { ; }     /* suppress unused warning */
+#endif
+    if (verbose > 1)
+        pr2ws("%s: bound to NUMA node %d, CPUs %s\n", __func__, node, b);
+    return 0;
+}
+
+#else   /* other OSes: not placed */
+
+int
+smp_numa_bind(int node, int verbose)
+{
+    if (node || verbose) { ; }  /* suppress unused warning */
+    return 1;
+}
+
+#endif
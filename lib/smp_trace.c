@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* Request/response tracing. When started by smp_trace_begin(), or by the
+ * SMP_UTILS_TRACE environment variable naming a file, each smp_send_req()
+ * implementation passes every attempt (so retries show) to
+ * smp_trace_note() which copies the request and response frames, with a
+ * time stamp and the time the pass-through took, into a slot of a ring
+ * buffer. Senders claim slots with a compare and swap (a bounded queue
+ * with a sequence number per slot, as described by D. Vyukov) so they
+ * never wait on a lock, nor on the disk: when the ring is full the record
+ * is dropped and counted. A background thread drains the ring to the
+ * trace file. The file is in the classic pcap format, link type USER0
+ * (147), so generic pcap readers can list it; each packet is a 40 byte
+ * (big endian) header followed by the request then response frames,
+ * both including their CRC fields:
+ *    0: sequence number       4: pass-through duration in microseconds
+ *    8: SAS address of target 16: pass-through result (smp_send_req())
+ *   20: transport_err         24: request length in bytes
+ *   26: response length       28: interface selector
+ *   30: subvalue              32: attempt (0 for first)
+ *   36: flags (bit 0: pass-through timed out)
+ * When tracing is off the cost to smp_send_req() is one load and test. */
+
+#define SMP_TRACE_SLOTS 1024            /* a power of 2 */
+#define SMP_TRACE_FRAME_MAX 1032
+#define SMP_TRACE_PCAP_HDR 16
+#define SMP_TRACE_META_LEN 40
+#define SMP_TRACE_LINKTYPE 147          /* LINKTYPE_USER0 */
+#define SMP_TRACE_FILE_BUFF (256 * 1024)
+
+enum trace_state_e {
+    TRACE_UNCHECKED = 0,        /* SMP_UTILS_TRACE not yet looked at */
+    TRACE_OFF,
+    TRACE_ON,
+};
+
+struct trace_slot {
+    uint64_t seq;
+    uint32_t len;               /* bytes used in b */
+    uint8_t b[SMP_TRACE_PCAP_HDR + SMP_TRACE_META_LEN +
+              (2 * SMP_TRACE_FRAME_MAX)];
+};
+
+struct pcap_file_hdr {          /* host byte order, as pcap expects */
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t network;
+};
+
+/* trace_mtx serializes begin and end, the rest is lock free */
+static pthread_mutex_t trace_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t trace_env_once = PTHREAD_ONCE_INIT;
+static int trace_state = TRACE_UNCHECKED;
+static int trace_writers;       /* senders inside smp_trace_note() */
+static bool trace_stop;
+static bool trace_thr_running;
+static uint32_t trace_rec_seq;
+static uint64_t trace_head;     /* next slot to claim */
+static uint64_t trace_tail;     /* next slot to drain, flush thread only */
+static uint64_t trace_dropped;
+static uint64_t trace_written;
+static uint64_t real_base_us;   /* CLOCK_REALTIME at begin ... */
+static uint64_t mono_base_us;   /* ... and CLOCK_MONOTONIC then */
+static struct trace_slot * trace_ring;
+static FILE * trace_fp;
+static char * trace_fbuff;
+static pthread_t trace_thr;
+
+
+/* Writes completed slots, in order, to the file. Returns number written */
+static int
+drain(void)
+{
+    int n = 0;
+    struct trace_slot * sp;
+
+    for (;;) {
+        sp = trace_ring + (trace_tail & (SMP_TRACE_SLOTS - 1));
+        if (__atomic_load_n(&sp->seq, __ATOMIC_ACQUIRE) != (trace_tail + 1))
+            break;
+        if (sp->len != fwrite(sp->b, 1, sp->len, trace_fp))
+            __atomic_add_fetch(&trace_dropped, 1, __ATOMIC_RELAXED);
+        else
+            ++trace_written;
+        __atomic_store_n(&sp->seq, trace_tail + SMP_TRACE_SLOTS,
+                         __ATOMIC_RELEASE);
+        ++trace_tail;
+        ++n;
+    }
+    return n;
+}
+
+static void *
+flush_thread(void * arg)
+{
+    bool dirty = false;
+    struct timespec ts = {0, 2 * 1000 * 1000};  /* 2 ms */
+
+    if (arg) { ; }      /* unused, suppress warning */
+    for (;;) {
+        if (drain() > 0) {
+            dirty = true;
+            continue;
+        }
+        if (dirty) {
+            fflush(trace_fp);
+            dirty = false;
+        }
+        if (__atomic_load_n(&trace_stop, __ATOMIC_ACQUIRE))
+            break;
+        nanosleep(&ts, NULL);
+    }
+    drain();
+    return NULL;
+}
+
+static void
+trace_atexit(void)
+{
+    smp_trace_end(0);
+}
+
+static void
+trace_env_init(void)
+{
+    const char * cp = getenv("SMP_UTILS_TRACE");
+
+    if (cp && *cp && (0 == smp_trace_begin(cp, 0)))
+        atexit(trace_atexit);
+    else {
+        int expect = TRACE_UNCHECKED;
+
+        __atomic_compare_exchange_n(&trace_state, &expect, TRACE_OFF, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+}
+
+int
+smp_trace_begin(const char * fn, int verbose)
+{
+    int k;
+    struct timespec ts;
+    struct pcap_file_hdr fh;
+
+    if (NULL == fn)
+        return -1;
+    pthread_mutex_lock(&trace_mtx);
+    if (TRACE_ON == __atomic_load_n(&trace_state, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_unlock(&trace_mtx);
+        pr2ws("%s: already tracing\n", __func__);
+        return -1;
+    }
+    trace_ring = (struct trace_slot *)calloc(SMP_TRACE_SLOTS,
+                                             sizeof(struct trace_slot));
+    trace_fbuff = (char *)malloc(SMP_TRACE_FILE_BUFF);
+    if ((NULL == trace_ring) || (NULL == trace_fbuff)) {
+        pr2ws("%s: out of memory\n", __func__);
+        goto err_out;
+    }
+    if (NULL == (trace_fp = fopen(fn, "wb"))) {
+        pr2ws("%s: unable to open %s: %s\n", __func__, fn,
+              safe_strerror(errno));
+        goto err_out;
+    }
+    setvbuf(trace_fp, trace_fbuff, _IOFBF, SMP_TRACE_FILE_BUFF);
+    memset(&fh, 0, sizeof(fh));
+    fh.magic = 0xa1b2c3d4;
+    fh.version_major = 2;
+    fh.version_minor = 4;
+    fh.snaplen = sizeof(trace_ring[0].b) - SMP_TRACE_PCAP_HDR;
+    fh.network = SMP_TRACE_LINKTYPE;
+    if (1 != fwrite(&fh, sizeof(fh), 1, trace_fp)) {
+        pr2ws("%s: unable to write %s\n", __func__, fn);
+        goto err_out;
+    }
+    for (k = 0; k < SMP_TRACE_SLOTS; ++k)
+        trace_ring[k].seq = k;
+    trace_head = 0;
+    trace_tail = 0;
+    trace_dropped = 0;
+    trace_written = 0;
+    trace_rec_seq = 0;
+    trace_stop = false;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    real_base_us = ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+    mono_base_us = smp_stats_clock_us();
+    if (pthread_create(&trace_thr, NULL, flush_thread, NULL)) {
+        pr2ws("%s: unable to start flush thread\n", __func__);
+        goto err_out;
+    }
+    trace_thr_running = true;
+    __atomic_store_n(&trace_state, TRACE_ON, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&trace_mtx);
+    if (verbose)
+        pr2ws("%s: tracing to %s\n", __func__, fn);
+    return 0;
+err_out:
+    if (trace_fp) {
+        fclose(trace_fp);
+        trace_fp = NULL;
+    }
+    free(trace_fbuff);
+    trace_fbuff = NULL;
+    free(trace_ring);
+    trace_ring = NULL;
+    __atomic_store_n(&trace_state, TRACE_OFF, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&trace_mtx);
+    return SMP_LIB_FILE_ERROR;
+}
+
+int
+smp_trace_end(int verbose)
+{
+    int ret = 0;
+    struct timespec ts = {0, 100 * 1000};      /* 100 us */
+
+    pthread_mutex_lock(&trace_mtx);
+    if (TRACE_ON != __atomic_load_n(&trace_state, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_unlock(&trace_mtx);
+        return 0;
+    }
+    __atomic_store_n(&trace_state, TRACE_OFF, __ATOMIC_SEQ_CST);
+    /* senders that saw TRACE_ON finish filling their slots */
+    while (__atomic_load_n(&trace_writers, __ATOMIC_SEQ_CST) > 0)
+        nanosleep(&ts, NULL);
+    if (trace_thr_running) {
+        __atomic_store_n(&trace_stop, true, __ATOMIC_RELEASE);
+        pthread_join(trace_thr, NULL);
+        trace_thr_running = false;
+    }
+    if (fclose(trace_fp))
+        ret = SMP_LIB_FILE_ERROR;
+    trace_fp = NULL;
+    if (trace_dropped || verbose)
+        pr2ws("%s: %" PRIu64 " records written, %" PRIu64 " dropped\n",
+              __func__, trace_written, trace_dropped);
+    free(trace_fbuff);
+    trace_fbuff = NULL;
+    free(trace_ring);
+    trace_ring = NULL;
+    pthread_mutex_unlock(&trace_mtx);
+    return ret;
+}
+
+/* Returns length of the response frame in bytes, including the CRC */
+static int
+resp_frame_len(const struct smp_req_resp * rresp, int res)
+{
+    int len;
+    const uint8_t * rp = rresp->response;
+
+    if (res || rresp->transport_err || (NULL == rp))
+        return 0;
+    if (rresp->act_response_len >= 0)
+        len = rresp->act_response_len;
+    else if (SMP_FRAME_TYPE_RESP != rp[0])
+        return 0;
+    else {
+        len = rp[3];
+        if ((0 == len) && (0 == rp[2]) &&
+            ((len = smp_get_func_def_resp_len(rp[1])) < 0))
+            len = 0;
+        len = 4 + (len * 4) + 4;
+    }
+    if (len > rresp->max_response_len)
+        len = rresp->max_response_len;
+    return (len > SMP_TRACE_FRAME_MAX) ? SMP_TRACE_FRAME_MAX : len;
+}
+
+void
+smp_trace_note(const struct smp_target_obj * tobj,
+               const struct smp_req_resp * rresp, int res, bool timed_out,
+               int attempt, uint64_t start_us)
+{
+    int state, req_len, resp_len;
+    uint32_t u;
+    uint64_t pos, seq, now_us, ts_us;
+    struct trace_slot * sp;
+    uint8_t * bp;
+
+    state = __atomic_load_n(&trace_state, __ATOMIC_RELAXED);
+    if (TRACE_OFF == state)
+        return;
+    if (TRACE_UNCHECKED == state)
+        pthread_once(&trace_env_once, trace_env_init);
+    if ((NULL == tobj) || (NULL == rresp) || (NULL == rresp->request))
+        return;
+    __atomic_add_fetch(&trace_writers, 1, __ATOMIC_SEQ_CST);
+    if (TRACE_ON != __atomic_load_n(&trace_state, __ATOMIC_SEQ_CST))
+        goto fini;
+    now_us = smp_stats_clock_us();
+    pos = __atomic_load_n(&trace_head, __ATOMIC_RELAXED);
+    for (;;) {
+        sp = trace_ring + (pos & (SMP_TRACE_SLOTS - 1));
+        seq = __atomic_load_n(&sp->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&trace_head, &pos, pos + 1,
+                                            true, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;
+        } else if (seq < pos) {         /* full, flush thread behind */
+            __atomic_add_fetch(&trace_dropped, 1, __ATOMIC_RELAXED);
+            goto fini;
+        } else
+            pos = __atomic_load_n(&trace_head, __ATOMIC_RELAXED);
+    }
+    req_len = rresp->request_len;
+    if (req_len > SMP_TRACE_FRAME_MAX)
+        req_len = SMP_TRACE_FRAME_MAX;
+    resp_len = resp_frame_len(rresp, res);
+    ts_us = real_base_us + ((start_us > mono_base_us) ?
+                            (start_us - mono_base_us) : 0);
+    u = SMP_TRACE_META_LEN + req_len + resp_len;
+    bp = sp->b;
+    {   /* pcap record header, host byte order */
+        uint32_t rh[4] = {(uint32_t)(ts_us / 1000000),
+                          (uint32_t)(ts_us % 1000000), u, u};
+
+        memcpy(bp, rh, sizeof(rh));
+    }
+    bp += SMP_TRACE_PCAP_HDR;
+    sg_put_unaligned_be32(__atomic_fetch_add(&trace_rec_seq, 1,
+                                             __ATOMIC_RELAXED), bp + 0);
+    u = (now_us > start_us) ? (now_us - start_us) : 0;
+    sg_put_unaligned_be32(u, bp + 4);
+    memcpy(bp + 8, tobj->sas_addr, 8);
+    sg_put_unaligned_be32((uint32_t)res, bp + 16);
+    sg_put_unaligned_be32((uint32_t)rresp->transport_err, bp + 20);
+    sg_put_unaligned_be16(req_len, bp + 24);
+    sg_put_unaligned_be16(resp_len, bp + 26);
+    sg_put_unaligned_be16(tobj->interface_selector, bp + 28);
+    sg_put_unaligned_be16(tobj->subvalue, bp + 30);
+    sg_put_unaligned_be32(attempt, bp + 32);
+    sg_put_unaligned_be32(timed_out ? 0x1 : 0, bp + 36);
+    memcpy(bp + SMP_TRACE_META_LEN, rresp->request, req_len);
+    if (resp_len > 0)
+        memcpy(bp + SMP_TRACE_META_LEN + req_len, rresp->response,
+               resp_len);
+    sp->len = SMP_TRACE_PCAP_HDR + SMP_TRACE_META_LEN + req_len + resp_len;
+    __atomic_store_n(&sp->seq, pos + 1, __ATOMIC_RELEASE);
+fini:
+    __atomic_sub_fetch(&trace_writers, 1, __ATOMIC_SEQ_CST);
+}
@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* Transport dispatch. Every open target object points at the operations
+ * table of the transport it was opened with, so smp_send_req() and
+ * smp_initiator_close() make one indirect call rather than testing the
+ * interface selector against each pass-through, and the retry, admission,
+ * statistics, trace and snapshot hooks around each request are written
+ * once here for every transport (including loaded ones) instead of once
+ * per OS. Transports are registered before the first open: "sim" and
+ * "smpd" here, the OS's own by smp_xport_native_init(), then any named
+ * by SMP_UTILS_XPORT. The table only grows, so a reader needs no lock. */
+
+#define XPORT_SEL_BASE 0x200    /* selectors assigned to loaded modules */
+
+struct xport_ent {
+    const struct smp_xport_ops * xp;
+    int selector;
+};
+
+static struct xport_ent xport_arr[SMP_XPORT_MAX];
+static int num_xports;
+static pthread_mutex_t xport_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t xport_once = PTHREAD_ONCE_INIT;
+
+
+static int
+sim_xp_send(const struct smp_target_obj * tobj, struct smp_req_resp * rresp,
+            bool * timed_outp, int verbose)
+{
+    if (timed_outp) { ; }       /* unused, the model does not time out */
+    return smp_sim_send_req(tobj, rresp, verbose);
+}
+
+static int
+smpd_xp_send(const struct smp_target_obj * tobj, struct smp_req_resp * rresp,
+             bool * timed_outp, int verbose)
+{
+    if (timed_outp) { ; }       /* unused, smpd does the retries */
+    return smp_smpd_send_req(tobj, rresp, verbose);
+}
+
+static const struct smp_xport_ops sim_xport = {
+    .name = "sim",
+    .prefix = {"sim", NULL},
+    .selector = SMP_SIM_INTERFACE,
+    .flags = SMP_XPORT_NO_DEVICE,
+    .open = smp_sim_open,
+    .send = sim_xp_send,
+    .close = smp_sim_close,
+};
+
+static const struct smp_xport_ops smpd_xport = {
+    .name = "smpd",
+    .prefix = {"smpd", NULL},
+    .selector = SMP_SMPD_INTERFACE,
+    .flags = SMP_XPORT_NO_DEVICE,
+    .open = smp_smpd_open,
+    .send = smpd_xp_send,
+    .close = smp_smpd_close,
+};
+
+int
+smp_xport_register(const struct smp_xport_ops * xp)
+{
+    int n;
+
+    if ((NULL == xp) || (NULL == xp->name) || (NULL == xp->open) ||
+        (NULL == xp->send) || (NULL == xp->close))
+        return -1;
+    pthread_mutex_lock(&xport_mtx);
+    n = num_xports;
+    if (n >= SMP_XPORT_MAX) {
+        pthread_mutex_unlock(&xport_mtx);
+        pr2ws("%s: %s: already %d transports\n", __func__, xp->name, n);
+        return -1;
+    }
+    xport_arr[n].xp = xp;
+    xport_arr[n].selector = xp->selector ? xp->selector :
+                                           (XPORT_SEL_BASE + n);
+    /* publish the entry before the count that makes it visible */
+    __atomic_store_n(&num_xports, n + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&xport_mtx);
+    return 0;
+}
+
+/* Loads each shared object named in SMP_UTILS_XPORT (colon separated)
+ * and calls its smp_xport_module_init(). Objects stay loaded. */
+static void
+load_modules(void)
+{
+    int (*init_fn)(void);
+    void * hp;
+    char * cp;
+    char * sp;
+    char * fname;
+    const char * ccp = getenv("SMP_UTILS_XPORT");
+
+    if ((NULL == ccp) || ('\0' == *ccp))
+        return;
+    if (NULL == (cp = strdup(ccp)))
+        return;
+    for (fname = strtok_r(cp, ":", &sp); fname;
+         fname = strtok_r(NULL, ":", &sp)) {
+        if (NULL == (hp = dlopen(fname, RTLD_NOW | RTLD_LOCAL))) {
+            pr2ws("SMP_UTILS_XPORT: %s\n", dlerror());
+            continue;
+        }
+        *(void **)(&init_fn) = dlsym(hp, "smp_xport_module_init");
+        if (NULL == init_fn) {
+            pr2ws("SMP_UTILS_XPORT: %s: no smp_xport_module_init()\n",
+                  fname);
+            dlclose(hp);
+        } else if (init_fn())
+            pr2ws("SMP_UTILS_XPORT: %s: smp_xport_module_init() failed\n",
+                  fname);
+    }
+    free(cp);
+}
+
+static void
+xport_init(void)
+{
+    smp_xport_register(&sim_xport);
+    smp_xport_register(&smpd_xport);
+    smp_xport_native_init();
+    load_modules();
+}
+
+/* Returns the number of registered transports, registering the library's
+ * own on the first call. */
+static int
+xport_count(void)
+{
+    pthread_once(&xport_once, xport_init);
+    return __atomic_load_n(&num_xports, __ATOMIC_ACQUIRE);
+}
+
+/* Returns the index of the transport whose prefix starts i_params, else
+ * -1 . */
+static int
+xport_match(const char * i_params)
+{
+    int k, j;
+    int n = xport_count();
+    const char * pp;
+
+    if ((NULL == i_params) || ('\0' == i_params[0]))
+        return -1;
+    for (k = 0; k < n; ++k) {
+        for (j = 0; (j < 4) && (pp = xport_arr[k].xp->prefix[j]); ++j) {
+            if (0 == strncmp(pp, i_params, strlen(pp)))
+                return k;
+        }
+    }
+    return -1;
+}
+
+const struct smp_xport_ops *
+smp_xport_get(const struct smp_target_obj * tobj)
+{
+    return tobj ? tobj->xops : NULL;
+}
+
+/* Opens device_name with transport k. Returns 0 on success, else -1 . */
+static int
+xport_open(int k, const char * device_name, int subvalue,
+           const char * i_params, uint64_t sa, struct smp_target_obj * tobj,
+           int verbose)
+{
+    const struct smp_xport_ops * xp = xport_arr[k].xp;
+
+    if (xp->open(device_name, subvalue, i_params, sa, tobj, verbose) < 0)
+        return -1;
+    tobj->interface_selector = xport_arr[k].selector;
+    tobj->xops = xp;
+    tobj->subvalue = subvalue;
+    tobj->opened = 1;
+    smp_stats_attach(tobj);
+    smp_req_policy_init(tobj);
+    if (verbose) {
+        if ((SMP_XPORT_NEEDS_SA & xp->flags) &&
+            (0 == sg_get_unaligned_be64(tobj->sas_addr)))
+            pr2ws("%s: %s interface needs the expander's SAS address\n",
+                  __func__, xp->name);
+        if ((tobj->timeout_ms > 0) && (! (SMP_XPORT_TIMEOUT & xp->flags)))
+            pr2ws("%s: %s interface ignores the timeout\n", __func__,
+                  xp->name);
+    }
+    return 0;
+}
+
+int
+smp_initiator_open(const char * device_name, int subvalue,
+                   const char * i_params, uint64_t sa,
+                   struct smp_target_obj * tobj, int verbose)
+{
+    bool force = false;
+    int k, n, res, named;
+    int len = device_name ? (strlen(device_name) + 1) : 0;
+    const struct smp_xport_ops * xp;
+    const char * cp;
+
+    if ((NULL == tobj) || (NULL == device_name))
+        return -1;
+    if (smp_session_lookup(device_name, subvalue, sa, tobj))
+        return 0;       /* already open in this session */
+    if (smp_snap_replaying())
+        return smp_snap_open(device_name, subvalue, sa, tobj, verbose);
+    n = xport_count();
+    named = xport_match(i_params);
+    if ((named >= 0) && (SMP_XPORT_NO_DEVICE & xport_arr[named].xp->flags)) {
+        xp = xport_arr[named].xp;
+        res = xp->open(device_name, subvalue, i_params, sa, tobj, verbose);
+        if (0 == res)
+            tobj->xops = xp;
+        return res;
+    }
+    if (('\0' == device_name[0]) && sa)
+        return smp_initiator_open_by_sa(sa, i_params, tobj, verbose);
+    memset(tobj, 0, sizeof(struct smp_target_obj));
+    memcpy(tobj->device_name, device_name,
+	   ((len > SMP_MAX_DEVICE_NAME) ? SMP_MAX_DEVICE_NAME : len));
+    if (sa)
+        sg_put_unaligned_be64(sa, tobj->sas_addr + 0);
+    if (i_params && i_params[0]) {
+        if (0 == strncmp("for", i_params, 3))
+            force = true;
+        else if ((named < 0) && (verbose > 3))
+            pr2ws("smp_initiator_open: interface not recognized\n");
+        cp = strchr(i_params, ',');
+        if (cp && (named >= 0) && (0 == strncmp("for", cp + 1, 3)))
+            force = true;
+    }
+    for (k = 0; k < n; ++k) {
+        xp = xport_arr[k].xp;
+        if ((named >= 0) ? (k != named) :
+                           (! (SMP_XPORT_AUTO & xp->flags)))
+            continue;
+        res = xp->probe ? xp->probe(device_name, verbose) : 1;
+        if (res || force) {
+            if ((0 == res) && force)
+                pr2ws("... overriding failed check due "
+                      "to 'force'\n");
+            if (xport_open(k, device_name, subvalue, i_params, sa, tobj,
+                           verbose))
+                break;
+            return 0;
+        } else if (verbose > 2)
+            pr2ws("smp_initiator_open: %s check failed\n", xp->name);
+    }
+    pr2ws("smp_initiator_open: failed to open %s\n", device_name);
+    return -1;
+}
+
+int
+smp_initiator_open_by_sa(uint64_t sa, const char * i_params,
+                         struct smp_target_obj * tobj, int verbose)
+{
+    int k, n, named;
+    const struct smp_xport_ops * xp;
+    char b[SMP_MAX_DEVICE_NAME];
+
+    if (NULL == tobj)
+        return -1;
+    if (smp_snap_replaying())
+        return smp_snap_open("", 0, sa, tobj, verbose);
+    n = xport_count();
+    named = xport_match(i_params);
+    if ((named >= 0) && (SMP_XPORT_NO_DEVICE & xport_arr[named].xp->flags))
+        return smp_initiator_open("", 0, i_params, sa, tobj, verbose);
+    for (k = 0; k < n; ++k) {
+        xp = xport_arr[k].xp;
+        if (xp->name_by_sa && ((named < 0) || (k == named)))
+            break;
+    }
+    if (k >= n) {
+        pr2ws("smp_initiator_open_by_sa: 0x%" PRIx64 ": not supported "
+              "by %s interface, give SMP_DEVICE\n", sa,
+              (named >= 0) ? xport_arr[named].xp->name : "any");
+        return -1;
+    }
+    if (xp->name_by_sa(sa, b, sizeof(b), verbose) < 0) {
+        if (verbose)
+            pr2ws("smp_initiator_open_by_sa: no %s device for SAS "
+                  "address 0x%" PRIx64 "\n", xp->name, sa);
+        return -1;
+    }
+    /* keep ',force' when the caller named this transport */
+    if (named < 0)
+        i_params = xp->prefix[0];
+    return smp_initiator_open(b, 0, i_params, sa, tobj, verbose);
+}
+
+int
+smp_send_req(const struct smp_target_obj * tobj,
+             struct smp_req_resp * rresp, int verbose)
+{
+    bool timed_out;
+    int res, attempt, slot;
+    uint64_t start_us;
+    const struct smp_xport_ops * xp;
+
+    if (smp_snap_member(tobj))
+        return smp_snap_send_req(tobj, rresp, verbose);
+    if ((NULL == tobj) || (0 == tobj->opened)) {
+        if (verbose > 2)
+            pr2ws("smp_send_req: nothing open??\n");
+        return -1;
+    }
+    if (NULL == (xp = tobj->xops)) {
+        if (verbose)
+            pr2ws("smp_send_req: no transport??\n");
+        return -1;
+    }
+    for (attempt = 0; ; ++attempt) {
+        timed_out = false;
+        slot = smp_admit_enter(tobj);
+        start_us = smp_stats_clock_us();
+        res = xp->send(tobj, rresp, &timed_out, verbose);
+        smp_admit_exit(tobj, slot, rresp, res, verbose);
+        smp_stats_note(tobj, rresp, res, timed_out, start_us);
+        smp_trace_note(tobj, rresp, res, timed_out, attempt, start_us);
+        if (! smp_req_retry(tobj, rresp, res, timed_out, attempt, verbose))
+            break;
+    }
+    if (0 == res) {
+        smp_rg_cache_note(tobj, rresp);
+        smp_caps_resp_note(tobj, rresp);
+    }
+    smp_snap_note(tobj, rresp, res);
+    return res;
+}
+
+int
+smp_initiator_close(struct smp_target_obj * tobj)
+{
+    int res;
+
+    if ((NULL == tobj) || (0 == tobj->opened)) {
+        pr2ws("smp_initiator_close: nothing open??\n");
+        return -1;
+    }
+    if (smp_session_member(tobj)) {
+        smp_buf_free(tobj);     /* the copy's own, see smp_session_lookup() */
+        tobj->opened = 0;       /* session owner does the real close */
+        return 0;
+    }
+    if (smp_snap_member(tobj))
+        return smp_snap_close(tobj);
+    if (NULL == tobj->xops) {
+        pr2ws("smp_initiator_close: no transport??\n");
+        return -1;
+    }
+    res = tobj->xops->close(tobj);
+    smp_stats_free(tobj);
+    smp_rg_cache_free(tobj);
+    smp_buf_free(tobj);
+    tobj->opened = 0;
+    return res;
+}
+
+const char *
+smp_get_interface_str(const struct smp_target_obj * tobj)
+{
+    if (NULL == tobj)
+        return "none";
+    if (SMP_SNAP_INTERFACE == tobj->interface_selector)
+        return "snapshot";
+    return tobj->xops ? tobj->xops->name : "unknown";
+}
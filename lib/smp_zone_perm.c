@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+
+/* Zone permission table as a 256 by 256 bit matrix of 64 bit words. The
+ * zoning utilities compare whole tables (e.g. the one in a permf file with
+ * what an expander holds) and check that ZP[s,d] equals ZP[d,s]; a byte
+ * (or bit) at a time that is 64K tests per table. Here a row is four
+ * words so the row loops below are short and of fixed length which
+ * compilers unroll and, where the target has them, turn into vector
+ * instructions. */
+
+static int
+popcount64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    int n;
+
+    for (n = 0; x; ++n)
+        x &= (x - 1);
+    return n;
+#endif
+}
+
+static int
+lowest_bit64(uint64_t x)        /* x must be non-zero */
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n;
+
+    for (n = 0; 0 == (x & 1); ++n)
+        x >>= 1;
+    return n;
+#endif
+}
+
+/* Transposes the 64 by 64 bit block in a (bit c of a[r] is element r,c) in
+ * six passes, each swapping the off diagonal quadrants of ever smaller
+ * sub-blocks. See "Hacker's Delight" [Warren], section 7-3. */
+static void
+transpose64(uint64_t * a)
+{
+    int j, k;
+    uint64_t m, t;
+
+    for (j = 32, m = 0x00000000ffffffffULL; j; j >>= 1, m ^= (m << j)) {
+        for (k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+            t = ((a[k] >> j) ^ a[k | j]) & m;
+            a[k] ^= (t << j);
+            a[k | j] ^= t;
+        }
+    }
+}
+
+static int
+zp_words(const struct smp_zone_perm * zpp)
+{
+    return zpp->num_zg / 64;
+}
+
+void
+smp_zp_init(struct smp_zone_perm * zpp, int num_zg)
+{
+    memset(zpp, 0, sizeof(*zpp));
+    zpp->num_zg = (256 == num_zg) ? 256 : 128;
+}
+
+/* The last byte of a descriptor holds ZP[s,0] to ZP[s,7] (least
+ * significant bit first) so word k is the k-th big endian 64 bit quantity
+ * counting back from the end of the descriptor. */
+void
+smp_zp_set_row(struct smp_zone_perm * zpp, int s, const uint8_t * descp)
+{
+    int k;
+    int nw = zp_words(zpp);
+
+    if ((s < 0) || (s >= zpp->num_zg))
+        return;
+    for (k = 0; k < nw; ++k)
+        zpp->w[s][k] = sg_get_unaligned_be64(descp + ((nw - 1 - k) * 8));
+}
+
+void
+smp_zp_get_row(const struct smp_zone_perm * zpp, int s, uint8_t * descp)
+{
+    int k;
+    int nw = zp_words(zpp);
+
+    for (k = 0; k < nw; ++k)
+        sg_put_unaligned_be64(((s >= 0) && (s < zpp->num_zg)) ?
+                              zpp->w[s][k] : 0, descp + ((nw - 1 - k) * 8));
+}
+
+bool
+smp_zp_test(const struct smp_zone_perm * zpp, int s, int d)
+{
+    if ((s < 0) || (s >= zpp->num_zg) || (d < 0) || (d >= zpp->num_zg))
+        return false;
+    return !! ((zpp->w[s][d / 64] >> (d % 64)) & 1);
+}
+
+void
+smp_zp_set(struct smp_zone_perm * zpp, int s, int d, bool permit)
+{
+    uint64_t m;
+
+    if ((s < 0) || (s >= zpp->num_zg) || (d < 0) || (d >= zpp->num_zg))
+        return;
+    m = (uint64_t)1 << (d % 64);
+    if (permit)
+        zpp->w[s][d / 64] |= m;
+    else
+        zpp->w[s][d / 64] &= ~m;
+}
+
+void
+smp_zp_transpose(const struct smp_zone_perm * src,
+                 struct smp_zone_perm * dst)
+{
+    int bi, bj, r;
+    int nw = zp_words(src);
+    uint64_t a[64];
+
+    smp_zp_init(dst, src->num_zg);
+    for (bi = 0; bi < nw; ++bi) {
+        for (bj = 0; bj < nw; ++bj) {
+            for (r = 0; r < 64; ++r)
+                a[r] = src->w[(bi * 64) + r][bj];
+            transpose64(a);
+            for (r = 0; r < 64; ++r)
+                dst->w[(bj * 64) + r][bi] = a[r];
+        }
+    }
+}
+
+int
+smp_zp_diff(const struct smp_zone_perm * a, const struct smp_zone_perm * b,
+            uint64_t * rows)
+{
+    int s, k, n;
+    uint64_t x;
+
+    if (rows)
+        memset(rows, 0, SMP_ZP_WORDS * sizeof(uint64_t));
+    if (a->num_zg != b->num_zg) {
+        if (rows) {
+            for (s = 0; s < a->num_zg; ++s)
+                rows[s / 64] |= (uint64_t)1 << (s % 64);
+        }
+        return a->num_zg;
+    }
+    for (s = 0, n = 0; s < a->num_zg; ++s) {
+        for (k = 0, x = 0; k < SMP_ZP_WORDS; ++k)
+            x |= (a->w[s][k] ^ b->w[s][k]);
+        if (x) {
+            ++n;
+            if (rows)
+                rows[s / 64] |= (uint64_t)1 << (s % 64);
+        }
+    }
+    return n;
+}
+
+/* Each differing pair shows up twice in (ZP xor transpose(ZP)), once in
+ * row s and once in row d. */
+int
+smp_zp_asymmetric(const struct smp_zone_perm * zpp, int * sp, int * dp)
+{
+    bool first = true;
+    int s, k, n;
+    uint64_t x;
+    struct smp_zone_perm * tp;
+
+    tp = (struct smp_zone_perm *)malloc(sizeof(*tp));
+    if (NULL == tp)
+        return -1;
+    smp_zp_transpose(zpp, tp);
+    for (s = 0, n = 0; s < zpp->num_zg; ++s) {
+        for (k = 0; k < SMP_ZP_WORDS; ++k) {
+            x = zpp->w[s][k] ^ tp->w[s][k];
+            if (0 == x)
+                continue;
+            n += popcount64(x);
+            if (first) {
+                first = false;
+                if (sp)
+                    *sp = s;
+                if (dp)
+                    *dp = (k * 64) + lowest_bit64(x);
+            }
+        }
+    }
+    free(tp);
+    return n / 2;
+}
+
+int
+smp_zp_reach(const struct smp_zone_perm * zpp, int g, uint64_t * srcs)
+{
+    int s, n, k, b;
+
+    memset(srcs, 0, SMP_ZP_WORDS * sizeof(uint64_t));
+    if ((g < 0) || (g >= zpp->num_zg))
+        return 0;
+    k = g / 64;
+    b = g % 64;
+    for (s = 0; s < zpp->num_zg; ++s)
+        srcs[s / 64] |= ((zpp->w[s][k] >> b) & 1) << (s % 64);
+    for (k = 0, n = 0; k < SMP_ZP_WORDS; ++k)
+        n += popcount64(srcs[k]);
+    return n;
+}
@@ -0,0 +1,418 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* Zoning transaction: ZONE LOCK, CONFIGURE ZONE PERMISSION TABLE (as many
+ * as needed), CONFIGURE ZONE PHY INFORMATION, ZONE ACTIVATE then ZONE
+ * UNLOCK, sent back to back on one open target. Done with separate
+ * utilities (see examples/zoning_ex.sh) the zone lock is held across the
+ * start up and open of each process, which blocks other zone managers for
+ * far longer than the SMP functions themselves take. If any function after
+ * the ZONE LOCK fails, ZONE UNLOCK is sent straight away. */
+
+#define ZT_PERM_MAX_DESC_128 63
+#define ZT_PERM_MAX_DESC_256 31
+#define ZT_PHY_INFO_MAX_DESC 254
+#define ZT_ZONE_LOCK_RESP_LEN 20
+#define ZT_REP_PERM_RESP_LEN 1028
+
+
+static void
+pr_req(const char * leadin, const uint8_t * req, int len)
+{
+    int k;
+
+    pr2ws("    %s request:", leadin);
+    for (k = 0; k < len; ++k) {
+        if (0 == (k % 16))
+            pr2ws("\n      ");
+        else if (0 == (k % 8))
+            pr2ws(" ");
+        pr2ws("%02x ", req[k]);
+    }
+    pr2ws("\n");
+}
+
+/* Sends one request of the transaction and checks the response. Returns 0
+ * if accepted, else the function result, SMP_LIB_CAT_MALFORMED or -1
+ * (send or transport failure). fail_func is set by the first failure. */
+static int
+txn_req(struct smp_target_obj * tobj, struct smp_zone_txn * ztp,
+        const char * leadin, uint8_t * req, int req_len, uint8_t * resp,
+        int max_resp_len, int verbose)
+{
+    int res, act_resplen;
+    struct smp_req_resp smp_rr;
+    char b[128];
+
+    req[0] = SMP_FRAME_TYPE_REQ;
+    if (verbose > 1)
+        pr_req(leadin, req, req_len);
+    memset(resp, 0, max_resp_len);
+    memset(&smp_rr, 0, sizeof(smp_rr));
+    smp_rr.request_len = req_len;
+    smp_rr.request = req;
+    smp_rr.max_response_len = max_resp_len;
+    smp_rr.response = resp;
+    ++ztp->num_reqs;
+    res = smp_send_req(tobj, &smp_rr, verbose);
+    if (res || smp_rr.transport_err) {
+        if (verbose)
+            pr2ws("%s: smp_send_req failed, res=%d, transport_err=%d\n",
+                  leadin, res, smp_rr.transport_err);
+        res = -1;
+        goto fail;
+    }
+    act_resplen = smp_rr.act_response_len;
+    if (((act_resplen >= 0) && (act_resplen < 4)) ||
+        (SMP_FRAME_TYPE_RESP != resp[0]) || (resp[1] != req[1])) {
+        if (verbose)
+            pr2ws("%s: response malformed\n", leadin);
+        res = SMP_LIB_CAT_MALFORMED;
+        goto fail;
+    }
+    if (resp[2]) {
+        res = resp[2];
+        if (verbose)
+            pr2ws("%s result: %s\n", leadin,
+                  smp_get_func_res_str(res, sizeof(b), b));
+        goto fail;
+    }
+    return 0;
+fail:
+    if (ztp->fail_func < 0)
+        ztp->fail_func = req[1];
+    return res;
+}
+
+static int
+txn_unlock(struct smp_target_obj * tobj, struct smp_zone_txn * ztp,
+           int verbose)
+{
+    int res;
+    uint8_t req[12];
+    uint8_t resp[8];
+
+    memset(req, 0, sizeof(req));
+    req[1] = SMP_FN_ZONE_UNLOCK;
+    req[3] = 1;
+    res = txn_req(tobj, ztp, "Zone unlock", req, sizeof(req), resp,
+                  sizeof(resp), verbose);
+    /* even if ZONE UNLOCK failed the lock is no longer ours to release */
+    ztp->locked = false;
+    ztp->lock_us = smp_stats_clock_us() - ztp->lock_start_us;
+    if (verbose > 1)
+        pr2ws("zone lock held for %" PRIu64 " microseconds\n",
+              ztp->lock_us);
+    return res;
+}
+
+static int
+txn_conf_perm(struct smp_target_obj * tobj, struct smp_zone_txn * ztp,
+              int verbose)
+{
+    int res, j, k, numd, desc_len, max_d, num_rows, last;
+    const struct smp_zone_perm * zpp = ztp->zpp;
+    uint8_t req[1028];
+    uint8_t resp[8];
+
+    desc_len = (256 == zpp->num_zg) ? 32 : 16;
+    max_d = (256 == zpp->num_zg) ? ZT_PERM_MAX_DESC_256 :
+                                   ZT_PERM_MAX_DESC_128;
+    num_rows = ztp->num_rows;
+    if ((num_rows <= 0) || ((ztp->sszg + num_rows) > zpp->num_zg))
+        num_rows = zpp->num_zg - ztp->sszg;
+    last = ztp->sszg + num_rows;
+    for (j = ztp->sszg; j < last; j += numd) {
+        numd = last - j;
+        if (numd > max_d)
+            numd = max_d;
+        memset(req, 0, sizeof(req));
+        req[1] = SMP_FN_CONFIG_ZONE_PERMISSION_TBL;
+        req[3] = (numd * (desc_len / 4)) + 3;
+        req[6] = j;
+        req[7] = numd;
+        req[8] = ztp->save & 0x3;
+        if (256 == zpp->num_zg)
+            req[8] |= 0x40;
+        req[9] = desc_len / 4;
+        for (k = 0; k < numd; ++k)
+            smp_zp_get_row(zpp, j + k, req + 16 + (k * desc_len));
+        res = txn_req(tobj, ztp, "Configure zone permission table", req,
+                      20 + (numd * desc_len), resp, sizeof(resp), verbose);
+        if (res)
+            return res;
+    }
+    return 0;
+}
+
+static int
+txn_conf_phy_info(struct smp_target_obj * tobj, struct smp_zone_txn * ztp,
+                  int verbose)
+{
+    int res, j, numd;
+    uint8_t req[1028];
+    uint8_t resp[8];
+
+    for (j = 0; j < ztp->num_phy_info; j += numd) {
+        numd = ztp->num_phy_info - j;
+        if (numd > ZT_PHY_INFO_MAX_DESC)
+            numd = ZT_PHY_INFO_MAX_DESC;
+        memset(req, 0, sizeof(req));
+        req[1] = SMP_FN_CONFIG_ZONE_PHY_INFO;
+        req[3] = numd + 1;
+        req[6] = (1 << 2) | (ztp->save & 0x3);  /* descriptor length: 1 */
+        req[7] = numd;
+        memcpy(req + 8, ztp->phy_info + (j * 4), numd * 4);
+        res = txn_req(tobj, ztp, "Configure zone phy information", req,
+                      12 + (numd * 4), resp, sizeof(resp), verbose);
+        if (res)
+            return res;
+    }
+    return 0;
+}
+
+int
+smp_zone_txn_stage(struct smp_target_obj * tobj, struct smp_zone_txn * ztp,
+                   int verbose)
+{
+    int res;
+    uint8_t req[44];
+    uint8_t resp[ZT_ZONE_LOCK_RESP_LEN];
+
+    if ((NULL == tobj) || (NULL == ztp))
+        return -1;
+    ztp->fail_func = -1;
+    ztp->num_reqs = 0;
+    ztp->active_zm_sa = 0;
+    if (ztp->zpp && ((ztp->sszg < 0) || (ztp->sszg >= ztp->zpp->num_zg)))
+        return SMP_LIB_SYNTAX_ERROR;
+    memset(req, 0, sizeof(req));
+    req[1] = SMP_FN_ZONE_LOCK;
+    req[2] = (sizeof(resp) - 8) / 4;
+    req[3] = 9;
+    sg_put_unaligned_be16(ztp->inact_tl, req + 6);
+    if (ztp->password)
+        memcpy(req + 8, ztp->password, 32);
+    ztp->lock_start_us = smp_stats_clock_us();
+    res = txn_req(tobj, ztp, "Zone lock", req, sizeof(req), resp,
+                  sizeof(resp), verbose);
+    /* on a ZONE LOCK failure the active zone manager is still reported */
+    if ((0 == res) || (SMP_FRES_ZONE_LOCK_VIOLATION == res))
+        ztp->active_zm_sa = sg_get_unaligned_be64(resp + 8);
+    if (res)
+        return res;
+    ztp->locked = true;
+    if (ztp->zpp && (res = txn_conf_perm(tobj, ztp, verbose)))
+        goto unlock;
+    if (ztp->phy_info && (ztp->num_phy_info > 0) &&
+        (res = txn_conf_phy_info(tobj, ztp, verbose)))
+        goto unlock;
+    return 0;
+unlock:
+    txn_unlock(tobj, ztp, verbose);
+    return res;
+}
+
+int
+smp_zone_txn_commit(struct smp_target_obj * tobj, struct smp_zone_txn * ztp,
+                    int verbose)
+{
+    int res, ures;
+    uint8_t req[12];
+    uint8_t resp[8];
+
+    if ((NULL == tobj) || (NULL == ztp) || (! ztp->locked))
+        return -1;
+    memset(req, 0, sizeof(req));
+    req[1] = SMP_FN_ZONE_ACTIVATE;
+    req[3] = 1;
+    ztp->activate_us = smp_stats_clock_us();
+    res = txn_req(tobj, ztp, "Zone activate", req, sizeof(req), resp,
+                  sizeof(resp), verbose);
+    ures = txn_unlock(tobj, ztp, verbose);
+    return res ? res : ures;
+}
+
+int
+smp_zone_txn_abort(struct smp_target_obj * tobj, struct smp_zone_txn * ztp,
+                   int verbose)
+{
+    if ((NULL == tobj) || (NULL == ztp) || (! ztp->locked))
+        return 0;
+    return txn_unlock(tobj, ztp, verbose);
+}
+
+int
+smp_zone_txn_run(struct smp_target_obj * tobj, struct smp_zone_txn * ztp,
+                 int verbose)
+{
+    int res;
+
+    res = smp_zone_txn_stage(tobj, ztp, verbose);
+    if (res)
+        return res;
+    return smp_zone_txn_commit(tobj, ztp, verbose);
+}
+
+int
+smp_zp_read(struct smp_target_obj * tobj, int report_type, int sszg,
+            int num_rows, struct smp_zone_perm * zpp, int verbose)
+{
+    bool first = true;
+    int j, k, res, len, got, num_zg, desc_len, act_resplen;
+    int last = sszg + num_rows;
+    uint8_t req[12];
+    uint8_t resp[ZT_REP_PERM_RESP_LEN];
+    struct smp_req_resp smp_rr;
+    char b[128];
+
+    if ((NULL == tobj) || (NULL == zpp) || (sszg < 0) || (num_rows < 1) ||
+        (last > SMP_ZP_MAX_ZG))
+        return SMP_LIB_SYNTAX_ERROR;
+    for (j = sszg; j < last; j += got) {
+        memset(req, 0, sizeof(req));
+        req[0] = SMP_FRAME_TYPE_REQ;
+        req[1] = SMP_FN_REPORT_ZONE_PERMISSION_TBL;
+        len = (sizeof(resp) - 8) / 4;
+        req[2] = (len < 0x100) ? len : 0xff;
+        req[3] = 0x1;
+        req[4] = report_type & 0x3;
+        req[6] = j;
+        req[7] = ((last - j) > ZT_PERM_MAX_DESC_128) ? ZT_PERM_MAX_DESC_128 :
+                                                       (last - j);
+        if (verbose > 1)
+            pr_req("Report zone permission table", req, sizeof(req));
+        memset(&smp_rr, 0, sizeof(smp_rr));
+        smp_rr.request_len = sizeof(req);
+        smp_rr.request = req;
+        smp_rr.max_response_len = sizeof(resp);
+        smp_rr.response = resp;
+        res = smp_send_req(tobj, &smp_rr, verbose);
+        if (res || smp_rr.transport_err) {
+            if (verbose)
+                pr2ws("Report zone permission table: smp_send_req "
+                      "failed\n");
+            return -1;
+        }
+        act_resplen = smp_rr.act_response_len;
+        if (((act_resplen >= 0) && (act_resplen < 4)) ||
+            (SMP_FRAME_TYPE_RESP != resp[0]) || (resp[1] != req[1])) {
+            if (verbose)
+                pr2ws("Report zone permission table response malformed\n");
+            return SMP_LIB_CAT_MALFORMED;
+        }
+        if (resp[2]) {
+            if (verbose)
+                pr2ws("Report zone permission table result: %s\n",
+                      smp_get_func_res_str(resp[2], sizeof(b), b));
+            return resp[2];
+        }
+        num_zg = (resp[7] >> 6) ? 256 : 128;
+        desc_len = (256 == num_zg) ? 32 : 16;
+        if (first) {
+            first = false;
+            smp_zp_init(zpp, num_zg);
+        } else if (num_zg != zpp->num_zg)
+            return SMP_LIB_CAT_MALFORMED;
+        got = resp[15];
+        len = 4 + (resp[3] * 4);
+        if ((act_resplen >= 0) && (len > act_resplen))
+            len = act_resplen;
+        if ((resp[13] * 4) != desc_len)
+            got = 0;
+        if (got > (last - j))
+            got = last - j;
+        if ((16 + (got * desc_len)) > len)
+            got = (len - 16) / desc_len;
+        if (got <= 0) {
+            if (verbose)
+                pr2ws("Report zone permission table returned no "
+                      "descriptors at source zone group %d\n", j);
+            return SMP_LIB_CAT_MALFORMED;
+        }
+        for (k = 0; k < got; ++k)
+            smp_zp_set_row(zpp, j + k, resp + 16 + (k * desc_len));
+    }
+    return 0;
+}
+
+/* An expander with 256 zone groups accepts 128 zone group descriptors, so
+ * only the columns that were configured are compared. */
+int
+smp_zone_txn_verify(struct smp_target_obj * tobj,
+                    const struct smp_zone_txn * ztp, int * num_diffp,
+                    int verbose)
+{
+    int res, s, k, nw, n, num_rows;
+    const struct smp_zone_perm * zpp;
+    struct smp_zone_perm * rbp;
+
+    if ((NULL == tobj) || (NULL == ztp) || (NULL == num_diffp))
+        return -1;
+    *num_diffp = 0;
+    if (NULL == (zpp = ztp->zpp))
+        return 0;
+    num_rows = ztp->num_rows;
+    if ((num_rows <= 0) || ((ztp->sszg + num_rows) > zpp->num_zg))
+        num_rows = zpp->num_zg - ztp->sszg;
+    rbp = (struct smp_zone_perm *)malloc(sizeof(*rbp));
+    if (NULL == rbp)
+        return SMP_LIB_RESOURCE_ERROR;
+    res = smp_zp_read(tobj, 0 /* current */, ztp->sszg, num_rows, rbp,
+                      verbose);
+    if (res) {
+        free(rbp);
+        return res;
+    }
+    nw = ((rbp->num_zg < zpp->num_zg) ? rbp->num_zg : zpp->num_zg) / 64;
+    for (s = ztp->sszg, n = 0; s < (ztp->sszg + num_rows); ++s) {
+        for (k = 0; k < nw; ++k) {
+            if (rbp->w[s][k] != zpp->w[s][k])
+                break;
+        }
+        if (k < nw) {
+            ++n;
+            if (verbose > 1)
+                pr2ws("source zone group %d differs on read back\n", s);
+        }
+    }
+    free(rbp);
+    *num_diffp = n;
+    return 0;
+}
@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* This is a Serial Attached SCSI (SAS) Serial Management Protocol (SMP)
+ * utility.
+ *
+ * This utility measures how quickly a SMP target answers. It sends
+ * REPORT GENERAL, DISCOVER and DISCOVER LIST requests, one after another,
+ * a given number of times each and reports the request rate and latency
+ * percentiles per function. The library's own statistics time each
+ * request from just before it is handed to the pass-through (e.g. the
+ * bsg write or the mptctl/aac ioctl) to just after it returns, so the
+ * difference between that and the time smp_send_req() takes is shown as
+ * the library overhead. It is built by 'make bench' and not installed.
+ */
+
+static const char * version_str = "1.00 20261014";
+
+#define SMP_BENCH_RESP_LEN 1032
+#define SMP_BENCH_DEF_COUNT 1000
+#define SMP_BENCH_DEF_WARMUP 10
+
+struct bench_func_t {
+    const char * acron;
+    const char * name;
+    int func;
+};
+
+static struct bench_func_t bench_func_arr[] = {
+    {"rg", "report general", SMP_FN_REPORT_GENERAL},
+    {"dis", "discover", SMP_FN_DISCOVER},
+    {"dl", "discover list", SMP_FN_DISCOVER_LIST},
+    {NULL, NULL, 0},
+};
+
+struct opts_t {
+    bool sel_func[3];           /* parallel to bench_func_arr[] */
+    int count;
+    int phy_id;
+    int warmup;
+    int verbose;
+};
+
+static struct option long_options[] = {
+        {"count", required_argument, 0, 'c'},
+        {"function", required_argument, 0, 'f'},
+        {"help", no_argument, 0, 'h'},
+        {"interface", required_argument, 0, 'I'},
+        {"phy", required_argument, 0, 'p'},
+        {"sa", required_argument, 0, 's'},
+        {"verbose", no_argument, 0, 'v'},
+        {"version", no_argument, 0, 'V'},
+        {"warmup", required_argument, 0, 'w'},
+        {0, 0, 0, 0},
+};
+
+
+static void
+usage(void)
+{
+    pr2serr("Usage: "
+            "smp_bench [--count=N] [--function=LIST] [--help] "
+            "[--interface=PARAMS]\n"
+            "                 [--phy=ID] [--sa=SAS_ADDR] [--verbose] "
+            "[--version]\n"
+            "                 [--warmup=N] SMP_DEVICE[,N]\n"
+            "  where:\n"
+            "    --count=N|-c N       requests to time per function "
+            "(def: %d)\n"
+            "    --function=LIST|-f LIST    comma separated list of: rg "
+            "(REPORT\n"
+            "                         GENERAL), dis (DISCOVER) and dl "
+            "(DISCOVER LIST)\n"
+            "                         (def: rg,dis,dl)\n"
+            "    --help|-h            print out usage message\n"
+            "    --interface=PARAMS|-I PARAMS    specify or override "
+            "interface\n"
+            "                         (e.g. 'sim' for simulated "
+            "expanders)\n"
+            "    --phy=ID|-p ID       phy identifier for DISCOVER and "
+            "start of\n"
+            "                         DISCOVER LIST (def: 0)\n"
+            "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of SMP "
+            "target (use leading\n"
+            "                                 '0x' or trailing 'h'). "
+            "Depending on\n"
+            "                                 the interface, may not be "
+            "needed\n"
+            "    --verbose|-v         increase verbosity\n"
+            "    --version|-V         print version string and exit\n"
+            "    --warmup=N|-w N      untimed requests sent first per "
+            "function\n"
+            "                         (def: %d)\n\n"
+            "Times SMP requests sent to a SMP target, outputs requests per "
+            "second,\nlatency percentiles and library overhead per SMP "
+            "function.\n", SMP_BENCH_DEF_COUNT, SMP_BENCH_DEF_WARMUP);
+}
+
+static int
+parse_func_list(const char * arg, struct opts_t * op)
+{
+    int k, n;
+    const char * cp;
+    const char * ep;
+
+    memset(op->sel_func, 0, sizeof(op->sel_func));
+    for (cp = arg; cp && *cp; cp = ep ? ep + 1 : NULL) {
+        ep = strchr(cp, ',');
+        n = ep ? (ep - cp) : (int)strlen(cp);
+        for (k = 0; bench_func_arr[k].acron; ++k) {
+            if ((n == (int)strlen(bench_func_arr[k].acron)) &&
+                (0 == strncmp(cp, bench_func_arr[k].acron, n)))
+                break;
+        }
+        if (NULL == bench_func_arr[k].acron) {
+            pr2serr("--function= expects a list of: rg, dis or dl\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+        op->sel_func[k] = true;
+    }
+    return 0;
+}
+
+static uint64_t
+mono_ns(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        return 0;
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static int
+cmp_u64(const void * a, const void * b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/* Returns the per mille'th percentile of the n sorted latencies in ns,
+ * as microseconds */
+static double
+pctile_us(const uint64_t * sorted, int n, int per_mille)
+{
+    int k = ((int64_t)n * per_mille + 999) / 1000;
+
+    if (k < 1)
+        k = 1;
+    return sorted[k - 1] / 1000.0;
+}
+
+/* Sends one request built for function 'func'. Returns 0 if answered
+ * with function result 0, -1 if smp_send_req() or the transport failed,
+ * else the function result. */
+static int
+send_one(struct smp_target_obj * top, int func, uint8_t * resp,
+         const struct opts_t * op)
+{
+    int len;
+    uint8_t smp_req[32];
+    struct smp_req_resp smp_rr;
+
+    memset(smp_req, 0, sizeof(smp_req));
+    smp_req[0] = SMP_FRAME_TYPE_REQ;
+    smp_req[1] = func;
+    switch (func) {
+    case SMP_FN_REPORT_GENERAL:
+        len = 8;
+        smp_req[2] = (SMP_REPORT_GENERAL_RESP_LEN - 8) / 4;
+        break;
+    case SMP_FN_DISCOVER:
+        len = 16;
+        smp_req[2] = (124 - 8) / 4;
+        smp_req[3] = 2;
+        smp_req[9] = op->phy_id;
+        break;
+    default:            /* SMP_FN_DISCOVER_LIST, 8 long descriptors */
+        len = 32;
+        smp_req[2] = 0xff;
+        smp_req[3] = 6;
+        smp_req[8] = op->phy_id;
+        smp_req[9] = 8;
+        break;
+    }
+    memset(&smp_rr, 0, sizeof(smp_rr));
+    smp_rr.request_len = len;
+    smp_rr.request = smp_req;
+    smp_rr.max_response_len = SMP_BENCH_RESP_LEN;
+    smp_rr.response = resp;
+    if (smp_send_req(top, &smp_rr, op->verbose > 1 ? op->verbose - 1 : 0) ||
+        smp_rr.transport_err)
+        return -1;
+    if ((SMP_FRAME_TYPE_RESP != resp[0]) || (func != resp[1]))
+        return -1;
+    return resp[2];
+}
+
+/* Times op->count requests of bench_func_arr[fi]. Returns 0 if all were
+ * answered, else SMP_LIB_CAT_OTHER (after outputting its line anyway) or
+ * SMP_LIB_RESOURCE_ERROR. */
+static int
+bench_func(struct smp_target_obj * top, int fi, uint8_t * resp,
+           const struct opts_t * op)
+{
+    int k, res, func;
+    int first_res = 0;
+    int fails = 0;
+    uint64_t t, start, wall_ns;
+    uint64_t total_ns = 0;
+    uint64_t * lat;
+    double pt_us, lib_us;
+    struct smp_stats * stp;
+    char b[128];
+
+    func = bench_func_arr[fi].func;
+    lat = (uint64_t *)calloc(op->count, sizeof(uint64_t));
+    stp = (struct smp_stats *)calloc(1, sizeof(*stp));
+    if ((NULL == lat) || (NULL == stp)) {
+        pr2serr("out of memory\n");
+        free(lat);
+        free(stp);
+        return SMP_LIB_RESOURCE_ERROR;
+    }
+    for (k = 0; k < op->warmup; ++k)
+        send_one(top, func, resp, op);
+    smp_reset_stats(top);
+    start = mono_ns();
+    for (k = 0; k < op->count; ++k) {
+        t = mono_ns();
+        res = send_one(top, func, resp, op);
+        lat[k] = mono_ns() - t;
+        total_ns += lat[k];
+        if (res) {
+            if (0 == fails++)
+                first_res = res;
+        }
+    }
+    wall_ns = mono_ns() - start;
+    qsort(lat, op->count, sizeof(uint64_t), cmp_u64);
+    pt_us = 0.0;
+    if ((0 == smp_get_stats(top, stp)) && (stp->fn[func].count > 0))
+        pt_us = (double)stp->fn[func].total_us / op->count;
+    lib_us = (total_ns / 1000.0 / op->count) - pt_us;
+    if (lib_us < 0.0)
+        lib_us = 0.0;
+    printf("%-14s %8d %10.0f %9.1f %9.1f %9.1f %9.1f %9.1f %8.1f %6d\n",
+           bench_func_arr[fi].name, op->count,
+           wall_ns ? (op->count * 1e9 / wall_ns) : 0.0,
+           pctile_us(lat, op->count, 500), pctile_us(lat, op->count, 990),
+           pctile_us(lat, op->count, 999), lat[op->count - 1] / 1000.0,
+           pt_us, lib_us, fails);
+    if (fails) {
+        if (first_res > 0)
+            pr2serr("  %s: %d failed, first: %s\n", bench_func_arr[fi].name,
+                    fails, smp_get_func_res_str(first_res, sizeof(b), b));
+        else
+            pr2serr("  %s: %d failed in smp_send_req() or transport\n",
+                    bench_func_arr[fi].name, fails);
+    }
+    free(lat);
+    free(stp);
+    return fails ? SMP_LIB_CAT_OTHER : 0;
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    int res, c, k;
+    int ret = 0;
+    int subvalue = 0;
+    int64_t sa_ll;
+    uint64_t sa = 0;
+    char * cp;
+    char device_name[512];
+    char i_params[256];
+    uint8_t * resp = NULL;
+    uint8_t * free_resp = NULL;
+    struct opts_t opts;
+    struct opts_t * op;
+    struct smp_target_obj tobj;
+
+    op = &opts;
+    memset(op, 0, sizeof(opts));
+    op->count = SMP_BENCH_DEF_COUNT;
+    op->warmup = SMP_BENCH_DEF_WARMUP;
+    for (k = 0; bench_func_arr[k].acron; ++k)
+        op->sel_func[k] = true;
+    memset(device_name, 0, sizeof device_name);
+    memset(i_params, 0, sizeof i_params);
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "c:f:hI:p:s:vVw:", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'c':
+            op->count = smp_get_num(optarg);
+            if (op->count < 1) {
+                pr2serr("bad argument to '--count'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'f':
+            if ((res = parse_func_list(optarg, op)))
+                return res;
+            break;
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'I':
+            strncpy(i_params, optarg, sizeof(i_params));
+            i_params[sizeof(i_params) - 1] = '\0';
+            break;
+        case 'p':
+            op->phy_id = smp_get_num(optarg);
+            if ((op->phy_id < 0) || (op->phy_id > 254)) {
+                pr2serr("bad argument to '--phy', expect value from 0 to "
+                        "254\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 's':
+           sa_ll = smp_get_llnum_nomult(optarg);
+           if (-1LL == sa_ll) {
+                pr2serr("bad argument to '--sa'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            sa = (uint64_t)sa_ll;
+            break;
+        case 'v':
+            ++op->verbose;
+            break;
+        case 'V':
+            pr2serr("version: %s\n", version_str);
+            return 0;
+        case 'w':
+            op->warmup = smp_get_num(optarg);
+            if (op->warmup < 0) {
+                pr2serr("bad argument to '--warmup'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        default:
+            pr2serr("unrecognised switch code 0x%x ??\n", c);
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (optind < argc) {
+        if ('\0' == device_name[0]) {
+            strncpy(device_name, argv[optind], sizeof(device_name) - 1);
+            device_name[sizeof(device_name) - 1] = '\0';
+            ++optind;
+        }
+        if (optind < argc) {
+            for (; optind < argc; ++optind)
+                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (0 == device_name[0]) {
+        cp = getenv("SMP_UTILS_DEVICE");
+        if (cp)
+            strncpy(device_name, cp, sizeof(device_name) - 1);
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
+            pr2serr("missing device name on command line\n    [Could use "
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if ((cp = strchr(device_name, SMP_SUBVALUE_SEPARATOR))) {
+        *cp = '\0';
+        if (1 != sscanf(cp + 1, "%d", &subvalue)) {
+            pr2serr("expected number after separator in SMP_DEVICE name\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (0 == sa) {
+        cp = getenv("SMP_UTILS_SAS_ADDR");
+        if (cp) {
+           sa_ll = smp_get_llnum_nomult(cp);
+           if (-1LL == sa_ll) {
+                pr2serr("bad value in environment variable "
+                        "SMP_UTILS_SAS_ADDR\n    use 0\n");
+                sa_ll = 0;
+            }
+            sa = (uint64_t)sa_ll;
+        }
+    }
+    if (sa > 0) {
+        if (! smp_is_naa5(sa)) {
+            pr2serr("SAS (target) address not in naa-5 format (may need "
+                    "leading '0x')\n");
+            if ('\0' == i_params[0]) {
+                pr2serr("    use '--interface=' to override\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+        }
+    }
+
+    res = smp_initiator_open(device_name, subvalue, i_params, sa,
+                             &tobj, op->verbose);
+    if (res < 0)
+        return SMP_LIB_FILE_ERROR;
+    resp = smp_memalign(SMP_BENCH_RESP_LEN, 0, &free_resp, false);
+    if (NULL == resp) {
+        pr2serr("Unable to allocated %u bytes on the heap\n",
+                SMP_BENCH_RESP_LEN);
+        ret = SMP_LIB_RESOURCE_ERROR;
+        goto err_out;
+    }
+    printf("device: %s  interface: %s  SAS address: 0x%" PRIx64 "\n",
+           tobj.device_name, smp_get_interface_str(&tobj),
+           sg_get_unaligned_be64(tobj.sas_addr));
+    printf("%-14s %8s %10s %9s %9s %9s %9s %9s %8s %6s\n", "function",
+           "count", "req/s", "p50_us", "p99_us", "p999_us", "max_us",
+           "pt_us", "lib_us", "fail");
+    for (k = 0; bench_func_arr[k].acron; ++k) {
+        if (! op->sel_func[k])
+            continue;
+        res = bench_func(&tobj, k, resp, op);
+        if (res && (0 == ret))
+            ret = res;
+        if (SMP_LIB_RESOURCE_ERROR == res)
+            break;
+    }
+    if (op->verbose)
+        pr2serr("pt_us: mean time in the pass-through (library "
+                "statistics), lib_us:\nmean time in smp_send_req() "
+                "outside it, including any BUSY retry backoff\n");
+
+err_out:
+    if (free_resp)
+        free(free_resp);
+    res = smp_initiator_close(&tobj);
+    if (res < 0) {
+        if (0 == ret)
+            return SMP_LIB_FILE_ERROR;
+    }
+    return (ret >= 0) ? ret : SMP_LIB_CAT_OTHER;
+}
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2011-2018, Douglas Gilbert
+ * Copyright (c) 2011-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -34,6 +34,8 @@
 #include <ctype.h>
 #include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -49,12 +51,17 @@
  * utility.
  *
  * This utility issues a CONFIGURE PHY EVENT function and outputs
- * its response.
+ * its response. The same phy event sources can be configured on a list
+ * of phys (or all phys) of one or more SMP targets.
  */
 
-static const char * version_str = "1.07 20180724";
+static const char * version_str = "1.08 20261014";
 
 #define MAX_PHY_EV_SRC 126      /* max in one request */
+#define MAX_TARGETS 64
+#define MAX_SAS_ADDRS 32
+#define CPE_RESP_LEN 8
+#define CPE_PEL_RESP_LEN (1020 + 4 + 4)
 
 struct pes_name_t {
     int pes;    /* phy event source, an 8 bit number */
@@ -75,6 +82,7 @@ static struct option long_options[] = {
     {"sa", required_argument, 0, 's'},
     {"thres", required_argument, 0, 'T'},
     {"verbose", no_argument, 0, 'v'},
+    {"verify", no_argument, 0, 'y'},
     {"version", no_argument, 0, 'V'},
     {0, 0, 0, 0},
 };
@@ -137,10 +145,12 @@ usage(void)
             "                          [--file=FILE] [--help] [--hex]\n"
             "                          [--interface=PARAMS] "
             "[--pes=PES,PES...]\n"
-            "                          [--phy=ID] [--raw] [--sa=SAS_ADDR]\n"
+            "                          [--phy=ID[,ID...]|all] [--raw] "
+            "[--sa=SAS_ADDR]\n"
             "                          [--thres=THR,THR...] [--verbose] "
-            "[--version]\n"
-            "                          SMP_DEVICE[,N]\n"
+            "[--verify]\n"
+            "                          [--version] SMP_DEVICE[,N] "
+            "[SMP_DEVICE[,N] ...]\n"
             "  where:\n"
             "    --clear|-C             clear all peak value detectors for "
             "this phy\n"
@@ -157,7 +167,9 @@ usage(void)
             "    --pes=PES,PES...|-P PES,PES...    comma separated list "
             "of Phy\n"
             "                                      Event Sources\n"
-            "    --phy=ID|-p ID         phy identifier (def: 0)\n"
+            "    --phy=ID|-p ID         phy identifier (def: 0); a list "
+            "(e.g. '0,4-7')\n"
+            "                           or 'all' (vacant phys skipped)\n"
             "    --raw|-r               output response in binary\n"
             "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of SMP "
             "target (use leading\n"
@@ -170,8 +182,14 @@ usage(void)
             "                                        value detector "
             "thresholds\n"
             "    --verbose|-v           increase verbosity\n"
+            "    --verify|-y            check phy event sources with REPORT "
+            "PHY EVENT\n"
+            "                           LIST afterwards\n"
             "    --version|-V           print version string and exit\n\n"
-            "Performs a SMP CONFIGURE PHY EVENT function\n"
+            "Performs a SMP CONFIGURE PHY EVENT function. With more than one "
+            "phy or\nSMP_DEVICE (or --sa=SAS_ADDR given more than once, "
+            "each is used with\neach SMP_DEVICE) the requests are sent "
+            "together.\n"
            );
 }
 /* Fetches unsigned int and returns it if found, with *err set to 0 if
@@ -179,7 +197,7 @@ usage(void)
  * err is non-NULL. Assumes number is decimal unless prefixed by '0x' (or
  * '0X') or has a trailing 'h' (or 'H') in which case it is assumed to be
  * hexadecimal. */
-unsigned int
+static unsigned int
 get_unum(const char * buf, bool * err)
 {
     int res, len;
@@ -446,17 +464,320 @@ dStrRaw(const uint8_t * str, int len)
         printf("%c", str[k]);
 }
 
+/* With more than one phy or SMP target, or --verify, the CONFIGURE PHY
+ * EVENT request is built once; copies differing only in the phy
+ * identifier are sent to each SMP target together with
+ * smp_send_req_batch(), the SMP targets in parallel (a thread each). With
+ * --verify REPORT PHY EVENT LIST is then read to check that each phy has
+ * the phy event sources (and peak value detector thresholds) requested. */
 
+struct cpe_phy_t {
+    bool skip;          /* vacant phy with --phy=all */
+    uint8_t phy_id;
+    int res;            /* of CONFIGURE PHY EVENT */
+    int num_found;      /* requested sources seen by --verify */
+};
+
+struct cpe_bulk_t;
+
+struct cpe_tgt_t {
+    bool thr_ok;
+    int subvalue;
+    int res;            /* open, REPORT GENERAL or heap problem */
+    int vres;           /* of REPORT PHY EVENT LIST */
+    int num_phys;
+    uint64_t sa;
+    pthread_t thr;
+    struct cpe_bulk_t * bp;
+    char dev_name[SMP_MAX_DEVICE_NAME];
+    struct cpe_phy_t phys[256];
+};
+
+struct cpe_bulk_t {
+    bool all_phys;
+    bool do_verify;
+    int num_list;
+    int verbose;
+    int num_tgts;
+    int req_len;
+    int num_desc;
+    const char * i_params;
+    const uint8_t * req;        /* template, phy identifier filled later */
+    uint8_t phy_list[256];
+    struct cpe_tgt_t tgts[MAX_TARGETS];
+};
+
+static bool
+is_pvd(int pes)
+{
+    return (pes >= 0x2b) && (pes <= 0x2e);
+}
+
+/* Reads the phy event list descriptors of the SMP target, paging with the
+ * descriptor index, and counts in each configured phy of tp those that
+ * match a requested descriptor. Returns 0 on success, else -1 or an SMP
+ * function result. */
+static int
+verify_tgt(struct smp_target_obj * top, struct cpe_tgt_t * tp,
+           uint8_t * resp)
+{
+    int k, j, len, ped_len, num_ped, pes;
+    unsigned int idx, last_di;
+    uint32_t thres;
+    const uint8_t * pedp;
+    const uint8_t * dp;
+    struct cpe_bulk_t * bp = tp->bp;
+    struct cpe_phy_t * ppp;
+    struct cpe_phy_t * by_id[256];
+    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_REPORT_PHY_EVENT_LIST,
+                         0, 1,  0, 0, 0, 0,  0, 0, 0, 0};
+    struct smp_req_resp smp_rr;
+
+    memset(by_id, 0, sizeof(by_id));
+    for (k = 0; k < tp->num_phys; ++k) {
+        ppp = tp->phys + k;
+        if ((! ppp->skip) && (0 == ppp->res))
+            by_id[ppp->phy_id] = ppp;
+    }
+    len = (CPE_PEL_RESP_LEN - 8) / 4;
+    smp_req[2] = (len < 0x100) ? len : 0xff;
+    for (idx = 1; ; ) {
+        sg_put_unaligned_be16(idx, smp_req + 6);
+        memset(&smp_rr, 0, sizeof(smp_rr));
+        smp_rr.request_len = sizeof(smp_req);
+        smp_rr.request = smp_req;
+        smp_rr.max_response_len = CPE_PEL_RESP_LEN;
+        smp_rr.response = resp;
+        if (smp_send_req(top, &smp_rr, bp->verbose))
+            return -1;
+        k = smp_batch_resp_res(&smp_rr, SMP_FN_REPORT_PHY_EVENT_LIST);
+        if (k)
+            return k;
+        len = 4 + (resp[3] * 4);
+        if ((smp_rr.act_response_len >= 0) &&
+            (len > smp_rr.act_response_len))
+            len = smp_rr.act_response_len;
+        last_di = sg_get_unaligned_be16(resp + 8);
+        ped_len = resp[10] * 4;
+        num_ped = resp[15];
+        if (ped_len < 12)
+            return SMP_LIB_CAT_MALFORMED;
+        if ((16 + (num_ped * ped_len)) > len)
+            num_ped = (len - 16) / ped_len;
+        pedp = resp + 16;
+        for (k = 0; (k < num_ped) && ((idx + k) <= last_di);
+             ++k, pedp += ped_len) {
+            ppp = by_id[pedp[2]];
+            if (NULL == ppp)
+                continue;
+            pes = pedp[3];
+            thres = sg_get_unaligned_be32(pedp + 8);
+            for (j = 0, dp = bp->req + 12; j < bp->num_desc; ++j, dp += 8) {
+                if ((dp[3] == pes) && ((! is_pvd(pes)) ||
+                    (sg_get_unaligned_be32(dp + 4) == thres))) {
+                    ++ppp->num_found;
+                    break;
+                }
+            }
+        }
+        if ((0 == k) || ((idx + k) > last_di))
+            break;
+        idx += k;
+    }
+    return 0;
+}
+
+/* Does all the work for one SMP target: open, find the phys, send the
+ * CONFIGURE PHY EVENT requests and optionally verify them. */
+static void *
+bulk_worker(void * arg)
+{
+    int k, n, res;
+    struct cpe_tgt_t * tp = (struct cpe_tgt_t *)arg;
+    struct cpe_bulk_t * bp = tp->bp;
+    struct cpe_phy_t * ppp;
+    uint8_t * reqs = NULL;
+    uint8_t * resps = NULL;
+    uint8_t * pel_resp = NULL;
+    struct smp_req_resp * rrp = NULL;
+    struct smp_report_general rg;
+    struct smp_target_obj tobj;
+
+    res = smp_initiator_open(tp->dev_name, tp->subvalue, bp->i_params,
+                             tp->sa, &tobj, bp->verbose);
+    if (res < 0) {
+        tp->res = SMP_LIB_FILE_ERROR;
+        return NULL;
+    }
+    if (bp->all_phys) {
+        res = smp_get_report_general(&tobj, &rg, -1, bp->verbose);
+        if (res) {
+            tp->res = (res < 0) ? SMP_LIB_CAT_OTHER : res;
+            goto fini;
+        }
+        tp->num_phys = rg.num_phys;
+        for (k = 0; k < tp->num_phys; ++k)
+            tp->phys[k].phy_id = k;
+    } else {
+        tp->num_phys = bp->num_list;
+        for (k = 0; k < tp->num_phys; ++k)
+            tp->phys[k].phy_id = bp->phy_list[k];
+    }
+    n = (tp->num_phys > 0) ? tp->num_phys : 1;
+    reqs = (uint8_t *)calloc(n, bp->req_len);
+    resps = (uint8_t *)calloc(n, CPE_RESP_LEN);
+    rrp = (struct smp_req_resp *)calloc(n, sizeof(struct smp_req_resp));
+    if ((NULL == reqs) || (NULL == resps) || (NULL == rrp)) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        tp->res = SMP_LIB_RESOURCE_ERROR;
+        goto fini;
+    }
+    for (k = 0; k < tp->num_phys; ++k) {
+        memcpy(reqs + (bp->req_len * k), bp->req, bp->req_len);
+        reqs[(bp->req_len * k) + 9] = tp->phys[k].phy_id;
+        rrp[k].request_len = bp->req_len;
+        rrp[k].request = reqs + (bp->req_len * k);
+        rrp[k].max_response_len = CPE_RESP_LEN;
+        rrp[k].response = resps + (CPE_RESP_LEN * k);
+    }
+    smp_send_req_batch(&tobj, rrp, tp->num_phys, 0, NULL, NULL, bp->verbose);
+    for (k = 0; k < tp->num_phys; ++k) {
+        ppp = tp->phys + k;
+        ppp->res = smp_batch_resp_res(rrp + k, SMP_FN_CONFIG_PHY_EVENT);
+        if (bp->all_phys && (SMP_FRES_PHY_VACANT == ppp->res))
+            ppp->skip = true;
+    }
+    if (bp->do_verify) {
+        pel_resp = (uint8_t *)calloc(1, CPE_PEL_RESP_LEN);
+        if (NULL == pel_resp) {
+            pr2serr("%s: heap allocation problem\n", __func__);
+            tp->vres = SMP_LIB_RESOURCE_ERROR;
+        } else
+            tp->vres = verify_tgt(&tobj, tp, pel_resp);
+    }
+fini:
+    free(pel_resp);
+    free(rrp);
+    free(resps);
+    free(reqs);
+    smp_initiator_close(&tobj);
+    return NULL;
+}
+
+/* Outputs a line per phy, returns the first error seen */
+static int
+output_tgt(const struct cpe_tgt_t * tp, const struct cpe_bulk_t * bp)
+{
+    int k, n;
+    int ret = tp->res;
+    const struct cpe_phy_t * ppp;
+    char p[SMP_MAX_DEVICE_NAME + 32];
+    char b[128];
+
+    if (tp->sa)
+        snprintf(p, sizeof(p), "%s sa=0x%" PRIx64, tp->dev_name, tp->sa);
+    else
+        snprintf(p, sizeof(p), "%s", tp->dev_name);
+    if (tp->res) {
+        if (SMP_LIB_FILE_ERROR == tp->res)
+            printf("%s: open failed\n", p);
+        else if (SMP_LIB_RESOURCE_ERROR == tp->res)
+            printf("%s: out of memory\n", p);
+        else if ((tp->res > 0) && (tp->res < SMP_LIB_SYNTAX_ERROR))
+            printf("%s: REPORT GENERAL failed: %s\n", p,
+                   smp_get_func_res_str(tp->res, sizeof(b), b));
+        else
+            printf("%s: REPORT GENERAL failed\n", p);
+        return ret;
+    }
+    if (bp->do_verify && tp->vres) {
+        if (tp->vres < 0)
+            printf("%s: REPORT PHY EVENT LIST failed\n", p);
+        else
+            printf("%s: REPORT PHY EVENT LIST failed: %s\n", p,
+                   smp_get_func_res_str(tp->vres, sizeof(b), b));
+        ret = tp->vres;
+    }
+    for (n = 0, k = 0; k < tp->num_phys; ++k) {
+        ppp = tp->phys + k;
+        if (ppp->skip)
+            continue;
+        ++n;
+        printf("%s: phy %3d: ", p, ppp->phy_id);
+        if (0 == ppp->res)
+            printf("ok");
+        else if (ppp->res < 0)
+            printf("request failed");
+        else if (SMP_LIB_CAT_MALFORMED == ppp->res)
+            printf("malformed response");
+        else
+            printf("%s", smp_get_func_res_str(ppp->res, sizeof(b), b));
+        if (ppp->res && (0 == ret))
+            ret = (ppp->res < 0) ? SMP_LIB_CAT_OTHER : ppp->res;
+        if (bp->do_verify && (0 == tp->vres) && (0 == ppp->res)) {
+            if (ppp->num_found >= bp->num_desc)
+                printf(", verified");
+            else {
+                printf(", %d of %d sources not reported", bp->num_desc -
+                       ppp->num_found, bp->num_desc);
+                if (0 == ret)
+                    ret = SMP_LIB_CAT_OTHER;
+            }
+        }
+        printf("\n");
+    }
+    if (bp->all_phys && (bp->verbose || (0 == n)))
+        printf("%s: %d phys sent CONFIGURE PHY EVENT (vacant phys "
+               "skipped)\n", p, n);
+    if (ret < 0)
+        ret = SMP_LIB_CAT_OTHER;
+    return ret;
+}
+
+static int
+do_bulk(struct cpe_bulk_t * bp)
+{
+    int k, res;
+    int ret = 0;
+    struct cpe_tgt_t * tp;
+
+    for (k = 0; k < bp->num_tgts; ++k) {
+        tp = bp->tgts + k;
+        tp->thr_ok = (bp->num_tgts > 1) &&
+                     (0 == pthread_create(&tp->thr, NULL, bulk_worker, tp));
+        if (! tp->thr_ok)
+            bulk_worker(tp);
+    }
+    for (k = 0; k < bp->num_tgts; ++k) {
+        tp = bp->tgts + k;
+        if (tp->thr_ok)
+            pthread_join(tp->thr, NULL);
+        res = output_tgt(tp, bp);
+        if (res && (0 == ret))
+            ret = res;
+    }
+    return ret;
+}
+
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_conf_phy_event_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
+    bool all_phys = false;
     bool do_clear = false;
     bool do_enumerate = false;
     bool do_raw = false;
+    bool do_verify = false;
     int res, c, k, j, len, num_desc, act_resplen, pes_elem, thres_elem;
     int do_hex = 0;
     int expected_cc = 0;
-    int phy_id = 0;
+    int num_list = 1;
+    int num_sa = 0;
     int ret = 0;
     int subvalue = 0;
     int verbose = 0;
@@ -474,8 +795,12 @@ main(int argc, char * argv[])
     unsigned int thres_arr[MAX_PHY_EV_SRC];
     unsigned char smp_req[1028];
     unsigned char smp_resp[8];
+    uint8_t phy_list[256];
+    uint64_t sa_arr[MAX_SAS_ADDRS];
     struct smp_req_resp smp_rr;
     struct smp_target_obj tobj;
+    struct cpe_bulk_t * bp;
+    struct cpe_tgt_t * tp;
 
     memset(smp_req, 0, sizeof(smp_req));
     memset(pes_arr, 0, sizeof(pes_arr));
@@ -484,10 +809,11 @@ main(int argc, char * argv[])
     smp_req[1] = SMP_FN_CONFIG_PHY_EVENT;
     memset(device_name, 0, sizeof device_name);
     memset(i_params, 0, sizeof i_params);
+    phy_list[0] = 0;
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "CeE:f:hHI:p:P:rs:S:T:vV", long_options,
+        c = getopt_long(argc, argv, "CeE:f:hHI:p:P:rs:S:T:vVy", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -525,9 +851,15 @@ main(int argc, char * argv[])
             i_params[sizeof(i_params) - 1] = '\0';
             break;
         case 'p':
-            phy_id = smp_get_num(optarg);
-            if ((phy_id < 0) || (phy_id > 254)) {
-                pr2serr("bad argument to '--phy'\n");
+            if (0 == strcmp("all", optarg)) {
+                all_phys = true;
+                break;
+            }
+            all_phys = false;
+            num_list = smp_get_phy_list(optarg, phy_list, sizeof(phy_list));
+            if (num_list < 1) {
+                pr2serr("bad argument to '--phy', expect 'all' or a list "
+                        "of values from 0\nto 254 (e.g. '0,4-7')\n");
                 return SMP_LIB_SYNTAX_ERROR;
             }
             break;
@@ -547,7 +879,11 @@ main(int argc, char * argv[])
                 pr2serr("bad argument to '--sa'\n");
                 return SMP_LIB_SYNTAX_ERROR;
             }
-            sa = (uint64_t)sa_ll;
+            if (num_sa >= MAX_SAS_ADDRS) {
+                pr2serr("'--sa' given more than %d times\n", MAX_SAS_ADDRS);
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            sa_arr[num_sa++] = (uint64_t)sa_ll;
             break;
         case 'T':
             if (thres_op) {
@@ -562,25 +898,15 @@ main(int argc, char * argv[])
         case 'V':
             pr2serr("version: %s\n", version_str);
             return 0;
+        case 'y':
+            do_verify = true;
+            break;
         default:
             pr2serr("unrecognised switch code 0x%x ??\n", c);
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
     }
-    if (optind < argc) {
-        if ('\0' == device_name[0]) {
-            strncpy(device_name, argv[optind], sizeof(device_name) - 1);
-            device_name[sizeof(device_name) - 1] = '\0';
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SMP_LIB_SYNTAX_ERROR;
-        }
-    }
 
     if (do_enumerate) {
         printf("Phy Event Source names (preceded by hex value):\n");
@@ -588,25 +914,19 @@ main(int argc, char * argv[])
             printf("    [0x%02x] %s\n", pnp->pes, pnp->pes_name);
         return 0;
     }
-    if (0 == device_name[0]) {
+    if (optind >= argc) {
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == num_sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
     }
-    if ((cp = strchr(device_name, SMP_SUBVALUE_SEPARATOR))) {
-        *cp = '\0';
-        if (1 != sscanf(cp + 1, "%d", &subvalue)) {
-            pr2serr("expected number after separator in SMP_DEVICE name\n");
-            return SMP_LIB_SYNTAX_ERROR;
-        }
-    }
-    if (0 == sa) {
+    if (0 == num_sa) {
         cp = getenv("SMP_UTILS_SAS_ADDR");
         if (cp) {
            sa_ll = smp_get_llnum_nomult(cp);
@@ -615,11 +935,12 @@ main(int argc, char * argv[])
                         "SMP_UTILS_SAS_ADDR\n    use 0\n");
                 sa_ll = 0;
             }
-            sa = (uint64_t)sa_ll;
+            if (sa_ll)
+                sa_arr[num_sa++] = (uint64_t)sa_ll;
         }
     }
-    if (sa > 0) {
-        if (! smp_is_naa5(sa)) {
+    for (k = 0; k < num_sa; ++k) {
+        if (! smp_is_naa5(sa_arr[k])) {
             pr2serr("SAS (target) address not in naa-5 format (may need "
                     "leading '0x')\n");
             if ('\0' == i_params[0]) {
@@ -662,15 +983,10 @@ main(int argc, char * argv[])
 
     num_desc = pes_elem;
 
-    res = smp_initiator_open(device_name, subvalue, i_params, sa,
-                             &tobj, verbose);
-    if (res < 0)
-        return SMP_LIB_FILE_ERROR;
-
     smp_req[3] = (num_desc * 2) + 2;
     sg_put_unaligned_be16((uint16_t)expected_cc, smp_req + 4);
     smp_req[6] = do_clear ? 1 : 0;
-    smp_req[9] = phy_id;
+    smp_req[9] = phy_list[0];
     smp_req[10] = 2;    /* descriptor 2 dwords long */
     smp_req[11] = num_desc;
     for (k = 0, j = 12; k < num_desc; ++k, j += 8) {
@@ -688,6 +1004,79 @@ main(int argc, char * argv[])
         }
         pr2serr("\n");
     }
+
+    if (((argc - optind) > 1) || (num_sa > 1) || all_phys ||
+        (num_list > 1) || do_verify) {
+        if (do_hex || do_raw) {
+            pr2serr("--hex and --raw need a single phy and SMP target, and "
+                    "no --verify\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+        bp = (struct cpe_bulk_t *)calloc(1, sizeof(*bp));
+        if (NULL == bp) {
+            pr2serr("heap allocation problem\n");
+            return SMP_LIB_RESOURCE_ERROR;
+        }
+        bp->all_phys = all_phys;
+        bp->do_verify = do_verify;
+        bp->num_list = num_list;
+        memcpy(bp->phy_list, phy_list, sizeof(bp->phy_list));
+        bp->verbose = verbose;
+        bp->i_params = i_params;
+        bp->req = smp_req;
+        bp->req_len = 16 + (num_desc * 8);
+        bp->num_desc = num_desc;
+        /* each SMP_DEVICE with each SAS_ADDR given */
+        for (j = optind; (j < argc) || ((j == optind) && (optind >= argc));
+             ++j) {
+            subvalue = 0;
+            if (j < argc)
+                strncpy(device_name, argv[j], sizeof(device_name) - 1);
+            if ((cp = strchr(device_name, SMP_SUBVALUE_SEPARATOR))) {
+                *cp = '\0';
+                if (1 != sscanf(cp + 1, "%d", &subvalue)) {
+                    pr2serr("expected number after separator in SMP_DEVICE "
+                            "name\n");
+                    ret = SMP_LIB_SYNTAX_ERROR;
+                    goto bulk_fini;
+                }
+            }
+            for (k = 0; k < (num_sa ? num_sa : 1); ++k) {
+                if (bp->num_tgts >= MAX_TARGETS) {
+                    pr2serr("more than %d SMP targets\n", MAX_TARGETS);
+                    ret = SMP_LIB_SYNTAX_ERROR;
+                    goto bulk_fini;
+                }
+                tp = bp->tgts + bp->num_tgts++;
+                tp->bp = bp;
+                tp->subvalue = subvalue;
+                tp->sa = num_sa ? sa_arr[k] : 0;
+                memcpy(tp->dev_name, device_name, sizeof(tp->dev_name));
+            }
+        }
+        ret = do_bulk(bp);
+bulk_fini:
+        free(bp);
+        if (verbose && ret)
+            pr2serr("Exit status %d indicates error detected\n", ret);
+        return ret;
+    }
+
+    if (optind < argc)
+        strncpy(device_name, argv[optind], sizeof(device_name) - 1);
+    if ((cp = strchr(device_name, SMP_SUBVALUE_SEPARATOR))) {
+        *cp = '\0';
+        if (1 != sscanf(cp + 1, "%d", &subvalue)) {
+            pr2serr("expected number after separator in SMP_DEVICE name\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    sa = num_sa ? sa_arr[0] : 0;
+    res = smp_initiator_open(device_name, subvalue, i_params, sa,
+                             &tobj, verbose);
+    if (res < 0)
+        return SMP_LIB_FILE_ERROR;
+
     memset(&smp_rr, 0, sizeof(smp_rr));
     smp_rr.request_len = 16 + (num_desc * 8);
     smp_rr.request = smp_req;
@@ -119,8 +119,13 @@ dStrRaw(const uint8_t * str, int len)
 }
 
 
+#ifdef SMP_UTILS_MULTI
+int
+smp_conf_route_info_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
     bool do_disable = false;
     bool do_raw = false;
@@ -242,9 +247,10 @@ main(int argc, char * argv[])
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
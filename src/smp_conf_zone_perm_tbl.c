@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2011-2018, Douglas Gilbert
+ * Copyright (c) 2011-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -31,7 +31,6 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <string.h>
-#include <ctype.h>
 #include <errno.h>
 #include <getopt.h>
 #include <sys/ioctl.h>
@@ -49,21 +48,34 @@
  * utility.
  *
  * This utility issues a CONFIGURE ZONE PERMISSION TABLE function and outputs
- * its response.
+ * its response. With --delta the shadow table is read first and only
+ * source zone groups whose rows differ are written.
  */
 
-static const char * version_str = "1.10 20180724";
+static const char * version_str = "1.12 20261014";
 
 /* Permission table big enough for 256 source zone groups (rows) and
  * 256 destination zone groups (columns). Each element is a single bit,
  * written in the drafts as ZP[s,d] . */
 static unsigned char full_perm_tbl[32 * 256];
 
+/* For --delta: the shadow table read from the expander, the table wanted
+ * and a bit per source zone group whose rows differ */
+static struct smp_zone_perm cur_zp;
+static struct smp_zone_perm want_zp;
+static uint64_t chg_rows[SMP_ZP_WORDS];
+
+/* Source zone group runs, relative to sszg, to configure */
+static int run_start[256];
+static int run_len[256];
+
 static bool sszg_given = false;
 static int sszg = 0;
 
 static struct option long_options[] = {
+    {"bin", no_argument, 0, 'b'},
     {"deduce", no_argument, 0, 'd'},
+    {"delta", no_argument, 0, 'D'},
     {"expected", required_argument, 0, 'E'},
     {"help", no_argument, 0, 'h'},
     {"hex", no_argument, 0, 'H'},
@@ -83,19 +95,24 @@ static struct option long_options[] = {
 static void
 usage(void)
 {
-    pr2serr("Usage: smp_conf_zone_perm_tbl [--deduce] [--expected=EX] "
-            "[--help] [--hex]\n"
-            "                              [--interface=PARAMS] [--numzg=NG] "
-            "--permf=FN\n"
-            "                              [--raw] [--sa=SAS_ADDR] "
-            "[--save=SAV]\n"
+    pr2serr("Usage: smp_conf_zone_perm_tbl [--bin] [--deduce] [--delta] "
+            "[--expected=EX]\n"
+            "                              [--help]"
+            " [--hex] [--interface=PARAMS] [--numzg=NG]\n"
+            "                              --permf=FN"
+            " [--raw] [--sa=SAS_ADDR] [--save=SAV]\n"
             "                              [--start=SS] [--verbose] "
             "[--version]\n"
             "                              SMP_DEVICE[,N]\n"
             "  where:\n"
+            "    --bin|-b               FN holds the descriptors in binary, "
+            "not hex\n"
             "    --deduce|-d            deduce number of zone groups from "
             "number\n"
             "                           of bytes on active FN lines\n"
+            "    --delta|-D             read shadow table first, only "
+            "configure\n"
+            "                           source zone groups that differ\n"
             "    --expected=EX|-E EX    set expected expander change "
             "count to EX\n"
             "    --help|-h              print out usage message\n"
@@ -130,178 +147,105 @@ usage(void)
            );
 }
 
-/* Read ASCII hex bytes from fname (a file named '-' taken as stdin).
- * There should be either one entry per line or a comma, space or tab
- * separated list of bytes. The first ASCII hex string detected has its
- * length checked; if the length is 1 or 2 then bytes are expected to
- * be space, comma or tab separated; if the length is 3 or more then a
- * string of ACSII hex digits is expected, 2 per byte. If any lines
- * contain more that 16 bytes (numzg256p is non-NULL), then true is written
- * to *numzg256p. Everything from and including a '#' and '-' on a line
- * is ignored. '#' is meant for comments. '-' is meant as a lead-in to an
- * option (e.g. "--start=8"); not yet implemented.
- * Returns 0 if ok, or 1 if error. */
-static int
-f2hex_arr(const char * fname, unsigned char * mp_arr, int * mp_arr_len,
-          int max_arr_len, bool * numzg256p, int verbose)
+static void
+dStrRaw(const uint8_t * str, int len)
 {
-    bool checked_hexlen = false;
-    bool no_space = false;
-    bool numzg256 = false;
-    int fn_len, in_len, k, j, m;
-    int off = 0;
-    unsigned int h;
-    const char * lcp;
-    FILE * fp;
-    char line[512];
+    int k;
 
-    if ((NULL == fname) || (NULL == mp_arr) || (NULL == mp_arr_len))
-        return 1;
-    fn_len = strlen(fname);
-    if (0 == fn_len)
-        return 1;
-    if ((1 == fn_len) && ('-' == fname[0]))        /* read from stdin */
-        fp = stdin;
-    else {
-        fp = fopen(fname, "r");
-        if (NULL == fp) {
-            pr2serr("Unable to open %s for reading\n", fname);
-            return 1;
-        }
-    }
+    for (k = 0 ; k < len; ++k)
+        printf("%c", str[k]);
+}
 
-    for (j = 0; j < 512; ++j) {
-        if (NULL == fgets(line, sizeof(line), fp))
-            break;
-        in_len = strlen(line);
-        if (in_len > 0) {
-            if ('\n' == line[in_len - 1]) {
-                --in_len;
-                line[in_len] = '\0';
-            }
-        }
-        if (0 == in_len)
-            continue;
-        lcp = line;
-        m = strspn(lcp, " \t");
-        if (m == in_len)
-            continue;
-        lcp += m;
-        in_len -= m;
-        if ('#' == *lcp)
-            continue;
-        if ('-' == *lcp) {
-            if (0 == strncmp("--start=", lcp, 8)) {
-                if (1 == sscanf(lcp, "--start=%d", &k)) {
-                    if (sszg_given && (k != sszg)) {
-                        pr2serr("permission file '--start=%d' contradicts "
-                                "command line '--start=%d'\n", k, sszg);
-                        goto bad;
-                    }
-                    if (verbose)
-                        pr2serr("permission file contains --start=%d, using "
-                                "it\n", k);
-                    sszg = k;
-                }  else if (verbose)
-                    pr2serr("found line with '-' but could not decode "
-                            "--start=<num>\n");
-            }
-            continue;
-        }
-        if (! checked_hexlen) {
-            checked_hexlen = true;
-            k = strspn(lcp, "0123456789aAbBcCdDeEfF");
-            if (k > 2)
-                no_space = true;
-        }
+/* Reads num_desc rows of the shadow zone permission table, starting at
+ * source zone group sszg, into cur_zp. Returns 0 if ok, else
+ * SMP_LIB_CAT_MALFORMED (e.g. the expander reports a different number of
+ * zone groups), the function result, or -1. */
+static int
+read_shadow_tbl(struct smp_target_obj * top, int num_zg, int num_desc,
+                int verbose)
+{
+    int res;
+    char b[128];
 
-        k = strspn(lcp, "0123456789aAbBcCdDeEfF ,\t");
-        if ((k < in_len) && ('#' != lcp[k]) && ('-' != lcp[k])) {
-            pr2serr("%s: syntax error at line %d, pos %d\n", __func__, j + 1,
-                    m + k + 1);
-            goto bad;
-        }
-        if (no_space) {
-            for (k = 0; isxdigit(*lcp) && isxdigit(*(lcp + 1));
-                 ++k, lcp += 2) {
-                if (1 != sscanf(lcp, "%2x", &h)) {
-                    pr2serr("%s: bad hex number in line %d, pos %d\n",
-                            __func__, j + 1, (int)(lcp - line + 1));
-                    goto bad;
-                }
-                if ((off + k) >= max_arr_len) {
-                    pr2serr("%s: array length exceeded\n", __func__);
-                    goto bad;
-                }
-                mp_arr[off + k] = h;
-            }
-            if (k > 16)
-                numzg256 = true;
-            off += k;
-        } else {
-            for (k = 0; k < 1024; ++k) {
-                if (1 == sscanf(lcp, "%x", &h)) {
-                    if (h > 0xff) {
-                        pr2serr("%s: hex number larger than 0xff in line %d, "
-                                "pos %d\n", __func__, j + 1,
-                                (int)(lcp - line + 1));
-                        goto bad;
-                    }
-                    if ((off + k) >= max_arr_len) {
-                        pr2serr("%s: array length exceeded\n", __func__);
-                        goto bad;
-                    }
-                    mp_arr[off + k] = h;
-                    lcp = strpbrk(lcp, " ,\t");
-                    if (NULL == lcp)
-                        break;
-                    lcp += strspn(lcp, " ,\t");
-                    if ('\0' == *lcp)
-                        break;
-                } else {
-                    if (('#' == *lcp) || ('-' == *lcp)) {
-                        --k;
-                        break;
-                    }
-                    pr2serr("%s: error in line %d, at pos %d\n", __func__,
-                            j + 1, (int)(lcp - line + 1));
-                    goto bad;
-                }
-            }
-            if (k > 15)
-                numzg256 = true;
-            off += (k + 1);
-        }
+    res = smp_zp_read(top, 1 /* shadow */, sszg, num_desc, &cur_zp,
+                      verbose);
+    if (res > 0) {
+        if (res < SMP_LIB_SYNTAX_ERROR)
+            pr2serr("Report zone permission table result: %s\n",
+                    smp_get_func_res_str(res, sizeof(b), b));
+        else
+            pr2serr("Report zone permission table response malformed\n");
+        return (res < SMP_LIB_SYNTAX_ERROR) ? res : SMP_LIB_CAT_MALFORMED;
+    } else if (res < 0) {
+        pr2serr("Report zone permission table: smp_send_req failed\n");
+        return -1;
+    }
+    if (cur_zp.num_zg != num_zg) {
+        pr2serr("expander has %d zone groups, %d given\n", cur_zp.num_zg,
+                num_zg);
+        return SMP_LIB_CAT_MALFORMED;
     }
-    *mp_arr_len = off;
-    fclose(fp);
-    if (numzg256p)
-        *numzg256p = numzg256;
     return 0;
-bad:
-    fclose(fp);
-    return 1;
 }
 
-static void
-dStrRaw(const uint8_t * str, int len)
+/* Splits the num_desc rows to configure into runs of at most max_d
+ * descriptors. When delta is true, rows that are the same in full_perm_tbl
+ * and cur_zp are skipped; unchanged rows between two changed ones are sent
+ * when that saves a request. Returns the number of runs and sets
+ * *num_chgp to the number of rows that differ. */
+static int
+plan_runs(int num_zg, int num_desc, int desc_len, int max_d, bool delta,
+          int * num_chgp)
 {
-    int k;
+    int j, s, last, num_runs;
 
-    for (k = 0 ; k < len; ++k)
-        printf("%c", str[k]);
+    if (delta) {
+        smp_zp_init(&want_zp, num_zg);
+        for (j = 0; j < num_desc; ++j)
+            smp_zp_set_row(&want_zp, sszg + j, full_perm_tbl + (j * desc_len));
+        *num_chgp = smp_zp_diff(&want_zp, &cur_zp, chg_rows);
+    } else {
+        memset(chg_rows, 0xff, sizeof(chg_rows));
+        *num_chgp = num_desc;
+    }
+    for (num_runs = 0, j = 0; j < num_desc; ) {
+        s = sszg + j;
+        if (0 == ((chg_rows[s / 64] >> (s % 64)) & 1)) {
+            ++j;
+            continue;
+        }
+        run_start[num_runs] = j;
+        last = j;
+        for (++j; (j < num_desc) && ((j - run_start[num_runs]) < max_d);
+             ++j) {
+            s = sszg + j;
+            if ((chg_rows[s / 64] >> (s % 64)) & 1)
+                last = j;
+        }
+        run_len[num_runs] = last + 1 - run_start[num_runs];
+        j = last + 1;
+        ++num_runs;
+    }
+    return num_runs;
 }
 
 
+#ifdef SMP_UTILS_MULTI
+int
+smp_conf_zone_perm_tbl_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
     bool deduce = false;
+    bool do_bin = false;
+    bool delta = false;
     bool do_raw = false;
     bool numzg256;
     bool num_zg_given = false;
-    int res, c, k, j, len, num_desc, numd, desc_len;
-    int max_desc_per_req, act_resplen;
+    int res, c, k, j, r, len, num_desc, numd, desc_len, num_runs, num_chg;
+    int max_desc_per_req, act_resplen, file_sszg, line_max;
     int expected_cc = 0;
     int do_hex = 0;
     int do_save = 0;
@@ -321,20 +265,35 @@ main(int argc, char * argv[])
     struct smp_req_resp smp_rr;
     struct smp_target_obj tobj;
 
+    /* file scope state: smp_shell may run this more than once */
+    memset(full_perm_tbl, 0, sizeof(full_perm_tbl));
+    memset(&cur_zp, 0, sizeof(cur_zp));
+    memset(&want_zp, 0, sizeof(want_zp));
+    memset(chg_rows, 0, sizeof(chg_rows));
+    memset(run_start, 0, sizeof(run_start));
+    memset(run_len, 0, sizeof(run_len));
+    sszg_given = false;
+    sszg = 0;
     memset(device_name, 0, sizeof device_name);
     memset(i_params, 0, sizeof i_params);
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "dE:f:hHI:n:P:rs:S:vV", long_options,
+        c = getopt_long(argc, argv, "bdDE:f:hHI:n:P:rs:S:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'b':
+            do_bin = true;
+            break;
         case 'd':
             deduce = true;
             break;
+        case 'D':
+            delta = true;
+            break;
         case 'E':
             expected_cc = smp_get_num(optarg);
             if ((expected_cc < 0) || (expected_cc > 65535)) {
@@ -426,9 +385,10 @@ main(int argc, char * argv[])
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -470,11 +430,23 @@ main(int argc, char * argv[])
         pr2serr("can't give both --deduce and --numzg=\n");
         return SMP_LIB_SYNTAX_ERROR;
     }
-    if (f2hex_arr(permf, full_perm_tbl, &len, sizeof full_perm_tbl,
-                  &numzg256, verbose)) {
+    if (smp_f2hex_arr(permf, do_bin, full_perm_tbl, &len,
+                      sizeof full_perm_tbl, &file_sszg, &line_max, verbose)) {
         pr2serr("failed decoding --permf=FN option\n");
         return SMP_LIB_SYNTAX_ERROR;
     }
+    if (file_sszg >= 0) {
+        if (sszg_given && (file_sszg != sszg)) {
+            pr2serr("permission file '--start=%d' contradicts "
+                    "command line '--start=%d'\n", file_sszg, sszg);
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+        if (verbose)
+            pr2serr("permission file contains --start=%d, using it\n",
+                    file_sszg);
+        sszg = file_sszg;
+    }
+    numzg256 = (line_max > 16);
     if (deduce && numzg256)
         num_zg = 256;
     desc_len = (128 == num_zg) ? 16 : 32;
@@ -484,15 +456,30 @@ main(int argc, char * argv[])
                 "excess\n", desc_len);
     max_desc_per_req = (128 == num_zg) ? 63 : 31;
 
+    if (delta && ((sszg + num_desc) > num_zg)) {
+        pr2serr("warning: permf data goes past the last zone group, ignore "
+                "excess\n");
+        num_desc = (sszg < num_zg) ? (num_zg - sszg) : 0;
+    }
+
     res = smp_initiator_open(device_name, subvalue, i_params, sa,
                              &tobj, verbose);
     if (res < 0)
         return SMP_LIB_FILE_ERROR;
 
-    for (j = 0; j < num_desc; j += max_desc_per_req) {
-        numd = num_desc - j;
-        if (numd > max_desc_per_req)
-            numd = max_desc_per_req;
+    if (delta && num_desc) {
+        ret = read_shadow_tbl(&tobj, num_zg, num_desc, verbose);
+        if (ret)
+            goto err_out;
+    }
+    num_runs = plan_runs(num_zg, num_desc, desc_len, max_desc_per_req, delta,
+                         &num_chg);
+    if (delta && verbose)
+        pr2serr("--delta: %d of %d source zone groups differ, %d "
+                "request(s)\n", num_chg, num_desc, num_runs);
+    for (r = 0; r < num_runs; ++r) {
+        j = run_start[r];
+        numd = run_len[r];
         memset(smp_req, 0, sizeof(smp_req));
         smp_req[0] = SMP_FRAME_TYPE_REQ;
         smp_req[1] = SMP_FN_CONFIG_ZONE_PERMISSION_TBL;
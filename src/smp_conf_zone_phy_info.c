@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2011-2018, Douglas Gilbert
+ * Copyright (c) 2011-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -31,7 +31,6 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <string.h>
-#include <ctype.h>
 #include <errno.h>
 #include <getopt.h>
 #include <sys/ioctl.h>
@@ -52,9 +51,10 @@
  * its response.
  */
 
-static const char * version_str = "1.11 20180724";
+static const char * version_str = "1.12 20261014";
 
 static struct option long_options[] = {
+    {"bin", no_argument, 0, 'b'},
     {"expected", required_argument, 0, 'E'},
     {"help", no_argument, 0, 'h'},
     {"hex", no_argument, 0, 'H'},
@@ -72,7 +72,8 @@ static struct option long_options[] = {
 static void
 usage(void)
 {
-    pr2serr("Usage: smp_conf_zone_phy_info [--expected=EX] [--help] [--hex]\n"
+    pr2serr("Usage: smp_conf_zone_phy_info [--bin] [--expected=EX] [--help] "
+            "[--hex]\n"
             "                              [--interface=PARAMS] "
             "--pconf=FN\n"
             "                              [--raw] [--sa=SAS_ADDR] "
@@ -80,6 +81,8 @@ usage(void)
             "                              [--verbose] [--version] "
             "SMP_DEVICE[,N]\n"
             "  where:\n"
+            "    --bin|-b               FN holds the descriptors in binary, "
+            "not hex\n"
             "    --expected=EX|-E EX    set expected expander change "
             "count to EX\n"
             "    --help|-h              print out usage message\n"
@@ -108,131 +111,6 @@ usage(void)
            );
 }
 
-/* Read ASCII hex bytes from fname (a file named '-' taken as stdin).
- * There should be either one entry per line or a comma, space or tab
- * separated list of bytes. The first ASCII hex string detected has its
- * length checked; if the length is 1 or 2 then bytes are expected to
- * be space, comma or tab separated; if the length is 3 or more then a
- * string of ACSII hex digits is expected, 2 per byte. Everything from
- * and including a '#' on a line is ignored.
- * Returns 0 if ok, or 1 if error. */
-static int
-f2hex_arr(const char * fname, uint8_t * mp_arr, int * mp_arr_len,
-          int max_arr_len)
-{
-    bool checked_hexlen = false;
-    bool no_space = false;
-    int fn_len, in_len, k, j, m;
-    int off = 0;
-    unsigned int h;
-    const char * lcp;
-    FILE * fp;
-    char line[512];
-
-    if ((NULL == fname) || (NULL == mp_arr) || (NULL == mp_arr_len))
-        return 1;
-    fn_len = strlen(fname);
-    if (0 == fn_len)
-        return 1;
-    if ((1 == fn_len) && ('-' == fname[0]))        /* read from stdin */
-        fp = stdin;
-    else {
-        fp = fopen(fname, "r");
-        if (NULL == fp) {
-            pr2serr("Unable to open %s for reading\n", fname);
-            return 1;
-        }
-    }
-
-    for (j = 0; j < 512; ++j) {
-        if (NULL == fgets(line, sizeof(line), fp))
-            break;
-        in_len = strlen(line);
-        if (in_len > 0) {
-            if ('\n' == line[in_len - 1]) {
-                --in_len;
-                line[in_len] = '\0';
-            }
-        }
-        if (0 == in_len)
-            continue;
-        lcp = line;
-        m = strspn(lcp, " \t");
-        if (m == in_len)
-            continue;
-        lcp += m;
-        in_len -= m;
-        if ('#' == *lcp)
-            continue;
-        if (! checked_hexlen) {
-            checked_hexlen = true;
-            k = strspn(lcp, "0123456789aAbBcCdDeEfF");
-            if (k > 2)
-                no_space = true;
-        }
-
-        k = strspn(lcp, "0123456789aAbBcCdDeEfF ,\t");
-        if ((k < in_len) && ('#' != lcp[k])) {
-            pr2serr("%s: syntax error at line %d, pos %d\n", __func__, j + 1,
-                    m + k + 1);
-            goto bad;
-        }
-        if (no_space) {
-            for (k = 0; isxdigit(*lcp) && isxdigit(*(lcp + 1));
-                 ++k, lcp += 2) {
-                if (1 != sscanf(lcp, "%2x", &h)) {
-                    pr2serr("%s: bad hex number in line %d, pos %d\n",
-                            __func__, j + 1, (int)(lcp - line + 1));
-                    goto bad;
-                }
-                if ((off + k) >= max_arr_len) {
-                    pr2serr("%s: array length exceeded\n", __func__);
-                    goto bad;
-                }
-                mp_arr[off + k] = h;
-            }
-            off += k;
-        } else {
-            for (k = 0; k < 1024; ++k) {
-                if (1 == sscanf(lcp, "%x", &h)) {
-                    if (h > 0xff) {
-                        pr2serr("%s: hex number larger than 0xff in line %d, "
-                                "pos %d\n", __func__, j + 1,
-                                (int)(lcp - line + 1));
-                        goto bad;
-                    }
-                    if ((off + k) >= max_arr_len) {
-                        pr2serr("%s: array length exceeded\n", __func__);
-                        goto bad;
-                    }
-                    mp_arr[off + k] = h;
-                    lcp = strpbrk(lcp, " ,\t");
-                    if (NULL == lcp)
-                        break;
-                    lcp += strspn(lcp, " ,\t");
-                    if ('\0' == *lcp)
-                        break;
-                } else {
-                    if ('#' == *lcp) {
-                        --k;
-                        break;
-                    }
-                    pr2serr("%s: error in line %d, at pos %d\n", __func__,
-                            j + 1, (int)(lcp - line + 1));
-                    goto bad;
-                }
-            }
-            off += (k + 1);
-        }
-    }
-    *mp_arr_len = off;
-    fclose(fp);
-    return 0;
-bad:
-    fclose(fp);
-    return 1;
-}
-
 static void
 dStrRaw(const uint8_t * str, int len)
 {
@@ -243,9 +121,15 @@ dStrRaw(const uint8_t * str, int len)
 }
 
 
+#ifdef SMP_UTILS_MULTI
+int
+smp_conf_zone_phy_info_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
+    bool do_bin = false;
     bool do_raw = false;
     int res, c, k, len, num_desc, act_resplen;
     int expected_cc = 0;
@@ -274,12 +158,15 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "E:hHI:p:rs:S:vV", long_options,
+        c = getopt_long(argc, argv, "bE:hHI:p:rs:S:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'b':
+            do_bin = true;
+            break;
         case 'E':
             expected_cc = smp_get_num(optarg);
             if ((expected_cc < 0) || (expected_cc > 65535)) {
@@ -348,9 +235,10 @@ main(int argc, char * argv[])
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -388,7 +276,8 @@ main(int argc, char * argv[])
         pr2serr("--pconf=FN option is required (i.e. it's not optional)\n");
         return SMP_LIB_SYNTAX_ERROR;
     }
-    if (f2hex_arr(pconf, smp_req + 8, &len, sizeof(smp_req) - 12)) {
+    if (smp_f2hex_arr(pconf, do_bin, smp_req + 8, &len, sizeof(smp_req) - 12,
+                      NULL, NULL, verbose)) {
         pr2serr("failed decoding --pconf=FN option\n");
         return SMP_LIB_SYNTAX_ERROR;
     }
@@ -58,15 +58,41 @@
  * defined in the SPL series. The most recent SPL-5 draft is spl5r05.pdf .
  */
 
-static const char * version_str = "1.62 20190124";    /* spl5r05 */
+static const char * version_str = "1.69 20261014";    /* spl5r05 */
 
 
 #define SMP_FN_DISCOVER_RESP_LEN 124
-#define SMP_FN_REPORT_GENERAL_RESP_LEN 76
+#define SMP_FN_DISCOVER_LIST_RESP_LEN 1028
+#define MAX_DLIST_SHORT_DESCS 40
+#define MAX_DLIST_LONG_DESCS 8
+#define MAX_PHY_ID 254
+
+#define SNAP_MAGIC "smp_discover snapshot 1"
 
+/* Saved between invocations by --since=SNAPSHOT, see do_multiple() */
+struct snap_t {
+    bool loaded;        /* read from file and is for this SMP target */
+    int exp_cc;         /* expander change count */
+    int num_phys;
+    uint64_t sa;        /* expander's SAS address */
+    int resp_len[MAX_PHY_ID + 1];   /* 0 -> none, < 0 -> (-4 - fres) */
+    bool stale[MAX_PHY_ID + 1];     /* true -> send DISCOVER for phy */
+    uint8_t resp[MAX_PHY_ID + 1][SMP_FN_DISCOVER_RESP_LEN];
+};
+
+/* DISCOVER LIST response used by do_multiple() in place of one DISCOVER
+ * per phy. Each long descriptor holds a DISCOVER response. */
+struct dlist_t {
+    bool use;           /* false -> per phy DISCOVER */
+    int first;          /* phy id of first descriptor in rp */
+    int num;            /* number of descriptors in rp */
+    int desc_len;
+    uint8_t * rp;       /* SMP_FN_DISCOVER_LIST_RESP_LEN bytes */
+};
 
 struct opts_t {
     bool do_adn;
+    bool do_cached;
     bool do_cap_phy;
     bool do_dsn;
     bool ign_zp;
@@ -81,28 +107,46 @@ struct opts_t {
     int do_hex;
     int multiple;
     int do_num;
+    int out_fmt;                /* 0, SMP_EMIT_JSON or SMP_EMIT_CSV */
     int phy_id;
+    int retries;                /* -1 -> library default */
+    int timeout_ms;             /* -1 -> library default */
     int verbose;
     uint64_t sa;
+    const char * since_fn;
+    const char * save_fn;       /* --save=FILE */
+    const char * from_fn;       /* --from=FILE */
+    const char * dev_name;
+    struct snap_t * snp;
+    struct smp_emit * emp;      /* non-NULL with --json or --csv */
+    struct smp_req_tmpl * disc_tp;      /* DISCOVER request template */
 };
 
 static struct option long_options[] = {
         {"adn", no_argument, 0, 'A'},
         {"brief", no_argument, 0, 'b'},
+        {"cached", no_argument, 0, 'k'},
         {"cap", no_argument, 0, 'c'},
         {"dsn", no_argument, 0, 'D'},
+        {"from", required_argument, 0, 'F'},
         {"help", no_argument, 0, 'h'},
         {"hex", no_argument, 0, 'H'},
+        {"csv", no_argument, 0, 'x'},
         {"ignore", no_argument, 0, 'i'},
         {"interface", required_argument, 0, 'I'},
+        {"json", no_argument, 0, 'j'},
         {"list", no_argument, 0, 'l'},
         {"multiple", no_argument, 0, 'm'},
         {"my", no_argument, 0, 'M'},
         {"num", required_argument, 0, 'n'},
         {"phy", required_argument, 0, 'p'},
         {"sa", required_argument, 0, 's'},
+        {"save", required_argument, 0, 'w'},
+        {"since", required_argument, 0, 'C'},
         {"summary", no_argument, 0, 'S'},
         {"raw", no_argument, 0, 'r'},
+        {"retries", required_argument, 0, 'R'},
+        {"timeout", required_argument, 0, 't'},
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
         {"zero", no_argument, 0, 'z'},
@@ -114,24 +158,37 @@ static void
 usage(void)
 {
     pr2serr("Usage: "
-            "smp_discover [--adn] [--brief] [--cap] [--dsn] [--help] "
-            "[--hex]\n"
-            "                    [--ignore] [--interface=PARAMS] [--list] "
+            "smp_discover [--adn] [--brief] [--cached] [--cap] [--csv] "
+            "[--dsn]\n"
+            "                    [--from=FILE] [--help] [--hex] [--ignore]\n"
+            "                    [--interface=PARAMS] [--json] [--list] "
             "[--multiple]\n"
             "                    [--my] [--num=NUM] [--phy=ID] [--raw] "
-            "[--sa=SAS_ADDR]\n"
-            "                    [--summary] [--verbose] [--version] "
-            "[--zero]\n"
-            "                    SMP_DEVICE[,N]\n"
+            "[--retries=N]\n"
+            "                    [--sa=SAS_ADDR] [--save=FILE] "
+            "[--since=SNAPSHOT]\n"
+            "                    [--summary] [--timeout=MS] [--verbose] "
+            "[--version]\n"
+            "                    [--zero] SMP_DEVICE[,N]\n"
             "  where:\n"
             "    --adn|-A             output attached device name in one "
             "line per\n"
             "                         phy mode (i.e. with --multiple)\n"
             "    --brief|-b           less output, can be used multiple "
             "times\n"
+            "    --cached|-k          in one line per phy output take "
+            "what the kernel\n"
+            "                         has in sysfs, DISCOVER only phys it "
+            "lacks\n"
             "    --cap|-c             decode phy capabilities bits\n"
+            "    --csv|-x             output one comma separated line per "
+            "phy,\n"
+            "                         after a header line of field names\n"
             "    --dsn|-D             show device slot number in 1 line\n"
             "                         per phy output, if available\n"
+            "    --from=FILE|-F FILE  answer requests from snapshot FILE "
+            "(written by\n"
+            "                         --save) rather than from SMP_DEVICE\n"
             "    --help|-h            print out usage message\n"
             "    --hex|-H             print response in hexadecimal\n"
             "    --ignore|-i          sets the Ignore Zone Group bit; "
@@ -139,6 +196,8 @@ usage(void)
             "                         phys otherwise hidden by zoning\n"
             "    --interface=PARAMS|-I PARAMS    specify or override "
             "interface\n"
+            "    --json|-j            output one JSON object per line, "
+            "one per phy\n"
             "    --list|-l            output attribute=value, 1 per line\n"
             "    --multiple|-m        query multiple phys, output 1 line "
             "for each\n"
@@ -150,18 +209,35 @@ usage(void)
             "                         (def: 0 -> the rest)\n"
             "    --phy=ID|-p ID       phy identifier [or starting phy id]\n"
             "    --raw|-r             output response in binary\n"
+            "    --retries=N|-R N     times to resend a request answered "
+            "BUSY (or\n"
+            "                         that timed out with --timeout) "
+            "(def: 2)\n"
             "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of SMP "
             "target (use leading\n"
             "                                 '0x' or trailing 'h'). "
             "Depending on\n"
             "                                 the interface, may not be "
             "needed\n"
+            "    --save=FILE|-w FILE  save each request and its response in "
+            "snapshot\n"
+            "                         FILE, to be read later with "
+            "--from=FILE\n"
+            "    --since=SNAPSHOT|-C SNAPSHOT    only send DISCOVER to phys "
+            "that have\n"
+            "                         changed since SNAPSHOT file was "
+            "written, then\n"
+            "                         update it (with '--multiple' or "
+            "'--summary')\n"
             "    --summary|-S         query phys, output 1 line for each "
             "active one,\n"
             "                         equivalent to '--multiple --brief' "
             "('-mb').\n"
             "                         This option is assumed if '--phy=ID' "
             "not given\n"
+            "    --timeout=MS|-t MS   SMP request timeout in milliseconds "
+            "(def: 0 ->\n"
+            "                         pass-through's default)\n"
             "    --verbose|-v         increase verbosity\n"
             "    --version|-V         print version string and exit\n"
             "    --zero|-z            zero Allocated Response Length "
@@ -185,108 +261,39 @@ dStrRaw(const uint8_t * str, int len)
 
 /* Returns the number of phys (from REPORT GENERAL response) and if
  * t2t_routingp is non-NULL places 'Table to Table Supported' bit where it
+ * points. If exp_ccp is non-NULL places the expander change count where it
  * points. Returns -3 (or less) -> SMP_LIB errors negated (-4 - smp_err),
- * -1 for other errors. */
+ * -1 for other errors. A cached REPORT GENERAL response is used unless
+ * --since needs the current expander change count. */
 static int
 get_num_phys(struct smp_target_obj * top, const struct opts_t * op,
-             bool * t2t_routingp)
+             bool * t2t_routingp, int * exp_ccp)
 {
-    bool t2t;
-    int len, res, k, act_resplen;
-    int ret = 0;
-    char * cp;
-    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_REPORT_GENERAL, 0, 0,
-                         0, 0, 0, 0};
-    struct smp_req_resp smp_rr;
-    uint8_t * rp = NULL;
-    uint8_t * free_rp = NULL;
+    int res;
     char b[256];
+    struct smp_report_general rg;
 
-    rp = smp_memalign(SMP_FN_REPORT_GENERAL_RESP_LEN, 0, &free_rp, false);
-    if (NULL == rp) {
-        pr2serr("%s: heap allocation problem\n", __func__);
-        return SMP_LIB_RESOURCE_ERROR;
-    }
-    if (op->verbose) {
-        pr2serr("    Report general request: ");
-        for (k = 0; k < (int)sizeof(smp_req); ++k)
-            pr2serr("%02x ", smp_req[k]);
-        pr2serr("\n");
-    }
-    memset(&smp_rr, 0, sizeof(smp_rr));
-    smp_rr.request_len = sizeof(smp_req);
-    smp_rr.request = smp_req;
-    smp_rr.max_response_len = SMP_FN_REPORT_GENERAL_RESP_LEN;
-    smp_rr.response = rp;
-    res = smp_send_req(top, &smp_rr, op->verbose);
-
-    if (res) {
+    res = smp_get_report_general(top, &rg, (op->since_fn ? 0 : -1),
+                                 op->verbose);
+    if (res < 0) {
         pr2serr("RG smp_send_req failed, res=%d\n", res);
         if (0 == op->verbose)
             pr2serr("    try adding '-v' option for more debug\n");
-        ret = -1;
-        goto fini;
-    }
-    if (smp_rr.transport_err) {
-        pr2serr("RG smp_send_req transport_error=%d\n",
-                smp_rr.transport_err);
-        ret = -1;
-        goto fini;
-    }
-    act_resplen = smp_rr.act_response_len;
-    if ((act_resplen >= 0) && (act_resplen < 4)) {
-        pr2serr("RG response too short, len=%d\n", act_resplen);
-        ret = -4 - SMP_LIB_CAT_MALFORMED;
-        goto fini;
-    }
-    len = rp[3];
-    if ((0 == len) && (0 == rp[2])) {
-        len = smp_get_func_def_resp_len(rp[1]);
-        if (len < 0) {
-            len = 0;
-            if (op->verbose > 1)
-                pr2serr("unable to determine RG response length\n");
-        }
-    }
-    len = 4 + (len * 4);        /* length in bytes, excluding 4 byte CRC */
-    if ((act_resplen >= 0) && (len > act_resplen)) {
-        if (op->verbose)
-            pr2serr("actual RG response length [%d] less than deduced "
-                    "length [%d]\n", act_resplen, len);
-        len = act_resplen;
-    }
-    /* ignore --hex and --raw */
-    if (SMP_FRAME_TYPE_RESP != rp[0]) {
-        pr2serr("RG expected SMP frame response type, got=0x%x\n",
-                rp[0]);
-        ret = -4 - SMP_LIB_CAT_MALFORMED;
-        goto fini;
-    }
-    if (rp[1] != smp_req[1]) {
-        pr2serr("RG Expected function code=0x%x, got=0x%x\n",
-                smp_req[1], rp[1]);
-        ret = -4 - SMP_LIB_CAT_MALFORMED;
-        goto fini;
-    }
-    if (rp[2]) {
-        if (op->verbose > 1) {
-            cp = smp_get_func_res_str(rp[2], sizeof(b), b);
-            pr2serr("Report General result: %s\n", cp);
-        }
-        ret = -4 - rp[2];
-        goto fini;
+        return -1;
+    } else if (res) {
+        if ((SMP_LIB_CAT_MALFORMED != res) && (op->verbose > 1))
+            pr2serr("Report General result: %s\n",
+                    smp_get_func_res_str(res, sizeof(b), b));
+        return -4 - res;
     }
-    t2t = (len > 10) ? !!(0x80 & rp[10]) : false;
     if (t2t_routingp)
-        *t2t_routingp = t2t;
+        *t2t_routingp = rg.table_to_table_sup;
+    if (exp_ccp)
+        *exp_ccp = (rg.resp_len > 5) ? rg.exp_change_count : -1;
     if (op->verbose > 2)
-        pr2serr("%s: len=%d, number of phys: %u, t2t=%d\n", __func__, len,
-                rp[9], (int)t2t);
-    ret = (len > 9) ? rp[9] : 0;
-fini:
-    if (free_rp)
-        free(free_rp);
-    return ret;
+        pr2serr("%s: len=%d, number of phys: %u, t2t=%d\n", __func__,
+                rg.resp_len, rg.num_phys, (int)rg.table_to_table_sup);
+    return rg.num_phys;
 }
 
 /* Since spl4r01 these are 'attached SAS device type's */
@@ -396,34 +403,50 @@ do_discover(struct smp_target_obj * top, int disc_phy_id,
             uint8_t * resp, int max_resp_len,
             bool silence_err_report, const struct opts_t * op)
 {
+    bool zero;
     int len, res, k, act_resplen;
     char * cp;
-    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_DISCOVER, 0, 0,
-                         0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0};
     char b[256];
-    struct smp_req_resp smp_rr;
+    struct smp_req_tmpl * tp = op->disc_tp;
+    struct smp_caps caps;
 
-    memset(resp, 0, max_resp_len);
-    if (! op->do_zero) {     /* SAS-2 or later */
-        len = (max_resp_len - 8) / 4;
-        smp_req[2] = (len < 0x100) ? len : 0xff; /* Allocated Response Len */
-        smp_req[3] = 2; /* Request Length: in dwords */
+    /* the request is only rebuilt when the response buffer changes */
+    if ((tp->rr.response != resp) || (tp->rr.max_response_len !=
+                                      max_resp_len)) {
+        /* SAS-1.1 expanders known from an earlier run get --zero */
+        zero = op->do_zero || ((0 == smp_caps_get(top, &caps, op->verbose))
+                               && (caps.known & SMP_CAP_ZERO_LENS) &&
+                               caps.zero_lens);
+        if (smp_tmpl_init(tp, SMP_FN_DISCOVER, 0, resp, max_resp_len, zero,
+                          op->verbose))
+            return -1;
+        if (op->ign_zp)
+            tp->req[8] |= 0x1;
     }
-    if (op->ign_zp)
-        smp_req[8] |= 0x1;
-    smp_req[9] = disc_phy_id;
+    smp_tmpl_set_idx(tp, disc_phy_id);
+again:
     if (op->verbose) {
         pr2serr("    Discover request: ");
-        for (k = 0; k < (int)sizeof(smp_req); ++k)
-            pr2serr("%02x ", smp_req[k]);
+        for (k = 0; k < tp->rr.request_len; ++k)
+            pr2serr("%02x ", tp->req[k]);
         pr2serr("\n");
     }
-    memset(&smp_rr, 0, sizeof(smp_rr));
-    smp_rr.request_len = sizeof(smp_req);
-    smp_rr.request = smp_req;
-    smp_rr.max_response_len = max_resp_len;
-    smp_rr.response = resp;
-    res = smp_send_req(top, &smp_rr, op->verbose);
+    res = smp_tmpl_send(top, tp, op->verbose);
+    if ((0 == res) && (0 == tp->rr.transport_err) &&
+        (SMP_FRES_INVALID_REQUEST_LEN == resp[2]) && tp->req[3] &&
+        (! op->do_zero)) {
+        /* a SAS-1.1 expander rejecting the length fields: zero them, as
+         * --zero would, and remember that for this model */
+        if (op->verbose)
+            pr2serr("Invalid request length, trying again with lengths "
+                    "zeroed\n");
+        tp->req[2] = 0;
+        tp->req[3] = 0;
+        memset(&caps, 0, sizeof(caps));
+        caps.zero_lens = true;
+        smp_caps_note(top, SMP_CAP_ZERO_LENS, &caps, op->verbose);
+        goto again;
+    }
 
     if (res) {
         pr2serr("smp_send_req failed, res=%d\n", res);
@@ -431,12 +454,12 @@ do_discover(struct smp_target_obj * top, int disc_phy_id,
             pr2serr("    try adding '-v' option for more debug\n");
         return -1;
     }
-    if (smp_rr.transport_err) {
+    if (tp->rr.transport_err) {
         pr2serr("smp_send_req transport_error=%d\n",
-                smp_rr.transport_err);
+                tp->rr.transport_err);
         return -1;
     }
-    act_resplen = smp_rr.act_response_len;
+    act_resplen = tp->rr.act_response_len;
     if ((act_resplen >= 0) && (act_resplen < 4)) {
         pr2serr("response too short, len=%d\n", act_resplen);
         return -4 - SMP_LIB_CAT_MALFORMED;
@@ -464,7 +487,7 @@ do_discover(struct smp_target_obj * top, int disc_phy_id,
             dStrRaw(resp, len);
         if (SMP_FRAME_TYPE_RESP != resp[0])
             return -4 - SMP_LIB_CAT_MALFORMED;
-        if (resp[1] != smp_req[1])
+        if (resp[1] != tp->req[1])
             return -4 - SMP_LIB_CAT_MALFORMED;
         if (resp[2]) {
             if (op->verbose)
@@ -478,8 +501,8 @@ do_discover(struct smp_target_obj * top, int disc_phy_id,
         pr2serr("expected SMP frame response type, got=0x%x\n", resp[0]);
         return -4 - SMP_LIB_CAT_MALFORMED;
     }
-    if (resp[1] != smp_req[1]) {
-        pr2serr("Expected function code=0x%x, got=0x%x\n", smp_req[1],
+    if (resp[1] != tp->req[1]) {
+        pr2serr("Expected function code=0x%x, got=0x%x\n", tp->req[1],
                 resp[1]);
         return -4 - SMP_LIB_CAT_MALFORMED;
     }
@@ -493,122 +516,243 @@ do_discover(struct smp_target_obj * top, int disc_phy_id,
     return len;
 }
 
+/* Sends a DISCOVER LIST asking for up to nphys long descriptors starting
+ * at sphy_id (all phys, no filter) into dlp->rp. Returns 0 if ok, -1 for
+ * low level errors, else the function result or SMP_LIB_CAT_MALFORMED. */
+static int
+do_discover_list(struct smp_target_obj * top, int sphy_id, int nphys,
+                 struct dlist_t * dlp, const struct opts_t * op)
+{
+    int res, k, len;
+    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_DISCOVER_LIST, 0, 6,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                         0, 0, 0, 0, };
+    uint8_t * rp = dlp->rp;
+    struct smp_req_resp smp_rr;
+
+    dlp->num = 0;
+    memset(rp, 0, SMP_FN_DISCOVER_LIST_RESP_LEN);
+    smp_req[2] = 0xff;
+    smp_req[8] = sphy_id;
+    smp_req[9] = nphys;
+    smp_req[10] = op->ign_zp ? 0x80 : 0;   /* phy filter: all */
+    smp_req[11] = 0;                       /* long format */
+    if (op->verbose) {
+        pr2serr("    Discover list request: ");
+        for (k = 0; k < (int)sizeof(smp_req); ++k) {
+            if (0 == (k % 16))
+                pr2serr("\n      ");
+            else if (0 == (k % 8))
+                pr2serr(" ");
+            pr2serr("%02x ", smp_req[k]);
+        }
+        pr2serr("\n");
+    }
+    memset(&smp_rr, 0, sizeof(smp_rr));
+    smp_rr.request_len = sizeof(smp_req);
+    smp_rr.request = smp_req;
+    smp_rr.max_response_len = SMP_FN_DISCOVER_LIST_RESP_LEN;
+    smp_rr.response = rp;
+    res = smp_send_req(top, &smp_rr, op->verbose);
+    if (res) {
+        pr2serr("smp_send_req failed, res=%d\n", res);
+        if (0 == op->verbose)
+            pr2serr("    try adding '-v' option for more debug\n");
+        return -1;
+    }
+    if (smp_rr.transport_err) {
+        pr2serr("smp_send_req transport_error=%d\n", smp_rr.transport_err);
+        return -1;
+    }
+    if (((smp_rr.act_response_len >= 0) && (smp_rr.act_response_len < 4)) ||
+        (SMP_FRAME_TYPE_RESP != rp[0]) || (rp[1] != smp_req[1]))
+        return SMP_LIB_CAT_MALFORMED;
+    if (rp[2])
+        return rp[2];
+    len = 4 + (4 * rp[3]);
+    if ((smp_rr.act_response_len >= 0) && (len > smp_rr.act_response_len))
+        len = smp_rr.act_response_len;
+    dlp->first = sphy_id;
+    dlp->num = rp[9];
+    dlp->desc_len = rp[12] * 4;
+    if ((0 == dlp->num) || ((rp[11] & 0xf) != 0) || (dlp->desc_len < 12) ||
+        (len < (48 + (dlp->num * dlp->desc_len))))
+        dlp->num = 0;
+    return 0;
+}
+
+/* Fetches the DISCOVER response of phy_id from the DISCOVER LIST held
+ * in dlp, sending a new DISCOVER LIST (for up to end_phy) when phy_id is
+ * not there. Falls back to DISCOVER when the expander does not support
+ * DISCOVER LIST. Returns as do_discover(). */
+static int
+discover_via_list(struct smp_target_obj * top, int phy_id, int end_phy,
+                  uint8_t * resp, struct dlist_t * dlp,
+                  const struct opts_t * op)
+{
+    int res, n, len;
+    const uint8_t * dp;
+
+    if ((phy_id < dlp->first) || (phy_id >= (dlp->first + dlp->num))) {
+        n = end_phy - phy_id;
+        if (n > MAX_DLIST_LONG_DESCS)
+            n = MAX_DLIST_LONG_DESCS;
+        else if (n < 1)
+            n = 1;
+        res = do_discover_list(top, phy_id, n, dlp, op);
+        if (SMP_FRES_UNKNOWN_FUNCTION == res) {
+            if (op->verbose)
+                pr2serr("DISCOVER LIST not supported, using DISCOVER\n");
+            smp_discover_list_cap_set(top, false);
+            dlp->use = false;
+            return do_discover(top, phy_id, resp, SMP_FN_DISCOVER_RESP_LEN,
+                               true, op);
+        } else if (res)
+            return (res < 0) ? -1 : (-4 - res);
+        if (0 == dlp->num)
+            return -4 - SMP_LIB_CAT_MALFORMED;
+    }
+    dp = dlp->rp + 48 + ((phy_id - dlp->first) * dlp->desc_len);
+    if (dp[9] != phy_id)        /* expected one descriptor per phy */
+        return do_discover(top, phy_id, resp, SMP_FN_DISCOVER_RESP_LEN,
+                           true, op);
+    len = dlp->desc_len;
+    if (len > (SMP_FN_DISCOVER_RESP_LEN - 4))
+        len = SMP_FN_DISCOVER_RESP_LEN - 4;
+    memset(resp, 0, SMP_FN_DISCOVER_RESP_LEN);
+    memcpy(resp, dp, len);
+    /* decoders go by the DISCOVER response length, the descriptor's own
+     * byte 3 may be zero or short */
+    resp[3] = (len - 4) / 4;
+    if (resp[2]) {              /* function result for this phy */
+        if (op->verbose > 0) {
+            char b[128];
+
+            pr2serr("Discover result: %s\n",
+                    smp_get_func_res_str(resp[2], sizeof(b), b));
+        }
+        return -4 - resp[2];
+    }
+    return len;
+}
+
 /* Note that the inner attributes are output in alphabetical order. */
 /* N.B. This function has not been kept up to date. */
 static int
-print_single_list(const uint8_t * rp, int len, bool show_exp_cc,
+print_single_list(const struct smp_discover_view * vp, bool show_exp_cc,
                   int do_brief)
 {
     bool sas2;
 
-    sas2 = !! (rp[3]);          /* response length other than zero */
+    sas2 = vp->sas2;
     if (sas2 && show_exp_cc && (! do_brief)) {
-        printf("expander_cc=%u\n", sg_get_unaligned_be16(rp + 4));
+        printf("expander_cc=%u\n", vp->exp_change_count);
     }
-    printf("phy_id=%d\n", rp[9]);
+    printf("phy_id=%d\n", vp->phy_id);
     if (! do_brief) {
         if (sas2) {
-            printf("  att_apta_cap=%d\n", !!(0x4 & rp[34]));
-            printf("  att_br_cap=%d\n", !!(0x1 & rp[33]));
+            printf("  att_apta_cap=%d\n", !!(0x4 & vp->att_caps[1]));
+            printf("  att_br_cap=%d\n", !!(0x1 & vp->att_caps[0]));
         }
-        if (len > 59)
+        if (vp->resp_len > 59)
             printf("  att_dev_name=0x%" PRIx64 "\n",
-                   sg_get_unaligned_be64(rp + 52));
+                   vp->att_dev_name);
     }
-    printf("  att_dev_type=%d\n", (0x70 & rp[12]) >> 4);
+    printf("  att_dev_type=%d\n", vp->att_dev_type);
     if (sas2 && (! do_brief)) {
-        printf("  att_iz_per=%d\n", !!(0x4 & rp[33]));
-        printf("  att_pa_cap=%d\n", !!(0x8 & rp[33]));
-        printf("  att_per_cap=%d\n", !!(0x80 & rp[33]));
+        printf("  att_iz_per=%d\n", !!(0x4 & vp->att_caps[0]));
+        printf("  att_pa_cap=%d\n", !!(0x8 & vp->att_caps[0]));
+        printf("  att_per_cap=%d\n", !!(0x80 & vp->att_caps[0]));
     }
-    printf("  att_phy_id=%d\n", rp[32]);
+    printf("  att_phy_id=%d\n", vp->att_phy_id);
     if (sas2 && (! do_brief)) {
-        printf("  att_pow_cap=%d\n", (rp[33] >> 5) & 0x3);
-        printf("  att_pwr_dis_cap=%d\n", !!(rp[34] & 1));
-        printf("  att_reason=%d\n", (0xf & rp[12]));
-        printf("  att_req_iz=%d\n", !!(0x2 & rp[33]));
-    }
-    printf("  att_sas_addr=0x%" PRIx64 "\n", sg_get_unaligned_be64(rp + 24));
-    printf("  att_sata_dev=%d\n", !! (0x1 & rp[15]));
-    printf("  att_sata_host=%d\n", !! (0x1 & rp[14]));
-    printf("  att_sata_ps=%d\n", !! (0x80 & rp[15]));
+        printf("  att_pow_cap=%d\n", (vp->att_caps[0] >> 5) & 0x3);
+        printf("  att_pwr_dis_cap=%d\n", !!(vp->att_caps[1] & 1));
+        printf("  att_reason=%d\n", vp->att_reason);
+        printf("  att_req_iz=%d\n", !!(0x2 & vp->att_caps[0]));
+    }
+    printf("  att_sas_addr=0x%" PRIx64 "\n", vp->att_sas_addr);
+    printf("  att_sata_dev=%d\n", !! (0x1 & vp->att_targ));
+    printf("  att_sata_host=%d\n", !! (0x1 & vp->att_init));
+    printf("  att_sata_ps=%d\n", !! (0x80 & vp->att_targ));
     if (sas2 && (! do_brief))
-        printf("  att_sl_cap=%d\n", !!(0x10 & rp[33]));
-    printf("  att_smp_init=%d\n", !! (0x2 & rp[14]));
+        printf("  att_sl_cap=%d\n", !!(0x10 & vp->att_caps[0]));
+    printf("  att_smp_init=%d\n", !! (0x2 & vp->att_init));
     if (sas2 && (! do_brief))
-        printf("  att_smp_prior_cap=%d\n", !!(0x2 & rp[34]));
-    printf("  att_smp_targ=%d\n", !! (0x2 & rp[15]));
-    printf("  att_ssp_init=%d\n", !! (0x8 & rp[14]));
-    printf("  att_ssp_targ=%d\n", !! (0x8 & rp[15]));
-    printf("  att_stp_init=%d\n", !! (0x4 & rp[14]));
-    printf("  att_stp_targ=%d\n", !! (0x4 & rp[15]));
+        printf("  att_smp_prior_cap=%d\n", !!(0x2 & vp->att_caps[1]));
+    printf("  att_smp_targ=%d\n", !! (0x2 & vp->att_targ));
+    printf("  att_ssp_init=%d\n", !! (0x8 & vp->att_init));
+    printf("  att_ssp_targ=%d\n", !! (0x8 & vp->att_targ));
+    printf("  att_stp_init=%d\n", !! (0x4 & vp->att_init));
+    printf("  att_stp_targ=%d\n", !! (0x4 & vp->att_targ));
     if (! do_brief) {
-        if (len > 118)
-            printf("  buff_phy_bs=%d\n", rp[118]);
-        if (sas2 || (rp[45] & 0x7f)) {
-            printf("  conn_elem_ind=%d\n", rp[46]);
-            printf("  conn_p_link=%d\n", rp[47]);
-            printf("  conn_type=%d\n", (0x7f & rp[45]));
+        if (vp->resp_len > 118)
+            printf("  buff_phy_bs=%d\n", vp->buff_phy_burst_sz);
+        if (sas2 || vp->conn_type) {
+            printf("  conn_elem_ind=%d\n", vp->conn_elem_ind);
+            printf("  conn_p_link=%d\n", vp->conn_phy_link);
+            printf("  conn_type=%d\n", vp->conn_type);
         }
-        if (len > 109) {
-            printf("  dev_slot_num=%d\n", rp[108]);
-            printf("  dev_slot_grp_num=%d\n", rp[109]);
+        if (vp->resp_len > 109) {
+            printf("  dev_slot_num=%d\n", vp->dev_slot_num);
+            printf("  dev_slot_grp_num=%d\n", vp->dev_slot_grp_num);
         }
     }
     if (! do_brief) {
-        printf("  hw_max_p_lrate=%d\n", (0xf & rp[41]));
-        printf("  hw_min_p_lrate=%d\n", (0xf & rp[40]));
-        if (len > 95)   /* muxing obsolete spl5r01 */
-            printf("  hw_mux_sup=%d\n", (!! (rp[95] & 0x1)));
+        printf("  hw_max_p_lrate=%d\n", vp->hw_max_lrate);
+        printf("  hw_min_p_lrate=%d\n", vp->hw_min_lrate);
+        if (vp->resp_len > 95)   /* muxing obsolete spl5r01 */
+            printf("  hw_mux_sup=%d\n", (!! (vp->phy_flags & 0x1)));
     }
 
     if (! do_brief) {
-        printf("  iz=%d\n", !! (0x2 & rp[60]));
-        printf("  iz_pers=%d\n", !! (0x20 & rp[60]));
+        printf("  iz=%d\n", !! (0x2 & vp->zone_flags));
+        printf("  iz_pers=%d\n", !! (0x20 & vp->zone_flags));
     }
-    printf("  neg_log_lrate=%d\n", (0xf & rp[13]));
+    printf("  neg_log_lrate=%d\n", vp->neg_log_lrate);
     if (! do_brief) {
-        if (len > 95) {
-            printf("  neg_phy_lrate=%d\n", (0xf & rp[94]));
-            printf("  opt_m_en=%d\n", (!! (rp[95] & 0x4)));
+        if (vp->resp_len > 95) {
+            printf("  neg_phy_lrate=%d\n", vp->neg_phy_lrate);
+            printf("  opt_m_en=%d\n", (!! (vp->phy_flags & 0x4)));
         }
-        printf("  phy_cc=%d\n", rp[42]);
-        printf("  phy_power_cond=%d\n", ((0xc0 & rp[48]) >> 6));
-        printf("  pp_timeout=%d\n", (0xf & rp[43]));
-        printf("  pr_max_p_lrate=%d\n", ((0xf0 & rp[41]) >> 4));
-        printf("  pr_min_p_lrate=%d\n", ((0xf0 & rp[40]) >> 4));
+        printf("  phy_cc=%d\n", vp->phy_change_count);
+        printf("  phy_power_cond=%d\n", ((0xc0 & vp->pwr_caps) >> 6));
+        printf("  pp_timeout=%d\n", vp->pp_timeout);
+        printf("  pr_max_p_lrate=%d\n", vp->prog_max_lrate);
+        printf("  pr_min_p_lrate=%d\n", vp->prog_min_lrate);
         if (sas2) {
-            printf("  pwr_dis_ctl_cap=%d\n", (rp[49] & 0x30) >> 4);
-            printf("  pwr_dis_sig=%d\n", (rp[49] & 0xc0) >> 6);
+            printf("  pwr_dis_ctl_cap=%d\n", (vp->pwr_ctl & 0x30) >> 4);
+            printf("  pwr_dis_sig=%d\n", (vp->pwr_ctl & 0xc0) >> 6);
         }
     }
-    if ((! do_brief) && (len > 95))
-            printf("  reason=%d\n", (0xf0 & rp[94]) >> 4);
+    if ((! do_brief) && (vp->resp_len > 95))
+            printf("  reason=%d\n", vp->reason);
     if (! do_brief) {
-        printf("  req_iz=%d\n", !! (0x10 & rp[60]));
-        printf("  req_iz_cbe=%d\n", !! (0x40 & rp[60]));
+        printf("  req_iz=%d\n", !! (0x10 & vp->zone_flags));
+        printf("  req_iz_cbe=%d\n", !! (0x40 & vp->zone_flags));
     }
-    printf("  routing_attr=%d\n", rp[44] & 0xf);
+    printf("  routing_attr=%d\n", vp->routing_attr);
 
-    printf("  sas_addr=0x%" PRIx64 "\n", sg_get_unaligned_be64(rp + 16));
+    printf("  sas_addr=0x%" PRIx64 "\n", vp->sas_addr);
     if (! do_brief) {
-        printf("  sas_pa_cap=%d\n", !!(0x4 & rp[48]));
-        printf("  sas_pa_en=%d\n", !!(0x4 & rp[49]));
-        printf("  sas_pow_cap=%d\n", (rp[48] >> 4) & 0x3);
-        printf("  sas_sl_cap=%d\n", !!(0x8 & rp[48]));
-        printf("  sas_sl_en=%d\n", !!(0x8 & rp[49]));
-        printf("  sata_pa_cap=%d\n", !!(0x1 & rp[48]));
-        printf("  sata_pa_en=%d\n", !!(0x1 & rp[49]));
-        printf("  sata_sl_cap=%d\n", !!(0x2 & rp[48]));
-        printf("  sata_sl_en=%d\n", !!(0x2 & rp[49]));
-        printf("  stp_buff_tsmall=%d\n", !!(0x10 & rp[15]));
-    }
-
-    printf("  virt_phy=%d\n", !!(0x80 & rp[43]));
+        printf("  sas_pa_cap=%d\n", !!(0x4 & vp->pwr_caps));
+        printf("  sas_pa_en=%d\n", !!(0x4 & vp->pwr_ctl));
+        printf("  sas_pow_cap=%d\n", (vp->pwr_caps >> 4) & 0x3);
+        printf("  sas_sl_cap=%d\n", !!(0x8 & vp->pwr_caps));
+        printf("  sas_sl_en=%d\n", !!(0x8 & vp->pwr_ctl));
+        printf("  sata_pa_cap=%d\n", !!(0x1 & vp->pwr_caps));
+        printf("  sata_pa_en=%d\n", !!(0x1 & vp->pwr_ctl));
+        printf("  sata_sl_cap=%d\n", !!(0x2 & vp->pwr_caps));
+        printf("  sata_sl_en=%d\n", !!(0x2 & vp->pwr_ctl));
+        printf("  stp_buff_tsmall=%d\n", !!(0x10 & vp->att_targ));
+    }
+
+    printf("  virt_phy=%d\n", vp->virt_phy);
     if (! do_brief) {
-        printf("  zg=%d\n", rp[63]);
-        printf("  zg_pers=%d\n", !! (0x4 & rp[60]));
-        printf("  zoning_en=%d\n", !! (0x1 & rp[60]));
+        printf("  zg=%d\n", vp->zone_group);
+        printf("  zg_pers=%d\n", !! (0x4 & vp->zone_flags));
+        printf("  zoning_en=%d\n", !! (0x1 & vp->zone_flags));
     }
     return 0;
 }
@@ -674,30 +818,27 @@ decode_phy_cap(unsigned int p_cap, const struct opts_t * op)
 }
 
 static int
-print_single(const uint8_t * rp, int len, bool just1,
+print_single(const struct smp_discover_view * vp, bool just1,
              const struct opts_t * op)
 {
     bool sas2;
     int res;
     unsigned int ui;
-    uint64_t ull = 0;
     char b[256];
 
-    if (len > 23) /* fetch my (expander's) SAS addrss */
-        ull = sg_get_unaligned_be64(rp + 16);
     if (just1)
         printf("Discover response%s:\n", (op->do_brief ? " (brief)" : ""));
     else
-        printf("phy identifier: %d\n", rp[9]);
-    sas2 = !! (rp[3]);          /* response length other than zero */
-    res = sg_get_unaligned_be16(rp + 4);
+        printf("phy identifier: %d\n", vp->phy_id);
+    sas2 = vp->sas2;
+    res = vp->exp_change_count;
     if ((sas2 && (! op->do_brief)) || (op->verbose > 3)) {
         if (op->verbose || (res > 0))
             printf("  expander change count: %d\n", res);
     }
     if (just1)
-        printf("  phy identifier: %d\n", rp[9]);
-    res = ((0x70 & rp[12]) >> 4);
+        printf("  phy identifier: %d\n", vp->phy_id);
+    res = vp->att_dev_type;
     if (res < 8)
         printf("  attached SAS device type: %s\n",
                smp_attached_device_type[res]);
@@ -705,53 +846,63 @@ print_single(const uint8_t * rp, int len, bool just1,
         return 0;
     if (sas2 || (op->verbose > 3))
         printf("  attached reason: %s\n",
-               smp_get_reason(0xf & rp[12], sizeof(b), b));
+               smp_get_reason(vp->att_reason, sizeof(b), b));
 
     printf("  negotiated logical link rate: %s\n",
-           smp_get_neg_xxx_link_rate(0xf & rp[13], sizeof(b), b));
+           smp_get_neg_xxx_link_rate(vp->neg_log_lrate, sizeof(b), b));
 
     printf("  attached initiator: ssp=%d stp=%d smp=%d sata_host=%d\n",
-           !!(rp[14] & 8), !!(rp[14] & 4), !!(rp[14] & 2), (rp[14] & 1));
+           !!(vp->att_init & 8), !!(vp->att_init & 4),
+           !!(vp->att_init & 2), (vp->att_init & 1));
     if (0 == op->do_brief) {
         printf("  attached sata port selector: %d\n",
-               !!(rp[15] & 0x80));
-        printf("  STP buffer too small: %d\n", !!(rp[15] & 0x10));
+               !!(vp->att_targ & 0x80));
+        printf("  STP buffer too small: %d\n", !!(vp->att_targ & 0x10));
     }
     printf("  attached target: ssp=%d stp=%d smp=%d sata_device=%d\n",
-           !!(rp[15] & 8), !!(rp[15] & 4), !!(rp[15] & 2), (rp[15] & 1));
+           !!(vp->att_targ & 8), !!(vp->att_targ & 4),
+           !!(vp->att_targ & 2), (vp->att_targ & 1));
 
-    printf("  SAS address: 0x%" PRIx64 "\n", ull);
+    printf("  SAS address: 0x%" PRIx64 "\n", vp->sas_addr);
     printf("  attached SAS address: 0x%" PRIx64 "\n",
-           sg_get_unaligned_be64(rp + 24));
-    printf("  attached phy identifier: %d\n", rp[32]);
+           vp->att_sas_addr);
+    printf("  attached phy identifier: %d\n", vp->att_phy_id);
     if (0 == op->do_brief) {
         if (sas2 || (op->verbose > 3)) {
-            printf("  attached persistent capable: %d\n", !!(rp[33] & 0x80));
-            printf("  attached power capable: %d\n", ((rp[33] >> 5) & 0x3));
-            printf("  attached slumber capable: %d\n", !!(rp[33] & 0x10));
-            printf("  attached partial capable: %d\n", !!(rp[33] & 0x8));
+            printf("  attached persistent capable: %d\n",
+                   !!(vp->att_caps[0] & 0x80));
+            printf("  attached power capable: %d\n",
+                   ((vp->att_caps[0] >> 5) & 0x3));
+            printf("  attached slumber capable: %d\n",
+                   !!(vp->att_caps[0] & 0x10));
+            printf("  attached partial capable: %d\n",
+                   !!(vp->att_caps[0] & 0x8));
             printf("  attached inside ZPSDS persistent: %d\n",
-                   !!(rp[33] & 4));
-            printf("  attached requested inside ZPSDS: %d\n", !!(rp[33] & 2));
-            printf("  attached break_reply capable: %d\n", !!(rp[33] & 1));
-            printf("  attached apta capable: %d\n", !!(rp[34] & 4));
-            printf("  attached smp priority capable: %d\n", !!(rp[34] & 2));
-            printf("  attached pwr_dis capable: %d\n", !!(rp[34] & 1));
+                   !!(vp->att_caps[0] & 4));
+            printf("  attached requested inside ZPSDS: %d\n",
+                   !!(vp->att_caps[0] & 2));
+            printf("  attached break_reply capable: %d\n",
+                   !!(vp->att_caps[0] & 1));
+            printf("  attached apta capable: %d\n", !!(vp->att_caps[1] & 4));
+            printf("  attached smp priority capable: %d\n",
+                   !!(vp->att_caps[1] & 2));
+            printf("  attached pwr_dis capable: %d\n",
+                   !!(vp->att_caps[1] & 1));
         }
         printf("  programmed minimum physical link rate: %s\n",
-               smp_get_plink_rate(((rp[40] >> 4) & 0xf), true, sizeof(b), b));
+               smp_get_plink_rate(vp->prog_min_lrate, true, sizeof(b), b));
         printf("  hardware minimum physical link rate: %s\n",
-               smp_get_plink_rate((rp[40] & 0xf), false, sizeof(b), b));
+               smp_get_plink_rate(vp->hw_min_lrate, false, sizeof(b), b));
         printf("  programmed maximum physical link rate: %s\n",
-               smp_get_plink_rate(((rp[41] >> 4) & 0xf), true, sizeof(b), b));
+               smp_get_plink_rate(vp->prog_max_lrate, true, sizeof(b), b));
         printf("  hardware maximum physical link rate: %s\n",
-               smp_get_plink_rate((rp[41] & 0xf), false, sizeof(b), b));
-        printf("  phy change count: %d\n", rp[42]);
-        printf("  virtual phy: %d\n", !!(rp[43] & 0x80));
+               smp_get_plink_rate(vp->hw_max_lrate, false, sizeof(b), b));
+        printf("  phy change count: %d\n", vp->phy_change_count);
+        printf("  virtual phy: %d\n", vp->virt_phy);
         printf("  partial pathway timeout value: %d microsecs\n",
-               (rp[43] & 0xf));
+               vp->pp_timeout);
     }
-    res = (0xf & rp[44]);
+    res = vp->routing_attr;
     switch (res) {
     case 0: snprintf(b, sizeof(b), "direct"); break;
     case 1: snprintf(b, sizeof(b), "subtractive"); break;
@@ -760,122 +911,154 @@ print_single(const uint8_t * rp, int len, bool just1,
     }
     printf("  routing attribute: %s\n", b);
     if (op->do_brief) {
-        if ((len > 63) && !!(rp[60] & 0x1))
-            printf("  zone group: %d\n", rp[63]);
+        if ((vp->resp_len > 63) && !!(vp->zone_flags & 0x1))
+            printf("  zone group: %d\n", vp->zone_group);
         return 0;
     }
-    if (sas2 || (rp[45] & 0x7f)) {
+    if (sas2 || vp->conn_type) {
         printf("  connector type: %s\n",
-               smp_get_connector_type_str((rp[45] & 0x7f), true, sizeof(b),
+               smp_get_connector_type_str(vp->conn_type, true, sizeof(b),
                                           b));
-        printf("  connector element index: %d\n", rp[46]);
-        printf("  connector physical link: %d\n", rp[47]);
+        printf("  connector element index: %d\n", vp->conn_elem_ind);
+        printf("  connector physical link: %d\n", vp->conn_phy_link);
         printf("  phy power condition: %s\n",
-               smp_get_phy_pwr_cond_str(((rp[48] & 0xc0) >> 6),
+               smp_get_phy_pwr_cond_str(((vp->pwr_caps & 0xc0) >> 6),
                                         sizeof(b), b));
-        printf("  sas power capable: %d\n", (rp[48] >> 4) & 0x3);
-        printf("  sas slumber capable: %d\n", !!(rp[48] & 0x8));
-        printf("  sas partial capable: %d\n", !!(rp[48] & 0x4));
-        printf("  sata slumber capable: %d\n", !!(rp[48] & 0x2));
-        printf("  sata partial capable: %d\n", !!(rp[48] & 0x1));
+        printf("  sas power capable: %d\n", (vp->pwr_caps >> 4) & 0x3);
+        printf("  sas slumber capable: %d\n", !!(vp->pwr_caps & 0x8));
+        printf("  sas partial capable: %d\n", !!(vp->pwr_caps & 0x4));
+        printf("  sata slumber capable: %d\n", !!(vp->pwr_caps & 0x2));
+        printf("  sata partial capable: %d\n", !!(vp->pwr_caps & 0x1));
         printf("  pwr_dis signal: %s\n",
-               smp_get_pwr_dis_signal_str(((rp[49] & 0xc0) >> 6),
+               smp_get_pwr_dis_signal_str(((vp->pwr_ctl & 0xc0) >> 6),
                                           sizeof(b), b));
-        printf("  pwr_dis control capable: %d\n", (rp[49] & 0x30) >> 4);
-        printf("  sas slumber enabled: %d\n", !!(rp[49] & 0x8));
-        printf("  sas partial enabled: %d\n", !!(rp[49] & 0x4));
-        printf("  sata slumber enabled: %d\n", !!(rp[49] & 0x2));
-        printf("  sata partial enabled: %d\n", !!(rp[49] & 0x1));
+        printf("  pwr_dis control capable: %d\n", (vp->pwr_ctl & 0x30) >> 4);
+        printf("  sas slumber enabled: %d\n", !!(vp->pwr_ctl & 0x8));
+        printf("  sas partial enabled: %d\n", !!(vp->pwr_ctl & 0x4));
+        printf("  sata slumber enabled: %d\n", !!(vp->pwr_ctl & 0x2));
+        printf("  sata partial enabled: %d\n", !!(vp->pwr_ctl & 0x1));
     }
-    if (len > 59) {
+    if (vp->resp_len > 59) {
         printf("  attached device name: 0x%" PRIx64 "\n",
-               sg_get_unaligned_be64(rp + 52));
+               vp->att_dev_name);
         printf("  requested inside ZPSDS changed by expander: %d\n",
-               !!(rp[60] & 0x40));
-        printf("  inside ZPSDS persistent: %d\n", !!(rp[60] & 0x20));
-        printf("  requested inside ZPSDS: %d\n", !!(rp[60] & 0x10));
-        /* printf("  zone address resolved: %d\n", !!(rp[60] & 0x8)); */
-        printf("  zone group persistent: %d\n", !!(rp[60] & 0x4));
-        printf("  inside ZPSDS: %d\n", !!(rp[60] & 0x2));
-        printf("  zoning enabled: %d\n", !!(rp[60] & 0x1));
-        printf("  zone group: %d\n", rp[63]);
-        if (len < 76)
+               !!(vp->zone_flags & 0x40));
+        printf("  inside ZPSDS persistent: %d\n", !!(vp->zone_flags & 0x20));
+        printf("  requested inside ZPSDS: %d\n", !!(vp->zone_flags & 0x10));
+        /* zone address resolved, !!(vp->zone_flags & 0x8), is obsolete */
+        printf("  zone group persistent: %d\n", !!(vp->zone_flags & 0x4));
+        printf("  inside ZPSDS: %d\n", !!(vp->zone_flags & 0x2));
+        printf("  zoning enabled: %d\n", !!(vp->zone_flags & 0x1));
+        printf("  zone group: %d\n", vp->zone_group);
+        if (vp->resp_len < 76)
             return 0;
-        printf("  self-configuration status: %d\n", rp[64]);
-        printf("  self-configuration levels completed: %d\n", rp[65]);
+        printf("  self-configuration status: %d\n", vp->self_config_status);
+        printf("  self-configuration levels completed: %d\n",
+               vp->self_config_levels);
         printf("  self-configuration sas address: 0x%" PRIx64 "\n",
-               sg_get_unaligned_be64(rp + 68));
-        ui = sg_get_unaligned_be32(rp + 76);
+               vp->self_config_sas_addr);
+        ui = vp->prog_phy_cap;
         printf("  programmed phy capabilities: 0x%x\n", ui);
         if (op->do_cap_phy)
             decode_phy_cap(ui, op);
-        ui = sg_get_unaligned_be32(rp + 80);
+        ui = vp->cur_phy_cap;
         printf("  current phy capabilities: 0x%x\n", ui);
         if (op->do_cap_phy)
             decode_phy_cap(ui, op);
-        ui = sg_get_unaligned_be32(rp + 84);
+        ui = vp->att_phy_cap;
         printf("  attached phy capabilities: 0x%x\n", ui);
         if (op->do_cap_phy)
             decode_phy_cap(ui, op);
     }
-    if (len > 95) {
+    if (vp->resp_len > 95) {
         printf("  reason: %s\n",
-               smp_get_reason((0xf0 & rp[94]) >> 4, sizeof(b), b));
+               smp_get_reason(vp->reason, sizeof(b), b));
         printf("  negotiated physical link rate: %s\n",
-               smp_get_neg_xxx_link_rate(0xf & rp[94], sizeof(b), b));
-        printf("  optical mode enabled: %d\n", !!(rp[95] & 0x4));
-        printf("  negotiated SSC: %d\n", !!(rp[95] & 0x2));
+               smp_get_neg_xxx_link_rate(vp->neg_phy_lrate, sizeof(b), b));
+        printf("  optical mode enabled: %d\n", !!(vp->phy_flags & 0x4));
+        printf("  negotiated SSC: %d\n", !!(vp->phy_flags & 0x2));
         /* hardware muxing obsolete spl5r01 */
-        printf("  hardware muxing supported: %d\n", !!(rp[95] & 0x1));
-    }
-    if (len > 107) {
-        printf("  default inside ZPSDS persistent: %d\n", !!(rp[96] & 0x20));
-        printf("  default requested inside ZPSDS: %d\n", !!(rp[96] & 0x10));
-        printf("  default zone group persistent: %d\n", !!(rp[96] & 0x4));
-        printf("  default zoning enabled: %d\n", !!(rp[96] & 0x1));
-        printf("  default zone group: %d\n", rp[99]);
-        printf("  saved inside ZPSDS persistent: %d\n", !!(rp[100] & 0x20));
-        printf("  saved requested inside ZPSDS: %d\n", !!(rp[100] & 0x10));
-        printf("  saved zone group persistent: %d\n", !!(rp[100] & 0x4));
-        printf("  saved zoning enabled: %d\n", !!(rp[100] & 0x1));
-        printf("  saved zone group: %d\n", rp[103]);
-        printf("  shadow inside ZPSDS persistent: %d\n", !!(rp[104] & 0x20));
-        printf("  shadow requested inside ZPSDS: %d\n", !!(rp[104] & 0x10));
-        printf("  shadow zone group persistent: %d\n", !!(rp[104] & 0x4));
+        printf("  hardware muxing supported: %d\n", !!(vp->phy_flags & 0x1));
+    }
+    if (vp->resp_len > 107) {
+        printf("  default inside ZPSDS persistent: %d\n",
+               !!(vp->def_zone_flags & 0x20));
+        printf("  default requested inside ZPSDS: %d\n",
+               !!(vp->def_zone_flags & 0x10));
+        printf("  default zone group persistent: %d\n",
+               !!(vp->def_zone_flags & 0x4));
+        printf("  default zoning enabled: %d\n", !!(vp->def_zone_flags & 0x1));
+        printf("  default zone group: %d\n", vp->def_zone_group);
+        printf("  saved inside ZPSDS persistent: %d\n",
+               !!(vp->saved_zone_flags & 0x20));
+        printf("  saved requested inside ZPSDS: %d\n",
+               !!(vp->saved_zone_flags & 0x10));
+        printf("  saved zone group persistent: %d\n",
+               !!(vp->saved_zone_flags & 0x4));
+        printf("  saved zoning enabled: %d\n", !!(vp->saved_zone_flags & 0x1));
+        printf("  saved zone group: %d\n", vp->saved_zone_group);
+        printf("  shadow inside ZPSDS persistent: %d\n",
+               !!(vp->shadow_zone_flags & 0x20));
+        printf("  shadow requested inside ZPSDS: %d\n",
+               !!(vp->shadow_zone_flags & 0x10));
+        printf("  shadow zone group persistent: %d\n",
+               !!(vp->shadow_zone_flags & 0x4));
         /* 'shadow zoning enabled' added in spl2r03 */
-        printf("  shadow zoning enabled: %d\n", !!(rp[104] & 0x1));
-        printf("  shadow zone group: %d\n", rp[107]);
+        printf("  shadow zoning enabled: %d\n",
+               !!(vp->shadow_zone_flags & 0x1));
+        printf("  shadow zone group: %d\n", vp->shadow_zone_group);
     }
-    if (len > 109) {
-        printf("  device slot number: %d\n", rp[108]);
-        ui = rp[109];
+    if (vp->resp_len > 109) {
+        printf("  device slot number: %d\n", vp->dev_slot_num);
+        ui = vp->dev_slot_grp_num;
         printf("  device slot group number: ");
         if (255 == ui)
             printf("not available\n");
         else
             printf("%d\n", ui);
     }
-    if (len > 115)
-        printf("  device slot group output connector: %.6s\n", rp + 110);
-    if (len > 117)
-        printf("  STP buffer size: %u\n", sg_get_unaligned_be16(rp + 116));
-    if (len > 118)
-        printf("  Buffered phy burst size (KiB): %u\n", rp[118]);
+    if (vp->resp_len > 115)
+        printf("  device slot group output connector: %.6s\n",
+               vp->dev_slot_grp_oc);
+    if (vp->resp_len > 117)
+        printf("  STP buffer size: %u\n", vp->stp_buff_size);
+    if (vp->resp_len > 118)
+        printf("  Buffered phy burst size (KiB): %u\n", vp->buff_phy_burst_sz);
     return 0;
 }
 
 
 /* Output (multiline) for a single phy. Return 0 on success, positive error
  * number suitable for exit status if problems. */
+/* Emits one --json or --csv record for phy_id. A vacant phy (fres of
+ * SMP_FRES_PHY_VACANT) has all fields zero apart from its identifier and
+ * function result. */
+static void
+emit_phy(struct smp_emit * emp, const uint8_t * rp, int len, int phy_id,
+         int fres)
+{
+    struct smp_discover_view dv;
+
+    if (fres || smp_decode_discover(rp, len, 0, &dv)) {
+        memset(&dv, 0, sizeof(dv));
+        dv.phy_id = phy_id;
+        dv.func_res = fres;
+        dv.dev_slot_num = 0xff;
+    }
+    smp_emit_rec_begin(emp);
+    smp_emit_discover(emp, &dv);
+    smp_emit_rec_end(emp);
+}
+
 static int
 do_single(struct smp_target_obj * top, const struct opts_t * op)
 {
     int len, ret;
     uint64_t ull;
     uint8_t * rp = NULL;
-    uint8_t * free_rp = NULL;
+    struct smp_discover_view dv;
 
-    rp = smp_memalign(SMP_FN_DISCOVER_RESP_LEN, 0, &free_rp, false);
+    rp = smp_buf_get(top, SMP_FN_DISCOVER_RESP_LEN);
     if (NULL == rp) {
         pr2serr("%s: heap allocation problem\n", __func__);
         return SMP_LIB_RESOURCE_ERROR;
@@ -899,23 +1082,234 @@ do_single(struct smp_target_obj * top, const struct opts_t * op)
             ret = 0;
         goto fini;
     }
+    if (op->emp && ((0 == ret) || (SMP_FRES_PHY_VACANT == ret))) {
+        emit_phy(op->emp, rp, len, op->phy_id, ret);
+        goto fini;
+    }
     if (ret) {
         if (SMP_FRES_PHY_VACANT == ret)
             printf("  phy identifier: %d  inaccessible (phy vacant)\n",
                    op->phy_id);
         goto fini;
     }
+    smp_decode_discover(rp, len, 0, &dv);
     if (op->do_list)
-        ret = print_single_list(rp, len, true, op->do_brief);
+        ret = print_single_list(&dv, true, op->do_brief);
     else
-        ret = print_single(rp, len, true, op);
+        ret = print_single(&dv, true, op);
 fini:
-    if (free_rp)
-        free(free_rp);
+    smp_buf_reset(top);
     return ret;
 }
 
-#define MAX_PHY_ID 254
+/* Reads the SNAPSHOT file written by an earlier invocation into 'snp'. A
+ * missing file is not an error, snp->loaded is left false. Returns 0 if
+ * ok, else SMP_LIB_FILE_ERROR. */
+static int
+read_snapshot(struct snap_t * snp, const struct opts_t * op)
+{
+    int k, n, phy, len, off;
+    unsigned int u;
+    uint64_t ull;
+    FILE * fp;
+    char line[512];
+    char dev[SMP_MAX_DEVICE_NAME];
+    uint8_t * rp;
+
+    memset(snp, 0, sizeof(*snp));
+    if (NULL == (fp = fopen(op->since_fn, "r"))) {
+        if (ENOENT == errno) {
+            if (op->verbose)
+                pr2serr("--since: %s not found, will create\n",
+                        op->since_fn);
+            return 0;
+        }
+        pr2serr("--since: unable to open %s: %s\n", op->since_fn,
+                safe_strerror(errno));
+        return SMP_LIB_FILE_ERROR;
+    }
+    if ((NULL == fgets(line, sizeof(line), fp)) ||
+        strncmp(line, SNAP_MAGIC, sizeof(SNAP_MAGIC) - 1))
+        goto bad;
+    if ((NULL == fgets(line, sizeof(line), fp)) ||
+        (1 != sscanf(line, "device=%255s", dev)))
+        goto bad;
+    if ((NULL == fgets(line, sizeof(line), fp)) ||
+        (1 != sscanf(line, "sas_addr=0x%" SCNx64, &ull)))
+        goto bad;
+    snp->sa = ull;
+    if ((NULL == fgets(line, sizeof(line), fp)) ||
+        (2 != sscanf(line, "exp_cc=%d num_phys=%d", &snp->exp_cc,
+                     &snp->num_phys)) ||
+        (snp->num_phys < 0) || (snp->num_phys > (MAX_PHY_ID + 1)))
+        goto bad;
+    while (fgets(line, sizeof(line), fp)) {
+        if (2 != sscanf(line, "phy=%d len=%d%n", &phy, &len, &off))
+            goto bad;
+        if ((phy < 0) || (phy > MAX_PHY_ID) ||
+            (len > SMP_FN_DISCOVER_RESP_LEN))
+            goto bad;
+        snp->resp_len[phy] = len;
+        rp = snp->resp[phy];
+        for (k = 0; k < len; ++k, off += n) {
+            if (1 != sscanf(line + off, " %2x%n", &u, &n))
+                goto bad;
+            rp[k] = (uint8_t)u;
+        }
+    }
+    fclose(fp);
+    /* a snapshot of some other SMP target is of no use */
+    if (strcmp(dev, op->dev_name) ||
+        (op->sa && (op->sa != snp->sa))) {
+        if (op->verbose)
+            pr2serr("--since: %s is for %s, ignored\n", op->since_fn, dev);
+        memset(snp, 0, sizeof(*snp));
+        return 0;
+    }
+    snp->loaded = true;
+    return 0;
+bad:
+    fclose(fp);
+    pr2serr("--since: %s is not a valid snapshot, ignored\n", op->since_fn);
+    memset(snp, 0, sizeof(*snp));
+    return 0;
+}
+
+/* Writes 'snp' to a temporary file then renames it over SNAPSHOT so
+ * a reader never sees a partial snapshot. Returns 0 if ok. */
+static int
+write_snapshot(const struct snap_t * snp, const struct opts_t * op)
+{
+    int k, j;
+    FILE * fp;
+    char b[1024];
+
+    snprintf(b, sizeof(b), "%s.tmp", op->since_fn);
+    if (NULL == (fp = fopen(b, "w"))) {
+        pr2serr("--since: unable to create %s: %s\n", b,
+                safe_strerror(errno));
+        return SMP_LIB_FILE_ERROR;
+    }
+    fprintf(fp, "%s\ndevice=%s\nsas_addr=0x%" PRIx64 "\n", SNAP_MAGIC,
+            op->dev_name, snp->sa);
+    fprintf(fp, "exp_cc=%d num_phys=%d\n", snp->exp_cc, snp->num_phys);
+    for (k = 0; k <= MAX_PHY_ID; ++k) {
+        if (0 == snp->resp_len[k])
+            continue;
+        fprintf(fp, "phy=%d len=%d", k, snp->resp_len[k]);
+        for (j = 0; j < snp->resp_len[k]; ++j)
+            fprintf(fp, " %02x", snp->resp[k][j]);
+        fprintf(fp, "\n");
+    }
+    if (fclose(fp) || rename(b, op->since_fn)) {
+        pr2serr("--since: unable to write %s: %s\n", op->since_fn,
+                safe_strerror(errno));
+        unlink(b);
+        return SMP_LIB_FILE_ERROR;
+    }
+    return 0;
+}
+
+/* Fetches the phy change count of each phy with DISCOVER LIST (short
+ * format descriptors) and marks those phys that differ from the snapshot
+ * as stale. One DISCOVER LIST response typically covers all the phys of an
+ * expander. Returns 0 if ok, else -1 and caller should treat all phys as
+ * stale (e.g. a SAS-1.1 expander without DISCOVER LIST). */
+static int
+mark_stale_phys(struct smp_target_obj * top, struct snap_t * snp, int num,
+                const struct opts_t * op)
+{
+    int k, j, res, len, sphy, ndesc, desc_len, phy;
+    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_DISCOVER_LIST, 0, 6,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                         0, 0, 0, 0, };
+    const uint8_t * dp;
+    uint8_t * rp;
+    struct smp_req_resp smp_rr;
+    int ret = -1;
+
+    /* released with do_multiple()'s buffers */
+    rp = smp_buf_get(top, SMP_FN_DISCOVER_LIST_RESP_LEN);
+    if (NULL == rp)
+        return -1;
+    for (k = 0; k < num; ++k)
+        snp->stale[k] = true;
+    for (sphy = 0; sphy < num; sphy += ndesc) {
+        memset(rp, 0, SMP_FN_DISCOVER_LIST_RESP_LEN);
+        smp_req[2] = 0xff;
+        smp_req[8] = sphy;
+        smp_req[9] = MAX_DLIST_SHORT_DESCS;
+        smp_req[10] = op->ign_zp ? 0x80 : 0;   /* phy filter: all */
+        smp_req[11] = 1;                       /* short format */
+        memset(&smp_rr, 0, sizeof(smp_rr));
+        smp_rr.request_len = sizeof(smp_req);
+        smp_rr.request = smp_req;
+        smp_rr.max_response_len = SMP_FN_DISCOVER_LIST_RESP_LEN;
+        smp_rr.response = rp;
+        res = smp_send_req(top, &smp_rr, op->verbose);
+        if (res || smp_rr.transport_err ||
+            ((smp_rr.act_response_len >= 0) &&
+             (smp_rr.act_response_len < 48)) ||
+            (SMP_FRAME_TYPE_RESP != rp[0]) || (rp[1] != smp_req[1]) ||
+            rp[2]) {
+            if (op->verbose)
+                pr2serr("--since: DISCOVER LIST failed, rediscover all "
+                        "phys\n");
+            goto fini;
+        }
+        len = 4 + (4 * rp[3]);
+        if ((smp_rr.act_response_len >= 0) &&
+            (len > smp_rr.act_response_len))
+            len = smp_rr.act_response_len;
+        ndesc = rp[9];
+        desc_len = rp[12] * 4;
+        if ((0 == ndesc) || (desc_len < 12) ||
+            (len < (48 + (ndesc * desc_len))))
+            goto fini;
+        for (j = 0, dp = rp + 48; j < ndesc; ++j, dp += desc_len) {
+            phy = dp[0];
+            if ((phy >= num) || dp[1] || (snp->resp_len[phy] <= 0))
+                continue;       /* function result in byte 1 */
+            /* phy change count moves on any change on that link */
+            snp->stale[phy] = (snp->resp[phy][42] != dp[11]);
+        }
+    }
+    ret = 0;
+fini:
+    return ret;
+}
+
+/* Prepares the snapshot for do_multiple() by working out which phys need
+ * a fresh DISCOVER. When the expander change count is unchanged no phys
+ * do. */
+static void
+prep_since(struct smp_target_obj * top, struct snap_t * snp, int num,
+           int exp_cc, const struct opts_t * op)
+{
+    int k, n;
+
+    if ((! snp->loaded) || (exp_cc < 0) || (num != snp->num_phys)) {
+        for (k = 0; k <= MAX_PHY_ID; ++k)
+            snp->stale[k] = true;
+        if (op->verbose && snp->loaded)
+            pr2serr("--since: number of phys changed, rediscover all\n");
+    } else if (exp_cc == snp->exp_cc) {
+        if (op->verbose)
+            pr2serr("--since: expander change count unchanged (%d), no "
+                    "DISCOVER needed\n", exp_cc);
+    } else if (mark_stale_phys(top, snp, num, op)) {
+        for (k = 0; k <= MAX_PHY_ID; ++k)
+            snp->stale[k] = true;
+    } else if (op->verbose) {
+        for (k = 0, n = 0; k < num; ++k)
+            n += snp->stale[k];
+        pr2serr("--since: expander change count %d -> %d, %d phy%s changed"
+                "\n", snp->exp_cc, exp_cc, n, ((1 == n) ? "" : "s"));
+    }
+    snp->exp_cc = exp_cc;
+    snp->num_phys = num;
+}
 
 /* Calls do_discover() multiple times. Summarizes info into one
  * line per phy. Returns 0 if ok, else function result. */
@@ -924,23 +1318,38 @@ do_multiple(struct smp_target_obj * top, const struct opts_t * op)
 {
     bool first = true;
     bool has_t2t = false;
-    bool plus;
-    int len, k, num, off, negot, adt, zg;
+    bool plus, cached, from_sysfs, rg_needed;
+    int len, k, num, off, negot, adt, zg, exp_cc;
+    int num_sysfs = 0;
     int ret = 0;
     uint64_t ull, adn, expander_sa;
+    struct snap_t * snp = op->snp;
     const char * cp;
     char b[256];
     char dsn[10] = "";
     uint8_t * rp = NULL;
-    uint8_t * free_rp = NULL;
+    struct smp_discover_view dv;
+    struct smp_discover_view * vp = &dv;
+    struct dlist_t dl;
 
-    rp = smp_memalign(SMP_FN_DISCOVER_RESP_LEN, 0, &free_rp, false);
+    rp = smp_buf_get(top, SMP_FN_DISCOVER_RESP_LEN);
     if (NULL == rp) {
         pr2serr("%s: heap allocation problem\n", __func__);
         return SMP_LIB_RESOURCE_ERROR;
     }
     expander_sa = 0;
-    num = get_num_phys(top, op, &has_t2t);
+    exp_cc = -1;
+    /* sysfs has what one line per phy output needs, less the routing
+     * attribute and zoning; --since, --adn and --dsn need DISCOVER */
+    cached = op->do_cached && (! (op->do_hex || op->do_raw || op->emp ||
+                                  op->do_list || op->do_adn || op->do_dsn ||
+                                  snp || (op->multiple > 1)));
+    if (op->do_cached && (! cached) && op->verbose)
+        pr2serr("--cached ignored with these options\n");
+    num = cached ? smp_sysfs_num_phys(top, op->verbose) : -1;
+    rg_needed = (num > 0);      /* defer REPORT GENERAL till a DISCOVER */
+    if (num <= 0)
+        num = get_num_phys(top, op, &has_t2t, &exp_cc);
     if (num <= 0)
         num = op->do_num ? (op->phy_id + op->do_num) : MAX_PHY_ID;
     else {
@@ -954,8 +1363,50 @@ do_multiple(struct smp_target_obj * top, const struct opts_t * op)
         if (op->do_num)
             num = (num > op->do_num) ? op->do_num : num;
     }
+    if (snp)
+        prep_since(top, snp, num, exp_cc, op);
+    /* DISCOVER LIST fetches up to 8 phys per round-trip. Hex and raw output
+     * are of DISCOVER responses, --zero is for SAS-1.1 expanders and
+     * --since sends DISCOVER only to phys that changed. */
+    memset(&dl, 0, sizeof(dl));
+    if (! (op->do_hex || op->do_raw || op->do_zero || snp) &&
+        (1 == smp_discover_list_supported(top, op->verbose))) {
+        dl.rp = smp_buf_get(top, SMP_FN_DISCOVER_LIST_RESP_LEN);
+        dl.use = (NULL != dl.rp);
+    }
     for (k = op->phy_id; k < num; ++k) {
-        len = do_discover(top, k, rp, SMP_FN_DISCOVER_RESP_LEN, true, op);
+        from_sysfs = cached && (SMP_DVF_ALL ==
+                       (smp_sysfs_discover(top, k, vp, op->verbose) &
+                        SMP_DVF_ALL));
+        if ((! from_sysfs) && rg_needed) {
+            rg_needed = false;
+            get_num_phys(top, op, &has_t2t, &exp_cc);
+        }
+        if (from_sysfs) {
+            len = 0;
+            ++num_sysfs;
+        } else if (dl.use)
+            len = discover_via_list(top, k, num, rp, &dl, op);
+        else if (snp && (! snp->stale[k]) && snp->resp_len[k]) {
+            len = snp->resp_len[k];     /* unchanged since snapshot */
+            if (len > 0) {
+                memcpy(rp, snp->resp[k], len);
+                if (op->do_hex)
+                    hex2stdout(rp, len, 1);
+                else if (op->do_raw)
+                    dStrRaw(rp, len);
+            }
+        } else {
+            len = do_discover(top, k, rp, SMP_FN_DISCOVER_RESP_LEN, true,
+                              op);
+            if (snp && (k <= MAX_PHY_ID)) {
+                if (len > 0)
+                    memcpy(snp->resp[k], rp, len);
+                snp->resp_len[k] = ((len > 0) ||
+                                    ((-4 - SMP_FRES_PHY_VACANT) == len)) ?
+                                   len : 0;
+            }
+        }
         if (len < 0)
             ret = (len < -2) ? (-4 - len) : len;
         else
@@ -964,30 +1415,43 @@ do_multiple(struct smp_target_obj * top, const struct opts_t * op)
             ret = 0;   /* expected, end condition */
             goto fini;
         } else if (SMP_FRES_PHY_VACANT == ret) {
-            printf("  phy %3d: inaccessible (phy vacant)\n", k);
+            if (op->emp)
+                emit_phy(op->emp, rp, len, k, ret);
+            else
+                printf("  phy %3d: inaccessible (phy vacant)\n", k);
             continue;
         } else if (ret)
             goto fini;
-        ull = sg_get_unaligned_be64(rp + 16);
-        if (0 == expander_sa)
+        if (! from_sysfs)
+            smp_decode_discover(rp, len, 0, vp);
+        ull = vp->sas_addr;
+        if (0 == expander_sa) {
             expander_sa = ull;
+            if (snp)
+                snp->sa = ull;
+        }
         else {
             if (ull != expander_sa) {
                 if (ull > 0) {
                     pr2serr(">> expander's SAS address is changing?? "
                             "phy_id=%d, was=0x%" PRIx64 ", now=0x%" PRIx64
-                    "\n", rp[9], expander_sa, ull);
+                    "\n", vp->phy_id, expander_sa, ull);
                     expander_sa = ull;
                 } else if (op->verbose)
                     pr2serr(">> expander's SAS address shown as 0 at "
-                            "phy_id=%d\n", rp[9]);
+                            "phy_id=%d\n", vp->phy_id);
             }
         }
         if (first && (! op->do_raw)) {
             first = false;
-            if (op->sa_given && (op->sa != expander_sa))
-                printf("  <<< Warning: reported expander address is not the "
-                       "one requested >>>\n");
+            if (op->sa_given && (op->sa != expander_sa)) {
+                if (op->emp)    /* keep stdout machine readable */
+                    pr2serr("  <<< Warning: reported expander address is "
+                            "not the one requested >>>\n");
+                else
+                    printf("  <<< Warning: reported expander address is "
+                           "not the one requested >>>\n");
+            }
 #if 0
             /* for compatibility with smp_discover_list which does not
              * know its own SAS address with short descriptors */
@@ -996,23 +1460,27 @@ do_multiple(struct smp_target_obj * top, const struct opts_t * op)
         }
         if (op->do_hex || op->do_raw)
             continue;
+        if (op->emp) {
+            emit_phy(op->emp, rp, len, k, 0);
+            continue;
+        }
 
         if (op->do_list) {
-            print_single_list(rp, len, false, op->do_brief);
+            print_single_list(vp, false, op->do_brief);
             continue;
         }
         if (op->multiple > 1) {
-            print_single(rp, len, false, op);
+            print_single(vp, false, op);
             continue;
         }
-        adt = ((0x70 & rp[12]) >> 4);
+        adt = vp->att_dev_type;
         /* attached SAS device type: 0-> none, 1-> (SAS or SATA end) device,
          * 2-> expander, 3-> fanout expander (obsolete), rest-> reserved */
         if ((op->do_brief > 1) && (0 == adt))
             continue;
 
-        negot = rp[13] & 0xf;
-        switch(rp[44] & 0xf) {
+        negot = vp->neg_log_lrate;
+        switch(vp->routing_attr) {
         case 0:
             cp = "D";
             break;
@@ -1027,28 +1495,30 @@ do_multiple(struct smp_target_obj * top, const struct opts_t * op)
             cp = "R";
             break;
         }
+        if (from_sysfs)
+            cp = "-";           /* routing attribute not in sysfs */
 
-        if (op->do_dsn && (len > 108) && (0xff != rp[108]))
-            sprintf(dsn, "  dsn=%d", rp[108]);
+        if (op->do_dsn && (0xff != vp->dev_slot_num))
+            sprintf(dsn, "  dsn=%d", vp->dev_slot_num);
 
         switch (negot) {
         case 1:
-            printf("  phy %3d:%s:disabled%s\n", rp[9], cp, dsn);
+            printf("  phy %3d:%s:disabled%s\n", vp->phy_id, cp, dsn);
             continue;   /* N.B. not break; finished with this line/phy */
         case 2:
-            printf("  phy %3d:%s:reset problem%s\n", rp[9], cp, dsn);
+            printf("  phy %3d:%s:reset problem%s\n", vp->phy_id, cp, dsn);
             continue;
         case 3:
-            printf("  phy %3d:%s:spinup hold%s\n", rp[9], cp, dsn);
+            printf("  phy %3d:%s:spinup hold%s\n", vp->phy_id, cp, dsn);
             continue;
         case 4:
-            printf("  phy %3d:%s:port selector%s\n", rp[9], cp, dsn);
+            printf("  phy %3d:%s:port selector%s\n", vp->phy_id, cp, dsn);
             continue;
         case 5:
-            printf("  phy %3d:%s:reset in progress%s\n", rp[9], cp, dsn);
+            printf("  phy %3d:%s:reset in progress%s\n", vp->phy_id, cp, dsn);
             continue;
         case 6:
-            printf("  phy %3d:%s:unsupported phy attached%s\n", rp[9], cp,
+            printf("  phy %3d:%s:unsupported phy attached%s\n", vp->phy_id, cp,
                    dsn);
             continue;
         default:
@@ -1057,84 +1527,84 @@ do_multiple(struct smp_target_obj * top, const struct opts_t * op)
         }
         if ((op->do_brief > 0) && (0 == adt))
             continue;
-        if (k != rp[9])
+        if (k != vp->phy_id)
             pr2serr(">> requested phy_id=%d differs from response phy=%d\n",
-                    k, rp[9]);
-        ull = sg_get_unaligned_be64(rp + 24);
+                    k, vp->phy_id);
+        ull = vp->att_sas_addr;
         if ((0 == adt) || (adt > 3)) {
             printf("  phy %3d:%s:attached:[0000000000000000:00]", k, cp);
-            if ((op->do_brief > 1) || op->do_adn || (len < 64)) {
+            if ((op->do_brief > 1) || op->do_adn || (vp->resp_len < 64)) {
                 printf("\n");
                 continue;
             }
-            zg = rp[63];
+            zg = vp->zone_group;
             /* zoning_enabled and a zone_group other than 1 */
-            if ((rp[60] & 0x1) && (1 != zg))
+            if ((vp->zone_flags & 0x1) && (1 != zg))
                 printf("  ZG:%d", zg);
             if ('\0' != dsn[0])
                 printf("%s", dsn);
             printf("\n");
             continue;
         }
-        if (op->do_adn && (len > 59)) {
-            adn = sg_get_unaligned_be64(rp + 52);
+        if (op->do_adn && (vp->resp_len > 59)) {
+            adn = vp->att_dev_name;
             printf("  phy %3d:%s:attached:[%016" PRIx64 ":%02d %016" PRIx64
-                   " %s%s", k, cp, ull, rp[32], adn,
+                   " %s%s", k, cp, ull, vp->att_phy_id, adn,
                    smp_short_attached_device_type[adt],
-                   ((rp[43] & 0x80) ? " V" : ""));
+                   (vp->virt_phy ? " V" : ""));
         } else
             printf("  phy %3d:%s:attached:[%016" PRIx64 ":%02d %s%s", k, cp,
-                   ull, rp[32], smp_short_attached_device_type[adt],
-                   ((rp[43] & 0x80) ? " V" : ""));
-        if (rp[14] & 0xf) {
+                   ull, vp->att_phy_id, smp_short_attached_device_type[adt],
+                   (vp->virt_phy ? " V" : ""));
+        if (vp->att_init & 0xf) {
             off = 0;
             plus = false;
             off += snprintf(b + off, sizeof(b) - off, " i(");
-            if (rp[14] & 0x8) {
+            if (vp->att_init & 0x8) {
                 off += snprintf(b + off, sizeof(b) - off, "SSP");
                 plus = true;
             }
-            if (rp[14] & 0x4) {
+            if (vp->att_init & 0x4) {
                 off += snprintf(b + off, sizeof(b) - off, "%sSTP",
                                 (plus ? "+" : ""));
                 plus = true;
             }
-            if (rp[14] & 0x2) {
+            if (vp->att_init & 0x2) {
                 off += snprintf(b + off, sizeof(b) - off, "%sSMP",
                                 (plus ? "+" : ""));
                 plus = true;
             }
-            if (rp[14] & 0x1) {
+            if (vp->att_init & 0x1) {
                 off += snprintf(b + off, sizeof(b) - off, "%sSATA",
                                 (plus ? "+" : ""));
                 plus = true;
             }
             printf("%s)", b);
         }
-        if (rp[15] & 0xf) {
+        if (vp->att_targ & 0xf) {
             off = 0;
             plus = false;
             off += snprintf(b + off, sizeof(b) - off, " t(");
-            if (rp[15] & 0x80) {
+            if (vp->att_targ & 0x80) {
                 off += snprintf(b + off, sizeof(b) - off, "PORT_SEL");
                 plus = true;
             }
-            if (rp[15] & 0x8) {
+            if (vp->att_targ & 0x8) {
                 off += snprintf(b + off, sizeof(b) - off, "%sSSP",
                                 (plus ? "+" : ""));
                 plus = true;
             }
-            if (rp[15] & 0x4) {
+            if (vp->att_targ & 0x4) {
                 off += snprintf(b + off, sizeof(b) - off, "%sSTP",
                                 (plus ? "+" : ""));
                 plus = true;
             }
-            if (rp[15] & 0x2) {
+            if (vp->att_targ & 0x2) {
                 off += snprintf(b + off, sizeof(b) - off, "%sSMP",
                                 (plus ? "+" : ""));
                 plus = true;
             }
-            if (rp[15] & 0x1) {
+            if (vp->att_targ & 0x1) {
                 off += snprintf(b + off, sizeof(b) - off, "%sSATA",
                                 (plus ? "+" : ""));
                 plus = true;
@@ -1170,9 +1640,9 @@ do_multiple(struct smp_target_obj * top, const struct opts_t * op)
             break;
         }
         printf("%s", cp);
-        if (len > 63) {
-            zg = rp[63];
-            if ((rp[60] & 0x1) && (1 != zg))
+        if (vp->resp_len > 63) {
+            zg = vp->zone_group;
+            if ((vp->zone_flags & 0x1) && (1 != zg))
                 printf("  ZG:%d", zg);
         }
         if ('\0' != dsn[0])
@@ -1180,14 +1650,23 @@ do_multiple(struct smp_target_obj * top, const struct opts_t * op)
         printf("\n");
     }
 fini:
-    if (free_rp)
-        free(free_rp);
+    if (cached && op->verbose)
+        pr2serr("--cached: %d phy%s from sysfs\n", num_sysfs,
+                ((1 == num_sysfs) ? "" : "s"));
+    if (snp && (0 == ret))
+        ret = write_snapshot(snp, op);
+    smp_buf_reset(top);
     return ret;
 }
 
 
+#ifdef SMP_UTILS_MULTI
+int
+smp_discover_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
     int res, c;
     int ret = 0;
@@ -1199,16 +1678,23 @@ main(int argc, char * argv[])
     char device_name[512];
     struct smp_target_obj tobj;
     struct opts_t opts;
+    static struct snap_t snap;  /* about 32 KB, keep off the stack */
+    struct smp_emit emit;
+    struct smp_req_tmpl disc_tmpl;
 
     op = &opts;
     memset(op, 0, sizeof(opts));
+    memset(&disc_tmpl, 0, sizeof(disc_tmpl));
+    op->disc_tp = &disc_tmpl;
+    op->retries = -1;
+    op->timeout_ms = -1;
     memset(device_name, 0, sizeof device_name);
     memset(i_params, 0, sizeof i_params);
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "AbcDhHiI:lmMn:p:rs:SvVz", long_options,
-                        &option_index);
+        c = getopt_long(argc, argv, "AbcC:DF:hHiI:jklmMn:p:rR:s:St:vVw:xz",
+                        long_options, &option_index);
         if (c == -1)
             break;
 
@@ -1222,9 +1708,18 @@ main(int argc, char * argv[])
         case 'D':
             op->do_dsn = true;
             break;
+        case 'F':
+            op->from_fn = optarg;
+            break;
         case 'c':
             op->do_cap_phy = true;
             break;
+        case 'k':
+            op->do_cached = true;
+            break;
+        case 'C':
+            op->since_fn = optarg;
+            break;
         case 'h':
         case '?':
             usage();
@@ -1239,6 +1734,9 @@ main(int argc, char * argv[])
             strncpy(i_params, optarg, sizeof(i_params));
             i_params[sizeof(i_params) - 1] = '\0';
             break;
+        case 'j':
+            op->out_fmt = SMP_EMIT_JSON;
+            break;
         case 'l':
             op->do_list = true;
             break;
@@ -1267,6 +1765,13 @@ main(int argc, char * argv[])
         case 'r':
             op->do_raw = true;
             break;
+        case 'R':
+           op->retries = smp_get_num(optarg);
+           if (op->retries < 0) {
+                pr2serr("bad argument to '--retries'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 's':
            sa_ll = smp_get_llnum_nomult(optarg);
            if (-1LL == sa_ll) {
@@ -1277,6 +1782,9 @@ main(int argc, char * argv[])
             if (op->sa > 0)
                 op->sa_given = true;
             break;
+        case 'w':
+            op->save_fn = optarg;
+            break;
         case 'v':
             ++op->verbose;
             break;
@@ -1286,6 +1794,16 @@ main(int argc, char * argv[])
         case 'S':
             op->do_summary = true;
             break;
+        case 't':
+           op->timeout_ms = smp_get_num(optarg);
+           if (op->timeout_ms < 0) {
+                pr2serr("bad argument to '--timeout'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'x':
+            op->out_fmt = SMP_EMIT_CSV;
+            break;
         case 'z':
             op->do_zero = true;
             break;
@@ -1313,9 +1831,11 @@ main(int argc, char * argv[])
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == op->sa) && (NULL == op->from_fn) &&
+                 (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -1355,6 +1875,12 @@ main(int argc, char * argv[])
         if (cp)
             op->do_dsn = true;
     }
+    if (op->out_fmt && (op->do_hex || op->do_raw || op->do_list ||
+                        op->do_my)) {
+        pr2serr("--json and --csv can not be used with --hex, --list, --my "
+                "or --raw\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
     if (op->do_my) {
         op->multiple = 0;
         op->do_summary = false;
@@ -1366,21 +1892,54 @@ main(int argc, char * argv[])
         ++op->do_brief;
         op->multiple = 1;
     }
+    if (op->since_fn) {
+        if ((0 == op->multiple) || op->phy_id_given || op->do_num) {
+            pr2serr("--since=SNAPSHOT needs all phys, so needs "
+                    "'--multiple' or\n'--summary' and excludes '--phy=ID' "
+                    "and '--num=NUM'\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+        op->dev_name = device_name;
+        op->snp = &snap;
+        res = read_snapshot(op->snp, op);
+        if (res)
+            return res;
+    }
+    if (op->from_fn && (res = smp_snap_load(op->from_fn, op->verbose)))
+        return (res < 0) ? SMP_LIB_FILE_ERROR : res;
+    if (op->save_fn && (res = smp_snap_save_begin(op->save_fn,
+                                                  op->verbose)))
+        return (res < 0) ? SMP_LIB_FILE_ERROR : res;
 
     res = smp_initiator_open(device_name, subvalue, i_params, op->sa,
                              &tobj, op->verbose);
     if (res < 0)
         return SMP_LIB_FILE_ERROR;
+    smp_set_req_policy(&tobj, op->timeout_ms, op->retries, -1);
 
+    if (op->out_fmt) {
+        if (smp_emit_init(&emit, op->out_fmt, stdout)) {
+            pr2serr("unable to allocate output buffer\n");
+            smp_initiator_close(&tobj);
+            return SMP_LIB_RESOURCE_ERROR;
+        }
+        op->emp = &emit;
+    }
     if (op->multiple)
         ret = do_multiple(&tobj, op);
     else
         ret = do_single(&tobj, op);
+    if (op->emp && smp_emit_fini(op->emp) && (0 == ret))
+        ret = SMP_LIB_FILE_ERROR;
     res = smp_initiator_close(&tobj);
     if (res < 0) {
         if (0 == ret)
-            return SMP_LIB_FILE_ERROR;
+            ret = SMP_LIB_FILE_ERROR;
     }
+    if (op->save_fn && smp_snap_save_end(op->verbose) && (0 == ret))
+        ret = SMP_LIB_FILE_ERROR;
+    if (op->from_fn)
+        smp_snap_unload();
     if (ret < 0)
         ret = SMP_LIB_CAT_OTHER;
     if (op->verbose && ret)
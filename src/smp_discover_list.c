@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2019, Douglas Gilbert
+ * Copyright (c) 2006-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -55,30 +55,37 @@
  * defined in the SPL series. The most recent SPL-5 draft is spl5r05.pdf .
  */
 
-static const char * version_str = "1.48 20180725";    /* spl5r05 */
+static const char * version_str = "1.53 20261014";    /* spl5r05 */
 
 #define MAX_DLIST_SHORT_DESCS 40
 #define MAX_DLIST_LONG_DESCS 8
-#define SMP_FN_REPORT_GENERAL_RESP_LEN 76
 
 static struct option long_options[] = {
+        {"adaptive", no_argument, 0, 'a'},
         {"adn", no_argument, 0, 'A'},
         {"brief", no_argument, 0, 'b'},
+        {"cached", no_argument, 0, 'k'},
         {"cap", no_argument, 0, 'c'},
+        {"csv", no_argument, 0, 'x'},
         {"descriptor", required_argument, 0, 'd'},
         {"dsn", no_argument, 0, 'D'},
         {"filter", required_argument, 0, 'f'},
+        {"from", required_argument, 0, 'F'},
         {"help", no_argument, 0, 'h'},
         {"hex", no_argument, 0, 'H'},
         {"ignore", no_argument, 0, 'i'},
         {"interface", required_argument, 0, 'I'},
+        {"json", no_argument, 0, 'j'},
         {"list", no_argument, 0, 'l'},    /* placeholder, not implemented */
         {"num", required_argument, 0, 'n'},
         {"one", no_argument, 0, 'o'},
         {"phy", required_argument, 0, 'p'},
         {"sa", required_argument, 0, 's'},
+        {"save", required_argument, 0, 'w'},
         {"summary", no_argument, 0, 'S'},
         {"raw", no_argument, 0, 'r'},
+        {"retries", required_argument, 0, 'R'},
+        {"timeout", required_argument, 0, 't'},
         {"verbose", no_argument, 0, 'v'},
         {"version", no_argument, 0, 'V'},
         {"zpi", required_argument, 0, 'Z'},
@@ -86,7 +93,9 @@ static struct option long_options[] = {
 };
 
 struct opts_t {
+    bool do_adaptive;
     bool do_adn;
+    bool do_cached;
     bool do_cap_phy;
     bool do_dsn;
     bool desc_type_given;
@@ -101,11 +110,17 @@ struct opts_t {
     int filter;
     int do_hex;
     int do_num;
+    int out_fmt;                /* 0, SMP_EMIT_JSON or SMP_EMIT_CSV */
     int phy_id;
+    int retries;                /* -1 -> library default */
+    int timeout_ms;             /* -1 -> library default */
     int verbose;
     uint64_t sa;
     const char * zpi_fn;
+    const char * save_fn;       /* --save=FILE */
+    const char * from_fn;       /* --from=FILE */
     FILE * zpi_filep;
+    struct smp_emit * emp;      /* non-NULL with --json or --csv */
 };
 
 
@@ -113,24 +128,41 @@ static void
 usage(void)
 {
     pr2serr("Usage: "
-            "smp_discover_list  [--adn] [--brief] [--cap] [--descriptor=TY]\n"
-            "                          [--dsn] [--filter=FI] [--help] "
-            "[--hex] "
+            "smp_discover_list  [--adaptive] [--adn] [--brief] [--cached] "
+            "[--cap]\n"
+            "                          [--csv] [--descriptor=TY] [--dsn] "
+            "[--filter=FI]\n"
+            "                          [--from=FILE] [--help] [--hex] "
             "[--ignore]\n"
-            "                          [--interface=PARAMS] [--num=NUM] "
-            "[--one]\n"
-            "                          [--phy=ID] [--raw] [--sa=SAS_ADDR] "
+            "                          [--interface=PARAMS] [--json] "
+            "[--num=NUM]\n"
+            "                          [--one] [--phy=ID] [--raw] "
+            "[--retries=N]\n"
+            "                          [--sa=SAS_ADDR] [--save=FILE] "
             "[--summary]\n"
-            "                          [--verbose] [--version] [--zpi=FN]\n"
+            "                          [--timeout=MS] [--verbose] "
+            "[--version] [--zpi=FN]\n"
             "                          <smp_device>[,<n>]\n");
     pr2serr(
             "  where:\n"
+            "    --adaptive|-a        size each request to get as many "
+            "phys per\n"
+            "                         response as the expander allows "
+            "(def: with\n"
+            "                         --summary)\n"
             "    --adn|-A             output attached device name in one "
             "line per\n"
             "                         phy mode (i.e. with --one)\n"
             "    --brief|-b           brief: less output, can be used "
             "multiple times\n"
+            "    --cached|-k          in one line per phy output take what "
+            "the kernel\n"
+            "                         has in sysfs, DISCOVER LIST only phys "
+            "it lacks\n"
             "    --cap|-c             decode phy capabilities bits\n"
+            "    --csv|-x             output one comma separated line per "
+            "descriptor,\n"
+            "                         after a header line of field names\n"
             "    --descriptor=TY|-d TY    descriptor type:\n"
             "                         0 -> long (as in DISCOVER); 1 -> "
             "short (24 byte)\n"
@@ -141,6 +173,9 @@ usage(void)
             "                         attached; 2 -> expander "
             "or SAS SATA\n"
             "                         device; 3 -> SAS SATA (end) device\n"
+            "    --from=FILE|-F FILE  answer requests from snapshot FILE "
+            "(written by\n"
+            "                         --save) rather than from <smp_device>\n"
             "    --help|-h            print out usage message\n"
             "    --hex|-H             print response in hexadecimal\n"
             "    --ignore|-i          sets the Ignore Zone Group bit; "
@@ -148,24 +183,38 @@ usage(void)
             "                         phys otherwise hidden by zoning\n"
             "    --interface=PARAMS|-I PARAMS    specify or override "
             "interface\n"
+            "    --json|-j            output one JSON object per line, "
+            "one per\n"
+            "                         descriptor (phy)\n"
             "    --num=NUM|-n NUM     maximum number of descriptors to fetch "
             "(def: 1)\n"
             "    --one|-o             one line output per response "
             "descriptor (phy)\n"
             "    --phy=ID|-p ID       phy identifier [or starting phy id]\n"
             "    --raw|-r             output response in binary\n"
+            "    --retries=N|-R N     times to resend a request answered "
+            "BUSY (or\n"
+            "                         that timed out with --timeout) "
+            "(def: 2)\n"
             "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of SMP "
             "target (use leading\n"
             "                                 '0x' or trailing 'h'). "
             "Depending on\n"
             "                                 the interface, may not be "
-            "needed\n");
+            "needed\n"
+            "    --save=FILE|-w FILE  save each request and its response in "
+            "snapshot\n"
+            "                         FILE, to be read later with "
+            "--from=FILE\n");
     pr2serr(
             "    --summary|-S         output 1 line per active phy; "
             "typically\n"
             "                         equivalent to: '-o -d 1 -n 254 -b' .\n"
             "                         This option is assumed if '--phy=ID' "
             "not given\n"
+            "    --timeout=MS|-t MS   SMP request timeout in milliseconds "
+            "(def: 0 ->\n"
+            "                         pass-through's default)\n"
             "    --verbose|-v         increase verbosity\n"
             "    --version|-V         print version string and exit\n"
             "    --zpi=FN|-Z FN       FN is file that zone phy information "
@@ -188,6 +237,26 @@ dStrRaw(const uint8_t * str, int len)
         printf("%c", str[k]);
 }
 
+/* Returns the phy identifier in the last of num_desc descriptors in a
+ * DISCOVER LIST response of len bytes, or -1 if it can't be found. */
+static int
+last_desc_phy_id(const uint8_t * resp, int len, int num_desc)
+{
+    int desc_len = resp[12] * 4;
+    int off = 48 + ((num_desc - 1) * desc_len);
+
+    if ((num_desc < 1) || (desc_len < 4) || ((off + desc_len) > len))
+        return -1;
+    switch (resp[11] & 0xf) {
+    case 0:             /* long: as DISCOVER response, phy id at byte 9 */
+        return (desc_len > 9) ? resp[off + 9] : -1;
+    case 1:             /* short: phy id at byte 0 */
+        return resp[off];
+    default:
+        return -1;
+    }
+}
+
 /* Returns the number of phys (from REPORT GENERAL response) and if
  * t2t_routingp is non-NULL places 'Table to Table Supported' bit where it
  * points. Returns -3 (or less) -> SMP_LIB errors negated (-4 - smp_err),
@@ -196,97 +265,25 @@ static int
 get_num_phys(struct smp_target_obj * top, const struct opts_t * op,
              bool * t2t_routingp)
 {
-    int len, res, k, act_resplen;
-    int ret = 0;
-    char * cp;
-    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_REPORT_GENERAL, 0, 0,
-                         0, 0, 0, 0};
-    struct smp_req_resp smp_rr;
-    uint8_t * rp = NULL;
-    uint8_t * free_rp = NULL;
+    int res;
     char b[256];
+    struct smp_report_general rg;
 
-    rp = smp_memalign(SMP_FN_REPORT_GENERAL_RESP_LEN, 0, &free_rp, false);
-    if (NULL == rp) {
-        pr2serr("%s: heap allocation problem\n", __func__);
-        return SMP_LIB_RESOURCE_ERROR;
-    }
-    if (op->verbose) {
-        pr2serr("    Report general request: ");
-        for (k = 0; k < (int)sizeof(smp_req); ++k)
-            pr2serr("%02x ", smp_req[k]);
-        pr2serr("\n");
-    }
-    memset(&smp_rr, 0, sizeof(smp_rr));
-    smp_rr.request_len = sizeof(smp_req);
-    smp_rr.request = smp_req;
-    smp_rr.max_response_len = SMP_FN_REPORT_GENERAL_RESP_LEN;
-    smp_rr.response = rp;
-    res = smp_send_req(top, &smp_rr, op->verbose);
-
-    if (res) {
+    res = smp_get_report_general(top, &rg, -1, op->verbose);
+    if (res < 0) {
         pr2serr("RG smp_send_req failed, res=%d\n", res);
         if (0 == op->verbose)
             pr2serr("    try adding '-v' option for more debug\n");
-        ret = -1;
-        goto fini;
-    }
-    if (smp_rr.transport_err) {
-        pr2serr("RG smp_send_req transport_error=%d\n",
-                smp_rr.transport_err);
-        ret = -1;
-        goto fini;
-    }
-    act_resplen = smp_rr.act_response_len;
-    if ((act_resplen >= 0) && (act_resplen < 4)) {
-        pr2serr("RG response too short, len=%d\n", act_resplen);
-        ret = -4 - SMP_LIB_CAT_MALFORMED;
-        goto fini;
-    }
-    len = rp[3];
-    if ((0 == len) && (0 == rp[2])) {
-        len = smp_get_func_def_resp_len(rp[1]);
-        if (len < 0) {
-            len = 0;
-            if (op->verbose > 1)
-                pr2serr("unable to determine RG response length\n");
-        }
-    }
-    len = 4 + (len * 4);        /* length in bytes, excluding 4 byte CRC */
-    if ((act_resplen >= 0) && (len > act_resplen)) {
-        if (op->verbose)
-            pr2serr("actual RG response length [%d] less than deduced "
-                    "length [%d]\n", act_resplen, len);
-        len = act_resplen;
-    }
-    /* ignore --hex and --raw */
-    if (SMP_FRAME_TYPE_RESP != rp[0]) {
-        pr2serr("RG expected SMP frame response type, got=0x%x\n",
-                rp[0]);
-        ret = -4 - SMP_LIB_CAT_MALFORMED;
-        goto fini;
-    }
-    if (rp[1] != smp_req[1]) {
-        pr2serr("RG Expected function code=0x%x, got=0x%x\n",
-                smp_req[1], rp[1]);
-        ret = -4 - SMP_LIB_CAT_MALFORMED;
-        goto fini;
-    }
-    if (rp[2]) {
-        if (op->verbose > 1) {
-            cp = smp_get_func_res_str(rp[2], sizeof(b), b);
-            pr2serr("Report General result: %s\n", cp);
-        }
-        ret = -4 - rp[2];
-        goto fini;
+        return -1;
+    } else if (res) {
+        if ((SMP_LIB_CAT_MALFORMED != res) && (op->verbose > 1))
+            pr2serr("Report General result: %s\n",
+                    smp_get_func_res_str(res, sizeof(b), b));
+        return -4 - res;
     }
     if (t2t_routingp)
-        *t2t_routingp = (len > 10) ? !!(0x80 & rp[10]) : false;
-    ret = (len > 9) ? rp[9] : 0;
-fini:
-    if (free_rp)
-        free(free_rp);
-    return ret;
+        *t2t_routingp = rg.table_to_table_sup;
+    return rg.num_phys;
 }
 
 /* Since spl4r01 these are 'attached SAS device type's */
@@ -388,10 +385,10 @@ smp_get_neg_xxx_link_rate(int val, int b_len, char * b)
     return b;
 }
 
-/* Returns 0 when successful, -1 for low level errors and > 0
-   for other error categories. */
+/* Asks for up to mnum descriptors starting at sphy_id. Returns 0 when
+   successful, -1 for low level errors and > 0 for other error categories. */
 static int
-do_discover_list(struct smp_target_obj * top, int sphy_id,
+do_discover_list(struct smp_target_obj * top, int sphy_id, int mnum,
                  uint8_t * resp, int max_resp_len,
                  struct opts_t * op)
 {
@@ -407,7 +404,7 @@ do_discover_list(struct smp_target_obj * top, int sphy_id,
     dword_resp_len = (max_resp_len - 8) / 4;
     smp_req[2] = (dword_resp_len < 0x100) ? dword_resp_len : 0xff;
     smp_req[8] = sphy_id;
-    mnum_desc = op->do_num;
+    mnum_desc = mnum;
     if ((0 == op->desc_type) && (mnum_desc > MAX_DLIST_LONG_DESCS))
         mnum_desc = MAX_DLIST_LONG_DESCS;
     if ((1 == op->desc_type) && (mnum_desc > MAX_DLIST_SHORT_DESCS))
@@ -566,15 +563,15 @@ decode_phy_cap(unsigned int p_cap, const struct opts_t * op)
 /* long format: as described in (full, single) DISCOVER response
  * Returns 0 for okay, else -1 . */
 static int
-decode_desc0_multiline(const uint8_t * rp, int hdr_ecc, struct opts_t * op)
+decode_desc0_multiline(const struct smp_discover_view * vp, int hdr_ecc,
+                       struct opts_t * op)
 {
     unsigned int ui;
-    int func_res, phy_id, ecc, adt, route_attr, len;
+    int func_res, phy_id, ecc, adt, route_attr;
     char b[256];
 
-    phy_id = rp[9];
-    func_res = rp[2];
-    len = 4 + (rp[3] * 4);        /* length in bytes, excluding 4 byte CRC */
+    phy_id = vp->phy_id;
+    func_res = vp->func_res;
     printf("  phy identifier: %d\n", phy_id);
     if (SMP_FRES_PHY_VACANT == func_res) {
         printf("  inaccessible (phy vacant)\n");
@@ -584,11 +581,11 @@ decode_desc0_multiline(const uint8_t * rp, int hdr_ecc, struct opts_t * op)
                smp_get_func_res_str(func_res, sizeof(b), b));
         return -1;
     }
-    ecc = sg_get_unaligned_be16(rp + 4);
+    ecc = vp->exp_change_count;
     if ((0 != ecc) && (hdr_ecc != ecc))
         printf("  >>> expander change counts differ, header: %d, this phy: "
         "%d\n", hdr_ecc, ecc);
-    adt = ((0x70 & rp[12]) >> 4);
+    adt = vp->att_dev_type;
     if (adt < 8)
         printf("  attached SAS device type: %s\n",
                smp_attached_device_type[adt]);
@@ -596,51 +593,59 @@ decode_desc0_multiline(const uint8_t * rp, int hdr_ecc, struct opts_t * op)
         return 0;
     if (0 == op->do_brief)
         printf("  attached reason: %s\n",
-               smp_get_reason(0xf & rp[12], sizeof(b), b));
+               smp_get_reason(vp->att_reason, sizeof(b), b));
 
     printf("  negotiated logical link rate: %s\n",
-           smp_get_neg_xxx_link_rate(0xf & rp[13], sizeof(b), b));
+           smp_get_neg_xxx_link_rate(vp->neg_log_lrate, sizeof(b), b));
     printf("  attached initiator: ssp=%d stp=%d smp=%d sata_host=%d\n",
-           !!(rp[14] & 8), !!(rp[14] & 4), !!(rp[14] & 2), (rp[14] & 1));
+           !!(vp->att_init & 8), !!(vp->att_init & 4),
+           !!(vp->att_init & 2), (vp->att_init & 1));
     if (0 == op->do_brief) {
-        printf("  attached sata port selector: %d\n", !!(rp[15] & 0x80));
-        printf("  STP buffer too small: %d\n", !!(rp[15] & 0x10));
+        printf("  attached sata port selector: %d\n", !!(vp->att_targ & 0x80));
+        printf("  STP buffer too small: %d\n", !!(vp->att_targ & 0x10));
     }
     printf("  attached target: ssp=%d stp=%d smp=%d sata_device=%d\n",
-           !!(rp[15] & 8), !!(rp[15] & 4), !!(rp[15] & 2), (rp[15] & 1));
+           !!(vp->att_targ & 8), !!(vp->att_targ & 4),
+           !!(vp->att_targ & 2), (vp->att_targ & 1));
 
-    printf("  SAS address: 0x%" PRIx64 "\n", sg_get_unaligned_be64(rp + 16));
+    printf("  SAS address: 0x%" PRIx64 "\n", vp->sas_addr);
     printf("  attached SAS address: 0x%" PRIx64 "\n",
-           sg_get_unaligned_be64(rp + 24));
-    printf("  attached phy identifier: %d\n", rp[32]);
+           vp->att_sas_addr);
+    printf("  attached phy identifier: %d\n", vp->att_phy_id);
     if (0 == op->do_brief) {
-        printf("  attached persistent capable: %d\n", !!(rp[33] & 0x80));
-        printf("  attached power capable: %d\n", ((rp[33] >> 5) & 0x3));
-        printf("  attached slumber capable: %d\n", !!(rp[33] & 0x10));
-        printf("  attached partial capable: %d\n", !!(rp[33] & 0x8));
-        printf("  attached inside ZPSDS persistent: %d\n", !!(rp[33] & 4));
-        printf("  attached requested inside ZPSDS: %d\n", !!(rp[33] & 2));
-        printf("  attached break_reply capable: %d\n", !!(rp[33] & 1));
-        printf("  attached apta capable: %d\n", !!(rp[34] & 4));
-        printf("  attached smp priority capable: %d\n", !!(rp[34] & 2));
-        printf("  attached pwr_dis capable: %d\n", !!(rp[34] & 1));
+        printf("  attached persistent capable: %d\n",
+               !!(vp->att_caps[0] & 0x80));
+        printf("  attached power capable: %d\n",
+               ((vp->att_caps[0] >> 5) & 0x3));
+        printf("  attached slumber capable: %d\n", !!(vp->att_caps[0] & 0x10));
+        printf("  attached partial capable: %d\n", !!(vp->att_caps[0] & 0x8));
+        printf("  attached inside ZPSDS persistent: %d\n",
+               !!(vp->att_caps[0] & 4));
+        printf("  attached requested inside ZPSDS: %d\n",
+               !!(vp->att_caps[0] & 2));
+        printf("  attached break_reply capable: %d\n",
+               !!(vp->att_caps[0] & 1));
+        printf("  attached apta capable: %d\n", !!(vp->att_caps[1] & 4));
+        printf("  attached smp priority capable: %d\n",
+               !!(vp->att_caps[1] & 2));
+        printf("  attached pwr_dis capable: %d\n", !!(vp->att_caps[1] & 1));
         printf("  programmed minimum physical link rate: %s\n",
-               smp_get_plink_rate(((rp[40] >> 4) & 0xf), true,
+               smp_get_plink_rate(vp->prog_min_lrate, true,
                                   sizeof(b), b));
         printf("  hardware minimum physical link rate: %s\n",
-               smp_get_plink_rate((rp[40] & 0xf), false, sizeof(b), b));
+               smp_get_plink_rate(vp->hw_min_lrate, false, sizeof(b), b));
         printf("  programmed maximum physical link rate: %s\n",
-               smp_get_plink_rate(((rp[41] >> 4) & 0xf), true,
+               smp_get_plink_rate(vp->prog_max_lrate, true,
                                   sizeof(b), b));
         printf("  hardware maximum physical link rate: %s\n",
-               smp_get_plink_rate((rp[41] & 0xf), false,
+               smp_get_plink_rate(vp->hw_max_lrate, false,
                                   sizeof(b), b));
-        printf("  phy change count: %d\n", rp[42]);
-        printf("  virtual phy: %d\n", !!(rp[43] & 0x80));
+        printf("  phy change count: %d\n", vp->phy_change_count);
+        printf("  virtual phy: %d\n", vp->virt_phy);
         printf("  partial pathway timeout value: %d us\n",
-               (rp[43] & 0xf));
+               vp->pp_timeout);
     }
-    route_attr = (0xf & rp[44]);
+    route_attr = vp->routing_attr;
     switch (route_attr) {
     case 0: snprintf(b, sizeof(b), "direct"); break;
     case 1: snprintf(b, sizeof(b), "subtractive"); break;
@@ -649,115 +654,129 @@ decode_desc0_multiline(const uint8_t * rp, int hdr_ecc, struct opts_t * op)
     }
     printf("  routing attribute: %s\n", b);
     if (op->do_brief) {
-        if ((len > 59) && (rp[60] & 0x1))
-            printf("  zone group: %d\n", rp[63]);
+        if ((vp->resp_len > 59) && (vp->zone_flags & 0x1))
+            printf("  zone group: %d\n", vp->zone_group);
         return 0;
     }
     printf("  connector type: %s\n",
-           smp_get_connector_type_str((rp[45] & 0x7f), true, sizeof(b), b));
-    printf("  connector element index: %d\n", rp[46]);
-    printf("  connector physical link: %d\n", rp[47]);
+           smp_get_connector_type_str(vp->conn_type, true, sizeof(b), b));
+    printf("  connector element index: %d\n", vp->conn_elem_ind);
+    printf("  connector physical link: %d\n", vp->conn_phy_link);
     printf("  phy power condition: %s\n",
-           smp_get_phy_pwr_cond_str(((rp[48] & 0xc0) >> 6), sizeof(b), b));
-    printf("  sas slumber capable: %d\n", !!(rp[48] & 0x8));
-    printf("  sas partial capable: %d\n", !!(rp[48] & 0x4));
-    printf("  sata slumber capable: %d\n", !!(rp[48] & 0x2));
-    printf("  sata partial capable: %d\n", !!(rp[48] & 0x1));
+           smp_get_phy_pwr_cond_str(((vp->pwr_caps & 0xc0) >> 6), sizeof(b),
+                                    b));
+    printf("  sas slumber capable: %d\n", !!(vp->pwr_caps & 0x8));
+    printf("  sas partial capable: %d\n", !!(vp->pwr_caps & 0x4));
+    printf("  sata slumber capable: %d\n", !!(vp->pwr_caps & 0x2));
+    printf("  sata partial capable: %d\n", !!(vp->pwr_caps & 0x1));
     printf("  pwr_dis signal: %s\n",
-           smp_get_pwr_dis_signal_str(((rp[49] & 0xc0) >> 6),
+           smp_get_pwr_dis_signal_str(((vp->pwr_ctl & 0xc0) >> 6),
                                       sizeof(b), b));
-    printf("  pwr_dis control capable: %d\n", (rp[49] & 0x30) >> 4);
-    printf("  sas slumber enabled: %d\n", !!(rp[49] & 0x8));
-    printf("  sas partial enabled: %d\n", !!(rp[49] & 0x4));
-    printf("  sata slumber enabled: %d\n", !!(rp[49] & 0x2));
-    printf("  sata partial enabled: %d\n", !!(rp[49] & 0x1));
-    if (len > 59) {
+    printf("  pwr_dis control capable: %d\n", (vp->pwr_ctl & 0x30) >> 4);
+    printf("  sas slumber enabled: %d\n", !!(vp->pwr_ctl & 0x8));
+    printf("  sas partial enabled: %d\n", !!(vp->pwr_ctl & 0x4));
+    printf("  sata slumber enabled: %d\n", !!(vp->pwr_ctl & 0x2));
+    printf("  sata partial enabled: %d\n", !!(vp->pwr_ctl & 0x1));
+    if (vp->resp_len > 59) {
         printf("  attached device name: 0x%" PRIx64 "\n",
-               sg_get_unaligned_be64(rp + 52));
+               vp->att_dev_name);
         printf("  requested inside ZPSDS changed by expander: %d\n",
-               !!(rp[60] & 0x40));
-        printf("  inside ZPSDS persistent: %d\n", !!(rp[60] & 0x20));
-        printf("  requested inside ZPSDS: %d\n", !!(rp[60] & 0x10));
-        /* printf("  zone address resolved: %d\n", !!(rp[60] & 0x8)); */
-        printf("  zone group persistent: %d\n", !!(rp[60] & 0x4));
-        printf("  inside ZPSDS: %d\n", !!(rp[60] & 0x2));
-        printf("  zoning enabled: %d\n", !!(rp[60] & 0x1));
-        printf("  zone group: %d\n", rp[63]);
-        if (len < 76)
+               !!(vp->zone_flags & 0x40));
+        printf("  inside ZPSDS persistent: %d\n", !!(vp->zone_flags & 0x20));
+        printf("  requested inside ZPSDS: %d\n", !!(vp->zone_flags & 0x10));
+        /* zone address resolved, !!(vp->zone_flags & 0x8), is obsolete */
+        printf("  zone group persistent: %d\n", !!(vp->zone_flags & 0x4));
+        printf("  inside ZPSDS: %d\n", !!(vp->zone_flags & 0x2));
+        printf("  zoning enabled: %d\n", !!(vp->zone_flags & 0x1));
+        printf("  zone group: %d\n", vp->zone_group);
+        if (vp->resp_len < 76)
             return 0;
-        printf("  self-configuration status: %d\n", rp[64]);
-        printf("  self-configuration levels completed: %d\n", rp[65]);
+        printf("  self-configuration status: %d\n", vp->self_config_status);
+        printf("  self-configuration levels completed: %d\n",
+               vp->self_config_levels);
         printf("  self-configuration sas address: 0x%" PRIx64 "\n",
-               sg_get_unaligned_be64(rp + 68));
-        ui = sg_get_unaligned_be32(rp + 76);
+               vp->self_config_sas_addr);
+        ui = vp->prog_phy_cap;
         printf("  programmed phy capabilities: 0x%x\n", ui);
         if (op->do_cap_phy)
             decode_phy_cap(ui, op);
-        ui = sg_get_unaligned_be32(rp + 80);
+        ui = vp->cur_phy_cap;
         printf("  current phy capabilities: 0x%x\n", ui);
         if (op->do_cap_phy)
             decode_phy_cap(ui, op);
-        ui = sg_get_unaligned_be32(rp + 84);
+        ui = vp->att_phy_cap;
         printf("  attached phy capabilities: 0x%x\n", ui);
         if (op->do_cap_phy)
             decode_phy_cap(ui, op);
     }
-    if (len > 95) {
+    if (vp->resp_len > 95) {
         printf("  reason: %s\n",
-               smp_get_reason((0xf0 & rp[94]) >> 4, sizeof(b), b));
+               smp_get_reason(vp->reason, sizeof(b), b));
         printf("  negotiated physical link rate: %s\n",
-               smp_get_neg_xxx_link_rate(0xf & rp[94], sizeof(b), b));
-        printf("  optical mode enabled: %d\n", !!(rp[95] & 0x4));
-        printf("  negotiated SSC: %d\n", !!(rp[95] & 0x2));
+               smp_get_neg_xxx_link_rate(vp->neg_phy_lrate, sizeof(b), b));
+        printf("  optical mode enabled: %d\n", !!(vp->phy_flags & 0x4));
+        printf("  negotiated SSC: %d\n", !!(vp->phy_flags & 0x2));
         /* hardware muxing made obsolete in spl5r01 */
-        printf("  hardware muxing supported: %d\n", !!(rp[95] & 0x1));
+        printf("  hardware muxing supported: %d\n", !!(vp->phy_flags & 0x1));
     }
-    if (len > 107) {
-        printf("  default inside ZPSDS persistent: %d\n", !!(rp[96] & 0x20));
-        printf("  default requested inside ZPSDS: %d\n", !!(rp[96] & 0x10));
-        printf("  default zone group persistent: %d\n", !!(rp[96] & 0x4));
-        printf("  default zoning enabled: %d\n", !!(rp[96] & 0x1));
-        printf("  default zone group: %d\n", rp[99]);
-        printf("  saved inside ZPSDS persistent: %d\n", !!(rp[100] & 0x20));
-        printf("  saved requested inside ZPSDS: %d\n", !!(rp[100] & 0x10));
-        printf("  saved zone group persistent: %d\n", !!(rp[100] & 0x4));
-        printf("  saved zoning enabled: %d\n", !!(rp[100] & 0x1));
-        printf("  saved zone group: %d\n", rp[103]);
-        printf("  shadow inside ZPSDS persistent: %d\n", !!(rp[104] & 0x20));
-        printf("  shadow requested inside ZPSDS: %d\n", !!(rp[104] & 0x10));
-        printf("  shadow zone group persistent: %d\n", !!(rp[104] & 0x4));
+    if (vp->resp_len > 107) {
+        printf("  default inside ZPSDS persistent: %d\n",
+               !!(vp->def_zone_flags & 0x20));
+        printf("  default requested inside ZPSDS: %d\n",
+               !!(vp->def_zone_flags & 0x10));
+        printf("  default zone group persistent: %d\n",
+               !!(vp->def_zone_flags & 0x4));
+        printf("  default zoning enabled: %d\n", !!(vp->def_zone_flags & 0x1));
+        printf("  default zone group: %d\n", vp->def_zone_group);
+        printf("  saved inside ZPSDS persistent: %d\n",
+               !!(vp->saved_zone_flags & 0x20));
+        printf("  saved requested inside ZPSDS: %d\n",
+               !!(vp->saved_zone_flags & 0x10));
+        printf("  saved zone group persistent: %d\n",
+               !!(vp->saved_zone_flags & 0x4));
+        printf("  saved zoning enabled: %d\n", !!(vp->saved_zone_flags & 0x1));
+        printf("  saved zone group: %d\n", vp->saved_zone_group);
+        printf("  shadow inside ZPSDS persistent: %d\n",
+               !!(vp->shadow_zone_flags & 0x20));
+        printf("  shadow requested inside ZPSDS: %d\n",
+               !!(vp->shadow_zone_flags & 0x10));
+        printf("  shadow zone group persistent: %d\n",
+               !!(vp->shadow_zone_flags & 0x4));
         /* 'shadow zoning enabled' added in spl2r03 */
-        printf("  shadow zoning enabled: %d\n", !!(rp[104] & 0x1));
-        printf("  shadow zone group: %d\n", rp[107]);
+        printf("  shadow zoning enabled: %d\n",
+               !!(vp->shadow_zone_flags & 0x1));
+        printf("  shadow zone group: %d\n", vp->shadow_zone_group);
     }
-    if (len > 109) {
-        printf("  device slot number: %d\n", rp[108]);
-        ui = rp[109];
+    if (vp->resp_len > 109) {
+        printf("  device slot number: %d\n", vp->dev_slot_num);
+        ui = vp->dev_slot_grp_num;
         printf("  device slot group number: ");
         if (255 == ui)
             printf("not available\n");
         else
             printf("%d\n", ui);
     }
-    if (len > 115)
-        printf("  device slot group output connector: %.6s\n", rp + 110);
-    if (len > 117)
-        printf("  STP buffer size: %u\n", sg_get_unaligned_be16(rp + 116));
-    if (len > 118)
-        printf("  Buffered phy burst size (KiB): %u\n", rp[118]);
+    if (vp->resp_len > 115)
+        printf("  device slot group output connector: %.6s\n",
+               vp->dev_slot_grp_oc);
+    if (vp->resp_len > 117)
+        printf("  STP buffer size: %u\n", vp->stp_buff_size);
+    if (vp->resp_len > 118)
+        printf("  Buffered phy burst size (KiB): %u\n", vp->buff_phy_burst_sz);
     return 0;
 }
 
 /* short format: only DISCOVER LIST has this abridged 24 byte descriptor.
  * Returns 0 for okay, else -1 . */
 static int
-decode_desc1_multiline(const uint8_t * rp, bool z_enabled, struct opts_t * op)
+decode_desc1_multiline(const struct smp_discover_view * vp, bool z_enabled,
+                       struct opts_t * op)
 {
     int func_res, phy_id, adt, route_attr;
     char b[256];
 
-    phy_id = rp[0];
-    func_res = rp[1];
+    phy_id = vp->phy_id;
+    func_res = vp->func_res;
     printf("  phy identifier: %d\n", phy_id);
     if (SMP_FRES_PHY_VACANT == func_res) {
         printf("  inaccessible (phy vacant)\n");
@@ -767,7 +786,7 @@ decode_desc1_multiline(const uint8_t * rp, bool z_enabled, struct opts_t * op)
                smp_get_func_res_str(func_res, sizeof(b), b));
         return -1;
     }
-    adt = ((0x70 & rp[2]) >> 4);
+    adt = vp->att_dev_type;
     if (adt < 8)
         printf("  attached SAS device type: %s\n",
                smp_attached_device_type[adt]);
@@ -775,25 +794,27 @@ decode_desc1_multiline(const uint8_t * rp, bool z_enabled, struct opts_t * op)
         return 0;
     if (0 == op->do_brief)
         printf("  attached reason: %s\n",
-               smp_get_reason(0xf & rp[2], sizeof(b), b));
+               smp_get_reason(vp->att_reason, sizeof(b), b));
     printf("  negotiated logical link rate: %s\n",
-           smp_get_neg_xxx_link_rate(0xf & rp[3], sizeof(b), b));
+           smp_get_neg_xxx_link_rate(vp->neg_log_lrate, sizeof(b), b));
 
     printf("  attached initiator: ssp=%d stp=%d smp=%d sata_host=%d\n",
-           !!(rp[4] & 8), !!(rp[4] & 4), !!(rp[4] & 2), (rp[4] & 1));
+           !!(vp->att_init & 8), !!(vp->att_init & 4),
+           !!(vp->att_init & 2), (vp->att_init & 1));
     if (0 == op->do_brief)
-        printf("  attached sata port selector: %d\n", !!(rp[5] & 0x80));
+        printf("  attached sata port selector: %d\n",
+               !!(vp->att_targ & 0x80));
     printf("  attached target: ssp=%d stp=%d smp=%d sata_device=%d\n",
-           !!(rp[5] & 8), !!(rp[5] & 4), !!(rp[5] & 2), (rp[5] & 1));
+           !!(vp->att_targ & 8), !!(vp->att_targ & 4),
+           !!(vp->att_targ & 2), (vp->att_targ & 1));
 
     if (0 == op->do_brief)
-        printf("  virtual phy: %d\n", !!(rp[6] & 0x80));
-    printf("  attached SAS address: 0x%" PRIx64 "\n",
-           sg_get_unaligned_be64(rp + 12));
-    printf("  attached phy identifier: %d\n", rp[10]);
+        printf("  virtual phy: %d\n", vp->virt_phy);
+    printf("  attached SAS address: 0x%" PRIx64 "\n", vp->att_sas_addr);
+    printf("  attached phy identifier: %d\n", vp->att_phy_id);
     if (0 == op->do_brief)
-        printf("  phy change count: %d\n", rp[11]);
-    route_attr = (0xf & rp[6]);
+        printf("  phy change count: %d\n", vp->phy_change_count);
+    route_attr = vp->routing_attr;
     switch (route_attr) {
     case 0: snprintf(b, sizeof(b), "direct"); break;
     case 1: snprintf(b, sizeof(b), "subtractive"); break;
@@ -803,20 +824,19 @@ decode_desc1_multiline(const uint8_t * rp, bool z_enabled, struct opts_t * op)
     printf("  routing attribute: %s\n", b);
     if (op->do_brief) {
         if (z_enabled)
-            printf("  zone group: %d\n", rp[8]);
+            printf("  zone group: %d\n", vp->zone_group);
         return 0;
     }
-    printf("  reason: %s\n", smp_get_reason(0xf & (rp[7] >> 4),
-                                            sizeof(b), b));
+    printf("  reason: %s\n", smp_get_reason(vp->reason, sizeof(b), b));
     printf("  negotiated physical link rate: %s\n",
-           smp_get_neg_xxx_link_rate(0xf & rp[7], sizeof(b), b));
-    printf("  zone group: %d\n", rp[8]);
-    printf("  inside ZPSDS persistent: %d\n", !!(rp[9] & 0x20));
-    printf("  requested inside ZPSDS: %d\n", !!(rp[9] & 0x10));
-    /* printf("  zone address resolved: %d\n", !!(rp[9] & 0x8)); */
-    printf("  zone group persistent: %d\n", !!(rp[9] & 0x4));
-    printf("  inside ZPSDS: %d\n", !!(rp[9] & 0x2));
-    printf("  Buffered phy burst size (KiB): %u\n", rp[20]);
+           smp_get_neg_xxx_link_rate(vp->neg_phy_lrate, sizeof(b), b));
+    printf("  zone group: %d\n", vp->zone_group);
+    printf("  inside ZPSDS persistent: %d\n", !!(vp->zone_flags & 0x20));
+    printf("  requested inside ZPSDS: %d\n", !!(vp->zone_flags & 0x10));
+    /* zone address resolved, !!(vp->zone_flags & 0x8), is obsolete */
+    printf("  zone group persistent: %d\n", !!(vp->zone_flags & 0x4));
+    printf("  inside ZPSDS: %d\n", !!(vp->zone_flags & 0x2));
+    printf("  Buffered phy burst size (KiB): %u\n", vp->buff_phy_burst_sz);
     return 0;
 }
 
@@ -824,75 +844,41 @@ decode_desc1_multiline(const uint8_t * rp, bool z_enabled, struct opts_t * op)
  * "per phy" function. Returns 0 for ok, 1 for ok plus zoning enabled and
   * seen ZG other than 1, else -1 (for problem) . */
 static int
-decode_1line(const uint8_t * rp, int len, int desc, bool z_enabled,
+decode_1line(const struct smp_discover_view * vp, bool z_enabled,
              int has_t2t, struct opts_t * op)
 {
     bool plus;
     bool zg_not1 = true;
-    int phy_id, off, negot, adt, route_attr, vp, asa_off;
-    int func_res, aphy_id, a_init, a_target, z_group, iz_mask;
+    int off;
     uint64_t ull, adn;
     const char * cp;
     char b[256];
     char dsn[10] = "";
 
-    switch (desc) {
-    case 0:     /* longer descriptor */
-        phy_id = rp[9];
-        func_res = rp[2];
-        adt = ((0x70 & rp[12]) >> 4);
-        negot = rp[13] & 0xf;
-        route_attr = rp[44] & 0xf;
-        vp = rp[43] & 0x80;
-        asa_off = 24;
-        aphy_id = rp[32];
-        a_init = rp[14];
-        a_target = rp[15];
-        z_group = rp[63];
-        iz_mask = rp[60];
-        break;
-    case 1:     /* abridged 24 byte descriptor [short] */
-        phy_id = rp[0];
-        func_res = rp[1];
-        adt = ((0x70 & rp[2]) >> 4);
-        negot = rp[3] & 0xf;
-        route_attr = rp[6] & 0xf;
-        vp = !!(rp[6] & 0x80);
-        asa_off = 12;
-        aphy_id = rp[10];
-        a_init = rp[4];
-        a_target = rp[5];
-        z_group = rp[8];
-        iz_mask = rp[9];
-        break;
-    default:
-        pr2serr("  Unknown descriptor type %d\n", desc);
-        return -1;
-    }
     if (op->zpi_fn) {
-        if (func_res && (SMP_FRES_PHY_VACANT != func_res)) {
+        if (vp->func_res && (SMP_FRES_PHY_VACANT != vp->func_res)) {
             pr2serr("  >>> function result: %s\n",
-                    smp_get_func_res_str(func_res, sizeof(b), b));
+                    smp_get_func_res_str(vp->func_res, sizeof(b), b));
             return -1;
         }
-        snprintf(b, sizeof(b) - 1, "%x,%x,0,%x\n", phy_id, iz_mask & 0x34,
-                 z_group);
+        snprintf(b, sizeof(b) - 1, "%x,%x,0,%x\n", vp->phy_id,
+                 vp->zone_flags & 0x34, vp->zone_group);
         b[sizeof(b) - 1] = '\0';
         fprintf(op->zpi_filep, "%s", b);
         return 0;
     }
-    if (SMP_FRES_PHY_VACANT == func_res) {
-        printf("  phy %3d: inaccessible (phy vacant)\n", phy_id);
+    if (SMP_FRES_PHY_VACANT == vp->func_res) {
+        printf("  phy %3d: inaccessible (phy vacant)\n", vp->phy_id);
         return 0;
-    } else if (func_res) {
-        printf("  phy %3d: function result: %s\n", phy_id,
-               smp_get_func_res_str(func_res, sizeof(b), b));
+    } else if (vp->func_res) {
+        printf("  phy %3d: function result: %s\n", vp->phy_id,
+               smp_get_func_res_str(vp->func_res, sizeof(b), b));
         return -1;
     }
-    if ((0 == op->verbose) && (0 == adt) && (op->do_brief > 1))
+    if ((0 == op->verbose) && (0 == vp->att_dev_type) && (op->do_brief > 1))
         return 0;
 
-    switch (route_attr) {
+    switch (vp->routing_attr) {
     case 0:
         cp = "D";
         break;
@@ -906,109 +892,114 @@ decode_1line(const uint8_t * rp, int len, int desc, bool z_enabled,
         cp = "R";
         break;
     }
+    if (vp->src)
+        cp = "-";       /* routing attribute not in sysfs */
 
-    if (op->do_dsn && (0 == desc) && (len > 108) && (0xff != rp[108]))
-        sprintf(dsn, "  dsn=%d", rp[108]);
+    if (op->do_dsn && (0xff != vp->dev_slot_num))
+        sprintf(dsn, "  dsn=%d", vp->dev_slot_num);
 
-    switch (negot) {
+    switch (vp->neg_log_lrate) {
     case 1:
-        printf("  phy %3d:%s:disabled%s\n", phy_id, cp, dsn);
+        printf("  phy %3d:%s:disabled%s\n", vp->phy_id, cp, dsn);
         return 0;
     case 2:
-        printf("  phy %3d:%s:reset problem%s\n", phy_id, cp, dsn);
+        printf("  phy %3d:%s:reset problem%s\n", vp->phy_id, cp, dsn);
         return 0;
     case 3:
-        printf("  phy %3d:%s:spinup hold%s\n", phy_id, cp, dsn);
+        printf("  phy %3d:%s:spinup hold%s\n", vp->phy_id, cp, dsn);
         return 0;
     case 4:
-        printf("  phy %3d:%s:port selector%s\n", phy_id, cp, dsn);
+        printf("  phy %3d:%s:port selector%s\n", vp->phy_id, cp, dsn);
         return 0;
     case 5:
-        printf("  phy %3d:%s:reset in progress%s\n", phy_id, cp, dsn);
+        printf("  phy %3d:%s:reset in progress%s\n", vp->phy_id, cp, dsn);
         return 0;
     case 6:
-        printf("  phy %3d:%s:unsupported phy attached%s\n", phy_id, cp, dsn);
+        printf("  phy %3d:%s:unsupported phy attached%s\n", vp->phy_id, cp,
+               dsn);
         return 0;
     default:
         /* keep going */
         break;
     }
-    if ((0 == op->verbose) && (0 == adt) && op->do_brief)
+    if ((0 == op->verbose) && (0 == vp->att_dev_type) && op->do_brief)
         return 0;
-    ull = sg_get_unaligned_be64(rp + asa_off);
-    if ((0 == adt) || (adt > 3)) {
-        printf("  phy %3d:%s:attached:[0000000000000000:00]", phy_id, cp);
+    ull = vp->att_sas_addr;
+    if ((0 == vp->att_dev_type) || (vp->att_dev_type > 3)) {
+        printf("  phy %3d:%s:attached:[0000000000000000:00]", vp->phy_id, cp);
         if ((op->do_brief > 1) || op->do_adn) {
             printf("\n");
             return 0;
         }
-        if (z_enabled && (1 != z_group)) {
+        if (z_enabled && (1 != vp->zone_group)) {
             zg_not1 = true;
-            printf("  ZG:%d", z_group);
+            printf("  ZG:%d", vp->zone_group);
         }
         if ('\0' != dsn[0])
              printf("%s", dsn);
         printf("\n");
         return (int)zg_not1;
     }
-    if ((0 == desc) && op->do_adn) {
-        adn = sg_get_unaligned_be64(rp + 52);
+    if ((0 == vp->desc_type) && op->do_adn) {
+        adn = vp->att_dev_name;
         printf("  phy %3d:%s:attached:[%016" PRIx64 ":%02d %016" PRIx64
-               " %s%s", phy_id, cp, ull, aphy_id, adn,
-               smp_short_attached_device_type[adt], (vp ? " V" : ""));
+               " %s%s", vp->phy_id, cp, ull, vp->att_phy_id, adn,
+               smp_short_attached_device_type[vp->att_dev_type],
+               (vp->virt_phy ? " V" : ""));
     } else
-        printf("  phy %3d:%s:attached:[%016" PRIx64 ":%02d %s%s", phy_id, cp,
-               ull, aphy_id, smp_short_attached_device_type[adt],
-               (vp ? " V" : ""));
-    if (a_init & 0xf) {
+        printf("  phy %3d:%s:attached:[%016" PRIx64 ":%02d %s%s", vp->phy_id,
+               cp, ull, vp->att_phy_id,
+               smp_short_attached_device_type[vp->att_dev_type],
+               (vp->virt_phy ? " V" : ""));
+    if (vp->att_init & 0xf) {
         off = 0;
         plus = false;
         off += snprintf(b + off, sizeof(b) - off, " i(");
-        if (a_init & 0x8) {
+        if (vp->att_init & 0x8) {
             off += snprintf(b + off, sizeof(b) - off, "SSP");
             plus = true;
         }
-        if (a_init & 0x4) {
+        if (vp->att_init & 0x4) {
             off += snprintf(b + off, sizeof(b) - off, "%sSTP",
                             (plus ? "+" : ""));
             plus = true;
         }
-        if (a_init & 0x2) {
+        if (vp->att_init & 0x2) {
             off += snprintf(b + off, sizeof(b) - off, "%sSMP",
                             (plus ? "+" : ""));
             plus = true;
         }
-        if (a_init & 0x1) {
+        if (vp->att_init & 0x1) {
             off += snprintf(b + off, sizeof(b) - off, "%sSATA",
                             (plus ? "+" : ""));
             plus = true;
         }
         printf("%s)", b);
     }
-    if (a_target & 0xf) {
+    if (vp->att_targ & 0xf) {
         off = 0;
         plus = false;
         off += snprintf(b + off, sizeof(b) - off, " t(");
-        if (a_target & 0x80) {
+        if (vp->att_targ & 0x80) {
             off += snprintf(b + off, sizeof(b) - off, "PORT_SEL");
             plus = true;
         }
-        if (a_target & 0x8) {
+        if (vp->att_targ & 0x8) {
             off += snprintf(b + off, sizeof(b) - off, "%sSSP",
                             (plus ? "+" : ""));
             plus = true;
         }
-        if (a_target & 0x4) {
+        if (vp->att_targ & 0x4) {
             off += snprintf(b + off, sizeof(b) - off, "%sSTP",
                             (plus ? "+" : ""));
             plus = true;
         }
-        if (a_target & 0x2) {
+        if (vp->att_targ & 0x2) {
             off += snprintf(b + off, sizeof(b) - off, "%sSMP",
                             (plus ? "+" : ""));
             plus = true;
         }
-        if (a_target & 0x1) {
+        if (vp->att_targ & 0x1) {
             off += snprintf(b + off, sizeof(b) - off, "%sSATA",
                             (plus ? "+" : ""));
             plus = true;
@@ -1017,7 +1008,7 @@ decode_1line(const uint8_t * rp, int len, int desc, bool z_enabled,
     }
     printf("]");
     if ((op->do_brief < 2) && (! op->do_adn)) {
-        switch(negot) {
+        switch(vp->neg_log_lrate) {
         case 8:
             cp = "  1.5 Gbps";
             break;
@@ -1038,9 +1029,9 @@ decode_1line(const uint8_t * rp, int len, int desc, bool z_enabled,
             break;
         }
         printf("%s", cp);
-        if (z_enabled && (1 != z_group)) {
+        if (z_enabled && (1 != vp->zone_group)) {
             zg_not1 = true;
-            printf("  ZG:%d", z_group);
+            printf("  ZG:%d", vp->zone_group);
         }
         if ('\0' != dsn[0])
             printf("%s", dsn);
@@ -1099,16 +1090,84 @@ output_header_info(const uint8_t * rp, struct opts_t * op)
     }
 }
 
+/* One line per phy output from phy_id to end_phy-1 taking each phy's state
+ * from sysfs when the kernel has all of it, otherwise from a DISCOVER LIST
+ * of that one phy. When rg_needed is true the REPORT GENERAL that yields
+ * has_t2t is deferred until the first phy that sysfs can not provide.
+ * Returns 0 if ok, else function result. */
+static int
+do_cached_1line(struct smp_target_obj * top, int end_phy, bool rg_needed,
+                bool has_t2t, uint8_t * resp, int resp_sz, bool * zg_not1p,
+                bool * z_enabledp, struct opts_t * op)
+{
+    int k, res, desc_len;
+    int err = 0;
+    int num_sysfs = 0;
+    int ret = 0;
+    struct smp_discover_view dv;
 
+    for (k = op->phy_id; k < end_phy; ++k) {
+        if (SMP_DVF_ALL == (smp_sysfs_discover(top, k, &dv, op->verbose) &
+                            SMP_DVF_ALL)) {
+            ++num_sysfs;
+            res = decode_1line(&dv, false, has_t2t, op);
+        } else {
+            if (rg_needed) {
+                rg_needed = false;
+                get_num_phys(top, op, &has_t2t);
+            }
+            memset(resp, 0, resp_sz);
+            ret = do_discover_list(top, k, 1, resp, resp_sz, op);
+            if (ret) {
+                if (SMP_FRES_NO_PHY == ret)
+                    ret = 0;    /* off the end so not error */
+                break;
+            }
+            if (0 == resp[9])
+                continue;       /* filtered out */
+            *z_enabledp = !!(resp[16] & 0x40);
+            desc_len = resp[12] * 4;
+            if (smp_decode_discover(resp + 48, desc_len, resp[11] & 0xf,
+                                    &dv)) {
+                ++err;
+                continue;
+            }
+            res = decode_1line(&dv, *z_enabledp, has_t2t, op);
+        }
+        if (res < 0)
+            ++err;
+        else if (res > 0)
+            *zg_not1p = true;
+    }
+    if (op->verbose)
+        pr2serr("--cached: %d phy%s from sysfs\n", num_sysfs,
+                ((1 == num_sysfs) ? "" : "s"));
+    if (err && (0 == ret)) {
+        if (op->verbose)
+           pr2serr(">>> %d error%s detected\n", err,
+                   ((1 == err) ? "" : "s"));
+        ret = SMP_LIB_CAT_OTHER;
+    }
+    return ret;
+}
+
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_discover_list_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
+    bool cached, rg_needed;
     bool has_t2t = false;
     bool no_more;
+    bool num_known = false;
     bool z_enabled = false;
     bool zg_not1 = false;
     int res, c, len, hdr_ecc, num_desc, resp_filter, resp_desc_type;
-    int desc_len, k, j, err, off, adt, fresult, num;
+    int desc_len, k, j, err, off, num, end_phy, sphy_id, mnum, want;
     int ret = 0;
     int subvalue = 0;
     int64_t sa_ll;
@@ -1120,21 +1179,28 @@ main(int argc, char * argv[])
     uint8_t * resp = NULL;
     uint8_t * free_resp = NULL;
     struct smp_target_obj tobj;
+    struct smp_discover_view dv;
+    struct smp_emit emit;
     struct opts_t opts;
 
     op = &opts;
     memset(op, 0, sizeof(opts));
+    op->retries = -1;
+    op->timeout_ms = -1;
     memset(device_name, 0, sizeof device_name);
     memset(i_params, 0, sizeof i_params);
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "Abcd:Df:hHiI:ln:op:rs:SvVZ:",
+        c = getopt_long(argc, argv, "aAbcd:Df:F:hHiI:jkln:op:rR:s:St:vVw:xZ:",
                         long_options, &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'a':
+            op->do_adaptive = true;
+            break;
         case 'A':
             op->do_adn = true;
             break;
@@ -1162,6 +1228,9 @@ main(int argc, char * argv[])
                 return SMP_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'F':
+            op->from_fn = optarg;
+            break;
         case 'h':
         case '?':
             usage();
@@ -1176,6 +1245,9 @@ main(int argc, char * argv[])
             strncpy(i_params, optarg, sizeof(i_params));
             i_params[sizeof(i_params) - 1] = '\0';
             break;
+        case 'j':
+            op->out_fmt = SMP_EMIT_JSON;
+            break;
         case 'l':
             /* just ignore, placeholder */
             break;
@@ -1188,6 +1260,9 @@ main(int argc, char * argv[])
             }
             op->num_given = true;
             break;
+        case 'k':
+            op->do_cached = true;
+            break;
         case 'o':
             op->do_1line = true;
             break;
@@ -1203,6 +1278,13 @@ main(int argc, char * argv[])
         case 'r':
             op->do_raw = true;
             break;
+        case 'R':
+           op->retries = smp_get_num(optarg);
+           if (op->retries < 0) {
+                pr2serr("bad argument to '--retries'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 's':
            sa_ll = smp_get_llnum_nomult(optarg);
            if (-1LL == sa_ll) {
@@ -1214,12 +1296,25 @@ main(int argc, char * argv[])
         case 'S':
             op->do_summary = true;
             break;
+        case 't':
+           op->timeout_ms = smp_get_num(optarg);
+           if (op->timeout_ms < 0) {
+                pr2serr("bad argument to '--timeout'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'v':
             ++op->verbose;
             break;
+        case 'w':
+            op->save_fn = optarg;
+            break;
         case 'V':
             pr2serr("version: %s\n", version_str);
             return 0;
+        case 'x':
+            op->out_fmt = SMP_EMIT_CSV;
+            break;
         case 'Z':
             op->zpi_fn = optarg;
             break;
@@ -1246,9 +1341,11 @@ main(int argc, char * argv[])
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == op->sa) && (NULL == op->from_fn) &&
+                 (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -1294,6 +1391,11 @@ main(int argc, char * argv[])
         if (cp)
             op->do_dsn = true;
     }
+    if (op->out_fmt && (op->do_hex || op->do_raw || op->zpi_fn)) {
+        pr2serr("--json and --csv can not be used with --hex, --raw or "
+                "--zpi=FN\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
     if (op->do_summary || op->do_1line || op->num_given ||
         op->phy_id_given || op->zpi_fn)
         ;
@@ -1323,8 +1425,16 @@ main(int argc, char * argv[])
             op->desc_type = 1;
         op->do_1line = true;
         op->do_num = 254;
-    } else if (! (op->num_given || op->zpi_fn))
+        op->do_adaptive = true;
+    } else if (op->do_adaptive && (! op->num_given))
+        op->do_num = 254;
+    else if (! (op->num_given || op->zpi_fn))
         op->do_num = 1;
+    if (op->do_adaptive && (! op->desc_type_given) && (NULL == op->zpi_fn))
+        /* short descriptors hold all that one line per phy output needs,
+         * five times as many fit in a response */
+        op->desc_type = (op->do_1line && (! op->do_adn) && (! op->do_dsn) &&
+                         (0 == op->out_fmt)) ? 1 : 0;
     if (op->do_adn && (1 == op->desc_type)) {
         pr2serr("--adn and --descriptor=1 options clash since there is no "
                 "'attached\ndevice name' field in the short format. "
@@ -1337,12 +1447,23 @@ main(int argc, char * argv[])
         return SMP_LIB_RESOURCE_ERROR;
     }
 
+    if (op->from_fn && (res = smp_snap_load(op->from_fn, op->verbose))) {
+        ret = (res < 0) ? SMP_LIB_FILE_ERROR : res;
+        goto err_out;
+    }
+    if (op->save_fn && (res = smp_snap_save_begin(op->save_fn,
+                                                  op->verbose))) {
+        ret = (res < 0) ? SMP_LIB_FILE_ERROR : res;
+        op->save_fn = NULL;
+        goto err_out;
+    }
     res = smp_initiator_open(device_name, subvalue, i_params, op->sa,
                              &tobj, op->verbose);
     if (res < 0) {
         ret = SMP_LIB_FILE_ERROR;
         goto err_out;
     }
+    smp_set_req_policy(&tobj, op->timeout_ms, op->retries, -1);
 
     if (op->zpi_fn) {
         if ((1 == strlen(op->zpi_fn)) && (0 == strcmp("-", op->zpi_fn)))
@@ -1357,10 +1478,30 @@ main(int argc, char * argv[])
             }
         }
     }
-    num = get_num_phys(&tobj, op, &has_t2t);
+    if (op->out_fmt) {
+        if (smp_emit_init(&emit, op->out_fmt, stdout)) {
+            pr2serr("unable to allocate output buffer\n");
+            ret = SMP_LIB_RESOURCE_ERROR;
+            goto err_out;
+        }
+        op->emp = &emit;
+    }
+    /* sysfs has what one line per phy output needs, less the routing
+     * attribute and zoning */
+    cached = op->do_cached && op->do_1line &&
+             (! (op->do_hex || op->do_raw || op->emp || op->zpi_fn ||
+                 op->do_adn || op->do_dsn || op->filter || op->from_fn ||
+                 op->save_fn));
+    if (op->do_cached && (! cached) && op->verbose)
+        pr2serr("--cached ignored with these options\n");
+    num = cached ? smp_sysfs_num_phys(&tobj, op->verbose) : -1;
+    rg_needed = (num > 0);
+    if (num <= 0)
+        num = get_num_phys(&tobj, op, &has_t2t);
     if (num <= 0)
         num = op->do_num;
     else {
+        num_known = true;
         if (op->phy_id >= num) {
             printf("Given phy_id=%d equals or exceeds number of phys (%d)\n",
                    op->phy_id, num);
@@ -1370,28 +1511,79 @@ main(int argc, char * argv[])
         num -= op->phy_id;
         num = (num < op->do_num) ? num : op->do_num;
     }
+    end_phy = op->phy_id + num;
+    if (cached) {
+        ret = do_cached_1line(&tobj, end_phy, rg_needed, has_t2t, resp,
+                              resp_sz, &zg_not1, &z_enabled, op);
+        goto zoning;
+    }
+    mnum = op->do_num;
+    if (op->do_adaptive) {
+        mnum = (0 == op->desc_type) ? MAX_DLIST_LONG_DESCS :
+                                      MAX_DLIST_SHORT_DESCS;
+        if (op->verbose > 1)
+            pr2serr("adaptive: phys %d to %d, %s descriptors, up to %d per "
+                    "response\n", op->phy_id, end_phy - 1,
+                    (op->desc_type ? "short" : "long"), mnum);
+    }
     no_more = false;
-    for (j = 0; (j < num) && (! no_more); j += num_desc) {
+    sphy_id = op->phy_id;
+    for (j = 0; (sphy_id < end_phy) && (! no_more); j += num_desc) {
         memset(resp, 0, resp_sz);
-        if ((op->phy_id + j) > 254) {
+        if (sphy_id > 254) {
             ret = 0;    /* off the end so not error */
             break;
         }
-        ret = do_discover_list(&tobj, op->phy_id + j, resp, resp_sz, op);
+        if (op->do_adaptive)    /* ask for no more than is left */
+            want = ((end_phy - sphy_id) < mnum) ? (end_phy - sphy_id) : mnum;
+        else
+            want = mnum;
+        ret = do_discover_list(&tobj, sphy_id, want, resp, resp_sz, op);
         if (ret) {
             if (SMP_FRES_NO_PHY == ret)
                 ret = 0;    /* off the end so not error */
             break;
         }
         num_desc = resp[9];
-        if ((0 == op->desc_type) && (num_desc < MAX_DLIST_LONG_DESCS))
-            no_more = true;
-        if ((1 == op->desc_type) && (num_desc < MAX_DLIST_SHORT_DESCS))
+        if (! op->do_adaptive) {
+            if ((0 == op->desc_type) && (num_desc < MAX_DLIST_LONG_DESCS))
+                no_more = true;
+            if ((1 == op->desc_type) && (num_desc < MAX_DLIST_SHORT_DESCS))
+                no_more = true;
+            sphy_id += num_desc;
+        } else if (0 == num_desc)
             no_more = true;
+        else {
+            /* with a filter, phys may be skipped, so continue after the
+             * last one returned rather than counting descriptors */
+            k = last_desc_phy_id(resp, resp_sz - 4, num_desc);
+            sphy_id = (k < 0) ? (sphy_id + num_desc) : (k + 1);
+            if ((resp[11] & 0xf) != op->desc_type) {
+                /* expander chose another type, size later requests by it */
+                if (op->verbose > 1)
+                    pr2serr("adaptive: asked for descriptor type %d, got "
+                            "%d\n", op->desc_type, resp[11] & 0xf);
+                op->desc_type = resp[11] & 0xf;
+                mnum = (0 == op->desc_type) ? MAX_DLIST_LONG_DESCS :
+                                              MAX_DLIST_SHORT_DESCS;
+            }
+            if (num_desc < want) {
+                if ((! num_known) || op->filter)
+                    no_more = true; /* expander has looked at all its phys */
+                else if (num_desc < mnum) {
+                    /* expander returns less than the maximum that fits */
+                    if (op->verbose > 1)
+                        pr2serr("adaptive: asked for %d descriptors, got %d, "
+                                "asking for %d from now on\n", want,
+                                num_desc, num_desc);
+                    mnum = num_desc;
+                }
+            }
+        }
         if (op->do_hex || op->do_raw)
             continue;
         len = (resp[3] * 4) + 4;    /* length in bytes excluding CRC field */
-        if ((0 == j) && ((! op->do_1line) || op->zpi_fn))
+        if ((0 == j) && (NULL == op->emp) && ((! op->do_1line) || op->zpi_fn))
             output_header_info(resp, op);
         hdr_ecc = sg_get_unaligned_be16(resp + 4);
         z_enabled = !!(resp[16] & 0x40);
@@ -1415,30 +1607,32 @@ main(int argc, char * argv[])
         }
         for (k = 0, err = 0; k < num_desc; ++k) {
             off = 48 + (k * desc_len);
-            if (op->do_1line) {
-                res = decode_1line(resp + off, desc_len, resp_desc_type,
-                                   z_enabled, has_t2t, op);
+            if (smp_decode_discover(resp + off, desc_len, resp_desc_type,
+                                    &dv)) {
+                ++err;
+                continue;
+            }
+            if (op->emp) {
+                /* short descriptors leave zoning enabled to the header */
+                if (z_enabled)
+                    dv.zone_flags |= SMP_DV_ZONING_EN;
+                smp_emit_rec_begin(op->emp);
+                smp_emit_discover(op->emp, &dv);
+                smp_emit_rec_end(op->emp);
+            } else if (op->do_1line) {
+                res = decode_1line(&dv, z_enabled, has_t2t, op);
                 if (res < 0)
                     ++err;
                 else if (res > 0)
                     zg_not1 = true;
-            } else {
-                fresult = resp[off + 2];    /* function result, 0 -> ok */
+            } else if (resp_desc_type > 1)
+                ++err;
+            else if ((0 == op->do_brief) || dv.att_dev_type || dv.func_res) {
+                printf("descriptor %d:\n", j + k);
                 if (0 == resp_desc_type) {
-                    adt = (resp[off + 12] >> 4) & 7;
-                    if ((0 == op->do_brief) || adt || fresult) {
-                        printf("descriptor %d:\n", j + k);
-                        if (decode_desc0_multiline(resp + off, hdr_ecc, op))
-                            ++err;
-                    }
-                } else if (1 == resp_desc_type) {
-                    adt = (resp[off + 2] >> 4) & 7;
-                    if ((0 == op->do_brief) || adt || fresult) {
-                        printf("descriptor %d:\n", j + k);
-                        if (decode_desc1_multiline(resp + off, z_enabled, op))
-                            ++err;
-                    }
-                } else
+                    if (decode_desc0_multiline(&dv, hdr_ecc, op))
+                        ++err;
+                } else if (decode_desc1_multiline(&dv, z_enabled, op))
                     ++err;
             }
         }
@@ -1450,6 +1644,7 @@ main(int argc, char * argv[])
                 ret = SMP_LIB_CAT_OTHER;
         }
     }
+zoning:
     if (zg_not1 && (0 == op->do_brief) && (NULL == op->zpi_fn))
         printf("Zoning %sabled\n", z_enabled ? "en" : "dis");
 
@@ -1458,11 +1653,17 @@ err_out:
         free(free_resp);
     if (op->zpi_filep && (stdout != op->zpi_filep))
         fclose(op->zpi_filep);
+    if (op->emp && smp_emit_fini(op->emp) && (0 == ret))
+        ret = SMP_LIB_FILE_ERROR;
     res = smp_initiator_close(&tobj);
     if (res < 0) {
         if (0 == ret)
-            return SMP_LIB_FILE_ERROR;
+            ret = SMP_LIB_FILE_ERROR;
     }
+    if (op->save_fn && smp_snap_save_end(op->verbose) && (0 == ret))
+        ret = SMP_LIB_FILE_ERROR;
+    if (op->from_fn)
+        smp_snap_unload();
     if (ret < 0)
         ret = SMP_LIB_CAT_OTHER;
     if (op->verbose && ret)
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <getopt.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_pr2serr.h"
+
+/* This is a Serial Attached SCSI (SAS) Serial Management Protocol (SMP)
+ * utility.
+ *
+ * This utility finds the expander phy(s) that a device with a given SAS
+ * address (or attached device name) is attached to. It sends no SMP
+ * requests: the answer comes from the index written at the end of a
+ * topology walk by 'smp_topology --index=FILE', which is mapped and
+ * probed as a hash table. So it is cheap enough to run for every fault
+ * event, and many addresses can be looked up in one invocation.
+ */
+
+static const char * version_str = "1.00 20261014";
+
+#define MAX_MATCHES 16
+
+static struct option long_options[] = {
+        {"adn", no_argument, 0, 'a'},
+        {"help", no_argument, 0, 'h'},
+        {"index", required_argument, 0, 'x'},
+        {"quiet", no_argument, 0, 'q'},
+        {"verbose", no_argument, 0, 'v'},
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0},
+};
+
+
+static void
+usage(void)
+{
+    pr2serr("Usage: "
+            "smp_locate [--adn] [--help] [--index=FILE] [--quiet] "
+            "[--verbose]\n"
+            "                  [--version] [SAS_ADDR...]\n"
+            "  where:\n"
+            "    --adn|-a             SAS_ADDR is an attached device name "
+            "(as shown\n"
+            "                         by 'smp_discover --adn'), not an "
+            "attached SAS\n"
+            "                         address\n"
+            "    --help|-h            print out usage message\n"
+            "    --index=FILE|-x FILE    index written by 'smp_topology "
+            "--index=FILE'\n"
+            "                            ('-' or def: %s)\n"
+            "    --quiet|-q           no output, only the exit status\n"
+            "    --verbose|-v         increase verbosity\n"
+            "    --version|-V         print version string and exit\n\n"
+            "Outputs the expander phy(s), zone group and negotiated rate of "
+            "the device\nattached with each SAS_ADDR (read one per line "
+            "from stdin if none given).\nExit status is 0 if all are "
+            "found.\n", SMP_LOCATE_FN);
+}
+
+static const char *
+lrate_str(int lrate)
+{
+    switch (lrate) {
+    case 8:
+        return "1.5 Gbps";
+    case 9:
+        return "3 Gbps";
+    case 0xa:
+        return "6 Gbps";
+    case 0xb:
+        return "12 Gbps";
+    case 0xc:
+        return "22.5 Gbps";
+    default:
+        return "rate unknown";
+    }
+}
+
+/* Looks up the SAS address (or device name) in 'arg' and outputs a line
+ * per phy it is attached to. As SAS addresses are usually shown without a
+ * leading '0x', 16 hex digits alone are taken as hexadecimal. Returns 0 if
+ * found. */
+static int
+locate_one(const struct smp_locate_idx * lip, const char * arg, bool by_name,
+           bool quiet, int verbose)
+{
+    int k, n;
+    int64_t ll;
+    uint64_t u;
+    const struct smp_locate_ent * ep;
+    struct smp_locate_ent ents[MAX_MATCHES];
+
+    if ((16 == strlen(arg)) && (16 == strspn(arg, "0123456789abcdefABCDEF")) &&
+        (1 == sscanf(arg, "%" SCNx64, &u)))
+        ll = (int64_t)u;
+    else
+        ll = smp_get_llnum_nomult(arg);
+    if ((-1LL == ll) || (0 == ll)) {
+        pr2serr("bad SAS address: %s\n", arg);
+        return SMP_LIB_SYNTAX_ERROR;
+    }
+    if ((! by_name) && (! smp_is_naa5((uint64_t)ll))) {
+        pr2serr("SAS address %s not in naa-5 format (may need leading "
+                "'0x')\n", arg);
+        return SMP_LIB_SYNTAX_ERROR;
+    }
+    n = smp_locate_find(lip, (uint64_t)ll, by_name, ents, MAX_MATCHES);
+    if (0 == n) {
+        if (! quiet)
+            printf("0x%016" PRIx64 ": not found\n", (uint64_t)ll);
+        return SMP_LIB_CAT_OTHER;
+    }
+    if (quiet)
+        return 0;
+    if (n > MAX_MATCHES) {
+        if (verbose)
+            pr2serr("0x%016" PRIx64 ": %d matches, showing %d\n",
+                    (uint64_t)ll, n, MAX_MATCHES);
+        n = MAX_MATCHES;
+    }
+    for (k = 0; k < n; ++k) {
+        ep = ents + k;
+        printf("0x%016" PRIx64 ": expander 0x%016" PRIx64 " phy %d, ",
+               (uint64_t)ll, ep->exp_sas_addr, ep->phy_id);
+        printf("zone group %d, %s", ep->zone_group,
+               lrate_str(ep->neg_log_lrate));
+        if (by_name)
+            printf(", sas address 0x%016" PRIx64, ep->att_sas_addr);
+        else if (ep->att_dev_name && verbose)
+            printf(", device name 0x%016" PRIx64, ep->att_dev_name);
+        if (ep->exp_dev[0])
+            printf(", %s", ep->exp_dev);
+        printf("\n");
+    }
+    return 0;
+}
+
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_locate_main(int argc, char * argv[])
+#else
+int
+main(int argc, char * argv[])
+#endif
+{
+    bool by_name = false;
+    bool quiet = false;
+    int c, res, n;
+    int ret = 0;
+    int verbose = 0;
+    const char * index_fn = NULL;
+    char * cp;
+    struct smp_locate_idx * lip;
+    char line[128];
+
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "ahqvVx:", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'a':
+            by_name = true;
+            break;
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'q':
+            quiet = true;
+            break;
+        case 'v':
+            ++verbose;
+            break;
+        case 'V':
+            pr2serr("version: %s\n", version_str);
+            return 0;
+        case 'x':
+            /* '-' is the default, as for 'smp_topology --index=-' */
+            index_fn = strcmp(optarg, "-") ? optarg : NULL;
+            break;
+        default:
+            pr2serr("unrecognised switch code 0x%x ??\n", c);
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (NULL == (lip = smp_locate_map(index_fn, verbose + 1))) {
+        pr2serr("    build the index with 'smp_topology --index=%s'\n",
+                index_fn ? index_fn : SMP_LOCATE_FN);
+        return SMP_LIB_FILE_ERROR;
+    }
+    if (optind < argc) {
+        for ( ; optind < argc; ++optind) {
+            res = locate_one(lip, argv[optind], by_name, quiet, verbose);
+            if (res && (0 == ret))
+                ret = res;
+        }
+    } else {
+        while (fgets(line, sizeof(line), stdin)) {
+            for (cp = line; isspace((unsigned char)*cp); ++cp)
+                ;
+            n = strcspn(cp, " \t\r\n#");
+            if (0 == n)
+                continue;       /* blank line or comment */
+            cp[n] = '\0';
+            res = locate_one(lip, cp, by_name, quiet, verbose);
+            if (res && (0 == ret))
+                ret = res;
+        }
+    }
+    smp_locate_free(lip);
+    if (verbose && ret)
+        pr2serr("Exit status %d indicates error detected\n", ret);
+    return ret;
+}
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2018, Douglas Gilbert
+ * Copyright (c) 2006-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -33,7 +33,10 @@
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <time.h>
+#include <inttypes.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -49,9 +52,11 @@
  * utility.
  *
  * This utility issues a PHY CONTROL function and outputs its response.
+ * Given a list of phys, or more than one SMP target, it sends the requests
+ * together and can wait for the links to come back up.
  */
 
-static const char * version_str = "1.25 20180725";
+static const char * version_str = "1.26 20261014";
 
 static struct option long_options[] = {
     {"attached", required_argument, 0, 'a'},
@@ -77,6 +82,7 @@ static struct option long_options[] = {
     {"sata_sl", required_argument, 0, 'L'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
+    {"wait", required_argument, 0, 'w'},
     {0, 0, 0, 0},
 };
 
@@ -88,13 +94,14 @@ usage(void)
             "[--help] [--hex]\n"
             "                       [--interface=PARAMS] [--max=MA] "
             "[--min=MI] [--op=OP]\n"
-            "                       [--phy=ID] [--pptv=TI] [--pwrdis=PDC] "
-            "[--raw]\n"
+            "                       [--phy=ID|LIST|all] [--pptv=TI] "
+            "[--pwrdis=PDC] [--raw]\n"
             "                       [--sa=SAS_ADDR] [--sas_pa=CO] "
             "[--sas_sl=CO]\n"
             "                       [--sata_pa=CO] [--sata_sl=CO] "
             "[--version]\n"
-            "                       [--verbose] SMP_DEVICE[,N]\n"
+            "                       [--verbose] [--wait=MS] SMP_DEVICE[,N]\n"
+            "                       [SMP_DEVICE[,N] ...]\n"
             "  where:\n"
             "    --attached=ADN|-a ADN    attached device name [a decimal "
             "number,\n"
@@ -117,7 +124,9 @@ usage(void)
             "    --op=OP|-o OP            OP (operation) is a number or "
             "abbreviation.\n"
             "                             Default: 0 (nop). See below\n"
-            "    --phy=ID|-p ID           phy identifier (def: 0)\n"
+            "    --phy=ID|-p ID           phy identifier (def: 0). May be a "
+            "list (e.g.\n"
+            "                             '0,4-7') or 'all'\n"
             "    --pptv=TI|-P TI          partial pathway timeout value "
             "(microseconds)\n"
             "                             (if given sets UPPTV bit)\n"
@@ -129,7 +138,8 @@ usage(void)
             "                                 '0x' or trailing 'h'). "
             "Depending on\n"
             "                                 the interface, may not be "
-            "needed\n"
+            "needed.\n"
+            "                                 May be given more than once\n"
             "    --sas_pa=CO|-q CO        Enable SAS Partial field; CO: "
             "0->leave (def)\n"
             "                             1->manage (enable), 2->disable\n"
@@ -137,7 +147,10 @@ usage(void)
             "    --sata_pa=CO|-Q CO       Enable SATA Partial field\n"
             "    --sata_sl=CO|-L CO       Enable SATA Slumber field\n"
             "    --verbose|-v             increase verbosity\n"
-            "    --version|-V             print version string and exit\n\n"
+            "    --version|-V             print version string and exit\n"
+            "    --wait=MS|-w MS          after 'lr' or 'hr' wait up to MS "
+            "milliseconds\n"
+            "                             for links to come up again\n\n"
             "Performs a SMP PHY CONTROL function. Operation codes (OP): "
             "0,'nop'; 1,'lr'\n[link reset]; 2,'hr' [hard reset]; 3,'dis' "
             "[disable]; 5,'cel' [clear error\nlog]; 6,'ca' [clear "
@@ -180,48 +193,464 @@ list_op_abbrevs()
 }
 
 
+/* With more than one phy or SMP target the PHY CONTROL requests to each
+ * SMP target are sent together with smp_send_req_batch(), the SMP targets
+ * in parallel (a thread each). With --wait=MS each phy that had a link up
+ * before is then polled with DISCOVER until its link is up again with a
+ * new phy change count. */
+
+#define MAX_TARGETS 64
+#define MAX_SAS_ADDRS 32
+#define PC_REQ_LEN 44
+#define PC_RESP_LEN 8
+#define PC_DISC_RESP_LEN 124
+#define PC_POLL_MS 50
+
+struct pc_phy_t {
+    bool skip;          /* attached SMP initiator with --phy=all */
+    bool was_up;
+    bool up;
+    uint8_t phy_id;
+    uint8_t pre_pcc;    /* phy change count before PHY CONTROL */
+    int res;            /* of PHY CONTROL */
+    uint64_t done_us;   /* when PHY CONTROL completed */
+    uint64_t up_us;
+};
+
+struct pc_bulk_t;
+
+struct pc_tgt_t {
+    bool thr_ok;
+    int subvalue;
+    int res;            /* open, REPORT GENERAL or heap problem */
+    int num_phys;
+    uint64_t sa;
+    pthread_t thr;
+    struct pc_bulk_t * bp;
+    char dev_name[SMP_MAX_DEVICE_NAME];
+    struct pc_phy_t phys[256];
+};
+
+struct pc_bulk_t {
+    bool all_phys;
+    bool disruptive;    /* link reset, hard reset or disable */
+    int num_list;
+    int wait_ms;
+    int verbose;
+    int num_tgts;
+    const char * i_params;
+    const uint8_t * req;        /* template, phy identifier filled later */
+    uint8_t phy_list[256];
+    struct pc_tgt_t tgts[MAX_TARGETS];
+};
+
+static void
+ctl_done_cb(int index, struct smp_req_resp * rresp, int res, void * cb_arg)
+{
+    struct pc_tgt_t * tp = (struct pc_tgt_t *)cb_arg;
+
+    if (rresp && (res >= 0))
+        tp->phys[index].done_us = smp_stats_clock_us();
+}
+
+/* DISCOVERs the phys of tp in pp_arr (n of them) that are not up and not
+ * skipped, in one batch. With 'before' set records which links are up and
+ * their phy change counts, else marks those that have come up again. */
+static int
+discover_phys(struct smp_target_obj * top, struct pc_tgt_t * tp, bool before,
+              uint8_t * reqs, uint8_t * resps, struct smp_req_resp * rrp)
+{
+    int k, n, len;
+    struct pc_phy_t * ppp;
+    struct smp_discover_view dv;
+    struct pc_bulk_t * bp = tp->bp;
+
+    for (n = 0, k = 0; k < tp->num_phys; ++k) {
+        ppp = tp->phys + k;
+        if (ppp->skip || ppp->up || ((! before) && (! ppp->was_up)))
+            continue;
+        memset(reqs + (16 * n), 0, 16);
+        reqs[16 * n] = SMP_FRAME_TYPE_REQ;
+        reqs[(16 * n) + 1] = SMP_FN_DISCOVER;
+        reqs[(16 * n) + 9] = ppp->phy_id;
+        memset(rrp + n, 0, sizeof(rrp[0]));
+        rrp[n].request_len = 16;
+        rrp[n].request = reqs + (16 * n);
+        rrp[n].max_response_len = PC_DISC_RESP_LEN;
+        rrp[n].response = resps + (PC_DISC_RESP_LEN * n);
+        memset(rrp[n].response, 0, PC_DISC_RESP_LEN);
+        ++n;
+    }
+    if (0 == n)
+        return 0;
+    smp_send_req_batch(top, rrp, n, 0, NULL, NULL, bp->verbose);
+    for (n = 0, k = 0; k < tp->num_phys; ++k) {
+        ppp = tp->phys + k;
+        if (ppp->skip || ppp->up || ((! before) && (! ppp->was_up)))
+            continue;
+        len = rrp[n].act_response_len;
+        if ((len < 0) || (len > PC_DISC_RESP_LEN))
+            len = PC_DISC_RESP_LEN;
+        if (smp_batch_resp_res(rrp + n, SMP_FN_DISCOVER) ||
+            smp_decode_discover(rrp[n].response, len - 4, 0, &dv)) {
+            /* e.g. vacant phy */
+            if (before && bp->all_phys)
+                ppp->skip = true;
+        } else if (before) {
+            ppp->was_up = (dv.neg_log_lrate >= 8);
+            ppp->pre_pcc = dv.phy_change_count;
+            if (bp->all_phys && bp->disruptive && (dv.att_init & SMP_DV_SMP))
+                ppp->skip = true;
+        } else if ((dv.neg_log_lrate >= 8) &&
+                   (dv.phy_change_count != ppp->pre_pcc)) {
+            ppp->up = true;
+            ppp->up_us = smp_stats_clock_us();
+        }
+        ++n;
+    }
+    return 0;
+}
+
+static void
+sleep_ms(int ms)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000;
+    while ((nanosleep(&ts, &ts) < 0) && (EINTR == errno))
+        ;
+}
+
+/* Does all the work for one SMP target: open, find the phys, send the
+ * PHY CONTROL requests and optionally wait for links to come up. */
+static void *
+bulk_worker(void * arg)
+{
+    int k, n, res, waiting;
+    uint64_t start_us;
+    struct pc_tgt_t * tp = (struct pc_tgt_t *)arg;
+    struct pc_bulk_t * bp = tp->bp;
+    struct pc_phy_t * ppp;
+    uint8_t * reqs = NULL;
+    uint8_t * resps = NULL;
+    struct smp_req_resp * rrp = NULL;
+    struct smp_report_general rg;
+    struct smp_target_obj tobj;
+
+    res = smp_initiator_open(tp->dev_name, tp->subvalue, bp->i_params,
+                             tp->sa, &tobj, bp->verbose);
+    if (res < 0) {
+        tp->res = SMP_LIB_FILE_ERROR;
+        return NULL;
+    }
+    if (bp->all_phys) {
+        res = smp_get_report_general(&tobj, &rg, -1, bp->verbose);
+        if (res) {
+            tp->res = (res < 0) ? SMP_LIB_CAT_OTHER : res;
+            goto fini;
+        }
+        tp->num_phys = rg.num_phys;
+        for (k = 0; k < tp->num_phys; ++k)
+            tp->phys[k].phy_id = k;
+    } else {
+        tp->num_phys = bp->num_list;
+        for (k = 0; k < tp->num_phys; ++k)
+            tp->phys[k].phy_id = bp->phy_list[k];
+    }
+    n = (tp->num_phys > 0) ? tp->num_phys : 1;
+    reqs = (uint8_t *)calloc(n, PC_REQ_LEN);
+    resps = (uint8_t *)calloc(n, PC_DISC_RESP_LEN);
+    rrp = (struct smp_req_resp *)calloc(n, sizeof(struct smp_req_resp));
+    if ((NULL == reqs) || (NULL == resps) || (NULL == rrp)) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        tp->res = SMP_LIB_RESOURCE_ERROR;
+        goto fini;
+    }
+    if (bp->all_phys || bp->wait_ms)
+        discover_phys(&tobj, tp, true, reqs, resps, rrp);
+
+    for (n = 0, k = 0; k < tp->num_phys; ++k) {
+        ppp = tp->phys + k;
+        ppp->res = -1;
+        if (ppp->skip)
+            continue;
+        memcpy(reqs + (PC_REQ_LEN * n), bp->req, PC_REQ_LEN);
+        reqs[(PC_REQ_LEN * n) + 9] = ppp->phy_id;
+        rrp[n].request_len = PC_REQ_LEN;
+        rrp[n].request = reqs + (PC_REQ_LEN * n);
+        rrp[n].max_response_len = PC_RESP_LEN;
+        rrp[n].response = resps + (PC_RESP_LEN * n);
+        ++n;
+    }
+    /* index in the callback is into rrp, so order phys to match */
+    for (n = 0, k = 0; k < tp->num_phys; ++k) {
+        if (! tp->phys[k].skip) {
+            if (n != k)
+                tp->phys[n] = tp->phys[k];
+            ++n;
+        }
+    }
+    tp->num_phys = n;
+    smp_send_req_batch(&tobj, rrp, n, 0, ctl_done_cb, tp, bp->verbose);
+    for (waiting = 0, k = 0; k < n; ++k) {
+        ppp = tp->phys + k;
+        ppp->res = smp_batch_resp_res(rrp + k, SMP_FN_PHY_CONTROL);
+        if (ppp->res)
+            ppp->was_up = false;        /* nothing to wait for */
+        else if (ppp->was_up)
+            ++waiting;
+    }
+    if (bp->wait_ms && waiting) {
+        for (start_us = smp_stats_clock_us(); ; ) {
+            sleep_ms(PC_POLL_MS);
+            discover_phys(&tobj, tp, false, reqs, resps, rrp);
+            for (waiting = 0, k = 0; k < n; ++k) {
+                if (tp->phys[k].was_up && (! tp->phys[k].up))
+                    ++waiting;
+            }
+            if ((0 == waiting) || ((smp_stats_clock_us() - start_us) >=
+                                   ((uint64_t)bp->wait_ms * 1000)))
+                break;
+        }
+    }
+fini:
+    free(rrp);
+    free(resps);
+    free(reqs);
+    smp_initiator_close(&tobj);
+    return NULL;
+}
+
+/* Outputs a line per phy, returns the first error seen */
+static int
+output_tgt(const struct pc_tgt_t * tp, const struct pc_bulk_t * bp)
+{
+    int k;
+    int ret = tp->res;
+    const struct pc_phy_t * ppp;
+    char p[SMP_MAX_DEVICE_NAME + 32];
+    char b[128];
+
+    if (tp->sa)
+        snprintf(p, sizeof(p), "%s sa=0x%" PRIx64, tp->dev_name, tp->sa);
+    else
+        snprintf(p, sizeof(p), "%s", tp->dev_name);
+    if (tp->res) {
+        if (SMP_LIB_FILE_ERROR == tp->res)
+            printf("%s: open failed\n", p);
+        else if (SMP_LIB_RESOURCE_ERROR == tp->res)
+            printf("%s: out of memory\n", p);
+        else if ((tp->res > 0) && (tp->res < SMP_LIB_SYNTAX_ERROR))
+            printf("%s: REPORT GENERAL failed: %s\n", p,
+                   smp_get_func_res_str(tp->res, sizeof(b), b));
+        else
+            printf("%s: REPORT GENERAL failed\n", p);
+        return ret;
+    }
+    for (k = 0; k < tp->num_phys; ++k) {
+        ppp = tp->phys + k;
+        printf("%s: phy %3d: ", p, ppp->phy_id);
+        if (0 == ppp->res)
+            printf("ok");
+        else if (ppp->res < 0)
+            printf("request failed");
+        else if (SMP_LIB_CAT_MALFORMED == ppp->res)
+            printf("malformed response");
+        else
+            printf("%s", smp_get_func_res_str(ppp->res, sizeof(b), b));
+        if (ppp->res && (0 == ret))
+            ret = (ppp->res < 0) ? SMP_LIB_CAT_OTHER : ppp->res;
+        if (bp->wait_ms && (0 == ppp->res)) {
+            if (ppp->up)
+                printf(", link up after %" PRIu64 " ms",
+                       (ppp->up_us - ppp->done_us) / 1000);
+            else if (ppp->was_up) {
+                printf(", link not up after %d ms", bp->wait_ms);
+                if (0 == ret)
+                    ret = SMP_LIB_CAT_OTHER;
+            } else
+                printf(", link was down");
+        }
+        printf("\n");
+    }
+    if (bp->all_phys && (bp->verbose || (0 == tp->num_phys)))
+        printf("%s: %d phys sent PHY CONTROL (vacant phys and those "
+               "attached to an\nSMP initiator skipped)\n", p,
+               tp->num_phys);
+    return ret;
+}
+
+static int
+do_bulk(struct pc_bulk_t * bp)
+{
+    int k, res;
+    int ret = 0;
+    struct pc_tgt_t * tp;
+
+    for (k = 0; k < bp->num_tgts; ++k) {
+        tp = bp->tgts + k;
+        tp->thr_ok = (bp->num_tgts > 1) &&
+                     (0 == pthread_create(&tp->thr, NULL, bulk_worker, tp));
+        if (! tp->thr_ok)
+            bulk_worker(tp);
+    }
+    for (k = 0; k < bp->num_tgts; ++k) {
+        tp = bp->tgts + k;
+        if (tp->thr_ok)
+            pthread_join(tp->thr, NULL);
+        res = output_tgt(tp, bp);
+        if (res && (0 == ret))
+            ret = res;
+    }
+    return ret;
+}
+
+static int
+do_single(struct smp_target_obj * top, uint8_t * smp_req, int do_hex,
+          bool do_raw, int verbose)
+{
+    int k, res, len, act_resplen;
+    char * cp;
+    uint8_t smp_resp[PC_RESP_LEN];
+    struct smp_req_resp smp_rr;
+    char b[256];
+
+    if (verbose) {
+        pr2serr("    Phy control request: ");
+        for (k = 0; k < PC_REQ_LEN; ++k) {
+            if (0 == (k % 16))
+                pr2serr("\n      ");
+            else if (0 == (k % 8))
+                pr2serr(" ");
+            pr2serr("%02x ", smp_req[k]);
+        }
+        pr2serr("\n");
+    }
+
+    memset(&smp_rr, 0, sizeof(smp_rr));
+    smp_rr.request_len = PC_REQ_LEN;
+    smp_rr.request = smp_req;
+    smp_rr.max_response_len = sizeof(smp_resp);
+    smp_rr.response = smp_resp;
+    res = smp_send_req(top, &smp_rr, verbose);
+
+    if (res) {
+        pr2serr("smp_send_req failed, res=%d\n", res);
+        if (0 == verbose)
+            pr2serr("    try adding '-v' option for more debug\n");
+        return -1;
+    }
+    if (smp_rr.transport_err) {
+        pr2serr("smp_send_req transport_error=%d\n", smp_rr.transport_err);
+        return -1;
+    }
+    act_resplen = smp_rr.act_response_len;
+    if ((act_resplen >= 0) && (act_resplen < 4)) {
+        pr2serr("response too short, len=%d\n", act_resplen);
+        return SMP_LIB_CAT_MALFORMED;
+    }
+    len = smp_resp[3];
+    if ((0 == len) && (0 == smp_resp[2])) {
+        len = smp_get_func_def_resp_len(smp_resp[1]);
+        if (len < 0) {
+            len = 0;
+            if (verbose > 0)
+                pr2serr("unable to determine response length\n");
+        }
+    }
+    len = 4 + (len * 4);        /* length in bytes, excluding 4 byte CRC */
+    if ((act_resplen >= 0) && (len > act_resplen)) {
+        if (verbose)
+            pr2serr("actual response length [%d] less than deduced length "
+                    "[%d]\n", act_resplen, len);
+        len = act_resplen;
+    }
+    if (do_hex || do_raw) {
+        if (do_hex)
+            hex2stdout(smp_resp, len, 1);
+        else
+            dStrRaw(smp_resp, len);
+        if (SMP_FRAME_TYPE_RESP != smp_resp[0])
+            return SMP_LIB_CAT_MALFORMED;
+        else if (smp_resp[1] != smp_req[1])
+            return SMP_LIB_CAT_MALFORMED;
+        else if (smp_resp[2]) {
+            if (verbose)
+                pr2serr("Phy control result: %s\n",
+                        smp_get_func_res_str(smp_resp[2], sizeof(b), b));
+            return smp_resp[2];
+        }
+        return 0;
+    }
+    if (SMP_FRAME_TYPE_RESP != smp_resp[0]) {
+        pr2serr("expected SMP frame response type, got=0x%x\n", smp_resp[0]);
+        return SMP_LIB_CAT_MALFORMED;
+    }
+    if (smp_resp[1] != smp_req[1]) {
+        pr2serr("Expected function code=0x%x, got=0x%x\n", smp_req[1],
+                smp_resp[1]);
+        return SMP_LIB_CAT_MALFORMED;
+    }
+    if (smp_resp[2]) {
+        cp = smp_get_func_res_str(smp_resp[2], sizeof(b), b);
+        pr2serr("Phy control result: %s\n", cp);
+        return smp_resp[2];
+    }
+    return 0;
+}
+
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_phy_control_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
     bool do_raw = false;
-    int res, c, k, len, act_resplen;
+    int res, c, j, k;
     int expected_cc = 0;
     int do_hex = 0;
     int do_min = 0;
     int do_max = 0;
+    int num_sa = 0;
     int op_val = 0;
     int sas_pa = 0;
     int sas_sl = 0;
     int sata_pa = 0;
     int sata_sl = 0;
     int pptv = -1;
-    int phy_id = 0;
     int pwrdis = 0;
     int ret = 0;
     int subvalue = 0;
     int verbose = 0;
     int64_t sa_ll;
-    uint64_t sa = 0;
     uint64_t adn = 0;
+    uint64_t sa_arr[MAX_SAS_ADDRS];
     char * cp;
     struct smp_val_name * vnp;
+    struct pc_tgt_t * tp;
+    struct pc_bulk_t * bp;
     char i_params[256];
-    char device_name[512];
-    char b[256];
-    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_PHY_CONTROL, 0, 9,
-                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-                         0, 0, 0, 0, 0, 0, 0, 0, };
-    uint8_t smp_resp[8];
-    struct smp_req_resp smp_rr;
+    char device_name[SMP_MAX_DEVICE_NAME];
+    uint8_t smp_req[PC_REQ_LEN] = {SMP_FRAME_TYPE_REQ, SMP_FN_PHY_CONTROL,
+                                   0, 9, };
     struct smp_target_obj tobj;
 
+    bp = (struct pc_bulk_t *)calloc(1, sizeof(struct pc_bulk_t));
+    if (NULL == bp) {
+        pr2serr("heap allocation problem\n");
+        return SMP_LIB_RESOURCE_ERROR;
+    }
+    bp->num_list = 1;           /* default: phy 0 */
     memset(device_name, 0, sizeof device_name);
     memset(i_params, 0, sizeof i_params);
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "a:D:E:hHI:l:L:m:M:o:p:P:q:Q;rs:vV",
+        c = getopt_long(argc, argv, "a:D:E:hHI:l:L:m:M:o:p:P:q:Q;rs:vVw:",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -231,7 +660,8 @@ main(int argc, char * argv[])
            sa_ll = smp_get_llnum_nomult(optarg);
            if (-1LL == sa_ll) {
                 pr2serr("bad argument to '--attached'\n");
-                return SMP_LIB_SYNTAX_ERROR;
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
             }
             adn = (uint64_t)sa_ll;
             break;
@@ -239,20 +669,22 @@ main(int argc, char * argv[])
            pwrdis = smp_get_num(optarg);
            if ((pwrdis < 0) || (pwrdis > 3)) {
                 pr2serr("bad argument to '--pwrdis'\n");
-                return SMP_LIB_SYNTAX_ERROR;
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
             }
             break;
         case 'E':
             expected_cc = smp_get_num(optarg);
             if ((expected_cc < 0) || (expected_cc > 65535)) {
                 pr2serr("bad argument to '--expected'\n");
-                return SMP_LIB_SYNTAX_ERROR;
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
             }
             break;
         case 'h':
         case '?':
             usage();
-            return 0;
+            goto fini;
         case 'H':
             ++do_hex;
             break;
@@ -273,7 +705,8 @@ main(int argc, char * argv[])
             default:
                 pr2serr("bad argument to '--min', want 0, 8, 9, 10, 11 or "
                         "12\n");
-                return SMP_LIB_SYNTAX_ERROR;
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
             }
             break;
         case 'M':
@@ -289,21 +722,24 @@ main(int argc, char * argv[])
             default:
                 pr2serr("bad argument to '--max', want 0, 8, 9, 10, 11 or "
                         "12\n");
-                return SMP_LIB_SYNTAX_ERROR;
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
             }
             break;
         case 'l':
            sas_sl = smp_get_num(optarg);
            if ((sas_sl < 0) || (sas_sl > 3)) {
                 pr2serr("bad argument to '--sas_sl'\n");
-                return SMP_LIB_SYNTAX_ERROR;
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
             }
             break;
         case 'L':
            sata_sl = smp_get_num(optarg);
            if ((sata_sl < 0) || (sata_sl > 3)) {
                 pr2serr("bad argument to '--sata_sl'\n");
-                return SMP_LIB_SYNTAX_ERROR;
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
             }
             break;
         case 'o':
@@ -317,22 +753,31 @@ main(int argc, char * argv[])
                 else {
                     pr2serr("bad argument to '--op'\n");
                     list_op_abbrevs();
-                    return SMP_LIB_SYNTAX_ERROR;
+                    ret = SMP_LIB_SYNTAX_ERROR;
+                    goto fini;
                 }
             } else {
                 op_val = smp_get_num(optarg);
                 if ((op_val < 0) || (op_val > 255)) {
                     pr2serr("bad numeric argument to '--op'\n");
-                    return SMP_LIB_SYNTAX_ERROR;
+                    ret = SMP_LIB_SYNTAX_ERROR;
+                    goto fini;
                 }
             }
             break;
         case 'p':
-           phy_id = smp_get_num(optarg);
-           if ((phy_id < 0) || (phy_id > 254)) {
-                pr2serr("bad argument to '--phy', expect value from 0 to "
-                        "254\n");
-                return SMP_LIB_SYNTAX_ERROR;
+            if (0 == strcmp("all", optarg)) {
+                bp->all_phys = true;
+                break;
+            }
+            bp->all_phys = false;
+            bp->num_list = smp_get_phy_list(optarg, bp->phy_list,
+                                            sizeof(bp->phy_list));
+            if (bp->num_list < 1) {
+                pr2serr("bad argument to '--phy', expect 'all' or a list "
+                        "of values from 0\nto 254 (e.g. '0,4-7')\n");
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
             }
             break;
         case 'P':
@@ -340,21 +785,24 @@ main(int argc, char * argv[])
            if ((pptv < 0) || (pptv > 15)) {
                 pr2serr("bad argument to '--pptv', want value from 0 to 15 "
                         "inclusive\n");
-                return SMP_LIB_SYNTAX_ERROR;
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
             }
             break;
         case 'q':
            sas_pa = smp_get_num(optarg);
            if ((sas_pa < 0) || (sas_pa > 3)) {
                 pr2serr("bad argument to '--sas_pa'\n");
-                return SMP_LIB_SYNTAX_ERROR;
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
             }
             break;
         case 'Q':
            sata_pa = smp_get_num(optarg);
            if ((sata_pa < 0) || (sata_pa > 3)) {
                 pr2serr("bad argument to '--sata_pa'\n");
-                return SMP_LIB_SYNTAX_ERROR;
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
             }
             break;
         case 'r':
@@ -364,54 +812,51 @@ main(int argc, char * argv[])
            sa_ll = smp_get_llnum_nomult(optarg);
            if (-1LL == sa_ll) {
                 pr2serr("bad argument to '--sa'\n");
-                return SMP_LIB_SYNTAX_ERROR;
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
             }
-            sa = (uint64_t)sa_ll;
+            if (num_sa >= MAX_SAS_ADDRS) {
+                pr2serr("'--sa' given more than %d times\n", MAX_SAS_ADDRS);
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+            sa_arr[num_sa++] = (uint64_t)sa_ll;
             break;
         case 'v':
             ++verbose;
             break;
         case 'V':
             pr2serr("version: %s\n", version_str);
-            return 0;
+            goto fini;
+        case 'w':
+            bp->wait_ms = smp_get_num(optarg);
+            if (bp->wait_ms < 1) {
+                pr2serr("bad argument to '--wait', expect milliseconds\n");
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+            break;
         default:
             pr2serr("unrecognised switch code 0x%x ??\n", c);
             usage();
-            return SMP_LIB_SYNTAX_ERROR;
-        }
-    }
-    if (optind < argc) {
-        if ('\0' == device_name[0]) {
-            strncpy(device_name, argv[optind], sizeof(device_name) - 1);
-            device_name[sizeof(device_name) - 1] = '\0';
-            ++optind;
-        }
-        if (optind < argc) {
-            for (; optind < argc; ++optind)
-                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
-            usage();
-            return SMP_LIB_SYNTAX_ERROR;
+            ret = SMP_LIB_SYNTAX_ERROR;
+            goto fini;
         }
     }
-    if (0 == device_name[0]) {
+    if (optind >= argc) {
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == num_sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
-            return SMP_LIB_SYNTAX_ERROR;
+            ret = SMP_LIB_SYNTAX_ERROR;
+            goto fini;
         }
     }
-    if ((cp = strchr(device_name, SMP_SUBVALUE_SEPARATOR))) {
-        *cp = '\0';
-        if (1 != sscanf(cp + 1, "%d", &subvalue)) {
-            pr2serr("expected number after separator in SMP_DEVICE name\n");
-            return SMP_LIB_SYNTAX_ERROR;
-        }
-    }
-    if (0 == sa) {
+    if (0 == num_sa) {
         cp = getenv("SMP_UTILS_SAS_ADDR");
         if (cp) {
            sa_ll = smp_get_llnum_nomult(cp);
@@ -420,27 +865,63 @@ main(int argc, char * argv[])
                         "SMP_UTILS_SAS_ADDR\n    use 0\n");
                 sa_ll = 0;
             }
-            sa = (uint64_t)sa_ll;
+            if (sa_ll)
+                sa_arr[num_sa++] = (uint64_t)sa_ll;
         }
     }
-    if (sa > 0) {
-        if (! smp_is_naa5(sa)) {
+    for (k = 0; k < num_sa; ++k) {
+        if (! smp_is_naa5(sa_arr[k])) {
             pr2serr("SAS (target) address not in naa-5 format (may need "
                     "leading '0x')\n");
             if ('\0' == i_params[0]) {
                 pr2serr("    use '--interface=' to override\n");
-                return SMP_LIB_SYNTAX_ERROR;
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
             }
         }
     }
-
-    res = smp_initiator_open(device_name, subvalue, i_params, sa,
-                             &tobj, verbose);
-    if (res < 0)
-        return SMP_LIB_FILE_ERROR;
+    if (bp->wait_ms && (1 != op_val) && (2 != op_val)) {
+        pr2serr("--wait=MS needs --op=lr or --op=hr\n");
+        ret = SMP_LIB_SYNTAX_ERROR;
+        goto fini;
+    }
+    /* each SMP_DEVICE with each SAS_ADDR given */
+    for (j = optind; (j < argc) || ((j == optind) && (optind >= argc));
+         ++j) {
+        subvalue = 0;
+        if (j < argc)
+            strncpy(device_name, argv[j], sizeof(device_name) - 1);
+        if ((cp = strchr(device_name, SMP_SUBVALUE_SEPARATOR))) {
+            *cp = '\0';
+            if (1 != sscanf(cp + 1, "%d", &subvalue)) {
+                pr2serr("expected number after separator in SMP_DEVICE "
+                        "name\n");
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+        }
+        for (k = 0; k < (num_sa ? num_sa : 1); ++k) {
+            if (bp->num_tgts >= MAX_TARGETS) {
+                pr2serr("more than %d SMP targets\n", MAX_TARGETS);
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+            tp = bp->tgts + bp->num_tgts++;
+            tp->bp = bp;
+            tp->subvalue = subvalue;
+            tp->sa = num_sa ? sa_arr[k] : 0;
+            memcpy(tp->dev_name, device_name, sizeof(tp->dev_name));
+        }
+    }
+    if ((do_hex || do_raw) && ((bp->num_tgts > 1) || bp->all_phys ||
+                               (bp->num_list > 1) || bp->wait_ms)) {
+        pr2serr("--hex and --raw need a single phy and SMP target\n");
+        ret = SMP_LIB_SYNTAX_ERROR;
+        goto fini;
+    }
 
     sg_put_unaligned_be16(expected_cc, smp_req + 4);
-    smp_req[9] = phy_id;
+    smp_req[9] = bp->phy_list[0];
     smp_req[10] = op_val;
     if (pptv >= 0) {
         smp_req[11] |= 1;
@@ -452,101 +933,33 @@ main(int argc, char * argv[])
     smp_req[33] |= (do_max << 4);
     smp_req[34] = (sas_sl << 6) | (sas_pa << 4) | (sata_sl << 2) | sata_pa;
     smp_req[35] = (pwrdis << 6);        /* added spl3r3 */
-    if (verbose) {
-        pr2serr("    Phy control request: ");
-        for (k = 0; k < (int)sizeof(smp_req); ++k) {
-            if (0 == (k % 16))
-                pr2serr("\n      ");
-            else if (0 == (k % 8))
-                pr2serr(" ");
-            pr2serr("%02x ", smp_req[k]);
-        }
-        pr2serr("\n");
-    }
 
-    memset(&smp_rr, 0, sizeof(smp_rr));
-    smp_rr.request_len = sizeof(smp_req);
-    smp_rr.request = smp_req;
-    smp_rr.max_response_len = sizeof(smp_resp);
-    smp_rr.response = smp_resp;
-    res = smp_send_req(&tobj, &smp_rr, verbose);
-
-    if (res) {
-        pr2serr("smp_send_req failed, res=%d\n", res);
-        if (0 == verbose)
-            pr2serr("    try adding '-v' option for more debug\n");
-        ret = -1;
-        goto err_out;
-    }
-    if (smp_rr.transport_err) {
-        pr2serr("smp_send_req transport_error=%d\n", smp_rr.transport_err);
-        ret = -1;
-        goto err_out;
-    }
-    act_resplen = smp_rr.act_response_len;
-    if ((act_resplen >= 0) && (act_resplen < 4)) {
-        pr2serr("response too short, len=%d\n", act_resplen);
-        ret = SMP_LIB_CAT_MALFORMED;
-        goto err_out;
-    }
-    len = smp_resp[3];
-    if ((0 == len) && (0 == smp_resp[2])) {
-        len = smp_get_func_def_resp_len(smp_resp[1]);
-        if (len < 0) {
-            len = 0;
-            if (verbose > 0)
-                pr2serr("unable to determine response length\n");
-        }
-    }
-    len = 4 + (len * 4);        /* length in bytes, excluding 4 byte CRC */
-    if ((act_resplen >= 0) && (len > act_resplen)) {
-        if (verbose)
-            pr2serr("actual response length [%d] less than deduced length "
-                    "[%d]\n", act_resplen, len);
-        len = act_resplen;
-    }
-    if (do_hex || do_raw) {
-        if (do_hex)
-            hex2stdout(smp_resp, len, 1);
-        else
-            dStrRaw(smp_resp, len);
-        if (SMP_FRAME_TYPE_RESP != smp_resp[0])
-            ret = SMP_LIB_CAT_MALFORMED;
-        else if (smp_resp[1] != smp_req[1])
-            ret = SMP_LIB_CAT_MALFORMED;
-        else if (smp_resp[2]) {
-            if (verbose)
-                pr2serr("Phy control result: %s\n",
-                        smp_get_func_res_str(smp_resp[2], sizeof(b), b));
-            ret = smp_resp[2];
-        }
-        goto err_out;
-    }
-    if (SMP_FRAME_TYPE_RESP != smp_resp[0]) {
-        pr2serr("expected SMP frame response type, got=0x%x\n", smp_resp[0]);
-        ret = SMP_LIB_CAT_MALFORMED;
-        goto err_out;
-    }
-    if (smp_resp[1] != smp_req[1]) {
-        pr2serr("Expected function code=0x%x, got=0x%x\n", smp_req[1],
-                smp_resp[1]);
-        ret = SMP_LIB_CAT_MALFORMED;
-        goto err_out;
-    }
-    if (smp_resp[2]) {
-        cp = smp_get_func_res_str(smp_resp[2], sizeof(b), b);
-        pr2serr("Phy control result: %s\n", cp);
-        ret = smp_resp[2];
-        goto err_out;
+    if ((bp->num_tgts > 1) || bp->all_phys || (bp->num_list > 1) ||
+        bp->wait_ms) {
+        bp->req = smp_req;
+        bp->disruptive = ((op_val >= 1) && (op_val <= 3));
+        bp->verbose = verbose;
+        bp->i_params = i_params;
+        ret = do_bulk(bp);
+        goto fini;
     }
 
-err_out:
+    tp = bp->tgts;
+    res = smp_initiator_open(tp->dev_name, tp->subvalue, i_params, tp->sa,
+                             &tobj, verbose);
+    if (res < 0) {
+        ret = SMP_LIB_FILE_ERROR;
+        goto fini;
+    }
+    ret = do_single(&tobj, smp_req, do_hex, do_raw, verbose);
     res = smp_initiator_close(&tobj);
     if (res < 0) {
         pr2serr("close error: %s\n", safe_strerror(errno));
         if (0 == ret)
-            return SMP_LIB_FILE_ERROR;
+            ret = SMP_LIB_FILE_ERROR;
     }
+fini:
+    free(bp);
     if (ret < 0)
         ret = SMP_LIB_CAT_OTHER;
     if (verbose && ret)
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2018, Douglas Gilbert
+ * Copyright (c) 2006-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -33,6 +33,8 @@
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <signal.h>
+#include <time.h>
 #include <getopt.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
@@ -49,12 +51,24 @@
  * utility.
  *
  * This utility issues a PHY TEST FUNCTION function and outputs its response.
+ * Given several phys it sends that function to them together; with
+ * --duration it runs a timed test on them, collecting their error counters.
  */
 
-static const char * version_str = "1.19 20180725"; /* sync with spl5r05 */
+static const char * version_str = "1.21 20261014"; /* sync with spl5r05 */
+
+#define PT_REQ_LEN 44
+#define PT_RESP_LEN 8
+#define PT_EL_REQ_LEN 16
+#define PT_EL_RESP_LEN 32       /* REPORT PHY ERROR LOG, including CRC */
+#define PT_NUM_CNTS 4
+#define SMP_FN_DISCOVER_RESP_LEN 124
+
+static volatile sig_atomic_t got_signal;
 
 static struct option long_options[] = {
     {"control", required_argument, 0, 'c'},
+    {"duration", required_argument, 0, 'D'},
     {"dwords", required_argument, 0, 'd'},
     {"expected", required_argument, 0, 'E'},
     {"function", required_argument, 0, 'f'},
@@ -77,17 +91,23 @@ static struct option long_options[] = {
 static void
 usage(void)
 {
-    pr2serr("Usage: smp_phy_test [--control=CO] [--dwords=DW] "
-            "[--expected=EX]\n"
-            "                    [--function=FN] [--help] [--hex] "
-            "[--interface=PARAMS]\n"
-            "                    [--linkrate=LR] [--pattern=PA] [--phy=ID]\n"
+    pr2serr("Usage: smp_phy_test [--control=CO] [--duration=SECS] "
+            "[--dwords=DW]\n"
+            "                    [--expected=EX] [--function=FN] [--help] "
+            "[--hex]\n"
+            "                    [--interface=PARAMS] [--linkrate=LR] "
+            "[--pattern=PA]\n"
+            "                    [--phy=ID[,ID...]|all]\n"
             "                    [--raw] [--sa=SAS_ADDR] [--sata] "
             "[--spread=Sc]\n"
             "                    [--verbose] [--version] SMP_DEVICE[,N]\n"
             "  where:\n"
             "    --control=CO|-c CO     phy test pattern dwords control "
             "(def: 0)\n"
+            "    --duration=SECS|-D SECS    run test on phy(s) for SECS "
+            "seconds, then\n"
+            "                               stop it and show error counter "
+            "deltas\n"
             "    --dwords=DW|-d DW      phy test pattern dwords (def:0)\n"
             "    --expected=EX|-E EX    set expected expander change count "
             "to EX\n"
@@ -100,7 +120,12 @@ usage(void)
             "6 Gbps)\n"
             "    --pattern=PA|-P PA     phy test pattern (def: 2 -> "
             "CJTPAT)\n"
-            "    --phy=ID|-p ID         phy identifier (def: 0)\n"
+            "    --phy=ID|-p ID         phy identifier (def: 0); a list "
+            "(e.g. '0,4-7')\n"
+            "                           or 'all' sends to those phys "
+            "together\n"
+            "                           ('all' skips phys on the SMP "
+            "path)\n"
             "    --raw|-r               output response in binary\n"
             "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of SMP "
             "target (use leading\n"
@@ -119,6 +144,12 @@ usage(void)
            );
 }
 
+static void
+sig_handler(int sig)
+{
+    got_signal = sig;
+}
+
 static void
 dStrRaw(const uint8_t * str, int len)
 {
@@ -129,9 +160,374 @@ dStrRaw(const uint8_t * str, int len)
 }
 
 
+/* Multiple phys (or --duration): the PHY TEST FUNCTION requests, one per
+ * phy, are sent together with smp_send_req_batch(). With a duration each
+ * phy's REPORT PHY ERROR LOG counters are swept (also in one batch) before
+ * the tests start and again once the duration has passed (or a signal is
+ * caught), then the tests are stopped. With --phy=all the phys are first
+ * discovered so that those that may carry the SMP path from this initiator
+ * are left alone: a test pattern would take that link down, and with it
+ * the error log sweep and the stop. */
+
+struct pt_phy_t {
+    bool skip;          /* vacant or path phy with --phy=all */
+    bool path;          /* may carry our SMP path, see skip_path_phys() */
+    bool base_ok;
+    bool cnt_ok;
+    uint8_t phy_id;
+    int res;            /* of PHY TEST FUNCTION start */
+    int stop_res;
+    uint32_t base[PT_NUM_CNTS];
+    uint32_t cnt[PT_NUM_CNTS];
+};
+
+struct pt_run_t {
+    int num_phys;
+    int verbose;
+    uint8_t * reqs;
+    uint8_t * resps;
+    struct smp_req_resp * rrp;
+    struct pt_phy_t * phys;
+};
+
+/* Sweeps REPORT PHY ERROR LOG over the phys not skipped. With 'before' set
+ * fills in their base counters (and with all_phys skips phys that fail,
+ * e.g. because they are vacant), else their current counters. */
+static void
+sweep_err_log(struct smp_target_obj * top, struct pt_run_t * rp, bool before,
+              bool all_phys)
+{
+    int k, n, len;
+    uint8_t * bp;
+    struct pt_phy_t * ppp;
+
+    for (n = 0, k = 0; k < rp->num_phys; ++k) {
+        ppp = rp->phys + k;
+        if (ppp->skip || ((! before) && (0 != ppp->res)))
+            continue;
+        bp = rp->reqs + (PT_REQ_LEN * n);
+        memset(bp, 0, PT_EL_REQ_LEN);
+        bp[0] = SMP_FRAME_TYPE_REQ;
+        bp[1] = SMP_FN_REPORT_PHY_ERR_LOG;
+        bp[9] = ppp->phy_id;
+        memset(rp->rrp + n, 0, sizeof(rp->rrp[0]));
+        rp->rrp[n].request_len = PT_EL_REQ_LEN;
+        rp->rrp[n].request = bp;
+        rp->rrp[n].max_response_len = PT_EL_RESP_LEN;
+        rp->rrp[n].response = rp->resps + (PT_EL_RESP_LEN * n);
+        memset(rp->rrp[n].response, 0, PT_EL_RESP_LEN);
+        ++n;
+    }
+    if (0 == n)
+        return;
+    smp_send_req_batch(top, rp->rrp, n, 0, NULL, NULL, rp->verbose);
+    for (n = 0, k = 0; k < rp->num_phys; ++k) {
+        ppp = rp->phys + k;
+        if (ppp->skip || ((! before) && (0 != ppp->res)))
+            continue;
+        bp = rp->rrp[n].response;
+        len = rp->rrp[n].act_response_len;
+        if (smp_batch_resp_res(rp->rrp + n, SMP_FN_REPORT_PHY_ERR_LOG) ||
+            ((len >= 0) && (len < 28))) {
+            if (before && all_phys)
+                ppp->skip = true;
+        } else {
+            uint32_t * cp = before ? ppp->base : ppp->cnt;
+            int j;
+
+            for (j = 0; j < PT_NUM_CNTS; ++j)
+                cp[j] = sg_get_unaligned_be32(bp + 12 + (4 * j));
+            if (before)
+                ppp->base_ok = true;
+            else
+                ppp->cnt_ok = true;
+        }
+        ++n;
+    }
+}
+
+/* Sends the PHY TEST FUNCTION request in tmpl, with phy test function
+ * 'func', to the phys not skipped (only to those whose test started when
+ * stopping). Results go in each phy's res (or stop_res). */
+static void
+send_test(struct smp_target_obj * top, struct pt_run_t * rp,
+          const uint8_t * tmpl, int func, bool stopping)
+{
+    int k, n;
+    uint8_t * bp;
+    struct pt_phy_t * ppp;
+
+    for (n = 0, k = 0; k < rp->num_phys; ++k) {
+        ppp = rp->phys + k;
+        if (ppp->skip || (stopping && (0 != ppp->res)))
+            continue;
+        bp = rp->reqs + (PT_REQ_LEN * n);
+        memcpy(bp, tmpl, PT_REQ_LEN);
+        bp[9] = ppp->phy_id;
+        bp[10] = func;
+        memset(rp->rrp + n, 0, sizeof(rp->rrp[0]));
+        rp->rrp[n].request_len = PT_REQ_LEN;
+        rp->rrp[n].request = bp;
+        rp->rrp[n].max_response_len = PT_RESP_LEN;
+        rp->rrp[n].response = rp->resps + (PT_EL_RESP_LEN * n);
+        memset(rp->rrp[n].response, 0, PT_RESP_LEN);
+        ++n;
+    }
+    if (0 == n)
+        return;
+    smp_send_req_batch(top, rp->rrp, n, 0, NULL, NULL, rp->verbose);
+    for (n = 0, k = 0; k < rp->num_phys; ++k) {
+        ppp = rp->phys + k;
+        if (ppp->skip || (stopping && (0 != ppp->res)))
+            continue;
+        if (stopping)
+            ppp->stop_res = smp_batch_resp_res(rp->rrp + n,
+                                           SMP_FN_PHY_TEST_FUNCTION);
+        else
+            ppp->res = smp_batch_resp_res(rp->rrp + n,
+                                          SMP_FN_PHY_TEST_FUNCTION);
+        ++n;
+    }
+}
+
+/* With --phy=all: DISCOVERs every phy, as one batch, and skips those that
+ * are vacant and those that may carry the SMP path from this initiator.
+ * Those are phys attached to an SMP initiator (the HBA, or an expander),
+ * subtractive phys (the way towards the initiator in a tree) and the other
+ * phys of the wide ports they belong to. If a phy that is not vacant
+ * can't be discovered --phy=all is refused, a list of phys is needed then.
+ * Returns 0, else an SMP_LIB_ error code or an SMP function result. */
+static int
+skip_path_phys(struct smp_target_obj * top, struct pt_run_t * rp)
+{
+    int k, j, len, res;
+    int ret = 0;
+    uint8_t * bufs;
+    uint8_t * qp;
+    uint64_t * att_sa;
+    struct smp_req_resp * rrp;
+    struct smp_discover_view dv;
+
+    bufs = (uint8_t *)calloc(rp->num_phys, 16 + SMP_FN_DISCOVER_RESP_LEN);
+    rrp = (struct smp_req_resp *)calloc(rp->num_phys, sizeof(*rrp));
+    att_sa = (uint64_t *)calloc(rp->num_phys, sizeof(uint64_t));
+    if ((NULL == bufs) || (NULL == rrp) || (NULL == att_sa)) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        free(att_sa);
+        free(rrp);
+        free(bufs);
+        return SMP_LIB_RESOURCE_ERROR;
+    }
+    for (k = 0; k < rp->num_phys; ++k) {
+        qp = bufs + (16 * k);
+        qp[0] = SMP_FRAME_TYPE_REQ;
+        qp[1] = SMP_FN_DISCOVER;
+        qp[9] = rp->phys[k].phy_id;
+        rrp[k].request_len = 16;
+        rrp[k].request = qp;
+        rrp[k].max_response_len = SMP_FN_DISCOVER_RESP_LEN;
+        rrp[k].response = bufs + (16 * rp->num_phys) +
+                          (SMP_FN_DISCOVER_RESP_LEN * k);
+    }
+    smp_send_req_batch(top, rrp, rp->num_phys, 0, NULL, NULL, rp->verbose);
+    for (k = 0; k < rp->num_phys; ++k) {
+        len = rrp[k].act_response_len;
+        if ((len < 0) || (len > SMP_FN_DISCOVER_RESP_LEN))
+            len = SMP_FN_DISCOVER_RESP_LEN;
+        res = smp_batch_resp_res(rrp + k, SMP_FN_DISCOVER);
+        if (SMP_FRES_PHY_VACANT == res) {
+            rp->phys[k].skip = true;
+            continue;
+        }
+        if (res || smp_decode_discover(rrp[k].response, len - 4, 0, &dv)) {
+            pr2serr("DISCOVER of phy %d failed, can't tell whether it "
+                    "carries the SMP path;\nrefusing --phy=all, give a "
+                    "list of phys instead\n", rp->phys[k].phy_id);
+            ret = (res > 0) ? res : SMP_LIB_CAT_OTHER;
+            goto fini;
+        }
+        if (0 == dv.att_dev_type) {
+            rp->phys[k].skip = true;    /* nothing attached */
+            continue;
+        }
+        att_sa[k] = dv.att_sas_addr;
+        if ((dv.att_init & SMP_DV_SMP) || (1 == dv.routing_attr))
+            rp->phys[k].path = true;
+    }
+    /* the rest of a path phy's wide port */
+    for (k = 0; k < rp->num_phys; ++k) {
+        if (! rp->phys[k].path)
+            continue;
+        for (j = 0; j < rp->num_phys; ++j) {
+            if (att_sa[k] && (att_sa[j] == att_sa[k]))
+                rp->phys[j].path = true;
+        }
+    }
+    for (k = 0; k < rp->num_phys; ++k) {
+        if (rp->phys[k].path) {
+            rp->phys[k].skip = true;
+            if (rp->verbose)
+                pr2serr("phy %d may carry the SMP path, skipped\n",
+                        rp->phys[k].phy_id);
+        }
+    }
+fini:
+    free(att_sa);
+    free(rrp);
+    free(bufs);
+    return ret;
+}
+
+/* Waits duration_s seconds or until SIGINT or SIGTERM is caught. Returns
+ * the number of milliseconds waited. */
+static int
+wait_duration(int duration_s)
+{
+    int res;
+    struct timespec dl, now;
+    struct sigaction sa, old_int, old_term;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sig_handler;
+    sigemptyset(&sa.sa_mask);
+    got_signal = 0;
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    dl = now;
+    dl.tv_sec += duration_s;
+    while ((res = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &dl,
+                                  NULL)) && (EINTR == res) && (! got_signal))
+        ;
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &dl);
+    return (int)(((dl.tv_sec - now.tv_sec) * 1000) +
+                 ((dl.tv_nsec - now.tv_nsec) / 1000000));
+}
+
+static uint32_t
+cnt_delta(uint32_t before, uint32_t after)
+{
+    /* counters saturate; one that went backwards was cleared meanwhile */
+    return (after >= before) ? (after - before) : after;
+}
+
+/* Runs the phy test function in tmpl on the phys in phy_list (num_list of
+ * them) or, with all_phys, on all the phys of the SMP target. Returns 0 if
+ * every phy's test started (and stopped), else the first non-zero phy
+ * result or one of the SMP_LIB_ error codes. */
+static int
+do_multi(struct smp_target_obj * top, const uint8_t * tmpl,
+         const uint8_t * phy_list, int num_list, bool all_phys,
+         int duration_s, int verbose)
+{
+    int k, j, n, res, waited_ms;
+    int ret = 0;
+    struct pt_phy_t * ppp;
+    struct smp_report_general rg;
+    struct pt_run_t run;
+    char b[128];
+    static const char * cnt_names[PT_NUM_CNTS] = {
+        "invalid dwords", "disparity", "loss of sync", "reset problems"};
+
+    memset(&run, 0, sizeof(run));
+    run.verbose = verbose;
+    if (all_phys) {
+        res = smp_get_report_general(top, &rg, -1, verbose);
+        if (res)
+            return (res < 0) ? SMP_LIB_CAT_OTHER : res;
+        run.num_phys = rg.num_phys;
+    } else
+        run.num_phys = num_list;
+    n = (run.num_phys > 0) ? run.num_phys : 1;
+    run.reqs = (uint8_t *)calloc(n, PT_REQ_LEN);
+    run.resps = (uint8_t *)calloc(n, PT_EL_RESP_LEN);
+    run.rrp = (struct smp_req_resp *)calloc(n, sizeof(struct smp_req_resp));
+    run.phys = (struct pt_phy_t *)calloc(n, sizeof(struct pt_phy_t));
+    if ((NULL == run.reqs) || (NULL == run.resps) || (NULL == run.rrp) ||
+        (NULL == run.phys)) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        ret = SMP_LIB_RESOURCE_ERROR;
+        goto fini;
+    }
+    for (k = 0; k < run.num_phys; ++k) {
+        run.phys[k].phy_id = all_phys ? k : phy_list[k];
+        run.phys[k].res = -1;
+        run.phys[k].stop_res = -1;
+    }
+    if (all_phys && tmpl[10] && ((ret = skip_path_phys(top, &run))))
+        goto fini;
+    if (duration_s)
+        sweep_err_log(top, &run, true, all_phys);
+    send_test(top, &run, tmpl, tmpl[10], false);
+    if (duration_s) {
+        for (n = 0, k = 0; k < run.num_phys; ++k)
+            n += (0 == run.phys[k].res);
+        if (n > 0) {
+            if (verbose)
+                pr2serr("Phy test function started on %d phy%s, waiting "
+                        "%d seconds\n", n, (1 == n) ? "" : "s", duration_s);
+            waited_ms = wait_duration(duration_s);
+            if (got_signal)
+                pr2serr("Interrupted after %d ms, stopping tests\n",
+                        waited_ms);
+            sweep_err_log(top, &run, false, all_phys);
+            send_test(top, &run, tmpl, 0 /* stop */, true);
+        }
+    }
+    for (k = 0; k < run.num_phys; ++k) {
+        ppp = run.phys + k;
+        if (ppp->path)
+            printf("phy %3d: skipped, may carry the SMP path from this "
+                   "initiator\n", ppp->phy_id);
+        if (ppp->skip)
+            continue;
+        printf("phy %3d: ", ppp->phy_id);
+        if (ppp->res) {
+            printf("%s\n", (ppp->res < 0) ? "request failed" :
+                   smp_get_func_res_str(ppp->res, sizeof(b), b));
+            if (0 == ret)
+                ret = ppp->res;
+            continue;
+        }
+        if (0 == duration_s) {
+            printf("ok\n");
+            continue;
+        }
+        if (ppp->base_ok && ppp->cnt_ok) {
+            for (j = 0; j < PT_NUM_CNTS; ++j)
+                printf("%s%s: %u", (j ? ", " : ""), cnt_names[j],
+                       cnt_delta(ppp->base[j], ppp->cnt[j]));
+            printf("\n");
+        } else
+            printf("error counters not available\n");
+        if (ppp->stop_res) {
+            printf("         stop: %s\n", (ppp->stop_res < 0) ?
+                   "request failed" :
+                   smp_get_func_res_str(ppp->stop_res, sizeof(b), b));
+            if (0 == ret)
+                ret = ppp->stop_res;
+        }
+    }
+fini:
+    free(run.phys);
+    free(run.rrp);
+    free(run.resps);
+    free(run.reqs);
+    return ret;
+}
+
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_phy_test_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
+    bool all_phys = false;
     bool do_raw = false;
     bool do_sata = false;
     int res, c, k, len, act_resplen;
@@ -140,9 +536,10 @@ main(int argc, char * argv[])
     int do_function = 0;
     int do_hex = 0;
     int do_ssc = 0;
+    int duration_s = 0;
     int linkrate = 0xa;   /* 6 Gbps */
     int pattern = 2;    /* CJTPAT */
-    int phy_id = 0;
+    int num_list = 1;
     int ret = 0;
     int subvalue = 0;
     int verbose = 0;
@@ -153,6 +550,7 @@ main(int argc, char * argv[])
     char i_params[256];
     char device_name[512];
     char b[256];
+    uint8_t phy_list[256];
     uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_PHY_TEST_FUNCTION, 0, 9,
                          0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
                          0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -163,10 +561,11 @@ main(int argc, char * argv[])
 
     memset(device_name, 0, sizeof device_name);
     memset(i_params, 0, sizeof i_params);
+    phy_list[0] = 0;
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "c:d:E:f:hHI:l:p:P:rs:S:tvV",
+        c = getopt_long(argc, argv, "c:d:D:E:f:hHI:l:p:P:rs:S:tvV",
                         long_options, &option_index);
         if (c == -1)
             break;
@@ -192,6 +591,14 @@ main(int argc, char * argv[])
                 dwords = (uint64_t)sa_ll;
             }
             break;
+        case 'D':
+            duration_s = smp_get_num(optarg);
+            if (duration_s < 1) {
+                pr2serr("bad argument to '--duration', expect a number of "
+                        "seconds\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'E':
             expected_cc = smp_get_num(optarg);
             if ((expected_cc < 0) || (expected_cc > 65535)) {
@@ -227,10 +634,15 @@ main(int argc, char * argv[])
             }
             break;
         case 'p':
-            phy_id = smp_get_num(optarg);
-            if ((phy_id < 0) || (phy_id > 254)) {
-                pr2serr("bad argument to '--phy', expect value from 0 to "
-                        "254\n");
+            if (0 == strcmp("all", optarg)) {
+                all_phys = true;
+                break;
+            }
+            all_phys = false;
+            num_list = smp_get_phy_list(optarg, phy_list, sizeof(phy_list));
+            if (num_list < 1) {
+                pr2serr("bad argument to '--phy', expect 'all' or a list "
+                        "of values from 0\nto 254 (e.g. '0,4-7')\n");
                 return SMP_LIB_SYNTAX_ERROR;
             }
             break;
@@ -293,9 +705,10 @@ main(int argc, char * argv[])
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -330,13 +743,20 @@ main(int argc, char * argv[])
         }
     }
 
+    if (duration_s && (0 == do_function))
+        do_function = 1;        /* transmit pattern, stop is done after */
+    if ((all_phys || (num_list > 1) || duration_s) && (do_hex || do_raw)) {
+        pr2serr("--hex and --raw need a single phy and no --duration\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
+
     res = smp_initiator_open(device_name, subvalue, i_params, sa,
                              &tobj, verbose);
     if (res < 0)
         return SMP_LIB_FILE_ERROR;
 
     sg_put_unaligned_be16(expected_cc, smp_req + 4);
-    smp_req[9] = phy_id;
+    smp_req[9] = phy_list[0];
     smp_req[10] = do_function;
     smp_req[11] = pattern;
     smp_req[15] = linkrate & 0xf;
@@ -356,6 +776,11 @@ main(int argc, char * argv[])
         }
         pr2serr("\n");
     }
+    if (all_phys || (num_list > 1) || duration_s) {
+        ret = do_multi(&tobj, smp_req, phy_list, num_list, all_phys,
+                       duration_s, verbose);
+        goto err_out;
+    }
 
     memset(&smp_rr, 0, sizeof(smp_rr));
     smp_rr.request_len = sizeof(smp_req);
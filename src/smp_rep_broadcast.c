@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2011-2018, Douglas Gilbert
+ * Copyright (c) 2011-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -33,9 +33,14 @@
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <inttypes.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -48,11 +53,19 @@
  * utility.
  *
  * This utility issues a REPORT BROADCAST function and outputs its response.
+ * With --monitor it polls REPORT GENERAL and REPORT BROADCAST, sends
+ * DISCOVER only to those phys that changed and outputs one event per phy
+ * change.
  */
 
-static const char * version_str = "1.09 20180725";
+static const char * version_str = "1.10 20261014";
 
 #define SMP_FN_REPORT_BROADCAST_RESP_LEN (1020 + 4 + 4)
+#define SMP_FN_DISCOVER_RESP_LEN 124
+#define SMP_FN_DISCOVER_LIST_RESP_LEN 1028
+#define MAX_DLIST_SHORT_DESCS 40
+#define MAX_PHY_ID 254
+#define DEF_INTERVAL_MS 1000
 
 static const char * broadcast_type_name[] = {
     "Broadcast (Change)",               /* 0x0 */
@@ -66,13 +79,42 @@ static const char * broadcast_type_name[] = {
     "Broadcast (Zone activate)",        /* 0x8 */
 };
 
+/* State kept by --monitor between polls */
+struct mon_t {
+    bool have_bcast;            /* REPORT BROADCAST supported */
+    bool have_dlist;            /* DISCOVER LIST supported */
+    int num_phys;
+    int exp_cc;
+    int interval_ms;
+    int count;                  /* number of polls, 0 -> until signalled */
+    int verbose;
+    int num_events;
+    int num_discovers;
+    int bcast_cnt[MAX_PHY_ID + 1];
+    bool stale[MAX_PHY_ID + 1];
+    struct smp_discover_view dv[MAX_PHY_ID + 1];
+    FILE * fp;                  /* events in text form go here */
+    struct smp_emit * emp;      /* else --json or --csv */
+    uint8_t * reqs;
+    uint8_t * resps;
+    struct smp_req_resp * rrp;
+};
+
+static volatile sig_atomic_t got_signal;
+
 static struct option long_options[] = {
     {"broadcast", required_argument, 0, 'b'},
+    {"count", required_argument, 0, 'c'},
+    {"csv", no_argument, 0, 'x'},
     {"help", no_argument, 0, 'h'},
     {"hex", no_argument, 0, 'H'},
     {"interface", required_argument, 0, 'I'},
+    {"interval", required_argument, 0, 'i'},
+    {"json", no_argument, 0, 'j'},
+    {"monitor", no_argument, 0, 'm'},
     {"raw", no_argument, 0, 'r'},
     {"sa", required_argument, 0, 's'},
+    {"unix", required_argument, 0, 'u'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
     {0, 0, 0, 0},
@@ -82,19 +124,35 @@ static struct option long_options[] = {
 static void
 usage(void)
 {
-    pr2serr("Usage: smp_rep_broadcast [--broadcast=BT] [--help] [--hex]\n"
-            "                         [--interface=PARAMS] [raw] "
+    pr2serr("Usage: smp_rep_broadcast [--broadcast=BT] [--count=CO] [--csv] "
+            "[--help]\n"
+            "                         [--hex] [--interface=PARAMS] "
+            "[--interval=MS]\n"
+            "                         [--json] [--monitor] [raw] "
             "[--sa=SAS_ADDR]\n"
-            "                         [--verbose] [--version] "
+            "                         [--unix=PATH] [--verbose] [--version] "
             "SMP_DEVICE[,N]\n"
             "  where:\n"
             "    --broadcast=RT|-b RT    RT is report type (def: 0 "
             "which is\n"
             "                            Broadcast(Change))\n"
+            "    --count=CO|-c CO        with --monitor: poll CO times "
+            "(def: 0 -> until\n"
+            "                            interrupted)\n"
+            "    --csv|-x                with --monitor: output events as "
+            "CSV\n"
             "    --help|-h               print out usage message\n"
             "    --hex|-H                print response in hexadecimal\n"
             "    --interface=PARAMS|-I PARAMS    specify or override "
             "interface\n"
+            "    --interval=MS|-i MS     with --monitor: poll every MS "
+            "milliseconds\n"
+            "                            (def: 1000)\n"
+            "    --json|-j               with --monitor: output events as "
+            "JSON lines\n"
+            "    --monitor|-m            poll for changes, rediscover "
+            "changed phys and\n"
+            "                            output an event for each\n"
             "    --raw|-r                output response in binary\n"
             "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of SMP "
             "target (use leading\n"
@@ -102,6 +160,9 @@ usage(void)
             "Depending\n"
             "                                 on the interface, may not be "
             "needed\n"
+            "    --unix=PATH|-u PATH     with --monitor: send events to unix "
+            "socket\n"
+            "                            PATH rather than stdout\n"
             "    --verbose|-v            increase verbosity\n"
             "    --version|-V            print version string and exit\n\n"
             "Performs a SMP REPORT BROADCAST function\n"
@@ -133,11 +194,399 @@ get_broadcast_type_str(int bt_num, int b_len, char * b)
 }
 
 
+static void
+sig_handler(int sig)
+{
+    got_signal = sig;
+}
+
+static uint64_t
+real_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+static const char * att_dev_type_name[] = {
+    "none", "end device", "expander", "fanout expander", "reserved [4]",
+    "reserved [5]", "reserved [6]", "reserved [7]",
+};
+
+/* Fetches the Broadcast (Change) counts into cnt_arr (indexed by phy id,
+ * unchanged for phys without a descriptor). Returns 0 if ok, the function
+ * result, or -1 . */
+static int
+fetch_bcast(struct smp_target_obj * top, int * cnt_arr, const struct mon_t * mp)
+{
+    int k, res, len, bd_len, num_bd;
+    const uint8_t * bdp;
+    uint8_t * rp = mp->resps;
+    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_REPORT_BROADCAST, 0, 1,
+                         0, 0, 0, 0, 0, 0, 0, 0};
+    struct smp_req_resp smp_rr;
+
+    len = (SMP_FN_REPORT_BROADCAST_RESP_LEN - 8) / 4;
+    smp_req[2] = (len < 0x100) ? len : 0xff;
+    memset(&smp_rr, 0, sizeof(smp_rr));
+    smp_rr.request_len = sizeof(smp_req);
+    smp_rr.request = smp_req;
+    smp_rr.max_response_len = SMP_FN_REPORT_BROADCAST_RESP_LEN;
+    smp_rr.response = rp;
+    res = smp_send_req(top, &smp_rr, mp->verbose);
+    if (res || smp_rr.transport_err)
+        return -1;
+    if (((smp_rr.act_response_len >= 0) && (smp_rr.act_response_len < 12)) ||
+        (SMP_FRAME_TYPE_RESP != rp[0]) || (rp[1] != smp_req[1]))
+        return SMP_LIB_CAT_MALFORMED;
+    if (rp[2])
+        return rp[2];
+    len = 4 + (4 * rp[3]);
+    if ((smp_rr.act_response_len >= 0) && (len > smp_rr.act_response_len))
+        len = smp_rr.act_response_len;
+    bd_len = rp[10] * 4;
+    num_bd = rp[11];
+    if ((bd_len < 8) || (len < (12 + (num_bd * bd_len))))
+        return (0 == num_bd) ? 0 : SMP_LIB_CAT_MALFORMED;
+    for (k = 0, bdp = rp + 12; k < num_bd; ++k, bdp += bd_len) {
+        if ((0 == (bdp[0] & 0xf)) && (bdp[1] <= MAX_PHY_ID))
+            cnt_arr[bdp[1]] = sg_get_unaligned_be16(bdp + 4);
+    }
+    return 0;
+}
+
+/* Marks as stale those phys whose phy change count in a DISCOVER LIST
+ * (short descriptors) differs from the last DISCOVER of that phy. Returns
+ * 0 if ok, else -1 . */
+static int
+mark_by_dlist(struct smp_target_obj * top, struct mon_t * mp)
+{
+    int j, res, len, sphy, ndesc, desc_len;
+    const uint8_t * dp;
+    uint8_t * rp = mp->resps;
+    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_DISCOVER_LIST, 0, 6,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                         0, 0, 0, 0, };
+    struct smp_req_resp smp_rr;
+
+    for (sphy = 0; sphy < mp->num_phys; sphy += ndesc) {
+        memset(rp, 0, SMP_FN_DISCOVER_LIST_RESP_LEN);
+        smp_req[2] = 0xff;
+        smp_req[8] = sphy;
+        smp_req[9] = MAX_DLIST_SHORT_DESCS;
+        smp_req[11] = 1;                /* short format */
+        memset(&smp_rr, 0, sizeof(smp_rr));
+        smp_rr.request_len = sizeof(smp_req);
+        smp_rr.request = smp_req;
+        smp_rr.max_response_len = SMP_FN_DISCOVER_LIST_RESP_LEN;
+        smp_rr.response = rp;
+        res = smp_send_req(top, &smp_rr, mp->verbose);
+        if (res || smp_rr.transport_err ||
+            ((smp_rr.act_response_len >= 0) &&
+             (smp_rr.act_response_len < 48)) ||
+            (SMP_FRAME_TYPE_RESP != rp[0]) || (rp[1] != smp_req[1]) || rp[2])
+            return -1;
+        len = 4 + (4 * rp[3]);
+        if ((smp_rr.act_response_len >= 0) &&
+            (len > smp_rr.act_response_len))
+            len = smp_rr.act_response_len;
+        ndesc = rp[9];
+        desc_len = rp[12] * 4;
+        if ((0 == ndesc) || (desc_len < 12) ||
+            (len < (48 + (ndesc * desc_len))))
+            return -1;
+        for (j = 0, dp = rp + 48; j < ndesc; ++j, dp += desc_len) {
+            if ((dp[0] < mp->num_phys) &&
+                (dp[1] != mp->dv[dp[0]].func_res ||
+                 (dp[11] != mp->dv[dp[0]].phy_change_count)))
+                mp->stale[dp[0]] = true;
+        }
+    }
+    return 0;
+}
+
+/* Outputs one event: phy of the expander changed from op to np */
+static void
+emit_event(struct mon_t * mp, const struct smp_discover_view * op,
+           const struct smp_discover_view * np)
+{
+    const char * ev;
+
+    if ((0 == op->att_dev_type) && np->att_dev_type)
+        ev = "attached";
+    else if (op->att_dev_type && (0 == np->att_dev_type))
+        ev = "removed";
+    else if (op->att_sas_addr != np->att_sas_addr)
+        ev = "replaced";
+    else
+        ev = "changed";
+    ++mp->num_events;
+    if (mp->emp) {
+        smp_emit_rec_begin(mp->emp);
+        smp_emit_int(mp->emp, "time_ms", real_ms());
+        smp_emit_str(mp->emp, "event", ev);
+        smp_emit_int(mp->emp, "previous_attached_device_type",
+                     op->att_dev_type);
+        smp_emit_hex64(mp->emp, "previous_attached_sas_address",
+                       op->att_sas_addr);
+        smp_emit_int(mp->emp, "previous_phy_change_count",
+                     op->phy_change_count);
+        smp_emit_discover(mp->emp, np);
+        smp_emit_rec_end(mp->emp);
+        return;
+    }
+    fprintf(mp->fp, "%" PRIu64 " 0x%" PRIx64 " phy %d %s: %s 0x%" PRIx64,
+            real_ms(), np->sas_addr, np->phy_id, ev,
+            att_dev_type_name[np->att_dev_type & 0x7], np->att_sas_addr);
+    if (op->att_sas_addr != np->att_sas_addr)
+        fprintf(mp->fp, " (was %s 0x%" PRIx64 ")",
+                att_dev_type_name[op->att_dev_type & 0x7],
+                op->att_sas_addr);
+    fprintf(mp->fp, ", link rate 0x%x, phy change count %d -> %d\n",
+            np->neg_log_lrate, op->phy_change_count, np->phy_change_count);
+}
+
+/* Sends DISCOVER, as one batch, to each stale phy. Unless 'quiet', outputs
+ * an event for each phy whose attached device, link rate or phy change
+ * count moved. */
+static void
+rediscover(struct smp_target_obj * top, struct mon_t * mp, bool quiet)
+{
+    int k, n, len;
+    struct smp_discover_view dv;
+
+    for (n = 0, k = 0; k < mp->num_phys; ++k) {
+        if (! mp->stale[k])
+            continue;
+        memset(mp->reqs + (16 * n), 0, 16);
+        mp->reqs[16 * n] = SMP_FRAME_TYPE_REQ;
+        mp->reqs[(16 * n) + 1] = SMP_FN_DISCOVER;
+        mp->reqs[(16 * n) + 9] = k;
+        memset(mp->rrp + n, 0, sizeof(mp->rrp[0]));
+        mp->rrp[n].request_len = 16;
+        mp->rrp[n].request = mp->reqs + (16 * n);
+        mp->rrp[n].max_response_len = SMP_FN_DISCOVER_RESP_LEN;
+        mp->rrp[n].response = mp->resps + (SMP_FN_DISCOVER_RESP_LEN * n);
+        memset(mp->rrp[n].response, 0, SMP_FN_DISCOVER_RESP_LEN);
+        ++n;
+    }
+    if (0 == n)
+        return;
+    smp_send_req_batch(top, mp->rrp, n, 0, NULL, NULL, mp->verbose);
+    mp->num_discovers += n;
+    for (n = 0, k = 0; k < mp->num_phys; ++k) {
+        if (! mp->stale[k])
+            continue;
+        mp->stale[k] = false;
+        len = mp->rrp[n].act_response_len;
+        if ((len < 0) || (len > SMP_FN_DISCOVER_RESP_LEN))
+            len = SMP_FN_DISCOVER_RESP_LEN;
+        memset(&dv, 0, sizeof(dv));
+        if (mp->rrp[n].transport_err ||
+            smp_decode_discover(mp->rrp[n].response, len - 4, 0, &dv)) {
+            /* e.g. vacant phy: keep its function result */
+            dv.phy_id = k;
+            dv.func_res = mp->rrp[n].response[2];
+        }
+        ++n;
+        if ((! quiet) &&
+            ((dv.att_dev_type != mp->dv[k].att_dev_type) ||
+             (dv.att_sas_addr != mp->dv[k].att_sas_addr) ||
+             (dv.neg_log_lrate != mp->dv[k].neg_log_lrate) ||
+             (dv.phy_change_count != mp->dv[k].phy_change_count)))
+            emit_event(mp, mp->dv + k, &dv);
+        mp->dv[k] = dv;
+    }
+}
+
+/* One poll. REPORT GENERAL gives the expander change count; REPORT
+ * BROADCAST (when supported) names the phys that originated Broadcast
+ * (Change). When the expander change count moves but no phy is named,
+ * DISCOVER LIST short descriptors give every phy change count in one or
+ * two responses and, failing that, all phys are rediscovered. The first
+ * poll is the baseline and outputs no events. */
+static int
+mon_poll(struct smp_target_obj * top, struct mon_t * mp, bool baseline)
+{
+    bool named = false;
+    int k, res;
+    int cnt_arr[MAX_PHY_ID + 1];
+    struct smp_report_general rg;
+    char b[128];
+
+    res = smp_get_report_general(top, &rg, 0, mp->verbose);
+    if (res) {
+        pr2serr("REPORT GENERAL failed: %s\n", (res > 0) ?
+                smp_get_func_res_str(res, sizeof(b), b) : "request failed");
+        return (res > 0) ? res : SMP_LIB_CAT_OTHER;
+    }
+    memcpy(cnt_arr, mp->bcast_cnt, sizeof(cnt_arr));
+    if (mp->have_bcast) {
+        res = fetch_bcast(top, cnt_arr, mp);
+        if (res > 0) {
+            if (SMP_FRES_UNKNOWN_FUNCTION == res) {
+                if (mp->verbose)
+                    pr2serr("REPORT BROADCAST not supported, use expander "
+                            "change count\n");
+                mp->have_bcast = false;
+            } else
+                pr2serr("REPORT BROADCAST failed: %s\n",
+                        smp_get_func_res_str(res, sizeof(b), b));
+        } else if (res < 0)
+            return SMP_LIB_CAT_OTHER;
+    }
+    if (baseline || (rg.num_phys != mp->num_phys)) {
+        if ((! baseline) && mp->verbose)
+            pr2serr("number of phys changed, rediscover all\n");
+        mp->num_phys = rg.num_phys;
+        for (k = 0; k < mp->num_phys; ++k)
+            mp->stale[k] = true;
+    } else {
+        for (k = 0; k < mp->num_phys; ++k) {
+            if (cnt_arr[k] != mp->bcast_cnt[k]) {
+                mp->stale[k] = true;
+                named = true;
+            }
+        }
+        if ((! named) && (rg.exp_change_count != mp->exp_cc)) {
+            if ((! mp->have_dlist) || mark_by_dlist(top, mp)) {
+                for (k = 0; k < mp->num_phys; ++k)
+                    mp->stale[k] = true;
+            }
+        }
+    }
+    if (mp->verbose > 1)
+        pr2serr("expander change count %d -> %d%s\n", mp->exp_cc,
+                rg.exp_change_count, named ? ", broadcast names phys" : "");
+    memcpy(mp->bcast_cnt, cnt_arr, sizeof(cnt_arr));
+    mp->exp_cc = rg.exp_change_count;
+    rediscover(top, mp, baseline);
+    return 0;
+}
+
+/* Polls every interval_ms milliseconds (to absolute deadlines) until count
+ * polls are done or a signal is caught. */
+static int
+do_monitor(struct smp_target_obj * top, struct mon_t * mp)
+{
+    int res, poll;
+    int ret = 0;
+    struct timespec dl;
+    struct sigaction sa, old_int, old_term, old_pipe;
+
+    mp->reqs = (uint8_t *)calloc(MAX_PHY_ID + 1, 16);
+    mp->resps = (uint8_t *)calloc(MAX_PHY_ID + 1, SMP_FN_DISCOVER_RESP_LEN);
+    mp->rrp = (struct smp_req_resp *)calloc(MAX_PHY_ID + 1,
+                                            sizeof(struct smp_req_resp));
+    if ((NULL == mp->reqs) || (NULL == mp->resps) || (NULL == mp->rrp)) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        ret = SMP_LIB_RESOURCE_ERROR;
+        goto fini;
+    }
+    mp->have_bcast = true;
+    mp->have_dlist = (smp_discover_list_supported(top, mp->verbose) > 0);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sig_handler;
+    sigemptyset(&sa.sa_mask);
+    got_signal = 0;
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+    sa.sa_handler = SIG_IGN;    /* reader of --unix socket went away */
+    sigaction(SIGPIPE, &sa, &old_pipe);
+
+    clock_gettime(CLOCK_MONOTONIC, &dl);
+    for (poll = 0; (0 == mp->count) || (poll < mp->count); ++poll) {
+        res = mon_poll(top, mp, (0 == poll));
+        if (res) {
+            ret = res;
+            break;
+        }
+        if (0 == poll)
+            pr2serr("Monitoring %d phys, polling every %d ms\n",
+                    mp->num_phys, mp->interval_ms);
+        if (mp->emp ? smp_emit_flush(mp->emp) :
+                      (fflush(mp->fp) || ferror(mp->fp))) {
+            pr2serr("unable to output events: %s\n", safe_strerror(errno));
+            ret = SMP_LIB_FILE_ERROR;
+            break;
+        }
+        if (got_signal || (mp->count && ((poll + 1) >= mp->count)))
+            break;
+        dl.tv_sec += mp->interval_ms / 1000;
+        dl.tv_nsec += (mp->interval_ms % 1000) * 1000000;
+        if (dl.tv_nsec >= 1000000000) {
+            ++dl.tv_sec;
+            dl.tv_nsec -= 1000000000;
+        }
+        while ((res = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &dl,
+                                      NULL)) && (EINTR == res) &&
+               (! got_signal))
+            ;
+        if (got_signal)
+            break;
+    }
+    if (mp->verbose)
+        pr2serr("%d poll%s, %d event%s, %d DISCOVER requests\n", poll + 1,
+                (0 == poll) ? "" : "s", mp->num_events,
+                (1 == mp->num_events) ? "" : "s", mp->num_discovers);
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    sigaction(SIGPIPE, &old_pipe, NULL);
+fini:
+    free(mp->rrp);
+    free(mp->resps);
+    free(mp->reqs);
+    return ret;
+}
+
+/* Connects to the unix (stream) socket at path. Returns a FILE pointer
+ * for writing, else NULL. */
+static FILE *
+open_unix(const char * path)
+{
+    int fd;
+    struct sockaddr_un s_un;
+    FILE * fp;
+
+    memset(&s_un, 0, sizeof(s_un));
+    s_un.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(s_un.sun_path)) {
+        pr2serr("--unix: path too long\n");
+        return NULL;
+    }
+    memcpy(s_un.sun_path, path, strlen(path));
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        pr2serr("--unix: socket: %s\n", safe_strerror(errno));
+        return NULL;
+    }
+    if (connect(fd, (struct sockaddr *)&s_un, sizeof(s_un)) < 0) {
+        pr2serr("--unix: unable to connect to %s: %s\n", path,
+                safe_strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    if (NULL == (fp = fdopen(fd, "w"))) {
+        pr2serr("--unix: fdopen: %s\n", safe_strerror(errno));
+        close(fd);
+    }
+    return fp;
+}
+
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_rep_broadcast_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
     bool do_raw = false;
+    bool do_monitor_mode = false;
     int res, c, k, j, len, bd_len, num_bd, bt, bt_hdr, act_resplen;
+    int out_fmt = 0;
     int btype = 0;
     int do_hex = 0;
     int ret = 0;
@@ -146,6 +595,7 @@ main(int argc, char * argv[])
     int64_t sa_ll;
     uint64_t sa = 0;
     uint8_t * bdp;
+    const char * unix_path = NULL;
     char * cp;
     char i_params[256];
     char device_name[512];
@@ -155,13 +605,17 @@ main(int argc, char * argv[])
     uint8_t smp_resp[SMP_FN_REPORT_BROADCAST_RESP_LEN];
     struct smp_req_resp smp_rr;
     struct smp_target_obj tobj;
+    struct smp_emit emit;
+    static struct mon_t mon;    /* large, and only one per process */
 
+    memset(&mon, 0, sizeof(mon));
+    mon.interval_ms = DEF_INTERVAL_MS;
     memset(device_name, 0, sizeof device_name);
     memset(i_params, 0, sizeof i_params);
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "b:hHI:rs:vV", long_options,
+        c = getopt_long(argc, argv, "b:c:hHi:I:jmrs:u:vVx", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -175,6 +629,13 @@ main(int argc, char * argv[])
                 return SMP_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'c':
+            mon.count = smp_get_num(optarg);
+            if (mon.count < 0) {
+                pr2serr("bad argument to '--count'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'h':
         case '?':
             usage();
@@ -182,10 +643,24 @@ main(int argc, char * argv[])
         case 'H':
             ++do_hex;
             break;
+        case 'i':
+            mon.interval_ms = smp_get_num(optarg);
+            if (mon.interval_ms < 1) {
+                pr2serr("bad argument to '--interval', expect milliseconds "
+                        "(1 or more)\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'I':
             strncpy(i_params, optarg, sizeof(i_params));
             i_params[sizeof(i_params) - 1] = '\0';
             break;
+        case 'j':
+            out_fmt = SMP_EMIT_JSON;
+            break;
+        case 'm':
+            do_monitor_mode = true;
+            break;
         case 'r':
             do_raw = true;
             break;
@@ -197,12 +672,18 @@ main(int argc, char * argv[])
             }
             sa = (uint64_t)sa_ll;
             break;
+        case 'u':
+            unix_path = optarg;
+            break;
         case 'v':
             ++verbose;
             break;
         case 'V':
             pr2serr("version: %s\n", version_str);
             return 0;
+        case 'x':
+            out_fmt = SMP_EMIT_CSV;
+            break;
         default:
             pr2serr("unrecognised switch code 0x%x ??\n", c);
             usage();
@@ -222,13 +703,26 @@ main(int argc, char * argv[])
             return SMP_LIB_SYNTAX_ERROR;
         }
     }
+    if (do_monitor_mode) {
+        if (do_hex || do_raw || btype) {
+            pr2serr("--monitor can't be given with --broadcast=, --hex or "
+                    "--raw\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    } else if (out_fmt || unix_path || mon.count ||
+               (DEF_INTERVAL_MS != mon.interval_ms)) {
+        pr2serr("--count=, --csv, --interval=, --json and --unix= need "
+                "--monitor\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
     if (0 == device_name[0]) {
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -268,6 +762,29 @@ main(int argc, char * argv[])
                              &tobj, verbose);
     if (res < 0)
         return SMP_LIB_FILE_ERROR;
+    if (do_monitor_mode) {
+        mon.verbose = verbose;
+        mon.fp = stdout;
+        if (unix_path && (NULL == (mon.fp = open_unix(unix_path)))) {
+            ret = SMP_LIB_FILE_ERROR;
+            goto err_out;
+        }
+        if (out_fmt) {
+            if (smp_emit_init(&emit, out_fmt, mon.fp)) {
+                pr2serr("unable to set up --json or --csv output\n");
+                ret = SMP_LIB_RESOURCE_ERROR;
+                goto mon_fini;
+            }
+            mon.emp = &emit;
+        }
+        ret = do_monitor(&tobj, &mon);
+        if (mon.emp && smp_emit_fini(mon.emp) && (0 == ret))
+            ret = SMP_LIB_FILE_ERROR;
+mon_fini:
+        if (unix_path && fclose(mon.fp) && (0 == ret))
+            ret = SMP_LIB_FILE_ERROR;
+        goto err_out;
+    }
 
     len = (sizeof(smp_resp) - 8) / 4;
     smp_req[2] = (len < 0x100) ? len : 0xff; /* Allocated Response Len */
@@ -235,8 +235,13 @@ do_rep_exp_rou_tbl(struct smp_target_obj * top, uint8_t * resp,
 }
 
 
+#ifdef SMP_UTILS_MULTI
+int
+smp_rep_exp_route_tbl_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
     int res, c, len, exp_cc, sphy_id, num_desc, desc_len;
     int k, j, off, exp_rtcc;
@@ -339,9 +344,10 @@ main(int argc, char * argv[])
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == opts.sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -51,16 +51,18 @@
  * This utility issues a REPORT GENERAL function and outputs its response.
  */
 
-static const char * version_str = "1.37 20180725";    /* spl5r05 */
+static const char * version_str = "1.38 20261014";    /* spl5r05 */
 
 #define SMP_FN_REPORT_GENERAL_RESP_LEN 76
 
 static struct option long_options[] = {
     {"brief", no_argument, 0, 'b'},
     {"changecount", no_argument, 0, 'c'},
+    {"csv", no_argument, 0, 'x'},
     {"help", no_argument, 0, 'h'},
     {"hex", no_argument, 0, 'H'},
     {"interface", required_argument, 0, 'I'},
+    {"json", no_argument, 0, 'j'},
     {"raw", no_argument, 0, 'r'},
     {"sa", required_argument, 0, 's'},
     {"verbose", no_argument, 0, 'v'},
@@ -73,20 +75,25 @@ static struct option long_options[] = {
 static void
 usage(void)
 {
-    pr2serr("Usage: smp_rep_general [--brief] [--changecount] [--help] "
-            "[--hex]\n"
-            "                       [--interface=PARAMS] [--raw] "
-            "[--sa=SAS_ADDR]\n"
-            "                       [--verbose] [--version] [--zero] "
-            "SMP_DEVICE[,N]\n"
+    pr2serr("Usage: smp_rep_general [--brief] [--changecount] [--csv] "
+            "[--help]\n"
+            "                       [--hex] [--interface=PARAMS] [--json] "
+            "[--raw]\n"
+            "                       [--sa=SAS_ADDR] [--verbose] [--version] "
+            "[--zero]\n"
+            "                       SMP_DEVICE[,N]\n"
             "  where:\n"
             "    --brief|-b           brief report, only important settings\n"
             "    --changecount|-c     report expander change count "
             "only\n"
+            "    --csv|-x             output response as a header line of "
+            "field\n"
+            "                         names then one comma separated line\n"
             "    --help|-h            print out usage message\n"
             "    --hex|-H             print response in hexadecimal\n"
             "    --interface=PARAMS|-I PARAMS    specify or override "
             "interface\n"
+            "    --json|-j            output response as one JSON object\n"
             "    --raw|-r             output response in binary\n"
             "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of SMP "
             "target (use leading\n"
@@ -112,9 +119,55 @@ dStrRaw(const uint8_t * str, int len)
         printf("%c", str[k]);
 }
 
+/* Outputs the REPORT GENERAL response as one --json or --csv record.
+ * Returns 0 if ok, else an SMP_LIB error. */
+static int
+emit_rg(int out_fmt, const uint8_t * rp, int len)
+{
+    struct smp_report_general rg;
+    struct smp_emit emit;
+
+    if (smp_emit_init(&emit, out_fmt, stdout))
+        return SMP_LIB_RESOURCE_ERROR;
+    smp_decode_report_general(rp, len, &rg);
+    smp_emit_rec_begin(&emit);
+    smp_emit_int(&emit, "expander_change_count", rg.exp_change_count);
+    smp_emit_int(&emit, "expander_route_indexes", rg.exp_route_indexes);
+    smp_emit_int(&emit, "long_response", rg.long_response);
+    smp_emit_int(&emit, "number_of_phys", rg.num_phys);
+    smp_emit_int(&emit, "table_to_table_supported", rg.table_to_table_sup);
+    smp_emit_int(&emit, "zone_configuring", rg.zone_configuring);
+    smp_emit_int(&emit, "self_configuring", rg.self_configuring);
+    smp_emit_int(&emit, "configures_others", rg.configures_others);
+    smp_emit_int(&emit, "configuring", rg.configuring);
+    smp_emit_int(&emit, "externally_configurable_route_table",
+                 rg.ext_config_route_table);
+    smp_emit_hex64(&emit, "enclosure_logical_identifier",
+                   rg.enclosure_logical_id);
+    smp_emit_int(&emit, "number_of_zone_groups", rg.num_zone_groups);
+    smp_emit_int(&emit, "zone_locked", rg.zone_locked);
+    smp_emit_int(&emit, "physical_presence_supported",
+                 rg.phys_presence_sup);
+    smp_emit_int(&emit, "physical_presence_asserted",
+                 rg.phys_presence_asserted);
+    smp_emit_int(&emit, "zoning_supported", rg.zoning_supported);
+    smp_emit_int(&emit, "zoning_enabled", rg.zoning_enabled);
+    smp_emit_int(&emit, "maximum_number_of_routed_sas_addresses",
+                 rg.max_routed_sas_addrs);
+    smp_emit_hex64(&emit, "active_zone_manager_sas_address",
+                   rg.active_zm_sas_addr);
+    smp_emit_rec_end(&emit);
+    return smp_emit_fini(&emit) ? SMP_LIB_FILE_ERROR : 0;
+}
 
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_rep_general_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
     bool do_brief = false;
     bool do_ccount = false;
@@ -123,6 +176,7 @@ main(int argc, char * argv[])
     bool do_raw = false;
     bool do_zero = false;
     int res, c, k, len, sas2, zsupp, psupp, act_resplen;
+    int out_fmt = 0;
     int ret = 0;
     int subvalue = 0;
     int verbose = 0;
@@ -145,7 +199,7 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "bchHI:rs:vVz", long_options,
+        c = getopt_long(argc, argv, "bchHI:jrs:vVxz", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -169,6 +223,9 @@ main(int argc, char * argv[])
             strncpy(i_params, optarg, sizeof(i_params));
             i_params[sizeof(i_params) - 1] = '\0';
             break;
+        case 'j':
+            out_fmt = SMP_EMIT_JSON;
+            break;
         case 'r':
             do_raw = true;
             break;
@@ -186,6 +243,9 @@ main(int argc, char * argv[])
         case 'V':
             pr2serr("version: %s\n", version_str);
             return 0;
+        case 'x':
+            out_fmt = SMP_EMIT_CSV;
+            break;
         case 'z':
             do_zero = true;
             break;
@@ -212,9 +272,10 @@ main(int argc, char * argv[])
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -353,6 +414,10 @@ main(int argc, char * argv[])
         printf("%u\n", sg_get_unaligned_be16(smp_resp + 4));
         goto err_out;
     }
+    if (out_fmt) {
+        ret = emit_rg(out_fmt, smp_resp, len);
+        goto err_out;
+    }
     sas2 = !! (smp_resp[3]);
     if (do_full) {
         printf("Report general response:\n");
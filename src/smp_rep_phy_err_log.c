@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2018, Douglas Gilbert
+ * Copyright (c) 2006-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -32,6 +32,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <getopt.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
@@ -48,20 +49,54 @@
  * utility.
  *
  * This utility issues a REPORT PHY ERROR LOG function and outputs its
- * response.
+ * response. With --all it fetches the error logs of all phys of an
+ * expander and can output the increments since a baseline file.
  */
 
-static const char * version_str = "1.20 20180725";
+static const char * version_str = "1.22 20261014";
 
 #define SMP_FN_REPORT_PHY_ERR_LOG_RESP_LEN 32
+#define MAX_PHY_ID 254
+#define NUM_ERR_CNTS 4          /* invalid dword ... phy reset problem */
+
+#define MAX_SAS_ADDRS 32
+#define MAX_TARGETS 64
+
+#define BASE_MAGIC "smp_rep_phy_err_log baseline 1"
+
+/* Saved between invocations by --baseline=FILE, see do_all() */
+struct base_t {
+    bool loaded;        /* read from file and is for this SMP target */
+    bool have[MAX_PHY_ID + 1];
+    uint32_t cnt[MAX_PHY_ID + 1][NUM_ERR_CNTS];
+};
+
+/* One SMP target of --lockstep, see do_lockstep() */
+struct ls_tgt_t {
+    bool opened;
+    int subvalue;
+    int num_phys;
+    uint64_t sa;
+    uint8_t * reqs;
+    uint8_t * resps;
+    uint64_t * sent_us;
+    uint32_t * lat_us;
+    struct smp_req_resp * rrp;
+    struct smp_target_obj tobj;
+    char dev_name[512];
+};
 
 static struct option long_options[] = {
+    {"all", no_argument, 0, 'a'},
+    {"baseline", required_argument, 0, 'b'},
     {"help", no_argument, 0, 'h'},
     {"hex", no_argument, 0, 'H'},
     {"interface", required_argument, 0, 'I'},
+    {"lockstep", no_argument, 0, 'L'},
     {"phy", required_argument, 0, 'p'},
     {"raw", no_argument, 0, 'r'},
     {"sa", required_argument, 0, 's'},
+    {"threshold", required_argument, 0, 't'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
     {"zero", no_argument, 0, 'z'},
@@ -72,16 +107,33 @@ static struct option long_options[] = {
 static void
 usage(void)
 {
-    pr2serr("Usage: smp_rep_phy_err_log [--help] [--hex] "
-            "[--interface=PARAMS] [--phy=ID]\n"
-            "                           [--raw] [--sa=SAS_ADDR] [--verbose] "
-            "[--version]\n"
-            "                           [--zero] SMP_DEVICE[,N]\n"
+    pr2serr("Usage: smp_rep_phy_err_log [--all] [--baseline=FILE] [--help] "
+            "[--hex]\n"
+            "                           [--interface=PARAMS] [--lockstep] "
+            "[--phy=ID]\n"
+            "                           [--raw] [--sa=SAS_ADDR] "
+            "[--threshold=TH]\n"
+            "                           [--verbose] [--version] [--zero] "
+            "SMP_DEVICE[,N]\n"
+            "                           [SMP_DEVICE[,N]...]\n"
             "  where:\n"
+            "    --all|-a             fetch error logs of all phys, output "
+            "a line for\n"
+            "                         each\n"
+            "    --baseline=FILE|-b FILE    with --all: output increments "
+            "since FILE\n"
+            "                               then update FILE\n"
             "    --help|-h            print out usage message\n"
             "    --hex|-H             print response in hexadecimal\n"
             "    --interface=PARAMS|-I PARAMS    specify or override "
             "interface\n"
+            "    --lockstep|-L        as --all for each SMP_DEVICE (and "
+            "--sa=) given:\n"
+            "                         open all, then read them together "
+            "from a thread\n"
+            "                         each; lines show when each request "
+            "was sent\n"
+            "                         and its latency\n"
             "    --phy=ID|-p ID       phy identifier (def: 0)\n"
             "    --raw|-r             output response in binary\n"
             "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of SMP "
@@ -89,7 +141,12 @@ usage(void)
             "                                 '0x' or trailing 'h'). "
             "Depending on\n"
             "                                 the interface, may not be "
-            "needed\n"
+            "needed.\n"
+            "                                 With --lockstep may be given "
+            "more than once\n"
+            "    --threshold=TH|-t TH    with --all: only output phys with a "
+            "count (or\n"
+            "                            increment) of TH or more\n"
             "    --verbose|-v         increase verbosity\n"
             "    --version|-V         print version string and exit\n"
             "    --zero|-z            zero Allocated Response Length "
@@ -109,20 +166,424 @@ dStrRaw(const uint8_t * str, int len)
 }
 
 
+/* Reads the baseline FILE written by an earlier invocation into bsp. A
+ * missing file is not an error, bsp->loaded is left false. Returns 0 if
+ * ok, else SMP_LIB_FILE_ERROR. */
+static int
+read_baseline(const char * fn, const char * dev_name, uint64_t sa,
+              struct base_t * bsp, int verbose)
+{
+    int phy;
+    uint64_t ull;
+    FILE * fp;
+    char line[256];
+    char dev[SMP_MAX_DEVICE_NAME];
+    uint32_t * up;
+
+    memset(bsp, 0, sizeof(*bsp));
+    if (NULL == (fp = fopen(fn, "r"))) {
+        if (ENOENT == errno) {
+            if (verbose)
+                pr2serr("--baseline: %s not found, will create\n", fn);
+            return 0;
+        }
+        pr2serr("--baseline: unable to open %s: %s\n", fn,
+                safe_strerror(errno));
+        return SMP_LIB_FILE_ERROR;
+    }
+    if ((NULL == fgets(line, sizeof(line), fp)) ||
+        strncmp(line, BASE_MAGIC, sizeof(BASE_MAGIC) - 1))
+        goto bad;
+    if ((NULL == fgets(line, sizeof(line), fp)) ||
+        (1 != sscanf(line, "device=%255s", dev)))
+        goto bad;
+    if ((NULL == fgets(line, sizeof(line), fp)) ||
+        (1 != sscanf(line, "sas_addr=0x%" SCNx64, &ull)))
+        goto bad;
+    while (fgets(line, sizeof(line), fp)) {
+        if (1 != sscanf(line, "phy=%d", &phy))
+            goto bad;
+        if ((phy < 0) || (phy > MAX_PHY_ID))
+            goto bad;
+        up = bsp->cnt[phy];
+        if (NUM_ERR_CNTS != sscanf(line, "phy=%*d %u %u %u %u", up + 0,
+                                   up + 1, up + 2, up + 3))
+            goto bad;
+        bsp->have[phy] = true;
+    }
+    fclose(fp);
+    /* a baseline of some other SMP target is of no use */
+    if (strcmp(dev, dev_name) || (sa != ull)) {
+        if (verbose)
+            pr2serr("--baseline: %s is for %s, ignored\n", fn, dev);
+        memset(bsp, 0, sizeof(*bsp));
+        return 0;
+    }
+    bsp->loaded = true;
+    return 0;
+bad:
+    fclose(fp);
+    pr2serr("--baseline: %s is not a valid baseline, ignored\n", fn);
+    memset(bsp, 0, sizeof(*bsp));
+    return 0;
+}
+
+/* Writes bsp to a temporary file then renames it over FILE so a reader
+ * never sees a partial baseline. Returns 0 if ok. */
+static int
+write_baseline(const char * fn, const char * dev_name, uint64_t sa,
+               const struct base_t * bsp)
+{
+    int k;
+    FILE * fp;
+    const uint32_t * up;
+    char b[1024];
+
+    snprintf(b, sizeof(b), "%s.tmp", fn);
+    if (NULL == (fp = fopen(b, "w"))) {
+        pr2serr("--baseline: unable to create %s: %s\n", b,
+                safe_strerror(errno));
+        return SMP_LIB_FILE_ERROR;
+    }
+    fprintf(fp, "%s\ndevice=%s\nsas_addr=0x%" PRIx64 "\n", BASE_MAGIC,
+            dev_name, sa);
+    for (k = 0; k <= MAX_PHY_ID; ++k) {
+        if (! bsp->have[k])
+            continue;
+        up = bsp->cnt[k];
+        fprintf(fp, "phy=%d %u %u %u %u\n", k, up[0], up[1], up[2], up[3]);
+    }
+    if (fclose(fp) || rename(b, fn)) {
+        pr2serr("--baseline: unable to write %s: %s\n", fn,
+                safe_strerror(errno));
+        unlink(b);
+        return SMP_LIB_FILE_ERROR;
+    }
+    return 0;
+}
+
+/* Builds a REPORT PHY ERROR LOG request for each of phys 0 to num_phys-1
+ * in reqs (16 bytes each) with rrp[] pointing at them and at resps. */
+static void
+build_reqs(uint8_t * reqs, uint8_t * resps, struct smp_req_resp * rrp,
+           int num_phys, bool do_zero)
+{
+    int k, len;
+    uint8_t * qp;
+
+    for (k = 0; k < num_phys; ++k) {
+        qp = reqs + (16 * k);
+        qp[0] = SMP_FRAME_TYPE_REQ;
+        qp[1] = SMP_FN_REPORT_PHY_ERR_LOG;
+        if (! do_zero) {
+            len = (SMP_FN_REPORT_PHY_ERR_LOG_RESP_LEN - 8) / 4;
+            qp[2] = (len < 0x100) ? len : 0xff;
+            qp[3] = 2;
+        }
+        qp[9] = k;
+        rrp[k].request_len = 16;
+        rrp[k].request = qp;
+        rrp[k].max_response_len = SMP_FN_REPORT_PHY_ERR_LOG_RESP_LEN;
+        rrp[k].response = resps + (SMP_FN_REPORT_PHY_ERR_LOG_RESP_LEN * k);
+    }
+}
+
+/* Returns 0 if the batched request in rrp got a good response, -1 if it
+ * failed to be sent, else the function result or SMP_LIB_CAT_MALFORMED */
+static int
+resp_res(const struct smp_req_resp * rrp)
+{
+    const uint8_t * rp = rrp->response;
+
+    if (rrp->transport_err || (rrp->act_response_len == 0))
+        return -1;
+    else if ((rrp->act_response_len > 0) && (rrp->act_response_len < 28))
+        return SMP_LIB_CAT_MALFORMED;
+    else if ((SMP_FRAME_TYPE_RESP != rp[0]) ||
+             (SMP_FN_REPORT_PHY_ERR_LOG != rp[1]))
+        return (0 == rp[0]) ? -1 : SMP_LIB_CAT_MALFORMED;
+    return rp[2];
+}
+
+/* Sends REPORT PHY ERROR LOG to all phys (number from REPORT GENERAL) as a
+ * batch and outputs one line per phy. With a baseline the increments since
+ * it are output, a count smaller than its baseline (e.g. the log was
+ * cleared or the expander reset) counts from zero. */
+static int
+do_all(struct smp_target_obj * top, const char * dev_name, uint64_t sa,
+       const char * base_fn, unsigned int thresh, bool do_zero, int verbose)
+{
+    bool show;
+    int k, j, res, num_phys;
+    int num_shown = 0;
+    int ret = 0;
+    uint32_t cur;
+    uint32_t v[NUM_ERR_CNTS];
+    const uint8_t * rp;
+    uint8_t * reqs = NULL;
+    uint8_t * resps = NULL;
+    struct smp_req_resp * rrp = NULL;
+    struct base_t * old_bp = NULL;
+    struct base_t * new_bp = NULL;
+    struct smp_report_general rg;
+    char b[128];
+
+    res = smp_get_report_general(top, &rg, -1, verbose);
+    if (res) {
+        if (res > 0)
+            pr2serr("REPORT GENERAL failed: %s\n",
+                    (SMP_LIB_CAT_MALFORMED == res) ? "malformed response" :
+                    smp_get_func_res_str(res, sizeof(b), b));
+        return res;
+    }
+    num_phys = rg.num_phys;
+    if (num_phys < 1)
+        return 0;
+    reqs = (uint8_t *)calloc(num_phys, 16);
+    resps = (uint8_t *)calloc(num_phys, SMP_FN_REPORT_PHY_ERR_LOG_RESP_LEN);
+    rrp = (struct smp_req_resp *)calloc(num_phys,
+                                        sizeof(struct smp_req_resp));
+    old_bp = (struct base_t *)calloc(2, sizeof(struct base_t));
+    if ((NULL == reqs) || (NULL == resps) || (NULL == rrp) ||
+        (NULL == old_bp)) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        ret = SMP_LIB_RESOURCE_ERROR;
+        goto fini;
+    }
+    new_bp = old_bp + 1;
+    if (base_fn) {
+        ret = read_baseline(base_fn, dev_name, sa, old_bp, verbose);
+        if (ret)
+            goto fini;
+    }
+    build_reqs(reqs, resps, rrp, num_phys, do_zero);
+    smp_send_req_batch(top, rrp, num_phys, 0, NULL, NULL, verbose);
+
+    printf("Report phy error log, %s:\n", old_bp->loaded ?
+           "increments since baseline" : "all phys");
+    printf("  phy  invalid dword  disparity error  loss of sync  "
+           "reset problem\n");
+    for (k = 0; k < num_phys; ++k) {
+        rp = rrp[k].response;
+        res = resp_res(rrp + k);
+        if (SMP_FRES_PHY_VACANT == res)
+            continue;
+        if (res) {
+            if (res > 0)
+                pr2serr("phy %d: %s\n", k, (SMP_LIB_CAT_MALFORMED == res) ?
+                        "malformed response" :
+                        smp_get_func_res_str(res, sizeof(b), b));
+            else
+                pr2serr("phy %d: request failed\n", k);
+            if (0 == ret)
+                ret = (res > 0) ? res : SMP_LIB_CAT_OTHER;
+            continue;
+        }
+        for (show = (0 == thresh), j = 0; j < NUM_ERR_CNTS; ++j) {
+            cur = sg_get_unaligned_be32(rp + 12 + (4 * j));
+            new_bp->cnt[k][j] = cur;
+            v[j] = cur;
+            if (old_bp->have[k] && (cur >= old_bp->cnt[k][j]))
+                v[j] = cur - old_bp->cnt[k][j];
+            if (thresh && (v[j] >= thresh))
+                show = true;
+        }
+        new_bp->have[k] = true;
+        if (show) {
+            printf("  %3d  %13u  %15u  %12u  %13u\n", k, v[0], v[1], v[2],
+                   v[3]);
+            ++num_shown;
+        }
+    }
+    if (thresh && (0 == num_shown))
+        printf("  no phys at or above threshold of %u\n", thresh);
+    if (base_fn) {
+        res = write_baseline(base_fn, dev_name, sa, new_bp);
+        if (res && (0 == ret))
+            ret = res;
+    }
+fini:
+    free(old_bp);
+    free(rrp);
+    free(resps);
+    free(reqs);
+    return ret;
+}
+
+
+/* --lockstep: opens every target and learns its number of phys first, then
+ * reads the error logs of all their phys with smp_send_req_lockstep() so
+ * that the reads of different expanders are as close together in time as
+ * possible. Each line carries the CLOCK_MONOTONIC time its request was sent
+ * and the request's latency. */
+static int
+do_lockstep(struct ls_tgt_t * tgts, int num_tgts, const char * i_params,
+            unsigned int thresh, bool do_zero, int verbose)
+{
+    bool show;
+    int k, j, n, res;
+    int ret = 0;
+    uint32_t v[NUM_ERR_CNTS];
+    uint64_t rel_us, first, first_min, first_max;
+    const uint8_t * rp;
+    struct ls_tgt_t * tp;
+    struct smp_lockstep_tgt * ltp = NULL;
+    struct smp_report_general rg;
+    char b[128];
+
+    for (k = 0; k < num_tgts; ++k) {
+        tp = tgts + k;
+        if (smp_initiator_open(tp->dev_name, tp->subvalue, i_params, tp->sa,
+                               &tp->tobj, verbose) < 0) {
+            ret = SMP_LIB_FILE_ERROR;
+            goto fini;
+        }
+        tp->opened = true;
+        if (0 == tp->sa)
+            tp->sa = sg_get_unaligned_be64(tp->tobj.sas_addr);
+        res = smp_get_report_general(&tp->tobj, &rg, -1, verbose);
+        if (res) {
+            pr2serr("%s: REPORT GENERAL failed: %s\n", tp->dev_name,
+                    (res < 0) ? "request failed" :
+                    ((SMP_LIB_CAT_MALFORMED == res) ? "malformed response" :
+                     smp_get_func_res_str(res, sizeof(b), b)));
+            ret = (res < 0) ? SMP_LIB_CAT_OTHER : res;
+            goto fini;
+        }
+        n = rg.num_phys;
+        tp->num_phys = n;
+        tp->reqs = (uint8_t *)calloc(n + 1, 16);
+        tp->resps = (uint8_t *)calloc(n + 1,
+                                      SMP_FN_REPORT_PHY_ERR_LOG_RESP_LEN);
+        tp->rrp = (struct smp_req_resp *)calloc(n + 1, sizeof(*tp->rrp));
+        tp->sent_us = (uint64_t *)calloc(n + 1, sizeof(uint64_t));
+        tp->lat_us = (uint32_t *)calloc(n + 1, sizeof(uint32_t));
+        if ((NULL == tp->reqs) || (NULL == tp->resps) || (NULL == tp->rrp) ||
+            (NULL == tp->sent_us) || (NULL == tp->lat_us)) {
+            pr2serr("%s: heap allocation problem\n", __func__);
+            ret = SMP_LIB_RESOURCE_ERROR;
+            goto fini;
+        }
+        build_reqs(tp->reqs, tp->resps, tp->rrp, n, do_zero);
+    }
+    ltp = (struct smp_lockstep_tgt *)calloc(num_tgts, sizeof(*ltp));
+    if (NULL == ltp) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        ret = SMP_LIB_RESOURCE_ERROR;
+        goto fini;
+    }
+    for (k = 0; k < num_tgts; ++k) {
+        ltp[k].tobj = &tgts[k].tobj;
+        ltp[k].rresp = tgts[k].rrp;
+        ltp[k].num = tgts[k].num_phys;
+        ltp[k].sent_us = tgts[k].sent_us;
+        ltp[k].lat_us = tgts[k].lat_us;
+    }
+    if (smp_send_req_lockstep(ltp, num_tgts, 0, &rel_us, verbose) < 0) {
+        pr2serr("unable to start a thread per SMP target\n");
+        ret = SMP_LIB_RESOURCE_ERROR;
+        goto fini;
+    }
+
+    printf("Report phy error log, lock-step read of %d SMP target%s "
+           "released at\n%" PRIu64 ".%06" PRIu64 " s (CLOCK_MONOTONIC):\n",
+           num_tgts, ((1 == num_tgts) ? "" : "s"), rel_us / 1000000,
+           rel_us % 1000000);
+    first_min = UINT64_MAX;
+    first_max = 0;
+    for (k = 0; k < num_tgts; ++k) {
+        tp = tgts + k;
+        printf("%s%s, SAS address 0x%" PRIx64 ", %d phys\n", (k ? "\n" : ""),
+               tp->dev_name, tp->sa, tp->num_phys);
+        if (tp->num_phys < 1)
+            continue;
+        /* several requests per target are in flight: take the earliest */
+        first = tp->sent_us[0];
+        for (j = 1; j < tp->num_phys; ++j) {
+            if (tp->sent_us[j] < first)
+                first = tp->sent_us[j];
+        }
+        if (first < first_min)
+            first_min = first;
+        if (first > first_max)
+            first_max = first;
+        printf("  phy     sent at (s)      latency (us)  invalid dword  "
+               "disparity error  loss of sync  reset problem\n");
+        for (j = 0; j < tp->num_phys; ++j) {
+            rp = tp->rrp[j].response;
+            res = resp_res(tp->rrp + j);
+            if (SMP_FRES_PHY_VACANT == res)
+                continue;
+            if (res) {
+                if (res > 0)
+                    pr2serr("%s: phy %d: %s\n", tp->dev_name, j,
+                            (SMP_LIB_CAT_MALFORMED == res) ?
+                            "malformed response" :
+                            smp_get_func_res_str(res, sizeof(b), b));
+                else
+                    pr2serr("%s: phy %d: request failed\n", tp->dev_name, j);
+                if (0 == ret)
+                    ret = (res > 0) ? res : SMP_LIB_CAT_OTHER;
+                continue;
+            }
+            for (show = (0 == thresh), n = 0; n < NUM_ERR_CNTS; ++n) {
+                v[n] = sg_get_unaligned_be32(rp + 12 + (4 * n));
+                if (thresh && (v[n] >= thresh))
+                    show = true;
+            }
+            if (show)
+                printf("  %3d  %" PRIu64 ".%06" PRIu64 "  %12u  %13u  %15u  "
+                       "%12u  %13u\n", j, tp->sent_us[j] / 1000000,
+                       tp->sent_us[j] % 1000000, tp->lat_us[j], v[0], v[1],
+                       v[2], v[3]);
+        }
+    }
+    if ((num_tgts > 1) && (first_max >= first_min))
+        printf("\nFirst requests to each SMP target sent within %" PRIu64
+               " us of each other\n", first_max - first_min);
+fini:
+    free(ltp);
+    for (k = 0; k < num_tgts; ++k) {
+        tp = tgts + k;
+        if (tp->opened && (smp_initiator_close(&tp->tobj) < 0) &&
+            (0 == ret))
+            ret = SMP_LIB_FILE_ERROR;
+        free(tp->lat_us);
+        free(tp->sent_us);
+        free(tp->rrp);
+        free(tp->resps);
+        free(tp->reqs);
+    }
+    return ret;
+}
+
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_rep_phy_err_log_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
+    bool do_all_phys = false;
+    bool lockstep = false;
     bool do_raw = false;
     bool do_zero = false;
     bool phy_id_given = false;
-    int res, c, k, len, act_resplen;
+    int res, c, k, j, len, act_resplen;
     int do_hex = 0;
+    int num_sa = 0;
+    int num_tgts = 0;
     int phy_id = 0;
     int ret = 0;
     int subvalue = 0;
     int verbose = 0;
     int64_t sa_ll;
     uint64_t sa = 0;
+    uint64_t sa_arr[MAX_SAS_ADDRS];
+    unsigned int thresh = 0;
+    const char * base_fn = NULL;
     char * cp;
     char b[256];
     char device_name[512];
@@ -133,18 +594,25 @@ main(int argc, char * argv[])
     uint8_t * free_smp_resp = NULL;
     struct smp_req_resp smp_rr;
     struct smp_target_obj tobj;
+    struct ls_tgt_t * tgts;
 
     memset(device_name, 0, sizeof device_name);
     memset(i_params, 0, sizeof i_params);
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "hHI:p:rs:vVz", long_options,
+        c = getopt_long(argc, argv, "ab:hHI:Lp:rs:t:vVz", long_options,
                         &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'a':
+            do_all_phys = true;
+            break;
+        case 'b':
+            base_fn = optarg;
+            break;
         case 'h':
         case '?':
             usage();
@@ -156,6 +624,9 @@ main(int argc, char * argv[])
             strncpy(i_params, optarg, sizeof(i_params));
             i_params[sizeof(i_params) - 1] = '\0';
             break;
+        case 'L':
+            lockstep = true;
+            break;
         case 'p':
            phy_id = smp_get_num(optarg);
            if ((phy_id < 0) || (phy_id > 254)) {
@@ -174,7 +645,20 @@ main(int argc, char * argv[])
                 pr2serr("bad argument to '--sa'\n");
                 return SMP_LIB_SYNTAX_ERROR;
             }
+            if (num_sa >= MAX_SAS_ADDRS) {
+                pr2serr("'--sa' given more than %d times\n", MAX_SAS_ADDRS);
+                return SMP_LIB_SYNTAX_ERROR;
+            }
             sa = (uint64_t)sa_ll;
+            sa_arr[num_sa++] = sa;
+            break;
+        case 't':
+            res = smp_get_num(optarg);
+            if (res < 0) {
+                pr2serr("bad argument to '--threshold'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            thresh = (unsigned int)res;
             break;
         case 'v':
             ++verbose;
@@ -191,6 +675,61 @@ main(int argc, char * argv[])
             return SMP_LIB_SYNTAX_ERROR;
         }
     }
+    if (lockstep) {
+        if (do_all_phys || phy_id_given || do_hex || do_raw || base_fn) {
+            pr2serr("--lockstep can't be given with --all, --baseline=, "
+                    "--phy=, --hex or\n--raw\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+        tgts = (struct ls_tgt_t *)calloc(MAX_TARGETS, sizeof(*tgts));
+        if (NULL == tgts) {
+            pr2serr("heap allocation problem\n");
+            return SMP_LIB_RESOURCE_ERROR;
+        }
+        if ((optind >= argc) && (cp = getenv("SMP_UTILS_DEVICE")))
+            strncpy(device_name, cp, sizeof(device_name) - 1);
+        /* each SMP_DEVICE with each SAS_ADDR given */
+        for (j = optind; (j < argc) || ((j == optind) && (optind >= argc));
+             ++j) {
+            subvalue = 0;
+            if (j < argc)
+                strncpy(device_name, argv[j], sizeof(device_name) - 1);
+            if ((cp = strchr(device_name, SMP_SUBVALUE_SEPARATOR))) {
+                *cp = '\0';
+                if (1 != sscanf(cp + 1, "%d", &subvalue)) {
+                    pr2serr("expected number after separator in SMP_DEVICE "
+                            "name\n");
+                    ret = SMP_LIB_SYNTAX_ERROR;
+                    goto ls_fini;
+                }
+            }
+            for (k = 0; k < (num_sa ? num_sa : 1); ++k) {
+                if (num_tgts >= MAX_TARGETS) {
+                    pr2serr("more than %d SMP targets\n", MAX_TARGETS);
+                    ret = SMP_LIB_SYNTAX_ERROR;
+                    goto ls_fini;
+                }
+                tgts[num_tgts].subvalue = subvalue;
+                tgts[num_tgts].sa = num_sa ? sa_arr[k] : 0;
+                memcpy(tgts[num_tgts].dev_name, device_name,
+                       sizeof(tgts[0].dev_name));
+                ++num_tgts;
+            }
+        }
+        ret = do_lockstep(tgts, num_tgts, i_params, thresh, do_zero,
+                          verbose);
+ls_fini:
+        free(tgts);
+        if (ret < 0)
+            ret = SMP_LIB_CAT_OTHER;
+        if (verbose && ret)
+            pr2serr("Exit status %d indicates error detected\n", ret);
+        return ret;
+    }
+    if (num_sa > 1) {
+        pr2serr("'--sa' may only be given more than once with --lockstep\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
     if (optind < argc) {
         if ('\0' == device_name[0]) {
             strncpy(device_name, argv[optind], sizeof(device_name) - 1);
@@ -208,9 +747,10 @@ main(int argc, char * argv[])
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -245,10 +785,25 @@ main(int argc, char * argv[])
         }
     }
 
+    if (do_all_phys) {
+        if (phy_id_given || do_hex || do_raw) {
+            pr2serr("--all can't be given with --phy=, --hex or --raw\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    } else if (base_fn || thresh) {
+        pr2serr("--baseline= and --threshold= need --all\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
+
     res = smp_initiator_open(device_name, subvalue, i_params, sa,
                              &tobj, verbose);
     if (res < 0)
         return SMP_LIB_FILE_ERROR;
+    if (do_all_phys) {
+        ret = do_all(&tobj, device_name, sa, base_fn, thresh, do_zero,
+                     verbose);
+        goto err_out;
+    }
 
     /* Align SMP response buffer to a page boundary */
     smp_resp = smp_memalign(SMP_FN_REPORT_PHY_ERR_LOG_RESP_LEN, 0,
@@ -33,6 +33,9 @@
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <inttypes.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -51,11 +54,16 @@
  * response.
  */
 
-static const char * version_str = "1.14 20180725";
+static const char * version_str = "1.17 20261014";
 
 #define SMP_FN_REPORT_PHY_EVENT_LIST_RESP_LEN (1020 + 4 + 4)
 
 #define DEF_STARTING_INDEX 1
+#define DEF_INTERVAL_MS 1000
+#define SAMPLE_RING_LEN 16      /* snapshots kept by --interval=MS */
+#define MAX_SAMPLE_DESCS 2048
+#define MAX_SAS_ADDRS 32
+#define MAX_TARGETS 64
 
 struct pes_name_t {
     int pes;    /* phy event source, an 8 bit number */
@@ -63,6 +71,8 @@ struct pes_name_t {
 };
 
 static struct option long_options[] = {
+    {"count", required_argument, 0, 'c'},
+    {"csv", no_argument, 0, 'x'},
     {"desc", no_argument, 0, 'd'},
     {"enumerate", no_argument, 0, 'e'},
     {"force", no_argument, 0, 'f'},
@@ -70,6 +80,9 @@ static struct option long_options[] = {
     {"hex", no_argument, 0, 'H'},
     {"index", required_argument, 0, 'i'},
     {"interface", required_argument, 0, 'I'},
+    {"interval", required_argument, 0, 't'},
+    {"json", no_argument, 0, 'j'},
+    {"lockstep", no_argument, 0, 'L'},
     {"long", no_argument, 0, 'l'},
     {"nonz", no_argument, 0, 'n'},
     {"raw", no_argument, 0, 'r'},
@@ -132,15 +145,25 @@ static struct pes_name_t pes_name_arr[] = {
 static void
 usage(void)
 {
-    pr2serr("Usage: smp_rep_phy_event_list [--desc] [--enumerate] [--force] "
-            "[--help]\n"
-            "                              [--hex] [--index=IN] "
-            "[--interface=PARAMS]\n"
-            "                              [--long] [--nonz] [--raw] "
-            "[--sa=SAS_ADDR]\n"
-            "                              [--verbose] [--version] "
-            "SMP_DEVICE[,N]\n"
+    pr2serr("Usage: smp_rep_phy_event_list [--count=N] [--csv] [--desc] "
+            "[--enumerate]\n"
+            "                              [--force] [--help] [--hex] "
+            "[--index=IN]\n"
+            "                              [--interface=PARAMS] "
+            "[--interval=MS] [--json]\n"
+            "                              [--lockstep] [--long] [--nonz] "
+            "[--raw]\n"
+            "                              [--sa=SAS_ADDR] [--verbose] "
+            "[--version]\n"
+            "                              SMP_DEVICE[,N] "
+            "[SMP_DEVICE[,N]...]\n"
             "  where:\n"
+            "    --count=N|-c N       take N samples (def: 0 -> until "
+            "interrupted)\n"
+            "                         when '--interval=MS' is given\n"
+            "    --csv|-x             output one comma separated line per "
+            "phy event\n"
+            "                         descriptor, after a header line\n"
             "    --desc|-d            show descriptor number in output\n"
             "    --enumerate|-e       enumerate phy event source names, "
             "ignore\n"
@@ -153,6 +176,19 @@ usage(void)
             "index (def: 1)\n"
             "    --interface=PARAMS|-I PARAMS    specify or override "
             "interface\n"
+            "    --interval=MS|-t MS    sample all phy events every MS "
+            "milliseconds\n"
+            "                         and show changes (def: 1000 when "
+            "--count=N)\n"
+            "    --json|-j            output one JSON object per line, one "
+            "per phy\n"
+            "                         event descriptor\n"
+            "    --lockstep|-L        read all phy events of each "
+            "SMP_DEVICE (and --sa=)\n"
+            "                         given: open all, send the first "
+            "request to each\n"
+            "                         together, then page through the "
+            "rest\n"
             "    --long|-l            show phy event source hex value in "
             "output\n"
             "    --nonz|-n            only show phy events with non-zero "
@@ -163,7 +199,9 @@ usage(void)
             "                                 '0x' or trailing 'h'). "
             "Depending on\n"
             "                                 the interface, may not be "
-            "needed\n"
+            "needed.\n"
+            "                                 With --lockstep may be given "
+            "more than once\n"
             "    --verbose|-v         increase verbosity\n"
             "    --version|-V         print version string and exit\n\n"
             "Performs a SMP REPORT PHY EVENT LIST function\n"
@@ -296,24 +334,539 @@ show_phy_event_info(int phy_id, int prev_pid, int pes, unsigned int val,
 }
 
 
+/* One poll of every phy event list descriptor from starting_index on */
+struct pe_snap_t {
+    uint64_t ms;                /* CLOCK_MONOTONIC when fetched */
+    int num;
+    uint8_t phy_id[MAX_SAMPLE_DESCS];
+    uint8_t pes[MAX_SAMPLE_DESCS];
+    uint32_t val[MAX_SAMPLE_DESCS];
+    uint32_t thresh[MAX_SAMPLE_DESCS];
+};
+
+struct sample_t {
+    bool do_nonz;
+    int count;                  /* 0 -> until interrupted */
+    int interval_ms;
+    int starting_index;
+    int verbose;
+    int head;                   /* ring index of newest snapshot */
+    int filled;                 /* snapshots held in ring */
+    struct smp_emit * emp;
+    struct pe_snap_t * ring;    /* SAMPLE_RING_LEN snapshots */
+};
+
+/* One SMP target of --lockstep, see do_lockstep() */
+struct ls_tgt_t {
+    bool opened;
+    int subvalue;
+    uint64_t sa;
+    uint64_t sent_us;           /* first request */
+    uint32_t lat_us;
+    uint8_t * free_resp;
+    struct pe_snap_t * snp;
+    struct smp_req_tmpl tmpl;
+    struct smp_target_obj tobj;
+    char dev_name[512];
+};
+
+static volatile sig_atomic_t got_signal;
+
+static void
+sig_handler(int sig)
+{
+    got_signal = sig;
+}
+
+static uint64_t
+mono_ms(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        return 0;
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+static void
+add_ms(struct timespec * tsp, int ms)
+{
+    tsp->tv_sec += ms / 1000;
+    tsp->tv_nsec += (ms % 1000) * 1000000L;
+    if (tsp->tv_nsec >= 1000000000L) {
+        ++tsp->tv_sec;
+        tsp->tv_nsec -= 1000000000L;
+    }
+}
+
+/* Peak value detector sources hold a maximum, not a count */
+static bool
+is_pvd(int pes)
+{
+    return (pes >= 0x2b) && (pes <= 0x2e);
+}
+
+/* Adds the descriptors in the REPORT PHY EVENT LIST response in tp's
+ * buffer, which was asked for from descriptor index idx, to snp. Sets
+ * *nextp to the index to ask for next, or to 0 when the last descriptor
+ * index is passed (or snp is full). Returns 0 on success, else an SMP_LIB
+ * error or an SMP function result. */
+static int
+add_page(const struct smp_req_tmpl * tp, unsigned int idx,
+         struct pe_snap_t * snp, unsigned int * nextp)
+{
+    int k, len, ped_len, num_ped;
+    unsigned int last_di;
+    const uint8_t * resp = tp->rr.response;
+    const uint8_t * pedp;
+    char b[128];
+
+    *nextp = 0;
+    if (tp->rr.transport_err) {
+        pr2serr("smp_send_req transport_error=%d\n", tp->rr.transport_err);
+        return SMP_LIB_CAT_OTHER;
+    }
+    if ((SMP_FRAME_TYPE_RESP != resp[0]) || (resp[1] != tp->req[1])) {
+        pr2serr("Unexpected response frame type=0x%x, function=0x%x\n",
+                resp[0], resp[1]);
+        return SMP_LIB_CAT_MALFORMED;
+    }
+    if (resp[2]) {
+        pr2serr("Report phy event list result: %s\n",
+                smp_get_func_res_str(resp[2], sizeof(b), b));
+        return resp[2];
+    }
+    len = 4 + (resp[3] * 4);
+    if ((tp->rr.act_response_len >= 0) && (len > tp->rr.act_response_len))
+        len = tp->rr.act_response_len;
+    last_di = sg_get_unaligned_be16(resp + 8);
+    ped_len = resp[10] * 4;
+    num_ped = resp[15];
+    if (ped_len < 12) {
+        pr2serr("Unexpectedly low descriptor length: %d bytes\n", ped_len);
+        return SMP_LIB_CAT_MALFORMED;
+    }
+    if ((16 + (num_ped * ped_len)) > len)
+        num_ped = (len - 16) / ped_len;
+    pedp = resp + 16;
+    for (k = 0; (k < num_ped) && ((idx + k) <= last_di) &&
+                (snp->num < MAX_SAMPLE_DESCS); ++k, pedp += ped_len) {
+        snp->phy_id[snp->num] = pedp[2];
+        snp->pes[snp->num] = pedp[3];
+        snp->val[snp->num] = sg_get_unaligned_be32(pedp + 4);
+        snp->thresh[snp->num] = sg_get_unaligned_be32(pedp + 8);
+        ++snp->num;
+    }
+    if ((k > 0) && ((idx + k) <= last_di) && (snp->num < MAX_SAMPLE_DESCS))
+        *nextp = idx + k;
+    return 0;
+}
+
+/* Pages through the phy event list descriptors from index idx on, with the
+ * request template tp, adding them to snp. Returns 0 on success, else an
+ * SMP_LIB error or an SMP function result. */
+static int
+fetch_pages(struct smp_target_obj * top, struct smp_req_tmpl * tp,
+            unsigned int idx, struct pe_snap_t * snp, int verbose)
+{
+    int res;
+
+    do {
+        smp_tmpl_set_idx(tp, idx);
+        res = smp_tmpl_send(top, tp, verbose);
+        if (res) {
+            pr2serr("smp_send_req failed, res=%d\n", res);
+            return SMP_LIB_CAT_OTHER;
+        }
+        res = add_page(tp, idx, snp, &idx);
+        if (res)
+            return res;
+    } while (idx > 0);
+    return 0;
+}
+
+/* Fetches all phy event list descriptors into snp, paging with the
+ * descriptor index until the last descriptor index is passed. tp is the
+ * request template, built once by do_sample(). Returns 0 on success, else
+ * an SMP_LIB error or an SMP function result. */
+static int
+fetch_snapshot(struct smp_target_obj * top, const struct sample_t * smp,
+               struct smp_req_tmpl * tp, struct pe_snap_t * snp)
+{
+    snp->num = 0;
+    snp->ms = mono_ms();
+    return fetch_pages(top, tp, smp->starting_index, snp, smp->verbose);
+}
+
+/* Returns true if o and n hold the same descriptors in the same order */
+static bool
+same_layout(const struct pe_snap_t * o, const struct pe_snap_t * n)
+{
+    return (o->num == n->num) &&
+           (0 == memcmp(o->phy_id, n->phy_id, n->num)) &&
+           (0 == memcmp(o->pes, n->pes, n->num));
+}
+
+/* Reports descriptor k that changed between snapshots o and n. Returns
+ * true if something was output. */
+static bool
+show_delta(const struct sample_t * smp, int sample, uint64_t elapsed_ms,
+           const struct pe_snap_t * o, const struct pe_snap_t * n, int k)
+{
+    bool pvd = is_pvd(n->pes[k]);
+    bool reset, crossed;
+    uint32_t ov = o->val[k];
+    uint32_t nv = n->val[k];
+    uint32_t th = n->thresh[k];
+    uint32_t delta;
+    const char * cp;
+    char b[80];
+
+    if (ov == nv)
+        return false;
+    reset = (! pvd) && (nv < ov);       /* counter cleared or wrapped */
+    delta = reset ? nv : (nv - ov);
+    crossed = th && (ov < th) && (nv >= th);
+    if (smp->do_nonz && (! crossed) && (0 == nv))
+        return false;
+    cp = get_pes_name(n->pes[k], b, sizeof(b));
+    if (smp->emp) {
+        smp_emit_rec_begin(smp->emp);
+        smp_emit_int(smp->emp, "sample", sample);
+        smp_emit_int(smp->emp, "elapsed_ms", elapsed_ms);
+        smp_emit_int(smp->emp, "phy_identifier", n->phy_id[k]);
+        smp_emit_int(smp->emp, "phy_event_source", n->pes[k]);
+        smp_emit_str(smp->emp, "phy_event_source_name", cp);
+        smp_emit_int(smp->emp, "phy_event", nv);
+        smp_emit_int(smp->emp, "delta", pvd ? 0 : delta);
+        smp_emit_int(smp->emp, "counter_reset", reset);
+        smp_emit_int(smp->emp, "peak_value_detector_threshold", th);
+        smp_emit_int(smp->emp, "threshold_crossed", crossed);
+        smp_emit_rec_end(smp->emp);
+        return true;
+    }
+    if (NULL == cp) {
+        snprintf(b, sizeof(b), "Phy Event Source [0x%x]", n->pes[k]);
+        cp = b;
+    }
+    if (pvd)
+        printf("    %d: %s: peak %u", n->phy_id[k], cp, nv);
+    else if (reset)
+        printf("    %d: %s: %u (counter reset)", n->phy_id[k], cp, nv);
+    else
+        printf("    %d: %s: +%u", n->phy_id[k], cp, delta);
+    if (crossed)
+        printf("  <<< threshold %u crossed", th);
+    printf("\n");
+    return true;
+}
+
+/* Outputs the change of each counter over the snapshots held in the ring,
+ * oldest to newest. */
+static void
+show_ring_summary(const struct sample_t * smp)
+{
+    int k, oldest;
+    uint32_t delta;
+    const struct pe_snap_t * o;
+    const struct pe_snap_t * n = smp->ring + smp->head;
+    char b[80];
+    const char * cp;
+
+    if (smp->filled < 2)
+        return;
+    oldest = (smp->head + SAMPLE_RING_LEN - (smp->filled - 1)) %
+             SAMPLE_RING_LEN;
+    o = smp->ring + oldest;
+    printf("Changes over the last %d samples (%" PRIu64 " ms):\n",
+           smp->filled, n->ms - o->ms);
+    for (k = 0; k < n->num; ++k) {
+        if (is_pvd(n->pes[k]) || (n->val[k] == o->val[k]))
+            continue;
+        delta = n->val[k] - o->val[k];
+        if (n->val[k] < o->val[k])
+            continue;   /* reset within window, already reported */
+        cp = get_pes_name(n->pes[k], b, sizeof(b));
+        printf("    %d: %s: +%u\n", n->phy_id[k], cp ? cp : "unknown",
+               delta);
+    }
+}
+
+/* Polls all phy events every interval_ms milliseconds, count times (or
+ * until SIGINT or SIGTERM when count is 0). The target is opened once.
+ * Successive snapshots are kept in a ring so that only the per interval
+ * deltas and threshold crossings need be output. Sleeps are to absolute
+ * deadlines so the sample period does not drift with response times. */
+static int
+do_sample(struct smp_target_obj * top, struct sample_t * smp)
+{
+    bool shown;
+    int k, res, sample, prev, missed;
+    int ret = 0;
+    uint64_t start_ms;
+    uint8_t * resp;
+    uint8_t * free_resp = NULL;
+    struct pe_snap_t * o;
+    struct pe_snap_t * n;
+    struct timespec dl;
+    struct sigaction sa, old_int, old_term;
+    struct smp_req_tmpl tmpl;
+
+    smp->ring = (struct pe_snap_t *)calloc(SAMPLE_RING_LEN,
+                                          sizeof(struct pe_snap_t));
+    resp = smp_memalign(SMP_FN_REPORT_PHY_EVENT_LIST_RESP_LEN, 0,
+                        &free_resp, false);
+    if ((NULL == smp->ring) || (NULL == resp)) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        ret = SMP_LIB_RESOURCE_ERROR;
+        goto fini;
+    }
+    /* request is 12 bytes: header, index, 4 reserved and CRC */
+    if (smp_tmpl_init(&tmpl, SMP_FN_REPORT_PHY_EVENT_LIST, 12, resp,
+                      SMP_FN_REPORT_PHY_EVENT_LIST_RESP_LEN, false,
+                      smp->verbose)) {
+        ret = SMP_LIB_CAT_OTHER;
+        goto fini;
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sig_handler;
+    sigemptyset(&sa.sa_mask);
+    got_signal = 0;
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+
+    clock_gettime(CLOCK_MONOTONIC, &dl);
+    smp->head = 0;
+    smp->filled = 0;
+    start_ms = mono_ms();
+    missed = 0;
+    for (sample = 0; (0 == smp->count) || (sample < smp->count); ++sample) {
+        prev = smp->head;
+        if (smp->filled > 0)
+            smp->head = (smp->head + 1) % SAMPLE_RING_LEN;
+        n = smp->ring + smp->head;
+        res = fetch_snapshot(top, smp, &tmpl, n);
+        if (res) {
+            ret = res;
+            break;
+        }
+        if (smp->filled < SAMPLE_RING_LEN)
+            ++smp->filled;
+        o = smp->ring + prev;
+        if (1 == smp->filled) {
+            if (NULL == smp->emp)
+                printf("Sampling %d phy event descriptors every %d ms\n",
+                       n->num, smp->interval_ms);
+        } else if (! same_layout(o, n)) {
+            /* phy events reconfigured, start again from this snapshot */
+            pr2serr("phy event descriptors changed, new baseline at sample "
+                    "%d\n", sample);
+            smp->ring[0] = *n;
+            smp->head = 0;
+            smp->filled = 1;
+        } else {
+            shown = false;
+            for (k = 0; k < n->num; ++k) {
+                if ((! shown) && (NULL == smp->emp) &&
+                    (n->val[k] != o->val[k])) {
+                    printf("sample %d at +%" PRIu64 " ms:\n", sample,
+                           n->ms - start_ms);
+                    shown = true;
+                }
+                show_delta(smp, sample, n->ms - start_ms, o, n, k);
+            }
+            if (smp->emp)
+                smp_emit_flush(smp->emp);
+            else if (shown)
+                fflush(stdout);
+        }
+        if (got_signal || (smp->count && ((sample + 1) >= smp->count)))
+            break;
+        add_ms(&dl, smp->interval_ms);
+        /* skip deadlines already passed rather than bunch up samples */
+        while ((((uint64_t)dl.tv_sec * 1000) + (dl.tv_nsec / 1000000)) <
+               mono_ms()) {
+            ++missed;
+            add_ms(&dl, smp->interval_ms);
+        }
+        while ((res = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &dl,
+                                      NULL)) && (EINTR == res) &&
+               (! got_signal))
+            ;
+        if (got_signal)
+            break;
+    }
+    if (missed)
+        pr2serr("%d sample period%s missed, expander slower than "
+                "--interval=%d\n", missed, (1 == missed) ? "" : "s",
+                smp->interval_ms);
+    if (NULL == smp->emp)
+        show_ring_summary(smp);
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+fini:
+    if (free_resp)
+        free(free_resp);
+    if (smp->ring)
+        free(smp->ring);
+    return ret;
+}
+
+/* --lockstep: opens every target and builds its request first, then sends
+ * the first REPORT PHY EVENT LIST request to all of them with
+ * smp_send_req_lockstep() so that the counters of different expanders are
+ * read as close together in time as possible. The rest of each target's
+ * descriptors are then paged through one by one. */
+static int
+do_lockstep(struct ls_tgt_t * tgts, int num_tgts, const char * i_params,
+            int starting_index, bool do_desc, bool do_long, bool do_nonz,
+            int verbose)
+{
+    int k, j, res, prev_pid;
+    int ret = 0;
+    unsigned int next;
+    uint64_t rel_us;
+    uint64_t first_min = UINT64_MAX;
+    uint64_t first_max = 0;
+    uint8_t * resp;
+    struct ls_tgt_t * tp;
+    struct pe_snap_t * snp;
+    struct smp_lockstep_tgt * ltp = NULL;
+
+    for (k = 0; k < num_tgts; ++k) {
+        tp = tgts + k;
+        if (smp_initiator_open(tp->dev_name, tp->subvalue, i_params, tp->sa,
+                               &tp->tobj, verbose) < 0) {
+            ret = SMP_LIB_FILE_ERROR;
+            goto fini;
+        }
+        tp->opened = true;
+        if (0 == tp->sa)
+            tp->sa = sg_get_unaligned_be64(tp->tobj.sas_addr);
+        resp = smp_memalign(SMP_FN_REPORT_PHY_EVENT_LIST_RESP_LEN, 0,
+                            &tp->free_resp, false);
+        tp->snp = (struct pe_snap_t *)calloc(1, sizeof(*tp->snp));
+        if ((NULL == resp) || (NULL == tp->snp)) {
+            pr2serr("%s: heap allocation problem\n", __func__);
+            ret = SMP_LIB_RESOURCE_ERROR;
+            goto fini;
+        }
+        if (smp_tmpl_init(&tp->tmpl, SMP_FN_REPORT_PHY_EVENT_LIST, 12, resp,
+                          SMP_FN_REPORT_PHY_EVENT_LIST_RESP_LEN, false,
+                          verbose)) {
+            ret = SMP_LIB_CAT_OTHER;
+            goto fini;
+        }
+        smp_tmpl_set_idx(&tp->tmpl, starting_index);
+    }
+    ltp = (struct smp_lockstep_tgt *)calloc(num_tgts, sizeof(*ltp));
+    if (NULL == ltp) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        ret = SMP_LIB_RESOURCE_ERROR;
+        goto fini;
+    }
+    for (k = 0; k < num_tgts; ++k) {
+        ltp[k].tobj = &tgts[k].tobj;
+        ltp[k].rresp = &tgts[k].tmpl.rr;
+        ltp[k].num = 1;
+        ltp[k].sent_us = &tgts[k].sent_us;
+        ltp[k].lat_us = &tgts[k].lat_us;
+    }
+    if (smp_send_req_lockstep(ltp, num_tgts, 0, &rel_us, verbose) < 0) {
+        pr2serr("unable to start a thread per SMP target\n");
+        ret = SMP_LIB_RESOURCE_ERROR;
+        goto fini;
+    }
+
+    printf("Report phy event list, lock-step read of %d SMP target%s "
+           "released at\n%" PRIu64 ".%06" PRIu64 " s (CLOCK_MONOTONIC):\n",
+           num_tgts, ((1 == num_tgts) ? "" : "s"), rel_us / 1000000,
+           rel_us % 1000000);
+    for (k = 0; k < num_tgts; ++k) {
+        tp = tgts + k;
+        snp = tp->snp;
+        printf("%s%s, SAS address 0x%" PRIx64 "\n", (k ? "\n" : ""),
+               tp->dev_name, tp->sa);
+        if (ltp[k].failed) {
+            pr2serr("%s: smp_send_req failed\n", tp->dev_name);
+            if (0 == ret)
+                ret = SMP_LIB_CAT_OTHER;
+            continue;
+        }
+        if (tp->sent_us < first_min)
+            first_min = tp->sent_us;
+        if (tp->sent_us > first_max)
+            first_max = tp->sent_us;
+        printf("  first request sent at %" PRIu64 ".%06" PRIu64 " s, "
+               "latency %u us\n", tp->sent_us / 1000000,
+               tp->sent_us % 1000000, tp->lat_us);
+        res = add_page(&tp->tmpl, starting_index, snp, &next);
+        if ((0 == res) && (next > 0))
+            res = fetch_pages(&tp->tobj, &tp->tmpl, next, snp, verbose);
+        if (res) {
+            pr2serr("%s: unable to fetch all phy event descriptors\n",
+                    tp->dev_name);
+            if (0 == ret)
+                ret = res;
+        }
+        for (j = 0, prev_pid = -1; j < snp->num;
+             prev_pid = snp->phy_id[j], ++j) {
+            if (do_nonz && (0 == snp->val[j]))
+                continue;
+            if (do_desc)
+                printf("   Descriptor index %u:\n", starting_index + j);
+            show_phy_event_info(snp->phy_id[j], prev_pid, snp->pes[j],
+                                snp->val[j], snp->thresh[j], do_long);
+        }
+    }
+    if ((num_tgts > 1) && (first_max >= first_min))
+        printf("\nFirst requests to each SMP target sent within %" PRIu64
+               " us of each other\n", first_max - first_min);
+fini:
+    free(ltp);
+    for (k = 0; k < num_tgts; ++k) {
+        tp = tgts + k;
+        if (tp->opened && (smp_initiator_close(&tp->tobj) < 0) &&
+            (0 == ret))
+            ret = SMP_LIB_FILE_ERROR;
+        free(tp->snp);
+        if (tp->free_resp)
+            free(tp->free_resp);
+    }
+    return ret;
+}
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_rep_phy_event_list_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
     bool do_desc = false;
     bool do_enumerate = false;
     bool do_force = false;
     bool do_long = false;
+    bool lockstep = false;
     bool do_nonz = false;
     bool do_raw = false;
-    int res, c, k, len, ped_len, num_ped, pes, phy_id, prev_pid, act_resplen;
+    int res, c, k, j, len, ped_len, num_ped, pes, phy_id, prev_pid;
+    int act_resplen;
     int do_hex = 0;
+    int num_sa = 0;
+    int num_tgts = 0;
+    int out_fmt = 0;
     int ret = 0;
     int starting_index = DEF_STARTING_INDEX;
+    int count = -1;
+    int interval_ms = 0;
     int subvalue = 0;
     int verbose = 0;
     unsigned int first_di, last_di, pe_val, pvdt;
     int64_t sa_ll;
     uint64_t sa = 0;
+    uint64_t sa_arr[MAX_SAS_ADDRS];
     char * cp;
     uint8_t * pedp;
     const struct pes_name_t * pnp;
@@ -326,18 +879,28 @@ main(int argc, char * argv[])
     uint8_t * free_smp_resp = NULL;
     struct smp_req_resp smp_rr;
     struct smp_target_obj tobj;
+    struct smp_emit emit;
+    struct smp_emit * emp = NULL;
+    struct ls_tgt_t * tgts;
 
     memset(device_name, 0, sizeof device_name);
     memset(i_params, 0, sizeof i_params);
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "defhHi:I:lnrs:vV", long_options,
-                        &option_index);
+        c = getopt_long(argc, argv, "c:defhHi:I:jLlnrs:t:vVx",
+                        long_options, &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'c':
+            count = smp_get_num(optarg);
+            if (count < 0) {
+                pr2serr("bad argument to '--count'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'd':
             do_desc = true;
             break;
@@ -365,6 +928,12 @@ main(int argc, char * argv[])
             strncpy(i_params, optarg, sizeof(i_params));
             i_params[sizeof(i_params) - 1] = '\0';
             break;
+        case 'j':
+            out_fmt = SMP_EMIT_JSON;
+            break;
+        case 'L':
+            lockstep = true;
+            break;
         case 'l':
             do_long = true;
             break;
@@ -380,7 +949,20 @@ main(int argc, char * argv[])
                 pr2serr("bad argument to '--sa'\n");
                 return SMP_LIB_SYNTAX_ERROR;
             }
+            if (num_sa >= MAX_SAS_ADDRS) {
+                pr2serr("'--sa' given more than %d times\n", MAX_SAS_ADDRS);
+                return SMP_LIB_SYNTAX_ERROR;
+            }
             sa = (uint64_t)sa_ll;
+            sa_arr[num_sa++] = sa;
+            break;
+        case 't':
+            interval_ms = smp_get_num(optarg);
+            if (interval_ms < 1) {
+                pr2serr("bad argument to '--interval', expect 1 or more "
+                        "milliseconds\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
             break;
         case 'v':
             ++verbose;
@@ -388,12 +970,72 @@ main(int argc, char * argv[])
         case 'V':
             pr2serr("version: %s\n", version_str);
             return 0;
+        case 'x':
+            out_fmt = SMP_EMIT_CSV;
+            break;
         default:
             pr2serr("unrecognised switch code 0x%x ??\n", c);
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
     }
+    if (lockstep) {
+        if (do_enumerate || do_force || do_hex || do_raw || out_fmt ||
+            (count >= 0) || interval_ms) {
+            pr2serr("--lockstep can't be given with --count=, --csv, "
+                    "--enumerate, --force,\n--hex, --interval=, --json or "
+                    "--raw\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+        tgts = (struct ls_tgt_t *)calloc(MAX_TARGETS, sizeof(*tgts));
+        if (NULL == tgts) {
+            pr2serr("heap allocation problem\n");
+            return SMP_LIB_RESOURCE_ERROR;
+        }
+        if ((optind >= argc) && (cp = getenv("SMP_UTILS_DEVICE")))
+            strncpy(device_name, cp, sizeof(device_name) - 1);
+        /* each SMP_DEVICE with each SAS_ADDR given */
+        for (j = optind; (j < argc) || ((j == optind) && (optind >= argc));
+             ++j) {
+            subvalue = 0;
+            if (j < argc)
+                strncpy(device_name, argv[j], sizeof(device_name) - 1);
+            if ((cp = strchr(device_name, SMP_SUBVALUE_SEPARATOR))) {
+                *cp = '\0';
+                if (1 != sscanf(cp + 1, "%d", &subvalue)) {
+                    pr2serr("expected number after separator in SMP_DEVICE "
+                            "name\n");
+                    ret = SMP_LIB_SYNTAX_ERROR;
+                    goto ls_fini;
+                }
+            }
+            for (k = 0; k < (num_sa ? num_sa : 1); ++k) {
+                if (num_tgts >= MAX_TARGETS) {
+                    pr2serr("more than %d SMP targets\n", MAX_TARGETS);
+                    ret = SMP_LIB_SYNTAX_ERROR;
+                    goto ls_fini;
+                }
+                tgts[num_tgts].subvalue = subvalue;
+                tgts[num_tgts].sa = num_sa ? sa_arr[k] : 0;
+                memcpy(tgts[num_tgts].dev_name, device_name,
+                       sizeof(tgts[0].dev_name));
+                ++num_tgts;
+            }
+        }
+        ret = do_lockstep(tgts, num_tgts, i_params, starting_index, do_desc,
+                          do_long, do_nonz, verbose);
+ls_fini:
+        free(tgts);
+        if (ret < 0)
+            ret = SMP_LIB_CAT_OTHER;
+        if (verbose && ret)
+            pr2serr("Exit status %d indicates error detected\n", ret);
+        return ret;
+    }
+    if (num_sa > 1) {
+        pr2serr("'--sa' may only be given more than once with --lockstep\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
     if (optind < argc) {
         if ('\0' == device_name[0]) {
             strncpy(device_name, argv[optind], sizeof(device_name) - 1);
@@ -418,9 +1060,10 @@ main(int argc, char * argv[])
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -461,6 +1104,34 @@ main(int argc, char * argv[])
     if (res < 0)
         return SMP_LIB_FILE_ERROR;
 
+    if ((count >= 0) || interval_ms) {
+        struct sample_t sam;
+
+        if (do_hex || do_raw) {
+            pr2serr("--interval=MS and --count=N can not be used with --hex "
+                    "or --raw\n");
+            ret = SMP_LIB_SYNTAX_ERROR;
+            goto err_out;
+        }
+        memset(&sam, 0, sizeof(sam));
+        sam.count = (count > 0) ? count : 0;
+        sam.interval_ms = interval_ms ? interval_ms : DEF_INTERVAL_MS;
+        sam.starting_index = starting_index;
+        sam.do_nonz = do_nonz;
+        sam.verbose = verbose;
+        if (out_fmt) {
+            if (smp_emit_init(&emit, out_fmt, stdout)) {
+                pr2serr("unable to allocate output buffer\n");
+                ret = SMP_LIB_RESOURCE_ERROR;
+                goto err_out;
+            }
+            emp = &emit;
+            sam.emp = emp;
+        }
+        ret = do_sample(&tobj, &sam);
+        goto err_out;
+    }
+
     /* Align SMP response buffer to a page boundary */
     smp_resp = smp_memalign(SMP_FN_REPORT_PHY_EVENT_LIST_RESP_LEN, 0,
                             &free_smp_resp, false);
@@ -554,18 +1225,27 @@ main(int argc, char * argv[])
         ret = smp_resp[2];
         goto err_out;
     }
-    printf("Report phy event list response:\n");
     res = sg_get_unaligned_be16(smp_resp + 4);
-    if (verbose || res)
-        printf("  Expander change count: %d\n", res);
     first_di = sg_get_unaligned_be16(smp_resp + 6);
     last_di = sg_get_unaligned_be16(smp_resp + 8);
-    printf("  first phy event list descriptor index: %u\n", first_di);
-    printf("  last phy event list descriptor index: %u\n", last_di);
-    printf("  phy event descriptor length: %d dwords\n", smp_resp[10]);
     ped_len = smp_resp[10] * 4;
     num_ped = smp_resp[15];
-    printf("  number of phy event descriptors: %d\n", num_ped);
+    if (out_fmt) {
+        if (smp_emit_init(&emit, out_fmt, stdout)) {
+            pr2serr("unable to allocate output buffer\n");
+            ret = SMP_LIB_RESOURCE_ERROR;
+            goto err_out;
+        }
+        emp = &emit;
+    } else {
+        printf("Report phy event list response:\n");
+        if (verbose || res)
+            printf("  Expander change count: %d\n", res);
+        printf("  first phy event list descriptor index: %u\n", first_di);
+        printf("  last phy event list descriptor index: %u\n", last_di);
+        printf("  phy event descriptor length: %d dwords\n", smp_resp[10]);
+        printf("  number of phy event descriptors: %d\n", num_ped);
+    }
     if (ped_len < 12) {
         pr2serr("Unexpectedly low descriptor length: %d bytes\n", ped_len);
         ret = -1;
@@ -575,7 +1255,7 @@ main(int argc, char * argv[])
     for (k = 0, prev_pid = -1; k < num_ped;
          ++k, pedp += ped_len, prev_pid = phy_id) {
         if ((! do_force) && ((first_di + k) > last_di)) {
-            if (do_long)
+            if (do_long && (NULL == emp))
                 printf("last descriptor index exceeded, exiting\n");
             break;
         }
@@ -583,16 +1263,35 @@ main(int argc, char * argv[])
         pes = pedp[3];
         pe_val = sg_get_unaligned_be32(pedp + 4);
         pvdt = sg_get_unaligned_be32(pedp + 8);
-        if ((! do_nonz) || pe_val) {
-            if (do_desc)
-                printf("   Descriptor index %u:\n", first_di + k);
-            show_phy_event_info(phy_id, prev_pid, pes, pe_val, pvdt, do_long);
+        if (do_nonz && (0 == pe_val))
+            continue;
+        if (emp) {
+            smp_emit_rec_begin(emp);
+            smp_emit_int(emp, "expander_change_count", res);
+            smp_emit_int(emp, "descriptor_index", first_di + k);
+            smp_emit_int(emp, "phy_identifier", phy_id);
+            smp_emit_int(emp, "phy_event_source", pes);
+            smp_emit_str(emp, "phy_event_source_name",
+                         get_pes_name(pes, b, sizeof(b)));
+            smp_emit_int(emp, "phy_event", pe_val);
+            smp_emit_int(emp, "peak_value_detector_threshold", pvdt);
+            smp_emit_rec_end(emp);
+            continue;
         }
+        if (do_desc)
+            printf("   Descriptor index %u:\n", first_di + k);
+        show_phy_event_info(phy_id, prev_pid, pes, pe_val, pvdt, do_long);
+    }
+    if ((k >= num_ped) && ((first_di + k) < last_di)) {
+        if (emp)
+            pr2serr("Start next invocation at '--index=%u'\n", first_di + k);
+        else
+            printf("Start next invocation at '--index=%u'\n", first_di + k);
     }
-    if ((k >= num_ped) && ((first_di + k) < last_di))
-        printf("Start next invocation at '--index=%u'\n", first_di + k);
 
 err_out:
+    if (emp && smp_emit_fini(emp) && (0 == ret))
+        ret = SMP_LIB_FILE_ERROR;
     if (free_smp_resp)
         free(free_smp_resp);
     res = smp_initiator_close(&tobj);
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2018, Douglas Gilbert
+ * Copyright (c) 2006-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -50,21 +50,29 @@
  * utility.
  *
  * This utility issues a REPORT PHY SATA function and outputs its
- * response.
+ * response. With --all it finds the phys with a SATA device attached
+ * using DISCOVER LIST and sends REPORT PHY SATA to each of them.
  */
 
-static const char * version_str = "1.20 20180725";
+static const char * version_str = "1.21 20261014";
 
 #define SMP_FN_REPORT_PHY_SATA_RESP_LEN 72
+#define SMP_FN_DISCOVER_LIST_RESP_LEN 1028
+#define SMP_FN_DISCOVER_RESP_LEN 124
+#define MAX_DLIST_SHORT_DESCS 40
+#define MAX_PHY_ID 254
 
 static struct option long_options[] = {
     {"affiliation", required_argument, 0, 'a'},
+    {"all", no_argument, 0, 'A'},
+    {"from", required_argument, 0, 'F'},
     {"help", no_argument, 0, 'h'},
     {"hex", no_argument, 0, 'H'},
     {"interface", required_argument, 0, 'I'},
     {"phy", required_argument, 0, 'p'},
     {"raw", no_argument, 0, 'r'},
     {"sa", required_argument, 0, 's'},
+    {"save", required_argument, 0, 'w'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
     {"zero", no_argument, 0, 'z'},
@@ -75,16 +83,22 @@ static struct option long_options[] = {
 static void
 usage(void)
 {
-    pr2serr("Usage: smp_rep_phy_sata [--affiliation=AC] [--help] [--hex]\n"
-            "                        [--interface=PARAMS] [--phy=ID] "
+    pr2serr("Usage: smp_rep_phy_sata [--affiliation=AC] [--all] "
+            "[--from=FILE] [--help]\n"
+            "                        [--hex] [--interface=PARAMS] [--phy=ID] "
             "[--raw]\n"
-            "                        [--sa=SAS_ADDR] [--verbose] [--version] "
-            "[--zero]\n"
-            "                        SMP_DEVICE[,N]\n"
+            "                        [--sa=SAS_ADDR] [--save=FILE] "
+            "[--verbose]\n"
+            "                        [--version] [--zero] SMP_DEVICE[,N]\n"
             "  where:\n"
             "    --affiliation=AC|-a AC    relative identifier of affiliation "
             "context\n"
             "                              (def: 0)\n"
+            "    --all|-A             send to all phys with a SATA device "
+            "attached\n"
+            "    --from=FILE|-F FILE  answer requests from snapshot FILE "
+            "(written by\n"
+            "                         --save) rather than from <smp_device>\n"
             "    --help|-h            print out usage message\n"
             "    --hex|-H             print response in hexadecimal\n"
             "    --interface=PARAMS|-I PARAMS    specify or override "
@@ -97,6 +111,10 @@ usage(void)
             "Depending on\n"
             "                                 the interface, may not be "
             "needed\n"
+            "    --save=FILE|-w FILE  save each request and its response in "
+            "snapshot\n"
+            "                         FILE, to be read later with "
+            "--from=FILE\n"
             "    --verbose|-v         increase verbosity\n"
             "    --version|-V         print version string and exit\n"
             "    --zero|-z            zero Allocated Response Length "
@@ -116,9 +134,258 @@ dStrRaw(const uint8_t * str, int len)
 }
 
 
+/* Outputs the decoded REPORT PHY SATA response in rp, len bytes long
+ * (excluding CRC), each line prefixed by 'pre'. */
+static void
+decode_phy_sata(const uint8_t * rp, int len, const char * pre, int verbose)
+{
+    int k, res;
+
+    res = sg_get_unaligned_be16(rp + 4);
+    if (verbose || (res > 0))
+        printf("%sexpander change count: %d\n", pre, res);
+    printf("%sphy identifier: %d\n", pre, rp[9]);
+    printf("%sSTP I_T nexus loss occurred: %d\n", pre, !!(rp[11] & 0x4));
+    printf("%saffiliations supported: %d\n", pre, !!(rp[11] & 0x2));
+    printf("%saffiliation valid: %d\n", pre, !!(rp[11] & 0x1));
+    printf("%sSTP SAS address: 0x%" PRIx64 "\n", pre,
+           sg_get_unaligned_be64(rp + 16));
+    printf("%sregister device to host FIS:\n%s  ", pre, pre);
+    for (k = 0; k < 20; ++k)
+        printf("%02x ", rp[24 + k]);
+    printf("\n");
+    printf("%saffiliated STP initiator SAS address: 0x%" PRIx64 "\n", pre,
+           sg_get_unaligned_be64(rp + 48));
+    if (len > 63)
+        printf("%sSTP I_T nexus loss SAS address: 0x%" PRIx64 "\n", pre,
+               sg_get_unaligned_be64(rp + 56));
+    if (len > 67) {
+        printf("%saffiliation context: %d\n", pre, rp[65]);
+        printf("%scurrent affiliation contexts: %d\n", pre, rp[66]);
+        printf("%smaximum affiliation contexts: %d\n", pre, rp[67]);
+    }
+}
+
+/* Marks in sata_arr the phys that have a SATA device attached, using
+ * DISCOVER LIST with short descriptors and the end device phy filter, or
+ * DISCOVER of each phy if the expander does not support DISCOVER LIST.
+ * Returns the number of such phys, or a negated error. */
+static int
+find_sata_phys(struct smp_target_obj * top, int num_phys, bool * sata_arr,
+               int verbose)
+{
+    int k, j, res, len, sphy, ndesc, desc_len;
+    int num = 0;
+    const uint8_t * dp;
+    uint8_t * rp;
+    uint8_t * reqs;
+    struct smp_req_resp * rrp;
+    struct smp_discover_view dv;
+    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_DISCOVER_LIST, 0, 6,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                         0, 0, 0, 0, };
+    struct smp_req_resp smp_rr;
+
+    if (smp_discover_list_supported(top, verbose) > 0) {
+        rp = smp_buf_get(top, SMP_FN_DISCOVER_LIST_RESP_LEN);
+        if (NULL == rp)
+            return -SMP_LIB_RESOURCE_ERROR;
+        for (sphy = 0; sphy < num_phys; ) {
+            memset(rp, 0, SMP_FN_DISCOVER_LIST_RESP_LEN);
+            smp_req[2] = 0xff;
+            smp_req[8] = sphy;
+            smp_req[9] = MAX_DLIST_SHORT_DESCS;
+            smp_req[10] = 3;            /* phy filter: end devices */
+            smp_req[11] = 1;            /* short format */
+            memset(&smp_rr, 0, sizeof(smp_rr));
+            smp_rr.request_len = sizeof(smp_req);
+            smp_rr.request = smp_req;
+            smp_rr.max_response_len = SMP_FN_DISCOVER_LIST_RESP_LEN;
+            smp_rr.response = rp;
+            res = smp_send_req(top, &smp_rr, verbose);
+            if (res || smp_rr.transport_err)
+                return -SMP_LIB_CAT_OTHER;
+            if (((smp_rr.act_response_len >= 0) &&
+                 (smp_rr.act_response_len < 48)) ||
+                (SMP_FRAME_TYPE_RESP != rp[0]) || (rp[1] != smp_req[1]))
+                return -SMP_LIB_CAT_MALFORMED;
+            if (rp[2])
+                return -rp[2];
+            len = 4 + (4 * rp[3]);
+            if ((smp_rr.act_response_len >= 0) &&
+                (len > smp_rr.act_response_len))
+                len = smp_rr.act_response_len;
+            ndesc = rp[9];
+            desc_len = rp[12] * 4;
+            if (0 == ndesc)
+                break;          /* no more end devices */
+            if ((desc_len < 24) || (len < (48 + (ndesc * desc_len))))
+                return -SMP_LIB_CAT_MALFORMED;
+            for (j = 0, dp = rp + 48; j < ndesc; ++j, dp += desc_len) {
+                if (dp[1] || smp_decode_discover(dp, desc_len, 1, &dv) ||
+                    (dv.phy_id >= num_phys))
+                    continue;   /* function result in byte 1 */
+                if (dv.att_targ & SMP_DV_SATA) {
+                    sata_arr[dv.phy_id] = true;
+                    ++num;
+                }
+            }
+            /* with a filter the last phy reported need not be sphy + n */
+            sphy = dp[-desc_len] + 1;
+        }
+        return num;
+    }
+    /* no DISCOVER LIST so DISCOVER every phy, as one batch; from the heap
+     * since with many phys it outgrows the smp_buf_get() arena */
+    reqs = (uint8_t *)calloc(num_phys, 16 + SMP_FN_DISCOVER_RESP_LEN);
+    rrp = (struct smp_req_resp *)calloc(num_phys, sizeof(*rrp));
+    if ((NULL == reqs) || (NULL == rrp)) {
+        free(reqs);
+        free(rrp);
+        return -SMP_LIB_RESOURCE_ERROR;
+    }
+    for (k = 0; k < num_phys; ++k) {
+        uint8_t * qp = reqs + (16 * k);
+
+        qp[0] = SMP_FRAME_TYPE_REQ;
+        qp[1] = SMP_FN_DISCOVER;
+        qp[9] = k;
+        rrp[k].request_len = 16;
+        rrp[k].request = qp;
+        rrp[k].max_response_len = SMP_FN_DISCOVER_RESP_LEN;
+        rrp[k].response = reqs + (16 * num_phys) +
+                          (SMP_FN_DISCOVER_RESP_LEN * k);
+    }
+    smp_send_req_batch(top, rrp, num_phys, 0, NULL, NULL, verbose);
+    for (k = 0; k < num_phys; ++k) {
+        len = rrp[k].act_response_len;
+        if ((len < 0) || (len > SMP_FN_DISCOVER_RESP_LEN))
+            len = SMP_FN_DISCOVER_RESP_LEN;
+        if (smp_batch_resp_res(rrp + k, SMP_FN_DISCOVER) ||
+            smp_decode_discover(rrp[k].response, len - 4, 0, &dv))
+            continue;
+        if ((1 == dv.att_dev_type) && (dv.att_targ & SMP_DV_SATA)) {
+            sata_arr[k] = true;
+            ++num;
+        }
+    }
+    free(reqs);
+    free(rrp);
+    return num;
+}
+
+/* Sends REPORT PHY SATA, as one batch, to each phy that has a SATA device
+ * attached and outputs the responses in phy order. */
+static int
+do_all(struct smp_target_obj * top, int aff_context, bool do_zero,
+       int verbose)
+{
+    int k, n, res, num, len;
+    int ret = 0;
+    const uint8_t * rp;
+    uint8_t * reqs = NULL;
+    uint8_t * resps = NULL;
+    struct smp_req_resp * rrp = NULL;
+    struct smp_report_general rg;
+    bool sata_arr[MAX_PHY_ID + 1];
+    char b[128];
+
+    res = smp_get_report_general(top, &rg, -1, verbose);
+    if (res) {
+        if (res > 0)
+            pr2serr("REPORT GENERAL failed: %s\n",
+                    (SMP_LIB_CAT_MALFORMED == res) ? "malformed response" :
+                    smp_get_func_res_str(res, sizeof(b), b));
+        return res;
+    }
+    memset(sata_arr, 0, sizeof(sata_arr));
+    num = find_sata_phys(top, rg.num_phys, sata_arr, verbose);
+    if (num < 0) {
+        pr2serr("unable to find phys with SATA devices attached\n");
+        return -num;
+    }
+    if (verbose)
+        pr2serr("%d of %d phys have a SATA device attached\n", num,
+                rg.num_phys);
+    if (0 == num) {
+        printf("No phys with a SATA device attached\n");
+        return 0;
+    }
+    reqs = (uint8_t *)calloc(num, 16);
+    resps = (uint8_t *)calloc(num, SMP_FN_REPORT_PHY_SATA_RESP_LEN);
+    rrp = (struct smp_req_resp *)calloc(num, sizeof(struct smp_req_resp));
+    if ((NULL == reqs) || (NULL == resps) || (NULL == rrp)) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        ret = SMP_LIB_RESOURCE_ERROR;
+        goto fini;
+    }
+    for (n = 0, k = 0; k < rg.num_phys; ++k) {
+        uint8_t * qp = reqs + (16 * n);
+
+        if (! sata_arr[k])
+            continue;
+        qp[0] = SMP_FRAME_TYPE_REQ;
+        qp[1] = SMP_FN_REPORT_PHY_SATA;
+        if (! do_zero) {
+            len = (SMP_FN_REPORT_PHY_SATA_RESP_LEN - 8) / 4;
+            qp[2] = (len < 0x100) ? len : 0xff;
+            qp[3] = 2;
+        }
+        qp[9] = k;
+        qp[10] = aff_context;
+        rrp[n].request_len = 16;
+        rrp[n].request = qp;
+        rrp[n].max_response_len = SMP_FN_REPORT_PHY_SATA_RESP_LEN;
+        rrp[n].response = resps + (SMP_FN_REPORT_PHY_SATA_RESP_LEN * n);
+        ++n;
+    }
+    smp_send_req_batch(top, rrp, n, 0, NULL, NULL, verbose);
+    for (k = 0; k < n; ++k) {
+        rp = rrp[k].response;
+        res = smp_batch_resp_res(rrp + k, SMP_FN_REPORT_PHY_SATA);
+        if (res) {
+            if (res > 0)
+                pr2serr("phy %d: %s\n", rrp[k].request[9],
+                        (SMP_LIB_CAT_MALFORMED == res) ?
+                        "malformed response" :
+                        smp_get_func_res_str(res, sizeof(b), b));
+            else
+                pr2serr("phy %d: request failed\n", rrp[k].request[9]);
+            if (0 == ret)
+                ret = (res > 0) ? res : SMP_LIB_CAT_OTHER;
+            continue;
+        }
+        len = 4 + (4 * rp[3]);
+        if ((rrp[k].act_response_len >= 0) &&
+            (len > rrp[k].act_response_len))
+            len = rrp[k].act_response_len;
+        if (len < 56) {
+            pr2serr("phy %d: response too short\n", rrp[k].request[9]);
+            if (0 == ret)
+                ret = SMP_LIB_CAT_MALFORMED;
+            continue;
+        }
+        printf("Report phy SATA response, phy %d:\n", rp[9]);
+        decode_phy_sata(rp, len, "  ", verbose);
+    }
+fini:
+    free(rrp);
+    free(resps);
+    free(reqs);
+    return ret;
+}
+
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_rep_phy_sata_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
+    bool do_all_phys = false;
     bool do_raw = false;
     bool do_zero = false;
     bool phy_id_given = false;
@@ -131,6 +398,8 @@ main(int argc, char * argv[])
     int verbose = 0;
     int64_t sa_ll;
     uint64_t sa = 0;
+    const char * save_fn = NULL;
+    const char * from_fn = NULL;
     char * cp;
     char i_params[256];
     char device_name[512];
@@ -147,7 +416,7 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "ahHI:p:rs:vVz", long_options,
+        c = getopt_long(argc, argv, "a:AF:hHI:p:rs:vVw:z", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -160,6 +429,12 @@ main(int argc, char * argv[])
                 return SMP_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'A':
+            do_all_phys = true;
+            break;
+        case 'F':
+            from_fn = optarg;
+            break;
         case 'h':
         case '?':
             usage();
@@ -197,6 +472,9 @@ main(int argc, char * argv[])
         case 'V':
             pr2serr("version: %s\n", version_str);
             return 0;
+        case 'w':
+            save_fn = optarg;
+            break;
         case 'z':
             do_zero = true;
             break;
@@ -223,9 +501,11 @@ main(int argc, char * argv[])
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == sa) && (NULL == from_fn) &&
+                 (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -260,10 +540,28 @@ main(int argc, char * argv[])
         }
     }
 
+    if (do_all_phys && (phy_id_given || do_hex || do_raw)) {
+        pr2serr("--all can't be given with --phy=, --hex or --raw\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
+
+    if (from_fn && (res = smp_snap_load(from_fn, verbose)))
+        return (res < 0) ? SMP_LIB_FILE_ERROR : res;
+    if (save_fn && (res = smp_snap_save_begin(save_fn, verbose))) {
+        if (from_fn)
+            smp_snap_unload();
+        return (res < 0) ? SMP_LIB_FILE_ERROR : res;
+    }
     res = smp_initiator_open(device_name, subvalue, i_params, sa,
                              &tobj, verbose);
-    if (res < 0)
-        return SMP_LIB_FILE_ERROR;
+    if (res < 0) {
+        ret = SMP_LIB_FILE_ERROR;
+        goto snap_fini;
+    }
+    if (do_all_phys) {
+        ret = do_all(&tobj, aff_context, do_zero, verbose);
+        goto err_out;
+    }
 
     /* Align SMP response buffer to a page boundary */
     smp_resp = smp_memalign(SMP_FN_REPORT_PHY_SATA_RESP_LEN, 0,
@@ -364,37 +662,22 @@ main(int argc, char * argv[])
         goto err_out;
     }
     printf("Report phy SATA response:\n");
-    res = sg_get_unaligned_be16(smp_resp + 4);
-    if (verbose || (res > 0))
-        printf("  expander change count: %d\n", res);
-    printf("  phy identifier: %d\n", smp_resp[9]);
-    printf("  STP I_T nexus loss occurred: %d\n", !!(smp_resp[11] & 0x4));
-    printf("  affiliations supported: %d\n", !!(smp_resp[11] & 0x2));
-    printf("  affiliation valid: %d\n", !!(smp_resp[11] & 0x1));
-    printf("  STP SAS address: 0x%" PRIx64 "\n",
-           sg_get_unaligned_be64(smp_resp + 16));
-    printf("  register device to host FIS:\n    ");
-    for (k = 0; k < 20; ++k)
-        printf("%02x ", smp_resp[24 + k]);
-    printf("\n");
-    printf("  affiliated STP initiator SAS address: 0x%" PRIx64 "\n",
-           sg_get_unaligned_be64(smp_resp + 48));
-    if (len > 63)
-        printf("  STP I_T nexus loss SAS address: 0x%" PRIx64 "\n",
-               sg_get_unaligned_be64(smp_resp + 56));
-    if (len > 67) {
-        printf("  affiliation context: %d\n", smp_resp[65]);
-        printf("  current affiliation contexts: %d\n", smp_resp[66]);
-        printf("  maximum affiliation contexts: %d\n", smp_resp[67]);
-    }
+    decode_phy_sata(smp_resp, len, "  ", verbose);
 
 err_out:
+    if (free_smp_resp)
+        free(free_smp_resp);
     res = smp_initiator_close(&tobj);
     if (res < 0) {
         pr2serr("close error: %s\n", safe_strerror(errno));
         if (0 == ret)
-            return SMP_LIB_FILE_ERROR;
+            ret = SMP_LIB_FILE_ERROR;
     }
+snap_fini:
+    if (save_fn && smp_snap_save_end(verbose) && (0 == ret))
+        ret = SMP_LIB_FILE_ERROR;
+    if (from_fn)
+        smp_snap_unload();
     if (ret < 0)
         ret = SMP_LIB_CAT_OTHER;
     if (verbose && ret)
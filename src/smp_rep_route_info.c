@@ -50,21 +50,28 @@
  * utility.
  *
  * This utility issues a REPORT ROUTE INFORMATION function and outputs its
- * response.
+ * response. With --all it fetches the route tables of all table routed
+ * phys of an expander, the phys in parallel, and outputs the enabled
+ * entries sorted by routed SAS address.
  */
 
-static const char * version_str = "1.16 20180725";
+static const char * version_str = "1.17 20261014";
 
 #define REP_ROUTE_INFO_RESP_LEN 44
+#define SMP_FN_DISCOVER_RESP_LEN 124
 
 static struct option long_options[] = {
+    {"all", no_argument, 0, 'a'},
+    {"csv", no_argument, 0, 'x'},
     {"help", no_argument, 0, 'h'},
     {"hex", no_argument, 0, 'H'},
     {"index", required_argument, 0, 'i'},
     {"interface", required_argument, 0, 'I'},
+    {"json", no_argument, 0, 'j'},
     {"multiple", no_argument, 0, 'm'},
     {"num", required_argument, 0, 'n'},
     {"phy", required_argument, 0, 'p'},
+    {"queue", required_argument, 0, 'q'},
     {"raw", no_argument, 0, 'r'},
     {"sa", required_argument, 0, 's'},
     {"verbose", no_argument, 0, 'v'},
@@ -77,25 +84,40 @@ static struct option long_options[] = {
 static void
 usage(void)
 {
-    pr2serr("Usage: smp_rep_route_info [--help] [--hex] [--index=IN] "
-            "[--interface=PARAMS]\n"
-            "                          [--multiple] [--num=NUM] [--phy=ID] "
+    pr2serr("Usage: smp_rep_route_info [--all] [--csv] [--help] [--hex] "
+            "[--index=IN]\n"
+            "                          [--interface=PARAMS] [--json] "
+            "[--multiple]\n"
+            "                          [--num=NUM] [--phy=ID] [--queue=QD] "
             "[--raw]\n"
             "                          [--sa=SAS_ADDR] [--verbose] "
             "[--version]\n"
             "                          [--zero] SMP_DEVICE[,N]\n"
             "  where:\n"
+            "    --all|-a          fetch route tables of all table routed "
+            "phys, output\n"
+            "                      enabled entries sorted by routed SAS "
+            "address\n"
+            "    --csv|-x          with --all: output CSV, one line per "
+            "entry\n"
             "    --help|-h         print out usage message\n"
             "    --hex|-H          print response in hexadecimal\n"
             "    --index=IN|-i IN    expander route index (def: 0)\n"
             "    --interface=PARAMS|-I PARAMS    specify or override "
             "interface\n"
+            "    --json|-j         with --all: output JSON, one object per "
+            "entry\n"
             "    --multiple|-m     query multiple indexes, output 1 "
             "line for each\n"
             "    --num=NUM|-n NUM  number of indexes to examine when '-m' "
             "is given\n"
             "    --phy=ID|-p ID    phy identifier (def: 0)\n"
-            "    --raw|-r          output response in binary\n"
+            "    --queue=QD|-q QD    with --all: requests kept in flight "
+            "(def: 8)\n"
+            "    --raw|-r          output response in binary (with --all: "
+            "12 bytes\n"
+            "                      per entry: routed SAS address, phy id, "
+            "index)\n"
             "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of SMP "
             "target (use leading\n"
             "                                 '0x' or trailing 'h'). "
@@ -272,6 +294,261 @@ do_multiple(struct smp_target_obj * top, int phy_id, int index, int num_ind,
     return 0;
 }
 
+#define ALL_CHUNK_MIN 8          /* indexes per phy in the first round */
+#define ALL_CHUNK_MAX 64
+
+struct route_ent_t {
+    uint64_t sa;                /* routed SAS address */
+    uint16_t index;
+    uint8_t phy_id;
+};
+
+/* Per table routed phy: where its next round starts */
+struct all_phy_t {
+    bool done;
+    int next;
+    int adj_dis;
+    int chunk;
+};
+
+static int
+cmp_route_ent(const void * a, const void * b)
+{
+    const struct route_ent_t * ea = (const struct route_ent_t *)a;
+    const struct route_ent_t * eb = (const struct route_ent_t *)b;
+
+    if (ea->sa != eb->sa)
+        return (ea->sa < eb->sa) ? -1 : 1;
+    if (ea->phy_id != eb->phy_id)
+        return (ea->phy_id < eb->phy_id) ? -1 : 1;
+    return (int)ea->index - (int)eb->index;
+}
+
+static void
+output_all(const struct route_ent_t * ents, int num, uint64_t exp_sa,
+           int num_tphys, int out_fmt, bool do_raw)
+{
+    int k;
+    uint8_t b[12];
+    struct smp_emit emit;
+
+    if (do_raw) {
+        for (k = 0; k < num; ++k) {
+            sg_put_unaligned_be64(ents[k].sa, b + 0);
+            sg_put_unaligned_be16(ents[k].phy_id, b + 8);
+            sg_put_unaligned_be16(ents[k].index, b + 10);
+            dStrRaw(b, sizeof(b));
+        }
+        return;
+    }
+    if (out_fmt) {
+        if (smp_emit_init(&emit, out_fmt, stdout)) {
+            pr2serr("unable to set up output buffer\n");
+            return;
+        }
+        for (k = 0; k < num; ++k) {
+            smp_emit_rec_begin(&emit);
+            smp_emit_hex64(&emit, "routed_sas_address", ents[k].sa);
+            smp_emit_int(&emit, "phy_identifier", ents[k].phy_id);
+            smp_emit_int(&emit, "expander_route_index", ents[k].index);
+            smp_emit_rec_end(&emit);
+        }
+        smp_emit_fini(&emit);
+        return;
+    }
+    printf("Route tables of expander 0x%" PRIx64 ": %d enabled entries "
+           "over %d table routed phys, by routed SAS address\n", exp_sa,
+           num, num_tphys);
+    for (k = 0; k < num; ++k)
+        printf("  0x%" PRIx64 "  phy_id: %-3d  index: %d\n", ents[k].sa,
+               ents[k].phy_id, ents[k].index);
+}
+
+/* Fetches the route tables of all table routed phys. Each round sends, in
+ * one batch, the next chunk of indexes for every phy not yet done; a phy
+ * is done at the last route index, at a NO INDEX function result or after
+ * MAX_ADJACENT_DISABLED disabled entries in a row (as do_multiple() does).
+ * Chunks double while a phy's entries stay enabled so long tables take few
+ * rounds, while mostly empty ones stop early. */
+static int
+do_all(struct smp_target_obj * top, bool do_zero, int out_fmt, bool do_raw,
+       int queue_depth, int verbose)
+{
+    int k, j, n, res, num_phys, max_ind, num_req, num_tphys, len;
+    int num_ents = 0;
+    int max_ents = 0;
+    int ret = 0;
+    uint64_t exp_sa = 0;
+    const uint8_t * rp;
+    uint8_t * reqs = NULL;
+    uint8_t * resps = NULL;
+    struct route_ent_t * ents = NULL;
+    struct route_ent_t * ep;
+    struct smp_req_resp * rrp = NULL;
+    struct all_phy_t * app = NULL;
+    struct smp_report_general rg;
+    char b[128];
+
+    res = smp_get_report_general(top, &rg, -1, verbose);
+    if (res)
+        return res;
+    num_phys = rg.num_phys;
+    max_ind = rg.exp_route_indexes ? rg.exp_route_indexes : MAX_NUM_INDEXES;
+    if (num_phys < 1)
+        return 0;
+    reqs = (uint8_t *)calloc(num_phys * ALL_CHUNK_MAX, 16);
+    resps = (uint8_t *)calloc(num_phys * ALL_CHUNK_MAX,
+                              SMP_FN_DISCOVER_RESP_LEN);
+    rrp = (struct smp_req_resp *)calloc(num_phys * ALL_CHUNK_MAX,
+                                        sizeof(struct smp_req_resp));
+    app = (struct all_phy_t *)calloc(num_phys, sizeof(struct all_phy_t));
+    if ((NULL == reqs) || (NULL == resps) || (NULL == rrp) || (NULL == app)) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        ret = SMP_LIB_RESOURCE_ERROR;
+        goto fini;
+    }
+    /* DISCOVER each phy to find which are table routed */
+    for (k = 0; k < num_phys; ++k) {
+        uint8_t * qp = reqs + (16 * k);
+
+        qp[0] = SMP_FRAME_TYPE_REQ;
+        qp[1] = SMP_FN_DISCOVER;
+        if (! do_zero) {
+            qp[2] = (SMP_FN_DISCOVER_RESP_LEN - 8) / 4;
+            qp[3] = 2;
+        }
+        qp[9] = k;
+        rrp[k].request_len = 16;
+        rrp[k].request = qp;
+        rrp[k].max_response_len = SMP_FN_DISCOVER_RESP_LEN;
+        rrp[k].response = resps + (SMP_FN_DISCOVER_RESP_LEN * k);
+    }
+    smp_send_req_batch(top, rrp, num_phys, queue_depth, NULL, NULL,
+                       verbose);
+    for (num_tphys = 0, k = 0; k < num_phys; ++k) {
+        rp = rrp[k].response;
+        app[k].done = true;
+        if (smp_batch_resp_res(rrp + k, SMP_FN_DISCOVER))
+            continue;   /* e.g. vacant phy */
+        if (0 == exp_sa)
+            exp_sa = sg_get_unaligned_be64(rp + 16);
+        if (2 != (rp[44] & 0xf))
+            continue;   /* not table routed */
+        app[k].done = false;
+        app[k].chunk = ALL_CHUNK_MIN;
+        ++num_tphys;
+    }
+    if (verbose)
+        pr2serr("%d table routed phys of %d, up to %d route indexes each\n",
+                num_tphys, num_phys, max_ind);
+    while (1) {
+        for (num_req = 0, k = 0; k < num_phys; ++k) {
+            if (app[k].done)
+                continue;
+            n = app[k].chunk;
+            if (n > (max_ind - app[k].next))
+                n = max_ind - app[k].next;
+            for (j = 0; j < n; ++j, ++num_req) {
+                uint8_t * qp = reqs + (16 * num_req);
+
+                memset(qp, 0, 16);
+                qp[0] = SMP_FRAME_TYPE_REQ;
+                qp[1] = SMP_FN_REPORT_ROUTE_INFO;
+                if (! do_zero) {
+                    qp[2] = (REP_ROUTE_INFO_RESP_LEN - 8) / 4;
+                    qp[3] = 2;
+                }
+                sg_put_unaligned_be16(app[k].next + j, qp + 6);
+                qp[9] = k;
+                memset(&rrp[num_req], 0, sizeof(rrp[0]));
+                rrp[num_req].request_len = 16;
+                rrp[num_req].request = qp;
+                rrp[num_req].max_response_len = REP_ROUTE_INFO_RESP_LEN;
+                rrp[num_req].response = resps +
+                                        (REP_ROUTE_INFO_RESP_LEN * num_req);
+                memset(rrp[num_req].response, 0, REP_ROUTE_INFO_RESP_LEN);
+            }
+        }
+        if (0 == num_req)
+            break;
+        smp_send_req_batch(top, rrp, num_req, queue_depth, NULL, NULL,
+                           verbose);
+        /* requests are in phy then index order */
+        for (j = 0; j < num_req; ++j) {
+            rp = rrp[j].response;
+            k = rrp[j].request[9];
+            if (app[k].done)
+                continue;
+            n = sg_get_unaligned_be16(rrp[j].request + 6);
+            res = smp_batch_resp_res(rrp + j, SMP_FN_REPORT_ROUTE_INFO);
+            if (SMP_FRES_NO_INDEX == res) {
+                app[k].done = true;     /* expected, end condition */
+                continue;
+            }
+            if (res) {
+                if (verbose) {
+                    if (res > 0)
+                        pr2serr("phy %d index %d: %s\n", k, n,
+                                (res == SMP_LIB_CAT_MALFORMED) ?
+                                "malformed response" :
+                                smp_get_func_res_str(res, sizeof(b), b));
+                    else
+                        pr2serr("phy %d index %d: request failed\n", k, n);
+                }
+                if (0 == ret)
+                    ret = (res > 0) ? res : SMP_LIB_CAT_OTHER;
+                app[k].done = true;
+                continue;
+            }
+            if (rp[12] & 0x80) {        /* disabled */
+                if (++app[k].adj_dis >= MAX_ADJACENT_DISABLED) {
+                    if (verbose > 2)
+                        pr2serr("phy %d: number of 'adjacent disables' "
+                                "exceeded at index=%d\n", k, n);
+                    app[k].done = true;
+                }
+                continue;
+            }
+            app[k].adj_dis = 0;
+            if (num_ents >= max_ents) {
+                max_ents = max_ents ? (2 * max_ents) : 256;
+                ep = (struct route_ent_t *)realloc(ents, max_ents *
+                                                   sizeof(*ents));
+                if (NULL == ep) {
+                    pr2serr("%s: heap allocation problem\n", __func__);
+                    ret = SMP_LIB_RESOURCE_ERROR;
+                    goto fini;
+                }
+                ents = ep;
+            }
+            ep = ents + num_ents++;
+            ep->sa = sg_get_unaligned_be64(rp + 16);
+            ep->phy_id = k;
+            ep->index = n;
+        }
+        for (k = 0; k < num_phys; ++k) {
+            if (app[k].done)
+                continue;
+            len = app[k].chunk;
+            app[k].next += len;
+            if (app[k].next >= max_ind)
+                app[k].done = true;
+            else if ((0 == app[k].adj_dis) && (len < ALL_CHUNK_MAX))
+                app[k].chunk = 2 * len;
+        }
+    }
+    if (num_ents > 1)
+        qsort(ents, num_ents, sizeof(*ents), cmp_route_ent);
+    output_all(ents, num_ents, exp_sa, num_tphys, out_fmt, do_raw);
+fini:
+    free(ents);
+    free(app);
+    free(rrp);
+    free(resps);
+    free(reqs);
+    return ret;
+}
+
 static int
 do_single(struct smp_target_obj * top, int phy_id, int index, bool do_zero,
           int do_hex, bool do_raw, int verbose)
@@ -302,9 +579,15 @@ do_single(struct smp_target_obj * top, int phy_id, int index, bool do_zero,
 }
 
 
+#ifdef SMP_UTILS_MULTI
+int
+smp_rep_route_info_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
+    bool do_all_phys = false;
     bool do_raw = false;
     bool do_zero = false;
     bool multiple = false;
@@ -312,7 +595,9 @@ main(int argc, char * argv[])
     int do_hex = 0;
     int do_num = 0;
     int er_ind = 0;
+    int out_fmt = 0;
     int phy_id = 0;
+    int queue_depth = 0;
     int ret = 0;
     int subvalue = 0;
     int verbose = 0;
@@ -329,12 +614,15 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "hHi:I:mn:p:rs:vVz", long_options,
+        c = getopt_long(argc, argv, "ahHi:I:jmn:p:q:rs:vVxz", long_options,
                         &option_index);
         if (c == -1)
             break;
 
         switch (c) {
+        case 'a':
+            do_all_phys = true;
+            break;
         case 'h':
         case '?':
             usage();
@@ -354,6 +642,9 @@ main(int argc, char * argv[])
             strncpy(i_params, optarg, sizeof(i_params));
             i_params[sizeof(i_params) - 1] = '\0';
             break;
+        case 'j':
+            out_fmt = SMP_EMIT_JSON;
+            break;
         case 'm':
             multiple = true;
             break;
@@ -373,6 +664,14 @@ main(int argc, char * argv[])
                 return SMP_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'q':
+           queue_depth = smp_get_num(optarg);
+           if ((queue_depth < 1) || (queue_depth > SMP_BATCH_MAX_INFLIGHT)) {
+                pr2serr("bad argument to '--queue', expect value from 1 to "
+                        "%d\n", SMP_BATCH_MAX_INFLIGHT);
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'r':
             do_raw = true;
             break;
@@ -390,6 +689,9 @@ main(int argc, char * argv[])
         case 'V':
             pr2serr("version: %s\n", version_str);
             return 0;
+        case 'x':
+            out_fmt = SMP_EMIT_CSV;
+            break;
         case 'z':
             do_zero = true;
             break;
@@ -416,9 +718,10 @@ main(int argc, char * argv[])
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -452,6 +755,10 @@ main(int argc, char * argv[])
             }
         }
     }
+    if (do_all_phys && (multiple || do_hex)) {
+        pr2serr("--all conflicts with --multiple and --hex\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
     if (verbose > 2)
             pr2serr("  phy_id=%d  expander_route_index=%d\n", phy_id, er_ind);
 
@@ -460,7 +767,9 @@ main(int argc, char * argv[])
     if (res < 0)
         return SMP_LIB_FILE_ERROR;
 
-    if (multiple)
+    if (do_all_phys)
+        ret = do_all(&tobj, do_zero, out_fmt, do_raw, queue_depth, verbose);
+    else if (multiple)
         ret = do_multiple(&tobj, phy_id, er_ind, do_num, do_zero, do_hex,
                           do_raw, verbose);
     else
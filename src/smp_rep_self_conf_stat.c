@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2011-2018, Douglas Gilbert
+ * Copyright (c) 2011-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -33,6 +33,9 @@
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <inttypes.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -48,15 +51,38 @@
  * utility.
  *
  * This utility issues a REPORT SELF-CONFIGURATION STATUS function and
- * outputs its response.
+ * outputs its response. With --follow it polls, only fetching and
+ * outputting descriptors recorded since the previous poll.
  */
 
-static const char * version_str = "1.08 20180725";
+static const char * version_str = "1.09 20261014";
 
 #define SMP_FN_REPORT_SELF_CONFIG_RESP_LEN (1020 + 4 + 4)
+#define SCSD_MAX_INDEX 65535    /* indexes run 1 to 65535 then back to 1 */
+#define DEF_INTERVAL_MS 1000
+
+/* State kept by --follow between polls */
+struct follow_t {
+    bool have_next;             /* false until the first poll */
+    int next_ind;               /* index of the first unseen descriptor */
+    int exp_cc;
+    int tot_num;
+    int interval_ms;
+    int count;                  /* number of polls, 0 -> until signalled */
+    int num_out;
+    int num_lost;
+    int num_reqs;
+    int verbose;
+    bool brief;
+    const bool * status_arr;    /* NULL -> output all */
+};
+
+static volatile sig_atomic_t got_signal;
 
 static struct option long_options[] = {
     {"brief", no_argument, 0, 'b'},
+    {"count", required_argument, 0, 'c'},
+    {"follow", no_argument, 0, 'f'},
     {"help", no_argument, 0, 'h'},
     {"hex", no_argument, 0, 'H'},
     {"index", required_argument, 0, 'i'},
@@ -65,6 +91,8 @@ static struct option long_options[] = {
     {"one", no_argument, 0, 'o'},
     {"raw", no_argument, 0, 'r'},
     {"sa", required_argument, 0, 's'},
+    {"status", required_argument, 0, 'S'},
+    {"interval", required_argument, 0, 't'},
     {"verbose", no_argument, 0, 'v'},
     {"version", no_argument, 0, 'V'},
     {0, 0, 0, 0},
@@ -74,15 +102,23 @@ static struct option long_options[] = {
 static void
 usage(void)
 {
-    pr2serr("Usage: smp_rep_self_conf_stat [--brief] [--help] [--hex] "
-            "[--index=SDI]\n"
-            "                              [--interface=PARAMS] [--last] "
-            "[--one] [--raw]\n"
-            "                              [--sa=SAS_ADDR] [--verbose] "
-            "[--version]\n"
-            "                              SMP_DEVICE[,N]\n"
+    pr2serr("Usage: smp_rep_self_conf_stat [--brief] [--count=CO] "
+            "[--follow] [--help]\n"
+            "                              [--hex] [--index=SDI] "
+            "[--interface=PARAMS]\n"
+            "                              [--interval=MS] [--last] [--one] "
+            "[--raw]\n"
+            "                              [--sa=SAS_ADDR] [--status=ST,...] "
+            "[--verbose]\n"
+            "                              [--version] SMP_DEVICE[,N]\n"
             "  where:\n"
             "    --brief|-b              lessen the amount output\n"
+            "    --count=CO|-c CO        with --follow: poll CO times "
+            "(def: 0 -> until\n"
+            "                            interrupted)\n"
+            "    --follow|-f             poll, outputting only new "
+            "descriptors (from\n"
+            "                            --index=SDI if given)\n"
             "    --help|-h               print out usage message\n"
             "    --hex|-H                print response in hexadecimal\n"
             "    --index=SDI|-i SDI      SDI is starting self-configuration "
@@ -90,6 +126,9 @@ usage(void)
             "                            descriptor index (def: 1)\n"
             "    --interface=PARAMS|-I PARAMS    specify or override "
             "interface\n"
+            "    --interval=MS|-t MS     with --follow: poll every MS "
+            "milliseconds\n"
+            "                            (def: 1000)\n"
             "    --last|-l               output descriptors starting at last "
             "recorded\n"
             "    --one|-o                only output first descriptor\n"
@@ -100,6 +139,9 @@ usage(void)
             "Depending\n"
             "                                 on the interface, may not be "
             "needed\n"
+            "    --status=ST,...|-S ST,...    only output descriptors with "
+            "one of\n"
+            "                                 these status values\n"
             "    --verbose|-v            increase verbosity\n"
             "    --version|-V            print version string and exit\n\n"
             "Performs a SMP REPORT SELF-CONFIGURATION STATUS function\n"
@@ -174,10 +216,246 @@ find_status_description(int status, char * buff, int buff_len)
 }
 
 
+/* Parses a comma separated list of status values (decimal, or hex with a
+ * leading '0x' or trailing 'h') into arr. Returns 0 if ok, else -1. */
+static int
+parse_status_list(const char * buf, bool * arr)
+{
+    int n, val;
+    const char * cp;
+    const char * ep;
+    char b[16];
+
+    for (cp = buf; cp; cp = ep ? (ep + 1) : NULL) {
+        ep = strchr(cp, ',');
+        n = ep ? (int)(ep - cp) : (int)strlen(cp);
+        if ((n < 1) || (n >= (int)sizeof(b)))
+            return -1;
+        memcpy(b, cp, n);
+        b[n] = '\0';
+        val = smp_get_dhnum(b);
+        if ((val < 0) || (val > 255))
+            return -1;
+        arr[val] = true;
+    }
+    return 0;
+}
+
+static void
+sig_handler(int sig)
+{
+    got_signal = sig;
+}
+
+static inline int
+next_index(int ind)
+{
+    return (ind >= SCSD_MAX_INDEX) ? 1 : (ind + 1);
+}
+
+/* Number of steps from index 'from' forward to index 'to' */
+static inline int
+index_dist(int from, int to)
+{
+    return ((to - from) + SCSD_MAX_INDEX) % SCSD_MAX_INDEX;
+}
+
+/* Index of the oldest of tot descriptors when the newest is 'last' */
+static inline int
+oldest_index(int last, int tot)
+{
+    return ((((last - 1) - (tot - 1)) % SCSD_MAX_INDEX) + SCSD_MAX_INDEX) %
+           SCSD_MAX_INDEX + 1;
+}
+
+/* Sends REPORT SELF-CONFIGURATION STATUS starting at index ind into rp.
+ * Returns 0 if ok, the function result, SMP_LIB_CAT_MALFORMED or -1 . */
+static int
+fetch_scs(struct smp_target_obj * top, int ind, uint8_t * rp, int * lenp,
+          struct follow_t * fp)
+{
+    int res, len;
+    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_REPORT_SELF_CONFIG, 0, 1,
+                         0, 0, 0, 0,  0, 0, 0, 0};
+    struct smp_req_resp smp_rr;
+
+    len = (SMP_FN_REPORT_SELF_CONFIG_RESP_LEN - 8) / 4;
+    smp_req[2] = (len < 0x100) ? len : 0xff;
+    sg_put_unaligned_be16(ind, smp_req + 6);
+    memset(&smp_rr, 0, sizeof(smp_rr));
+    smp_rr.request_len = sizeof(smp_req);
+    smp_rr.request = smp_req;
+    smp_rr.max_response_len = SMP_FN_REPORT_SELF_CONFIG_RESP_LEN;
+    smp_rr.response = rp;
+    ++fp->num_reqs;
+    res = smp_send_req(top, &smp_rr, fp->verbose);
+    if (res || smp_rr.transport_err)
+        return -1;
+    if (((smp_rr.act_response_len >= 0) && (smp_rr.act_response_len < 20)) ||
+        (SMP_FRAME_TYPE_RESP != rp[0]) || (rp[1] != smp_req[1]))
+        return SMP_LIB_CAT_MALFORMED;
+    if (rp[2])
+        return rp[2];
+    len = 4 + (4 * rp[3]);
+    if ((smp_rr.act_response_len >= 0) && (len > smp_rr.act_response_len))
+        len = smp_rr.act_response_len;
+    *lenp = len;
+    return 0;
+}
+
+/* One --follow poll. The response holds the index of the newest (last
+ * recorded) descriptor, so those from next_ind up to it are new. Further
+ * requests continue from where a full response stopped until the newest
+ * is reached. If more are new than the expander holds, the oldest were
+ * overwritten before being seen; the poll restarts at the oldest held. */
+static int
+follow_poll(struct smp_target_obj * top, uint8_t * rp, struct follow_t * fp)
+{
+    int k, j, res, len, ind, want, pending, start, last, num, dlen, tot, cc;
+    const uint8_t * dp;
+    char b[128];
+
+    want = fp->have_next ? fp->next_ind : 0;
+    do {
+        res = fetch_scs(top, want, rp, &len, fp);
+        if (res) {
+            pr2serr("Report self-configuration status failed: %s\n",
+                    (res > 0) ? smp_get_func_res_str(res, sizeof(b), b) :
+                    "request failed");
+            return (res > 0) ? res : SMP_LIB_CAT_OTHER;
+        }
+        cc = sg_get_unaligned_be16(rp + 4);
+        start = sg_get_unaligned_be16(rp + 6);
+        tot = sg_get_unaligned_be16(rp + 8);
+        last = sg_get_unaligned_be16(rp + 10);
+        dlen = (16 == rp[12]) ? 16 : (rp[12] * 4);
+        num = rp[19];
+        if (! fp->have_next) {
+            /* first poll without --index: only follow what comes next */
+            fp->next_ind = (0 == last) ? 1 : next_index(last);
+            fp->have_next = true;
+            fp->exp_cc = cc;
+            fp->tot_num = tot;
+            return 0;
+        }
+        if ((fp->exp_cc != cc) && (tot < fp->tot_num)) {
+            if (fp->verbose)
+                pr2serr("expander change count %d -> %d and fewer "
+                        "descriptors, list was reset\n", fp->exp_cc, cc);
+            want = (0 == last) ? 1 : oldest_index(last, tot);
+        }
+        fp->exp_cc = cc;
+        fp->tot_num = tot;
+        pending = (0 == last) ? 0 : index_dist(want, next_index(last));
+        if (pending > tot) {
+            fp->num_lost += pending - tot;
+            pr2serr("%d self-configuration status descriptors overwritten "
+                    "before being read\n", pending - tot);
+            want = oldest_index(last, tot);
+            continue;
+        }
+        if ((0 == pending) || (dlen < 16) || (len < (20 + (num * dlen))))
+            break;
+        /* output those in the window want .. last, in order */
+        ind = start;
+        for (k = 0, dp = rp + 20; k < num; ++k, dp += dlen) {
+            if (index_dist(want, ind) < pending) {
+                if ((NULL == fp->status_arr) || fp->status_arr[dp[0]]) {
+                    printf("[%d] status=0x%x (%s) final=%d pi=%d sa=0x",
+                           ind, dp[0],
+                           find_status_description(dp[0], b, sizeof(b)),
+                           dp[1] & 1, dp[3]);
+                    for (j = 0; j < 8; ++j)
+                        printf("%02x", dp[8 + j]);
+                    printf("\n");
+                    ++fp->num_out;
+                }
+            }
+            ind = next_index(ind);
+        }
+        if ((0 == num) || (index_dist(want, start) >= pending))
+            break;              /* expander did not start within window */
+        k = index_dist(want, start) + num;
+        if (k > pending)
+            k = pending;
+        for (j = 0; j < k; ++j)
+            want = next_index(want);
+    } while ((index_dist(want, next_index(last)) > 0) && (! got_signal));
+    fp->next_ind = want;
+    return 0;
+}
+
+static int
+do_follow(struct smp_target_obj * top, struct follow_t * fp)
+{
+    int res, poll;
+    int ret = 0;
+    uint8_t * rp;
+    struct timespec dl;
+    struct sigaction sa, old_int, old_term;
+
+    rp = (uint8_t *)calloc(1, SMP_FN_REPORT_SELF_CONFIG_RESP_LEN);
+    if (NULL == rp) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        return SMP_LIB_RESOURCE_ERROR;
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sig_handler;
+    sigemptyset(&sa.sa_mask);
+    got_signal = 0;
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+
+    clock_gettime(CLOCK_MONOTONIC, &dl);
+    for (poll = 0; (0 == fp->count) || (poll < fp->count); ++poll) {
+        res = follow_poll(top, rp, fp);
+        if (res) {
+            ret = res;
+            break;
+        }
+        if ((0 == poll) && (! fp->brief))
+            pr2serr("Following from self-configuration status descriptor "
+                    "index %d, polling every %d ms\n", fp->next_ind,
+                    fp->interval_ms);
+        fflush(stdout);
+        if (got_signal || (fp->count && ((poll + 1) >= fp->count)))
+            break;
+        dl.tv_sec += fp->interval_ms / 1000;
+        dl.tv_nsec += (fp->interval_ms % 1000) * 1000000;
+        if (dl.tv_nsec >= 1000000000) {
+            ++dl.tv_sec;
+            dl.tv_nsec -= 1000000000;
+        }
+        while ((res = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &dl,
+                                      NULL)) && (EINTR == res) &&
+               (! got_signal))
+            ;
+        if (got_signal)
+            break;
+    }
+    if (fp->verbose)
+        pr2serr("%d poll%s, %d request%s, %d descriptor%s output, %d "
+                "lost\n", poll + 1, (0 == poll) ? "" : "s", fp->num_reqs,
+                (1 == fp->num_reqs) ? "" : "s", fp->num_out,
+                (1 == fp->num_out) ? "" : "s", fp->num_lost);
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    free(rp);
+    return ret;
+}
+
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_rep_self_conf_stat_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
     bool do_brief = false;
+    bool do_follow_mode = false;
+    bool index_given = false;
     bool do_last = false;
     bool do_one = false;
     bool do_raw = false;
@@ -201,13 +479,19 @@ main(int argc, char * argv[])
     uint8_t smp_resp[SMP_FN_REPORT_SELF_CONFIG_RESP_LEN];
     struct smp_req_resp smp_rr;
     struct smp_target_obj tobj;
+    struct follow_t fol;
+    bool status_arr[256];
+    const bool * filt = NULL;
 
+    memset(&fol, 0, sizeof(fol));
+    fol.interval_ms = DEF_INTERVAL_MS;
+    memset(status_arr, 0, sizeof(status_arr));
     memset(device_name, 0, sizeof device_name);
     memset(i_params, 0, sizeof i_params);
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "bhHi:I:lors:vV", long_options,
+        c = getopt_long(argc, argv, "bc:fhHi:I:lors:S:t:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -216,6 +500,16 @@ main(int argc, char * argv[])
         case 'b':
             do_brief = true;
             break;
+        case 'c':
+            fol.count = smp_get_num(optarg);
+            if (fol.count < 0) {
+                pr2serr("bad argument to '--count'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'f':
+            do_follow_mode = true;
+            break;
         case 'h':
         case '?':
             usage();
@@ -230,6 +524,7 @@ main(int argc, char * argv[])
                         "65535\n");
                 return SMP_LIB_SYNTAX_ERROR;
             }
+            index_given = true;
             break;
         case 'I':
             strncpy(i_params, optarg, sizeof(i_params));
@@ -252,6 +547,22 @@ main(int argc, char * argv[])
             }
             sa = (uint64_t)sa_ll;
             break;
+        case 'S':
+            if (parse_status_list(optarg, status_arr)) {
+                pr2serr("bad argument to '--status', expect a comma "
+                        "separated list of values\n    from 0 to 255\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            filt = status_arr;
+            break;
+        case 't':
+            fol.interval_ms = smp_get_num(optarg);
+            if (fol.interval_ms < 1) {
+                pr2serr("bad argument to '--interval', expect milliseconds "
+                        "(1 or more)\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'v':
             ++verbose;
             break;
@@ -277,13 +588,24 @@ main(int argc, char * argv[])
             return SMP_LIB_SYNTAX_ERROR;
         }
     }
+    if (do_follow_mode) {
+        if (do_hex || do_raw || do_last || do_one) {
+            pr2serr("--follow can't be given with --hex, --last, --one or "
+                    "--raw\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    } else if (fol.count || (DEF_INTERVAL_MS != fol.interval_ms)) {
+        pr2serr("--count= and --interval= need --follow\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
     if (0 == device_name[0]) {
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -322,6 +644,17 @@ main(int argc, char * argv[])
                              &tobj, verbose);
     if (res < 0)
         return SMP_LIB_FILE_ERROR;
+    if (do_follow_mode) {
+        fol.verbose = verbose;
+        fol.brief = do_brief;
+        fol.status_arr = filt;
+        if (index_given) {
+            fol.have_next = true;
+            fol.next_ind = (0 == index) ? 1 : index;
+        }
+        ret = do_follow(&tobj, &fol);
+        goto err_out;
+    }
 
 last_again:
     len = (sizeof(smp_resp) - 8) / 4;
@@ -454,6 +787,10 @@ last_again:
     scsdp = smp_resp + 20;
     for (k = 0, ind = sscsd_ind; k < num_scsd; ++k, scsdp += scsd_len) {
         status = scsdp[0];
+        if (filt && (! filt[status])) {
+            ind = next_index(ind);
+            continue;
+        }
         last_recp = (ind == last_scsd_ind) ? ">>> " : "";
         if (do_brief)
             printf("    %s%d [%d]: status=0x%x flag=%d pi=%d sa=0x",
@@ -475,10 +812,7 @@ last_again:
                 printf("%02x ", scsdp[j]);
             printf("\n");
         }
-        if (ind > 0xfffe)
-            ind = 1;
-        else
-            ++ind;
+        ind = next_index(ind);
         if (do_one)
             break;
     }
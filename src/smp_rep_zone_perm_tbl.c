@@ -48,10 +48,12 @@
  * utility.
  *
  * This utility issues a REPORT ZONE PERMISSION TABLE function and outputs
- * its response.
+ * its response. With --check or --reach=G the whole table is read and
+ * then checked for symmetry or searched for the source zone groups that
+ * may access zone group G.
  */
 
-static const char * version_str = "1.11 20180725";
+static const char * version_str = "1.12 20261014";
 
 #define SMP_FN_REPORT_ZONE_PERMISSION_TBL_RESP_LEN (1020 + 4 + 4)
 #define DEF_MAX_NUM_DESC 63
@@ -80,6 +82,7 @@ static int numzg_blen[] = {
 static struct option long_options[] = {
         {"append", no_argument, 0, 'a'},
         {"bits", required_argument, 0, 'B'},
+        {"check", no_argument, 0, 'c'},
         {"help", no_argument, 0, 'h'},
         {"hex", no_argument, 0, 'H'},
         {"interface", required_argument, 0, 'I'},
@@ -88,6 +91,7 @@ static struct option long_options[] = {
         {"nocomma", no_argument, 0, 'N'},
         {"permf", required_argument, 0, 'P'},
         {"raw", no_argument, 0, 'r'},
+        {"reach", required_argument, 0, 'g'},
         {"report", required_argument, 0, 'R'},
         {"sa", required_argument, 0, 's'},
         {"start", required_argument, 0, 'f'},
@@ -100,21 +104,26 @@ static struct option long_options[] = {
 static void
 usage(void)
 {
-    pr2serr("Usage: smp_rep_zone_perm_tbl [--append] [--bits=COL] [--help] "
-            "[--hex]\n"
-            "                             [--interface=PARAMS] [--multiple] "
-            "[--nocomma]\n"
-            "                             [--num=MD] [--permf=FN] [--raw] "
-            "[--report=RT]\n"
-            "                             [--sa=SAS_ADDR] [--start=SS] "
-            "[--verbose]\n"
-            "                             [--version] SMP_DEVICE[,N]\n"
+    pr2serr("Usage: smp_rep_zone_perm_tbl [--append] [--bits=COL] [--check] "
+            "[--help]\n"
+            "                             [--hex] [--interface=PARAMS] "
+            "[--multiple]\n"
+            "                             [--nocomma] [--num=MD] [--permf=FN] "
+            "[--raw]\n"
+            "                             [--reach=G] [--report=RT] "
+            "[--sa=SAS_ADDR]\n"
+            "                             [--start=SS] [--verbose] "
+            "[--version]\n"
+            "                             SMP_DEVICE[,N]\n"
             "  where:\n"
             "    --append|-a          append to FN with '--permf' option\n"
             "    --bits=COL|-B COL    output table as bit array with COL "
             "columns\n"
             "                         and ZP[0,0] top left (def: output byte "
             "array)\n"
+            "    --check|-c           read whole table then check that "
+            "ZP[s,d] equals\n"
+            "                         ZP[d,s] for all s and d\n"
             "    --help|-h            print out usage message\n"
             "    --hex|-H             print response in hexadecimal\n"
             "    --interface=PARAMS|-I PARAMS    specify or override "
@@ -133,6 +142,9 @@ usage(void)
             "write\n"
             "                         to stdout)\n"
             "    --raw|-r             output response in binary\n"
+            "    --reach=G|-g G       read whole table then list source zone "
+            "groups\n"
+            "                         that may access zone group G\n"
             "    --report=RT|-R RT    report type (default: 0). 0 -> current;"
             "\n"
             "                         1 -> shadow; 2 -> saved; 3 -> default\n"
@@ -160,10 +172,16 @@ dStrRaw(const uint8_t * str, int len)
 }
 
 
+#ifdef SMP_UTILS_MULTI
+int
+smp_rep_zone_perm_tbl_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
     bool do_append = false;
+    bool do_check = false;
     bool do_raw = false;
     bool first;
     bool mndesc_given = false;
@@ -171,7 +189,9 @@ main(int argc, char * argv[])
     bool nocomma = false;
     int res, c, k, j, m, len, desc_len, num_desc, numzg, max_sszg;
     int desc_per_resp, rtype, act_resplen;
+    int s, d, n;
     int bits_col = 0;
+    int reach_g = -1;
     int do_hex = 0;
     int mndesc = DEF_MAX_NUM_DESC;
     int report_type = 0;
@@ -181,6 +201,7 @@ main(int argc, char * argv[])
     int verbose = 0;
     int64_t sa_ll;
     uint64_t sa = 0;
+    uint64_t srcs[SMP_ZP_WORDS];
     char * cp;
     uint8_t * descp;
     FILE * foutp = stdout;
@@ -192,6 +213,7 @@ main(int argc, char * argv[])
     uint8_t smp_resp[SMP_FN_REPORT_ZONE_PERMISSION_TBL_RESP_LEN];
     struct smp_req_resp smp_rr;
     struct smp_target_obj tobj;
+    static struct smp_zone_perm zp;
 
     memset(device_name, 0, sizeof device_name);
     memset(smp_resp, 0, sizeof smp_resp);
@@ -199,7 +221,7 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "aB:f:hHI:mn:NP:rR:s:vV", long_options,
+        c = getopt_long(argc, argv, "aB:cf:g:hHI:mn:NP:rR:s:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -215,6 +237,9 @@ main(int argc, char * argv[])
                 return SMP_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'c':
+            do_check = true;
+            break;
         case 'f':       /* note: maps to '--start=SS' option */
            sszg = smp_get_num(optarg);
            if ((sszg < 0) || (sszg > 255)) {
@@ -222,6 +247,13 @@ main(int argc, char * argv[])
                 return SMP_LIB_SYNTAX_ERROR;
             }
             break;
+        case 'g':
+           reach_g = smp_get_num(optarg);
+           if ((reach_g < 0) || (reach_g > 255)) {
+                pr2serr("bad argument to '--reach=', expect 0 to 255\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
         case 'h':
         case '?':
             usage();
@@ -300,9 +332,10 @@ main(int argc, char * argv[])
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
             pr2serr("missing device name on command line\n    [Could use "
-                    "environment variable SMP_UTILS_DEVICE instead]\n\n");
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -336,6 +369,14 @@ main(int argc, char * argv[])
             }
         }
     }
+    if (do_check || (reach_g >= 0)) {
+        if (mndesc_given || (sszg > 0)) {
+            pr2serr("--check and --reach= need the whole table so clash "
+                    "with --num= and\n--start=\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+        multiple = true;
+    }
     if (multiple && mndesc_given) {
         pr2serr("--multiple and --num clash, give one or the other\n");
         return SMP_LIB_SYNTAX_ERROR;
@@ -505,9 +546,11 @@ main(int argc, char * argv[])
                 pr2serr("unexpected number of zone groups: %d\n", numzg);
                 goto err_out;
             }
+            smp_zp_init(&zp, numzg ? 256 : 128);
         }
         descp = smp_resp + 16;
         for (k = 0; k < num_desc; ++k, descp += desc_len) {
+            smp_zp_set_row(&zp, j + k, descp);
             if (0 == bits_col) {
                 for (m = 0; m < desc_len; ++m) {
                     if (nocomma)
@@ -520,22 +563,48 @@ main(int argc, char * argv[])
                     }
                 }
             } else {    /* --bit=<bits_col> given */
-                int by, bi;
-
                 if ((k + j) >= bits_col)
-                    break;
+                    continue;
                 fprintf(foutp, "%-4d", j + k);
-                for (m = 0; m < bits_col; ++m) {
-                    by = (m / 8) + 1;
-                    bi = m % 8;
-                    fprintf(foutp, "%d", (descp[desc_len - by] >> bi) & 0x1);
-                }
+                for (m = 0; m < bits_col; ++m)
+                    fprintf(foutp, "%d", (int)smp_zp_test(&zp, j + k, m));
             }
             fprintf(foutp, "\n");
         }
         if ((! multiple) || (mndesc < desc_per_resp))
             break;
     }
+    /* output as comments so FN remains acceptable to smp_conf_zone_perm_tbl */
+    if (do_check) {
+        n = smp_zp_asymmetric(&zp, &s, &d);
+        if (n < 0) {
+            pr2serr("--check: out of memory\n");
+            ret = -1;
+            goto err_out;
+        }
+        if (0 == n)
+            fprintf(foutp, "\n# zone permission table is symmetric\n");
+        else
+            fprintf(foutp, "\n# zone permission table is NOT symmetric: %d "
+                    "pair%s,\n#   first: ZP[%d,%d]=%d but ZP[%d,%d]=%d\n",
+                    n, ((1 == n) ? " differs" : "s differ"), s, d,
+                    (int)smp_zp_test(&zp, s, d), d, s,
+                    (int)smp_zp_test(&zp, d, s));
+    }
+    if (reach_g >= 0) {
+        n = smp_zp_reach(&zp, reach_g, srcs);
+        fprintf(foutp, "\n# %d source zone group%s may access zone group "
+                "%d:", n, ((1 == n) ? "" : "s"), reach_g);
+        for (s = 0, k = 0; s < SMP_ZP_MAX_ZG; ++s) {
+            if (0 == ((srcs[s / 64] >> (s % 64)) & 1))
+                continue;
+            if (0 == (k % 16))
+                fprintf(foutp, "\n#  ");
+            fprintf(foutp, " %d", s);
+            ++k;
+        }
+        fprintf(foutp, "\n");
+    }
 
 err_out:
     if (foutp && (stdout != foutp)) {
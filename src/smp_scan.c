@@ -0,0 +1,607 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* This is a Serial Attached SCSI (SAS) Serial Management Protocol (SMP)
+ * utility.
+ *
+ * This utility finds the SMP targets (expanders) on this host and sends
+ * each a REPORT GENERAL, a REPORT MANUFACTURER INFORMATION and a DISCOVER
+ * (of phy 0, to learn its SAS address), all three in flight together. The
+ * targets are grouped by HBA and each group is scanned by its own thread
+ * so that a slow HBA does not hold up the others. In Linux the expanders
+ * are found in /sys/class/bsg ; other SMP targets (e.g. those only
+ * reachable through mptctl or aac) can be added on the command line.
+ */
+
+static const char * version_str = "1.02 20261014";    /* spl5r05 */
+
+
+#define SMP_FN_DISCOVER_RESP_LEN 124
+#define SMP_FN_REPORT_GENERAL_RESP_LEN (SMP_REPORT_GENERAL_RESP_LEN)
+#define SMP_FN_REPORT_MANUFACTURER_RESP_LEN 64
+#define MAX_TARGETS 256
+#define MAX_SAS_ADDRS 32
+#define MAX_HBAS 64
+
+struct opts_t {
+    bool do_brief;
+    int num_sa;
+    int retries;                /* -1 -> library default */
+    int timeout_ms;             /* -1 -> library default */
+    int verbose;
+    uint64_t sa[MAX_SAS_ADDRS];
+};
+
+/* One per SMP target found or given */
+struct scan_tgt_t {
+    int hba;                    /* host number, or < 0 for a command line
+                                 * SMP_DEVICE */
+    int subvalue;
+    int status;                 /* 0 when scanned successfully */
+    int num_phys;
+    int exp_cc;                 /* expander change count */
+    uint64_t sa;                /* given (or 0) */
+    uint64_t exp_sa;            /* from DISCOVER response */
+    bool rm_ok;
+    bool zoning_en;
+    char dev_name[SMP_MAX_DEVICE_NAME];
+    char vendor[9];
+    char product[17];
+    char revision[5];
+};
+
+struct scan_t;
+
+/* Targets of one HBA are scanned by one worker thread, in order */
+struct scan_hba_t {
+    int first;                  /* index into scan_t::tgts[] */
+    int num;
+    int node;                   /* NUMA node of the HBA, -1 if unknown */
+    struct scan_t * sp;
+    pthread_t thr;
+};
+
+struct scan_t {
+    const struct opts_t * op;
+    const char * i_params;
+    int num_tgts;
+    int num_hbas;
+    struct scan_tgt_t tgts[MAX_TARGETS];
+    struct scan_hba_t hbas[MAX_HBAS];
+};
+
+static struct option long_options[] = {
+        {"brief", no_argument, 0, 'b'},
+        {"help", no_argument, 0, 'h'},
+        {"interface", required_argument, 0, 'I'},
+        {"retries", required_argument, 0, 'R'},
+        {"sa", required_argument, 0, 's'},
+        {"timeout", required_argument, 0, 't'},
+        {"verbose", no_argument, 0, 'v'},
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0},
+};
+
+
+static void
+usage(void)
+{
+    pr2serr("Usage: "
+            "smp_scan [--brief] [--help] [--interface=PARAMS] "
+            "[--retries=N]\n"
+            "                [--sa=SAS_ADDR] [--timeout=MS] [--verbose] "
+            "[--version]\n"
+            "                [SMP_DEVICE[,N] ...]\n"
+            "  where:\n"
+            "    --brief|-b           only output the device name and SAS "
+            "address\n"
+            "    --help|-h            print out usage message\n"
+            "    --interface=PARAMS|-I PARAMS    specify or override "
+            "interface\n"
+            "                                    of each given SMP_DEVICE\n"
+            "    --retries=N|-R N     times to resend a request answered "
+            "BUSY (or\n"
+            "                         that timed out with --timeout) "
+            "(def: 2)\n"
+            "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of SMP target "
+            "reached via\n"
+            "                                 each given SMP_DEVICE; may be "
+            "given up to\n"
+            "                                 %d times\n"
+            "    --timeout=MS|-t MS   SMP request timeout in milliseconds "
+            "(def: 0 ->\n"
+            "                         pass-through's default)\n"
+            "    --verbose|-v         increase verbosity\n"
+            "    --version|-V         print version string and exit\n\n"
+            "Finds the SMP targets (expanders) on this host and sends each "
+            "REPORT\nGENERAL, REPORT MANUFACTURER INFORMATION and DISCOVER "
+            "(phy 0) requests.\nTargets are scanned in parallel, one thread "
+            "per HBA. SMP_DEVICEs given\nare scanned as well, each with "
+            "every SAS_ADDR given.\n", MAX_SAS_ADDRS);
+}
+
+/* Checks SMP response header. Returns response length excluding CRC, or
+ * -1 for transport problems, or (-4 - function result). */
+static int
+check_resp(const struct smp_req_resp * rrp, int res, const char * leadin,
+           int verbose)
+{
+    int len, act_resplen;
+    const uint8_t * rp = rrp->response;
+    char b[128];
+
+    if (res) {
+        if (verbose)
+            pr2serr("%s smp_send_req failed, res=%d\n", leadin, res);
+        return -1;
+    }
+    if (rrp->transport_err) {
+        if (verbose)
+            pr2serr("%s smp_send_req transport_error=%d\n", leadin,
+                    rrp->transport_err);
+        return -1;
+    }
+    act_resplen = rrp->act_response_len;
+    if ((act_resplen >= 0) && (act_resplen < 4)) {
+        if (verbose)
+            pr2serr("%s response too short, len=%d\n", leadin, act_resplen);
+        return -4 - SMP_LIB_CAT_MALFORMED;
+    }
+    len = rp[3];
+    if ((0 == len) && (0 == rp[2])) {
+        len = smp_get_func_def_resp_len(rp[1]);
+        if (len < 0)
+            len = 0;
+    }
+    len = 4 + (len * 4);        /* length in bytes, excluding 4 byte CRC */
+    if ((act_resplen >= 0) && (len > act_resplen))
+        len = act_resplen;
+    if ((SMP_FRAME_TYPE_RESP != rp[0]) || (rp[1] != rrp->request[1])) {
+        if (verbose)
+            pr2serr("%s malformed response, frame type=0x%x, function=0x%x"
+                    "\n", leadin, rp[0], rp[1]);
+        return -4 - SMP_LIB_CAT_MALFORMED;
+    }
+    if (rp[2]) {
+        if (verbose > 1)
+            pr2serr("%s result: %s\n", leadin,
+                    smp_get_func_res_str(rp[2], sizeof(b), b));
+        return -4 - rp[2];
+    }
+    return len;
+}
+
+static void
+batch_cb(int index, struct smp_req_resp * rresp, int res, void * cb_arg)
+{
+    if (rresp) { ; }    /* unused, suppress warning */
+    ((int *)cb_arg)[index] = res;
+}
+
+/* Copies n bytes of an ASCII field, trimming trailing spaces */
+static void
+copy_ascii(char * dst, const uint8_t * src, int n)
+{
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+    while ((n > 0) && (' ' == dst[n - 1]))
+        dst[--n] = '\0';
+}
+
+static void
+scan_tgt(const struct scan_t * sp, struct scan_tgt_t * tp)
+{
+    int k, len;
+    int res_arr[3];
+    const struct opts_t * op = sp->op;
+    struct smp_target_obj tobj;
+    struct smp_report_general rg;
+    uint8_t rg_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_REPORT_GENERAL, 0, 0,
+                        0, 0, 0, 0};
+    uint8_t rm_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_REPORT_MANUFACTURER, 0,
+                        0, 0, 0, 0, 0};
+    uint8_t disc_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_DISCOVER, 0, 0,
+                          0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    uint8_t rg_resp[SMP_FN_REPORT_GENERAL_RESP_LEN];
+    uint8_t rm_resp[SMP_FN_REPORT_MANUFACTURER_RESP_LEN];
+    uint8_t disc_resp[SMP_FN_DISCOVER_RESP_LEN];
+    struct smp_req_resp rr[3];
+    static const char * leadin[3] = {"RG", "RM", "Discover"};
+
+    if (smp_initiator_open(tp->dev_name, tp->subvalue, sp->i_params, tp->sa,
+                           &tobj, op->verbose) < 0) {
+        tp->status = SMP_LIB_FILE_ERROR;
+        return;
+    }
+    smp_set_req_policy(&tobj, op->timeout_ms, op->retries, -1);
+    /* non-zero allocated response lengths (in dwords) ask for SAS-2
+     * style responses */
+    rg_req[2] = (sizeof(rg_resp) - 8) / 4;
+    rm_req[2] = (sizeof(rm_resp) - 8) / 4;
+    disc_req[2] = (sizeof(disc_resp) - 8) / 4;
+    disc_req[3] = 2;            /* request length in dwords */
+    memset(rr, 0, sizeof(rr));
+    rr[0].request_len = sizeof(rg_req);
+    rr[0].request = rg_req;
+    rr[0].max_response_len = sizeof(rg_resp);
+    rr[0].response = rg_resp;
+    rr[1].request_len = sizeof(rm_req);
+    rr[1].request = rm_req;
+    rr[1].max_response_len = sizeof(rm_resp);
+    rr[1].response = rm_resp;
+    rr[2].request_len = sizeof(disc_req);
+    rr[2].request = disc_req;
+    rr[2].max_response_len = sizeof(disc_resp);
+    rr[2].response = disc_resp;
+    memset(rg_resp, 0, sizeof(rg_resp));
+    memset(rm_resp, 0, sizeof(rm_resp));
+    memset(disc_resp, 0, sizeof(disc_resp));
+    if (smp_send_req_batch(&tobj, rr, 3, 3, batch_cb, res_arr,
+                           op->verbose) < 0) {
+        tp->status = SMP_LIB_CAT_OTHER;
+        goto fini;
+    }
+    for (k = 0; k < 3; ++k) {
+        len = check_resp(rr + k, res_arr[k], leadin[k], op->verbose);
+        if (0 == k) {
+            if (len < 0) {
+                tp->status = (len < -2) ? (-4 - len) : SMP_LIB_CAT_OTHER;
+                goto fini;
+            }
+            smp_decode_report_general(rg_resp, len, &rg);
+            tp->num_phys = rg.num_phys;
+            tp->exp_cc = rg.exp_change_count;
+            tp->zoning_en = rg.zoning_enabled;
+        } else if (1 == k) {
+            if (len >= 40) {
+                copy_ascii(tp->vendor, rm_resp + 12, 8);
+                copy_ascii(tp->product, rm_resp + 20, 16);
+                copy_ascii(tp->revision, rm_resp + 36, 4);
+                tp->rm_ok = true;
+            }
+        } else if (len >= 24)
+            tp->exp_sa = sg_get_unaligned_be64(disc_resp + 16);
+    }
+    if (0 == tp->exp_sa)
+        tp->exp_sa = tp->sa;
+fini:
+    smp_initiator_close(&tobj);
+}
+
+static void *
+scan_worker(void * arg)
+{
+    int k;
+    struct scan_hba_t * hp = (struct scan_hba_t *)arg;
+    struct scan_t * sp = hp->sp;
+
+    /* before anything is allocated, so it is local to the HBA too */
+    smp_numa_bind(hp->node, sp->op->verbose);
+    for (k = 0; k < hp->num; ++k)
+        scan_tgt(sp, sp->tgts + hp->first + k);
+    return NULL;
+}
+
+#ifdef SMP_LIB_LINUX
+static int
+tgt_cmp(const void * a, const void * b)
+{
+    const struct scan_tgt_t * ap = (const struct scan_tgt_t *)a;
+    const struct scan_tgt_t * bp = (const struct scan_tgt_t *)b;
+
+    if (ap->hba != bp->hba)
+        return (ap->hba < bp->hba) ? -1 : 1;
+    return strcmp(ap->dev_name, bp->dev_name);
+}
+
+/* Adds the expanders known to the SAS transport class, whose bsg devices
+ * are named like "expander-<host>:<n>", sorted by host then name.
+ * Returns the number added. */
+static int
+find_bsg_expanders(struct scan_t * sp, int verbose)
+{
+    int h, n, first;
+    DIR * dirp;
+    struct dirent * dep;
+    struct stat st;
+    struct scan_tgt_t * tp;
+    char b[SMP_MAX_DEVICE_NAME];
+
+    if (NULL == (dirp = opendir("/sys/class/bsg"))) {
+        if (verbose)
+            pr2serr("unable to open /sys/class/bsg: %s\n",
+                    safe_strerror(errno));
+        return 0;
+    }
+    first = sp->num_tgts;
+    while ((dep = readdir(dirp))) {
+        if (2 != sscanf(dep->d_name, "expander-%d:%d", &h, &n))
+            continue;
+        if (sp->num_tgts >= MAX_TARGETS) {
+            pr2serr(">> more than %d SMP targets, some not scanned\n",
+                    MAX_TARGETS);
+            break;
+        }
+        tp = sp->tgts + sp->num_tgts++;
+        memset(tp, 0, sizeof(*tp));
+        tp->hba = h;
+        /* prefer the /dev/bsg node, the library resolves the sysfs name */
+        snprintf(b, sizeof(b), "/dev/bsg/%.200s", dep->d_name);
+        if (stat(b, &st) < 0)
+            snprintf(b, sizeof(b), "/sys/class/bsg/%.200s", dep->d_name);
+        snprintf(tp->dev_name, sizeof(tp->dev_name), "%s", b);
+    }
+    closedir(dirp);
+    n = sp->num_tgts - first;
+    if (n > 1)
+        qsort(sp->tgts + first, n, sizeof(struct scan_tgt_t), tgt_cmp);
+    return n;
+}
+#endif
+
+/* Groups targets (already ordered by HBA) into one scan_hba_t per HBA */
+static void
+group_by_hba(struct scan_t * sp)
+{
+    int k;
+    struct scan_hba_t * hp = NULL;
+
+    sp->num_hbas = 0;
+    for (k = 0; k < sp->num_tgts; ++k) {
+        if ((NULL == hp) || (sp->tgts[k].hba != sp->tgts[k - 1].hba)) {
+            if (sp->num_hbas >= MAX_HBAS) {
+                hp->num += sp->num_tgts - k;    /* last worker does rest */
+                break;
+            }
+            hp = sp->hbas + sp->num_hbas++;
+            hp->first = k;
+            hp->num = 0;
+            hp->sp = sp;
+            hp->node = smp_sysfs_numa_node(sp->tgts[k].dev_name,
+                                           sp->tgts[k].subvalue,
+                                           sp->op->verbose);
+        }
+        ++hp->num;
+    }
+}
+
+static void
+output_tgt(const struct scan_tgt_t * tp, const struct opts_t * op)
+{
+    char b[32];
+
+    if (tp->status) {
+        printf("%s: not scanned, error %d\n", tp->dev_name, tp->status);
+        return;
+    }
+    if (tp->subvalue)
+        snprintf(b, sizeof(b), "%c%d", SMP_SUBVALUE_SEPARATOR, tp->subvalue);
+    else
+        b[0] = '\0';
+    printf("%s%s: %016" PRIx64, tp->dev_name, b, tp->exp_sa);
+    if (op->do_brief) {
+        printf("\n");
+        return;
+    }
+    printf("  phys=%d", tp->num_phys);
+    if (tp->rm_ok)
+        printf("  %-8s  %-16s  %-4s", tp->vendor, tp->product, tp->revision);
+    printf("\n");
+    if (op->verbose)
+        printf("    expander change count=%d, zoning %sabled\n", tp->exp_cc,
+               tp->zoning_en ? "en" : "dis");
+}
+
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_scan_main(int argc, char * argv[])
+#else
+int
+main(int argc, char * argv[])
+#endif
+{
+    int res, c, k, j, n;
+    int ret = 0;
+    int subvalue;
+    int64_t sa_ll;
+    char * cp;
+    char i_params[256];
+    struct opts_t opts;
+    struct opts_t * op;
+    struct scan_t * sp;
+    struct scan_tgt_t * tp;
+
+    op = &opts;
+    memset(op, 0, sizeof(opts));
+    op->retries = -1;
+    op->timeout_ms = -1;
+    memset(i_params, 0, sizeof i_params);
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "bhI:R:s:t:vV", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'b':
+            op->do_brief = true;
+            break;
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'I':
+            strncpy(i_params, optarg, sizeof(i_params));
+            i_params[sizeof(i_params) - 1] = '\0';
+            break;
+        case 'R':
+           op->retries = smp_get_num(optarg);
+           if (op->retries < 0) {
+                pr2serr("bad argument to '--retries'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 's':
+           sa_ll = smp_get_llnum_nomult(optarg);
+           if (-1LL == sa_ll) {
+                pr2serr("bad argument to '--sa'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            if (op->num_sa >= MAX_SAS_ADDRS) {
+                pr2serr("'--sa' given more than %d times\n", MAX_SAS_ADDRS);
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            if (! smp_is_naa5(sa_ll)) {
+                pr2serr("SAS (target) address not in naa-5 format (may "
+                        "need leading '0x')\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            op->sa[op->num_sa++] = (uint64_t)sa_ll;
+            break;
+        case 't':
+           op->timeout_ms = smp_get_num(optarg);
+           if (op->timeout_ms < 0) {
+                pr2serr("bad argument to '--timeout'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'v':
+            ++op->verbose;
+            break;
+        case 'V':
+            pr2serr("version: %s\n", version_str);
+            return 0;
+        default:
+            pr2serr("unrecognised switch code 0x%x ??\n", c);
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+
+    sp = (struct scan_t *)calloc(1, sizeof(struct scan_t));
+    if (NULL == sp) {
+        pr2serr("heap allocation problem\n");
+        return SMP_LIB_RESOURCE_ERROR;
+    }
+    sp->op = op;
+    sp->i_params = i_params;
+#ifdef SMP_LIB_LINUX
+    find_bsg_expanders(sp, op->verbose);
+#endif
+    /* each SMP_DEVICE given is treated as a HBA of its own */
+    for (j = 0; optind < argc; ++optind, ++j) {
+        subvalue = 0;
+        for (k = 0; k < (op->num_sa ? op->num_sa : 1); ++k) {
+            if (sp->num_tgts >= MAX_TARGETS) {
+                pr2serr(">> more than %d SMP targets, some not scanned\n",
+                        MAX_TARGETS);
+                break;
+            }
+            tp = sp->tgts + sp->num_tgts++;
+            memset(tp, 0, sizeof(*tp));
+            tp->hba = -1 - j;
+            snprintf(tp->dev_name, sizeof(tp->dev_name), "%s", argv[optind]);
+            if ((cp = strchr(tp->dev_name, SMP_SUBVALUE_SEPARATOR))) {
+                *cp = '\0';
+                if (1 != sscanf(cp + 1, "%d", &subvalue)) {
+                    pr2serr("expected number after separator in "
+                            "SMP_DEVICE name\n");
+                    ret = SMP_LIB_SYNTAX_ERROR;
+                    goto fini;
+                }
+            }
+            tp->subvalue = subvalue;
+            tp->sa = op->num_sa ? op->sa[k] : 0;
+        }
+    }
+    if (0 == sp->num_tgts) {
+        pr2serr("No SMP targets found\n");
+        ret = SMP_LIB_FILE_ERROR;
+        goto fini;
+    }
+    group_by_hba(sp);
+    if (op->verbose)
+        pr2serr("%d SMP target%s on %d HBA%s\n", sp->num_tgts,
+                (1 == sp->num_tgts) ? "" : "s", sp->num_hbas,
+                (1 == sp->num_hbas) ? "" : "s");
+
+    /* one worker per HBA, the calling thread takes the first */
+    for (n = 1; n < sp->num_hbas; ++n) {
+        res = pthread_create(&sp->hbas[n].thr, NULL, scan_worker,
+                             sp->hbas + n);
+        if (res) {
+            if (op->verbose)
+                pr2serr("pthread_create: %s, scanning the rest in this "
+                        "thread\n", safe_strerror(res));
+            break;
+        }
+    }
+    scan_worker(sp->hbas + 0);
+    for (k = n; k < sp->num_hbas; ++k)
+        scan_worker(sp->hbas + k);
+    for (k = 1; k < n; ++k)
+        pthread_join(sp->hbas[k].thr, NULL);
+
+    for (k = 0; k < sp->num_tgts; ++k) {
+        output_tgt(sp->tgts + k, op);
+        if (sp->tgts[k].status && (0 == ret))
+            ret = sp->tgts[k].status;
+    }
+fini:
+    free(sp);
+    if (op->verbose && ret)
+        pr2serr("Exit status %d indicates error detected\n", ret);
+    return ret;
+}
@@ -0,0 +1,502 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_pr2serr.h"
+
+/* This is a Serial Attached SCSI (SAS) Serial Management Protocol (SMP)
+ * utility.
+ *
+ * This utility opens one SMP target then reads commands, one per line,
+ * from stdin or a script file. Each command is the name of another
+ * smp_utils utility (with or without its "smp_" prefix) followed by its
+ * options. The utilities are built into this binary and are run in this
+ * process against the already open SMP target, so there is no process
+ * creation, device probing or open per SMP function.
+ */
+
+static const char * version_str = "1.01 20261014";
+
+#define MAX_LINE_LEN 4096
+#define MAX_ARGS 128
+
+/* Each utility's main() when built with SMP_UTILS_MULTI defined */
+int smp_conf_general_main(int argc, char * argv[]);
+int smp_conf_phy_event_main(int argc, char * argv[]);
+int smp_conf_route_info_main(int argc, char * argv[]);
+int smp_conf_zone_man_pass_main(int argc, char * argv[]);
+int smp_conf_zone_perm_tbl_main(int argc, char * argv[]);
+int smp_conf_zone_phy_info_main(int argc, char * argv[]);
+int smp_discover_main(int argc, char * argv[]);
+int smp_discover_list_main(int argc, char * argv[]);
+int smp_ena_dis_zoning_main(int argc, char * argv[]);
+int smp_phy_control_main(int argc, char * argv[]);
+int smp_phy_test_main(int argc, char * argv[]);
+int smp_read_gpio_main(int argc, char * argv[]);
+int smp_rep_broadcast_main(int argc, char * argv[]);
+int smp_rep_exp_route_tbl_main(int argc, char * argv[]);
+int smp_rep_general_main(int argc, char * argv[]);
+int smp_rep_manufacturer_main(int argc, char * argv[]);
+int smp_rep_phy_err_log_main(int argc, char * argv[]);
+int smp_rep_phy_event_main(int argc, char * argv[]);
+int smp_rep_phy_event_list_main(int argc, char * argv[]);
+int smp_rep_phy_sata_main(int argc, char * argv[]);
+int smp_rep_route_info_main(int argc, char * argv[]);
+int smp_rep_self_conf_stat_main(int argc, char * argv[]);
+int smp_rep_zone_man_pass_main(int argc, char * argv[]);
+int smp_rep_zone_perm_tbl_main(int argc, char * argv[]);
+int smp_topology_main(int argc, char * argv[]);
+int smp_write_gpio_main(int argc, char * argv[]);
+int smp_zone_activate_main(int argc, char * argv[]);
+int smp_zone_lock_main(int argc, char * argv[]);
+int smp_zone_unlock_main(int argc, char * argv[]);
+int smp_zoned_broadcast_main(int argc, char * argv[]);
+
+typedef int (*util_main_t)(int argc, char * argv[]);
+
+struct util_cmd_t {
+    const char * name;          /* without the "smp_" prefix */
+    util_main_t main_fn;
+};
+
+static struct util_cmd_t util_cmd_arr[] = {
+        {"conf_general", smp_conf_general_main},
+        {"conf_phy_event", smp_conf_phy_event_main},
+        {"conf_route_info", smp_conf_route_info_main},
+        {"conf_zone_man_pass", smp_conf_zone_man_pass_main},
+        {"conf_zone_perm_tbl", smp_conf_zone_perm_tbl_main},
+        {"conf_zone_phy_info", smp_conf_zone_phy_info_main},
+        {"discover", smp_discover_main},
+        {"discover_list", smp_discover_list_main},
+        {"ena_dis_zoning", smp_ena_dis_zoning_main},
+        {"phy_control", smp_phy_control_main},
+        {"phy_test", smp_phy_test_main},
+        {"read_gpio", smp_read_gpio_main},
+        {"rep_broadcast", smp_rep_broadcast_main},
+        {"rep_exp_route_tbl", smp_rep_exp_route_tbl_main},
+        {"rep_general", smp_rep_general_main},
+        {"rep_manufacturer", smp_rep_manufacturer_main},
+        {"rep_phy_err_log", smp_rep_phy_err_log_main},
+        {"rep_phy_event", smp_rep_phy_event_main},
+        {"rep_phy_event_list", smp_rep_phy_event_list_main},
+        {"rep_phy_sata", smp_rep_phy_sata_main},
+        {"rep_route_info", smp_rep_route_info_main},
+        {"rep_self_conf_stat", smp_rep_self_conf_stat_main},
+        {"rep_zone_man_pass", smp_rep_zone_man_pass_main},
+        {"rep_zone_perm_tbl", smp_rep_zone_perm_tbl_main},
+        {"topology", smp_topology_main},
+        {"write_gpio", smp_write_gpio_main},
+        {"zone_activate", smp_zone_activate_main},
+        {"zone_lock", smp_zone_lock_main},
+        {"zone_unlock", smp_zone_unlock_main},
+        {"zoned_broadcast", smp_zoned_broadcast_main},
+        {NULL, NULL},
+};
+
+struct opts_t {
+    bool do_echo;
+    bool keep_going;
+    int verbose;
+    const char * script_fn;
+};
+
+static struct option long_options[] = {
+        {"echo", no_argument, 0, 'e'},
+        {"file", required_argument, 0, 'f'},
+        {"help", no_argument, 0, 'h'},
+        {"interface", required_argument, 0, 'I'},
+        {"keep-going", no_argument, 0, 'k'},
+        {"keep_going", no_argument, 0, 'k'},
+        {"sa", required_argument, 0, 's'},
+        {"verbose", no_argument, 0, 'v'},
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0},
+};
+
+
+static void
+usage(void)
+{
+    pr2serr("Usage: "
+            "smp_shell [--echo] [--file=SF] [--help] [--interface=PARAMS]\n"
+            "                 [--keep-going] [--sa=SAS_ADDR] [--verbose] "
+            "[--version]\n"
+            "                 SMP_DEVICE[,N]\n"
+            "  where:\n"
+            "    --echo|-e            echo each command before it is run\n"
+            "    --file=SF|-f SF      read commands from script file SF "
+            "(def: stdin)\n"
+            "    --help|-h            print out usage message\n"
+            "    --interface=PARAMS|-I PARAMS    specify or override "
+            "interface\n"
+            "    --keep-going|-k      continue after a command fails (def: "
+            "stop,\n"
+            "                         unless interactive)\n"
+            "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of SMP "
+            "target (use leading\n"
+            "                                 '0x' or trailing 'h'). "
+            "Depending on\n"
+            "                                 the interface, may not be "
+            "needed\n"
+            "    --verbose|-v         increase verbosity\n"
+            "    --version|-V         print version string and exit\n\n"
+            "Opens SMP_DEVICE once then runs commands read from SF or stdin. "
+            "Each\ncommand line is a smp_utils utility name (the 'smp_' "
+            "prefix is optional)\nfollowed by its options, without "
+            "SMP_DEVICE. Use 'help' to list them.\n");
+}
+
+static void
+list_cmds(void)
+{
+    int k;
+    const struct util_cmd_t * ucp;
+
+    printf("Commands (each may be prefixed by 'smp_'):\n");
+    for (k = 0, ucp = util_cmd_arr; ucp->name; ++ucp, ++k)
+        printf("  %-22s%s", ucp->name, (1 == (k % 3)) ? "\n" : "");
+    printf("%s  echo [TEXT]  help  quit (or exit)\n", (k % 3) ? "\n" : "");
+}
+
+static void
+reset_getopt(void)
+{
+#ifdef SMP_LIB_FREEBSD
+    optreset = 1;
+    optind = 1;
+#elif defined(SMP_UTILS_SOLARIS)
+    optind = 1;
+#else
+    optind = 0;         /* glibc: also re-initializes its internal state */
+#endif
+}
+
+/* Splits line into whitespace separated arguments, in place. Single and
+ * double quotes group words; '#' outside quotes starts a comment. Returns
+ * the number of arguments or -1 if there are too many or a quote is not
+ * closed. */
+static int
+split_line(char * line, char * argv[], int max_args)
+{
+    int argc = 0;
+    char q;
+    char * cp = line;
+    char * op;
+
+    while (1) {
+        while (*cp && strchr(" \t\r\n", *cp))
+            ++cp;
+        if (('\0' == *cp) || ('#' == *cp))
+            break;
+        if (argc >= (max_args - 1))
+            return -1;
+        argv[argc++] = cp;
+        for (op = cp, q = '\0'; *cp; ++cp) {
+            if (q) {
+                if (*cp == q)
+                    q = '\0';
+                else
+                    *op++ = *cp;
+            } else if (('\'' == *cp) || ('"' == *cp))
+                q = *cp;
+            else if (strchr(" \t\r\n", *cp))
+                break;
+            else
+                *op++ = *cp;
+        }
+        if (q)
+            return -1;
+        if (*cp)
+            ++cp;
+        *op = '\0';
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+/* Runs the command in line. Returns its exit status, -1 for quit, or
+ * SMP_LIB_SYNTAX_ERROR. */
+static int
+do_line(char * line, int lineno, const struct opts_t * op)
+{
+    int argc, k, res;
+    const char * name;
+    char * argv[MAX_ARGS];
+    char prog[64];
+    const struct util_cmd_t * ucp;
+
+    if (op->do_echo) {
+        printf("%s%s", line, (strchr(line, '\n') ? "" : "\n"));
+        fflush(stdout);
+    }
+    argc = split_line(line, argv, MAX_ARGS);
+    if (argc < 0) {
+        pr2serr("line %d: too many arguments or unterminated quote\n",
+                lineno);
+        return SMP_LIB_SYNTAX_ERROR;
+    }
+    if (0 == argc)
+        return 0;
+    name = argv[0];
+    if (0 == strncmp(name, "smp_", 4))
+        name += 4;
+    if ((0 == strcmp(name, "quit")) || (0 == strcmp(name, "exit")))
+        return -1;
+    if ((0 == strcmp(name, "help")) || (0 == strcmp(name, "?"))) {
+        list_cmds();
+        return 0;
+    }
+    if (0 == strcmp(name, "echo")) {
+        for (k = 1; k < argc; ++k)
+            printf("%s%s", argv[k], (k < (argc - 1)) ? " " : "");
+        printf("\n");
+        return 0;
+    }
+    for (ucp = util_cmd_arr; ucp->name; ++ucp) {
+        if (0 == strcmp(name, ucp->name))
+            break;
+    }
+    if (NULL == ucp->name) {
+        pr2serr("line %d: unknown command: %s ('help' lists them)\n",
+                lineno, argv[0]);
+        return SMP_LIB_SYNTAX_ERROR;
+    }
+    snprintf(prog, sizeof(prog), "smp_%s", ucp->name);
+    argv[0] = prog;
+    reset_getopt();
+    res = ucp->main_fn(argc, argv);
+    fflush(stdout);
+    if (res && (op->verbose || op->script_fn))
+        pr2serr("line %d: %s exit status %d\n", lineno, prog, res);
+    return res;
+}
+
+
+#ifdef SMP_UTILS_MULTICALL
+int
+smp_shell_main(int argc, char * argv[])
+#else
+int
+main(int argc, char * argv[])
+#endif
+{
+    bool interactive;
+    int res, c, lineno;
+    int ret = 0;
+    int subvalue = 0;
+    int64_t sa_ll;
+    uint64_t sa = 0;
+    char * cp;
+    char i_params[256];
+    char device_name[512];
+    char env_dev[600];
+    char b[32];
+    char line[MAX_LINE_LEN];
+    FILE * fp;
+    struct smp_target_obj tobj;
+    struct opts_t opts;
+    struct opts_t * op;
+
+    op = &opts;
+    memset(op, 0, sizeof(opts));
+    memset(device_name, 0, sizeof device_name);
+    memset(i_params, 0, sizeof i_params);
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "ef:hI:ks:vV", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'e':
+            op->do_echo = true;
+            break;
+        case 'f':
+            op->script_fn = optarg;
+            break;
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'I':
+            strncpy(i_params, optarg, sizeof(i_params));
+            i_params[sizeof(i_params) - 1] = '\0';
+            break;
+        case 'k':
+            op->keep_going = true;
+            break;
+        case 's':
+           sa_ll = smp_get_llnum_nomult(optarg);
+           if (-1LL == sa_ll) {
+                pr2serr("bad argument to '--sa'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            sa = (uint64_t)sa_ll;
+            break;
+        case 'v':
+            ++op->verbose;
+            break;
+        case 'V':
+            pr2serr("version: %s\n", version_str);
+            return 0;
+        default:
+            pr2serr("unrecognised switch code 0x%x ??\n", c);
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (optind < argc) {
+        if ('\0' == device_name[0]) {
+            strncpy(device_name, argv[optind], sizeof(device_name) - 1);
+            device_name[sizeof(device_name) - 1] = '\0';
+            ++optind;
+        }
+        if (optind < argc) {
+            for (; optind < argc; ++optind)
+                pr2serr("Unexpected extra argument: %s\n",
+                        argv[optind]);
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (0 == device_name[0]) {
+        cp = getenv("SMP_UTILS_DEVICE");
+        if (cp)
+            strncpy(device_name, cp, sizeof(device_name) - 1);
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
+            pr2serr("missing device name on command line\n    [Could use "
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    /* each command finds the SMP target in the environment */
+    snprintf(env_dev, sizeof(env_dev), "%s", device_name);
+    if ((cp = strchr(device_name, SMP_SUBVALUE_SEPARATOR))) {
+        *cp = '\0';
+        if (1 != sscanf(cp + 1, "%d", &subvalue)) {
+            pr2serr("expected number after separator in SMP_DEVICE name\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (0 == sa) {
+        cp = getenv("SMP_UTILS_SAS_ADDR");
+        if (cp) {
+           sa_ll = smp_get_llnum_nomult(cp);
+           if (-1LL == sa_ll) {
+                pr2serr("bad value in environment variable "
+                        "SMP_UTILS_SAS_ADDR\n");
+                pr2serr("    use 0\n");
+                sa_ll = 0;
+            }
+            sa = (uint64_t)sa_ll;
+        }
+    }
+    if (sa > 0) {
+        if (! smp_is_naa5(sa)) {
+            pr2serr("SAS (target) address not in naa-5 format (may need "
+                    "leading '0x')\n");
+            if ('\0' == i_params[0]) {
+                pr2serr("    use '--interface=' to override\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+        }
+        snprintf(b, sizeof(b), "0x%" PRIx64, sa);
+        setenv("SMP_UTILS_SAS_ADDR", b, 1);
+    }
+    if (env_dev[0])     /* else opened by SAS address */
+        setenv("SMP_UTILS_DEVICE", env_dev, 1);
+
+    if (op->script_fn) {
+        if (0 == strcmp("-", op->script_fn))
+            fp = stdin;
+        else if (NULL == (fp = fopen(op->script_fn, "r"))) {
+            pr2serr("unable to open %s: %s\n", op->script_fn,
+                    safe_strerror(errno));
+            return SMP_LIB_FILE_ERROR;
+        }
+    } else
+        fp = stdin;
+    interactive = (stdin == fp) && isatty(fileno(stdin));
+    if (interactive)
+        op->keep_going = true;
+
+    res = smp_initiator_open(device_name, subvalue, i_params, sa, &tobj,
+                             op->verbose);
+    if (res < 0) {
+        ret = SMP_LIB_FILE_ERROR;
+        goto close_fp;
+    }
+    smp_session_begin(&tobj);
+    for (lineno = 1; ; ++lineno) {
+        if (interactive) {
+            printf("smp> ");
+            fflush(stdout);
+        }
+        if (NULL == fgets(line, sizeof(line), fp))
+            break;
+        res = do_line(line, lineno, op);
+        if (res < 0)
+            break;      /* quit or exit */
+        if (res) {
+            ret = res;
+            if (! op->keep_going)
+                break;
+        }
+    }
+    if (interactive)
+        printf("\n");
+    smp_session_end();
+    res = smp_initiator_close(&tobj);
+    if ((res < 0) && (0 == ret))
+        ret = SMP_LIB_FILE_ERROR;
+close_fp:
+    if (fp && (stdin != fp))
+        fclose(fp);
+    if (op->verbose && ret)
+        pr2serr("Exit status %d indicates error detected\n", ret);
+    return ret;
+}
@@ -0,0 +1,968 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* This is a Serial Attached SCSI (SAS) Serial Management Protocol (SMP)
+ * utility.
+ *
+ * This utility starts at a root expander and walks the SAS domain by
+ * following those phys whose attached device is an expander. Each
+ * expander is queried with REPORT GENERAL then a DISCOVER for every phy.
+ * Several expanders are walked at once by a pool of worker threads and
+ * each worker keeps several DISCOVER requests in flight to its expander.
+ * Once the whole domain has been walked a consolidated graph is output.
+ */
+
+static const char * version_str = "1.02 20261014";    /* spl5r05 */
+
+
+#define SMP_FN_DISCOVER_RESP_LEN 124
+#define MAX_EXPANDERS 256
+#define DEF_JOBS 4
+#define MAX_JOBS 32
+
+struct opts_t {
+    bool do_dot;
+    bool ign_zp;
+    int do_brief;
+    int jobs;
+    int max_depth;
+    int queue_depth;
+    int retries;                /* -1 -> library default */
+    int timeout_ms;             /* -1 -> library default */
+    int verbose;
+    uint64_t sa;
+    const char * save_fn;       /* --save=FILE */
+    const char * from_fn;       /* --from=FILE */
+    const char * index_fn;      /* --index=FILE */
+};
+
+/* One per expander found in the SAS domain */
+struct topo_exp_t {
+    bool t2t;
+    int depth;                  /* root expander is depth 0 */
+    int parent;                 /* index of parent expander, -1 for root */
+    int parent_phy;             /* phy id on parent leading here */
+    int num_phys;               /* from REPORT GENERAL */
+    int status;                 /* 0 when walked successfully */
+    uint64_t sa;
+    char dev_name[SMP_MAX_DEVICE_NAME];
+    uint8_t * disc;             /* num_phys DISCOVER responses */
+    int * disc_len;             /* < 0 --> (-4 - function result) */
+};
+
+struct topo_t {
+    const struct opts_t * op;
+    const char * root_dev;
+    const char * i_params;
+    int root_subvalue;
+    int num;                    /* number of expanders in nodes[] */
+    int next;                   /* next expander to walk */
+    int busy;                   /* workers currently walking */
+    bool overflow;
+    pthread_mutex_t mtx;
+    pthread_cond_t cv;
+    struct topo_exp_t * nodes[MAX_EXPANDERS];
+};
+
+static struct option long_options[] = {
+        {"brief", no_argument, 0, 'b'},
+        {"depth", required_argument, 0, 'd'},
+        {"dot", no_argument, 0, 'D'},
+        {"from", required_argument, 0, 'F'},
+        {"help", no_argument, 0, 'h'},
+        {"ignore", no_argument, 0, 'i'},
+        {"index", required_argument, 0, 'x'},
+        {"interface", required_argument, 0, 'I'},
+        {"jobs", required_argument, 0, 'j'},
+        {"queue", required_argument, 0, 'q'},
+        {"retries", required_argument, 0, 'R'},
+        {"sa", required_argument, 0, 's'},
+        {"save", required_argument, 0, 'w'},
+        {"timeout", required_argument, 0, 't'},
+        {"verbose", no_argument, 0, 'v'},
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0},
+};
+
+static const char * smp_short_attached_device_type[] = {
+    "",         /* was "no " */
+    "",         /* was "end" */
+    "exp",
+    "fex",      /* obsolete in sas2r05a */
+    "res",
+    "res",
+    "res",
+    "res",
+};
+
+
+static void
+usage(void)
+{
+    pr2serr("Usage: "
+            "smp_topology [--brief] [--depth=MD] [--dot] [--from=FILE] "
+            "[--help]\n"
+            "                    [--ignore] [--index=FILE] "
+            "[--interface=PARAMS] [--jobs=J]\n"
+            "                    [--queue=QD] [--retries=N] [--sa=SAS_ADDR] "
+            "[--save=FILE]\n"
+            "                    [--timeout=MS] [--verbose] [--version]\n"
+            "                    SMP_DEVICE[,N]\n"
+            "  where:\n"
+            "    --brief|-b           less output, only show phys attached "
+            "to other\n"
+            "                         expanders; twice: only show "
+            "expanders\n"
+            "    --depth=MD|-d MD     maximum depth to walk below root "
+            "expander\n"
+            "                         (def: 0 -> no limit)\n"
+            "    --dot|-D             output graph in Graphviz dot format\n"
+            "    --from=FILE|-F FILE  walk the domain recorded in snapshot "
+            "FILE\n"
+            "                         (written by --save), not the "
+            "hardware\n"
+            "    --help|-h            print out usage message\n"
+            "    --ignore|-i          sets the Ignore Zone Group bit; "
+            "will show\n"
+            "                         phys otherwise hidden by zoning\n"
+            "    --index=FILE|-x FILE    write index of attached devices to "
+            "FILE for\n"
+            "                            smp_locate ('-' -> %s)\n"
+            "    --interface=PARAMS|-I PARAMS    specify or override "
+            "interface\n"
+            "    --jobs=J|-j J        number of expanders walked at once "
+            "(def: %d)\n"
+            "    --queue=QD|-q QD     DISCOVER requests in flight per "
+            "expander\n"
+            "                         (def: %d)\n"
+            "    --retries=N|-R N     times to resend a request answered "
+            "BUSY (or\n"
+            "                         that timed out with --timeout) "
+            "(def: 2)\n"
+            "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of root SMP "
+            "target (use\n"
+            "                                 leading '0x' or trailing "
+            "'h'). Depending\n"
+            "                                 on the interface, may not be "
+            "needed\n"
+            "    --save=FILE|-w FILE  save each request and its response in "
+            "snapshot\n"
+            "                         FILE, to be read later with "
+            "--from=FILE\n"
+            "    --timeout=MS|-t MS   SMP request timeout in milliseconds "
+            "(def: 0 ->\n"
+            "                         pass-through's default). With "
+            "--retries=0\n"
+            "                         bounds the time a hung expander "
+            "costs\n"
+            "    --verbose|-v         increase verbosity\n"
+            "    --version|-V         print version string and exit\n\n"
+            "Walks the SAS domain starting at the expander given by "
+            "SMP_DEVICE and\nfollowing attached expanders. Outputs one "
+            "consolidated graph of the\nexpanders found and the disposition "
+            "of each of their phys.\n", SMP_LOCATE_FN, DEF_JOBS,
+            SMP_BATCH_DEF_INFLIGHT);
+}
+
+/* Keeps what smp_send_req() returned for each request of a batch */
+static void
+batch_cb(int index, struct smp_req_resp * rresp, int res, void * cb_arg)
+{
+    if (rresp) { ; }    /* unused, suppress warning */
+    ((int *)cb_arg)[index] = res;
+}
+
+/* Checks SMP response header. Returns response length excluding CRC, or
+ * -1 for transport problems, or (-4 - function result). */
+static int
+check_resp(const struct smp_req_resp * rrp, int res, const char * leadin,
+           int verbose)
+{
+    int len, act_resplen;
+    const uint8_t * rp = rrp->response;
+    char b[128];
+
+    if (res) {
+        if (verbose)
+            pr2serr("%s smp_send_req failed, res=%d\n", leadin, res);
+        return -1;
+    }
+    if (rrp->transport_err) {
+        if (verbose)
+            pr2serr("%s smp_send_req transport_error=%d\n", leadin,
+                    rrp->transport_err);
+        return -1;
+    }
+    act_resplen = rrp->act_response_len;
+    if ((act_resplen >= 0) && (act_resplen < 4)) {
+        if (verbose)
+            pr2serr("%s response too short, len=%d\n", leadin, act_resplen);
+        return -4 - SMP_LIB_CAT_MALFORMED;
+    }
+    len = rp[3];
+    if ((0 == len) && (0 == rp[2])) {
+        len = smp_get_func_def_resp_len(rp[1]);
+        if (len < 0)
+            len = 0;
+    }
+    len = 4 + (len * 4);        /* length in bytes, excluding 4 byte CRC */
+    if ((act_resplen >= 0) && (len > act_resplen))
+        len = act_resplen;
+    if ((SMP_FRAME_TYPE_RESP != rp[0]) || (rp[1] != rrp->request[1])) {
+        if (verbose)
+            pr2serr("%s malformed response, frame type=0x%x, function=0x%x"
+                    "\n", leadin, rp[0], rp[1]);
+        return -4 - SMP_LIB_CAT_MALFORMED;
+    }
+    if (rp[2]) {
+        if (verbose > 1)
+            pr2serr("%s result: %s\n", leadin,
+                    smp_get_func_res_str(rp[2], sizeof(b), b));
+        return -4 - rp[2];
+    }
+    return len;
+}
+
+/* Returns number of phys (> 0) or a negative value as check_resp() */
+static int
+do_rep_gen(struct smp_target_obj * top, bool * t2tp, int verbose)
+{
+    int res;
+    struct smp_report_general rg;
+
+    res = smp_get_report_general(top, &rg, -1, verbose);
+    if (res) {
+        if (verbose)
+            pr2serr("RG failed, res=%d\n", res);
+        return (res < 0) ? -1 : (-4 - res);
+    }
+    *t2tp = rg.table_to_table_sup;
+    return rg.num_phys;
+}
+
+/* Returns index of expander with SAS address 'sa' or -1. Call with mutex
+ * held. */
+static int
+find_exp(const struct topo_t * tp, uint64_t sa)
+{
+    int k;
+
+    for (k = 0; k < tp->num; ++k) {
+        if (tp->nodes[k]->sa == sa)
+            return k;
+    }
+    return -1;
+}
+
+/* Opens the expander in 'np'. The root expander is opened as given on the
+ * command line. Others are opened by SAS address (in Linux via the
+ * library's SAS address to bsg index); if that fails then the root's
+ * SMP_DEVICE is re-opened with the expander's SAS address which is what
+ * the mpt and aac interfaces need. */
+static int
+open_exp(const struct topo_t * tp, struct topo_exp_t * np,
+         struct smp_target_obj * top)
+{
+    int res;
+    const struct opts_t * op = tp->op;
+
+    if (np->parent < 0) {
+        res = smp_initiator_open(tp->root_dev, tp->root_subvalue,
+                                 tp->i_params, op->sa, top, op->verbose);
+        /* with --from an empty SMP_DEVICE is the snapshot's first */
+        snprintf(np->dev_name, sizeof(np->dev_name), "%s",
+                 res ? tp->root_dev : top->device_name);
+        goto fini;
+    }
+#ifdef SMP_LIB_LINUX
+    if (0 == smp_initiator_open_by_sa(np->sa, tp->i_params, top,
+                                      op->verbose)) {
+        snprintf(np->dev_name, sizeof(np->dev_name), "%s", top->device_name);
+        res = 0;
+        goto fini;
+    }
+#endif
+    snprintf(np->dev_name, sizeof(np->dev_name), "%s", tp->root_dev);
+    res = smp_initiator_open(tp->root_dev, tp->root_subvalue, tp->i_params,
+                             np->sa, top, op->verbose);
+fini:
+    if (0 == res)
+        smp_set_req_policy(top, op->timeout_ms, op->retries, -1);
+    return res;
+}
+
+/* Sends REPORT GENERAL then DISCOVER to every phy of the expander at
+ * index 'idx', then queues any newly found expanders. */
+static void
+walk_exp(struct topo_t * tp, int idx)
+{
+    bool first = true;
+    int k, n, num, res;
+    uint64_t ull;
+    const struct opts_t * op = tp->op;
+    struct topo_exp_t * np = tp->nodes[idx];
+    struct topo_exp_t * cnp;
+    struct smp_target_obj tobj;
+    struct smp_discover_view dv;
+    struct smp_req_resp * rrp = NULL;
+    int * res_arr = NULL;
+    uint8_t * reqs = NULL;
+    uint8_t * rp;
+    char b[64];
+
+    if (open_exp(tp, np, &tobj) < 0) {
+        np->status = SMP_LIB_FILE_ERROR;
+        return;
+    }
+    num = do_rep_gen(&tobj, &np->t2t, op->verbose);
+    if (num <= 0) {
+        np->status = (num < -2) ? (-4 - num) : SMP_LIB_CAT_OTHER;
+        goto fini;
+    }
+    np->disc = (uint8_t *)calloc(num, SMP_FN_DISCOVER_RESP_LEN);
+    np->disc_len = (int *)calloc(num, sizeof(int));
+    rrp = (struct smp_req_resp *)calloc(num, sizeof(struct smp_req_resp));
+    reqs = (uint8_t *)calloc(num, 16);
+    res_arr = (int *)calloc(num, sizeof(int));
+    if ((NULL == np->disc) || (NULL == np->disc_len) || (NULL == rrp) ||
+        (NULL == reqs) || (NULL == res_arr)) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        np->status = SMP_LIB_RESOURCE_ERROR;
+        goto fini;
+    }
+    np->num_phys = num;
+    for (k = 0; k < num; ++k) {
+        uint8_t * qp = reqs + (16 * k);
+
+        qp[0] = SMP_FRAME_TYPE_REQ;
+        qp[1] = SMP_FN_DISCOVER;
+        qp[2] = (SMP_FN_DISCOVER_RESP_LEN - 8) / 4;
+        qp[3] = 2;
+        if (op->ign_zp)
+            qp[8] |= 0x1;
+        qp[9] = k;
+        rrp[k].request_len = 16;
+        rrp[k].request = qp;
+        rrp[k].max_response_len = SMP_FN_DISCOVER_RESP_LEN;
+        rrp[k].response = np->disc + (SMP_FN_DISCOVER_RESP_LEN * k);
+    }
+    if (smp_send_req_batch(&tobj, rrp, num, op->queue_depth, batch_cb,
+                           res_arr, op->verbose) < 0) {
+        for (k = 0; k < num; ++k)
+            res_arr[k] = -1;    /* nothing was sent */
+    }
+
+    snprintf(b, sizeof(b), "expander %d phy", idx);
+    for (k = 0; k < num; ++k) {
+        rp = np->disc + (SMP_FN_DISCOVER_RESP_LEN * k);
+        res = check_resp(rrp + k, res_arr[k], b, op->verbose);
+        np->disc_len[k] = res;
+        if ((res < 0) || smp_decode_discover(rp, res, 0, &dv))
+            continue;
+        ull = dv.sas_addr;
+        if (first) {
+            first = false;
+            if (0 == np->sa)
+                np->sa = ull;
+            else if ((ull > 0) && (ull != np->sa)) {
+                pr2serr(">> expected expander 0x%" PRIx64 " but reached "
+                        "0x%" PRIx64 "\n", np->sa, ull);
+                np->status = SMP_LIB_CAT_OTHER;
+                goto fini;
+            }
+        }
+        if ((2 != dv.att_dev_type) && (3 != dv.att_dev_type))
+            continue;
+        ull = dv.att_sas_addr;
+        if (0 == ull)
+            continue;
+        pthread_mutex_lock(&tp->mtx);
+        if (op->max_depth && (np->depth >= op->max_depth))
+            n = 0;
+        else if (find_exp(tp, ull) >= 0)
+            n = 0;
+        else if (tp->num >= MAX_EXPANDERS) {
+            tp->overflow = true;
+            n = 0;
+        } else
+            n = 1;
+        if (n) {
+            cnp = (struct topo_exp_t *)calloc(1, sizeof(*cnp));
+            if (cnp) {
+                cnp->sa = ull;
+                cnp->depth = np->depth + 1;
+                cnp->parent = idx;
+                cnp->parent_phy = k;
+                tp->nodes[tp->num++] = cnp;
+                pthread_cond_broadcast(&tp->cv);
+            }
+        }
+        pthread_mutex_unlock(&tp->mtx);
+    }
+fini:
+    free(res_arr);
+    if (reqs)
+        free(reqs);
+    if (rrp)
+        free(rrp);
+    smp_initiator_close(&tobj);
+}
+
+static void *
+topo_worker(void * arg)
+{
+    int idx;
+    struct topo_t * tp = (struct topo_t *)arg;
+
+    pthread_mutex_lock(&tp->mtx);
+    while (1) {
+        if (tp->next < tp->num) {
+            idx = tp->next++;
+            ++tp->busy;
+            pthread_mutex_unlock(&tp->mtx);
+            walk_exp(tp, idx);
+            pthread_mutex_lock(&tp->mtx);
+            --tp->busy;
+            pthread_cond_broadcast(&tp->cv);
+        } else if (0 == tp->busy)
+            break;      /* nothing queued and no one to queue more */
+        else
+            pthread_cond_wait(&tp->cv, &tp->mtx);
+    }
+    pthread_mutex_unlock(&tp->mtx);
+    return NULL;
+}
+
+static char *
+proto_str(int bits, const char * leadin, char * b, int blen)
+{
+    bool plus = false;
+    int off = 0;
+
+    b[0] = '\0';
+    if (0 == (bits & 0xf))
+        return b;
+    off += snprintf(b + off, blen - off, " %s(", leadin);
+    if (bits & 0x8) {
+        off += snprintf(b + off, blen - off, "SSP");
+        plus = true;
+    }
+    if (bits & 0x4) {
+        off += snprintf(b + off, blen - off, "%sSTP", (plus ? "+" : ""));
+        plus = true;
+    }
+    if (bits & 0x2) {
+        off += snprintf(b + off, blen - off, "%sSMP", (plus ? "+" : ""));
+        plus = true;
+    }
+    if (bits & 0x1)
+        off += snprintf(b + off, blen - off, "%sSATA", (plus ? "+" : ""));
+    snprintf(b + off, blen - off, ")");
+    return b;
+}
+
+/* Outputs one line per phy in the same style as 'smp_discover -m' */
+static void
+print_phy(const struct topo_t * tp, const struct topo_exp_t * np, int k)
+{
+    int len, adt, ei;
+    const char * cp;
+    const char * rate;
+    const uint8_t * rp = np->disc + (SMP_FN_DISCOVER_RESP_LEN * k);
+    const struct opts_t * op = tp->op;
+    struct smp_discover_view dv;
+    char b[64];
+    char c[64];
+
+    len = np->disc_len[k];
+    if (len < 0) {
+        if (SMP_FRES_PHY_VACANT == (-4 - len))
+            printf("  phy %3d: inaccessible (phy vacant)\n", k);
+        else if ((SMP_FRES_NO_PHY != (-4 - len)) && (op->do_brief < 1))
+            printf("  phy %3d: error, %s\n", k, (len < -2) ?
+                   smp_get_func_res_str(-4 - len, sizeof(b), b) :
+                   "transport failure");
+        return;
+    }
+    if (smp_decode_discover(rp, len, 0, &dv))
+        return;
+    adt = dv.att_dev_type;
+    if ((op->do_brief > 0) && (2 != adt) && (3 != adt))
+        return;
+    switch (dv.routing_attr) {
+    case 0:
+        cp = "D";
+        break;
+    case 1:
+        cp = "S";
+        break;
+    case 2:
+        cp = np->t2t ? "U" : "T";
+        break;
+    default:
+        cp = "R";
+        break;
+    }
+    switch (dv.neg_log_lrate) {
+    case 1:
+        printf("  phy %3d:%s:disabled\n", k, cp);
+        return;
+    case 2:
+        printf("  phy %3d:%s:reset problem\n", k, cp);
+        return;
+    case 3:
+        printf("  phy %3d:%s:spinup hold\n", k, cp);
+        return;
+    case 4:
+        printf("  phy %3d:%s:port selector\n", k, cp);
+        return;
+    case 5:
+        printf("  phy %3d:%s:reset in progress\n", k, cp);
+        return;
+    case 6:
+        printf("  phy %3d:%s:unsupported phy attached\n", k, cp);
+        return;
+    case 8:
+        rate = "  1.5 Gbps";
+        break;
+    case 9:
+        rate = "  3 Gbps";
+        break;
+    case 0xa:
+        rate = "  6 Gbps";
+        break;
+    case 0xb:
+        rate = "  12 Gbps";
+        break;
+    case 0xc:
+        rate = "  22.5 Gbps";
+        break;
+    default:
+        rate = "";
+        break;
+    }
+    if ((0 == adt) || (adt > 3)) {
+        printf("  phy %3d:%s:attached:[0000000000000000:00]\n", k, cp);
+        return;
+    }
+    printf("  phy %3d:%s:attached:[%016" PRIx64 ":%02d %s%s%s%s]%s", k, cp,
+           dv.att_sas_addr, dv.att_phy_id, smp_short_attached_device_type[adt],
+           (dv.virt_phy ? " V" : ""),
+           proto_str(dv.att_init, "i", b, sizeof(b)),
+           proto_str(dv.att_targ, "t", c, sizeof(c)), rate);
+    if ((dv.zone_flags & SMP_DV_ZONING_EN) && (1 != dv.zone_group))
+        printf("  ZG:%d", dv.zone_group);
+    if ((2 == adt) || (3 == adt)) {
+        ei = find_exp(tp, dv.att_sas_addr);
+        if (ei >= 0)
+            printf("  --> exp#%d", ei);
+    }
+    printf("\n");
+}
+
+/* Writes the reverse index of attached SAS addresses (and device names)
+ * to the expander phys of the walk. Returns 0 on success. */
+static int
+write_index(const struct topo_t * tp)
+{
+    int j, k, n, res;
+    const struct topo_exp_t * np;
+    struct smp_locate_idx * lip;
+    const char * fn = tp->op->index_fn;
+
+    for (j = 0, n = 0; j < tp->num; ++j)
+        n += tp->nodes[j]->num_phys;
+    if (NULL == (lip = smp_locate_new(n ? n : 1))) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        return SMP_LIB_RESOURCE_ERROR;
+    }
+    for (j = 0; j < tp->num; ++j) {
+        np = tp->nodes[j];
+        for (k = 0; k < np->num_phys; ++k) {
+            if (np->disc_len[k] >= 0)
+                smp_locate_add(lip, np->dev_name,
+                               np->disc + (SMP_FN_DISCOVER_RESP_LEN * k),
+                               np->disc_len[k]);
+        }
+    }
+    res = smp_locate_save(lip, (0 == strcmp("-", fn)) ? NULL : fn,
+                          tp->op->verbose);
+    smp_locate_free(lip);
+    return res;
+}
+
+static void
+output_text(const struct topo_t * tp)
+{
+    int j, k;
+    const struct topo_exp_t * np;
+
+    printf("SAS domain walked from expander %016" PRIx64 ", %d expander%s "
+           "found\n", tp->nodes[0]->sa, tp->num, (1 == tp->num) ? "" : "s");
+    for (j = 0; j < tp->num; ++j) {
+        np = tp->nodes[j];
+        printf("exp#%d: %016" PRIx64 "  depth=%d", j, np->sa, np->depth);
+        if (np->parent >= 0)
+            printf("  via exp#%d phy %d", np->parent, np->parent_phy);
+        if (np->status) {
+            printf("  [not walked: error %d]\n", np->status);
+            continue;
+        }
+        printf("  phys=%d\n", np->num_phys);
+        if (tp->op->verbose)
+            printf("  device: %s\n", np->dev_name);
+        if (tp->op->do_brief > 1)
+            continue;
+        for (k = 0; k < np->num_phys; ++k)
+            print_phy(tp, np, k);
+    }
+}
+
+/* One node per expander, one edge per expander phy with an attached
+ * device. End devices are shown as (smaller) nodes too. */
+static void
+output_dot(const struct topo_t * tp)
+{
+    int j, k, adt, ei;
+    uint64_t ull;
+    const struct topo_exp_t * np;
+    struct smp_discover_view dv;
+
+    printf("graph sas_domain {\n");
+    for (j = 0; j < tp->num; ++j) {
+        np = tp->nodes[j];
+        printf("  \"%016" PRIx64 "\" [shape=box,label=\"exp#%d\\n%016"
+               PRIx64 "\"];\n", np->sa, j, np->sa);
+    }
+    for (j = 0; j < tp->num; ++j) {
+        np = tp->nodes[j];
+        if (np->status)
+            continue;
+        for (k = 0; k < np->num_phys; ++k) {
+            if ((np->disc_len[k] < 0) ||
+                smp_decode_discover(np->disc + (SMP_FN_DISCOVER_RESP_LEN * k),
+                                    np->disc_len[k], 0, &dv))
+                continue;
+            adt = dv.att_dev_type;
+            ull = dv.att_sas_addr;
+            if ((0 == adt) || (adt > 3) || (0 == ull))
+                continue;
+            if ((2 == adt) || (3 == adt)) {
+                /* show each expander to expander link once */
+                ei = find_exp(tp, ull);
+                if ((ei >= 0) && (0 == tp->nodes[ei]->status) &&
+                    (ull < np->sa))
+                    continue;
+            } else if (tp->op->do_brief)
+                continue;
+            else
+                printf("  \"%016" PRIx64 "\" [shape=ellipse];\n", ull);
+            printf("  \"%016" PRIx64 "\" -- \"%016" PRIx64 "\" "
+                   "[label=\"%d:%d\"];\n", np->sa, ull, k, dv.att_phy_id);
+        }
+    }
+    printf("}\n");
+}
+
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_topology_main(int argc, char * argv[])
+#else
+int
+main(int argc, char * argv[])
+#endif
+{
+    int res, c, k, n_thr;
+    int ret = 0;
+    int subvalue = 0;
+    int64_t sa_ll;
+    char * cp;
+    char i_params[256];
+    char device_name[512];
+    pthread_t thr[MAX_JOBS];
+    struct opts_t opts;
+    struct opts_t * op;
+    struct topo_t topo;
+    struct topo_t * tp;
+
+    op = &opts;
+    memset(op, 0, sizeof(opts));
+    op->retries = -1;
+    op->timeout_ms = -1;
+    op->jobs = DEF_JOBS;
+    op->queue_depth = SMP_BATCH_DEF_INFLIGHT;
+    memset(device_name, 0, sizeof device_name);
+    memset(i_params, 0, sizeof i_params);
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "bd:DF:hiI:j:q:R:s:t:vVw:x:", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'b':
+            ++op->do_brief;
+            break;
+        case 'd':
+           op->max_depth = smp_get_num(optarg);
+           if (op->max_depth < 0) {
+                pr2serr("bad argument to '--depth'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'D':
+            op->do_dot = true;
+            break;
+        case 'F':
+            op->from_fn = optarg;
+            break;
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'i':
+            op->ign_zp = true;
+            break;
+        case 'I':
+            strncpy(i_params, optarg, sizeof(i_params));
+            i_params[sizeof(i_params) - 1] = '\0';
+            break;
+        case 'j':
+           op->jobs = smp_get_num(optarg);
+           if ((op->jobs < 1) || (op->jobs > MAX_JOBS)) {
+                pr2serr("bad argument to '--jobs', expect value from 1 to "
+                        "%d\n", MAX_JOBS);
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'q':
+           op->queue_depth = smp_get_num(optarg);
+           if ((op->queue_depth < 1) ||
+               (op->queue_depth > SMP_BATCH_MAX_INFLIGHT)) {
+                pr2serr("bad argument to '--queue', expect value from 1 to "
+                        "%d\n", SMP_BATCH_MAX_INFLIGHT);
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'R':
+           op->retries = smp_get_num(optarg);
+           if (op->retries < 0) {
+                pr2serr("bad argument to '--retries'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 's':
+           sa_ll = smp_get_llnum_nomult(optarg);
+           if (-1LL == sa_ll) {
+                pr2serr("bad argument to '--sa'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            op->sa = (uint64_t)sa_ll;
+            break;
+        case 't':
+           op->timeout_ms = smp_get_num(optarg);
+           if (op->timeout_ms < 0) {
+                pr2serr("bad argument to '--timeout'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'v':
+            ++op->verbose;
+            break;
+        case 'w':
+            op->save_fn = optarg;
+            break;
+        case 'x':
+            op->index_fn = optarg;
+            break;
+        case 'V':
+            pr2serr("version: %s\n", version_str);
+            return 0;
+        default:
+            pr2serr("unrecognised switch code 0x%x ??\n", c);
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (optind < argc) {
+        if ('\0' == device_name[0]) {
+            strncpy(device_name, argv[optind], sizeof(device_name) - 1);
+            device_name[sizeof(device_name) - 1] = '\0';
+            ++optind;
+        }
+        if (optind < argc) {
+            for (; optind < argc; ++optind)
+                pr2serr("Unexpected extra argument: %s\n",
+                        argv[optind]);
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (0 == device_name[0]) {
+        cp = getenv("SMP_UTILS_DEVICE");
+        if (cp)
+            strncpy(device_name, cp, sizeof(device_name) - 1);
+        else if ((0 == op->sa) && (NULL == op->from_fn) &&
+                 (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
+            pr2serr("missing device name on command line\n    [Could use "
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if ((cp = strchr(device_name, SMP_SUBVALUE_SEPARATOR))) {
+        *cp = '\0';
+        if (1 != sscanf(cp + 1, "%d", &subvalue)) {
+            pr2serr("expected number after separator in SMP_DEVICE name\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (0 == op->sa) {
+        cp = getenv("SMP_UTILS_SAS_ADDR");
+        if (cp) {
+           sa_ll = smp_get_llnum_nomult(cp);
+           if (-1LL == sa_ll) {
+                pr2serr("bad value in environment variable "
+                        "SMP_UTILS_SAS_ADDR\n");
+                pr2serr("    use 0\n");
+                sa_ll = 0;
+            }
+            op->sa = (uint64_t)sa_ll;
+        }
+    }
+    if (op->sa > 0) {
+        if (! smp_is_naa5(op->sa)) {
+            pr2serr("SAS (target) address not in naa-5 format (may need "
+                    "leading '0x')\n");
+            if ('\0' == i_params[0]) {
+                pr2serr("    use '--interface=' to override\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+        }
+    }
+    if (op->from_fn && (res = smp_snap_load(op->from_fn, op->verbose)))
+        return (res < 0) ? SMP_LIB_FILE_ERROR : res;
+    if (op->save_fn && (res = smp_snap_save_begin(op->save_fn,
+                                                  op->verbose)))
+        return (res < 0) ? SMP_LIB_FILE_ERROR : res;
+
+    tp = &topo;
+    memset(tp, 0, sizeof(topo));
+    tp->op = op;
+    tp->root_dev = device_name;
+    tp->root_subvalue = subvalue;
+    tp->i_params = i_params;
+    pthread_mutex_init(&tp->mtx, NULL);
+    pthread_cond_init(&tp->cv, NULL);
+    tp->nodes[0] = (struct topo_exp_t *)calloc(1, sizeof(struct topo_exp_t));
+    if (NULL == tp->nodes[0]) {
+        pr2serr("heap allocation problem\n");
+        return SMP_LIB_RESOURCE_ERROR;
+    }
+    tp->nodes[0]->sa = op->sa;
+    tp->nodes[0]->parent = -1;
+    tp->nodes[0]->parent_phy = -1;
+    tp->num = 1;
+
+    /* the root expander is walked first, it must be reachable */
+    tp->next = 1;
+    walk_exp(tp, 0);
+    if (tp->nodes[0]->status) {
+        ret = tp->nodes[0]->status;
+        goto fini;
+    }
+    for (n_thr = 0; n_thr < (op->jobs - 1); ++n_thr) {
+        res = pthread_create(thr + n_thr, NULL, topo_worker, tp);
+        if (res) {
+            if (op->verbose)
+                pr2serr("pthread_create: %s\n", safe_strerror(res));
+            break;
+        }
+    }
+    topo_worker(tp);
+    for (k = 0; k < n_thr; ++k)
+        pthread_join(thr[k], NULL);
+
+    if (tp->overflow)
+        pr2serr(">> more than %d expanders, some not walked\n",
+                MAX_EXPANDERS);
+    if (op->do_dot)
+        output_dot(tp);
+    else
+        output_text(tp);
+    for (k = 0; k < tp->num; ++k) {
+        if (tp->nodes[k]->status && (0 == ret))
+            ret = tp->nodes[k]->status;
+    }
+    if (op->index_fn && write_index(tp) && (0 == ret))
+        ret = SMP_LIB_FILE_ERROR;
+fini:
+    for (k = 0; k < tp->num; ++k) {
+        if (tp->nodes[k]->disc)
+            free(tp->nodes[k]->disc);
+        if (tp->nodes[k]->disc_len)
+            free(tp->nodes[k]->disc_len);
+        free(tp->nodes[k]);
+    }
+    pthread_cond_destroy(&tp->cv);
+    pthread_mutex_destroy(&tp->mtx);
+    if (op->save_fn && smp_snap_save_end(op->verbose) && (0 == ret))
+        ret = SMP_LIB_FILE_ERROR;
+    if (op->from_fn)
+        smp_snap_unload();
+    if (op->verbose && ret)
+        pr2serr("Exit status %d indicates error detected\n", ret);
+    return ret;
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_pr2serr.h"
+
+/* This is a Serial Attached SCSI (SAS) Serial Management Protocol (SMP)
+ * utility.
+ *
+ * This is the multi-call binary: every other smp_utils utility is built
+ * into it (each with its main() renamed to <utility>_main()) and the one
+ * to run is chosen by the name it is invoked by (e.g. through a symbolic
+ * link named smp_discover) or, when invoked as smp_utils, by its first
+ * argument. Built by 'make multicall' and installed, with a link for each
+ * utility, by 'make install-multicall'.
+ */
+
+static const char * version_str = "1.00 20261014";
+
+typedef int (*util_main_t)(int argc, char * argv[]);
+
+int smp_conf_general_main(int argc, char * argv[]);
+int smp_conf_phy_event_main(int argc, char * argv[]);
+int smp_conf_route_info_main(int argc, char * argv[]);
+int smp_conf_zone_man_pass_main(int argc, char * argv[]);
+int smp_conf_zone_perm_tbl_main(int argc, char * argv[]);
+int smp_conf_zone_phy_info_main(int argc, char * argv[]);
+int smp_discover_main(int argc, char * argv[]);
+int smp_discover_list_main(int argc, char * argv[]);
+int smp_ena_dis_zoning_main(int argc, char * argv[]);
+int smp_locate_main(int argc, char * argv[]);
+int smp_phy_control_main(int argc, char * argv[]);
+int smp_phy_test_main(int argc, char * argv[]);
+int smp_read_gpio_main(int argc, char * argv[]);
+int smp_rep_broadcast_main(int argc, char * argv[]);
+int smp_rep_exp_route_tbl_main(int argc, char * argv[]);
+int smp_rep_general_main(int argc, char * argv[]);
+int smp_rep_manufacturer_main(int argc, char * argv[]);
+int smp_rep_phy_err_log_main(int argc, char * argv[]);
+int smp_rep_phy_event_main(int argc, char * argv[]);
+int smp_rep_phy_event_list_main(int argc, char * argv[]);
+int smp_rep_phy_sata_main(int argc, char * argv[]);
+int smp_rep_route_info_main(int argc, char * argv[]);
+int smp_rep_self_conf_stat_main(int argc, char * argv[]);
+int smp_rep_zone_man_pass_main(int argc, char * argv[]);
+int smp_rep_zone_perm_tbl_main(int argc, char * argv[]);
+int smp_scan_main(int argc, char * argv[]);
+int smp_shell_main(int argc, char * argv[]);
+int smp_topology_main(int argc, char * argv[]);
+int smp_write_gpio_main(int argc, char * argv[]);
+int smp_zone_activate_main(int argc, char * argv[]);
+int smp_zone_lock_main(int argc, char * argv[]);
+int smp_zone_txn_main(int argc, char * argv[]);
+int smp_zone_unlock_main(int argc, char * argv[]);
+int smp_zoned_broadcast_main(int argc, char * argv[]);
+int smpd_main(int argc, char * argv[]);
+
+struct util_t {
+    const char * name;          /* as installed */
+    util_main_t main_fn;
+};
+
+static struct util_t util_arr[] = {
+        {"smp_conf_general", smp_conf_general_main},
+        {"smp_conf_phy_event", smp_conf_phy_event_main},
+        {"smp_conf_route_info", smp_conf_route_info_main},
+        {"smp_conf_zone_man_pass", smp_conf_zone_man_pass_main},
+        {"smp_conf_zone_perm_tbl", smp_conf_zone_perm_tbl_main},
+        {"smp_conf_zone_phy_info", smp_conf_zone_phy_info_main},
+        {"smp_discover", smp_discover_main},
+        {"smp_discover_list", smp_discover_list_main},
+        {"smp_ena_dis_zoning", smp_ena_dis_zoning_main},
+        {"smp_locate", smp_locate_main},
+        {"smp_phy_control", smp_phy_control_main},
+        {"smp_phy_test", smp_phy_test_main},
+        {"smp_read_gpio", smp_read_gpio_main},
+        {"smp_rep_broadcast", smp_rep_broadcast_main},
+        {"smp_rep_exp_route_tbl", smp_rep_exp_route_tbl_main},
+        {"smp_rep_general", smp_rep_general_main},
+        {"smp_rep_manufacturer", smp_rep_manufacturer_main},
+        {"smp_rep_phy_err_log", smp_rep_phy_err_log_main},
+        {"smp_rep_phy_event", smp_rep_phy_event_main},
+        {"smp_rep_phy_event_list", smp_rep_phy_event_list_main},
+        {"smp_rep_phy_sata", smp_rep_phy_sata_main},
+        {"smp_rep_route_info", smp_rep_route_info_main},
+        {"smp_rep_self_conf_stat", smp_rep_self_conf_stat_main},
+        {"smp_rep_zone_man_pass", smp_rep_zone_man_pass_main},
+        {"smp_rep_zone_perm_tbl", smp_rep_zone_perm_tbl_main},
+        {"smp_scan", smp_scan_main},
+        {"smp_shell", smp_shell_main},
+        {"smp_topology", smp_topology_main},
+        {"smp_write_gpio", smp_write_gpio_main},
+        {"smp_zone_activate", smp_zone_activate_main},
+        {"smp_zone_lock", smp_zone_lock_main},
+        {"smp_zone_txn", smp_zone_txn_main},
+        {"smp_zone_unlock", smp_zone_unlock_main},
+        {"smp_zoned_broadcast", smp_zoned_broadcast_main},
+        {"smpd", smpd_main},
+        {NULL, NULL},
+};
+
+
+static void
+usage(void)
+{
+    pr2serr("Usage: smp_utils UTILITY [UTILITY_OPTIONS] [SMP_DEVICE[,N]]\n"
+            "       smp_utils [--help] [--list] [--version]\n"
+            "       UTILITY [UTILITY_OPTIONS] [SMP_DEVICE[,N]]\n"
+            "  where:\n"
+            "    --help|-h       print out usage message\n"
+            "    --list|-l       list the utilities built in, one per line\n"
+            "    --version|-V    print version string and exit\n\n"
+            "Runs the smp_utils utility named by UTILITY (the 'smp_' "
+            "prefix is optional)\nor, in the third form, the one named by "
+            "the link it is invoked through\n");
+}
+
+/* Finds the utility called name, with or without its "smp_" prefix.
+ * Returns NULL if there is none. */
+static const struct util_t *
+find_util(const char * name)
+{
+    const struct util_t * up;
+
+    for (up = util_arr; up->name; ++up) {
+        if ((0 == strcmp(name, up->name)) ||
+            ((0 == strncmp(up->name, "smp_", 4)) &&
+             (0 == strcmp(name, up->name + 4))))
+            return up;
+    }
+    return NULL;
+}
+
+
+int
+main(int argc, char * argv[])
+{
+    const char * name;
+    const struct util_t * up;
+
+    name = (argc > 0) ? strrchr(argv[0], '/') : NULL;
+    name = name ? (name + 1) : ((argc > 0) ? argv[0] : "smp_utils");
+    if ((up = find_util(name)))
+        return up->main_fn(argc, argv);
+    /* invoked as smp_utils (or under an unknown name) */
+    if (argc < 2) {
+        usage();
+        return SMP_LIB_SYNTAX_ERROR;
+    }
+    name = argv[1];
+    if ((0 == strcmp(name, "--help")) || (0 == strcmp(name, "-h")) ||
+        (0 == strcmp(name, "-?"))) {
+        usage();
+        return 0;
+    }
+    if ((0 == strcmp(name, "--list")) || (0 == strcmp(name, "-l"))) {
+        for (up = util_arr; up->name; ++up)
+            printf("%s\n", up->name);
+        return 0;
+    }
+    if ((0 == strcmp(name, "--version")) || (0 == strcmp(name, "-V"))) {
+        pr2serr("version: %s\n", version_str);
+        return 0;
+    }
+    if (NULL == (up = find_util(name))) {
+        pr2serr("smp_utils: unknown utility: %s ('smp_utils --list' lists "
+                "them)\n", name);
+        return SMP_LIB_SYNTAX_ERROR;
+    }
+    /* the utility sees its own name as argv[0] */
+    argv[1] = (char *)up->name;
+    return up->main_fn(argc - 1, argv + 1);
+}
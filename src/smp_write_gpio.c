@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2006-2018, Douglas Gilbert
+ * Copyright (c) 2006-2026, Douglas Gilbert
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -55,11 +55,53 @@
  * changed to comply with other SAS-2 SMP requests. This will increase
  * the byte position by 2 of the register type, index and count fields.
  * The remaining write data (first..last register) is not moved.
+ *
+ * With --led= the desired LED states of many bays (drives) are given and
+ * the GPIO_TX registers holding them are read, modified and only those
+ * register ranges that changed are written back, in as few requests as
+ * the SMP target accepts.
  */
 
-static const char * version_str = "1.15 20180725";
+static const char * version_str = "1.16 20261014";
 
 #define SMP_MAX_REQ_LEN (1020 + 4 + 4)
+#define SMP_MAX_RESP_LEN (1020 + 4 + 4)
+
+#define GPIO_TYPE_CFG 0
+#define GPIO_TYPE_TX 3
+#define GPIO_MAX_BAY 254
+#define GPIO_TX_REGS ((GPIO_MAX_BAY + 4) / 4)
+#define GPIO_MAX_WR_COUNT 254   /* largest count that fits in an SMP frame */
+#define GPIO_GAP_MERGE 3        /* rewrite up to 3 unchanged registers rather
+                                 * than start another request */
+#define MAX_LED_SPECS 64
+
+/* In each GPIO_TX byte (one per drive or bay) bits 7:5 are activity, 4:3
+ * locate and 2:0 error. Each state sets 'val' in the bits of 'mask'. */
+struct led_state_t {
+    const char * name;
+    uint8_t mask;
+    uint8_t val;
+};
+
+static struct led_state_t led_state_arr[] = {
+    {"off", 0x1f, 0x0},         /* locate and error off */
+    {"locate", 0x18, 0x8},      /* locate on */
+    {"blink", 0x18, 0x10},      /* locate blinks at rate A */
+    {"nolocate", 0x18, 0x0},
+    {"fault", 0x7, 0x1},        /* error on */
+    {"nofault", 0x7, 0x0},
+    {NULL, 0, 0},
+};
+
+struct led_spec_t {
+    int num_bays;
+    uint8_t mask;
+    uint8_t val;
+    uint8_t bay_arr[GPIO_MAX_BAY + 1];
+};
+
+static struct led_spec_t spec_arr[MAX_LED_SPECS];
 
 static struct option long_options[] = {
     {"count", required_argument, 0, 'c'},
@@ -69,6 +111,7 @@ static struct option long_options[] = {
     {"hex", no_argument, 0, 'H'},
     {"index", required_argument, 0, 'i'},
     {"interface", required_argument, 0, 'I'},
+    {"led", required_argument, 0, 'l'},
     {"phy", required_argument, 0, 'p'},
     {"raw", no_argument, 0, 'r'},
     {"sa", required_argument, 0, 's'},
@@ -85,10 +128,10 @@ usage(void)
     pr2serr("Usage: smp_write_gpio [--count=CO] [--data=H,H...] [--enhanced] "
             "[--help]\n"
             "                      [--hex] [--index=IN] [--interface=PARAMS] "
-            "[--raw]\n"
-            "                      [--sa=SAS_ADDR] [type=TY] [--verbose] "
-            "[--version]\n"
-            "                      SMP_DEVICE[,N]\n"
+            "\n"
+            "                      [--led=BAYS:STATE] [--raw] [--sa=SAS_ADDR] "
+            "[type=TY]\n"
+            "                      [--verbose] [--version] SMP_DEVICE[,N]\n"
             "  where:\n"
             "    --count=CO|-c CO     register count (dwords to write) "
             "(def: 1)\n"
@@ -102,6 +145,12 @@ usage(void)
             "    --index=IN|-i IN     register index (def: 0)\n"
             "    --interface=PARAMS|-I PARAMS    specify or override "
             "interface\n"
+            "    --led=BAYS:STATE|-l BAYS:STATE    set LEDs of BAYS (e.g. "
+            "'0,3,8-11'\n"
+            "                         or 'all') to STATE: off, locate, blink, "
+            "nolocate,\n"
+            "                         fault or nofault; may be given more "
+            "than once\n"
             "    --raw|-r             output response in binary\n"
             "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of SMP "
             "target (use leading\n"
@@ -113,7 +162,8 @@ usage(void)
             "    --verbose|-v         increase verbosity\n"
             "    --version|-V         print version string and exit\n\n"
             "Performs a SMP WRITE GPIO REGISTER (default) or SMP WRITE GPIO "
-            "REGISTER\nENHANCED function\n"
+            "REGISTER\nENHANCED function. With --led= reads the GPIO_TX "
+            "registers then only\nwrites back those that change\n"
            );
 }
 
@@ -223,8 +273,288 @@ read_hex(const char * inp, uint8_t * arr, int * arr_len)
 }
 
 
+/* Parses "BAYS:STATE" into lsp. BAYS is a list as taken by
+ * smp_get_phy_list() or "all" (num_bays set to -1 until the drive count is
+ * known). Returns 0 if ok, else -1. */
+static int
+parse_led_spec(const char * arg, struct led_spec_t * lsp)
+{
+    int n;
+    const char * cp;
+    const struct led_state_t * sp;
+    char b[256];
+
+    cp = strchr(arg, ':');
+    if ((NULL == cp) || (cp == arg) || ((cp - arg) >= (int)sizeof(b))) {
+        pr2serr("expected BAYS:STATE\n");
+        return -1;
+    }
+    n = cp - arg;
+    memcpy(b, arg, n);
+    b[n] = '\0';
+    for (sp = led_state_arr; sp->name; ++sp) {
+        if (0 == strcmp(cp + 1, sp->name))
+            break;
+    }
+    if (NULL == sp->name) {
+        pr2serr("unknown LED state '%s', expect one of:\n   ", cp + 1);
+        for (sp = led_state_arr; sp->name; ++sp)
+            pr2serr(" %s", sp->name);
+        pr2serr("\n");
+        return -1;
+    }
+    lsp->mask = sp->mask;
+    lsp->val = sp->val;
+    if (0 == strcmp(b, "all"))
+        lsp->num_bays = -1;
+    else {
+        lsp->num_bays = smp_get_phy_list(b, lsp->bay_arr,
+                                         GPIO_MAX_BAY + 1);
+        if (lsp->num_bays < 1) {
+            pr2serr("bad list of bays: %s\n", b);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Position of a bay's byte in the array of GPIO_TX registers. SFF-8485
+ * places drive 4n+3 in the first byte of register n and drive 4n in the
+ * last. */
+static inline int
+bay_off(int bay)
+{
+    return (4 * (bay / 4)) + 3 - (bay % 4);
+}
+
+/* Builds a READ or WRITE GPIO REGISTER (ENHANCED) request in req for count
+ * registers of rtype starting at rindex. For writes 'wdata' holds count*4
+ * bytes. Returns the request length (including the CRC). */
+static int
+build_gpio_req(uint8_t * req, bool write, bool enhanced, int rtype,
+               int rindex, int count, const uint8_t * wdata)
+{
+    int off = enhanced ? 2 : 0;
+
+    memset(req, 0, 12);
+    req[0] = SMP_FRAME_TYPE_REQ;
+    if (write) {
+        req[1] = enhanced ? SMP_FN_WRITE_GPIO_REG_ENH : SMP_FN_WRITE_GPIO_REG;
+        if (enhanced)
+            req[3] = count + 1;
+        memcpy(req + 8, wdata, count * 4);
+    } else {
+        req[1] = enhanced ? SMP_FN_READ_GPIO_REG_ENH : SMP_FN_READ_GPIO_REG;
+        if (enhanced) {
+            req[2] = count;
+            req[3] = 0x1;
+        }
+    }
+    req[2 + off] = rtype;
+    req[3 + off] = rindex;
+    req[4 + off] = count;
+    if (write)
+        return 12 + (count * 4);
+    return enhanced ? 12 : 8;
+}
+
+/* Reads GPIO_CFG[0] (for the supported drive count) and the GPIO_TX
+ * registers as one batch, applies the LED specs and writes back runs of
+ * changed registers. A run absorbs gaps of up to GPIO_GAP_MERGE unchanged
+ * registers (rewritten with the value just read) since another request
+ * costs more than those bytes. If the SMP target rejects the length of a
+ * write, the run is split in halves and retried. Note that another
+ * initiator changing GPIO_TX between the read and the write will have its
+ * change to the bytes in a written run undone. */
+static int
+do_leds(struct smp_target_obj * top, struct led_spec_t * spec_arr,
+        int num_specs, bool enhanced, int verbose)
+{
+    bool changed[GPIO_TX_REGS];
+    int k, j, res, bay, num_regs, drives, len, num_bays, start, end;
+    int num_wr, num_changed;
+    int ret = 0;
+    int max_cnt = GPIO_MAX_WR_COUNT;
+    int total_wr = 0;
+    int num_req = 0;
+    int run_start[GPIO_TX_REGS];
+    int run_cnt[GPIO_TX_REGS];
+    struct led_spec_t * lsp;
+    struct smp_req_resp rr_arr[GPIO_TX_REGS];
+    uint8_t * reqs = NULL;
+    uint8_t * resps = NULL;
+    uint8_t cur[GPIO_TX_REGS * 4];
+    uint8_t want[GPIO_TX_REGS * 4];
+    char b[128];
+
+    reqs = (uint8_t *)calloc(GPIO_TX_REGS, SMP_MAX_REQ_LEN);
+    resps = (uint8_t *)calloc(GPIO_TX_REGS, SMP_MAX_RESP_LEN);
+    if ((NULL == reqs) || (NULL == resps)) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        ret = SMP_LIB_RESOURCE_ERROR;
+        goto fini;
+    }
+    /* first GPIO_CFG[0]: supported drive count is in its last byte */
+    memset(rr_arr, 0, sizeof(rr_arr));
+    rr_arr[0].request = reqs;
+    rr_arr[0].request_len = build_gpio_req(reqs, false, enhanced,
+                                           GPIO_TYPE_CFG, 0, 1, NULL);
+    rr_arr[0].response = resps;
+    rr_arr[0].max_response_len = 4 + 4 + 4;
+    res = smp_send_req(top, rr_arr + 0, verbose);
+    if (res || (res = smp_batch_resp_res(rr_arr + 0, rr_arr[0].request[1]))) {
+        pr2serr("Read GPIO_CFG failed: %s\n", (res > 0) ?
+                smp_get_func_res_str(res, sizeof(b), b) : "request failed");
+        ret = (res > 0) ? res : SMP_LIB_CAT_OTHER;
+        goto fini;
+    }
+    drives = resps[4 + 3];
+    if (verbose)
+        pr2serr("GPIO enable: %d, supported drive count: %d\n",
+                !!(resps[4 + 2] & 0x80), drives);
+    if (drives > (GPIO_MAX_BAY + 1))
+        drives = GPIO_MAX_BAY + 1;
+    for (k = 0; k < num_specs; ++k) {
+        lsp = spec_arr + k;
+        num_bays = lsp->num_bays;
+        if (num_bays < 0) {
+            for (j = 0; j < drives; ++j)
+                lsp->bay_arr[j] = j;
+            lsp->num_bays = drives;
+        } else if (lsp->bay_arr[num_bays - 1] >= drives) {
+            pr2serr("bay %d out of range, the SMP target supports %d "
+                    "drives\n", lsp->bay_arr[num_bays - 1], drives);
+            ret = SMP_LIB_SYNTAX_ERROR;
+            goto fini;
+        }
+    }
+    if (0 == drives) {
+        pr2serr("SMP target reports no supported drives\n");
+        ret = SMP_LIB_CAT_OTHER;
+        goto fini;
+    }
+    num_regs = (drives + 3) / 4;
+    rr_arr[0].request_len = build_gpio_req(reqs, false, enhanced,
+                                           GPIO_TYPE_TX, 0, num_regs, NULL);
+    rr_arr[0].max_response_len = 4 + (num_regs * 4) + 4;
+    res = smp_send_req(top, rr_arr + 0, verbose);
+    if (res || (res = smp_batch_resp_res(rr_arr + 0, rr_arr[0].request[1]))) {
+        pr2serr("Read GPIO_TX failed: %s\n", (res > 0) ?
+                smp_get_func_res_str(res, sizeof(b), b) : "request failed");
+        ret = (res > 0) ? res : SMP_LIB_CAT_OTHER;
+        goto fini;
+    }
+    len = rr_arr[0].act_response_len;
+    if ((len >= 0) && (len < (4 + (num_regs * 4)))) {
+        pr2serr("Read GPIO_TX response too short\n");
+        ret = SMP_LIB_CAT_MALFORMED;
+        goto fini;
+    }
+    memcpy(cur, resps + 4, num_regs * 4);
+    memcpy(want, cur, num_regs * 4);
+    for (k = 0; k < num_specs; ++k) {   /* later specs override earlier */
+        lsp = spec_arr + k;
+        for (j = 0; j < lsp->num_bays; ++j) {
+            bay = bay_off(lsp->bay_arr[j]);
+            want[bay] = (want[bay] & ~lsp->mask) | lsp->val;
+        }
+    }
+    for (num_changed = 0, k = 0; k < num_regs; ++k) {
+        changed[k] = !! memcmp(cur + (4 * k), want + (4 * k), 4);
+        if (changed[k])
+            ++num_changed;
+    }
+    if (0 == num_changed) {
+        if (verbose)
+            pr2serr("LEDs already in requested state, nothing written\n");
+        goto fini;
+    }
+again:
+    /* coalesce changed registers into runs, at most max_cnt long */
+    for (num_wr = 0, k = 0; k < num_regs; ) {
+        if (! changed[k]) {
+            ++k;
+            continue;
+        }
+        start = k;
+        for (end = k, j = k + 1; (j < num_regs) && ((j - start) < max_cnt);
+             ++j) {
+            if (changed[j])
+                end = j;
+            else if ((j - end) > GPIO_GAP_MERGE)
+                break;
+        }
+        run_start[num_wr] = start;
+        run_cnt[num_wr] = end - start + 1;
+        ++num_wr;
+        k = end + 1;
+    }
+    memset(rr_arr, 0, sizeof(rr_arr));
+    for (k = 0; k < num_wr; ++k) {
+        rr_arr[k].request = reqs + (SMP_MAX_REQ_LEN * k);
+        rr_arr[k].request_len = build_gpio_req(rr_arr[k].request, true,
+                                    enhanced, GPIO_TYPE_TX, run_start[k],
+                                    run_cnt[k], want + (4 * run_start[k]));
+        rr_arr[k].response = resps + (SMP_MAX_RESP_LEN * k);
+        rr_arr[k].max_response_len = 8;
+        if (verbose > 1)
+            pr2serr("    write GPIO_TX registers %d to %d\n", run_start[k],
+                    run_start[k] + run_cnt[k] - 1);
+    }
+    smp_send_req_batch(top, rr_arr, num_wr, 0, NULL, NULL, verbose);
+    num_req += num_wr;
+    for (res = 0, k = 0; k < num_wr; ++k) {
+        res = smp_batch_resp_res(rr_arr + k, rr_arr[k].request[1]);
+        if (0 == res) {
+            total_wr += run_cnt[k];
+            for (j = 0; j < run_cnt[k]; ++j)
+                changed[run_start[k] + j] = false;
+        } else if ((SMP_FRES_INVALID_REQUEST_LEN == res) &&
+                   (run_cnt[k] > 1))
+            continue;           /* too long for this SMP target, split */
+        else {
+            pr2serr("Write GPIO_TX registers %d to %d: %s\n", run_start[k],
+                    run_start[k] + run_cnt[k] - 1, (res > 0) ?
+                    smp_get_func_res_str(res, sizeof(b), b) :
+                    "request failed");
+            if (0 == ret)
+                ret = (res > 0) ? res : SMP_LIB_CAT_OTHER;
+            for (j = 0; j < run_cnt[k]; ++j)
+                changed[run_start[k] + j] = false;
+        }
+    }
+    for (k = 0; k < num_regs; ++k) {
+        if (changed[k])
+            break;
+    }
+    if ((k < num_regs) && (max_cnt > 1)) {
+        for (max_cnt = 1, j = 0; j < num_wr; ++j) {
+            if (run_cnt[j] / 2 > max_cnt)
+                max_cnt = run_cnt[j] / 2;
+        }
+        if (verbose)
+            pr2serr("SMP target rejected request length, retry with at "
+                    "most %d registers per request\n", max_cnt);
+        goto again;
+    }
+    if (verbose)
+        pr2serr("%d of %d GPIO_TX registers changed, wrote %d in %d "
+                "request%s\n", num_changed, num_regs, total_wr, num_req,
+                (1 == num_req) ? "" : "s");
+fini:
+    free(resps);
+    free(reqs);
+    return ret;
+}
+
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_write_gpio_main(int argc, char * argv[])
+#else
 int
 main(int argc, char * argv[])
+#endif
 {
     bool do_data = false;
     bool enhanced = false;
@@ -239,6 +569,7 @@ main(int argc, char * argv[])
     int rtype = 0;
     int subvalue = 0;
     int verbose = 0;
+    int num_specs = 0;
     int64_t sa_ll;
     uint64_t sa = 0;
     char * cp;
@@ -251,6 +582,8 @@ main(int argc, char * argv[])
     struct smp_req_resp smp_rr;
     uint8_t data_arr[1024];
 
+    /* file scope: smp_shell may run this more than once */
+    memset(spec_arr, 0, sizeof(spec_arr));
     memset(device_name, 0, sizeof device_name);
     memset(i_params, 0, sizeof i_params);
     memset(smp_req, 0, sizeof smp_req);
@@ -259,7 +592,7 @@ main(int argc, char * argv[])
     while (1) {
         int option_index = 0;
 
-        c = getopt_long(argc, argv, "c:d:EhHi:I:p:rs:t:vV", long_options,
+        c = getopt_long(argc, argv, "c:d:EhHi:I:l:p:rs:t:vV", long_options,
                         &option_index);
         if (c == -1)
             break;
@@ -301,6 +634,18 @@ main(int argc, char * argv[])
             strncpy(i_params, optarg, sizeof(i_params));
             i_params[sizeof(i_params) - 1] = '\0';
             break;
+        case 'l':
+            if (num_specs >= MAX_LED_SPECS) {
+                pr2serr("too many '--led=' options, at most %d\n",
+                        MAX_LED_SPECS);
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            if (parse_led_spec(optarg, spec_arr + num_specs)) {
+                pr2serr("bad argument to '--led'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            ++num_specs;
+            break;
         case 'p':
            phy_id = smp_get_num(optarg);
            if ((phy_id < 0) || (phy_id > 254)) {
@@ -354,12 +699,17 @@ main(int argc, char * argv[])
             return SMP_LIB_SYNTAX_ERROR;
         }
     }
-    if ((! do_data) || (arr_len < 1)) {
+    if (num_specs > 0) {
+        if (do_data || do_hex || do_raw) {
+            pr2serr("--led= can't be given with --data=, --hex or --raw\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    } else if ((! do_data) || (arr_len < 1)) {
         pr2serr("need to supply data to write, see '--data=' option\n");
         usage();
         return SMP_LIB_SYNTAX_ERROR;
     }
-    if ((rcount * 4) != arr_len) {
+    if ((0 == num_specs) && ((rcount * 4) != arr_len)) {
         pr2serr("number of data bytes given (%d) needs to be 4 times count "
                 "(%d)\n", arr_len, rcount);
         return SMP_LIB_SYNTAX_ERROR;
@@ -368,9 +718,10 @@ main(int argc, char * argv[])
         cp = getenv("SMP_UTILS_DEVICE");
         if (cp)
             strncpy(device_name, cp, sizeof(device_name) - 1);
-        else {
-            pr2serr("missing device name on command line\n    [Could use"
-                    " environment variable SMP_UTILS_DEVICE instead]\n\n");
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
+            pr2serr("missing device name on command line\n    [Could use "
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
             usage();
             return SMP_LIB_SYNTAX_ERROR;
         }
@@ -409,6 +760,10 @@ main(int argc, char * argv[])
                              &tobj, verbose);
     if (res < 0)
         return SMP_LIB_FILE_ERROR;
+    if (num_specs > 0) {
+        ret = do_leds(&tobj, spec_arr, num_specs, enhanced, verbose);
+        goto err_out;
+    }
     if (enhanced) {
         smp_req[1] = SMP_FN_WRITE_GPIO_REG_ENH;
         smp_req[2] = 0x0;       /* response is only header+CRC */
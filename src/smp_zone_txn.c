@@ -0,0 +1,701 @@
+/*
+ * Copyright (c) 2026 Douglas Gilbert.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* This is a Serial Attached SCSI (SAS) Serial Management Protocol (SMP)
+ * utility.
+ *
+ * This utility sets up zoning in one transaction: it sends ZONE LOCK,
+ * CONFIGURE ZONE PERMISSION TABLE, CONFIGURE ZONE PHY INFORMATION, ZONE
+ * ACTIVATE and ZONE UNLOCK functions back to back to one SMP target. See
+ * smp_zone_txn_run() in the library. Given several SMP targets (e.g. the
+ * expanders of both domains of a dual domain fabric) each step is done
+ * on all of them concurrently, one thread per expander: all are locked
+ * and configured, then, only if that succeeded everywhere, activated
+ * together and unlocked. With --compare the current tables are then read
+ * back from all of them, again concurrently, and checked.
+ */
+
+static const char * version_str = "1.01 20261014";
+
+/* Permission table big enough for 256 source zone groups (rows) and
+ * 256 destination zone groups (columns) */
+static uint8_t full_perm_tbl[32 * 256];
+static uint8_t phy_info_arr[4 * 256];
+static struct smp_zone_perm zp;
+
+static bool sszg_given = false;
+static int sszg = 0;
+
+#define MAX_TARGETS 64
+#define MAX_SAS_ADDRS 32
+
+#define TXN_PH_OPEN 0
+#define TXN_PH_STAGE 1
+#define TXN_PH_COMMIT 2
+#define TXN_PH_ABORT 3
+#define TXN_PH_VERIFY 4
+
+struct txn_t;
+
+/* One per expander (SMP target) */
+struct txn_tgt_t {
+    bool opened;
+    bool thr_ok;                /* thr created, needs joining */
+    int subvalue;
+    int res;                    /* first failure, else 0 */
+    int vres;                   /* of read back: -1 if not done */
+    int num_diff;               /* rows that differ on read back */
+    uint64_t sa;
+    struct txn_t * sp;
+    pthread_t thr;
+    char dev_name[SMP_MAX_DEVICE_NAME];
+    struct smp_zone_txn zt;
+    struct smp_target_obj tobj;
+};
+
+struct txn_t {
+    bool go;                    /* workers of this phase may start */
+    int phase;                  /* one of TXN_PH_* */
+    int verbose;
+    int num_tgts;
+    const char * i_params;
+    pthread_mutex_t mtx;
+    pthread_cond_t cv;
+    struct txn_tgt_t tgts[MAX_TARGETS];
+};
+
+static struct option long_options[] = {
+    {"bin", no_argument, 0, 'b'},
+    {"compare", no_argument, 0, 'c'},
+    {"deduce", no_argument, 0, 'd'},
+    {"help", no_argument, 0, 'h'},
+    {"inactivity", required_argument, 0, 'i'},
+    {"interface", required_argument, 0, 'I'},
+    {"numzg", required_argument, 0, 'n'},
+    {"password", required_argument, 0, 'w'},
+    {"pconf", required_argument, 0, 'p'},
+    {"permf", required_argument, 0, 'P'},
+    {"sa", required_argument, 0, 's'},
+    {"save", required_argument, 0, 'S'},
+    {"start", required_argument, 0, 'f'},   /* note the short option: 'f' */
+    {"verbose", no_argument, 0, 'v'},
+    {"version", no_argument, 0, 'V'},
+    {0, 0, 0, 0},
+};
+
+static struct smp_val_name txn_fn_arr[] = {
+    {SMP_FN_ZONE_LOCK, "ZONE LOCK"},
+    {SMP_FN_CONFIG_ZONE_PERMISSION_TBL, "CONFIGURE ZONE PERMISSION TABLE"},
+    {SMP_FN_CONFIG_ZONE_PHY_INFO, "CONFIGURE ZONE PHY INFORMATION"},
+    {SMP_FN_ZONE_ACTIVATE, "ZONE ACTIVATE"},
+    {SMP_FN_ZONE_UNLOCK, "ZONE UNLOCK"},
+    {0, NULL},
+};
+
+
+static void
+usage(void)
+{
+    pr2serr("Usage: smp_zone_txn [--bin] [--compare] [--deduce] [--help]\n"
+            "                    [--inactivity=ITL] [--interface=PARAMS] "
+            "[--numzg=NG]\n"
+            "                    [--password=PA]"
+            " [--pconf=PC] [--permf=FN] [--sa=SAS_ADDR]\n"
+            "                    [--save=SAV]"
+            " [--start=SS] [--verbose] [--version]\n"
+            "                    SMP_DEVICE[,N] [SMP_DEVICE[,N] ...]\n"
+            "  where:\n"
+            "    --bin|-b               FN and PC hold descriptors in binary, "
+            "not hex\n"
+            "    --compare|-c           read back current zone permission "
+            "tables\n"
+            "                           and compare with FN\n"
+            "    --deduce|-d            deduce number of zone groups from "
+            "number\n"
+            "                           of bytes on active FN lines\n"
+            "    --help|-h              print out usage message\n"
+            "    --inactivity=ITL|-i ITL    inactivity time limit of zone "
+            "lock, unit:\n"
+            "                               100 ms (def: 0 -> no time "
+            "limit)\n"
+            "    --interface=PARAMS|-I PARAMS    specify or override "
+            "interface\n"
+            "    --numzg=NG|-n NG       number of zone groups. NG should be "
+            "0 (def)\n"
+            "                           or 1. 0 -> 128 zone groups, 1 -> 256\n"
+            "    --password=PA|-w PA    zone manager password PA in ASCII, "
+            "padded\n"
+            "                           with NULLs to 32 bytes (def: all "
+            "NULLs)\n"
+            "    --pconf=PC|-p PC       PC is a file containing zone phy "
+            "configuration\n"
+            "                           descriptors in hex\n"
+            "    --permf=FN|-P FN       FN is a file containing zone "
+            "permission\n"
+            "                           configuration descriptors in hex\n"
+            "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of SMP "
+            "target (use leading\n"
+            "                                 '0x' or trailing 'h'). "
+            "Depending on\n"
+            "                                 the interface, may not be "
+            "needed.\n"
+            "                                 May be given more than once\n"
+            "    --save=SAV|-S SAV      SAV: 0 -> shadow (def); 1 -> "
+            "saved\n"
+            "                           2 -> shadow (and saved if "
+            "supported))\n"
+            "                           3 -> shadow and saved\n"
+            "    --start=SS|-f SS       starting (first) source zone group "
+            "(def: 0)\n"
+            "    --verbose|-v           increase verbosity\n"
+            "    --version|-V           print version string and exit\n\n"
+            "Sets up zoning with SMP ZONE LOCK, CONFIGURE ZONE PERMISSION "
+            "TABLE,\nCONFIGURE ZONE PHY INFORMATION, ZONE ACTIVATE and ZONE "
+            "UNLOCK functions\nsent back to back. At least one of FN and PC "
+            "must be given. Given several\nSMP targets (each SMP_DEVICE "
+            "with each SAS_ADDR) each step is done on all\nof them "
+            "concurrently and none is activated unless all were "
+            "configured\n"
+           );
+}
+
+static const char *
+txn_fn_name(int func)
+{
+    const struct smp_val_name * vnp;
+
+    for (vnp = txn_fn_arr; vnp->name; ++vnp) {
+        if (func == vnp->value)
+            return vnp->name;
+    }
+    return "SMP function";
+}
+
+
+
+static void *
+txn_worker(void * arg)
+{
+    int res;
+    struct txn_tgt_t * tp = (struct txn_tgt_t *)arg;
+    struct txn_t * sp = tp->sp;
+    int verbose = sp->verbose;
+
+    pthread_mutex_lock(&sp->mtx);
+    while (! sp->go)
+        pthread_cond_wait(&sp->cv, &sp->mtx);
+    pthread_mutex_unlock(&sp->mtx);
+
+    switch (sp->phase) {
+    case TXN_PH_OPEN:
+        res = smp_initiator_open(tp->dev_name, tp->subvalue, sp->i_params,
+                                 tp->sa, &tp->tobj, verbose);
+        if (res < 0)
+            tp->res = SMP_LIB_FILE_ERROR;
+        else
+            tp->opened = true;
+        break;
+    case TXN_PH_STAGE:
+        if (tp->opened)
+            tp->res = smp_zone_txn_stage(&tp->tobj, &tp->zt, verbose);
+        break;
+    case TXN_PH_COMMIT:
+        if (tp->zt.locked)
+            tp->res = smp_zone_txn_commit(&tp->tobj, &tp->zt, verbose);
+        break;
+    case TXN_PH_ABORT:
+        if (tp->zt.locked)
+            smp_zone_txn_abort(&tp->tobj, &tp->zt, verbose);
+        break;
+    case TXN_PH_VERIFY:
+        if (tp->opened && (0 == tp->res))
+            tp->vres = smp_zone_txn_verify(&tp->tobj, &tp->zt,
+                                           &tp->num_diff, verbose);
+        break;
+    }
+    return NULL;
+}
+
+/* Runs phase on every target, each in its own thread. The threads are all
+ * created before any is let go so that, for example, the ZONE ACTIVATE
+ * requests leave close together. If a thread can't be created that
+ * target's work is done in this thread afterwards. */
+static void
+run_phase(struct txn_t * sp, int phase)
+{
+    int k;
+    struct txn_tgt_t * tp;
+
+    sp->phase = phase;
+    sp->go = false;
+    for (k = 0; k < sp->num_tgts; ++k) {
+        tp = sp->tgts + k;
+        tp->thr_ok = (sp->num_tgts > 1) &&
+                     (0 == pthread_create(&tp->thr, NULL, txn_worker, tp));
+    }
+    pthread_mutex_lock(&sp->mtx);
+    sp->go = true;
+    pthread_cond_broadcast(&sp->cv);
+    pthread_mutex_unlock(&sp->mtx);
+    for (k = 0; k < sp->num_tgts; ++k) {
+        tp = sp->tgts + k;
+        if (! tp->thr_ok)
+            txn_worker(tp);
+    }
+    for (k = 0; k < sp->num_tgts; ++k) {
+        tp = sp->tgts + k;
+        if (tp->thr_ok)
+            pthread_join(tp->thr, NULL);
+    }
+}
+
+static void
+output_tgt(const struct txn_tgt_t * tp, bool compare, int verbose)
+{
+    char b[128];
+
+    if (tp->sa)
+        printf("%s sa=0x%" PRIx64 ": ", tp->dev_name, tp->sa);
+    else
+        printf("%s: ", tp->dev_name);
+    if (SMP_LIB_FILE_ERROR == tp->res)
+        printf("open failed");
+    else if (0 == tp->res)
+        printf("activated");
+    else if (tp->zt.fail_func < 0)
+        printf("not activated");
+    else if ((tp->res > 0) && (tp->res < SMP_LIB_SYNTAX_ERROR))
+        printf("%s failed: %s", txn_fn_name(tp->zt.fail_func),
+               smp_get_func_res_str(tp->res, sizeof(b), b));
+    else
+        printf("%s failed", txn_fn_name(tp->zt.fail_func));
+    if (SMP_FN_ZONE_LOCK == tp->zt.fail_func) {
+        if (tp->zt.active_zm_sa)
+            printf(" (active zone manager: 0x%" PRIx64 ")",
+                   tp->zt.active_zm_sa);
+    } else if (SMP_FN_ZONE_UNLOCK == tp->zt.fail_func)
+        printf(", zone may still be locked");
+    if (compare && (0 == tp->res)) {
+        if (tp->vres)
+            printf(", read back failed");
+        else if (tp->num_diff)
+            printf(", read back: %d row%s differ%s", tp->num_diff,
+                   (1 == tp->num_diff) ? "" : "s",
+                   (1 == tp->num_diff) ? "s" : "");
+        else
+            printf(", read back: same");
+    }
+    if (verbose && tp->zt.num_reqs)
+        printf(", %d requests, lock held %" PRIu64 " us", tp->zt.num_reqs,
+               tp->zt.lock_us);
+    printf("\n");
+}
+
+
+#ifdef SMP_UTILS_MULTI
+int
+smp_zone_txn_main(int argc, char * argv[])
+#else
+int
+main(int argc, char * argv[])
+#endif
+{
+    bool compare = false;
+    bool do_bin = false;
+    bool deduce = false;
+    bool numzg256 = false;
+    bool num_zg_given = false;
+    bool staged;
+    int res, c, j, k, len, num_desc, num_phy_info, subvalue;
+    int file_sszg, line_max;
+    int do_save = 0;
+    int inact_tl = 0;
+    int num_sa = 0;
+    int num_zg = 128;
+    int ret = 0;
+    int verbose = 0;
+    int64_t sa_ll;
+    uint64_t first_us, last_us;
+    uint64_t sa_arr[MAX_SAS_ADDRS];
+    const char * permf = NULL;
+    const char * pconf = NULL;
+    char * cp;
+    struct txn_tgt_t * tp;
+    struct txn_t * sp = NULL;
+    char i_params[256];
+    char device_name[SMP_MAX_DEVICE_NAME];
+    uint8_t password[32];
+    struct smp_zone_txn zt;
+
+    /* file scope state: smp_shell may run this more than once */
+    memset(full_perm_tbl, 0, sizeof(full_perm_tbl));
+    memset(phy_info_arr, 0, sizeof(phy_info_arr));
+    memset(&zp, 0, sizeof(zp));
+    sszg_given = false;
+    sszg = 0;
+    memset(password, 0, sizeof password);
+    memset(device_name, 0, sizeof device_name);
+    memset(i_params, 0, sizeof i_params);
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "bcdf:hi:I:n:p:P:s:S:vVw:", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'b':
+            do_bin = true;
+            break;
+        case 'c':
+            compare = true;
+            break;
+        case 'd':
+            deduce = true;
+            break;
+        case 'f':       /* note: maps to '--start=SS' option */
+           sszg = smp_get_num(optarg);
+           if ((sszg < 0) || (sszg > 255)) {
+                pr2serr("bad argument to '--start=', expect 0 to 255\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            sszg_given = true;
+            break;
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'i':
+            inact_tl = smp_get_num(optarg);
+            if ((inact_tl < 0) || (inact_tl > 65535)) {
+                pr2serr("bad argument to '--inactivity'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'I':
+            strncpy(i_params, optarg, sizeof(i_params));
+            i_params[sizeof(i_params) - 1] = '\0';
+            break;
+        case 'n':
+            switch (smp_get_num(optarg)) {
+            case 0:
+                num_zg = 128;
+                break;
+            case 1:
+                num_zg = 256;
+                break;
+            default:
+                pr2serr("bad argument to '--numzg'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            num_zg_given = true;
+            break;
+        case 'p':
+            pconf = optarg;
+            break;
+        case 'P':
+            permf = optarg;
+            break;
+        case 's':
+           sa_ll = smp_get_llnum_nomult(optarg);
+           if (-1LL == sa_ll) {
+                pr2serr("bad argument to '--sa'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            if (num_sa >= MAX_SAS_ADDRS) {
+                pr2serr("'--sa' given more than %d times\n", MAX_SAS_ADDRS);
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            sa_arr[num_sa++] = (uint64_t)sa_ll;
+            break;
+        case 'S':
+            do_save = smp_get_num(optarg);
+            if ((do_save < 0) || (do_save > 3)) {
+                pr2serr("bad argument to '--save'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'v':
+            ++verbose;
+            break;
+        case 'V':
+            pr2serr("version: %s\n", version_str);
+            return 0;
+        case 'w':
+            len = (int)strlen(optarg);
+            if (len > 32) {
+                pr2serr("argument to '--password' too long; max 32 got %d\n",
+                        len);
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            memcpy(password, optarg, len);
+            break;
+        default:
+            pr2serr("unrecognised switch code 0x%x ??\n", c);
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (optind >= argc) {
+        cp = getenv("SMP_UTILS_DEVICE");
+        if (cp)
+            strncpy(device_name, cp, sizeof(device_name) - 1);
+        else if ((0 == num_sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
+            pr2serr("missing device name on command line\n    [Could use "
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (0 == num_sa) {
+        cp = getenv("SMP_UTILS_SAS_ADDR");
+        if (cp) {
+           sa_ll = smp_get_llnum_nomult(cp);
+           if (-1LL == sa_ll) {
+                pr2serr("bad value in environment variable "
+                        "SMP_UTILS_SAS_ADDR\n    use 0\n");
+                sa_ll = 0;
+            }
+            if (sa_ll)
+                sa_arr[num_sa++] = (uint64_t)sa_ll;
+        }
+    }
+    for (k = 0; k < num_sa; ++k) {
+        if (! smp_is_naa5(sa_arr[k])) {
+            pr2serr("SAS (target) address not in naa-5 format (may need "
+                    "leading '0x')\n");
+            if ('\0' == i_params[0]) {
+                pr2serr("    use '--interface=' to override\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+        }
+    }
+    if ((NULL == permf) && (NULL == pconf)) {
+        pr2serr("need --permf=FN or --pconf=PC (or both)\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
+    if (deduce && num_zg_given) {
+        pr2serr("can't give both --deduce and --numzg=\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
+    if (permf && pconf && (0 == strcmp("-", permf)) &&
+        (0 == strcmp("-", pconf))) {
+        pr2serr("--permf=FN and --pconf=PC can't both be stdin\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
+    if (compare && (NULL == permf)) {
+        pr2serr("--compare needs --permf=FN\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
+
+    memset(&zt, 0, sizeof(zt));
+    num_desc = 0;
+    if (permf) {
+        if (smp_f2hex_arr(permf, do_bin, full_perm_tbl, &len,
+                          sizeof full_perm_tbl, &file_sszg, &line_max,
+                          verbose)) {
+            pr2serr("failed decoding --permf=FN option\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+        if (file_sszg >= 0) {
+            if (sszg_given && (file_sszg != sszg)) {
+                pr2serr("permission file '--start=%d' contradicts "
+                        "command line '--start=%d'\n", file_sszg, sszg);
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            if (verbose)
+                pr2serr("permission file contains --start=%d, using it\n",
+                        file_sszg);
+            sszg = file_sszg;
+        }
+        numzg256 = (line_max > 16);
+        if (deduce && numzg256)
+            num_zg = 256;
+        num_desc = len / ((128 == num_zg) ? 16 : 32);
+        if (0 != (len % ((128 == num_zg) ? 16 : 32)))
+            pr2serr("warning: permf data not a multiple of %d bytes, ignore "
+                    "excess\n", (128 == num_zg) ? 16 : 32);
+        if ((sszg + num_desc) > num_zg) {
+            pr2serr("warning: permf data goes past the last zone group, "
+                    "ignore excess\n");
+            num_desc = (sszg < num_zg) ? (num_zg - sszg) : 0;
+        }
+        smp_zp_init(&zp, num_zg);
+        for (j = 0; j < num_desc; ++j)
+            smp_zp_set_row(&zp, sszg + j,
+                           full_perm_tbl + (j * ((128 == num_zg) ? 16 : 32)));
+        if (num_desc > 0) {
+            zt.zpp = &zp;
+            zt.sszg = sszg;
+            zt.num_rows = num_desc;
+        }
+    }
+    num_phy_info = 0;
+    if (pconf) {
+        if (smp_f2hex_arr(pconf, do_bin, phy_info_arr, &len,
+                          sizeof(phy_info_arr), NULL, NULL, verbose)) {
+            pr2serr("failed decoding --pconf=PC option\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+        num_phy_info = len / 4;
+        if (0 != (len % 4))
+            pr2serr("warning: pconf data not a multiple of 4, ignore "
+                    "excess\n");
+        zt.phy_info = phy_info_arr;
+        zt.num_phy_info = num_phy_info;
+    }
+    zt.password = password;
+    zt.save = do_save;
+    zt.inact_tl = inact_tl;
+    if (verbose)
+        pr2serr("%d permission table descriptors, %d zone phy "
+                "descriptors\n", num_desc, num_phy_info);
+
+    sp = (struct txn_t *)calloc(1, sizeof(struct txn_t));
+    if (NULL == sp) {
+        pr2serr("heap allocation problem\n");
+        return SMP_LIB_RESOURCE_ERROR;
+    }
+    sp->verbose = verbose;
+    sp->i_params = i_params;
+    pthread_mutex_init(&sp->mtx, NULL);
+    pthread_cond_init(&sp->cv, NULL);
+    /* each SMP_DEVICE with each SAS_ADDR given */
+    for (j = optind; (j < argc) || ((j == optind) && (optind >= argc));
+         ++j) {
+        subvalue = 0;
+        if (j < argc)
+            strncpy(device_name, argv[j], sizeof(device_name) - 1);
+        if ((cp = strchr(device_name, SMP_SUBVALUE_SEPARATOR))) {
+            *cp = '\0';
+            if (1 != sscanf(cp + 1, "%d", &subvalue)) {
+                pr2serr("expected number after separator in SMP_DEVICE "
+                        "name\n");
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+        }
+        for (k = 0; k < (num_sa ? num_sa : 1); ++k) {
+            if (sp->num_tgts >= MAX_TARGETS) {
+                pr2serr("more than %d SMP targets\n", MAX_TARGETS);
+                ret = SMP_LIB_SYNTAX_ERROR;
+                goto fini;
+            }
+            tp = sp->tgts + sp->num_tgts++;
+            tp->sp = sp;
+            tp->subvalue = subvalue;
+            tp->sa = num_sa ? sa_arr[k] : 0;
+            tp->vres = -1;
+            memcpy(tp->dev_name, device_name, sizeof(tp->dev_name));
+            memcpy(&tp->zt, &zt, sizeof(zt));
+        }
+    }
+
+    run_phase(sp, TXN_PH_OPEN);
+    for (k = 0, staged = true; k < sp->num_tgts; ++k) {
+        if (sp->tgts[k].res)
+            staged = false;
+    }
+    if (staged) {
+        run_phase(sp, TXN_PH_STAGE);
+        for (k = 0; k < sp->num_tgts; ++k) {
+            if (sp->tgts[k].res)
+                staged = false;
+        }
+    }
+    if (staged) {
+        run_phase(sp, TXN_PH_COMMIT);
+        if (compare)
+            run_phase(sp, TXN_PH_VERIFY);
+    } else {
+        run_phase(sp, TXN_PH_ABORT);
+        if (sp->num_tgts > 1)
+            pr2serr("zoning not set up on all SMP targets, so none "
+                    "activated\n");
+    }
+
+    first_us = 0;
+    last_us = 0;
+    for (k = 0; k < sp->num_tgts; ++k) {
+        tp = sp->tgts + k;
+        if ((sp->num_tgts > 1) || tp->res || compare || verbose)
+            output_tgt(tp, compare, verbose);
+        if (tp->res && (0 == ret))
+            ret = tp->res;
+        else if (compare && (0 == ret) && (tp->vres || tp->num_diff))
+            ret = SMP_LIB_CAT_OTHER;
+        if (tp->zt.activate_us) {
+            if ((0 == first_us) || (tp->zt.activate_us < first_us))
+                first_us = tp->zt.activate_us;
+            if (tp->zt.activate_us > last_us)
+                last_us = tp->zt.activate_us;
+        }
+        if (tp->opened) {
+            res = smp_initiator_close(&tp->tobj);
+            if (res < 0) {
+                pr2serr("%s: close error: %s\n", tp->dev_name,
+                        safe_strerror(errno));
+                if (0 == ret)
+                    ret = SMP_LIB_FILE_ERROR;
+            }
+        }
+    }
+    if ((sp->num_tgts > 1) && staged)
+        printf("ZONE ACTIVATE sent to %d SMP targets within %" PRIu64
+               " us\n", sp->num_tgts, last_us - first_us);
+fini:
+    pthread_cond_destroy(&sp->cv);
+    pthread_mutex_destroy(&sp->mtx);
+    free(sp);
+    if (ret < 0)
+        ret = SMP_LIB_CAT_OTHER;
+    if (verbose && ret)
+        pr2serr("Exit status %d indicates error detected\n", ret);
+    return ret;
+}
@@ -0,0 +1,1886 @@
+/*
+ * Copyright (c) 2026, Douglas Gilbert
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "smp_lib.h"
+#include "sg_unaligned.h"
+#include "sg_pr2serr.h"
+
+/* This is a Serial Attached SCSI (SAS) Serial Management Protocol (SMP)
+ * daemon.
+ *
+ * smpd owns the SMP targets of a fabric: the given SMP_DEVICE and (with
+ * --walk) the expanders found attached to it. One thread per target polls
+ * REPORT GENERAL and, when the expander change count moves, finds the
+ * changed phys with DISCOVER LIST and sends DISCOVER only to them. The
+ * resulting model is published in a file that readers mmap() (see
+ * smp_smpd_map()). Clients using the "smpd" interface send their requests
+ * through a Unix socket; identical report requests in flight at the same
+ * time are sent to the target once and the response goes to them all.
+ * With --metrics the workers also gather phy error counters and phy
+ * events, and render them (with the model and request statistics) as
+ * OpenMetrics text that a thread serves over HTTP.
+ */
+
+static const char * version_str = "1.03 20261014";
+
+#define SMP_FN_DISCOVER_RESP_LEN 124
+#define SMP_FN_DISCOVER_LIST_RESP_LEN 1028
+#define MAX_DLIST_SHORT_DESCS 40
+#define MAX_PHY_ID 254
+#define DEF_INTERVAL_MS 1000
+#define SMPD_MAX_TARGETS 64
+#define SMPD_MAX_CLIENTS 256
+#define SMPD_MSG_MAX (sizeof(struct smp_smpd_msg) + SMP_SMPD_MAX_FRAME)
+#define DEF_COUNTERS_MS 10000
+#define SMPD_EL_RESP_LEN 32     /* REPORT PHY ERROR LOG, including CRC */
+#define SMPD_PEL_RESP_LEN 1028  /* REPORT PHY EVENT LIST */
+#define SMPD_MAX_PES 16         /* phy events kept per phy */
+#define SMPD_NUM_FAM 14         /* metric families, see met_fams[] */
+#define SMPD_HTTP_REQ_MAX 2048
+
+struct smpd_waiter {
+    int cli;                    /* index in clients[] */
+    uint32_t cli_gen;           /* that slot may have been reused */
+    uint32_t tag;
+    uint32_t max_resp_len;
+};
+
+/* A request from one or more clients (more when coalesced) */
+struct smpd_op {
+    struct smpd_op * next;
+    struct smpd_tgt * tp;
+    bool coalesce;              /* report function, may be coalesced */
+    int res;
+    int num_w;
+    int max_w;
+    struct smpd_waiter * w;
+    struct smp_req_resp rr;
+    uint8_t req[SMP_SMPD_MAX_FRAME];
+    uint8_t resp[SMP_SMPD_MAX_FRAME];
+};
+
+struct smpd_pe {
+    uint8_t src;                /* phy event source */
+    uint32_t val;
+};
+
+struct smpd_tgt {
+    int idx;
+    bool first_poll;
+    bool have_dlist;
+    bool no_pel;                /* REPORT PHY EVENT LIST not supported */
+    bool refresh_now;           /* after a configure function */
+    bool stop;
+    bool started;               /* tgt_worker() running */
+    int num_phys;
+    int exp_cc;
+    uint64_t sa;
+    struct smp_target_obj tobj;
+    pthread_t thr;
+    pthread_mutex_t mtx;        /* protects the queue, busy and flags */
+    pthread_cond_t cv;
+    struct smpd_op * q_head;    /* waiting to be sent */
+    struct smpd_op * q_tail;
+    struct smpd_op * busy;      /* being sent */
+    struct smp_smpd_shm_exp * shm;      /* &boot until the model mapped */
+    uint64_t num_client_reqs;
+    uint64_t num_sent;
+    uint64_t num_coalesced;
+    uint64_t num_polls;
+    uint64_t num_rediscovered;
+    bool stale[MAX_PHY_ID + 1];
+    struct smp_discover_view dv[MAX_PHY_ID + 1];
+    uint8_t reqs[(MAX_PHY_ID + 1) * 16];
+    uint8_t resps[(MAX_PHY_ID + 1) * SMP_FN_DISCOVER_RESP_LEN];
+    struct smp_req_resp rrp[MAX_PHY_ID + 1];
+    struct smp_smpd_shm_exp boot;
+    /* with --metrics; met and met_off[] are protected by mtx */
+    struct timespec cnt_dl;     /* when counters are next refreshed */
+    int lbl_num;                /* phys labelled in phy_lbl[] */
+    int met_off[SMPD_NUM_FAM + 1];      /* of each family's samples */
+    char * met;
+    char exp_lbl[40];
+    char phy_lbl[MAX_PHY_ID + 1][64];
+    char * fn_lbl[SMP_STATS_NUM_FUNCS];
+    bool el_ok[MAX_PHY_ID + 1];
+    uint32_t el[MAX_PHY_ID + 1][4];     /* REPORT PHY ERROR LOG counters */
+    uint8_t num_pe[MAX_PHY_ID + 1];
+    struct smpd_pe pe[MAX_PHY_ID + 1][SMPD_MAX_PES];
+    struct smp_stats st;
+};
+
+/* Text grown by txt_add() */
+struct smpd_txt {
+    bool oom;
+    int len;
+    int cap;
+    char * b;
+};
+
+/* A metric family: render() appends the samples of one target */
+struct smpd_fam {
+    const char * name;
+    const char * type;
+    const char * help;
+    void (*render)(struct smpd_txt * txp, const struct smpd_tgt * tp,
+                   const char * name, int arg);
+    int arg;
+};
+
+struct smpd_cli {
+    int fd;                     /* -1 when slot free */
+    uint32_t gen;
+    int roff;
+    uint8_t rbuf[SMPD_MSG_MAX];
+};
+
+struct opts_t {
+    bool walk;
+    const char * met_spec;      /* --metrics=[ADDR:]PORT */
+    const char * shm_path;
+    const char * sock_path;
+};
+
+static struct smpd_tgt * tgts[SMPD_MAX_TARGETS];
+static int num_tgts;
+static struct smp_smpd_shm_hdr * shm_hdr;
+static struct smpd_cli clients[SMPD_MAX_CLIENTS];
+static pthread_mutex_t done_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct smpd_op * done_head;
+static int done_pipe[2] = {-1, -1};
+static int interval_ms = DEF_INTERVAL_MS;
+static int counters_ms = DEF_COUNTERS_MS;
+static int verbose;
+static bool metrics_on;
+static int met_lfd = -1;
+static bool met_stop;
+static char le_str[SMP_STATS_HIST_LEN][16];     /* histogram bucket bounds */
+
+static volatile sig_atomic_t got_signal;
+
+static struct option long_options[] = {
+    {"counters", required_argument, 0, 'c'},
+    {"dump", no_argument, 0, 'd'},
+    {"help", no_argument, 0, 'h'},
+    {"interface", required_argument, 0, 'I'},
+    {"interval", required_argument, 0, 'i'},
+    {"metrics", required_argument, 0, 'M'},
+    {"sa", required_argument, 0, 's'},
+    {"shm", required_argument, 0, 'm'},
+    {"socket", required_argument, 0, 'S'},
+    {"verbose", no_argument, 0, 'v'},
+    {"version", no_argument, 0, 'V'},
+    {"walk", no_argument, 0, 'W'},
+    {0, 0, 0, 0},
+};
+
+
+static void
+usage(void)
+{
+    pr2serr("Usage: smpd [--counters=MS] [--dump] [--help] "
+            "[--interface=PARAMS]\n"
+            "            [--interval=MS] [--metrics=[ADDR:]PORT] "
+            "[--sa=SAS_ADDR]\n"
+            "            [--shm=PATH] [--socket=PATH] [--verbose] "
+            "[--version] [--walk]\n"
+            "            SMP_DEVICE[,N]\n"
+            "  where:\n"
+            "    --counters=MS|-c MS     with --metrics, fetch phy error "
+            "counters and\n"
+            "                            phy events every MS milliseconds "
+            "(def: 10000)\n"
+            "    --dump|-d               output the fabric model published "
+            "by a running\n"
+            "                            smpd, then exit\n"
+            "    --help|-h               print out usage message\n"
+            "    --interface=PARAMS|-I PARAMS    specify or override "
+            "interface\n"
+            "    --interval=MS|-i MS     poll each expander every MS "
+            "milliseconds\n"
+            "                            (def: 1000)\n"
+            "    --metrics=[ADDR:]PORT|-M [ADDR:]PORT    serve OpenMetrics "
+            "text over\n"
+            "                            HTTP on PORT, at /metrics\n"
+            "    --sa=SAS_ADDR|-s SAS_ADDR    SAS address of SMP "
+            "target (use leading\n"
+            "                                 '0x' or trailing 'h'). "
+            "Depending\n"
+            "                                 on the interface, may not be "
+            "needed\n"
+            "    --shm=PATH|-m PATH      publish the fabric model in PATH "
+            "(def:\n"
+            "                            %s)\n"
+            "    --socket=PATH|-S PATH    listen for clients on unix socket "
+            "PATH\n"
+            "                            (def: %s)\n"
+            "    --verbose|-v            increase verbosity\n"
+            "    --version|-V            print version string and exit\n"
+            "    --walk|-W               also own the expanders attached "
+            "to SMP_DEVICE,\n"
+            "                            and those attached to them\n\n"
+            "SMP daemon: keeps a model of the fabric current and passes "
+            "requests from\nclients using the 'smpd' interface, coalescing "
+            "identical ones\n", SMP_SMPD_SHM, SMP_SMPD_SOCKET);
+}
+
+static void
+sig_handler(int sig)
+{
+    got_signal = sig;
+}
+
+/* Rewriting an expander record: seq odd between these two */
+static void
+rec_begin(struct smp_smpd_shm_exp * ep)
+{
+    __atomic_store_n(&ep->seq, ep->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void
+rec_end(struct smp_smpd_shm_exp * ep)
+{
+    __atomic_store_n(&ep->seq, ep->seq + 1, __ATOMIC_RELEASE);
+    if (shm_hdr)
+        __atomic_add_fetch(&shm_hdr->gen, 1, __ATOMIC_RELEASE);
+}
+
+/* Marks as stale those phys whose function result or phy change count, in
+ * the short DISCOVER LIST descriptors, differ from the model. */
+static int
+mark_by_dlist(struct smpd_tgt * tp)
+{
+    int j, res, len, sphy, ndesc, desc_len;
+    const uint8_t * dp;
+    uint8_t * rp = tp->resps;
+    uint8_t smp_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_DISCOVER_LIST, 0, 6,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                         0, 0, 0, 0, };
+    struct smp_req_resp smp_rr;
+
+    for (sphy = 0; sphy < tp->num_phys; sphy += ndesc) {
+        memset(rp, 0, SMP_FN_DISCOVER_LIST_RESP_LEN);
+        smp_req[2] = 0xff;
+        smp_req[8] = sphy;
+        smp_req[9] = MAX_DLIST_SHORT_DESCS;
+        smp_req[11] = 1;                /* short format */
+        memset(&smp_rr, 0, sizeof(smp_rr));
+        smp_rr.request_len = sizeof(smp_req);
+        smp_rr.request = smp_req;
+        smp_rr.max_response_len = SMP_FN_DISCOVER_LIST_RESP_LEN;
+        smp_rr.response = rp;
+        res = smp_send_req(&tp->tobj, &smp_rr, verbose);
+        ++tp->num_sent;
+        if (res || smp_rr.transport_err ||
+            ((smp_rr.act_response_len >= 0) &&
+             (smp_rr.act_response_len < 48)) ||
+            (SMP_FRAME_TYPE_RESP != rp[0]) || (rp[1] != smp_req[1]) || rp[2])
+            return -1;
+        len = 4 + (4 * rp[3]);
+        if ((smp_rr.act_response_len >= 0) &&
+            (len > smp_rr.act_response_len))
+            len = smp_rr.act_response_len;
+        ndesc = rp[9];
+        desc_len = rp[12] * 4;
+        if ((0 == ndesc) || (desc_len < 12) ||
+            (len < (48 + (ndesc * desc_len))))
+            return -1;
+        for (j = 0, dp = rp + 48; j < ndesc; ++j, dp += desc_len) {
+            if ((dp[0] < tp->num_phys) &&
+                (dp[1] != tp->dv[dp[0]].func_res ||
+                 (dp[11] != tp->dv[dp[0]].phy_change_count)))
+                tp->stale[dp[0]] = true;
+        }
+    }
+    return 0;
+}
+
+/* Sends DISCOVER to the stale phys and places their responses in the
+ * model. Returns the number of phys rediscovered. */
+static int
+rediscover(struct smpd_tgt * tp, const struct smp_report_general * rgp)
+{
+    int k, n, len, num;
+    struct smp_smpd_shm_exp * ep = tp->shm;
+    struct smp_discover_view dv;
+
+    for (n = 0, k = 0; k < tp->num_phys; ++k) {
+        if (! tp->stale[k])
+            continue;
+        memset(tp->reqs + (16 * n), 0, 16);
+        tp->reqs[16 * n] = SMP_FRAME_TYPE_REQ;
+        tp->reqs[(16 * n) + 1] = SMP_FN_DISCOVER;
+        tp->reqs[(16 * n) + 9] = k;
+        memset(tp->rrp + n, 0, sizeof(tp->rrp[0]));
+        tp->rrp[n].request_len = 16;
+        tp->rrp[n].request = tp->reqs + (16 * n);
+        tp->rrp[n].max_response_len = SMP_FN_DISCOVER_RESP_LEN;
+        tp->rrp[n].response = tp->resps + (SMP_FN_DISCOVER_RESP_LEN * n);
+        memset(tp->rrp[n].response, 0, SMP_FN_DISCOVER_RESP_LEN);
+        ++n;
+    }
+    num = n;
+    if (num > 0) {
+        smp_send_req_batch(&tp->tobj, tp->rrp, num, 0, NULL, NULL, verbose);
+        tp->num_sent += num;
+    }
+    rec_begin(ep);
+    ep->status = 0;
+    ep->num_phys = tp->num_phys;
+    ep->rg_len = rgp->resp_len;
+    memcpy(ep->rg_resp, rgp->resp, sizeof(ep->rg_resp));
+    for (n = 0, k = 0; k < tp->num_phys; ++k) {
+        if (! tp->stale[k])
+            continue;
+        tp->stale[k] = false;
+        len = tp->rrp[n].act_response_len;
+        if ((len < 0) || (len > SMP_FN_DISCOVER_RESP_LEN))
+            len = SMP_FN_DISCOVER_RESP_LEN;
+        memset(&dv, 0, sizeof(dv));
+        if (tp->rrp[n].transport_err) {
+            len = 0;
+            dv.func_res = 0xff; /* try again next change */
+        } else if (smp_decode_discover(tp->rrp[n].response, len - 4, 0,
+                                       &dv))
+            dv.func_res = tp->rrp[n].response[2];   /* e.g. vacant phy */
+        dv.phy_id = k;
+        tp->dv[k] = dv;
+        ep->phys[k].len = len;
+        memcpy(ep->phys[k].resp, tp->rrp[n].response,
+               SMP_FN_DISCOVER_RESP_LEN);
+        ++n;
+    }
+    for ( ; k < SMP_SMPD_MAX_PHYS; ++k)
+        ep->phys[k].len = 0;
+    ep->update_us = smp_stats_clock_us();
+    rec_end(ep);
+    tp->num_rediscovered += num;
+    return num;
+}
+
+/* Polls REPORT GENERAL of the target and, when its expander change count
+ * has moved (or on the first poll), rediscovers the changed phys. */
+static void
+poll_exp(struct smpd_tgt * tp)
+{
+    int k, res, n;
+    struct smp_smpd_shm_exp * ep = tp->shm;
+    struct smp_report_general rg;
+    char b[128];
+
+    ++tp->num_polls;
+    res = smp_get_report_general(&tp->tobj, &rg, 0, verbose);
+    ++tp->num_sent;
+    __atomic_store_n(&ep->poll_us, smp_stats_clock_us(), __ATOMIC_RELAXED);
+    if (res) {
+        if (res != ep->status) {
+            pr2serr("0x%" PRIx64 ": REPORT GENERAL failed: %s\n", tp->sa,
+                    (res > 0) ? smp_get_func_res_str(res, sizeof(b), b) :
+                                "request failed");
+            rec_begin(ep);
+            ep->status = res;
+            rec_end(ep);
+        }
+        return;
+    }
+    if ((! tp->first_poll) && (0 == ep->status) &&
+        (rg.exp_change_count == tp->exp_cc) && (rg.num_phys == tp->num_phys))
+        return;
+    if (tp->first_poll || (rg.num_phys != tp->num_phys) ||
+        (! tp->have_dlist) || mark_by_dlist(tp)) {
+        tp->num_phys = (rg.num_phys > MAX_PHY_ID) ? MAX_PHY_ID + 1 :
+                                                    rg.num_phys;
+        for (k = 0; k < tp->num_phys; ++k)
+            tp->stale[k] = true;
+    }
+    n = rediscover(tp, &rg);
+    if (verbose && (! tp->first_poll))
+        pr2serr("0x%" PRIx64 ": expander change count %d -> %d, %d phy%s "
+                "rediscovered\n", tp->sa, tp->exp_cc, rg.exp_change_count,
+                n, (1 == n) ? "" : "s");
+    tp->exp_cc = rg.exp_change_count;
+    tp->first_poll = false;
+}
+
+/* Appends to the text in txp, growing it as needed. On running out of
+ * memory the text is cut short (at a line end) and oom set. */
+static void
+txt_add(struct smpd_txt * txp, const char * fmt, ...)
+{
+    int n;
+    char * cp;
+    va_list args;
+
+    if (txp->oom)
+        return;
+    while (1) {
+        va_start(args, fmt);
+        n = vsnprintf(txp->b + txp->len, txp->cap - txp->len, fmt, args);
+        va_end(args);
+        if ((n >= 0) && (n < (txp->cap - txp->len))) {
+            txp->len += n;
+            return;
+        }
+        cp = (char *)realloc(txp->b, txp->cap ? (2 * txp->cap) : 4096);
+        if (NULL == cp) {
+            if (txp->b)
+                txp->b[txp->len] = '\0';
+            txp->oom = true;
+            return;
+        }
+        txp->b = cp;
+        txp->cap = txp->cap ? (2 * txp->cap) : 4096;
+    }
+}
+
+/* Fills the phy error log counters and phy events of the target's phys,
+ * each a batch of requests, for its metrics. */
+static void
+refresh_counters(struct smpd_tgt * tp)
+{
+    int k, n, len, ped_len, num_ped, phy;
+    unsigned int idx, last_di;
+    const uint8_t * bp;
+    uint8_t * rp;
+    struct smp_req_resp rr;
+    uint8_t pel_req[] = {SMP_FRAME_TYPE_REQ, SMP_FN_REPORT_PHY_EVENT_LIST,
+                         0, 1,  0, 0, 0, 0,  0, 0, 0, 0};
+
+    for (n = 0, k = 0; k < tp->num_phys; ++k) {
+        if (tp->dv[k].func_res)
+            continue;           /* e.g. vacant */
+        memset(tp->reqs + (16 * n), 0, 16);
+        tp->reqs[16 * n] = SMP_FRAME_TYPE_REQ;
+        tp->reqs[(16 * n) + 1] = SMP_FN_REPORT_PHY_ERR_LOG;
+        tp->reqs[(16 * n) + 9] = k;
+        memset(tp->rrp + n, 0, sizeof(tp->rrp[0]));
+        tp->rrp[n].request_len = 16;
+        tp->rrp[n].request = tp->reqs + (16 * n);
+        tp->rrp[n].max_response_len = SMPD_EL_RESP_LEN;
+        tp->rrp[n].response = tp->resps + (SMPD_EL_RESP_LEN * n);
+        memset(tp->rrp[n].response, 0, SMPD_EL_RESP_LEN);
+        ++n;
+    }
+    if (n > 0) {
+        smp_send_req_batch(&tp->tobj, tp->rrp, n, 0, NULL, NULL, verbose);
+        tp->num_sent += n;
+    }
+    for (n = 0, k = 0; k < tp->num_phys; ++k) {
+        tp->el_ok[k] = false;
+        if (tp->dv[k].func_res)
+            continue;
+        bp = tp->rrp[n].response;
+        len = tp->rrp[n].act_response_len;
+        if ((0 == tp->rrp[n].transport_err) && (0 == bp[2]) &&
+            ((len < 0) || (len >= 28))) {
+            tp->el_ok[k] = true;
+            tp->el[k][0] = sg_get_unaligned_be32(bp + 12);
+            tp->el[k][1] = sg_get_unaligned_be32(bp + 16);
+            tp->el[k][2] = sg_get_unaligned_be32(bp + 20);
+            tp->el[k][3] = sg_get_unaligned_be32(bp + 24);
+        }
+        ++n;
+    }
+
+    memset(tp->num_pe, 0, sizeof(tp->num_pe));
+    if (tp->no_pel)
+        return;
+    rp = tp->resps;
+    pel_req[2] = (SMPD_PEL_RESP_LEN - 8) / 4;
+    for (idx = 1; ; ) {
+        sg_put_unaligned_be16(idx, pel_req + 6);
+        memset(&rr, 0, sizeof(rr));
+        rr.request_len = sizeof(pel_req);
+        rr.request = pel_req;
+        rr.max_response_len = SMPD_PEL_RESP_LEN;
+        rr.response = rp;
+        memset(rp, 0, SMPD_PEL_RESP_LEN);
+        k = smp_send_req(&tp->tobj, &rr, verbose);
+        ++tp->num_sent;
+        if (k || rr.transport_err)
+            return;             /* try again next time */
+        if (rp[2]) {
+            /* e.g. SAS-1.1 expander, don't ask again */
+            if (SMP_FRES_UNKNOWN_FUNCTION == rp[2])
+                tp->no_pel = true;
+            return;
+        }
+        len = 4 + (rp[3] * 4);
+        if ((rr.act_response_len >= 0) && (len > rr.act_response_len))
+            len = rr.act_response_len;
+        last_di = sg_get_unaligned_be16(rp + 8);
+        ped_len = rp[10] * 4;
+        num_ped = rp[15];
+        if (ped_len < 12)
+            return;
+        if ((16 + (num_ped * ped_len)) > len)
+            num_ped = (len - 16) / ped_len;
+        bp = rp + 16;
+        for (k = 0; (k < num_ped) && ((idx + k) <= last_di);
+             ++k, bp += ped_len) {
+            phy = bp[2];
+            if ((phy >= tp->num_phys) || (tp->num_pe[phy] >= SMPD_MAX_PES))
+                continue;
+            tp->pe[phy][tp->num_pe[phy]].src = bp[3];
+            tp->pe[phy][tp->num_pe[phy]++].val =
+                                sg_get_unaligned_be32(bp + 4);
+        }
+        if ((0 == k) || ((idx + k) > last_di))
+            break;
+        idx += k;
+    }
+}
+
+static void
+met_exp(struct smpd_txt * txp, const struct smpd_tgt * tp, const char * name,
+        int arg)
+{
+    int v;
+
+    if (0 == arg)
+        v = (0 == tp->shm->status);
+    else if (1 == arg)
+        v = tp->exp_cc;
+    else
+        v = tp->num_phys;
+    txt_add(txp, "%s{%s} %d\n", name, tp->exp_lbl, v);
+}
+
+static void
+met_phy(struct smpd_txt * txp, const struct smpd_tgt * tp, const char * name,
+        int arg)
+{
+    int k, r;
+    const struct smp_discover_view * dvp;
+    static const char * gbps[] = {"1.5", "3", "6", "12", "22.5"};
+
+    for (k = 0, dvp = tp->dv; k < tp->num_phys; ++k, ++dvp) {
+        if (dvp->func_res)
+            continue;
+        if (arg)
+            txt_add(txp, "%s{%s} %d\n", name, tp->phy_lbl[k],
+                    dvp->phy_change_count);
+        else {
+            r = dvp->neg_log_lrate;
+            txt_add(txp, "%s{%s} %s\n", name, tp->phy_lbl[k],
+                    ((r >= 8) && (r <= 0xc)) ? gbps[r - 8] : "0");
+        }
+    }
+}
+
+static void
+met_el(struct smpd_txt * txp, const struct smpd_tgt * tp, const char * name,
+       int arg)
+{
+    int k;
+
+    for (k = 0; k < tp->num_phys; ++k) {
+        if (tp->el_ok[k])
+            txt_add(txp, "%s_total{%s} %" PRIu32 "\n", name, tp->phy_lbl[k],
+                    tp->el[k][arg]);
+    }
+}
+
+static void
+met_pe(struct smpd_txt * txp, const struct smpd_tgt * tp, const char * name,
+       int arg)
+{
+    int k, j;
+
+    if (arg) { ; }              /* suppress unused warning */
+    for (k = 0; k < tp->num_phys; ++k) {
+        for (j = 0; j < tp->num_pe[k]; ++j)
+            txt_add(txp, "%s{%s,source=\"0x%02x\"} %" PRIu32 "\n", name,
+                    tp->phy_lbl[k], tp->pe[k][j].src, tp->pe[k][j].val);
+    }
+}
+
+/* Latency histogram of the requests smpd sent, by SMP function, from the
+ * library's statistics. Bucket k of those holds latencies below 2**(k+1)
+ * microseconds, the last bucket the rest. */
+static void
+met_lat(struct smpd_txt * txp, const struct smpd_tgt * tp, const char * name,
+        int arg)
+{
+    int f, k;
+    uint32_t sum;
+    const struct smp_func_stats * fsp;
+
+    if (arg) { ; }              /* suppress unused warning */
+    for (f = 0, fsp = tp->st.fn; f < SMP_STATS_NUM_FUNCS; ++f, ++fsp) {
+        if ((0 == fsp->count) || (NULL == tp->fn_lbl[f]))
+            continue;
+        for (k = 0, sum = 0; k < (SMP_STATS_HIST_LEN - 1); ++k) {
+            sum += fsp->hist[k];
+            txt_add(txp, "%s_bucket{%s,le=\"%s\"} %" PRIu32 "\n", name,
+                    tp->fn_lbl[f], le_str[k], sum);
+        }
+        txt_add(txp, "%s_bucket{%s,le=\"+Inf\"} %" PRIu32 "\n", name,
+                tp->fn_lbl[f], fsp->count);
+        txt_add(txp, "%s_sum{%s} %" PRIu64 ".%06" PRIu64 "\n", name,
+                tp->fn_lbl[f], fsp->total_us / 1000000,
+                fsp->total_us % 1000000);
+        txt_add(txp, "%s_count{%s} %" PRIu32 "\n", name, tp->fn_lbl[f],
+                fsp->count);
+    }
+}
+
+static void
+met_req(struct smpd_txt * txp, const struct smpd_tgt * tp, const char * name,
+        int arg)
+{
+    int f;
+    uint32_t v;
+    const struct smp_func_stats * fsp;
+
+    for (f = 0, fsp = tp->st.fn; f < SMP_STATS_NUM_FUNCS; ++f, ++fsp) {
+        if ((0 == fsp->count) || (NULL == tp->fn_lbl[f]))
+            continue;
+        if (0 == arg)
+            v = fsp->busy;
+        else if (1 == arg)
+            v = fsp->send_fail + fsp->transport_err + fsp->fres_err;
+        else
+            v = fsp->timeout;
+        txt_add(txp, "%s_total{%s} %" PRIu32 "\n", name, tp->fn_lbl[f], v);
+    }
+}
+
+static const struct smpd_fam met_fams[SMPD_NUM_FAM] = {
+    {"smp_expander_up", "gauge",
+     "1 if the last REPORT GENERAL poll of the expander succeeded",
+     met_exp, 0},
+    {"smp_expander_change_count", "gauge",
+     "Expander change count in REPORT GENERAL", met_exp, 1},
+    {"smp_expander_phys", "gauge", "Number of phys in REPORT GENERAL",
+     met_exp, 2},
+    {"smp_phy_negotiated_linkrate_gbps", "gauge",
+     "Negotiated logical link rate, 0 when no link", met_phy, 0},
+    {"smp_phy_change_count", "gauge", "Phy change count in DISCOVER",
+     met_phy, 1},
+    {"smp_phy_invalid_dwords", "counter",
+     "Invalid dword count in REPORT PHY ERROR LOG", met_el, 0},
+    {"smp_phy_disparity_errors", "counter",
+     "Running disparity error count in REPORT PHY ERROR LOG", met_el, 1},
+    {"smp_phy_loss_of_dword_sync", "counter",
+     "Loss of dword synchronization count in REPORT PHY ERROR LOG",
+     met_el, 2},
+    {"smp_phy_reset_problems", "counter",
+     "Phy reset problem count in REPORT PHY ERROR LOG", met_el, 3},
+    {"smp_phy_event", "gauge",
+     "Phy event in REPORT PHY EVENT LIST, by phy event source", met_pe, 0},
+    {"smp_request_latency_seconds", "histogram",
+     "Latency of the SMP requests smpd sent, by SMP function", met_lat, 0},
+    {"smp_request_busy", "counter",
+     "SMP requests answered BUSY, by SMP function", met_req, 0},
+    {"smp_request_failures", "counter",
+     "SMP requests that failed in the pass-through, transport or function "
+     "result, by SMP function", met_req, 1},
+    {"smp_request_timeouts", "counter",
+     "SMP requests the pass-through timed out, by SMP function",
+     met_req, 2},
+};
+
+/* Renders the target's metric samples, family by family, and swaps them
+ * in for the metrics thread to copy. Label sets are made once: per phy
+ * when the number of phys changes and per SMP function on first use. */
+static void
+render_met(struct smpd_tgt * tp)
+{
+    int k, f;
+    int off[SMPD_NUM_FAM + 1];
+    char * old;
+    const char * cp;
+    struct smpd_txt t;
+
+    if ('\0' == tp->exp_lbl[0])
+        snprintf(tp->exp_lbl, sizeof(tp->exp_lbl),
+                 "sas_address=\"0x%016" PRIx64 "\"", tp->sa);
+    for (k = tp->lbl_num; k < tp->num_phys; ++k)
+        snprintf(tp->phy_lbl[k], sizeof(tp->phy_lbl[k]), "%s,phy=\"%d\"",
+                 tp->exp_lbl, k);
+    if (tp->num_phys > tp->lbl_num)
+        tp->lbl_num = tp->num_phys;
+    smp_get_stats(&tp->tobj, &tp->st);
+    for (f = 0; f < SMP_STATS_NUM_FUNCS; ++f) {
+        if (tp->st.fn[f].count && (NULL == tp->fn_lbl[f])) {
+            cp = smp_get_func_name(f);
+            k = strlen(tp->exp_lbl) + strlen(cp) + 16;
+            if ((tp->fn_lbl[f] = (char *)malloc(k)))
+                snprintf(tp->fn_lbl[f], k, "%s,function=\"%s\"",
+                         tp->exp_lbl, cp);
+        }
+    }
+    memset(&t, 0, sizeof(t));
+    for (f = 0; f < SMPD_NUM_FAM; ++f) {
+        off[f] = t.len;
+        met_fams[f].render(&t, tp, met_fams[f].name, met_fams[f].arg);
+    }
+    off[f] = t.len;
+    if (t.oom) {
+        pr2serr("0x%" PRIx64 ": out of memory rendering metrics\n", tp->sa);
+        free(t.b);
+        return;
+    }
+    pthread_mutex_lock(&tp->mtx);
+    old = tp->met;
+    tp->met = t.b;
+    memcpy(tp->met_off, off, sizeof(off));
+    pthread_mutex_unlock(&tp->mtx);
+    free(old);
+}
+
+/* Hands a completed op to the main thread, which answers its waiters */
+static void
+post_done(struct smpd_op * op)
+{
+    char c = 0;
+
+    pthread_mutex_lock(&done_mtx);
+    op->next = done_head;
+    done_head = op;
+    pthread_mutex_unlock(&done_mtx);
+    /* if the pipe is full the main thread has wake ups pending anyway */
+    if (write(done_pipe[1], &c, 1) < 0) {
+        ;
+    }
+}
+
+static void
+ts_add_ms(struct timespec * tsp, int ms)
+{
+    tsp->tv_sec += ms / 1000;
+    tsp->tv_nsec += (ms % 1000) * 1000000;
+    if (tsp->tv_nsec >= 1000000000) {
+        ++tsp->tv_sec;
+        tsp->tv_nsec -= 1000000000;
+    }
+}
+
+static bool
+ts_reached(const struct timespec * nowp, const struct timespec * dlp)
+{
+    return (nowp->tv_sec > dlp->tv_sec) ||
+           ((nowp->tv_sec == dlp->tv_sec) && (nowp->tv_nsec >= dlp->tv_nsec));
+}
+
+static void *
+tgt_worker(void * vp)
+{
+    struct smpd_tgt * tp = (struct smpd_tgt *)vp;
+    struct smpd_op * op;
+    struct timespec dl, now;
+
+    /* completions and poll responses stay on the HBA's NUMA node */
+    smp_numa_bind(smp_sysfs_numa_node(tp->tobj.device_name,
+                                      tp->tobj.subvalue, verbose), verbose);
+    clock_gettime(CLOCK_MONOTONIC, &dl);
+    pthread_mutex_lock(&tp->mtx);
+    while (! tp->stop) {
+        if ((op = tp->q_head)) {
+            tp->q_head = op->next;
+            if (NULL == tp->q_head)
+                tp->q_tail = NULL;
+            tp->busy = op;
+            pthread_mutex_unlock(&tp->mtx);
+            op->res = smp_send_req(&tp->tobj, &op->rr, verbose);
+            ++tp->num_sent;
+            pthread_mutex_lock(&tp->mtx);
+            tp->busy = NULL;
+            if ((0 == op->res) && (! op->coalesce))
+                tp->refresh_now = true;         /* configure function */
+            pthread_mutex_unlock(&tp->mtx);
+            post_done(op);
+            pthread_mutex_lock(&tp->mtx);
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (tp->refresh_now || ts_reached(&now, &dl)) {
+            tp->refresh_now = false;
+            pthread_mutex_unlock(&tp->mtx);
+            poll_exp(tp);
+            if (metrics_on) {
+                if (ts_reached(&now, &tp->cnt_dl)) {
+                    refresh_counters(tp);
+                    tp->cnt_dl = now;
+                    ts_add_ms(&tp->cnt_dl, counters_ms);
+                }
+                render_met(tp);
+            }
+            pthread_mutex_lock(&tp->mtx);
+            dl = now;
+            ts_add_ms(&dl, interval_ms);
+            continue;
+        }
+        pthread_cond_timedwait(&tp->cv, &tp->mtx, &dl);
+    }
+    pthread_mutex_unlock(&tp->mtx);
+    return NULL;
+}
+
+static int
+add_waiter(struct smpd_op * op, int cli, const struct smp_smpd_msg * mp)
+{
+    struct smpd_waiter * wp;
+
+    if (op->num_w >= op->max_w) {
+        wp = (struct smpd_waiter *)realloc(op->w, (op->max_w + 4) *
+                                                  sizeof(*wp));
+        if (NULL == wp)
+            return -1;
+        op->w = wp;
+        op->max_w += 4;
+    }
+    wp = op->w + op->num_w++;
+    wp->cli = cli;
+    wp->cli_gen = clients[cli].gen;
+    wp->tag = mp->tag;
+    wp->max_resp_len = mp->max_resp_len;
+    return 0;
+}
+
+static bool
+same_req(const struct smpd_op * op, const struct smp_smpd_msg * mp,
+         const uint8_t * req)
+{
+    return op->coalesce && (op->rr.request_len == (int)mp->len) &&
+           (0 == memcmp(op->req, req, mp->len));
+}
+
+/* Queues a request from client cli for its target, or joins an identical
+ * report request already queued or being sent. Only a read queued after
+ * the last queued write (or not coalesced function) is joined, and the
+ * one being sent only if no write is queued, so a client never gets a
+ * response from before a write it sent earlier. */
+static int
+submit(int cli, const struct smp_smpd_msg * mp, const uint8_t * req)
+{
+    bool write_queued = false;
+    int res = 0;
+    struct smpd_tgt * tp = tgts[mp->target];
+    struct smpd_op * op;
+    struct smpd_op * match = NULL;
+    const struct smp_func_desc * fdp;
+    uint32_t mrl = mp->max_resp_len;
+
+    if (mrl > SMP_SMPD_MAX_FRAME)
+        mrl = SMP_SMPD_MAX_FRAME;
+    pthread_mutex_lock(&tp->mtx);
+    ++tp->num_client_reqs;
+    for (op = tp->q_head; op; op = op->next) {
+        if (! op->coalesce) {
+            write_queued = true;
+            match = NULL;       /* reads before a write can't be joined */
+        } else if ((NULL == match) && same_req(op, mp, req))
+            match = op;
+    }
+    if (match) {
+        op = match;
+        if (mrl > (uint32_t)op->rr.max_response_len)
+            op->rr.max_response_len = mrl;
+        goto join;
+    }
+    op = tp->busy;
+    if (op && (! write_queued) && same_req(op, mp, req) &&
+        (mrl <= (uint32_t)op->rr.max_response_len))
+        goto join;     /* in flight, the response will do for this one */
+    pthread_mutex_unlock(&tp->mtx);
+    op = (struct smpd_op *)calloc(1, sizeof(*op));
+    if ((NULL == op) || add_waiter(op, cli, mp)) {
+        free(op);
+        return -1;
+    }
+    op->tp = tp;
+    fdp = smp_get_func_desc(req[1]);    /* unknown functions not merged */
+    op->coalesce = fdp && (! (SMP_FDESC_WRITE & fdp->flags));
+    memcpy(op->req, req, mp->len);
+    op->rr.request = op->req;
+    op->rr.request_len = mp->len;
+    op->rr.response = op->resp;
+    op->rr.max_response_len = mrl;
+    pthread_mutex_lock(&tp->mtx);
+    if (tp->q_tail)
+        tp->q_tail->next = op;
+    else
+        tp->q_head = op;
+    tp->q_tail = op;
+    pthread_cond_signal(&tp->cv);
+    pthread_mutex_unlock(&tp->mtx);
+    return 0;
+join:
+    if (add_waiter(op, cli, mp))
+        res = -1;
+    else
+        ++tp->num_coalesced;
+    pthread_mutex_unlock(&tp->mtx);
+    return res;
+}
+
+static void
+drop_client(int cli)
+{
+    if (clients[cli].fd >= 0) {
+        close(clients[cli].fd);
+        clients[cli].fd = -1;
+        if (verbose > 1)
+            pr2serr("client %d gone\n", cli);
+    }
+}
+
+/* Sends a reply without blocking; a client too slow to take it is
+ * dropped. */
+static void
+reply(int cli, const struct smp_smpd_msg * mp, const uint8_t * bp)
+{
+    int n, len;
+    uint8_t b[SMPD_MSG_MAX];
+
+    len = sizeof(*mp) + mp->len;
+    memcpy(b, mp, sizeof(*mp));
+    if (mp->len > 0)
+        memcpy(b + sizeof(*mp), bp, mp->len);
+    do
+        n = send(clients[cli].fd, b, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    while ((n < 0) && (EINTR == errno));
+    if (n != len)
+        drop_client(cli);
+}
+
+static void
+answer_done(void)
+{
+    int k, len;
+    struct smpd_op * op;
+    struct smpd_op * next;
+    struct smpd_waiter * wp;
+    struct smp_smpd_msg m;
+    char b[64];
+
+    while (read(done_pipe[0], b, sizeof(b)) > 0)
+        ;
+    pthread_mutex_lock(&done_mtx);
+    op = done_head;
+    done_head = NULL;
+    pthread_mutex_unlock(&done_mtx);
+    for ( ; op; op = next) {
+        next = op->next;
+        len = op->rr.act_response_len;
+        if ((len < 0) || (len > op->rr.max_response_len))
+            len = op->rr.max_response_len;
+        if (op->res < 0)
+            len = 0;
+        for (k = 0, wp = op->w; k < op->num_w; ++k, ++wp) {
+            if ((clients[wp->cli].fd < 0) ||
+                (clients[wp->cli].gen != wp->cli_gen))
+                continue;
+            memset(&m, 0, sizeof(m));
+            m.magic = SMP_SMPD_MAGIC;
+            m.op = SMP_SMPD_OP_REQ;
+            m.target = op->tp->idx;
+            m.tag = wp->tag;
+            m.res = op->res;
+            m.act_resp_len = op->rr.act_response_len;
+            m.transport_err = op->rr.transport_err;
+            m.len = ((uint32_t)len > wp->max_resp_len) ? wp->max_resp_len :
+                                                         (uint32_t)len;
+            if ((m.act_resp_len >= 0) &&
+                ((uint32_t)m.act_resp_len > wp->max_resp_len))
+                m.act_resp_len = wp->max_resp_len;
+            reply(wp->cli, &m, op->resp);
+        }
+        free(op->w);
+        free(op);
+    }
+}
+
+/* With sa non-zero choose that target, else the one opened as
+ * device_name, else (empty device_name) the first. */
+static int
+find_tgt(const char * device_name, int subvalue, uint64_t sa)
+{
+    int k;
+
+    for (k = 0; k < num_tgts; ++k) {
+        if (sa ? (sa == tgts[k]->sa) :
+                 (('\0' == device_name[0]) ||
+                  ((subvalue == tgts[k]->tobj.subvalue) &&
+                   (0 == strcmp(device_name, tgts[k]->tobj.device_name)))))
+            return k;
+    }
+    return -1;
+}
+
+/* Acts on each complete message held for client cli. Returns -1 if the
+ * client should be dropped. */
+static int
+client_msgs(int cli)
+{
+    int k, n, mlen;
+    struct smpd_cli * cp = clients + cli;
+    struct smp_smpd_msg m;
+    const uint8_t * pl;
+
+    for (n = 0; (cp->roff - n) >= (int)sizeof(m); n += mlen) {
+        memcpy(&m, cp->rbuf + n, sizeof(m));
+        if ((SMP_SMPD_MAGIC != m.magic) || (m.len > SMP_SMPD_MAX_FRAME))
+            return -1;
+        mlen = sizeof(m) + m.len;
+        if ((cp->roff - n) < mlen)
+            break;
+        pl = cp->rbuf + n + sizeof(m);
+        if (SMP_SMPD_OP_OPEN == m.op) {
+            if ((0 == m.len) || pl[m.len - 1])
+                return -1;
+            k = find_tgt((const char *)pl, m.max_resp_len, m.sas_addr);
+            m.len = 0;
+            m.res = (k < 0) ? -1 : 0;
+            m.target = (k < 0) ? 0 : k;
+            m.sas_addr = (k < 0) ? 0 : tgts[k]->sa;
+            reply(cli, &m, NULL);
+            if (verbose > 1)
+                pr2serr("client %d opens %s\n", cli,
+                        (k < 0) ? "nothing" : tgts[k]->tobj.device_name);
+        } else if (SMP_SMPD_OP_REQ == m.op) {
+            if ((m.target >= num_tgts) || (m.len < 8) ||
+                (SMP_FRAME_TYPE_REQ != pl[0]) || submit(cli, &m, pl))
+                return -1;
+        } else
+            return -1;
+        if (cp->fd < 0)
+            return 0;           /* dropped by reply() */
+    }
+    if (n > 0) {
+        memmove(cp->rbuf, cp->rbuf + n, cp->roff - n);
+        cp->roff -= n;
+    }
+    return 0;
+}
+
+static void
+client_read(int cli)
+{
+    int n;
+    struct smpd_cli * cp = clients + cli;
+
+    n = read(cp->fd, cp->rbuf + cp->roff, sizeof(cp->rbuf) - cp->roff);
+    if ((n < 0) && ((EINTR == errno) || (EAGAIN == errno)))
+        return;
+    if (n <= 0) {
+        drop_client(cli);
+        return;
+    }
+    cp->roff += n;
+    if (client_msgs(cli))
+        drop_client(cli);
+}
+
+static void
+client_accept(int lfd)
+{
+    int k, fd;
+
+    if ((fd = accept(lfd, NULL, NULL)) < 0)
+        return;
+    for (k = 0; k < SMPD_MAX_CLIENTS; ++k) {
+        if (clients[k].fd < 0)
+            break;
+    }
+    if (k >= SMPD_MAX_CLIENTS) {
+        pr2serr("too many clients, refusing another\n");
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    clients[k].fd = fd;
+    ++clients[k].gen;
+    clients[k].roff = 0;
+    if (verbose > 1)
+        pr2serr("client %d connected\n", k);
+}
+
+/* Opens a TCP socket listening on [ADDR:]PORT (ADDR may be in brackets,
+ * e.g. "[::1]:9180"); no ADDR means all addresses. */
+static int
+open_metrics(const char * spec)
+{
+    int fd, res;
+    int on = 1;
+    const char * host = NULL;
+    const char * port = spec;
+    const char * cp;
+    char b[256];
+    struct addrinfo hints;
+    struct addrinfo * aip;
+    struct addrinfo * ap;
+
+    if (strlen(spec) >= sizeof(b)) {
+        pr2serr("--metrics: argument too long\n");
+        return -1;
+    }
+    strcpy(b, spec);
+    if ('[' == b[0]) {
+        if ((NULL == (cp = strchr(b, ']'))) || (':' != cp[1])) {
+            pr2serr("--metrics: expect [ADDR]:PORT\n");
+            return -1;
+        }
+        b[cp - b] = '\0';
+        host = b + 1;
+        port = cp + 2;
+    } else if ((cp = strrchr(b, ':'))) {
+        b[cp - b] = '\0';
+        host = b[0] ? b : NULL;
+        port = cp + 1;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if ((res = getaddrinfo(host, port, &hints, &aip))) {
+        pr2serr("--metrics: %s: %s\n", spec, gai_strerror(res));
+        return -1;
+    }
+    for (fd = -1, ap = aip; ap; ap = ap->ai_next) {
+        if ((fd = socket(ap->ai_family, ap->ai_socktype,
+                         ap->ai_protocol)) < 0)
+            continue;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if ((0 == bind(fd, ap->ai_addr, ap->ai_addrlen)) &&
+            (0 == listen(fd, 16)))
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(aip);
+    if (fd < 0)
+        pr2serr("--metrics: unable to listen on %s: %s\n", spec,
+                safe_strerror(errno));
+    return fd;
+}
+
+static int
+write_all(int fd, const char * bp, int len)
+{
+    int n;
+
+    while (len > 0) {
+        n = write(fd, bp, len);
+        if (n < 0) {
+            if (EINTR == errno)
+                continue;
+            return -1;
+        }
+        bp += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Answers one HTTP request on fd. GET /metrics gets the samples the
+ * target workers last rendered, so a scrape sends no SMP requests. */
+static void
+http_answer(int fd, struct smpd_txt * pgp)
+{
+    int k, f, n;
+    int len = 0;
+    const char * status = "200 OK";
+    struct smpd_tgt * tp;
+    struct timeval tv;
+    char b[SMPD_HTTP_REQ_MAX];
+    char hdr[256];
+
+    tv.tv_sec = 2;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    tv.tv_sec = 5;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    /* the request line is all that is needed */
+    while (len < (int)sizeof(b) - 1) {
+        n = read(fd, b + len, sizeof(b) - 1 - len);
+        if ((n < 0) && (EINTR == errno))
+            continue;
+        if (n <= 0)
+            return;
+        len += n;
+        b[len] = '\0';
+        if (strstr(b, "\r\n\r\n") || strstr(b, "\n\n"))
+            break;
+    }
+    b[len] = '\0';
+    pgp->len = 0;
+    pgp->oom = false;
+    if (0 != strncmp(b, "GET ", 4))
+        status = "405 Method Not Allowed";
+    else if ((0 != strncmp(b + 4, "/metrics", 8)) ||
+             ((' ' != b[12]) && ('?' != b[12])))
+        status = "404 Not Found";
+    else {
+        for (f = 0; f < SMPD_NUM_FAM; ++f) {
+            txt_add(pgp, "# HELP %s %s\n# TYPE %s %s\n", met_fams[f].name,
+                    met_fams[f].help, met_fams[f].name, met_fams[f].type);
+            for (k = 0; k < num_tgts; ++k) {
+                tp = tgts[k];
+                pthread_mutex_lock(&tp->mtx);
+                if (tp->met)
+                    txt_add(pgp, "%.*s", tp->met_off[f + 1] - tp->met_off[f],
+                            tp->met + tp->met_off[f]);
+                pthread_mutex_unlock(&tp->mtx);
+            }
+        }
+        txt_add(pgp, "# EOF\n");
+        if (pgp->oom)
+            status = "500 Internal Server Error";
+    }
+    if (strncmp(status, "200", 3)) {
+        pgp->len = 0;
+        pgp->oom = false;
+        txt_add(pgp, "%s\n", status);
+    }
+    n = snprintf(hdr, sizeof(hdr), "HTTP/1.0 %s\r\nContent-Type: %s\r\n"
+                 "Content-Length: %d\r\nConnection: close\r\n\r\n", status,
+                 strncmp(status, "200", 3) ? "text/plain" :
+                 "application/openmetrics-text; version=1.0.0; "
+                 "charset=utf-8", pgp->len);
+    if (0 == write_all(fd, hdr, n))
+        write_all(fd, pgp->b, pgp->len);
+}
+
+/* Serves scrapes one at a time until smpd is stopping */
+static void *
+metrics_worker(void * vp)
+{
+    int fd;
+    struct pollfd pfd;
+    struct smpd_txt pg;
+
+    if (vp) { ; }               /* suppress unused warning */
+    memset(&pg, 0, sizeof(pg));
+    while (! __atomic_load_n(&met_stop, __ATOMIC_ACQUIRE)) {
+        pfd.fd = met_lfd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 250) <= 0)
+            continue;
+        if ((fd = accept(met_lfd, NULL, NULL)) < 0)
+            continue;
+        http_answer(fd, &pg);
+        close(fd);
+        if (verbose > 1)
+            pr2serr("metrics: scrape of %d bytes\n", pg.len);
+    }
+    free(pg.b);
+    return NULL;
+}
+
+static int
+open_listen(const char * path)
+{
+    int fd;
+    struct sockaddr_un s_un;
+
+    memset(&s_un, 0, sizeof(s_un));
+    s_un.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(s_un.sun_path)) {
+        pr2serr("--socket: path too long\n");
+        return -1;
+    }
+    memcpy(s_un.sun_path, path, strlen(path));
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        pr2serr("--socket: socket: %s\n", safe_strerror(errno));
+        return -1;
+    }
+    unlink(path);
+    if ((bind(fd, (struct sockaddr *)&s_un, sizeof(s_un)) < 0) ||
+        (listen(fd, 16) < 0)) {
+        pr2serr("--socket: unable to listen on %s: %s\n", path,
+                safe_strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Creates the model file afresh (readers of an earlier one keep their
+ * mapping of it) and copies the records built at start up into it. */
+static int
+publish_model(const char * path)
+{
+    int fd, k;
+    size_t len = sizeof(struct smp_smpd_shm_hdr) +
+                 (num_tgts * sizeof(struct smp_smpd_shm_exp));
+    void * vp;
+    struct smp_smpd_shm_exp * ep;
+
+    unlink(path);
+    if ((fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0) {
+        pr2serr("--shm: unable to create %s: %s\n", path,
+                safe_strerror(errno));
+        return -1;
+    }
+    if (ftruncate(fd, len) < 0) {
+        pr2serr("--shm: ftruncate: %s\n", safe_strerror(errno));
+        close(fd);
+        return -1;
+    }
+    vp = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == vp) {
+        pr2serr("--shm: mmap: %s\n", safe_strerror(errno));
+        return -1;
+    }
+    shm_hdr = (struct smp_smpd_shm_hdr *)vp;
+    shm_hdr->version = SMP_SMPD_SHM_VERSION;
+    shm_hdr->num_exps = num_tgts;
+    shm_hdr->exp_len = sizeof(struct smp_smpd_shm_exp);
+    shm_hdr->pid = getpid();
+    shm_hdr->interval_ms = interval_ms;
+    ep = (struct smp_smpd_shm_exp *)(shm_hdr + 1);
+    for (k = 0; k < num_tgts; ++k, ++ep) {
+        memcpy(ep, &tgts[k]->boot, sizeof(*ep));
+        tgts[k]->shm = ep;
+    }
+    shm_hdr->active = 1;
+    __atomic_store_n(&shm_hdr->magic, SMP_SMPD_SHM_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static struct smpd_tgt *
+new_tgt(void)
+{
+    struct smpd_tgt * tp;
+    pthread_condattr_t ca;
+
+    if (num_tgts >= SMPD_MAX_TARGETS)
+        return NULL;
+    tp = (struct smpd_tgt *)calloc(1, sizeof(*tp));
+    if (NULL == tp) {
+        pr2serr("%s: heap allocation problem\n", __func__);
+        return NULL;
+    }
+    tp->idx = num_tgts;
+    tp->first_poll = true;
+    tp->shm = &tp->boot;
+    pthread_mutex_init(&tp->mtx, NULL);
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&tp->cv, &ca);
+    pthread_condattr_destroy(&ca);
+    return tp;
+}
+
+/* Opens the root target, then with --walk every expander reachable from
+ * it (as smp_topology does), each polled once so its model is ready. */
+static int
+open_tgts(const char * device_name, int subvalue, const char * i_params,
+          uint64_t sa, const struct opts_t * op)
+{
+    int k, j, n;
+    uint64_t asa;
+    struct smpd_tgt * tp;
+    const struct smp_discover_view * dvp;
+
+    if (NULL == (tp = new_tgt()))
+        return -1;
+    if (smp_initiator_open(device_name, subvalue, i_params, sa, &tp->tobj,
+                           verbose) < 0) {
+        free(tp);
+        return -1;
+    }
+    tgts[num_tgts++] = tp;
+    for (k = 0; k < num_tgts; ++k) {
+        tp = tgts[k];
+        tp->sa = sg_get_unaligned_be64(tp->tobj.sas_addr);
+        tp->have_dlist = (smp_discover_list_supported(&tp->tobj,
+                                                      verbose) > 0);
+        poll_exp(tp);
+        if ((0 == tp->sa) && (tp->num_phys > 0))
+            tp->sa = tp->dv[0].sas_addr;        /* from DISCOVER */
+        tp->boot.sas_addr = tp->sa;
+        snprintf(tp->boot.device_name, sizeof(tp->boot.device_name), "%s",
+                 tp->tobj.device_name);
+        if (! op->walk)
+            continue;
+        for (j = 0; j < tp->num_phys; ++j) {
+            dvp = tp->dv + j;
+            /* attached device type 2: expander, 3: fanout expander */
+            if (dvp->func_res || ((2 != dvp->att_dev_type) &&
+                                  (3 != dvp->att_dev_type)))
+                continue;
+            asa = dvp->att_sas_addr;
+            for (n = 0; n < num_tgts; ++n) {
+                if ((asa == tgts[n]->sa) ||
+                    (asa == sg_get_unaligned_be64(tgts[n]->tobj.sas_addr)))
+                    break;
+            }
+            if (n < num_tgts)
+                continue;
+            if (NULL == (tp = new_tgt())) {
+                pr2serr("more than %d expanders, ignoring the rest\n",
+                        SMPD_MAX_TARGETS);
+                return 0;
+            }
+#ifdef SMP_LIB_LINUX
+            if (0 == smp_initiator_open_by_sa(asa, i_params, &tp->tobj,
+                                              verbose))
+                goto opened;
+#endif
+            if (smp_initiator_open(device_name, subvalue, i_params, asa,
+                                   &tp->tobj, verbose) < 0) {
+                pr2serr("unable to open expander 0x%" PRIx64 "\n", asa);
+                free(tp);
+                tp = tgts[k];
+                continue;
+            }
+#ifdef SMP_LIB_LINUX
+opened:
+#endif
+            tgts[num_tgts++] = tp;
+            tp = tgts[k];
+        }
+    }
+    return 0;
+}
+
+static void
+print_stats(void)
+{
+    int k;
+    const struct smpd_tgt * tp;
+
+    for (k = 0; k < num_tgts; ++k) {
+        tp = tgts[k];
+        pr2serr("0x%" PRIx64 ": %" PRIu64 " client requests (%" PRIu64
+                " coalesced), %" PRIu64 " SMP requests, %" PRIu64 " polls, %"
+                PRIu64 " phys rediscovered\n", tp->sa, tp->num_client_reqs,
+                tp->num_coalesced, tp->num_sent, tp->num_polls,
+                tp->num_rediscovered);
+    }
+}
+
+static int
+serve(const struct opts_t * op)
+{
+    bool met_started = false;
+    int k, n, lfd;
+    int ret = 0;
+    struct smpd_op * sop;
+    struct smpd_tgt * tp;
+    pthread_t met_thr;
+    struct pollfd pfd[2 + SMPD_MAX_CLIENTS];
+    int pfd_cli[2 + SMPD_MAX_CLIENTS];
+    sigset_t blk, old_blk;
+    struct sigaction sa;
+
+    if ((lfd = open_listen(op->sock_path)) < 0)
+        return SMP_LIB_FILE_ERROR;
+    if (metrics_on && ((met_lfd = open_metrics(op->met_spec)) < 0)) {
+        close(lfd);
+        return SMP_LIB_FILE_ERROR;
+    }
+    if (pipe(done_pipe) < 0) {
+        pr2serr("pipe: %s\n", safe_strerror(errno));
+        close(lfd);
+        if (met_lfd >= 0)
+            close(met_lfd);
+        return SMP_LIB_RESOURCE_ERROR;
+    }
+    fcntl(done_pipe[0], F_SETFL, fcntl(done_pipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(done_pipe[1], F_SETFL, fcntl(done_pipe[1], F_GETFL) | O_NONBLOCK);
+    for (k = 0; k < SMPD_MAX_CLIENTS; ++k)
+        clients[k].fd = -1;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sig_handler;
+    sigemptyset(&sa.sa_mask);
+    got_signal = 0;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, NULL);
+
+    /* workers leave SIGINT and SIGTERM to this thread's poll() */
+    sigemptyset(&blk);
+    sigaddset(&blk, SIGINT);
+    sigaddset(&blk, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blk, &old_blk);
+    for (k = 0; k < num_tgts; ++k) {
+        if (pthread_create(&tgts[k]->thr, NULL, tgt_worker, tgts[k])) {
+            pr2serr("pthread_create: %s\n", safe_strerror(errno));
+            ret = SMP_LIB_RESOURCE_ERROR;
+            break;
+        }
+        tgts[k]->started = true;
+    }
+    if ((0 == ret) && metrics_on) {
+        if (pthread_create(&met_thr, NULL, metrics_worker, NULL)) {
+            pr2serr("pthread_create: %s\n", safe_strerror(errno));
+            ret = SMP_LIB_RESOURCE_ERROR;
+        } else
+            met_started = true;
+    }
+    pthread_sigmask(SIG_SETMASK, &old_blk, NULL);
+    if (0 == ret)
+        pr2serr("smpd: %d expander%s, model in %s, clients on %s%s%s\n",
+                num_tgts, (1 == num_tgts) ? "" : "s", op->shm_path,
+                op->sock_path, (metrics_on ? ", metrics on " : ""),
+                (metrics_on ? op->met_spec : ""));
+
+    while ((0 == ret) && (! got_signal)) {
+        pfd[0].fd = lfd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = done_pipe[0];
+        pfd[1].events = POLLIN;
+        for (n = 2, k = 0; k < SMPD_MAX_CLIENTS; ++k) {
+            if (clients[k].fd < 0)
+                continue;
+            pfd[n].fd = clients[k].fd;
+            pfd[n].events = POLLIN;
+            pfd_cli[n++] = k;
+        }
+        if (poll(pfd, n, -1) < 0) {
+            if (EINTR == errno)
+                continue;
+            pr2serr("poll: %s\n", safe_strerror(errno));
+            ret = SMP_LIB_CAT_OTHER;
+            break;
+        }
+        if (pfd[1].revents)
+            answer_done();
+        for (k = 2; k < n; ++k) {
+            if (pfd[k].revents)
+                client_read(pfd_cli[k]);
+        }
+        if (pfd[0].revents)
+            client_accept(lfd);
+    }
+    if (met_started) {
+        __atomic_store_n(&met_stop, true, __ATOMIC_RELEASE);
+        pthread_join(met_thr, NULL);
+    }
+    if (met_lfd >= 0)
+        close(met_lfd);
+    for (k = 0; k < num_tgts; ++k) {
+        tp = tgts[k];
+        pthread_mutex_lock(&tp->mtx);
+        tp->stop = true;
+        pthread_cond_signal(&tp->cv);
+        pthread_mutex_unlock(&tp->mtx);
+    }
+    for (k = 0; k < num_tgts; ++k) {
+        if (tgts[k]->started)
+            pthread_join(tgts[k]->thr, NULL);
+        while ((sop = tgts[k]->q_head)) {
+            tgts[k]->q_head = sop->next;
+            free(sop->w);
+            free(sop);
+        }
+    }
+    answer_done();
+    for (k = 0; k < SMPD_MAX_CLIENTS; ++k)
+        drop_client(k);
+    close(lfd);
+    unlink(op->sock_path);
+    close(done_pipe[0]);
+    close(done_pipe[1]);
+    if (got_signal && verbose)
+        pr2serr("smpd: exiting on signal %d\n", (int)got_signal);
+    return ret;
+}
+
+static const char * att_dev_type_name[] = {
+    "none", "end device", "expander", "fanout", "reserved", "reserved",
+    "reserved", "reserved",
+};
+
+/* Output the model a running smpd publishes, found by mapping it */
+static int
+dump_model(const char * path)
+{
+    int k, j, len;
+    uint64_t now = smp_stats_clock_us();
+    const struct smp_smpd_shm_hdr * hp;
+    struct smp_smpd_shm_exp * ep;
+    struct smp_discover_view dv;
+    uint8_t resp[SMP_SMPD_DISC_LEN];
+
+    if (NULL == (hp = smp_smpd_map(path, 1)))
+        return SMP_LIB_FILE_ERROR;
+    ep = (struct smp_smpd_shm_exp *)malloc(sizeof(*ep));
+    if (NULL == ep) {
+        smp_smpd_unmap(hp);
+        return SMP_LIB_RESOURCE_ERROR;
+    }
+    printf("smpd pid %u%s, generation %" PRIu64 ", %u expander%s\n",
+           hp->pid, hp->active ? "" : " (exited)",
+           __atomic_load_n(&hp->gen, __ATOMIC_ACQUIRE), hp->num_exps,
+           (1 == hp->num_exps) ? "" : "s");
+    for (k = 0; k < (int)hp->num_exps; ++k) {
+        if (smp_smpd_read_exp(hp, k, ep)) {
+            printf("  expander %d: not published\n", k);
+            continue;
+        }
+        printf("  expander 0x%" PRIx64 " (%s): %u phys, change count %d, "
+               "updated %" PRIu64 " ms ago\n", ep->sas_addr, ep->device_name,
+               ep->num_phys, sg_get_unaligned_be16(ep->rg_resp + 4),
+               (now > ep->update_us) ? (now - ep->update_us) / 1000 : 0);
+        if (ep->status)
+            printf("    last poll failed [%d]\n", ep->status);
+        for (j = 0; j < (int)ep->num_phys; ++j) {
+            len = smp_smpd_read_phy(hp, k, j, resp, sizeof(resp));
+            if (len <= 0)
+                continue;
+            memset(&dv, 0, sizeof(dv));
+            if (smp_decode_discover(resp, len - 4, 0, &dv)) {
+                printf("    phy %3d: function result 0x%x\n", j, resp[2]);
+                continue;
+            }
+            if (0 == dv.att_dev_type)
+                continue;
+            printf("    phy %3d: %s 0x%" PRIx64 ", phy change count %d%s\n",
+                   j, att_dev_type_name[dv.att_dev_type & 0x7],
+                   dv.att_sas_addr, dv.phy_change_count,
+                   (1 == dv.neg_log_lrate) ? " (disabled)" : "");
+        }
+    }
+    free(ep);
+    smp_smpd_unmap(hp);
+    return 0;
+}
+
+
+#ifdef SMP_UTILS_MULTI
+int
+smpd_main(int argc, char * argv[])
+#else
+int
+main(int argc, char * argv[])
+#endif
+{
+    bool do_dump = false;
+    int res, c, k, j;
+    int ret = 0;
+    int subvalue = 0;
+    int64_t sa_ll;
+    uint64_t sa = 0;
+    char * cp;
+    char i_params[256];
+    char device_name[512];
+    struct opts_t opts;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.shm_path = SMP_SMPD_SHM;
+    opts.sock_path = SMP_SMPD_SOCKET;
+    memset(device_name, 0, sizeof device_name);
+    memset(i_params, 0, sizeof i_params);
+    while (1) {
+        int option_index = 0;
+
+        c = getopt_long(argc, argv, "c:dhi:I:m:M:s:S:vVW", long_options,
+                        &option_index);
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 'c':
+            counters_ms = smp_get_num(optarg);
+            if (counters_ms < 1) {
+                pr2serr("bad argument to '--counters', expect milliseconds "
+                        "(1 or more)\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'd':
+            do_dump = true;
+            break;
+        case 'h':
+        case '?':
+            usage();
+            return 0;
+        case 'i':
+            interval_ms = smp_get_num(optarg);
+            if (interval_ms < 1) {
+                pr2serr("bad argument to '--interval', expect milliseconds "
+                        "(1 or more)\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            break;
+        case 'I':
+            strncpy(i_params, optarg, sizeof(i_params));
+            i_params[sizeof(i_params) - 1] = '\0';
+            break;
+        case 'm':
+            opts.shm_path = optarg;
+            break;
+        case 'M':
+            opts.met_spec = optarg;
+            metrics_on = true;
+            break;
+        case 's':
+           sa_ll = smp_get_llnum_nomult(optarg);
+           if (-1LL == sa_ll) {
+                pr2serr("bad argument to '--sa'\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+            sa = (uint64_t)sa_ll;
+            break;
+        case 'S':
+            opts.sock_path = optarg;
+            break;
+        case 'v':
+            ++verbose;
+            break;
+        case 'V':
+            pr2serr("version: %s\n", version_str);
+            return 0;
+        case 'W':
+            opts.walk = true;
+            break;
+        default:
+            pr2serr("unrecognised switch code 0x%x ??\n", c);
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (optind < argc) {
+        if ('\0' == device_name[0]) {
+            strncpy(device_name, argv[optind], sizeof(device_name) - 1);
+            device_name[sizeof(device_name) - 1] = '\0';
+            ++optind;
+        }
+        if (optind < argc) {
+            for (; optind < argc; ++optind)
+                pr2serr("Unexpected extra argument: %s\n", argv[optind]);
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (do_dump)
+        return dump_model(opts.shm_path);
+    if (0 == strncmp("smpd", i_params, 4)) {
+        pr2serr("smpd can't be a client of itself\n");
+        return SMP_LIB_SYNTAX_ERROR;
+    }
+    if (0 == device_name[0]) {
+        cp = getenv("SMP_UTILS_DEVICE");
+        if (cp)
+            strncpy(device_name, cp, sizeof(device_name) - 1);
+        else if ((0 == sa) && (NULL == getenv("SMP_UTILS_SAS_ADDR"))) {
+            pr2serr("missing device name on command line\n    [Could use "
+                    "environment variable SMP_UTILS_DEVICE instead, or "
+                    "in Linux\n    --sa=SAS_ADDR alone]\n\n");
+            usage();
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if ((cp = strchr(device_name, SMP_SUBVALUE_SEPARATOR))) {
+        *cp = '\0';
+        if (1 != sscanf(cp + 1, "%d", &subvalue)) {
+            pr2serr("expected number after separator in SMP_DEVICE name\n");
+            return SMP_LIB_SYNTAX_ERROR;
+        }
+    }
+    if (0 == sa) {
+        cp = getenv("SMP_UTILS_SAS_ADDR");
+        if (cp) {
+           sa_ll = smp_get_llnum_nomult(cp);
+           if (-1LL == sa_ll) {
+                pr2serr("bad value in environment variable "
+                        "SMP_UTILS_SAS_ADDR\n");
+                pr2serr("    use 0\n");
+                sa_ll = 0;
+            }
+            sa = (uint64_t)sa_ll;
+        }
+    }
+    if (sa > 0) {
+        if (! smp_is_naa5(sa)) {
+            pr2serr("SAS (target) address not in naa-5 format (may need "
+                    "leading '0x')\n");
+            if ('\0' == i_params[0]) {
+                pr2serr("    use '--interface=' to override\n");
+                return SMP_LIB_SYNTAX_ERROR;
+            }
+        }
+    }
+
+    for (k = 0; k < (SMP_STATS_HIST_LEN - 1); ++k)
+        snprintf(le_str[k], sizeof(le_str[k]), "%.6f",
+                 (double)(2 << k) / 1000000.0);
+    res = open_tgts(device_name, subvalue, i_params, sa, &opts);
+    if (res || (0 == num_tgts)) {
+        ret = SMP_LIB_FILE_ERROR;
+        goto fini;
+    }
+    if (publish_model(opts.shm_path)) {
+        ret = SMP_LIB_FILE_ERROR;
+        goto fini;
+    }
+    ret = serve(&opts);
+    if (verbose)
+        print_stats();
+    shm_hdr->active = 0;
+    __atomic_add_fetch(&shm_hdr->gen, 1, __ATOMIC_RELEASE);
+    unlink(opts.shm_path);
+fini:
+    for (k = 0; k < num_tgts; ++k) {
+        if (smp_initiator_close(&tgts[k]->tobj) < 0)
+            pr2serr("close error: %s\n", safe_strerror(errno));
+        pthread_cond_destroy(&tgts[k]->cv);
+        pthread_mutex_destroy(&tgts[k]->mtx);
+        for (j = 0; j < SMP_STATS_NUM_FUNCS; ++j)
+            free(tgts[k]->fn_lbl[j]);
+        free(tgts[k]->met);
+        free(tgts[k]);
+    }
+    if (ret < 0)
+        ret = SMP_LIB_CAT_OTHER;
+    if (verbose && ret)
+        pr2serr("Exit status %d indicates error detected\n", ret);
+    return ret;
+}